@@ -3,9 +3,11 @@ SET(LIBNFC_DRIVER_ACR122_USB ON CACHE BOOL "Enable ACR122 support (Direct USB co
 SET(LIBNFC_DRIVER_ACR122S ON CACHE BOOL "Enable ACR122S support (Use serial port)")
 SET(LIBNFC_DRIVER_ARYGON ON CACHE BOOL "Enable ARYGON support (Use serial port)")
 IF(WIN32)
+  SET(LIBNFC_DRIVER_BROKER OFF CACHE BOOL "Enable nfcd broker support (Use Unix socket)")
   SET(LIBNFC_DRIVER_PN532_I2C OFF CACHE BOOL "Enable PN532 I2C support (Use I2C bus)")
   SET(LIBNFC_DRIVER_PN532_SPI OFF CACHE BOOL "Enable PN532 SPI support (Use SPI bus)")
 ELSE(WIN32)
+  SET(LIBNFC_DRIVER_BROKER ON CACHE BOOL "Enable nfcd broker support (Use Unix socket)")
   SET(LIBNFC_DRIVER_PN532_I2C ON CACHE BOOL "Enable PN532 I2C support (Use I2C bus)")
   SET(LIBNFC_DRIVER_PN532_SPI ON CACHE BOOL "Enable PN532 SPI support (Use SPI bus)")
 ENDIF(WIN32)
@@ -36,6 +38,11 @@ IF(LIBNFC_DRIVER_ARYGON)
   SET(UART_REQUIRED TRUE)
 ENDIF(LIBNFC_DRIVER_ARYGON)
 
+IF(LIBNFC_DRIVER_BROKER)
+  ADD_DEFINITIONS("-DDRIVER_BROKER_ENABLED")
+  SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/broker")
+ENDIF(LIBNFC_DRIVER_BROKER)
+
 IF(LIBNFC_DRIVER_PN532_I2C)
   ADD_DEFINITIONS("-DDRIVER_PN532_I2C_ENABLED")
   SET(DRIVERS_SOURCES ${DRIVERS_SOURCES} "drivers/pn532_i2c")
@@ -0,0 +1,265 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file pthread.h
+ * @brief This file intended to serve as a drop-in replacement for pthread.h on Windows
+ *
+ * Only the subset used by libnfc is provided, on top of slim reader/writer
+ * locks, condition variables, one-time initialization and TLS (Windows Vista
+ * or later). Recursive mutexes track their owner thread; thread-specific
+ * data destructors are not run.
+ */
+
+#ifndef _PTHREAD_H_
+#define _PTHREAD_H_
+
+#include "contrib/windows.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PTHREAD_MUTEX_NORMAL    0
+#define PTHREAD_MUTEX_RECURSIVE 1
+
+typedef struct {
+  int type;
+} pthread_mutexattr_t;
+
+typedef struct {
+  SRWLOCK lock;
+  volatile DWORD owner;
+  unsigned int count;
+  int type;
+} pthread_mutex_t;
+
+#define PTHREAD_MUTEX_INITIALIZER { SRWLOCK_INIT, 0, 0, PTHREAD_MUTEX_NORMAL }
+
+typedef CONDITION_VARIABLE pthread_cond_t;
+typedef void pthread_condattr_t;
+typedef INIT_ONCE pthread_once_t;
+#define PTHREAD_ONCE_INIT INIT_ONCE_STATIC_INIT
+typedef DWORD pthread_key_t;
+typedef HANDLE pthread_t;
+typedef void pthread_attr_t;
+
+static inline int
+pthread_mutexattr_init(pthread_mutexattr_t *attr)
+{
+  attr->type = PTHREAD_MUTEX_NORMAL;
+  return 0;
+}
+
+static inline int
+pthread_mutexattr_settype(pthread_mutexattr_t *attr, int type)
+{
+  attr->type = type;
+  return 0;
+}
+
+static inline int
+pthread_mutexattr_destroy(pthread_mutexattr_t *attr)
+{
+  (void) attr;
+  return 0;
+}
+
+static inline int
+pthread_mutex_init(pthread_mutex_t *mutex, const pthread_mutexattr_t *attr)
+{
+  InitializeSRWLock(&mutex->lock);
+  mutex->owner = 0;
+  mutex->count = 0;
+  mutex->type = attr ? attr->type : PTHREAD_MUTEX_NORMAL;
+  return 0;
+}
+
+static inline int
+pthread_mutex_destroy(pthread_mutex_t *mutex)
+{
+  (void) mutex;
+  return 0;
+}
+
+static inline int
+pthread_mutex_lock(pthread_mutex_t *mutex)
+{
+  // Only the owner thread can find its own id there
+  if ((mutex->type == PTHREAD_MUTEX_RECURSIVE) && (mutex->owner == GetCurrentThreadId())) {
+    mutex->count++;
+    return 0;
+  }
+  AcquireSRWLockExclusive(&mutex->lock);
+  mutex->owner = GetCurrentThreadId();
+  mutex->count = 1;
+  return 0;
+}
+
+static inline int
+pthread_mutex_unlock(pthread_mutex_t *mutex)
+{
+  if (--mutex->count == 0) {
+    mutex->owner = 0;
+    ReleaseSRWLockExclusive(&mutex->lock);
+  }
+  return 0;
+}
+
+static inline int
+pthread_cond_init(pthread_cond_t *cond, const pthread_condattr_t *attr)
+{
+  (void) attr;
+  InitializeConditionVariable(cond);
+  return 0;
+}
+
+static inline int
+pthread_cond_destroy(pthread_cond_t *cond)
+{
+  (void) cond;
+  return 0;
+}
+
+static inline int
+pthread_cond_timedwait_ms(pthread_cond_t *cond, pthread_mutex_t *mutex, DWORD ms)
+{
+  const unsigned int count = mutex->count;
+  mutex->owner = 0;
+  mutex->count = 0;
+  const BOOL res = SleepConditionVariableSRW(cond, &mutex->lock, ms, 0);
+  mutex->owner = GetCurrentThreadId();
+  mutex->count = count;
+  return res ? 0 : ETIMEDOUT;
+}
+
+static inline int
+pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex)
+{
+  return pthread_cond_timedwait_ms(cond, mutex, INFINITE);
+}
+
+static inline int
+pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime)
+{
+  // Deadlines are computed from the wall clock, like gettimeofday()
+  FILETIME ft;
+  GetSystemTimeAsFileTime(&ft);
+  const long long now_ms = ((((long long) ft.dwHighDateTime) << 32 | ft.dwLowDateTime) - 116444736000000000LL) / 10000;
+  const long long deadline_ms = (long long) abstime->tv_sec * 1000 + abstime->tv_nsec / 1000000;
+  return pthread_cond_timedwait_ms(cond, mutex, (deadline_ms > now_ms) ? (DWORD)(deadline_ms - now_ms) : 0);
+}
+
+static inline int
+pthread_cond_signal(pthread_cond_t *cond)
+{
+  WakeConditionVariable(cond);
+  return 0;
+}
+
+static inline int
+pthread_cond_broadcast(pthread_cond_t *cond)
+{
+  WakeAllConditionVariable(cond);
+  return 0;
+}
+
+static inline BOOL CALLBACK
+pthread_once_callback(PINIT_ONCE once, PVOID param, PVOID *context)
+{
+  (void) once;
+  (void) context;
+  (*(void (**)(void)) param)();
+  return TRUE;
+}
+
+static inline int
+pthread_once(pthread_once_t *once, void (*init_routine)(void))
+{
+  return InitOnceExecuteOnce(once, pthread_once_callback, &init_routine, NULL) ? 0 : EINVAL;
+}
+
+static inline int
+pthread_key_create(pthread_key_t *key, void (*destructor)(void *))
+{
+  (void) destructor;
+  *key = TlsAlloc();
+  return (*key == TLS_OUT_OF_INDEXES) ? EAGAIN : 0;
+}
+
+static inline void *
+pthread_getspecific(pthread_key_t key)
+{
+  return TlsGetValue(key);
+}
+
+static inline int
+pthread_setspecific(pthread_key_t key, const void *value)
+{
+  return TlsSetValue(key, (LPVOID) value) ? 0 : EINVAL;
+}
+
+struct pthread_start {
+  void *(*start_routine)(void *);
+  void *arg;
+};
+
+static inline DWORD WINAPI
+pthread_start_routine(LPVOID param)
+{
+  struct pthread_start start = *(struct pthread_start *) param;
+  free(param);
+  start.start_routine(start.arg);
+  return 0;
+}
+
+static inline int
+pthread_create(pthread_t *thread, const pthread_attr_t *attr, void *(*start_routine)(void *), void *arg)
+{
+  (void) attr;
+  struct pthread_start *start = malloc(sizeof(*start));
+  if (!start)
+    return EAGAIN;
+  start->start_routine = start_routine;
+  start->arg = arg;
+  if ((*thread = CreateThread(NULL, 0, pthread_start_routine, start, 0, NULL)) == NULL) {
+    free(start);
+    return EAGAIN;
+  }
+  return 0;
+}
+
+static inline int
+pthread_join(pthread_t thread, void **retval)
+{
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+  if (retval)
+    *retval = NULL;
+  return 0;
+}
+
+#endif /* _PTHREAD_H_ */
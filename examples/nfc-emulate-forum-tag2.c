@@ -38,7 +38,8 @@
  * @file nfc-emulate-forum-tag2.c
  * @brief Emulates a NFC-Forum Tag Type 2 with a NDEF message
  * This example allow to emulate an NFC-Forum Tag Type 2 that contains
- * a read-only NDEF message.
+ * a read-only NDEF message. Given an image file, the tag memory is mapped
+ * from it and becomes writable: WRITE commands are applied to the file.
  *
  * This example has been developed using PN533 USB hardware as target and
  * Google Nexus S phone as initiator.
@@ -74,6 +75,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <nfc/nfc.h>
 #include <nfc/nfc-emulation.h>
@@ -82,6 +84,7 @@
 
 static nfc_device *pnd;
 static nfc_context *context;
+static struct nfc_emulation_storage storage = { .data = NULL, .fd = -1 };
 
 static void
 stop_emulation(int sig)
@@ -122,49 +125,76 @@ static uint8_t __nfcforum_tag2_memory_area[] = {
 #define SECTOR_SELECT 	0xC2
 
 #define HALT 		0x50
+
+#define ACK 		0x0A
+#define NAK 		0x00
+#define NAK_WRITE 	0x05
+
 static int
-nfcforum_tag2_io(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+nfcforum_tag2_read(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
 {
-  int res = 0;
-
   uint8_t *nfcforum_tag2_memory_area = (uint8_t *)(emulator->user_data);
 
-  printf("    In: ");
-  print_hex(data_in, data_in_len);
-
-  switch (data_in[0]) {
-    case READ:
-      if (data_out_len >= 16) {
-        memcpy(data_out, nfcforum_tag2_memory_area + (data_in[1] * 4), 16);
-        res = 16;
-      } else {
-        res = -ENOSPC;
-      }
-      break;
-    case HALT:
-      printf("HALT sent\n");
-      res = -ECONNABORTED;
-      break;
-    default:
-      printf("Unknown command: 0x%02x\n", data_in[0]);
-      res = -ENOTSUP;
-  }
+  if (data_in_len < 2)
+    return -ENOTSUP;
+  if (data_out_len < 16)
+    return -ENOSPC;
+  // Reading past the last block rolls over to block 0
+  for (size_t n = 0; n < 16; n++)
+    data_out[n] = nfcforum_tag2_memory_area[(data_in[1] * 4 + n) % sizeof(__nfcforum_tag2_memory_area)];
+  return 16;
+}
 
-  if (res < 0) {
-    ERR("%s (%d)", strerror(-res), -res);
-  } else {
-    printf("    Out: ");
-    print_hex(data_out, res);
-  }
+// ACK and NAK are 4-bit frames without CRC: sent here, the emulator only listens for the next command
+static int
+nfcforum_tag2_ack(const uint8_t btAck)
+{
+  if ((nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, false) < 0) ||
+      (nfc_target_send_bits(pnd, &btAck, 4, NULL) < 0) ||
+      (nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true) < 0))
+    return -EIO;
+  return 0;
+}
+
+static int
+nfcforum_tag2_write(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+{
+  const uint8_t *nfcforum_tag2_memory_area = (uint8_t *)(emulator->user_data);
+  const size_t page = data_in[1];
+  uint8_t abtPage[4];
 
-  return res;
+  (void) data_out;
+  (void) data_out_len;
+  if (data_in_len < 6)
+    return -ENOTSUP;
+  // UID and static lock pages are read-only, the CC is one-time programmable, the data area follows its write access
+  if ((page < 3) || (page >= sizeof(__nfcforum_tag2_memory_area) / 4) || (nfcforum_tag2_memory_area[15] & 0x0F))
+    return nfcforum_tag2_ack(NAK);
+  for (size_t n = 0; n < 4; n++)
+    abtPage[n] = data_in[2 + n] | ((page == 3) ? nfcforum_tag2_memory_area[12 + n] : 0x00);
+  if (nfc_emulation_storage_write(&storage, page * 4, abtPage, sizeof(abtPage)) < 0)
+    return nfcforum_tag2_ack(NAK_WRITE);
+  return nfcforum_tag2_ack(ACK);
+}
+
+static int
+nfcforum_tag2_halt(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+{
+  (void) emulator;
+  (void) data_in;
+  (void) data_in_len;
+  (void) data_out;
+  (void) data_out_len;
+  return -ECONNABORTED;
 }
 
 int
 main(int argc, char *argv[])
 {
-  (void)argc;
-  (void)argv;
+  if (argc > 2) {
+    printf("usage: %s [image]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
 
   nfc_target nt = {
     .nm = {
@@ -182,14 +212,47 @@ main(int argc, char *argv[])
     }
   };
 
+  struct nfc_emulation_dispatcher dispatcher;
+  const uint8_t read_command[] = { READ };
+  const uint8_t write_command[] = { WRITE };
+  const uint8_t halt_command[] = { HALT };
+  uint8_t *memory_area = __nfcforum_tag2_memory_area;
+
+  nfc_emulation_dispatcher_init(&dispatcher);
+  if (argc == 2) {
+    // A new image starts from the built-in one, unlocked and read-write
+    uint8_t initial[sizeof(__nfcforum_tag2_memory_area)];
+    memcpy(initial, __nfcforum_tag2_memory_area, sizeof(initial));
+    initial[10] = initial[11] = 0x00;
+    initial[15] = 0x00;
+    if (nfc_emulation_storage_open(&storage, argv[1], initial, sizeof(initial), 1) < 0) {
+      ERR("Unable to map %s", argv[1]);
+      exit(EXIT_FAILURE);
+    }
+    memory_area = storage.data;
+    if (nfc_emulation_dispatcher_add_command(&dispatcher, write_command, sizeof(write_command), nfcforum_tag2_write) < 0) {
+      ERR("Unable to build the emulator");
+      nfc_emulation_storage_close(&storage);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if ((nfc_emulation_dispatcher_add_command(&dispatcher, read_command, sizeof(read_command), nfcforum_tag2_read) < 0) ||
+      (nfc_emulation_dispatcher_add_command(&dispatcher, halt_command, sizeof(halt_command), nfcforum_tag2_halt) < 0) ||
+      (nfc_emulation_dispatcher_build(&dispatcher) < 0)) {
+    ERR("Unable to build the emulator");
+    nfc_emulation_storage_close(&storage);
+    exit(EXIT_FAILURE);
+  }
+
   struct nfc_emulation_state_machine state_machine = {
-    .io = nfcforum_tag2_io
+    .io = nfc_emulation_dispatch,
+    .data = &dispatcher,
   };
 
   struct nfc_emulator emulator = {
     .target = &nt,
     .state_machine = &state_machine,
-    .user_data = __nfcforum_tag2_memory_area,
+    .user_data = memory_area,
   };
 
   signal(SIGINT, stop_emulation);
@@ -210,13 +273,19 @@ main(int argc, char *argv[])
   printf("NFC device: %s opened\n", nfc_device_get_name(pnd));
   printf("Emulating NDEF tag now, please touch it with a second NFC device\n");
 
-  if (nfc_emulate_target(pnd, &emulator, 0) < 0) {
+  int res = nfc_emulate_target(pnd, &emulator, 0);
+  print_emulation_report(&dispatcher);
+  if (res == -ECONNABORTED) {
+    printf("HALT sent\n");
+  } else if (res < 0) {
     nfc_perror(pnd, argv[0]);
+    nfc_emulation_storage_close(&storage);
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
 
+  nfc_emulation_storage_close(&storage);
   nfc_close(pnd);
   nfc_exit(context);
   exit(EXIT_SUCCESS);
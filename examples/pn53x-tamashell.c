@@ -54,39 +54,103 @@
 #include <ctype.h>
 #include <time.h>
 
-#ifndef _WIN32
-#  include <time.h>
-#  define msleep(x) do { \
-    struct timespec xsleep; \
-    xsleep.tv_sec = x / 1000; \
-    xsleep.tv_nsec = (x - xsleep.tv_sec * 1000) * 1000 * 1000; \
-    nanosleep(&xsleep, NULL); \
-  } while (0)
-#else
-#  include <winbase.h>
-#  define msleep Sleep
-#endif
-
-
 #include <nfc/nfc.h>
 
 #include "utils/nfc-utils.h"
 #include "libnfc/chips/pn53x.h"
+#include "libnfc/chips/pn53x-script.h"
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-v] [script]\n", progname);
+  printf("  -v      print every command and its response while running a script\n");
+  printf("  script  compile and run the script file, then print per-command timings\n");
+}
+
+static void
+print_step(unsigned int line, const uint8_t *pbtTx, const size_t szTx, const uint8_t *pbtRx, const int res, void *data)
+{
+  (void) line;
+  if (pbtTx == NULL) {
+    printf("Pause for %i msecs\n", res);
+    return;
+  }
+  printf("Tx: ");
+  print_hex(pbtTx, szTx);
+  if (res < 0) {
+    nfc_perror((nfc_device *) data, "Rx");
+    return;
+  }
+  printf("Rx: ");
+  print_hex(pbtRx, (size_t) res);
+}
 
-#define MAX_FRAME_LEN 264
+static void
+print_report(const pn53x_script *script)
+{
+  struct pn53x_script_step_stats stats;
+  uint64_t total_us = 0;
+  size_t szRuns = 0;
+
+  printf("%6s %8s %8s %10s %10s %10s\n", "Line", "Runs", "Failed", "Min (us)", "Avg (us)", "Max (us)");
+  for (size_t n = 0; n < pn53x_script_step_count(script); n++) {
+    pn53x_script_get_step_stats(script, n, &stats);
+    if (stats.runs == 0)
+      continue;
+    printf("%6u %8lu %8lu %10lu %10lu %10lu\n", stats.line, (unsigned long) stats.runs, (unsigned long) stats.failures,
+           (unsigned long) stats.min_us, (unsigned long)(stats.total_us / stats.runs), (unsigned long) stats.max_us);
+    total_us += stats.total_us;
+    szRuns += stats.runs;
+  }
+  printf("%lu commands in %lu.%03lu ms\n", (unsigned long) szRuns, (unsigned long)(total_us / 1000), (unsigned long)(total_us % 1000));
+}
+
+// Lines are buffered while a loop block is open so that it is compiled as a whole
+static int
+block_depth(const char *cmd, int depth)
+{
+  while (isspace((unsigned char) *cmd))
+    cmd++;
+  if (!strncmp(cmd, "loop", 4) && (!cmd[4] || isspace((unsigned char) cmd[4])))
+    return depth + 1;
+  if (!strncmp(cmd, "next", 4) && (!cmd[4] || isspace((unsigned char) cmd[4])) && (depth > 0))
+    return depth - 1;
+  return depth;
+}
 
 int main(int argc, const char *argv[])
 {
   nfc_device *pnd;
-  uint8_t abtRx[MAX_FRAME_LEN];
-  uint8_t abtTx[MAX_FRAME_LEN];
-  size_t szRx = sizeof(abtRx);
-  size_t szTx;
   FILE *input = NULL;
+  pn53x_script *script = NULL;
+  bool verbose = false;
+  int res;
 
-  if (argc >= 2) {
-    if ((input = fopen(argv[1], "r")) == NULL) {
-      ERR("%s", "Cannot open file.");
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-v")) {
+      verbose = true;
+    } else if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else if (input == NULL) {
+      if ((input = fopen(argv[arg], "r")) == NULL) {
+        ERR("%s", "Cannot open file.");
+        exit(EXIT_FAILURE);
+      }
+    } else {
+      print_usage(argv[0]);
+      fclose(input);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (input != NULL) {
+    unsigned int line;
+    script = pn53x_script_compile_file(input, &line);
+    fclose(input);
+    if (script == NULL) {
+      ERR("Cannot compile script (line %u).", line);
       exit(EXIT_FAILURE);
     }
   }
@@ -95,6 +159,7 @@ int main(int argc, const char *argv[])
   nfc_init(&context);
   if (context == NULL) {
     ERR("Unable to init libnfc (malloc)");
+    pn53x_script_free(script);
     exit(EXIT_FAILURE);
   }
 
@@ -103,9 +168,7 @@ int main(int argc, const char *argv[])
 
   if (pnd == NULL) {
     ERR("%s", "Unable to open NFC device.");
-    if (input != NULL) {
-      fclose(input);
-    }
+    pn53x_script_free(script);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
@@ -113,111 +176,92 @@ int main(int argc, const char *argv[])
   printf("NFC reader: %s opened\n", nfc_device_get_name(pnd));
   if (nfc_initiator_init(pnd) < 0) {
     nfc_perror(pnd, "nfc_initiator_init");
-    if (input != NULL) {
-      fclose(input);
-    }
+    pn53x_script_free(script);
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
 
-  const char *prompt = "> ";
+  if (script != NULL) {
+    res = pn53x_script_run(pnd, script, verbose ? print_step : NULL, pnd);
+    if (res == NFC_ESOFT) {
+      printf("Unexpected response at line %u\n", pn53x_script_error_line(script));
+    } else if (res < 0) {
+      printf("Command at line %u failed: %s\n", pn53x_script_error_line(script), nfc_strerror(pnd));
+    }
+    print_report(script);
+    pn53x_script_free(script);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit((res < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  char *block = NULL;
+  size_t szBlock = 0;
+  int depth = 0;
   while (1) {
-    int offset = 0;
+    const char *prompt = (depth > 0) ? ". " : "> ";
     char *cmd;
 #if defined(HAVE_READLINE)
-    if (input == NULL) { // means we use stdin
-      cmd = readline(prompt);
-      // NULL if ctrl-d
-      if (cmd == NULL) {
-        printf("Bye!\n");
-        break;
-      }
-      add_history(cmd);
-    } else {
-#endif //HAVE_READLINE
-      size_t n = 512;
-      char *ret = NULL;
-      cmd = malloc(n);
-      printf("%s", prompt);
-      fflush(0);
-      if (input != NULL) {
-        ret = fgets(cmd, n, input);
-      } else {
-        ret = fgets(cmd, n, stdin);
-      }
-      if (ret == NULL || strlen(cmd) <= 0) {
-        printf("Bye!\n");
-        free(cmd);
-        break;
-      }
-      // FIXME print only if read from redirected stdin (i.e. script)
-      printf("%s", cmd);
-#if defined(HAVE_READLINE)
+    cmd = readline(prompt);
+    // NULL if ctrl-d
+    if (cmd == NULL) {
+      printf("Bye!\n");
+      break;
     }
-#endif //HAVE_READLINE
-    if (cmd[0] == 'q') {
+    add_history(cmd);
+#else
+    size_t n = 512;
+    char *ret = NULL;
+    cmd = malloc(n);
+    printf("%s", prompt);
+    fflush(0);
+    ret = fgets(cmd, n, stdin);
+    if (ret == NULL || strlen(cmd) <= 0) {
       printf("Bye!\n");
       free(cmd);
       break;
     }
-    if (cmd[0] == 'p') {
-      int ms = 0;
-      offset++;
-      while (isspace(cmd[offset])) {
-        offset++;
-      }
-      sscanf(cmd + offset, "%10d", &ms);
-      printf("Pause for %i msecs\n", ms);
-      if (ms > 0) {
-        msleep(ms);
-      }
+    // FIXME print only if read from redirected stdin (i.e. script)
+    printf("%s", cmd);
+#endif //HAVE_READLINE
+    if (cmd[0] == 'q') {
+      printf("Bye!\n");
       free(cmd);
-      continue;
-    }
-    szTx = 0;
-    for (int i = 0; i < MAX_FRAME_LEN; i++) {
-      int size;
-      unsigned int byte;
-      while (isspace(cmd[offset])) {
-        offset++;
-      }
-      size = sscanf(cmd + offset, "%2x", &byte);
-      if (size < 1) {
-        break;
-      }
-      abtTx[i] = byte;
-      szTx++;
-      if (cmd[offset + 1] == 0) { // if last hex was only 1 symbol
-        break;
-      }
-      offset += 2;
+      break;
     }
 
-    if ((int)szTx < 1) {
+    size_t szCmd = strlen(cmd);
+    char *p = realloc(block, szBlock + szCmd + 2);
+    if (p == NULL) {
       free(cmd);
+      break;
+    }
+    block = p;
+    memcpy(block + szBlock, cmd, szCmd);
+    szBlock += szCmd;
+    block[szBlock++] = '\n';
+    block[szBlock] = '\0';
+    depth = block_depth(cmd, depth);
+    free(cmd);
+    if (depth > 0) {
       continue;
     }
-    printf("Tx: ");
-    print_hex(abtTx, szTx);
 
-    szRx = sizeof(abtRx);
-    int res = 0;
-    if ((res = pn53x_transceive(pnd, abtTx, szTx, abtRx, szRx, 0)) < 0) {
-      free(cmd);
-      nfc_perror(pnd, "Rx");
+    unsigned int line;
+    script = pn53x_script_compile(block, &line);
+    szBlock = 0;
+    if (script == NULL) {
+      printf("Syntax error\n");
       continue;
     }
-    szRx = (size_t) res;
-
-    printf("Rx: ");
-    print_hex(abtRx, szRx);
-    free(cmd);
+    if (pn53x_script_run(pnd, script, print_step, pnd) == NFC_ESOFT) {
+      printf("Unexpected response\n");
+    }
+    pn53x_script_free(script);
   }
+  free(block);
 
-  if (input != NULL) {
-    fclose(input);
-  }
   nfc_close(pnd);
   nfc_exit(context);
   exit(EXIT_SUCCESS);
@@ -41,6 +41,7 @@ extern  "C" {
 
 struct nfc_emulator;
 struct nfc_emulation_state_machine;
+struct nfc_emulation_storage;
 
 /**
  * @struct nfc_emulator
@@ -63,6 +64,131 @@ struct nfc_emulation_state_machine {
 
 NFC_EXPORT int    nfc_emulate_target(nfc_device *pnd, struct nfc_emulator *emulator, const int timeout);
 
+/*
+ * Declarative emulation: instead of writing an io() function, register
+ * command handlers and ISO/IEC 7816-4 files in a dispatcher, then use
+ * nfc_emulation_dispatch() as io() and the dispatcher as state machine data.
+ * The dispatcher is caller-allocated and never allocates memory.
+ */
+#define NFC_EMULATION_KEY_MAX_LEN   3
+#define NFC_EMULATION_MAX_COMMANDS  16
+#define NFC_EMULATION_MAX_FILES     8
+#define NFC_EMULATION_NAME_MAX_LEN  16
+#define NFC_EMULATION_TABLE_SIZE    64
+#define NFC_EMULATION_LOG_SIZE      64
+#define NFC_EMULATION_HEADER_LEN    4
+
+typedef int (*nfc_emulation_handler)(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len);
+
+/**
+ * @struct nfc_emulation_command
+ * @brief Command handler keyed by the first bytes of the command (CLA, INS, P1 of an APDU)
+ */
+struct nfc_emulation_command {
+  uint8_t  key[NFC_EMULATION_KEY_MAX_LEN];
+  size_t   key_len;
+  nfc_emulation_handler handler;
+  uint32_t packed_key;
+  /* Response latency, from the command reception until the response is sent */
+  size_t   count;
+  uint64_t total_us;
+  uint64_t min_us;
+  uint64_t max_us;
+};
+
+/**
+ * @struct nfc_emulation_file
+ * @brief File served by the built-in SELECT, READ BINARY and UPDATE BINARY commands
+ */
+struct nfc_emulation_file {
+  uint8_t  name[NFC_EMULATION_NAME_MAX_LEN];  /* file identifier or DF name (AID) */
+  size_t   name_len;
+  bool     by_name;   /* selected by DF name (P1 = 04) rather than by file identifier (P1 = 00) */
+  uint8_t *content;   /* NULL for a DF */
+  size_t   size;
+  bool     writable;
+  struct nfc_emulation_storage *storage;  /* when content lies in a storage, UPDATE BINARY goes through it */
+};
+
+/**
+ * @struct nfc_emulation_log_entry
+ * @brief Command answered by the dispatcher
+ */
+struct nfc_emulation_log_entry {
+  uint8_t  header[NFC_EMULATION_HEADER_LEN];  /* first bytes of the command */
+  size_t   header_len;
+  int      result;       /* response length or negative error */
+  uint8_t  trailer[2];   /* last bytes of the response, i.e. SW1 SW2 for an APDU */
+  uint32_t latency_us;   /* from the command reception until the response is sent */
+};
+
+/**
+ * @struct nfc_emulation_dispatcher
+ * @brief Perfect-hash command table, files and latency log of a declarative emulator
+ */
+struct nfc_emulation_dispatcher {
+  struct nfc_emulation_command commands[NFC_EMULATION_MAX_COMMANDS];
+  size_t   command_count;
+  const struct nfc_emulation_file *files[NFC_EMULATION_MAX_FILES];
+  size_t   file_count;
+  const struct nfc_emulation_file *current_file;
+  /* Built by nfc_emulation_dispatcher_build() */
+  uint8_t  table[NFC_EMULATION_TABLE_SIZE];   /* command index + 1, 0 when empty */
+  uint32_t table_seed;
+  unsigned int table_shift;
+  unsigned int key_lens;                      /* bit n set when some key is n bytes long */
+  /* Filled once the response is sent, nothing is printed while emulating */
+  struct nfc_emulation_log_entry log[NFC_EMULATION_LOG_SIZE];
+  size_t   log_count;                         /* entries ever logged, the last NFC_EMULATION_LOG_SIZE are kept */
+  int      pending;                           /* command being answered or -1 */
+  /* Frame waiting time of the emulated ATS (0 if not ISO/IEC 14443-4) and responses exceeding it */
+  uint32_t fwt_us;
+  size_t   fwt_overruns;
+};
+
+NFC_EXPORT void   nfc_emulation_dispatcher_init(struct nfc_emulation_dispatcher *dispatcher);
+NFC_EXPORT int    nfc_emulation_dispatcher_add_command(struct nfc_emulation_dispatcher *dispatcher, const uint8_t *key, const size_t key_len, nfc_emulation_handler handler);
+NFC_EXPORT int    nfc_emulation_dispatcher_add_file(struct nfc_emulation_dispatcher *dispatcher, const struct nfc_emulation_file *file);
+NFC_EXPORT int    nfc_emulation_dispatcher_build(struct nfc_emulation_dispatcher *dispatcher);
+NFC_EXPORT int    nfc_emulation_dispatch(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len);
+
+/*
+ * Persistent tag memory: the image is mapped from a file and written in
+ * place, the file being synced every sync_interval writes. A snapshot makes
+ * the mapping copy-on-write, so the writes of the next sessions can be
+ * dropped by nfc_emulation_storage_rollback() without reloading the file,
+ * at a cost depending on the bytes written only. The image stays at the
+ * same address whatever the mode, files and handlers can keep pointers into it.
+ */
+#define NFC_EMULATION_STORAGE_REMAP_PAGES 16
+
+/**
+ * @struct nfc_emulation_storage
+ * @brief Tag image mapped from a file
+ */
+struct nfc_emulation_storage {
+  uint8_t *data;
+  size_t   size;
+  int      fd;
+  bool     snapshot;        /* writes go to private pages, the file keeps the snapshot */
+  size_t   sync_interval;   /* writes between two syncs, 0 to leave it to nfc_emulation_storage_sync() */
+  size_t   pending_writes;
+  size_t   dirty_start;     /* bytes written since the last sync, snapshot or rollback */
+  size_t   dirty_end;
+  /* Statistics */
+  size_t   writes;
+  size_t   syncs;
+  size_t   rollbacks;
+};
+
+NFC_EXPORT int    nfc_emulation_storage_open(struct nfc_emulation_storage *storage, const char *path, const uint8_t *initial, const size_t size, const size_t sync_interval);
+NFC_EXPORT int    nfc_emulation_storage_write(struct nfc_emulation_storage *storage, const size_t offset, const uint8_t *data, const size_t len);
+NFC_EXPORT int    nfc_emulation_storage_sync(struct nfc_emulation_storage *storage);
+NFC_EXPORT int    nfc_emulation_storage_snapshot(struct nfc_emulation_storage *storage);
+NFC_EXPORT int    nfc_emulation_storage_rollback(struct nfc_emulation_storage *storage);
+NFC_EXPORT int    nfc_emulation_storage_commit(struct nfc_emulation_storage *storage);
+NFC_EXPORT void   nfc_emulation_storage_close(struct nfc_emulation_storage *storage);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,130 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file nfc-farm.h
+ * @brief Run jobs on a set of devices, each one driven by its own thread
+ */
+
+#ifndef __NFC_FARM_H__
+#define __NFC_FARM_H__
+
+#include <nfc/nfc.h>
+
+#ifdef __cplusplus
+extern  "C" {
+#endif /* __cplusplus */
+
+/*
+ * Reader farm: every device is opened and driven by its own worker thread,
+ * which runs the jobs of its deque, newest first, and steals the oldest jobs
+ * of the other workers when its deque is empty. A job failing on a reader is
+ * handed to another reader which has not failed it yet. Jobs are
+ * caller-allocated and must stay valid until they are done.
+ */
+#define NFC_FARM_MAX_DEVICES      64
+#define NFC_FARM_DEFAULT_ATTEMPTS 3
+
+typedef struct nfc_farm nfc_farm;
+struct nfc_farm_job;
+
+typedef enum {
+  NFC_FARM_READ,      /* send tx, keep the response in rx */
+  NFC_FARM_WRITE,     /* send tx */
+  NFC_FARM_VERIFY,    /* send tx, the response must be expected */
+  NFC_FARM_CALLBACK,  /* call callback() */
+} nfc_farm_job_type;
+
+/* Runs a job on the device of a worker, the target being selected; returns 0 or libnfc's error code */
+typedef int (*nfc_farm_callback)(nfc_device *pnd, const nfc_target *pnt, struct nfc_farm_job *job);
+/* Called by the worker thread once the job succeeded or failed for good */
+typedef void (*nfc_farm_done_callback)(struct nfc_farm_job *job);
+
+/**
+ * @struct nfc_farm_job
+ * @brief Operation on the first target found by a reader
+ */
+struct nfc_farm_job {
+  nfc_farm_job_type type;
+  nfc_modulation nm;          /* modulation of the target selected before the job */
+  const uint8_t *tx;
+  size_t   tx_len;
+  uint8_t *rx;
+  size_t   rx_size;
+  const uint8_t *expected;    /* NFC_FARM_VERIFY */
+  size_t   expected_len;
+  nfc_farm_callback callback; /* NFC_FARM_CALLBACK */
+  nfc_farm_done_callback done;
+  void    *user_data;
+  int      max_attempts;      /* 0 for NFC_FARM_DEFAULT_ATTEMPTS */
+  /* Filled by the farm */
+  int      result;            /* 0, or the error of the last attempt: NFC_ENOTSUCHDEV without target, NFC_ESOFT for a wrong VERIFY response */
+  size_t   rx_len;
+  nfc_target target;
+  int      attempts;
+  size_t   reader;            /* reader of the last attempt */
+  uint64_t failed_readers;    /* bit n set when the job failed on reader n */
+};
+
+/**
+ * @struct nfc_farm_reader_stats
+ * @brief Counters of one reader of a farm
+ */
+struct nfc_farm_reader_stats {
+  nfc_connstring connstring;
+  bool     open;
+  size_t   attempts;          /* jobs run, retries included */
+  size_t   failures;
+  size_t   steals;            /* jobs taken from the deque of another reader */
+  uint64_t busy_us;
+  double   utilisation;       /* busy time over the farm lifetime */
+};
+
+/**
+ * @struct nfc_farm_stats
+ * @brief Counters of a farm since it was created
+ */
+struct nfc_farm_stats {
+  size_t   readers;
+  size_t   readers_open;
+  size_t   jobs_done;
+  size_t   jobs_failed;
+  size_t   retries;
+  uint64_t elapsed_us;
+  double   jobs_per_second;
+};
+
+NFC_EXPORT nfc_farm *nfc_farm_new(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len);
+NFC_EXPORT int    nfc_farm_submit(nfc_farm *farm, struct nfc_farm_job *job);
+NFC_EXPORT void   nfc_farm_wait(nfc_farm *farm);
+NFC_EXPORT size_t nfc_farm_get_stats(nfc_farm *farm, struct nfc_farm_stats *stats, struct nfc_farm_reader_stats readers[], const size_t readers_len);
+NFC_EXPORT void   nfc_farm_free(nfc_farm *farm);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __NFC_FARM_H__ */
@@ -121,7 +121,7 @@ typedef enum {
    * FIFO of the PN53X chip. This could be retrieved by using the receive data
    * functions. Note that if the chip runs out of bytes (FIFO = 64 bytes long),
    * it will overwrite the first received frames, so quick retrieving of the
-   * received data is desirable. */
+   * received data is desirable. nfc_sniff() sets it up and drains the FIFO. */
   NP_ACCEPT_MULTIPLE_FRAMES,
   /** This option can be used to enable or disable the auto-switching mode to
    * ISO14443-4 is device is compliant.
@@ -333,4 +333,187 @@ typedef struct {
 // Reset struct alignment to default
 #  pragma pack()
 
+/** Number of per-command slots in \a nfc_device_stats, the last one gathers unknown commands */
+#  define NFC_STATS_COMMANDS 64
+/** Number of latency histogram buckets: bucket i counts commands faster than NFC_STATS_LATENCY_BASE_US << i, the last one everything else */
+#  define NFC_STATS_LATENCY_BUCKETS 16
+/** Upper bound of the first latency bucket, in microseconds */
+#  define NFC_STATS_LATENCY_BASE_US 64
+/** Number of chip status codes tracked (6 bits on PN53x) */
+#  define NFC_STATS_STATUS_CODES 64
+
+/**
+ * @struct nfc_command_stats
+ * @brief Counters of one chip command
+ */
+typedef struct {
+  /** Command name, NULL when the slot is unused */
+  const char *name;
+  /** Command code */
+  uint8_t code;
+  /** Number of commands sent */
+  uint64_t count;
+  /** Number of commands which failed, on the bus or reported by the chip */
+  uint64_t errors;
+  /** Sum of the command latencies, in microseconds */
+  uint64_t latency_us_total;
+  /** Latency histogram (not cumulative) */
+  uint64_t latency_buckets[NFC_STATS_LATENCY_BUCKETS];
+} nfc_command_stats;
+
+/**
+ * @struct nfc_device_stats
+ * @brief Counters maintained by a device since it was opened
+ */
+typedef struct {
+  /** Frames and payload bytes sent to the chip */
+  uint64_t tx_frames;
+  uint64_t tx_bytes;
+  /** Frames and payload bytes received from the chip */
+  uint64_t rx_frames;
+  uint64_t rx_bytes;
+  /** Commands which ended with NFC_ETIMEOUT */
+  uint64_t timeouts;
+  /** Commands which ended with NFC_EOPABORTED */
+  uint64_t aborts;
+  /** Commands which ended with a given chip status code (index 0 is unused) */
+  uint64_t status_errors[NFC_STATS_STATUS_CODES];
+  /** Per-command counters */
+  nfc_command_stats commands[NFC_STATS_COMMANDS];
+} nfc_device_stats;
+
+/**
+ * @struct nfc_timing_stats
+ * @brief Frame delay times of repeated timed exchanges, in 13.56 MHz carrier cycles
+ */
+typedef struct {
+  /** Number of exchanges */
+  size_t runs;
+  /** Number of exchanges answered by the target, the other fields only cover them */
+  size_t answers;
+  uint32_t min_cycles;
+  uint32_t median_cycles;
+  uint32_t max_cycles;
+  double mean_cycles;
+  /** Median absolute deviation from the median: a spread which ignores a few outliers */
+  uint32_t mad_cycles;
+} nfc_timing_stats;
+
+/**
+ * @struct nfc_low_power_params
+ * @brief Duty cycle of nfc_initiator_poll_target_low_power()
+ */
+typedef struct {
+  /** Time the chip stays powered down between two polls, in ms */
+  uint32_t sleep_ms;
+  /** Give up after this time, in ms; 0 polls until a target is found */
+  uint32_t timeout_ms;
+} nfc_low_power_params;
+
+/**
+ * @struct nfc_low_power_stats
+ * @brief Duty cycle and wake-up latency measured by nfc_initiator_poll_target_low_power()
+ */
+typedef struct {
+  /** Poll windows run */
+  size_t polls;
+  uint64_t elapsed_us;
+  /** Time the chip was awake: wake-up, field on, poll, field off and power down */
+  uint64_t awake_us;
+  /** awake_us over elapsed_us */
+  double duty_cycle;
+  /** Duration of the first command of each window, which wakes the chip up */
+  uint64_t wake_min_us;
+  uint64_t wake_max_us;
+  double wake_mean_us;
+  /** Longest window: a target arriving right after a window is found within sleep_ms plus this time */
+  uint64_t window_max_us;
+  /** Power mode changes of the chip */
+  unsigned long power_transitions;
+} nfc_low_power_stats;
+
+/** Flag of \a nfc_sniffed_frame: the chip reported a collision, parity, CRC or protocol error */
+#  define NFC_SNIFF_ERROR   0x01
+/** Flag of \a nfc_sniffed_frame: the chip FIFO overflowed since the previous frame, frames were lost */
+#  define NFC_SNIFF_OVERRUN 0x02
+/** Flag of \a nfc_sniffed_frame: the chip split it from the next frame late, it may hold bytes of that frame or lack its first bytes */
+#  define NFC_SNIFF_MERGED  0x04
+
+/**
+ * @struct nfc_sniffed_frame
+ * @brief Frame received by nfc_sniff()
+ */
+typedef struct {
+  /** Host monotonic time, in microseconds, of the poll which saw the end of the frame */
+  uint64_t timestamp_us;
+  /** Frame content, valid during the callback only */
+  const uint8_t *data;
+  /** Length in bytes, the last one possibly incomplete */
+  size_t len;
+  /** Length in bits */
+  size_t bits;
+  /** NFC_SNIFF_* flags */
+  int flags;
+} nfc_sniffed_frame;
+
+/**
+ * @struct nfc_sniff_stats
+ * @brief Counters of a nfc_sniff() session
+ */
+typedef struct {
+  /** Reads of the chip FIFO and status */
+  uint64_t polls;
+  uint64_t frames;
+  uint64_t bytes;
+  /** Frames flagged with NFC_SNIFF_ERROR */
+  uint64_t errors;
+  /** Frames flagged with NFC_SNIFF_MERGED */
+  uint64_t merged;
+  /** FIFO overflows: the transport did not drain the chip quickly enough */
+  uint64_t overruns;
+  /** Highest FIFO level seen by a poll */
+  size_t peak_fifo_level;
+  /** Duration of the session, in microseconds */
+  uint64_t elapsed_us;
+} nfc_sniff_stats;
+
+/** Called by nfc_sniff() for each frame, with the device held: the sniffing stops when it returns non-zero */
+typedef int (*nfc_sniff_callback)(nfc_device *pnd, const nfc_sniffed_frame *pnf, void *data);
+
+/**
+ * @struct nfc_iso_dep_params
+ * @brief Settings of the host-side ISO14443-4 engine, see nfc_initiator_iso_dep_activate()
+ */
+typedef struct {
+  /** Frame size of the reader sent in RATS: 0 - 8 for 16 - 256 bytes */
+  uint8_t fsdi;
+  /** Card identifier 0 - 14, or -1 for none. Only used when the ATS says the card supports it */
+  int cid;
+  /** Node address put in the I-blocks, or -1 for none. Only used when the ATS says the card supports it */
+  int nad;
+  /** Largest information field of the I-blocks sent, 0 for the largest the card accepts */
+  size_t block_size;
+} nfc_iso_dep_params;
+
+/**
+ * @struct nfc_iso_dep_info
+ * @brief Parameters of the ISO14443-4 link, as negotiated by nfc_initiator_iso_dep_activate()
+ */
+typedef struct {
+  /** Largest frame accepted by the reader and by the card, CRC included */
+  size_t fsd;
+  size_t fsc;
+  /** Frame waiting time, in microseconds */
+  uint32_t fwt_us;
+  /** Start-up frame guard time: delay after the ATS, in microseconds */
+  uint32_t sfgt_us;
+  bool cid_used;
+  bool nad_used;
+  /** Counters: blocks sent, blocks received, frames sent again after an error, waiting time extensions */
+  unsigned long blocks_sent;
+  unsigned long blocks_received;
+  unsigned long retransmissions;
+  unsigned long wtx;
+} nfc_iso_dep_info;
+
 #endif // _LIBNFC_TYPES_H_
@@ -84,6 +84,7 @@ extern  "C" {
 
 /* Library initialization/deinitialization */
 NFC_EXPORT void nfc_init(nfc_context **context) ATTRIBUTE_NONNULL(1);
+NFC_EXPORT void nfc_init_from_buffer(nfc_context **context, const char *config, const size_t config_len) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT void nfc_exit(nfc_context *context) ATTRIBUTE_NONNULL(1);
 NFC_EXPORT int nfc_register_driver(const nfc_driver *driver);
 
@@ -100,6 +101,9 @@ NFC_EXPORT int nfc_initiator_init_secure_element(nfc_device *pnd);
 NFC_EXPORT int nfc_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
 NFC_EXPORT int nfc_initiator_list_passive_targets(nfc_device *pnd, const nfc_modulation nm, nfc_target ant[], const size_t szTargets);
 NFC_EXPORT int nfc_initiator_poll_target(nfc_device *pnd, const nfc_modulation *pnmTargetTypes, const size_t szTargetTypes, const uint8_t uiPollNr, const uint8_t uiPeriod, nfc_target *pnt);
+NFC_EXPORT int nfc_initiator_poll_target_low_power(nfc_device *pnd, const nfc_modulation *pnmTargetTypes, const size_t szTargetTypes, const nfc_low_power_params *pparams, nfc_target *pnt, nfc_low_power_stats *pstats);
+NFC_EXPORT int nfc_initiator_inventory_iso14443a(nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+NFC_EXPORT int nfc_initiator_inventory_felica(nfc_device *pnd, const nfc_baud_rate nbr, const uint16_t ui16SystemCode, nfc_target ant[], const size_t szTargets);
 NFC_EXPORT int nfc_initiator_select_dep_target(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
 NFC_EXPORT int nfc_initiator_poll_dep_target(nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
 NFC_EXPORT int nfc_initiator_deselect_target(nfc_device *pnd);
@@ -107,12 +111,23 @@ NFC_EXPORT int nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pb
 NFC_EXPORT int nfc_initiator_transceive_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar);
 NFC_EXPORT int nfc_initiator_transceive_bytes_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles);
 NFC_EXPORT int nfc_initiator_transceive_bits_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar, uint32_t *cycles);
+NFC_EXPORT int nfc_initiator_measure_bits_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, uint8_t *pbtRx, const size_t szRx, const uint32_t max_cycles, const size_t szRuns, nfc_timing_stats *pstats);
+NFC_EXPORT int nfc_initiator_measure_bytes_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, const uint32_t max_cycles, const size_t szRuns, nfc_timing_stats *pstats);
+NFC_EXPORT int nfc_device_calibrate_timer(nfc_device *pnd, int *piCorrection);
+NFC_EXPORT int nfc_sniff(nfc_device *pnd, const nfc_modulation nm, const nfc_mode nmFrom, nfc_sniff_callback cb, void *data, int timeout, nfc_sniff_stats *pstats);
 NFC_EXPORT int nfc_initiator_target_is_present(nfc_device *pnd, const nfc_target *pnt);
+NFC_EXPORT int nfc_initiator_iso_dep_activate(nfc_device *pnd, nfc_target *pnt, const nfc_iso_dep_params *pparams);
+NFC_EXPORT int nfc_initiator_iso_dep_send(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, const bool bMore);
+NFC_EXPORT int nfc_initiator_iso_dep_receive(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, bool *pbMore);
+NFC_EXPORT int nfc_initiator_iso_dep_transceive(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx);
+NFC_EXPORT int nfc_initiator_iso_dep_deselect(nfc_device *pnd);
+NFC_EXPORT int nfc_initiator_iso_dep_get_info(nfc_device *pnd, nfc_iso_dep_info *pinfo);
 
 /* NFC target: act as tag (i.e. MIFARE Classic) or NFC target device. */
 NFC_EXPORT int nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout);
 NFC_EXPORT int nfc_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
 NFC_EXPORT int nfc_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout);
+NFC_EXPORT int nfc_target_send_receive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
 NFC_EXPORT int nfc_target_send_bits(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
 NFC_EXPORT int nfc_target_receive_bits(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar);
 
@@ -127,6 +142,7 @@ NFC_EXPORT const char *nfc_device_get_name(nfc_device *pnd);
 NFC_EXPORT const char *nfc_device_get_connstring(nfc_device *pnd);
 NFC_EXPORT int nfc_device_get_supported_modulation(nfc_device *pnd, const nfc_mode mode,  const nfc_modulation_type **const supported_mt);
 NFC_EXPORT int nfc_device_get_supported_baud_rate(nfc_device *pnd, const nfc_modulation_type nmt, const nfc_baud_rate **const supported_br);
+NFC_EXPORT int nfc_device_get_stats(nfc_device *pnd, nfc_device_stats *pstats);
 
 /* Properties accessors */
 NFC_EXPORT int nfc_device_set_property_int(nfc_device *pnd, const nfc_property property, const int value);
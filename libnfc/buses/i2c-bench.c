@@ -0,0 +1,316 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tarti?re
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ * Copyright (C) 2013      Laurent Latil
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file i2c-bench.c
+ * @brief pn532_i2c driver benchmark against a simulated I2C bus
+ *
+ * This program is linked with the library objects and with the i2c_* bus
+ * functions wrapped (ld --wrap), so the pn532_i2c driver talks to a PN532
+ * simulated here instead of a /dev/i2c-N bus. Like the real chip, every read
+ * transaction starts with the status byte, followed by the pending frame
+ * from its first byte; a frame is consumed once read to its end.
+ * The ACK is ready a fixed delay after a command, the response after the
+ * command latency chosen on the command line.
+ * The simulated bus counts every byte it moves.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "i2c.h"
+
+#define SIM_ACK_DELAY 800 // µs
+
+struct sim_frame {
+  uint8_t  abtData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD];
+  size_t   szData;
+  uint64_t ui64ReadyAt;
+};
+
+static struct {
+  struct sim_frame frames[2]; // ACK, then response
+  size_t   szFrames;
+  size_t   szPayload;         // InDataExchange response length
+  uint32_t ui32Latency;       // InDataExchange latency (µs)
+  unsigned long ulPolls;      // reads with no frame ready
+  struct i2c_stats stats;
+} sim;
+
+static const uint8_t abtAck[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
+
+static void
+sim_queue(const uint8_t *pbtData, const size_t szData, const uint64_t ui64ReadyAt)
+{
+  struct sim_frame *frame = &sim.frames[sim.szFrames++];
+  memcpy(frame->abtData, pbtData, szData);
+  frame->szData = szData;
+  frame->ui64ReadyAt = ui64ReadyAt;
+}
+
+// Build the PN532 answer to a command, PD0 included
+static size_t
+sim_answer(const uint8_t *pbtCmd, const size_t szCmd, uint8_t *pbtRx, uint32_t *pui32Latency)
+{
+  size_t szRx = 0;
+  *pui32Latency = 1000;
+  pbtRx[szRx++] = pbtCmd[0] + 1;
+  switch (pbtCmd[0]) {
+    case Diagnose:
+      memcpy(pbtRx + szRx, pbtCmd + 1, szCmd - 1);
+      szRx += szCmd - 1;
+      break;
+    case GetFirmwareVersion:
+      memcpy(pbtRx + szRx, "\x32\x01\x06\x07", 4);
+      szRx += 4;
+      break;
+    case ReadRegister:
+      memset(pbtRx + szRx, 0, (szCmd - 1) / 2);
+      szRx += (szCmd - 1) / 2;
+      break;
+    case InDataExchange:
+      pbtRx[szRx++] = 0x00;
+      for (size_t n = 0; n < sim.szPayload; n++)
+        pbtRx[szRx++] = (uint8_t) n;
+      *pui32Latency = sim.ui32Latency;
+      break;
+    default:
+      break;
+  }
+  return szRx;
+}
+
+i2c_device
+__wrap_i2c_open(const char *pcI2C_busName, uint32_t devAddr)
+{
+  (void) pcI2C_busName;
+  (void) devAddr;
+  return &sim;
+}
+
+void
+__wrap_i2c_close(const i2c_device id)
+{
+  (void) id;
+}
+
+char **
+__wrap_i2c_list_ports(void)
+{
+  return calloc(1, sizeof(char *));
+}
+
+int
+__wrap_i2c_write(i2c_device id, const uint8_t *pbtTx, const size_t szTx)
+{
+  (void) id;
+  sim.stats.transactions++;
+  sim.stats.bytes_written += szTx;
+  if ((szTx == sizeof(abtAck)) && !memcmp(pbtTx, abtAck, szTx)) {
+    // Host ACK: abort the running command
+    sim.szFrames = 0;
+    return NFC_SUCCESS;
+  }
+  if ((szTx < 8) || (pbtTx[5] != 0xd4))
+    return NFC_EIO;
+
+  uint8_t abtAnswer[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtFrame[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD];
+  uint32_t ui32Latency;
+  size_t szAnswer = sim_answer(pbtTx + 6, pbtTx[3] - 1, abtAnswer, &ui32Latency);
+  size_t szFrame = 0;
+  uint8_t btDcs = 0xd5;
+
+  abtFrame[szFrame++] = 0x00;
+  abtFrame[szFrame++] = 0x00;
+  abtFrame[szFrame++] = 0xff;
+  abtFrame[szFrame++] = (uint8_t)(szAnswer + 1);
+  abtFrame[szFrame++] = (uint8_t)(0x100 - (szAnswer + 1));
+  abtFrame[szFrame++] = 0xd5;
+  for (size_t n = 0; n < szAnswer; n++) {
+    abtFrame[szFrame++] = abtAnswer[n];
+    btDcs += abtAnswer[n];
+  }
+  abtFrame[szFrame++] = (uint8_t)(0x100 - btDcs);
+  abtFrame[szFrame++] = 0x00;
+
+  const uint64_t ui64Now = monotonic_time_us();
+  sim.szFrames = 0;
+  sim_queue(abtAck, sizeof(abtAck), ui64Now + SIM_ACK_DELAY);
+  sim_queue(abtFrame, szFrame, ui64Now + SIM_ACK_DELAY + ui32Latency);
+  return NFC_SUCCESS;
+}
+
+// One read transaction: status byte, then the pending frame from its start
+static void
+sim_read(uint8_t *pbtRx, const size_t szRx)
+{
+  sim.stats.transactions++;
+  sim.stats.bytes_read += szRx;
+  memset(pbtRx, 0, szRx);
+  if ((sim.szFrames == 0) || (monotonic_time_us() < sim.frames[0].ui64ReadyAt)) {
+    sim.ulPolls++;
+    return;
+  }
+  pbtRx[0] = 0x01;
+  memcpy(pbtRx + 1, sim.frames[0].abtData, MIN(szRx - 1, sim.frames[0].szData));
+  if (szRx - 1 >= sim.frames[0].szData) {
+    // Frame read to its end
+    memmove(&sim.frames[0], &sim.frames[1], sizeof(sim.frames[0]));
+    sim.szFrames--;
+  }
+}
+
+ssize_t
+__wrap_i2c_read(i2c_device id, uint8_t *pbtRx, const size_t szRx)
+{
+  (void) id;
+  sim_read(pbtRx, szRx);
+  return (ssize_t) szRx;
+}
+
+ssize_t
+__wrap_i2c_readv(i2c_device id, const struct iovec *iov, const int iovcnt)
+{
+  uint8_t abtFrame[1 + PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD];
+  size_t szFrame = 0;
+  (void) id;
+
+  for (int i = 0; i < iovcnt; i++)
+    szFrame += iov[i].iov_len;
+  if (szFrame > sizeof(abtFrame))
+    return NFC_EINVARG;
+  sim_read(abtFrame, szFrame);
+  szFrame = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    memcpy(iov[i].iov_base, abtFrame + szFrame, iov[i].iov_len);
+    szFrame += iov[i].iov_len;
+  }
+  return (ssize_t) szFrame;
+}
+
+void
+__wrap_i2c_get_stats(const i2c_device id, struct i2c_stats *stats)
+{
+  (void) id;
+  *stats = sim.stats;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned long ulIterations = 200;
+  int opt;
+
+  sim.szPayload = 64;
+  sim.ui32Latency = 10000;
+  while ((opt = getopt(argc, argv, "n:l:t:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        ulIterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        sim.szPayload = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        sim.ui32Latency = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n iterations] [-l response length (0-252)] [-t command latency in µs]\n", argv[0]);
+        return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if ((ulIterations == 0) || (sim.szPayload > 252)) {
+    fprintf(stderr, "Invalid iteration count or response length\n");
+    return EXIT_FAILURE;
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+  const nfc_connstring connstring = "pn532_i2c:/dev/i2c-sim";
+  nfc_device *pnd = nfc_open(context, connstring);
+  if (pnd == NULL) {
+    fprintf(stderr, "Unable to open the simulated PN532\n");
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+
+  const uint8_t abtCmd[] = { InDataExchange, 0x01, 0x30, 0x00 };
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  struct i2c_stats before = sim.stats;
+  const unsigned long ulPolls = sim.ulPolls;
+  uint64_t ui64Total = 0, ui64Max = 0;
+  int res = 0;
+
+  for (unsigned long n = 0; n < ulIterations; n++) {
+    const uint64_t t0 = monotonic_time_us();
+    if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx), -1)) < 0)
+      break;
+    if ((size_t) res != sim.szPayload + 1) {
+      res = NFC_EIO;
+      break;
+    }
+    const uint64_t ui64Elapsed = monotonic_time_us() - t0;
+    ui64Total += ui64Elapsed;
+    ui64Max = MAX(ui64Max, ui64Elapsed);
+  }
+
+  if (res < 0) {
+    fprintf(stderr, "Command failed: %s\n", nfc_strerror(pnd));
+  } else {
+    const double dIterations = (double) ulIterations;
+    const uint64_t ui64Expected = SIM_ACK_DELAY + sim.ui32Latency;
+    printf("%lu InDataExchange, %lu response bytes, %lu us simulated latency\n",
+           ulIterations, (unsigned long) sim.szPayload, (unsigned long) sim.ui32Latency);
+    printf("bus bytes per command: %.1f (%.1f read, %.1f written)\n",
+           ((sim.stats.bytes_read - before.bytes_read) + (sim.stats.bytes_written - before.bytes_written)) / dIterations,
+           (sim.stats.bytes_read - before.bytes_read) / dIterations, (sim.stats.bytes_written - before.bytes_written) / dIterations);
+    printf("transactions per command: %.1f (%.1f not-ready polls)\n",
+           (sim.stats.transactions - before.transactions) / dIterations, (sim.ulPolls - ulPolls) / dIterations);
+    printf("command time: avg %.0f us, max %lu us, %lu us past the frame readiness on average\n",
+           ui64Total / dIterations, (unsigned long) ui64Max, (unsigned long)(ui64Total / ulIterations - MIN(ui64Expected, ui64Total / ulIterations)));
+  }
+
+  nfc_close(pnd);
+  nfc_exit(context);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -41,6 +41,8 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <linux/i2c.h>
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
@@ -66,8 +68,16 @@ const char *i2c_ports_device_radix[] =
 #  endif
 
 
+// Largest frame i2c_readv() gathers with a plain read
+#define I2C_READV_BUFFER_LEN 512
+// Most buffers i2c_readv() scatters a frame over
+#define I2C_READV_MAX_CHUNKS 4
+
 struct i2c_device_unix {
   int fd;             // I2C device file descriptor
+  uint16_t addr;      // Address of the device on the bus
+  unsigned long funcs; // Adapter functionality (I2C_FUNC_*)
+  struct i2c_stats stats;
 };
 
 #define I2C_DATA( X ) ((struct i2c_device_unix *) X)
@@ -87,6 +97,10 @@ i2c_open(const char *pcI2C_busName, uint32_t devAddr)
   if (id == 0)
     return INVALID_I2C_BUS ;
 
+  id->addr = (uint16_t) devAddr;
+  id->funcs = 0;
+  memset(&id->stats, 0, sizeof(id->stats));
+
   id->fd = open(pcI2C_busName, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (id->fd == -1) {
     perror("Cannot open I2C bus");
@@ -100,6 +114,11 @@ i2c_open(const char *pcI2C_busName, uint32_t devAddr)
     return INVALID_I2C_ADDRESS ;
   }
 
+  // Combined reads need I2C_FUNC_NOSTART, i2c_readv() falls back to plain reads without it
+  if (ioctl(id->fd, I2C_FUNCS, &id->funcs) < 0) {
+    id->funcs = 0;
+  }
+
   return id;
 }
 
@@ -132,6 +151,7 @@ i2c_read(i2c_device id, uint8_t *pbtRx, const size_t szRx)
   ssize_t recCount;
 
   recCount = read(I2C_DATA(id) ->fd, pbtRx, szRx);
+  I2C_DATA(id)->stats.transactions++;
 
   if (recCount < 0) {
     res = NFC_EIO;
@@ -141,10 +161,76 @@ i2c_read(i2c_device id, uint8_t *pbtRx, const size_t szRx)
     } else {
       res = recCount;
     }
+    I2C_DATA(id)->stats.bytes_read += (unsigned long) recCount;
   }
   return res;
 }
 
+/**
+ * @brief Read one frame from the I2C device, scattered over several buffers
+ *
+ * The whole frame is read in a single bus transaction: an I2C_RDWR combined
+ * transaction whose messages after the first continue without a new start
+ * condition when the adapter supports it (I2C_FUNC_NOSTART), otherwise one
+ * plain read which is then split.
+ *
+ * @param id I2C device.
+ * @param iov buffers to fill, in frame order
+ * @param iovcnt number of buffers (at most I2C_READV_MAX_CHUNKS)
+ * @return length (in bytes) of read data, or driver error code (negative value)
+ */
+ssize_t
+i2c_readv(i2c_device id, const struct iovec *iov, const int iovcnt)
+{
+  size_t szTotal = 0;
+  int i;
+
+  if ((iovcnt < 1) || (iovcnt > I2C_READV_MAX_CHUNKS)) {
+    return NFC_EINVARG;
+  }
+  for (i = 0; i < iovcnt; i++) {
+    szTotal += iov[i].iov_len;
+  }
+
+  if (I2C_DATA(id)->funcs & I2C_FUNC_NOSTART) {
+    struct i2c_msg msgs[I2C_READV_MAX_CHUNKS];
+    struct i2c_rdwr_ioctl_data rdwr = { msgs, 0 };
+
+    for (i = 0; i < iovcnt; i++) {
+      if (iov[i].iov_len == 0) {
+        continue;
+      }
+      msgs[rdwr.nmsgs].addr = I2C_DATA(id)->addr;
+      msgs[rdwr.nmsgs].flags = I2C_M_RD | (rdwr.nmsgs ? I2C_M_NOSTART : 0);
+      msgs[rdwr.nmsgs].len = (uint16_t) iov[i].iov_len;
+      msgs[rdwr.nmsgs].buf = iov[i].iov_base;
+      rdwr.nmsgs++;
+    }
+    I2C_DATA(id)->stats.transactions++;
+    if (ioctl(I2C_DATA(id)->fd, I2C_RDWR, &rdwr) < 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Combined read failed: %s", strerror(errno));
+      return NFC_EIO;
+    }
+    I2C_DATA(id)->stats.bytes_read += (unsigned long) szTotal;
+  } else {
+    uint8_t abtFrame[I2C_READV_BUFFER_LEN];
+    size_t szOffset = 0;
+    ssize_t res;
+
+    if (szTotal > sizeof(abtFrame)) {
+      return NFC_EINVARG;
+    }
+    if ((res = i2c_read(id, abtFrame, szTotal)) < 0) {
+      return res;
+    }
+    for (i = 0; i < iovcnt; i++) {
+      memcpy(iov[i].iov_base, abtFrame + szOffset, iov[i].iov_len);
+      szOffset += iov[i].iov_len;
+    }
+  }
+  return (ssize_t) szTotal;
+}
+
 /**
  * @brief Write a frame to I2C device containing \a pbtTx content
  *
@@ -160,6 +246,10 @@ i2c_write(i2c_device id, const uint8_t *pbtTx, const size_t szTx)
 
   ssize_t writeCount;
   writeCount = write(I2C_DATA(id) ->fd, pbtTx, szTx);
+  I2C_DATA(id)->stats.transactions++;
+  if (writeCount > 0) {
+    I2C_DATA(id)->stats.bytes_written += (unsigned long) writeCount;
+  }
 
   if ((const ssize_t) szTx == writeCount) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
@@ -172,6 +262,15 @@ i2c_write(i2c_device id, const uint8_t *pbtTx, const size_t szTx)
   }
 }
 
+/**
+ * @brief Get the traffic counters of the I2C device
+ */
+void
+i2c_get_stats(const i2c_device id, struct i2c_stats *stats)
+{
+  *stats = I2C_DATA(id)->stats;
+}
+
 /**
  * @brief Get the path of all I2C bus devices.
  *
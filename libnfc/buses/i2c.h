@@ -39,6 +39,7 @@
 #  include <stdio.h>
 #  include <string.h>
 #  include <stdlib.h>
+#  include <sys/uio.h>
 
 #  include <linux/i2c-dev.h>
 #  include <nfc/nfc-types.h>
@@ -53,8 +54,19 @@ void       i2c_close(const i2c_device id);
 
 ssize_t    i2c_read(i2c_device id, uint8_t *pbtRx, const size_t szRx);
 
+ssize_t    i2c_readv(i2c_device id, const struct iovec *iov, const int iovcnt);
+
 int        i2c_write(i2c_device id, const uint8_t *pbtTx, const size_t szTx);
 
 char     **i2c_list_ports(void);
 
+// Traffic on an I2C device since it was opened
+struct i2c_stats {
+  unsigned long transactions;
+  unsigned long bytes_read;
+  unsigned long bytes_written;
+};
+
+void       i2c_get_stats(const i2c_device id, struct i2c_stats *stats);
+
 #endif // __NFC_BUS_I2C_H__
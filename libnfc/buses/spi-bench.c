@@ -0,0 +1,423 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ * Copyright (C) 2013      Evgeny Boger
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file spi-bench.c
+ * @brief pn532_spi driver benchmark against a simulated spidev controller
+ *
+ * This program is linked with the library objects and with ioctl() wrapped
+ * (ld --wrap): the SPI requests the spi bus code sends to its device (opened
+ * on /dev/null) reach a spidev controller and PN532 simulated here.
+ * The controller costs a fixed time per SPI_IOC_MESSAGE plus the clocking of
+ * the bytes at the port speed, and it may refuse the LSB-first mode (-m),
+ * in which case the wire carries MSB-first bytes the PN532 reads reversed.
+ * The PN532 answers status reads (02), data reads (03) and data writes (01)
+ * as described in pn532_spi_receive_next_chunk(). The ACK is ready a fixed
+ * delay after a command, the response after the command latency chosen on
+ * the command line.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "spi.h"
+
+#define SIM_ACK_DELAY 800 // µs
+
+struct sim_frame {
+  uint8_t  abtData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD];
+  size_t   szData;
+  uint64_t ui64ReadyAt;
+};
+
+static struct {
+  struct sim_frame frames[2]; // ACK, then response
+  size_t   szFrames;
+  size_t   szPos;             // next byte of frames[0]
+  bool     bStarted;          // frames[0] read has begun
+  uint8_t  btCommand;         // SPI command of the current CS cycle, 0 before it
+  bool     bFirstByte;        // next byte is the first of the CS cycle
+  uint8_t  abtWrite[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD];
+  size_t   szWrite;
+  size_t   szPayload;         // InDataExchange response length
+  uint32_t ui32Latency;       // InDataExchange latency (µs)
+  uint32_t ui32Overhead;      // cost of one SPI message (µs)
+  uint32_t ui32Speed;
+  uint8_t  btMode;
+  bool     bNoLsbFirst;       // controller refuses SPI_LSB_FIRST
+  unsigned long ulMessages;
+  unsigned long ulBytes;
+  unsigned long ulPolls;      // status reads with no frame ready
+} sim;
+
+static const uint8_t abtAck[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
+
+int __real_ioctl(int fd, unsigned long request, ...);
+
+static uint8_t
+sim_reverse(uint8_t x)
+{
+  x = (uint8_t)(((x & 0xaa) >> 1) | ((x & 0x55) << 1));
+  x = (uint8_t)(((x & 0xcc) >> 2) | ((x & 0x33) << 2));
+  return (uint8_t)((x >> 4) | (x << 4));
+}
+
+static void
+sim_queue(const uint8_t *pbtData, const size_t szData, const uint64_t ui64ReadyAt)
+{
+  struct sim_frame *frame = &sim.frames[sim.szFrames++];
+  memcpy(frame->abtData, pbtData, szData);
+  frame->szData = szData;
+  frame->ui64ReadyAt = ui64ReadyAt;
+}
+
+static bool
+sim_ready(void)
+{
+  return (sim.szFrames > 0) && (monotonic_time_us() >= sim.frames[0].ui64ReadyAt);
+}
+
+// Build the PN532 answer to a command, PD0 included
+static size_t
+sim_answer(const uint8_t *pbtCmd, const size_t szCmd, uint8_t *pbtRx, uint32_t *pui32Latency)
+{
+  size_t szRx = 0;
+  *pui32Latency = 1000;
+  pbtRx[szRx++] = pbtCmd[0] + 1;
+  switch (pbtCmd[0]) {
+    case Diagnose:
+      memcpy(pbtRx + szRx, pbtCmd + 1, szCmd - 1);
+      szRx += szCmd - 1;
+      break;
+    case GetFirmwareVersion:
+      memcpy(pbtRx + szRx, "\x32\x01\x06\x07", 4);
+      szRx += 4;
+      break;
+    case ReadRegister:
+      memset(pbtRx + szRx, 0, (szCmd - 1) / 2);
+      szRx += (szCmd - 1) / 2;
+      break;
+    case InDataExchange:
+      pbtRx[szRx++] = 0x00;
+      for (size_t n = 0; n < sim.szPayload; n++)
+        pbtRx[szRx++] = (uint8_t) n;
+      *pui32Latency = sim.ui32Latency;
+      break;
+    default:
+      break;
+  }
+  return szRx;
+}
+
+// A DATAWRITE cycle is over: run the written frame
+static void
+sim_write_done(void)
+{
+  const uint8_t *pbtTx = sim.abtWrite;
+  const size_t szTx = sim.szWrite;
+
+  if ((szTx == sizeof(abtAck)) && !memcmp(pbtTx, abtAck, szTx)) {
+    // Host ACK: abort the running command
+    sim.szFrames = 0;
+    return;
+  }
+  if ((szTx < 8) || (pbtTx[5] != 0xd4))
+    return;
+
+  uint8_t abtAnswer[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtFrame[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + PN53x_EXTENDED_FRAME__OVERHEAD];
+  uint32_t ui32Latency;
+  size_t szAnswer = sim_answer(pbtTx + 6, pbtTx[3] - 1, abtAnswer, &ui32Latency);
+  size_t szFrame = 0;
+  uint8_t btDcs = 0xd5;
+
+  abtFrame[szFrame++] = 0x00;
+  abtFrame[szFrame++] = 0x00;
+  abtFrame[szFrame++] = 0xff;
+  abtFrame[szFrame++] = (uint8_t)(szAnswer + 1);
+  abtFrame[szFrame++] = (uint8_t)(0x100 - (szAnswer + 1));
+  abtFrame[szFrame++] = 0xd5;
+  for (size_t n = 0; n < szAnswer; n++) {
+    abtFrame[szFrame++] = abtAnswer[n];
+    btDcs += abtAnswer[n];
+  }
+  abtFrame[szFrame++] = (uint8_t)(0x100 - btDcs);
+  abtFrame[szFrame++] = 0x00;
+
+  const uint64_t ui64Now = monotonic_time_us();
+  sim.szFrames = 0;
+  sim.szPos = 0;
+  sim.bStarted = false;
+  sim_queue(abtAck, sizeof(abtAck), ui64Now + SIM_ACK_DELAY);
+  sim_queue(abtFrame, szFrame, ui64Now + SIM_ACK_DELAY + ui32Latency);
+}
+
+static void
+sim_cs_release(void)
+{
+  if (sim.btCommand == 0x01)
+    sim_write_done();
+  sim.btCommand = 0;
+  sim.bFirstByte = true;
+}
+
+// Next byte of the pending frame; a frame is consumed once read to its end
+static uint8_t
+sim_frame_byte(const bool bShift)
+{
+  if (!sim_ready())
+    return 0x00;
+  const uint8_t btByte = sim.frames[0].abtData[sim.szPos];
+  if (bShift && (++sim.szPos == sim.frames[0].szData)) {
+    memmove(&sim.frames[0], &sim.frames[1], sizeof(sim.frames[0]));
+    sim.szFrames--;
+    sim.szPos = 0;
+    sim.bStarted = false;
+  }
+  return btByte;
+}
+
+// One byte clocked on the bus, seen by the PN532 (LSB first): returns MISO
+static uint8_t
+sim_clock(const bool bTx, const uint8_t btMosi)
+{
+  if (sim.bFirstByte) {
+    sim.bFirstByte = false;
+    if (!bTx) {
+      // Read without command: the PN532 outputs its current byte without shifting
+      return sim.szFrames ? sim_frame_byte(false) : 0x00;
+    }
+    sim.btCommand = btMosi;
+    if (btMosi == 0x03) {
+      if (!sim.bStarted) {
+        sim.bStarted = true;
+        return 0x01;
+      }
+      return sim_frame_byte(true);
+    }
+    if (btMosi == 0x01)
+      sim.szWrite = 0;
+    return 0x00;
+  }
+  switch (sim.btCommand) {
+    case 0x02:
+      if (sim_ready())
+        return 0x01;
+      sim.ulPolls++;
+      return 0x00;
+    case 0x03:
+      return sim_frame_byte(true);
+    case 0x01:
+      if (sim.szWrite < sizeof(sim.abtWrite))
+        sim.abtWrite[sim.szWrite++] = btMosi;
+      return 0x00;
+    default:
+      return 0x00;
+  }
+}
+
+static int
+sim_message(struct spi_ioc_transfer *tr, const size_t szTransfers)
+{
+  const uint64_t ui64Start = monotonic_time_us();
+  const bool bLsbFirst = (sim.btMode & SPI_LSB_FIRST) != 0;
+  unsigned long ulBytes = 0;
+
+  sim.ulMessages++;
+  for (size_t i = 0; i < szTransfers; i++) {
+    const uint8_t *pbtTx = (const uint8_t *)(uintptr_t) tr[i].tx_buf;
+    uint8_t *pbtRx = (uint8_t *)(uintptr_t) tr[i].rx_buf;
+    for (size_t n = 0; n < tr[i].len; n++) {
+      uint8_t btMosi = pbtTx ? pbtTx[n] : 0x00;
+      if (!bLsbFirst)
+        btMosi = sim_reverse(btMosi);
+      uint8_t btMiso = sim_clock(pbtTx != NULL, btMosi);
+      if (pbtRx)
+        pbtRx[n] = bLsbFirst ? btMiso : sim_reverse(btMiso);
+    }
+    ulBytes += tr[i].len;
+    if (tr[i].cs_change || (i == szTransfers - 1))
+      sim_cs_release();
+  }
+  sim.ulBytes += ulBytes;
+
+  // Controller overhead, then 8 clock cycles per byte
+  const uint64_t ui64Done = ui64Start + sim.ui32Overhead + (ulBytes * 8 * 1000000) / sim.ui32Speed;
+  while (monotonic_time_us() < ui64Done)
+    ;
+  return (int) ulBytes;
+}
+
+int
+__wrap_ioctl(int fd, unsigned long request, ...)
+{
+  va_list ap;
+  va_start(ap, request);
+  void *arg = va_arg(ap, void *);
+  va_end(ap);
+
+  if (_IOC_TYPE(request) != SPI_IOC_MAGIC)
+    return __real_ioctl(fd, request, arg);
+
+  switch (request) {
+    case SPI_IOC_WR_MAX_SPEED_HZ:
+      sim.ui32Speed = *(uint32_t *) arg;
+      return 0;
+    case SPI_IOC_RD_MAX_SPEED_HZ:
+      *(uint32_t *) arg = sim.ui32Speed;
+      return 0;
+    case SPI_IOC_WR_MODE:
+      if (sim.bNoLsbFirst && (*(uint8_t *) arg & SPI_LSB_FIRST)) {
+        errno = EINVAL;
+        return -1;
+      }
+      sim.btMode = *(uint8_t *) arg;
+      return 0;
+    case SPI_IOC_RD_MODE:
+      *(uint8_t *) arg = sim.btMode;
+      return 0;
+    case SPI_IOC_WR_LSB_FIRST:
+      if (sim.bNoLsbFirst && *(uint8_t *) arg) {
+        errno = EINVAL;
+        return -1;
+      }
+      sim.btMode = (uint8_t)((sim.btMode & ~SPI_LSB_FIRST) | (*(uint8_t *) arg ? SPI_LSB_FIRST : 0));
+      return 0;
+    case SPI_IOC_RD_LSB_FIRST:
+      *(uint8_t *) arg = (sim.btMode & SPI_LSB_FIRST) ? 1 : 0;
+      return 0;
+    default:
+      break;
+  }
+  if ((_IOC_NR(request) == _IOC_NR(SPI_IOC_MESSAGE(1))) && (_IOC_DIR(request) == _IOC_WRITE))
+    return sim_message(arg, _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer));
+  errno = EINVAL;
+  return -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned long ulIterations = 200;
+  int opt;
+
+  sim.szPayload = 64;
+  sim.ui32Latency = 10000;
+  sim.ui32Overhead = 30;
+  sim.bFirstByte = true;
+  while ((opt = getopt(argc, argv, "n:l:t:o:mh")) != -1) {
+    switch (opt) {
+      case 'n':
+        ulIterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        sim.szPayload = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        sim.ui32Latency = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      case 'o':
+        sim.ui32Overhead = (uint32_t) strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        sim.bNoLsbFirst = true;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n iterations] [-l response length (0-252)] [-t command latency in µs] [-o SPI message overhead in µs] [-m]\n", argv[0]);
+        fprintf(stderr, "  -m  the controller only supports MSB first transfers\n");
+        return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if ((ulIterations == 0) || (sim.szPayload > 252)) {
+    fprintf(stderr, "Invalid iteration count or response length\n");
+    return EXIT_FAILURE;
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+  const nfc_connstring connstring = "pn532_spi:/dev/null";
+  nfc_device *pnd = nfc_open(context, connstring);
+  if (pnd == NULL) {
+    fprintf(stderr, "Unable to open the simulated PN532\n");
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+
+  const uint8_t abtCmd[] = { InDataExchange, 0x01, 0x30, 0x00 };
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  const unsigned long ulMessages = sim.ulMessages, ulBytes = sim.ulBytes, ulPolls = sim.ulPolls;
+  uint64_t ui64Total = 0, ui64Max = 0;
+  int res = 0;
+
+  for (unsigned long n = 0; n < ulIterations; n++) {
+    const uint64_t t0 = monotonic_time_us();
+    if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx), -1)) < 0)
+      break;
+    if ((size_t) res != sim.szPayload + 1) {
+      res = NFC_EIO;
+      break;
+    }
+    const uint64_t ui64Elapsed = monotonic_time_us() - t0;
+    ui64Total += ui64Elapsed;
+    ui64Max = MAX(ui64Max, ui64Elapsed);
+  }
+
+  if (res < 0) {
+    fprintf(stderr, "Command failed: %s\n", nfc_strerror(pnd));
+  } else {
+    const double dIterations = (double) ulIterations;
+    const uint64_t ui64Expected = SIM_ACK_DELAY + sim.ui32Latency;
+    printf("%lu InDataExchange, %lu response bytes, %lu us simulated latency, %s first controller\n",
+           ulIterations, (unsigned long) sim.szPayload, (unsigned long) sim.ui32Latency, sim.bNoLsbFirst ? "MSB" : "LSB");
+    printf("SPI messages (ioctls) per command: %.1f (%.1f not-ready status polls), %.1f bus bytes\n",
+           (sim.ulMessages - ulMessages) / dIterations, (sim.ulPolls - ulPolls) / dIterations, (sim.ulBytes - ulBytes) / dIterations);
+    printf("command time: avg %.0f us, max %lu us, %lu us past the frame readiness on average\n",
+           ui64Total / dIterations, (unsigned long) ui64Max, (unsigned long)(ui64Total / ulIterations - MIN(ui64Expected, ui64Total / ulIterations)));
+  }
+
+  nfc_close(pnd);
+  nfc_exit(context);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -69,10 +69,30 @@ const char *spi_ports_device_radix[] = { "spidev", NULL };
 #  endif
 
 
+// Software bit reversal (table), used when the controller has no LSB-first mode
+#define R2(n) (n), (n) + 2*64, (n) + 1*64, (n) + 3*64
+#define R4(n) R2(n), R2((n) + 2*16), R2((n) + 1*16), R2((n) + 3*16)
+#define R6(n) R4(n), R4((n) + 2*4), R4((n) + 1*4), R4((n) + 3*4)
+static const uint8_t abtBitReversal[256] = { R6(0), R6(2), R6(1), R6(3) };
+#undef R2
+#undef R4
+#undef R6
+
+// Initial size of the bit-reversed TX copy, enough for any PN53x frame
+#define SPI_TX_BUFFER_LEN 512
+
 struct spi_port_unix {
   int 			fd; 			// Serial port file descriptor
   //~ struct termios 	termios_backup; 	// Terminal info before using the port
   //~ struct termios 	termios_new; 		// Terminal info during the transaction
+
+  // Transfer context, reused by every message
+  struct spi_ioc_transfer tr[SPI_MAX_SEGMENTS];
+  uint8_t *pbtTx;               // bit-reversed TX bytes
+  size_t  szTx;                 // size of pbtTx
+  bool    lsb_first;            // controller is in LSB-first mode
+  bool    lsb_first_unsupported;// controller refused LSB-first mode
+  struct spi_stats stats;
 };
 
 #define SPI_DATA( X ) ((struct spi_port_unix *) X)
@@ -81,17 +101,22 @@ struct spi_port_unix {
 spi_port
 spi_open(const char *pcPortName)
 {
-  struct spi_port_unix *sp = malloc(sizeof(struct spi_port_unix));
+  struct spi_port_unix *sp = calloc(1, sizeof(struct spi_port_unix));
 
   if (sp == 0)
     return INVALID_SPI_PORT;
 
   sp->fd = open(pcPortName, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (sp->fd == -1) {
-    spi_close(sp);
+    free(sp);
     return INVALID_SPI_PORT;
   }
 
+  sp->szTx = SPI_TX_BUFFER_LEN;
+  if (!(sp->pbtTx = malloc(sp->szTx))) {
+    spi_close(sp);
+    return INVALID_SPI_PORT;
+  }
 
   return sp;
 }
@@ -114,10 +139,13 @@ void
 spi_set_mode(spi_port sp, const uint32_t uiPortMode)
 {
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "SPI port mode requested to be set to %d.", uiPortMode);
+  // SPI_IOC_WR_MODE takes the 8 low mode bits
+  const uint8_t btMode = (uint8_t) uiPortMode;
   int ret;
-  ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &uiPortMode);
+  ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_WR_MODE, &btMode);
 
   if (ret == -1)  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Error setting SPI mode.");
+  else SPI_DATA(sp)->lsb_first = (btMode & SPI_LSB_FIRST) != 0;
 
 }
 
@@ -139,113 +167,138 @@ void
 spi_close(const spi_port sp)
 {
   close(SPI_DATA(sp)->fd);
+  free(SPI_DATA(sp)->pbtTx);
   free(sp);
 }
 
 
 /**
- * @brief Perform bit reversal on one byte \a x
+ * @brief Put the controller in the bit order wanted by the caller, when it can
+ *
+ * Controllers which refuse SPI_LSB_FIRST are only asked once.
  *
- * @return reversed byte
+ * @return true if bytes have to be bit-reversed in software
  */
-
-static uint8_t
-bit_reversal(const uint8_t x)
+static bool
+spi_bit_order(struct spi_port_unix *sp, const bool lsb_first)
 {
-  uint8_t ret = x;
-  ret = (((ret & 0xaa) >> 1) | ((ret & 0x55) << 1));
-  ret = (((ret & 0xcc) >> 2) | ((ret & 0x33) << 2));
-  ret = (((ret & 0xf0) >> 4) | ((ret & 0x0f) << 4));
-  return ret;
+  if ((lsb_first != sp->lsb_first) && !(lsb_first && sp->lsb_first_unsupported)) {
+    uint8_t btLsb = lsb_first ? 1 : 0;
+    if ((ioctl(sp->fd, SPI_IOC_WR_LSB_FIRST, &btLsb) == 0) &&
+        (ioctl(sp->fd, SPI_IOC_RD_LSB_FIRST, &btLsb) == 0) && ((btLsb != 0) == lsb_first)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Controller switched to %s first bit order", lsb_first ? "LSB" : "MSB");
+      sp->lsb_first = lsb_first;
+    } else if (lsb_first) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Controller has no LSB first mode, bits will be reversed in software");
+      sp->lsb_first_unsupported = true;
+    }
+  }
+  return lsb_first != sp->lsb_first;
 }
 
-
-
-
-
 /**
- * @brief Send \a pbtTx content to SPI then receive data from SPI and copy data to \a pbtRx. CS line stays active	 between transfers as well as during transfers.
+ * @brief Send and receive the \a szSegments segments of \a pSegments in one SPI message
+ *
+ * CS line stays active from a segment to the next one, unless the segment has cs_change set.
+ * A segment may both send and receive (full duplex), but half-duplex controllers only accept
+ * one direction per segment.
  *
  * @return 0 on success, otherwise a driver error is returned
  */
 int
-spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, bool lsb_first)
+spi_transfer(spi_port sp, const struct spi_segment *pSegments, const size_t szSegments, bool lsb_first)
 {
-  size_t transfers = 0;
-  struct spi_ioc_transfer tr[2];
+  struct spi_port_unix *spu = SPI_DATA(sp);
+  size_t szTx = 0, szLen = 0;
 
+  if (szSegments > SPI_MAX_SEGMENTS)
+    return NFC_EINVARG;
+  if (szSegments == 0)
+    return NFC_SUCCESS;
 
-  uint8_t *pbtTxLSB = 0;
+  const bool reverse = spi_bit_order(spu, lsb_first);
 
-  if (szTx) {
-    LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
-    if (lsb_first) {
-      pbtTxLSB = malloc(szTx * sizeof(uint8_t));
-      if (!pbtTxLSB) {
+  if (reverse) {
+    for (size_t i = 0; i < szSegments; i++) {
+      if (pSegments[i].pbtTx)
+        szTx += pSegments[i].szLen;
+    }
+    if (szTx > spu->szTx) {
+      uint8_t *pbtTx = realloc(spu->pbtTx, szTx);
+      if (!pbtTx)
         return NFC_ESOFT;
-      }
+      spu->pbtTx = pbtTx;
+      spu->szTx = szTx;
+    }
+    szTx = 0;
+  }
 
-      size_t i;
-      for (i = 0; i < szTx; ++i) {
-        pbtTxLSB[i] = bit_reversal(pbtTx[i]);
+  for (size_t i = 0; i < szSegments; i++) {
+    const struct spi_segment *seg = &pSegments[i];
+    const uint8_t *pbtTx = seg->pbtTx;
+
+    if (pbtTx) {
+      LOG_HEX(LOG_GROUP, "TX", pbtTx, seg->szLen);
+      if (reverse) {
+        for (size_t n = 0; n < seg->szLen; n++)
+          spu->pbtTx[szTx + n] = abtBitReversal[pbtTx[n]];
+        pbtTx = spu->pbtTx + szTx;
+        szTx += seg->szLen;
       }
-
-      pbtTx = pbtTxLSB;
+      spu->stats.bytes_written += seg->szLen;
     }
-
-    struct spi_ioc_transfer tr_send = {
-      .tx_buf = (unsigned long) pbtTx,
-      .rx_buf = 0,
-      .len = szTx ,
-      .delay_usecs = 0,
-      .speed_hz = 0,
-      .bits_per_word = 0,
-    };
-    tr[transfers] = tr_send;
-
-    ++transfers;
+    memset(&spu->tr[i], 0, sizeof(spu->tr[i]));
+    spu->tr[i].tx_buf = (unsigned long) pbtTx;
+    spu->tr[i].rx_buf = (unsigned long) seg->pbtRx;
+    spu->tr[i].len = seg->szLen;
+    spu->tr[i].cs_change = seg->cs_change;
+    szLen += seg->szLen;
   }
 
-  if (szRx) {
-    struct spi_ioc_transfer tr_receive = {
-      .tx_buf = 0,
-      .rx_buf = (unsigned long) pbtRx,
-      .len = szRx,
-      .delay_usecs = 0,
-      .speed_hz = 0,
-      .bits_per_word = 0,
-    };
-    tr[transfers] = tr_receive;
-    ++transfers;
+  spu->stats.messages++;
+  int ret = ioctl(spu->fd, SPI_IOC_MESSAGE(szSegments), spu->tr);
+  if (ret != (int) szLen) {
+    return NFC_EIO;
   }
 
-
-
-  if (transfers) {
-    int ret = ioctl(SPI_DATA(sp)->fd, SPI_IOC_MESSAGE(transfers), tr);
-    if (szTx && lsb_first) {
-      free(pbtTxLSB);
+  // Reverse received bytes if needed
+  for (size_t i = 0; i < szSegments; i++) {
+    const struct spi_segment *seg = &pSegments[i];
+    if (seg->pbtRx) {
+      if (reverse) {
+        for (size_t n = 0; n < seg->szLen; n++)
+          seg->pbtRx[n] = abtBitReversal[seg->pbtRx[n]];
+      }
+      spu->stats.bytes_read += seg->szLen;
+      LOG_HEX(LOG_GROUP, "RX", seg->pbtRx, seg->szLen);
     }
+  }
 
-    if (ret != (int)(szRx + szTx)) {
-      return NFC_EIO;
-    }
+  return NFC_SUCCESS;
+}
 
-    // Reverse received bytes if needed
-    if (szRx) {
-      if (lsb_first) {
-        size_t i;
-        for (i = 0; i < szRx; ++i) {
-          pbtRx[i] = bit_reversal(pbtRx[i]);
-        }
-      }
+/**
+ * @brief Send \a pbtTx content to SPI then receive data from SPI and copy data to \a pbtRx. CS line stays active	 between transfers as well as during transfers.
+ *
+ * @return 0 on success, otherwise a driver error is returned
+ */
+int
+spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, bool lsb_first)
+{
+  struct spi_segment segments[2];
+  size_t szSegments = 0;
 
-      LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
-    }
+  if (szTx) {
+    const struct spi_segment send = { .pbtTx = pbtTx, .pbtRx = NULL, .szLen = szTx, .cs_change = false };
+    segments[szSegments++] = send;
   }
 
+  if (szRx) {
+    const struct spi_segment receive = { .pbtTx = NULL, .pbtRx = pbtRx, .szLen = szRx, .cs_change = false };
+    segments[szSegments++] = receive;
+  }
 
-  return NFC_SUCCESS;
+  return spi_transfer(sp, segments, szSegments, lsb_first);
 }
 
 
@@ -272,6 +325,15 @@ spi_send(spi_port sp, const uint8_t *pbtTx, const size_t szTx, bool lsb_first)
   return spi_send_receive(sp, pbtTx, szTx, 0, 0, lsb_first);
 }
 
+/**
+ * @brief Get the traffic counters of the SPI port
+ */
+void
+spi_get_stats(const spi_port sp, struct spi_stats *stats)
+{
+  *stats = SPI_DATA(sp)->stats;
+}
+
 
 char **
 spi_list_ports(void)
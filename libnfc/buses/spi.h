@@ -56,9 +56,30 @@ void    spi_set_speed(spi_port sp, const uint32_t uiPortSpeed);
 void    spi_set_mode(spi_port sp, const uint32_t uiPortMode);
 uint32_t spi_get_speed(const spi_port sp);
 
+// Largest number of segments in one SPI message
+#  define SPI_MAX_SEGMENTS 8
+
+// One segment of an SPI message, see spi_transfer()
+struct spi_segment {
+  const uint8_t *pbtTx;   // bytes to send, NULL to clock out zeroes
+  uint8_t *pbtRx;         // received bytes, NULL to drop them
+  size_t  szLen;
+  bool    cs_change;      // deselect the device between this segment and the next one
+};
+
 int     spi_receive(spi_port sp, uint8_t *pbtRx, const size_t szRx, bool lsb_first);
 int     spi_send(spi_port sp, const uint8_t *pbtTx, const size_t szTx, bool lsb_first);
 int     spi_send_receive(spi_port sp, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, bool lsb_first);
+int     spi_transfer(spi_port sp, const struct spi_segment *pSegments, const size_t szSegments, bool lsb_first);
+
+// Traffic on an SPI port since it was opened
+struct spi_stats {
+  unsigned long messages;   // SPI_IOC_MESSAGE ioctls
+  unsigned long bytes_read;
+  unsigned long bytes_written;
+};
+
+void    spi_get_stats(const spi_port sp, struct spi_stats *stats);
 
 char  **spi_list_ports(void);
 
@@ -0,0 +1,267 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file uart-bench.c
+ * @brief UART receive path benchmark over a pseudo-terminal pair
+ *
+ * A child process plays a PN532 on the master side of a pty: for every
+ * command frame it gets, it answers an ACK frame then a response frame.
+ * The parent drives the slave side through uart_send() / uart_receive(),
+ * parsing frames field by field like pn532_uart does, and reports the
+ * system calls spent per frame and the round-trip latency.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "uart.h"
+
+#ifdef LOG
+// uart.c is linked in directly, without the library log facility
+void
+log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
+{
+  (void) group;
+  (void) category;
+  (void) priority;
+  (void) format;
+}
+#endif
+
+static const uint8_t abtAck[] = { 0x00, 0x00, 0xff, 0x00, 0xff, 0x00 };
+// GetFirmwareVersion
+static const uint8_t abtCmd[] = { 0x00, 0x00, 0xff, 0x02, 0xfe, 0xd4, 0x02, 0x2a, 0x00 };
+
+static uint64_t
+now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+static int
+cmp_u64(const void *a, const void *b)
+{
+  const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+// Fake PN532: answer every command with an ACK, then a response of szPayload bytes
+static void
+responder(int fd, size_t szPayload)
+{
+  uint8_t abtFrame[8 + 255];
+  uint8_t abtIn[sizeof(abtCmd)];
+  size_t szFrame = 0;
+
+  abtFrame[szFrame++] = 0x00;
+  abtFrame[szFrame++] = 0x00;
+  abtFrame[szFrame++] = 0xff;
+  abtFrame[szFrame++] = (uint8_t)(szPayload + 2);
+  abtFrame[szFrame++] = (uint8_t)(256 - (szPayload + 2));
+  abtFrame[szFrame++] = 0xd5;
+  abtFrame[szFrame++] = 0x03;
+  uint8_t btDcs = 0xd5 + 0x03;
+  for (size_t n = 0; n < szPayload; n++) {
+    abtFrame[szFrame] = (uint8_t) n;
+    btDcs += abtFrame[szFrame++];
+  }
+  abtFrame[szFrame++] = (uint8_t)(256 - btDcs);
+  abtFrame[szFrame++] = 0x00;
+
+  for (;;) {
+    size_t szIn = 0;
+    while (szIn < sizeof(abtIn)) {
+      ssize_t res = read(fd, abtIn + szIn, sizeof(abtIn) - szIn);
+      if (res <= 0) {
+        if ((res < 0) && (errno == EINTR))
+          continue;
+        _exit(0);
+      }
+      szIn += (size_t) res;
+    }
+    // The ACK and the response leave the chip apart, as on a real UART
+    if ((write(fd, abtAck, sizeof(abtAck)) < 0) || (write(fd, abtFrame, szFrame) < 0))
+      _exit(1);
+  }
+}
+
+// Receive one response the way pn532_uart_receive() does: header, TFI/CC, payload, trailer
+static int
+receive_frame(serial_port sp, int *piAbortFd, uint8_t *pbtData, size_t *pszData)
+{
+  uint8_t abtRxBuf[6];
+  int res;
+
+  if ((res = uart_receive(sp, abtRxBuf, 6, piAbortFd, 1000)) < 0)
+    return res;
+  if (memcmp(abtRxBuf, abtAck, sizeof(abtAck)))
+    return NFC_EIO;
+  if ((res = uart_receive(sp, abtRxBuf, 5, piAbortFd, 1000)) < 0)
+    return res;
+  if ((abtRxBuf[3] + abtRxBuf[4]) != 256)
+    return NFC_EIO;
+  *pszData = abtRxBuf[3] - 2;
+  if ((res = uart_receive(sp, abtRxBuf, 2, NULL, 1000)) < 0)
+    return res;
+  if ((*pszData > 0) && ((res = uart_receive(sp, pbtData, *pszData, NULL, 1000)) < 0))
+    return res;
+  if ((res = uart_receive(sp, abtRxBuf, 2, NULL, 1000)) < 0)
+    return res;
+  uint8_t btDcs = 0xd5 + 0x03 + abtRxBuf[0];
+  for (size_t n = 0; n < *pszData; n++)
+    btDcs += pbtData[n];
+  return (btDcs == 0) ? NFC_SUCCESS : NFC_EIO;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned long ulIterations = 10000;
+  size_t szPayload = 200;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:l:h")) != -1) {
+    switch (opt) {
+      case 'n':
+        ulIterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        szPayload = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n iterations] [-l payload length (0-253)]\n", argv[0]);
+        return (opt == 'h') ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  if ((ulIterations == 0) || (szPayload > 253)) {
+    fprintf(stderr, "Invalid iteration count or payload length\n");
+    return EXIT_FAILURE;
+  }
+
+  int iMaster = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((iMaster < 0) || (grantpt(iMaster) < 0) || (unlockpt(iMaster) < 0)) {
+    perror("posix_openpt");
+    return EXIT_FAILURE;
+  }
+  const char *pcSlave = ptsname(iMaster);
+
+  serial_port sp = uart_open(pcSlave);
+  if ((sp == INVALID_SERIAL_PORT) || (sp == CLAIMED_SERIAL_PORT)) {
+    fprintf(stderr, "Unable to open %s\n", pcSlave);
+    return EXIT_FAILURE;
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return EXIT_FAILURE;
+  }
+  if (pid == 0) {
+    responder(iMaster, szPayload);
+    _exit(0);
+  }
+
+  int iAbortFds[2];
+  if (uart_abort_fd_open(iAbortFds) < 0) {
+    perror("uart_abort_fd_open");
+    return EXIT_FAILURE;
+  }
+
+  uint64_t *pui64Latency = malloc(ulIterations * sizeof(uint64_t));
+  if (!pui64Latency) {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+  uint8_t abtData[255];
+  size_t szData;
+  int res = NFC_SUCCESS;
+  struct uart_stats before, after;
+
+  uart_get_stats(sp, &before);
+  const uint64_t ui64Start = now_us();
+  for (unsigned long n = 0; n < ulIterations; n++) {
+    const uint64_t t0 = now_us();
+    if ((res = uart_send(sp, abtCmd, sizeof(abtCmd), 0)) < 0)
+      break;
+    if ((res = receive_frame(sp, &iAbortFds[0], abtData, &szData)) < 0)
+      break;
+    pui64Latency[n] = now_us() - t0;
+  }
+  const uint64_t ui64Elapsed = now_us() - ui64Start;
+  uart_get_stats(sp, &after);
+
+  if (res < 0) {
+    fprintf(stderr, "Transaction failed: %d\n", res);
+  } else {
+    const double dFrames = (double) ulIterations * 2; // ACK + response
+    qsort(pui64Latency, ulIterations, sizeof(uint64_t), cmp_u64);
+    printf("%lu transactions, %lu response bytes each, %.3f s\n", ulIterations, (unsigned long) szPayload, ui64Elapsed / 1e6);
+    printf("syscalls per frame: %.2f poll, %.2f read (%.2f per transaction, write excluded)\n",
+           (after.polls - before.polls) / dFrames, (after.reads - before.reads) / dFrames,
+           ((after.polls - before.polls) + (after.reads - before.reads)) / (double) ulIterations);
+    printf("bytes per read: %.1f\n", (double)(after.bytes - before.bytes) / (double)(after.reads - before.reads));
+    printf("round trip: min %lu us, p50 %lu us, p99 %lu us, max %lu us\n",
+           (unsigned long) pui64Latency[0], (unsigned long) pui64Latency[ulIterations / 2],
+           (unsigned long) pui64Latency[(ulIterations * 99) / 100], (unsigned long) pui64Latency[ulIterations - 1]);
+
+    // The abort descriptor outlives an abort: the wait after it is aborted, the next one is not
+    uart_abort_fd_signal(iAbortFds);
+    int abort_res = uart_receive(sp, abtData, 1, &iAbortFds[0], 1000);
+    int next_res = uart_send(sp, abtCmd, sizeof(abtCmd), 0);
+    if (next_res == 0)
+      next_res = receive_frame(sp, &iAbortFds[0], abtData, &szData);
+    printf("abort: %s, next transaction: %s\n", (abort_res == NFC_EOPABORTED) ? "ok" : "FAILED", (next_res == 0) ? "ok" : "FAILED");
+    if ((abort_res != NFC_EOPABORTED) || (next_res != 0))
+      res = NFC_ESOFT;
+  }
+
+  free(pui64Latency);
+  uart_abort_fd_close(iAbortFds);
+  uart_close(sp);
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  close(iMaster);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -37,15 +37,19 @@
 #include "uart.h"
 
 #include <sys/ioctl.h>
-#include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#if defined (__linux__)
+#  include <sys/eventfd.h>
+#endif
 #include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <termios.h>
 #include <unistd.h>
@@ -86,10 +90,17 @@ const char *serial_ports_device_radix[] = { "ttyUSB", "ttyS", "ttyACM", "ttyAMA"
 // Work-around to claim uart interface using the c_iflag (software input processing) from the termios struct
 #  define CCLAIMED 0x80000000
 
+// Read-ahead buffer size, must be a power of two holding at least one extended PN53x frame
+#  define UART_RING_SIZE 1024
+
 struct serial_port_unix {
   int 			fd; 			// Serial port file descriptor
   struct termios 	termios_backup; 	// Terminal info before using the port
   struct termios 	termios_new; 		// Terminal info during the transaction
+  uint8_t		ring[UART_RING_SIZE];	// Bytes read ahead of the frame parsers
+  size_t		ring_head;		// Free running read index
+  size_t		ring_tail;		// Free running write index
+  struct uart_stats	stats;
 };
 
 #define UART_DATA( X ) ((struct serial_port_unix *) X)
@@ -104,6 +115,9 @@ uart_open(const char *pcPortName)
   if (sp == 0)
     return INVALID_SERIAL_PORT;
 
+  sp->ring_head = sp->ring_tail = 0;
+  memset(&sp->stats, 0, sizeof(sp->stats));
+
   sp->fd = open(pcPortName, O_RDWR | O_NOCTTY | O_NONBLOCK);
   if (sp->fd == -1) {
     uart_close_ext(sp, false);
@@ -148,6 +162,9 @@ uart_flush_input(serial_port sp, bool wait)
     msleep(50); // 50 ms
   }
 
+  // Drop what was read ahead
+  UART_DATA(sp)->ring_head = UART_DATA(sp)->ring_tail;
+
   // This line seems to produce absolutely no effect on my system (GNU/Linux 2.6.35)
   tcflush(UART_DATA(sp)->fd, TCIFLUSH);
   // So, I wrote this byte-eater
@@ -284,42 +301,149 @@ uart_close(const serial_port sp)
   uart_close_ext(sp, true);
 }
 
+/**
+ * @brief Create the persistent abort descriptor(s) of a driver
+ *
+ * \a fds[0] is the descriptor to give (by address) to uart_receive() as \a abort_p,
+ * \a fds[1] the one uart_abort_fd_signal() writes to. Under Linux both are the same eventfd.
+ * @return 0 on success, otherwise NFC_ESOFT
+ */
+int
+uart_abort_fd_open(int fds[2])
+{
+#if defined (__linux__)
+  if ((fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+    return NFC_ESOFT;
+  }
+  fds[1] = fds[0];
+#else
+  if (pipe(fds) < 0) {
+    return NFC_ESOFT;
+  }
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+#endif
+  return NFC_SUCCESS;
+}
+
+/**
+ * @brief Wake up the uart_receive() waiting on \a fds, or the next one to wait on it
+ */
+void
+uart_abort_fd_signal(const int fds[2])
+{
+#if defined (__linux__)
+  const uint64_t one = 1;
+  if (write(fds[1], &one, sizeof(one)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to signal abort: %s", strerror(errno));
+  }
+#else
+  const uint8_t one = 1;
+  if (write(fds[1], &one, sizeof(one)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to signal abort: %s", strerror(errno));
+  }
+#endif
+}
+
+void
+uart_abort_fd_close(int fds[2])
+{
+  close(fds[0]);
+  if (fds[1] != fds[0]) {
+    close(fds[1]);
+  }
+  fds[0] = fds[1] = -1;
+}
+
+// Consume pending abort requests, the descriptor stays usable
+static void
+uart_abort_fd_clear(int fd)
+{
+  uint64_t buf;
+  while (read(fd, &buf, sizeof(buf)) > 0) {
+#if defined (__linux__)
+    break; // an eventfd read resets the counter
+#endif
+  }
+}
+
+// Move up to szRx read-ahead bytes to pbtRx
+static size_t
+uart_ring_take(struct serial_port_unix *sp, uint8_t *pbtRx, size_t szRx)
+{
+  size_t szTaken = 0;
+  while ((szTaken < szRx) && (sp->ring_head != sp->ring_tail)) {
+    const size_t szOffset = sp->ring_head & (UART_RING_SIZE - 1);
+    size_t szChunk = MIN(sp->ring_tail - sp->ring_head, UART_RING_SIZE - szOffset);
+    szChunk = MIN(szChunk, szRx - szTaken);
+    memcpy(pbtRx + szTaken, sp->ring + szOffset, szChunk);
+    sp->ring_head += szChunk;
+    szTaken += szChunk;
+  }
+  return szTaken;
+}
+
+// Read everything available (up to the free room) with a single read
+static ssize_t
+uart_ring_fill(struct serial_port_unix *sp)
+{
+  const size_t szFree = UART_RING_SIZE - (sp->ring_tail - sp->ring_head);
+  const size_t szOffset = sp->ring_tail & (UART_RING_SIZE - 1);
+  struct iovec iov[2];
+  int iovcnt = 1;
+
+  iov[0].iov_base = sp->ring + szOffset;
+  iov[0].iov_len = MIN(szFree, UART_RING_SIZE - szOffset);
+  if (iov[0].iov_len < szFree) {
+    // Free room wraps around the end of the ring
+    iov[1].iov_base = sp->ring;
+    iov[1].iov_len = szFree - iov[0].iov_len;
+    iovcnt = 2;
+  }
+  sp->stats.reads++;
+  ssize_t res = readv(sp->fd, iov, iovcnt);
+  if (res > 0) {
+    sp->ring_tail += (size_t) res;
+    sp->stats.bytes += (size_t) res;
+  }
+  return res;
+}
+
 /**
  * @brief Receive data from UART and copy data to \a pbtRx
  *
+ * Bytes are served from the port read-ahead buffer first. When it runs dry, the
+ * port is polled and everything it holds is read at once, so a frame parser
+ * asking for a header, a length, a payload and a trailer in turn usually costs a
+ * single poll() and read() per frame.
+ * If \a abort_p is not NULL, it points to a descriptor from uart_abort_fd_open():
+ * a signal on it ends the wait with NFC_EOPABORTED.
+ *
  * @return 0 on success, otherwise driver error code
  */
 int
 uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout)
 {
-  int iAbortFd = abort_p ? *((int *)abort_p) : 0;
-  int received_bytes_count = 0;
-  int available_bytes_count = 0;
-  const int expected_bytes_count = (int)szRx;
+  int iAbortFd = abort_p ? *((int *)abort_p) : -1;
+  size_t received_bytes_count = 0;
+  struct pollfd pfds[2];
   int res;
-  fd_set rfds;
-  do {
-select:
-    // Reset file descriptor
-    FD_ZERO(&rfds);
-    FD_SET(UART_DATA(sp)->fd, &rfds);
-
-    if (iAbortFd) {
-      FD_SET(iAbortFd, &rfds);
-    }
 
-    struct timeval timeout_tv;
-    if (timeout > 0) {
-      timeout_tv.tv_sec = (timeout / 1000);
-      timeout_tv.tv_usec = ((timeout % 1000) * 1000);
-    }
+  while ((received_bytes_count += uart_ring_take(UART_DATA(sp), pbtRx + received_bytes_count, szRx - received_bytes_count)) < szRx) {
+    pfds[0].fd = UART_DATA(sp)->fd;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    pfds[1].fd = iAbortFd;
+    pfds[1].events = POLLIN;
+    pfds[1].revents = 0;
 
-    res = select(MAX(UART_DATA(sp)->fd, iAbortFd) + 1, &rfds, NULL, NULL, timeout ? &timeout_tv : NULL);
+    UART_DATA(sp)->stats.polls++;
+    res = poll(pfds, (iAbortFd >= 0) ? 2 : 1, (timeout > 0) ? timeout : -1);
 
     if ((res < 0) && (EINTR == errno)) {
       // The system call was interupted by a signal and a signal handler was
       // run.  Restart the interupted system call.
-      goto select;
+      continue;
     }
 
     // Read error
@@ -333,31 +457,33 @@ select:
       return NFC_ETIMEOUT;
     }
 
-    if (FD_ISSET(iAbortFd, &rfds)) {
+    if ((iAbortFd >= 0) && (pfds[1].revents & POLLIN)) {
       // Abort requested
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Abort!");
-      close(iAbortFd);
+      uart_abort_fd_clear(iAbortFd);
       return NFC_EOPABORTED;
     }
 
-    // Retrieve the count of the incoming bytes
-    res = ioctl(UART_DATA(sp)->fd, FIONREAD, &available_bytes_count);
-    if (res != 0) {
-      return NFC_EIO;
-    }
     // There is something available, read the data
-    res = read(UART_DATA(sp)->fd, pbtRx + received_bytes_count, MIN(available_bytes_count, (expected_bytes_count - received_bytes_count)));
+    res = uart_ring_fill(UART_DATA(sp));
+    if ((res < 0) && ((EAGAIN == errno) || (EINTR == errno))) {
+      continue;
+    }
     // Stop if the OS has some troubles reading the data
     if (res <= 0) {
       return NFC_EIO;
     }
-    received_bytes_count += res;
-
-  } while (expected_bytes_count > received_bytes_count);
+  }
   LOG_HEX(LOG_GROUP, "RX", pbtRx, szRx);
   return NFC_SUCCESS;
 }
 
+void
+uart_get_stats(const serial_port sp, struct uart_stats *stats)
+{
+  *stats = UART_DATA(sp)->stats;
+}
+
 /**
  * @brief Send \a pbtTx content to UART
  *
@@ -368,6 +494,7 @@ uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout)
 {
   (void) timeout;
   LOG_HEX(LOG_GROUP, "TX", pbtTx, szTx);
+  UART_DATA(sp)->stats.writes++;
   if ((int) szTx == write(UART_DATA(sp)->fd, pbtTx, szTx))
     return NFC_SUCCESS;
   else
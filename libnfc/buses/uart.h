@@ -57,6 +57,20 @@ uint32_t uart_get_speed(const serial_port sp);
 int     uart_receive(serial_port sp, uint8_t *pbtRx, const size_t szRx, void *abort_p, int timeout);
 int     uart_send(serial_port sp, const uint8_t *pbtTx, const size_t szTx, int timeout);
 
+// Persistent abort descriptors: an abort requested between two commands ends the next wait
+int     uart_abort_fd_open(int fds[2]);
+void    uart_abort_fd_signal(const int fds[2]);
+void    uart_abort_fd_close(int fds[2]);
+
+// System calls issued on a port since it was opened
+struct uart_stats {
+  unsigned long polls;
+  unsigned long reads;
+  unsigned long writes;
+  unsigned long bytes;    // received bytes
+};
+void    uart_get_stats(const serial_port sp, struct uart_stats *stats);
+
 char  **uart_list_ports(void);
 
 #endif // __NFC_BUS_UART_H__
@@ -35,35 +35,44 @@
 #endif // HAVE_CONFIG_H
 
 #include <stdlib.h>
+#include <pthread.h>
 
 #include "usbbus.h"
 #include "log.h"
 #define LOG_CATEGORY "libnfc.buses.usbbus"
 #define LOG_GROUP    NFC_LOG_GROUP_DRIVER
 
-int usb_prepare(void)
+static pthread_once_t usb_once = PTHREAD_ONCE_INIT;
+// libusb-0.1 rebuilds its global bus list in place
+static pthread_mutex_t usb_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+usb_initialize(void)
 {
-  static bool usb_initialized = false;
-  if (!usb_initialized) {
+  usb_init();
 
 #ifdef ENVVARS
-    char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
-    // Set libusb debug only if asked explicitely:
-    // LIBUSB_LOG_LEVEL=12288 (= NFC_LOG_PRIORITY_DEBUG * 2 ^ NFC_LOG_GROUP_LIBUSB)
-    if (env_log_level && (((atoi(env_log_level) >> (NFC_LOG_GROUP_LIBUSB * 2)) & 0x00000003) >= NFC_LOG_PRIORITY_DEBUG)) {
-      setenv("USB_DEBUG", "255", 1);
-    }
+  char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
+  // Set libusb debug only if asked explicitely:
+  // LIBUSB_LOG_LEVEL=12288 (= NFC_LOG_PRIORITY_DEBUG * 2 ^ NFC_LOG_GROUP_LIBUSB)
+  if (env_log_level && (((atoi(env_log_level) >> (NFC_LOG_GROUP_LIBUSB * 2)) & 0x00000003) >= NFC_LOG_PRIORITY_DEBUG)) {
+    // Same as USB_DEBUG=255, without writing the environment other threads read
+    usb_set_debug(255);
+  }
 #endif
+}
 
-    usb_init();
-    usb_initialized = true;
-  }
+int usb_prepare(void)
+{
+  pthread_once(&usb_once, usb_initialize);
 
   int res;
+  pthread_mutex_lock(&usb_lock);
   // usb_find_busses will find all of the busses on the system. Returns the
   // number of changes since previous call to this function (total of new
   // busses and busses removed).
   if ((res = usb_find_busses()) < 0) {
+    pthread_mutex_unlock(&usb_lock);
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB busses (%s)", _usb_strerror(res));
     return -1;
   }
@@ -71,9 +80,11 @@ int usb_prepare(void)
   // called after usb_find_busses. Returns the number of changes since the
   // previous call to this function (total of new device and devices removed).
   if ((res = usb_find_devices()) < 0) {
+    pthread_mutex_unlock(&usb_lock);
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to find USB devices (%s)", _usb_strerror(res));
     return -1;
   }
+  pthread_mutex_unlock(&usb_lock);
   return 0;
 }
 
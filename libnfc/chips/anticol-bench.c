@@ -0,0 +1,530 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file anticol-bench.c
+ * @brief Software ISO14443A anticollision benchmark against simulated tag stacks
+ *
+ * This program is linked with the library objects and registers a driver
+ * ("sim") whose PN532 chip is simulated at the command level: registers,
+ * RFConfiguration timings and InCommunicateThru with bit framing, RxAlign,
+ * bit collisions and the CIU Coll register. Its field holds a stack of
+ * ISO14443A tags with 4, 7 or 10 byte UIDs implementing the REQA,
+ * ANTICOLLISION, SELECT and HLTA state machine. Every exchange with the chip
+ * costs a fixed time, plus the chip RF timeout when no tag answers.
+ * nfc_initiator_inventory_iso14443a() must return every UID of the stack.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define SIM_DRIVER_NAME "sim"
+#define SIM_MAX_TAGS 256
+
+enum sim_tag_state {
+  TAG_IDLE,
+  TAG_READY,
+  TAG_ACTIVE,
+  TAG_HALT,
+};
+
+struct sim_tag {
+  uint8_t  abtUid[10];
+  size_t   szUid;
+  uint8_t  btSak;
+  enum sim_tag_state state;
+  size_t   szLevel;           // cascade level while READY
+};
+
+struct sim_data {
+  uint8_t  abtRegs[256];      // CIU registers, 0x6300 to 0x63ff
+  uint8_t  ui8RetryTimeout;   // RFConfiguration timing, non-DEP communications
+  uint8_t  abtResponse[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t   szResponse;
+  struct sim_tag tags[SIM_MAX_TAGS];
+  size_t   szTags;
+  unsigned long ulFrames;     // RF frames sent
+  uint64_t ui64Time;          // simulated time, in µs
+};
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+#define REG(sd, reg) ((sd)->abtRegs[(reg) & 0xff])
+
+static long lLatency = 1000; // µs per exchange with the chip
+
+// Bits levels blocks: CT (0x88) and 3 UID bytes on the upper levels, then BCC
+static size_t
+sim_tag_levels(const struct sim_tag *pt)
+{
+  return (pt->szUid == 4) ? 1 : (pt->szUid == 7) ? 2 : 3;
+}
+
+static void
+sim_tag_block(const struct sim_tag *pt, const size_t szLevel, uint8_t abtBlock[5])
+{
+  const size_t szLevels = sim_tag_levels(pt);
+  if (szLevel + 1 < szLevels) {
+    abtBlock[0] = 0x88;
+    memcpy(abtBlock + 1, pt->abtUid + 3 * szLevel, 3);
+  } else {
+    memcpy(abtBlock, pt->abtUid + 3 * szLevel, 4);
+  }
+  abtBlock[4] = abtBlock[0] ^ abtBlock[1] ^ abtBlock[2] ^ abtBlock[3];
+}
+
+static int
+bit_get(const uint8_t *pbt, const size_t szBit)
+{
+  return (pbt[szBit / 8] >> (szBit % 8)) & 1;
+}
+
+static void
+bit_set(uint8_t *pbt, const size_t szBit, const int iValue)
+{
+  if (iValue)
+    pbt[szBit / 8] |= 1 << (szBit % 8);
+  else
+    pbt[szBit / 8] &= ~(1 << (szBit % 8));
+}
+
+/*
+ * Answer of the tags: each one sends szBits bits from its pbtBits, stored
+ * from bit ui8RxAlign of the chip buffer. Sets the InCommunicateThru status
+ * and the Coll register like the CIU does.
+ */
+static void
+sim_rf_answer(struct sim_data *sd, uint8_t *apbtBits[], const size_t szAnswers, const size_t szBits, const uint8_t ui8RxAlign)
+{
+  uint8_t *pbtData = sd->abtResponse + 1;
+  const size_t szTotal = ui8RxAlign + szBits;
+
+  sd->ulFrames++;
+  if (szAnswers == 0) {
+    // Nobody answers: the chip waits for its timeout
+    sd->ui64Time += (sd->ui8RetryTimeout ? (100 << (sd->ui8RetryTimeout - 1)) : 0);
+    sd->abtResponse[0] = ETIMEOUT;
+    sd->szResponse = 1;
+    return;
+  }
+  memset(pbtData, 0, (szTotal + 7) / 8);
+  sd->abtResponse[0] = 0x00;
+  REG(sd, PN53X_REG_CIU_Coll) = 0xa0; // ValuesAfterColl, CollPosNotValid
+  for (size_t n = 0; n < szBits; n++) {
+    int iBit = bit_get(apbtBits[0], n);
+    for (size_t a = 1; a < szAnswers; a++) {
+      if (bit_get(apbtBits[a], n) != iBit) {
+        sd->abtResponse[0] = EBITCOLL;
+        REG(sd, PN53X_REG_CIU_Coll) = 0x80 | ((ui8RxAlign + n + 1) & 0x1f);
+        sd->szResponse = 1 + (szTotal + 7) / 8;
+        return;
+      }
+    }
+    bit_set(pbtData, ui8RxAlign + n, iBit);
+  }
+  sd->szResponse = 1 + (szTotal + 7) / 8;
+}
+
+static void
+sim_rf_frame(struct sim_data *sd, const uint8_t *pbtFrame, const size_t szFrame)
+{
+  const uint8_t ui8TxBits = REG(sd, PN53X_REG_CIU_BitFraming) & 0x07;
+  const uint8_t ui8RxAlign = (REG(sd, PN53X_REG_CIU_BitFraming) >> 4) & 0x07;
+  const size_t szBits = szFrame * 8 - (ui8TxBits ? 8 - ui8TxBits : 0);
+  uint8_t abtAnswers[SIM_MAX_TAGS][5];
+  uint8_t *apbtAnswers[SIM_MAX_TAGS];
+  size_t  szAnswers = 0;
+  uint8_t abtCrc[2];
+
+  // The chip would add and check CRCs itself: tags would not understand these frames
+  if ((REG(sd, PN53X_REG_CIU_TxMode) & SYMBOL_TX_CRC_ENABLE) || (szFrame == 0)) {
+    sim_rf_answer(sd, NULL, 0, 0, 0);
+    return;
+  }
+
+  if ((szBits == 7) && ((pbtFrame[0] == 0x26) || (pbtFrame[0] == 0x52))) {
+    // REQA, WUPA
+    for (size_t t = 0; t < sd->szTags; t++) {
+      struct sim_tag *pt = &sd->tags[t];
+      if ((pt->state == TAG_HALT) && (pbtFrame[0] == 0x26))
+        continue;
+      pt->state = TAG_READY;
+      pt->szLevel = 0;
+      abtAnswers[szAnswers][0] = (uint8_t)((sim_tag_levels(pt) - 1) << 6) | 0x04;
+      abtAnswers[szAnswers][1] = 0x00;
+      apbtAnswers[szAnswers] = abtAnswers[szAnswers];
+      szAnswers++;
+    }
+    sim_rf_answer(sd, apbtAnswers, szAnswers, 16, ui8RxAlign);
+    return;
+  }
+
+  if ((szBits == 32) && (pbtFrame[0] == 0x50) && (pbtFrame[1] == 0x00)) {
+    // HLTA
+    iso14443a_crc((uint8_t *) pbtFrame, 2, abtCrc);
+    for (size_t t = 0; t < sd->szTags; t++) {
+      if ((sd->tags[t].state == TAG_ACTIVE) && !memcmp(pbtFrame + 2, abtCrc, 2))
+        sd->tags[t].state = TAG_HALT;
+    }
+    sim_rf_answer(sd, NULL, 0, 0, 0);
+    return;
+  }
+
+  if ((szBits >= 16) && ((pbtFrame[0] == 0x93) || (pbtFrame[0] == 0x95) || (pbtFrame[0] == 0x97))) {
+    const size_t szLevel = (pbtFrame[0] - 0x93) / 2;
+    if ((pbtFrame[1] == 0x70) && (szBits == 72)) {
+      // SELECT
+      iso14443a_crc((uint8_t *) pbtFrame, 7, abtCrc);
+      if (memcmp(pbtFrame + 7, abtCrc, 2)) {
+        sim_rf_answer(sd, NULL, 0, 0, 0);
+        return;
+      }
+      for (size_t t = 0; t < sd->szTags; t++) {
+        struct sim_tag *pt = &sd->tags[t];
+        uint8_t abtBlock[5];
+        if ((pt->state != TAG_READY) || (pt->szLevel != szLevel))
+          continue;
+        sim_tag_block(pt, szLevel, abtBlock);
+        if (memcmp(abtBlock, pbtFrame + 2, 5)) {
+          pt->state = TAG_IDLE;
+          continue;
+        }
+        uint8_t *pbtSak = abtAnswers[szAnswers];
+        if (szLevel + 1 < sim_tag_levels(pt)) {
+          pt->szLevel++;
+          pbtSak[0] = 0x04;
+        } else {
+          pt->state = TAG_ACTIVE;
+          pbtSak[0] = pt->btSak;
+        }
+        iso14443a_crc_append(pbtSak, 1);
+        apbtAnswers[szAnswers] = pbtSak;
+        szAnswers++;
+      }
+      sim_rf_answer(sd, apbtAnswers, szAnswers, 24, ui8RxAlign);
+      return;
+    }
+    // ANTICOLLISION: NVB gives the number of bits sent, SEL and NVB included
+    const size_t szKnown = ((pbtFrame[1] >> 4) - 2) * 8 + (pbtFrame[1] & 0x07);
+    if ((pbtFrame[1] >= 0x20) && (pbtFrame[1] < 0x70) && (szBits == 16 + szKnown)) {
+      for (size_t t = 0; t < sd->szTags; t++) {
+        struct sim_tag *pt = &sd->tags[t];
+        uint8_t abtBlock[5];
+        if ((pt->state != TAG_READY) || (pt->szLevel != szLevel))
+          continue;
+        sim_tag_block(pt, szLevel, abtBlock);
+        size_t n;
+        for (n = 0; (n < szKnown) && (bit_get(abtBlock, n) == bit_get(pbtFrame + 2, n)); n++)
+          ;
+        if (n < szKnown)
+          continue;
+        // The tag sends the rest of its block
+        memset(abtAnswers[szAnswers], 0, 5);
+        for (n = szKnown; n < 40; n++)
+          bit_set(abtAnswers[szAnswers], n - szKnown, bit_get(abtBlock, n));
+        apbtAnswers[szAnswers] = abtAnswers[szAnswers];
+        szAnswers++;
+      }
+      sim_rf_answer(sd, apbtAnswers, szAnswers, 40 - szKnown, ui8RxAlign);
+      return;
+    }
+  }
+  // Anything else is ignored by the tags
+  sim_rf_answer(sd, NULL, 0, 0, 0);
+}
+
+static int
+sim_send(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+
+  sd->ui64Time += lLatency;
+  sd->szResponse = 0;
+  switch (pbtData[0]) {
+    case ReadRegister:
+      for (size_t n = 1; n + 1 < szData; n += 2)
+        sd->abtResponse[sd->szResponse++] = sd->abtRegs[pbtData[n + 1]];
+      break;
+    case WriteRegister:
+      for (size_t n = 1; n + 2 < szData; n += 3)
+        sd->abtRegs[pbtData[n + 1]] = pbtData[n + 2];
+      break;
+    case RFConfiguration:
+      if ((szData >= 5) && (pbtData[1] == RFCI_TIMING))
+        sd->ui8RetryTimeout = pbtData[4];
+      break;
+    case InCommunicateThru:
+      sim_rf_frame(sd, pbtData + 1, szData - 1);
+      break;
+    default:
+      // Other commands succeed without data
+      break;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+sim_receive(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  if (sd->szResponse > szDataLen)
+    return NFC_EOVFLOW;
+  memcpy(pbtData, sd->abtResponse, sd->szResponse);
+  return (int) sd->szResponse;
+}
+
+static const struct pn53x_io sim_io = {
+  .send    = sim_send,
+  .receive = sim_receive,
+};
+
+static const struct nfc_driver sim_driver;
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  if (connstrings_len == 0)
+    return 0;
+  snprintf(connstrings[0], sizeof(nfc_connstring), "%s:0", SIM_DRIVER_NAME);
+  return 1;
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd)
+    return NULL;
+  pnd->driver_data = calloc(1, sizeof(struct sim_data));
+  if (!pnd->driver_data || !pn53x_data_new(pnd, &sim_io)) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  DRIVER_DATA(pnd)->ui8RetryTimeout = 0x0a;
+  snprintf(pnd->name, sizeof(pnd->name), "simulated PN532 %s", connstring);
+  pnd->driver = &sim_driver;
+  return pnd;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .device_set_property_bool         = pn53x_set_property_bool,
+  .device_set_property_int          = pn53x_set_property_int,
+};
+
+enum uid_kind {
+  UID_RANDOM4,      // 4 byte random UIDs
+  UID_SERIAL7,      // 7 byte UIDs of one manufacturer, consecutive serial numbers
+  UID_MIXED,        // 4, 7 and 10 byte random UIDs
+};
+
+static const char *
+uid_kind_name(const enum uid_kind kind)
+{
+  switch (kind) {
+    case UID_RANDOM4:
+      return "4-byte random";
+    case UID_SERIAL7:
+      return "7-byte consecutive";
+    case UID_MIXED:
+      return "4/7/10-byte mixed";
+  }
+  return "";
+}
+
+static void
+stack_fill(struct sim_data *sd, const size_t szTags, const enum uid_kind kind)
+{
+  sd->szTags = szTags;
+  for (size_t t = 0; t < szTags; t++) {
+    struct sim_tag *pt = &sd->tags[t];
+    memset(pt, 0, sizeof(*pt));
+    switch (kind) {
+      case UID_RANDOM4:
+        pt->szUid = 4;
+        break;
+      case UID_SERIAL7:
+        pt->szUid = 7;
+        break;
+      case UID_MIXED:
+        pt->szUid = (t % 3 == 0) ? 4 : (t % 3 == 1) ? 7 : 10;
+        break;
+    }
+    for (;;) {
+      for (size_t n = 0; n < pt->szUid; n++)
+        pt->abtUid[n] = (uint8_t) rand();
+      if (kind == UID_SERIAL7) {
+        // NXP, then a serial number: all tags share their first cascade level
+        memset(pt->abtUid, 0, 7);
+        pt->abtUid[0] = 0x04;
+        pt->abtUid[5] = (uint8_t)((0x1234 + t) >> 8);
+        pt->abtUid[6] = (uint8_t)(0x1234 + t);
+      }
+      // The cascade tag can not start a single size UID
+      if ((pt->szUid == 4) && (pt->abtUid[0] == 0x88))
+        continue;
+      // Nor two tags have the same UID
+      size_t u;
+      for (u = 0; u < t; u++) {
+        if ((sd->tags[u].szUid == pt->szUid) && !memcmp(sd->tags[u].abtUid, pt->abtUid, pt->szUid))
+          break;
+      }
+      if (u == t)
+        break;
+    }
+    pt->btSak = (pt->szUid == 4) ? 0x08 : 0x00;
+    pt->state = TAG_IDLE;
+  }
+}
+
+static int
+bench(nfc_device *pnd, const size_t szTags, const enum uid_kind kind)
+{
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  nfc_target ant[SIM_MAX_TAGS + 1];
+  nfc_device_stats before, after;
+
+  stack_fill(sd, szTags, kind);
+  sd->ulFrames = 0;
+  sd->ui64Time = 0;
+  nfc_device_get_stats(pnd, &before);
+  const int res = nfc_initiator_inventory_iso14443a(pnd, ant, SIM_MAX_TAGS + 1);
+  nfc_device_get_stats(pnd, &after);
+  if (res < 0) {
+    nfc_perror(pnd, "nfc_initiator_inventory_iso14443a");
+    return -1;
+  }
+
+  // Every tag must be found once, with its UID and SAK
+  size_t szMissing = 0;
+  for (size_t t = 0; t < szTags; t++) {
+    const struct sim_tag *pt = &sd->tags[t];
+    size_t szSeen = 0;
+    for (int n = 0; n < res; n++) {
+      if ((ant[n].nti.nai.szUidLen == pt->szUid) && !memcmp(ant[n].nti.nai.abtUid, pt->abtUid, pt->szUid) &&
+          (ant[n].nti.nai.btSak == pt->btSak))
+        szSeen++;
+    }
+    if (szSeen != 1)
+      szMissing++;
+  }
+
+  const unsigned long ulRoundTrips = (unsigned long)(after.tx_frames - before.tx_frames);
+  printf("%4lu tags %-19s %4d found %4lu wrong %6lu round trips %7.1f per tag %6lu RF frames %8.1f ms %7.1f tags/s\n",
+         (unsigned long) szTags, uid_kind_name(kind), res, (unsigned long) szMissing,
+         ulRoundTrips, szTags ? (double) ulRoundTrips / szTags : 0.0, sd->ulFrames,
+         sd->ui64Time / 1000.0, sd->ui64Time ? szTags * 1e6 / sd->ui64Time : 0.0);
+  return ((size_t) res != szTags) || szMissing ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  nfc_context *context;
+  nfc_connstring connstring;
+  nfc_device *pnd;
+  int opt;
+  int res = 0;
+
+  while ((opt = getopt(argc, argv, "l:")) != -1) {
+    switch (opt) {
+      case 'l':
+        lLatency = strtol(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-l chip exchange latency in µs]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((lLatency < 0) || (lLatency > 999999)) {
+    fprintf(stderr, "Invalid latency\n");
+    return EXIT_FAILURE;
+  }
+
+  // Registered before the first context: the simulated driver is the only one
+  nfc_register_driver(&sim_driver);
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+  if ((nfc_list_devices(context, &connstring, 1) != 1) || ((pnd = nfc_open(context, connstring)) == NULL)) {
+    fprintf(stderr, "Unable to open the simulated device\n");
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+  if (nfc_initiator_init(pnd) < 0) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+
+  printf("%ld us per exchange with the chip, plus the chip timeout when no tag answers\n", lLatency);
+  srand(1);
+  const size_t aszTags[] = { 0, 1, 2, 8, 32, 64, 128, 256 };
+  const enum uid_kind akinds[] = { UID_RANDOM4, UID_SERIAL7, UID_MIXED };
+  for (size_t k = 0; k < sizeof(akinds) / sizeof(akinds[0]); k++) {
+    for (size_t n = 0; n < sizeof(aszTags) / sizeof(aszTags[0]); n++) {
+      if (bench(pnd, aszTags[n], akinds[k]) < 0)
+        res = -1;
+    }
+  }
+
+  nfc_close(pnd);
+  nfc_exit(context);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
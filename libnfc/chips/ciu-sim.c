@@ -0,0 +1,382 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file ciu-sim.c
+ * @brief Register-level simulation of the PN53x CIU, for the benchmarks
+ *
+ * Only what the timed exchanges and the sniffer use is simulated: the FIFO
+ * and its overflow, CommIrq, the Transceive and Receive commands with
+ * RxMultiple, TxLastBits and RxLastBits, and the timer in TAuto mode. CRC
+ * and modulation settings are not: the frames are exchanged as they are,
+ * at 106 kbps.
+ *
+ * The timer starts at the end of the transmission, 64 cycles later when
+ * the last bit is a 1, plus \a timer_offset, and stops once 5 bits of the
+ * answer are received. This is what the cycles count of libnfc undoes, so a
+ * timer_correction equal to \a timer_offset gives back the frame delay time
+ * set by the responder.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <string.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+#include "chips/ciu-sim.h"
+
+#define REG(sim, reg) ((sim)->regs[(reg) & 0xff])
+
+#define CIU_SIM_TX_IRQ 0x40
+// The timer stops after 5 bits are received
+#define CIU_SIM_TIMER_STOP_BITS 5
+
+void
+ciu_sim_init(struct ciu_sim *sim)
+{
+  memset(sim, 0, sizeof(*sim));
+  REG(sim, PN53X_REG_CIU_TReloadVal_hi) = 0xFF;
+  REG(sim, PN53X_REG_CIU_TReloadVal_lo) = 0xFF;
+}
+
+static uint32_t
+ciu_sim_timer_period(const struct ciu_sim *sim)
+{
+  const uint32_t u32Prescaler = ((REG(sim, PN53X_REG_CIU_TMode) & SYMBOL_TPRESCALERHI) << 8) | REG(sim, PN53X_REG_CIU_TPrescaler);
+  return 2 * u32Prescaler + 1;
+}
+
+// Time the counter reaches 0 and raises TimerIRq
+static uint64_t
+ciu_sim_timer_saturation(const struct ciu_sim *sim)
+{
+  const uint16_t ui16Reload = (REG(sim, PN53X_REG_CIU_TReloadVal_hi) << 8) | REG(sim, PN53X_REG_CIU_TReloadVal_lo);
+  return sim->timer_start + 1 + (uint64_t) ui16Reload * ciu_sim_timer_period(sim);
+}
+
+static uint16_t
+ciu_sim_timer_counter(const struct ciu_sim *sim)
+{
+  const uint16_t ui16Reload = (REG(sim, PN53X_REG_CIU_TReloadVal_hi) << 8) | REG(sim, PN53X_REG_CIU_TReloadVal_lo);
+  if (!sim->timer_started)
+    return ui16Reload;
+  const uint64_t ui64End = (sim->now < sim->timer_stop) ? sim->now : sim->timer_stop;
+  if (ui64End <= sim->timer_start)
+    return ui16Reload;
+  const uint64_t ui64Ticks = (ui64End - sim->timer_start - 1) / ciu_sim_timer_period(sim);
+  return (ui64Ticks >= ui16Reload) ? 0 : (uint16_t)(ui16Reload - ui64Ticks);
+}
+
+static void
+ciu_sim_fifo_push(struct ciu_sim *sim, const uint8_t ui8Byte)
+{
+  if (sim->fifo_level == CIU_SIM_FIFO_SIZE) {
+    REG(sim, PN53X_REG_CIU_Error) |= SYMBOL_BUFFER_OVFL;
+    REG(sim, PN53X_REG_CIU_CommIrq) |= SYMBOL_ERR_IRQ;
+    sim->overflows++;
+    return;
+  }
+  sim->fifo[(sim->fifo_head + sim->fifo_level) % CIU_SIM_FIFO_SIZE] = ui8Byte;
+  sim->fifo_level++;
+}
+
+static uint8_t
+ciu_sim_fifo_pop(struct ciu_sim *sim)
+{
+  if (sim->fifo_level == 0)
+    return 0x00;
+  const uint8_t ui8Byte = sim->fifo[sim->fifo_head];
+  sim->fifo_head = (sim->fifo_head + 1) % CIU_SIM_FIFO_SIZE;
+  sim->fifo_level--;
+  return ui8Byte;
+}
+
+// Last bit on air: data bit of a short frame, parity bit of a complete byte
+int
+ciu_sim_last_bit(const uint8_t *pbtFrame, const size_t szLen, const uint8_t ui8LastBits)
+{
+  const uint8_t ui8Byte = pbtFrame[szLen - 1];
+  if (ui8LastBits)
+    return (ui8Byte >> (ui8LastBits - 1)) & 1;
+  int iOnes = 0;
+  for (int n = 0; n < 8; n++)
+    iOnes += (ui8Byte >> n) & 1;
+  return (iOnes % 2) ? 0 : 1;
+}
+
+// Time byte n of the frame being received is complete, after the start of communication bit
+static uint64_t
+ciu_sim_rx_byte_end(const struct ciu_sim *sim, const size_t n)
+{
+  const size_t szBits = sim->rx_bits - n * 8;
+  return sim->rx_start + CIU_SIM_BIT_CYCLES + n * CIU_SIM_BYTE_CYCLES + ((szBits >= 8) ? CIU_SIM_BYTE_CYCLES : szBits * CIU_SIM_BIT_CYCLES);
+}
+
+static bool
+ciu_sim_receiving(const struct ciu_sim *sim)
+{
+  return (REG(sim, PN53X_REG_CIU_Command) & SYMBOL_COMMAND) == SYMBOL_COMMAND_RECEIVE;
+}
+
+static void
+ciu_sim_tx_end(struct ciu_sim *sim)
+{
+  const uint8_t ui8LastBits = REG(sim, PN53X_REG_CIU_BitFraming) & SYMBOL_TX_LAST_BITS;
+
+  sim->tx_active = false;
+  REG(sim, PN53X_REG_CIU_BitFraming) &= ~SYMBOL_START_SEND;
+  if (sim->tx_len == 0)
+    return;
+  const uint64_t ui64End = sim->tx_last_start + (ui8LastBits ? ui8LastBits * CIU_SIM_BIT_CYCLES : CIU_SIM_BYTE_CYCLES);
+  const size_t szTxBits = sim->tx_len * 8 - (ui8LastBits ? 8 - ui8LastBits : 0);
+  REG(sim, PN53X_REG_CIU_CommIrq) |= CIU_SIM_TX_IRQ;
+
+  if (REG(sim, PN53X_REG_CIU_TMode) & SYMBOL_TAUTO) {
+    // A frame ending with a 1 is seen ending 64 cycles later
+    const int64_t i64Start = (int64_t) ui64End + 64 * ciu_sim_last_bit(sim->tx_frame, sim->tx_len, ui8LastBits) + sim->timer_offset;
+    sim->timer_started = true;
+    sim->timer_start = (i64Start > 0) ? (uint64_t) i64Start : 0;
+    sim->timer_stop = UINT64_MAX;
+    sim->timer_irq_pending = true;
+  }
+  if (sim->responder) {
+    uint32_t u32Fdt = 0;
+    const size_t szBits = sim->responder(sim->responder_data, sim->tx_frame, szTxBits, sim->rx_frame, &u32Fdt);
+    if ((szBits > 0) && (szBits <= CIU_SIM_FRAME_MAX * 8)) {
+      sim->rx_active = true;
+      sim->rx_start = ui64End + u32Fdt;
+      sim->rx_bits = szBits;
+      sim->rx_next = 0;
+      sim->rx_error = 0x00;
+      if (sim->timer_started)
+        sim->timer_stop = sim->rx_start + CIU_SIM_TIMER_STOP_BITS * CIU_SIM_BIT_CYCLES;
+    }
+  }
+}
+
+static void
+ciu_sim_rx_end(struct ciu_sim *sim)
+{
+  sim->rx_active = false;
+  if (REG(sim, PN53X_REG_CIU_RxMode) & SYMBOL_RX_MULTIPLE)
+    ciu_sim_fifo_push(sim, sim->rx_error);
+  REG(sim, PN53X_REG_CIU_Control) = (REG(sim, PN53X_REG_CIU_Control) & ~SYMBOL_RX_LAST_BITS) | (sim->rx_bits % 8);
+  REG(sim, PN53X_REG_CIU_CommIrq) |= SYMBOL_RX_IRQ;
+  if (ciu_sim_receiving(sim) && !(REG(sim, PN53X_REG_CIU_RxMode) & SYMBOL_RX_MULTIPLE)) {
+    REG(sim, PN53X_REG_CIU_Command) = SYMBOL_COMMAND_IDLE;
+    REG(sim, PN53X_REG_CIU_CommIrq) |= SYMBOL_IDLE_IRQ;
+  }
+}
+
+// Runs the CIU until the given time, event by event
+static void
+ciu_sim_run(struct ciu_sim *sim, const uint64_t ui64Until)
+{
+  enum { EV_NONE, EV_TX, EV_RX, EV_TRAFFIC, EV_TIMER } ev;
+
+  for (;;) {
+    uint64_t t = UINT64_MAX;
+    ev = EV_NONE;
+    if (sim->tx_active && (sim->tx_next < t)) {
+      t = sim->tx_next;
+      ev = EV_TX;
+    }
+    if (sim->rx_active && (ciu_sim_rx_byte_end(sim, sim->rx_next) < t)) {
+      t = ciu_sim_rx_byte_end(sim, sim->rx_next);
+      ev = EV_RX;
+    }
+    if (!sim->rx_active && ciu_sim_receiving(sim) && (sim->traffic_next < sim->traffic_len) && (sim->traffic[sim->traffic_next].start < t)) {
+      t = sim->traffic[sim->traffic_next].start;
+      ev = EV_TRAFFIC;
+    }
+    if (sim->timer_irq_pending) {
+      const uint64_t ui64Saturation = ciu_sim_timer_saturation(sim);
+      if ((ui64Saturation < sim->timer_stop) && (ui64Saturation < t)) {
+        t = ui64Saturation;
+        ev = EV_TIMER;
+      }
+    }
+    if ((ev == EV_NONE) || (t > ui64Until))
+      break;
+    sim->now = t;
+
+    switch (ev) {
+      case EV_TX:
+        if ((sim->fifo_level > 0) && (sim->tx_len < CIU_SIM_FRAME_MAX)) {
+          sim->tx_frame[sim->tx_len++] = ciu_sim_fifo_pop(sim);
+          sim->tx_last_start = sim->tx_next;
+          sim->tx_next += CIU_SIM_BYTE_CYCLES;
+        } else {
+          // Nothing left to send
+          ciu_sim_tx_end(sim);
+        }
+        break;
+      case EV_RX:
+        ciu_sim_fifo_push(sim, sim->rx_frame[sim->rx_next++]);
+        if (sim->rx_next * 8 >= sim->rx_bits)
+          ciu_sim_rx_end(sim);
+        break;
+      case EV_TRAFFIC: {
+        const struct ciu_sim_frame *pf = &sim->traffic[sim->traffic_next++];
+        if ((pf->bits == 0) || (pf->bits > CIU_SIM_FRAME_MAX * 8))
+          break;
+        sim->rx_active = true;
+        sim->rx_start = pf->start;
+        memcpy(sim->rx_frame, pf->data, (pf->bits + 7) / 8);
+        sim->rx_bits = pf->bits;
+        sim->rx_next = 0;
+        sim->rx_error = pf->error;
+      }
+      break;
+      case EV_TIMER:
+        REG(sim, PN53X_REG_CIU_CommIrq) |= SYMBOL_TIMER_IRQ;
+        sim->timer_irq_pending = false;
+        break;
+      case EV_NONE:
+        break;
+    }
+  }
+  if (ui64Until > sim->now)
+    sim->now = ui64Until;
+}
+
+static uint8_t
+ciu_sim_read(struct ciu_sim *sim, const uint16_t ui16Reg)
+{
+  if ((ui16Reg >> 8) != 0x63)
+    return 0x00;
+  switch (ui16Reg) {
+    case PN53X_REG_CIU_FIFOData:
+      return ciu_sim_fifo_pop(sim);
+    case PN53X_REG_CIU_FIFOLevel:
+      return sim->fifo_level & SYMBOL_FIFO_LEVEL;
+    case PN53X_REG_CIU_TCounterVal_hi:
+      return ciu_sim_timer_counter(sim) >> 8;
+    case PN53X_REG_CIU_TCounterVal_lo:
+      return ciu_sim_timer_counter(sim) & 0xff;
+    case PN53X_REG_CIU_Status2: {
+      // ModemState: Idle, Transmitting, WaitForData or Receiving
+      uint8_t ui8State = 0x00;
+      if (sim->tx_active)
+        ui8State = 0x03;
+      else if (sim->rx_active && (sim->now >= sim->rx_start))
+        ui8State = SYMBOL_MODEM_RECEIVING;
+      else if (ciu_sim_receiving(sim))
+        ui8State = 0x05;
+      return (REG(sim, ui16Reg) & ~SYMBOL_MODEM_STATE) | ui8State;
+    }
+    default:
+      return REG(sim, ui16Reg);
+  }
+}
+
+static void
+ciu_sim_write(struct ciu_sim *sim, const uint16_t ui16Reg, const uint8_t ui8Value)
+{
+  if ((ui16Reg >> 8) != 0x63)
+    return;
+  switch (ui16Reg) {
+    case PN53X_REG_CIU_CommIrq:
+      // Set1 tells whether the bits written as 1 are set or cleared
+      if (ui8Value & 0x80)
+        REG(sim, ui16Reg) |= ui8Value & 0x7F;
+      else
+        REG(sim, ui16Reg) &= ~ui8Value;
+      break;
+    case PN53X_REG_CIU_FIFOData:
+      ciu_sim_fifo_push(sim, ui8Value);
+      break;
+    case PN53X_REG_CIU_FIFOLevel:
+      if (ui8Value & SYMBOL_FLUSH_BUFFER) {
+        sim->fifo_head = 0;
+        sim->fifo_level = 0;
+        REG(sim, PN53X_REG_CIU_Error) &= ~SYMBOL_BUFFER_OVFL;
+      }
+      break;
+    case PN53X_REG_CIU_TCounterVal_hi:
+    case PN53X_REG_CIU_TCounterVal_lo:
+      break;
+    case PN53X_REG_CIU_Command:
+      REG(sim, ui16Reg) = ui8Value;
+      sim->tx_active = false;
+      sim->rx_active = false;
+      if ((ui8Value & SYMBOL_COMMAND) == SYMBOL_COMMAND_RECEIVE) {
+        // Frames already on air are missed
+        while ((sim->traffic_next < sim->traffic_len) && (sim->traffic[sim->traffic_next].start < sim->now))
+          sim->traffic_next++;
+      }
+      break;
+    case PN53X_REG_CIU_BitFraming:
+      REG(sim, ui16Reg) = ui8Value;
+      if ((ui8Value & SYMBOL_START_SEND) && ((REG(sim, PN53X_REG_CIU_Command) & SYMBOL_COMMAND) == SYMBOL_COMMAND_TRANSCEIVE) && !sim->tx_active) {
+        sim->tx_active = true;
+        sim->tx_next = sim->now;
+        sim->tx_len = 0;
+        sim->timer_started = false;
+        sim->timer_irq_pending = false;
+      }
+      break;
+    default:
+      REG(sim, ui16Reg) = ui8Value;
+      break;
+  }
+}
+
+/**
+ * @brief Handle a command frame of the host, the exchange takes \a exchange_cycles
+ * @return Returns the answer length, otherwise returns libnfc's error code
+ */
+int
+ciu_sim_exchange(struct ciu_sim *sim, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx)
+{
+  size_t szAnswer = 0;
+
+  sim->exchanges++;
+  ciu_sim_run(sim, sim->now + sim->exchange_cycles);
+  switch (pbtTx[0]) {
+    case ReadRegister:
+      for (size_t n = 1; n + 1 < szTx; n += 2) {
+        if (szAnswer >= szRx)
+          return NFC_EOVFLOW;
+        pbtRx[szAnswer++] = ciu_sim_read(sim, (pbtTx[n] << 8) | pbtTx[n + 1]);
+      }
+      break;
+    case WriteRegister:
+      for (size_t n = 1; n + 2 < szTx; n += 3)
+        ciu_sim_write(sim, (pbtTx[n] << 8) | pbtTx[n + 1], pbtTx[n + 2]);
+      break;
+    default:
+      // Other commands succeed without data
+      break;
+  }
+  return (int) szAnswer;
+}
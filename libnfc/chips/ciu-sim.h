@@ -0,0 +1,111 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file ciu-sim.h
+ * @brief Register-level simulation of the PN53x CIU, for the benchmarks
+ *
+ * The simulated chip only knows ReadRegister and WriteRegister, other
+ * commands succeed without data. Time is counted in carrier cycles: each
+ * exchange with the host takes \a exchange_cycles, and in between the CIU
+ * sends, receives, fills its FIFO and runs its timer as a PN532 at 106 kbps
+ * would.
+ */
+
+#ifndef __NFC_CHIPS_CIU_SIM_H__
+#  define __NFC_CHIPS_CIU_SIM_H__
+
+#  include <stdbool.h>
+#  include <stddef.h>
+#  include <stdint.h>
+
+#  define CIU_SIM_FIFO_SIZE 64
+#  define CIU_SIM_FRAME_MAX 512
+
+// Carrier cycles per bit at 106 kbps, and per byte with its parity bit
+#  define CIU_SIM_BIT_CYCLES 128
+#  define CIU_SIM_BYTE_CYCLES (9 * CIU_SIM_BIT_CYCLES)
+
+/**
+ * Answer of the target to a frame sent by the CIU: returns its length in
+ * bits, 0 for no answer, and sets the frame delay time in carrier cycles
+ */
+typedef size_t (*ciu_sim_responder)(void *data, const uint8_t *pbtTx, const size_t szTxBits, uint8_t *pbtAnswer, uint32_t *pui32Fdt);
+
+/** Frame sent by other devices, received while the CIU runs its Receive command */
+struct ciu_sim_frame {
+  uint64_t start;               // carrier cycles
+  uint8_t  data[CIU_SIM_FRAME_MAX];
+  size_t   bits;
+  uint8_t  error;               // Error register copy appended by RxMultiple
+};
+
+struct ciu_sim {
+  // Settings
+  uint32_t exchange_cycles;     // duration of an exchange with the host
+  int32_t  timer_offset;        // device dependent part of the timer count, what timer_correction makes up for
+  ciu_sim_responder responder;
+  void    *responder_data;
+  const struct ciu_sim_frame *traffic;
+  size_t   traffic_len;
+
+  // Counters
+  uint64_t now;
+  unsigned long exchanges;
+  unsigned long overflows;      // bytes lost on a full FIFO
+
+  // Internal state
+  uint8_t  regs[256];           // 0x63xx registers
+  uint8_t  fifo[CIU_SIM_FIFO_SIZE];
+  size_t   fifo_head;
+  size_t   fifo_level;
+  // Transmission: a byte is taken from the FIFO every CIU_SIM_BYTE_CYCLES
+  bool     tx_active;
+  uint64_t tx_next;
+  uint64_t tx_last_start;
+  uint8_t  tx_frame[CIU_SIM_FRAME_MAX];
+  size_t   tx_len;
+  // Reception: the bytes of rx_frame enter the FIFO as they are received
+  bool     rx_active;
+  uint64_t rx_start;
+  uint8_t  rx_frame[CIU_SIM_FRAME_MAX];
+  size_t   rx_bits;
+  size_t   rx_next;
+  uint8_t  rx_error;
+  size_t   traffic_next;
+  // Timer
+  bool     timer_started;
+  uint64_t timer_start;
+  uint64_t timer_stop;
+  bool     timer_irq_pending;
+};
+
+void    ciu_sim_init(struct ciu_sim *sim);
+int     ciu_sim_exchange(struct ciu_sim *sim, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx);
+int     ciu_sim_last_bit(const uint8_t *pbtFrame, const size_t szLen, const uint8_t ui8LastBits);
+
+#endif // __NFC_CHIPS_CIU_SIM_H__
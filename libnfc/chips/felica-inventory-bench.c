@@ -0,0 +1,484 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file felica-inventory-bench.c
+ * @brief FeliCa time slot inventory benchmark against simulated cards
+ *
+ * This program is linked with the library objects and registers a driver
+ * ("sim") whose PN532 chip is simulated at the command level: registers,
+ * RFConfiguration timings, InListPassiveTarget for FeliCa and InCommunicateThru
+ * with the CIU RxMultiple mode. Its field holds FeliCa cards answering POLLING
+ * in a random time slot; the answers of cards sharing a slot are garbled.
+ * Every exchange with the chip costs a fixed time plus the slots it waits for.
+ * nfc_initiator_list_passive_targets(), which now runs
+ * nfc_initiator_inventory_felica(), is compared with polling one card per
+ * nfc_initiator_select_passive_target() until every card was seen, then run
+ * with cards which all collide in its first InListPassiveTarget.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define SIM_DRIVER_NAME "sim"
+#define SIM_MAX_CARDS 32
+#define SIM_MAX_SLOTS 16
+// FeliCa POLLING timings: answers start 2.417 ms after the command, one slot every 1.208 ms
+#define SIM_SLOT0_US 2417
+#define SIM_SLOT_US 1208
+// Tries of the one card per select polling
+#define SIM_MAX_SELECTS 200
+
+struct sim_card {
+  uint8_t  abtIdm[8];
+  uint8_t  abtPmm[8];
+  uint8_t  abtSystemCode[2];
+};
+
+struct sim_data {
+  uint8_t  abtRegs[256];      // CIU registers, 0x6300 to 0x63ff
+  uint8_t  ui8RetryTimeout;   // RFConfiguration timing, non-DEP communications
+  uint8_t  abtResponse[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t   szResponse;
+  struct sim_card cards[SIM_MAX_CARDS];
+  size_t   szCards;
+  size_t   szListCollisions;  // next InListPassiveTarget whose cards all answer in the first slot
+  unsigned long ulPollings;   // POLLING commands sent on the RF
+  uint64_t ui64Time;          // simulated time, in µs
+};
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+#define REG(sd, reg) ((sd)->abtRegs[(reg) & 0xff])
+
+static long lLatency = 1000; // µs per exchange with the chip
+
+// POLLING response of a card: LEN, 0x01, IDm, PMm, then the System Code for Request Code 0x01
+static size_t
+sim_card_response(const struct sim_card *pc, const uint8_t btRequestCode, uint8_t *pbtRes)
+{
+  const size_t szRes = (btRequestCode == 0x01) ? 20 : 18;
+  pbtRes[0] = szRes;
+  pbtRes[1] = 0x01;
+  memcpy(pbtRes + 2, pc->abtIdm, 8);
+  memcpy(pbtRes + 10, pc->abtPmm, 8);
+  if (szRes > 18)
+    memcpy(pbtRes + 18, pc->abtSystemCode, 2);
+  return szRes;
+}
+
+/*
+ * POLLING payload [0x00, SC1, SC2, RC, TSN]: every card holding the system
+ * code (0xff matches any byte) picks one of the TSN + 1 slots. Fills
+ * aszSlot with the number of cards per slot and aszCard with the last one.
+ */
+static size_t
+sim_polling(struct sim_data *sd, const uint8_t *pbtPayload, size_t aszSlot[SIM_MAX_SLOTS], size_t aszCard[SIM_MAX_SLOTS])
+{
+  const size_t szSlots = (size_t)(pbtPayload[4] & 0x0f) + 1;
+
+  sd->ulPollings++;
+  memset(aszSlot, 0, SIM_MAX_SLOTS * sizeof(size_t));
+  for (size_t c = 0; c < sd->szCards; c++) {
+    const struct sim_card *pc = &sd->cards[c];
+    if (((pbtPayload[1] != 0xff) && (pbtPayload[1] != pc->abtSystemCode[0])) ||
+        ((pbtPayload[2] != 0xff) && (pbtPayload[2] != pc->abtSystemCode[1])))
+      continue;
+    const size_t szSlot = (size_t) rand() % szSlots;
+    aszSlot[szSlot]++;
+    aszCard[szSlot] = c;
+  }
+  return szSlots;
+}
+
+/*
+ * The firmware waits for every slot, then lists the first cards answering
+ * alone. The Error register keeps CRCErr and CollErr of garbled answers.
+ */
+static void
+sim_in_list_passive_target(struct sim_data *sd, const uint8_t *pbtData, const size_t szData)
+{
+  size_t aszSlot[SIM_MAX_SLOTS], aszCard[SIM_MAX_SLOTS];
+  uint8_t *pbt = sd->abtResponse + 1;
+
+  sd->abtResponse[0] = 0;
+  sd->szResponse = 1;
+  REG(sd, PN53X_REG_CIU_Error) = 0x00;
+  if ((szData < 8) || ((pbtData[2] != PM_FELICA_212) && (pbtData[2] != PM_FELICA_424)) || (pbtData[3] != 0x00))
+    return;
+  const size_t szSlots = sim_polling(sd, pbtData + 3, aszSlot, aszCard);
+  sd->ui64Time += SIM_SLOT0_US + szSlots * SIM_SLOT_US;
+  if (sd->szListCollisions > 0) {
+    sd->szListCollisions--;
+    for (size_t s = 1; s < szSlots; s++) {
+      aszSlot[0] += aszSlot[s];
+      aszSlot[s] = 0;
+    }
+  }
+  for (size_t s = 0; s < szSlots; s++) {
+    if (aszSlot[s] > 1)
+      REG(sd, PN53X_REG_CIU_Error) = 0x0c;
+  }
+  for (size_t s = 0; (s < szSlots) && (sd->abtResponse[0] < pbtData[1]); s++) {
+    if (aszSlot[s] != 1)
+      continue;
+    *(pbt++) = ++sd->abtResponse[0];
+    pbt += sim_card_response(&sd->cards[aszCard[s]], pbtData[6], pbt);
+  }
+  sd->szResponse = pbt - sd->abtResponse;
+  // The CIU is left set for FeliCa, CRC included
+  REG(sd, PN53X_REG_CIU_TxMode) |= SYMBOL_TX_CRC_ENABLE;
+  REG(sd, PN53X_REG_CIU_RxMode) |= SYMBOL_RX_CRC_ENABLE;
+}
+
+/*
+ * Raw POLLING. Without RxMultiple the reception stops on the first frame;
+ * with it, the chip waits for its timeout and the FIFO holds every frame
+ * followed by the Error register. Answers sharing a slot are ORed.
+ */
+static void
+sim_in_communicate_thru(struct sim_data *sd, const uint8_t *pbtFrame, const size_t szFrame)
+{
+  const bool bMultiple = REG(sd, PN53X_REG_CIU_RxMode) & SYMBOL_RX_MULTIPLE;
+  const uint64_t ui64Timeout = sd->ui8RetryTimeout ? (100 << (sd->ui8RetryTimeout - 1)) : 0;
+  size_t aszSlot[SIM_MAX_SLOTS], aszCard[SIM_MAX_SLOTS];
+  uint8_t *pbt = sd->abtResponse + 1;
+
+  sd->abtResponse[0] = ETIMEOUT;
+  sd->szResponse = 1;
+  if (!(REG(sd, PN53X_REG_CIU_TxMode) & SYMBOL_TX_CRC_ENABLE) || !(REG(sd, PN53X_REG_CIU_RxMode) & SYMBOL_RX_CRC_ENABLE) ||
+      (szFrame != 6) || (pbtFrame[0] != 6) || (pbtFrame[1] != 0x00)) {
+    sd->ui64Time += ui64Timeout;
+    return;
+  }
+  const size_t szSlots = sim_polling(sd, pbtFrame + 1, aszSlot, aszCard);
+  for (size_t s = 0; s < szSlots; s++) {
+    if (aszSlot[s] == 0)
+      continue;
+    uint8_t abtRes[20];
+    const size_t szRes = sim_card_response(&sd->cards[aszCard[s]], pbtFrame[4], pbt);
+    uint8_t btError = 0x00;
+    if (aszSlot[s] > 1) {
+      // Other cards of the slot
+      for (size_t c = 0; c < sd->szCards; c++) {
+        if (c == aszCard[s])
+          continue;
+        sim_card_response(&sd->cards[c], pbtFrame[4], abtRes);
+        for (size_t n = 0; n < szRes; n++)
+          pbt[n] |= abtRes[n];
+        if (--aszSlot[s] == 1)
+          break;
+      }
+      btError = bMultiple ? 0x0c : ECRC; // CRCErr, CollErr
+    }
+    sd->abtResponse[0] = 0x00;
+    if (!bMultiple) {
+      if (btError)
+        sd->abtResponse[0] = btError;
+      sd->szResponse = 1 + szRes;
+      sd->ui64Time += SIM_SLOT0_US + (s + 1) * SIM_SLOT_US;
+      return;
+    }
+    pbt += szRes;
+    *(pbt++) = btError;
+  }
+  sd->szResponse = pbt - sd->abtResponse;
+  sd->ui64Time += ui64Timeout;
+}
+
+static int
+sim_send(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+
+  sd->ui64Time += lLatency;
+  sd->szResponse = 0;
+  switch (pbtData[0]) {
+    case ReadRegister:
+      for (size_t n = 1; n + 1 < szData; n += 2)
+        sd->abtResponse[sd->szResponse++] = sd->abtRegs[pbtData[n + 1]];
+      break;
+    case WriteRegister:
+      for (size_t n = 1; n + 2 < szData; n += 3)
+        sd->abtRegs[pbtData[n + 1]] = pbtData[n + 2];
+      break;
+    case RFConfiguration:
+      if ((szData >= 5) && (pbtData[1] == RFCI_TIMING))
+        sd->ui8RetryTimeout = pbtData[4];
+      break;
+    case InListPassiveTarget:
+      sim_in_list_passive_target(sd, pbtData, szData);
+      break;
+    case InCommunicateThru:
+      sim_in_communicate_thru(sd, pbtData + 1, szData - 1);
+      break;
+    default:
+      // Other commands succeed without data
+      break;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+sim_receive(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  if (sd->szResponse > szDataLen)
+    return NFC_EOVFLOW;
+  memcpy(pbtData, sd->abtResponse, sd->szResponse);
+  return (int) sd->szResponse;
+}
+
+static const struct pn53x_io sim_io = {
+  .send    = sim_send,
+  .receive = sim_receive,
+};
+
+static const struct nfc_driver sim_driver;
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  if (connstrings_len == 0)
+    return 0;
+  snprintf(connstrings[0], sizeof(nfc_connstring), "%s:0", SIM_DRIVER_NAME);
+  return 1;
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd)
+    return NULL;
+  pnd->driver_data = calloc(1, sizeof(struct sim_data));
+  if (!pnd->driver_data || !pn53x_data_new(pnd, &sim_io)) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  DRIVER_DATA(pnd)->ui8RetryTimeout = 0x0a;
+  snprintf(pnd->name, sizeof(pnd->name), "simulated PN532 %s", connstring);
+  pnd->driver = &sim_driver;
+  return pnd;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_inventory_felica       = pn53x_initiator_inventory_felica,
+  .device_set_property_bool         = pn53x_set_property_bool,
+  .device_set_property_int          = pn53x_set_property_int,
+};
+
+static void
+field_fill(struct sim_data *sd, const size_t szCards)
+{
+  sd->szCards = szCards;
+  for (size_t c = 0; c < szCards; c++) {
+    struct sim_card *pc = &sd->cards[c];
+    // Manufacturer code, then a serial number
+    pc->abtIdm[0] = 0x01;
+    pc->abtIdm[1] = 0x2e;
+    for (size_t n = 2; n < 8; n++)
+      pc->abtIdm[n] = (uint8_t) rand();
+    memcpy(pc->abtPmm, "\x03\x32\x42\x82\x82\x47\xaa\xff", 8);
+    // NFC Forum Type 3 Tags and plain FeliCa cards
+    memcpy(pc->abtSystemCode, (c % 2) ? "\x12\xfc" : "\x00\x03", 2);
+  }
+}
+
+// Cards of the field seen once each in ant; a card seen twice is counted wrong
+static size_t
+field_missing(const struct sim_data *sd, const nfc_target ant[], const size_t szFound)
+{
+  size_t szMissing = 0;
+  for (size_t c = 0; c < sd->szCards; c++) {
+    size_t szSeen = 0;
+    for (size_t n = 0; n < szFound; n++) {
+      if (!memcmp(ant[n].nti.nfi.abtId, sd->cards[c].abtIdm, 8) && !memcmp(ant[n].nti.nfi.abtSysCode, sd->cards[c].abtSystemCode, 2))
+        szSeen++;
+    }
+    if (szSeen != 1)
+      szMissing++;
+  }
+  return szMissing;
+}
+
+static void
+report(const char *pcMode, const size_t szCards, const size_t szFound, const size_t szMissing,
+       const unsigned long ulRoundTrips, const unsigned long ulPollings, const uint64_t ui64Time)
+{
+  printf("%-9s %3lu cards %3lu found %3lu missing %5lu round trips %5lu POLLINGs %9.1f ms\n",
+         pcMode, (unsigned long) szCards, (unsigned long) szFound, (unsigned long) szMissing,
+         ulRoundTrips, ulPollings, ui64Time / 1000.0);
+}
+
+// With bCollided, the cards all collide in the first InListPassiveTarget of the inventory
+static int
+bench(nfc_device *pnd, const size_t szCards, const bool bCollided)
+{
+  const nfc_modulation nm = { .nmt = NMT_FELICA, .nbr = NBR_212 };
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  nfc_target ant[SIM_MAX_CARDS + 1];
+  nfc_device_stats before, after;
+  size_t szFound = 0;
+
+  field_fill(sd, szCards);
+
+  // One card per select, 16 slots, until all the cards were seen
+  const uint8_t abtPolling[] = { 0x00, 0xff, 0xff, 0x01, 0x0f };
+  sd->ulPollings = 0;
+  sd->ui64Time = 0;
+  nfc_device_get_stats(pnd, &before);
+  for (size_t n = 0; (n < SIM_MAX_SELECTS) && (szFound < szCards); n++) {
+    nfc_target nt;
+    int res = nfc_initiator_select_passive_target(pnd, nm, abtPolling, sizeof(abtPolling), &nt);
+    if (res < 0) {
+      nfc_perror(pnd, "nfc_initiator_select_passive_target");
+      return -1;
+    }
+    if (res == 0)
+      continue;
+    size_t i;
+    for (i = 0; (i < szFound) && memcmp(ant[i].nti.nfi.abtId, nt.nti.nfi.abtId, 8); i++)
+      ;
+    if (i == szFound)
+      ant[szFound++] = nt;
+  }
+  nfc_device_get_stats(pnd, &after);
+  report("select", szCards, szFound, field_missing(sd, ant, szFound),
+         (unsigned long)(after.tx_frames - before.tx_frames), sd->ulPollings, sd->ui64Time);
+
+  sd->ulPollings = 0;
+  sd->ui64Time = 0;
+  sd->szListCollisions = bCollided ? 1 : 0;
+  nfc_device_get_stats(pnd, &before);
+  const int res = nfc_initiator_list_passive_targets(pnd, nm, ant, SIM_MAX_CARDS + 1);
+  nfc_device_get_stats(pnd, &after);
+  if (res < 0) {
+    nfc_perror(pnd, "nfc_initiator_list_passive_targets");
+    return -1;
+  }
+  const size_t szMissing = field_missing(sd, ant, res);
+  report(bCollided ? "collided" : "inventory", szCards, res, szMissing,
+         (unsigned long)(after.tx_frames - before.tx_frames), sd->ulPollings, sd->ui64Time);
+  // The first card found is the selected one
+  const nfc_target *pntSelected = CHIP_DATA(pnd)->current_target;
+  if ((res > 0) && ((pntSelected == NULL) || memcmp(pntSelected->nti.nfi.abtId, ant[0].nti.nfi.abtId, 8))) {
+    fprintf(stderr, "The first card is not the selected one\n");
+    return -1;
+  }
+  // A card listed twice or an IDm made up from garbled answers is a failure, a card left out is not
+  return ((size_t) res != szCards - szMissing) ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  nfc_context *context;
+  nfc_connstring connstring;
+  nfc_device *pnd;
+  int opt;
+  int res = 0;
+
+  while ((opt = getopt(argc, argv, "l:")) != -1) {
+    switch (opt) {
+      case 'l':
+        lLatency = strtol(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-l chip exchange latency in µs]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((lLatency < 0) || (lLatency > 999999)) {
+    fprintf(stderr, "Invalid latency\n");
+    return EXIT_FAILURE;
+  }
+
+  // Registered before the first context: the simulated driver is the only one
+  nfc_register_driver(&sim_driver);
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+  if ((nfc_list_devices(context, &connstring, 1) != 1) || ((pnd = nfc_open(context, connstring)) == NULL)) {
+    fprintf(stderr, "Unable to open the simulated device\n");
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+  if ((nfc_initiator_init(pnd) < 0) || (nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, false) < 0)) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+
+  printf("%ld us per exchange with the chip, plus the POLLING slots or the chip timeout\n", lLatency);
+  srand(1);
+  const size_t aszCards[] = { 0, 1, 2, 4, 8, 12, 16 };
+  for (size_t n = 0; n < sizeof(aszCards) / sizeof(aszCards[0]); n++) {
+    if (bench(pnd, aszCards[n], false) < 0)
+      res = -1;
+  }
+  for (size_t n = 2; n < sizeof(aszCards) / sizeof(aszCards[0]); n++) {
+    if (bench(pnd, aszCards[n], true) < 0)
+      res = -1;
+  }
+
+  nfc_close(pnd);
+  nfc_exit(context);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
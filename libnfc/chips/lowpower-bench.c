@@ -0,0 +1,491 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file lowpower-bench.c
+ * @brief Duty-cycled low-power detection benchmark against a simulated PN532
+ *
+ * This program is linked with the library objects and registers a driver
+ * ("sim") whose PN532 chip is simulated at the command level, in real time:
+ * every exchange with the chip takes a fixed time, and so does waking the
+ * chip up from PowerDown. The simulated chip ignores commands while it is
+ * powered down, so a power mode tracked wrongly by the library shows up as
+ * lost commands. A tag enters the field at a random time; the benchmark
+ * measures how long it takes to be found and the share of time the chip
+ * was awake, polling continuously then with nfc_initiator_poll_target_low_power()
+ * and various sleep times. Without tag, the call must give up at its timeout,
+ * wake up on nfc_abort_command() and let nfc_close() in, leaving the chip
+ * awake with the field on; other threads must be able to use the device
+ * while it sleeps.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define SIM_DRIVER_NAME "sim"
+
+struct sim_data {
+  bool     bAsleep;           // chip state, as opposed to the power mode tracked by the library
+  bool     bPowerDownPending; // asleep once the PowerDown answer is read
+  bool     bNoAnswer;
+  bool     bField;
+  uint64_t ui64Arrival;       // the tag is in the field from then on
+  uint64_t ui64AsleepSince;
+  uint64_t ui64AsleepUs;      // time the chip spent powered down
+  unsigned long ulWakeups;
+  unsigned long ulLost;       // commands sent to the chip while it was asleep
+  uint8_t  abtResponse[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t   szResponse;
+};
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+
+static long lLatency = 300;   // µs per exchange with the chip
+static long lWakeup = 1000;   // µs for the chip to wake up
+static long lPoll = 1000;     // µs of RF activity for an InListPassiveTarget
+
+static void
+sim_delay(long lUs)
+{
+  if (lUs > 0) {
+    struct timespec ts = { lUs / 1000000, (lUs % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+  }
+}
+
+static void
+sim_wakeup(nfc_device *pnd)
+{
+  struct sim_data *sd = DRIVER_DATA(pnd);
+
+  if (sd->bAsleep)
+    sd->ui64AsleepUs += monotonic_time_us() - sd->ui64AsleepSince;
+  sim_delay(lWakeup);
+  sd->bAsleep = false;
+  sd->ulWakeups++;
+  pn53x_set_power_mode(pnd, NORMAL);
+}
+
+// Same power handling as the PN532 drivers
+static int
+sim_send(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  int res;
+
+  switch (CHIP_DATA(pnd)->power_mode) {
+    case LOWVBAT:
+      sim_wakeup(pnd);
+      if ((res = pn532_SAMConfiguration(pnd, PSM_NORMAL, 1000)) < 0)
+        return res;
+      break;
+    case POWERDOWN:
+      sim_wakeup(pnd);
+      break;
+    case NORMAL:
+      break;
+  }
+
+  sim_delay(lLatency);
+  sd->szResponse = 0;
+  sd->bNoAnswer = sd->bAsleep;
+  if (sd->bAsleep) {
+    sd->ulLost++;
+    return NFC_SUCCESS;
+  }
+  switch (pbtData[0]) {
+    case PowerDown:
+      sd->abtResponse[sd->szResponse++] = 0x00;
+      sd->bPowerDownPending = true;
+      break;
+    case RFConfiguration:
+      if ((szData >= 3) && (pbtData[1] == RFCI_FIELD))
+        sd->bField = pbtData[2] & 0x01;
+      break;
+    case InListPassiveTarget:
+      sim_delay(lPoll);
+      if (sd->bField && (monotonic_time_us() >= sd->ui64Arrival)) {
+        const uint8_t abtTarget[] = { 0x01, 0x01, 0x00, 0x44, 0x00, 0x07, 0x04, 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 };
+        memcpy(sd->abtResponse, abtTarget, sizeof(abtTarget));
+        sd->szResponse = sizeof(abtTarget);
+      } else {
+        sd->abtResponse[sd->szResponse++] = 0x00;
+      }
+      break;
+    case InRelease:
+    case InDeselect:
+      sd->abtResponse[sd->szResponse++] = 0x00;
+      break;
+    default:
+      // Other commands succeed without data
+      break;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+sim_receive(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+
+  if (sd->bNoAnswer)
+    return pnd->last_error = NFC_ETIMEOUT;
+  if (sd->szResponse > szDataLen)
+    return NFC_EOVFLOW;
+  memcpy(pbtData, sd->abtResponse, sd->szResponse);
+  if (sd->bPowerDownPending) {
+    sd->bPowerDownPending = false;
+    sd->bAsleep = true;
+    sd->ui64AsleepSince = monotonic_time_us();
+  }
+  return (int) sd->szResponse;
+}
+
+static const struct pn53x_io sim_io = {
+  .send    = sim_send,
+  .receive = sim_receive,
+};
+
+static const struct nfc_driver sim_driver;
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  if (connstrings_len == 0)
+    return 0;
+  snprintf(connstrings[0], sizeof(nfc_connstring), "%s:0", SIM_DRIVER_NAME);
+  return 1;
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd)
+    return NULL;
+  pnd->driver_data = calloc(1, sizeof(struct sim_data));
+  if (!pnd->driver_data || !pn53x_data_new(pnd, &sim_io)) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  // Like a PN532 on HSU, the chip starts in LowVBat
+  pn53x_set_power_mode(pnd, LOWVBAT);
+  DRIVER_DATA(pnd)->bAsleep = true;
+  DRIVER_DATA(pnd)->ui64AsleepSince = monotonic_time_us();
+  DRIVER_DATA(pnd)->ui64Arrival = UINT64_MAX;
+  snprintf(pnd->name, sizeof(pnd->name), "simulated PN532 %s", connstring);
+  pnd->driver = &sim_driver;
+  return pnd;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_poll_target_low_power  = pn53x_initiator_poll_target_low_power,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .device_set_property_bool         = pn53x_set_property_bool,
+  .device_set_property_int          = pn53x_set_property_int,
+  .powerdown                        = pn53x_PowerDown,
+};
+
+static const nfc_modulation nmIso14443a = {
+  .nmt = NMT_ISO14443A,
+  .nbr = NBR_106,
+};
+
+struct result {
+  unsigned long ulFound;
+  uint64_t ui64LatencySum;
+  uint64_t ui64LatencyMax;
+  uint64_t ui64AwakeUs;
+  uint64_t ui64ElapsedUs;
+  double   dWakeSum;
+  uint64_t ui64WakeMax;
+  uint64_t ui64WindowMax;
+  size_t   szPolls;
+  unsigned long ulTransitions;
+};
+
+// The tag enters the field between 50 and 300 ms from now
+static void
+tag_schedule(struct sim_data *sd)
+{
+  sd->ui64Arrival = monotonic_time_us() + 50000 + (uint64_t)(rand() % 250000);
+}
+
+static int
+detect_continuous(nfc_device *pnd, struct result *pr)
+{
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  nfc_target nt;
+  int res;
+
+  const uint64_t start = monotonic_time_us();
+  tag_schedule(sd);
+  while ((res = nfc_initiator_select_passive_target(pnd, nmIso14443a, NULL, 0, &nt)) == 0)
+    pr->szPolls++;
+  if (res < 0)
+    return res;
+  const uint64_t now = monotonic_time_us();
+  pr->ulFound++;
+  pr->ui64LatencySum += now - sd->ui64Arrival;
+  pr->ui64LatencyMax = MAX(pr->ui64LatencyMax, now - sd->ui64Arrival);
+  pr->ui64AwakeUs += now - start;
+  pr->ui64ElapsedUs += now - start;
+  sd->ui64Arrival = UINT64_MAX;
+  return nfc_initiator_deselect_target(pnd);
+}
+
+static int
+detect_low_power(nfc_device *pnd, const nfc_low_power_params *pparams, struct result *pr)
+{
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  nfc_low_power_stats stats;
+  nfc_target nt;
+  int res;
+
+  tag_schedule(sd);
+  if ((res = nfc_initiator_poll_target_low_power(pnd, &nmIso14443a, 1, pparams, &nt, &stats)) <= 0)
+    return res ? res : NFC_ETIMEOUT;
+  const uint64_t now = monotonic_time_us();
+  pr->ulFound++;
+  pr->ui64LatencySum += now - sd->ui64Arrival;
+  pr->ui64LatencyMax = MAX(pr->ui64LatencyMax, now - sd->ui64Arrival);
+  pr->ui64AwakeUs += stats.awake_us;
+  pr->ui64ElapsedUs += stats.elapsed_us;
+  pr->dWakeSum += stats.wake_mean_us * stats.polls;
+  pr->ui64WakeMax = MAX(pr->ui64WakeMax, stats.wake_max_us);
+  pr->ui64WindowMax = MAX(pr->ui64WindowMax, stats.window_max_us);
+  pr->szPolls += stats.polls;
+  pr->ulTransitions += stats.power_transitions;
+  sd->ui64Arrival = UINT64_MAX;
+  return nfc_initiator_deselect_target(pnd);
+}
+
+static int
+bench(nfc_device *pnd, const long lSleepMs, const unsigned int uiRuns)
+{
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  struct result r;
+  nfc_low_power_params params = { .sleep_ms = (uint32_t) lSleepMs, .timeout_ms = 0 };
+  int res = 0;
+
+  memset(&r, 0, sizeof(r));
+  sd->ulLost = 0;
+  sd->ui64AsleepUs = 0;
+  for (unsigned int n = 0; (n < uiRuns) && (res >= 0); n++)
+    res = (lSleepMs < 0) ? detect_continuous(pnd, &r) : detect_low_power(pnd, &params, &r);
+  if (res < 0) {
+    nfc_perror(pnd, "detection");
+    return -1;
+  }
+
+  if (lSleepMs < 0)
+    printf("continuous polling     ");
+  else
+    printf("power down %4ld ms     ", lSleepMs);
+  printf("%2lu found, latency avg %6.1f ms max %6.1f ms, duty cycle %5.1f%% (chip asleep %5.1f%%), %4lu windows",
+         r.ulFound, r.ui64LatencySum / 1e3 / r.ulFound, r.ui64LatencyMax / 1e3,
+         r.ui64AwakeUs * 100.0 / r.ui64ElapsedUs, sd->ui64AsleepUs * 100.0 / r.ui64ElapsedUs, (unsigned long) r.szPolls);
+  if (lSleepMs >= 0)
+    printf(", wake-up avg %5.0f us max %5" PRIu64 " us, window max %5.1f ms, %lu power mode changes",
+           r.szPolls ? r.dWakeSum / r.szPolls : 0.0, r.ui64WakeMax, r.ui64WindowMax / 1e3, r.ulTransitions);
+  printf(", lost commands %lu\n", sd->ulLost);
+  return sd->ulLost ? -1 : 0;
+}
+
+// Without tag the call gives up at the timeout, the chip awake with the field on
+static int
+bench_timeout(nfc_device *pnd)
+{
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  nfc_low_power_params params = { .sleep_ms = 50, .timeout_ms = 200 };
+  nfc_low_power_stats stats;
+  nfc_target nt;
+
+  sd->ulLost = 0;
+  sd->ui64Arrival = UINT64_MAX;
+  const int res = nfc_initiator_poll_target_low_power(pnd, &nmIso14443a, 1, &params, &nt, &stats);
+  printf("no tag, 200 ms timeout:     returned %d after %6.1f ms and %lu windows, chip %s, field %s, lost commands %lu\n",
+         res, stats.elapsed_us / 1e3, (unsigned long) stats.polls, sd->bAsleep ? "asleep" : "awake", sd->bField ? "on" : "off", sd->ulLost);
+  return ((res != 0) || sd->bAsleep || !sd->bField || sd->ulLost) ? -1 : 0;
+}
+
+struct interrupter {
+  nfc_device *pnd;
+  bool     bClose;
+  uint64_t ui64LockedUs;      // duration of a call taking the device lock during the sleep
+  uint64_t ui64At;            // time of the abort or close
+  int      res;
+};
+
+// Runs a call taking the device lock, then aborts or closes 100 ms after the poll started sleeping
+static void *
+interrupter_run(void *arg)
+{
+  struct interrupter *pi = arg;
+  const struct timespec ts = { 0, 100 * 1000 * 1000 };
+
+  nanosleep(&ts, NULL);
+  uint64_t now = monotonic_time_us();
+  pi->res = nfc_device_set_property_int(pi->pnd, NP_TIMEOUT_COMMAND, 350);
+  pi->ui64LockedUs = monotonic_time_us() - now;
+  pi->ui64At = monotonic_time_us();
+  if (pi->bClose)
+    nfc_close(pi->pnd);
+  else if (pi->res >= 0)
+    pi->res = nfc_abort_command(pi->pnd);
+  return NULL;
+}
+
+// Without tag nor timeout, the call sleeps 1 s per window: it must wake up on nfc_abort_command() or nfc_close()
+static int
+bench_interrupt(nfc_device *pnd, const bool bClose)
+{
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  nfc_low_power_params params = { .sleep_ms = 1000, .timeout_ms = 0 };
+  struct interrupter i = { .pnd = pnd, .bClose = bClose };
+  nfc_low_power_stats stats;
+  nfc_target nt;
+  pthread_t thread;
+
+  sd->ulLost = 0;
+  sd->ui64Arrival = UINT64_MAX;
+  if (pthread_create(&thread, NULL, interrupter_run, &i) != 0)
+    return -1;
+  const int res = nfc_initiator_poll_target_low_power(pnd, &nmIso14443a, 1, &params, &nt, &stats);
+  const uint64_t ui64Return = monotonic_time_us() - i.ui64At;
+  // The device is freed once the call returned
+  const bool bAsleep = bClose ? false : sd->bAsleep;
+  const bool bField = bClose ? true : sd->bField;
+  const unsigned long ulLost = bClose ? 0 : sd->ulLost;
+  pthread_join(thread, NULL);
+  printf("no tag, %-19s returned %d after %6.1f ms and %lu windows, %.1f ms after it, locked call during the sleep %.1f ms",
+         bClose ? "nfc_close():" : "nfc_abort_command():", res, stats.elapsed_us / 1e3, (unsigned long) stats.polls, ui64Return / 1e3, i.ui64LockedUs / 1e3);
+  if (!bClose)
+    printf(", chip %s, field %s, lost commands %lu", bAsleep ? "asleep" : "awake", bField ? "on" : "off", ulLost);
+  printf("\n");
+  return ((res != NFC_EOPABORTED) || (i.res < 0) || (i.ui64LockedUs > 50000) || (ui64Return > 50000) || bAsleep || !bField || ulLost) ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  nfc_context *context;
+  nfc_connstring connstring;
+  nfc_device *pnd;
+  unsigned int uiRuns = 5;
+  int opt;
+  int res = 0;
+
+  while ((opt = getopt(argc, argv, "l:w:n:")) != -1) {
+    switch (opt) {
+      case 'l':
+        lLatency = strtol(optarg, NULL, 10);
+        break;
+      case 'w':
+        lWakeup = strtol(optarg, NULL, 10);
+        break;
+      case 'n':
+        uiRuns = (unsigned int) strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-l chip exchange latency in µs] [-w chip wake-up time in µs] [-n detections]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((lLatency < 0) || (lLatency > 999999) || (lWakeup < 0) || (lWakeup > 999999) || (uiRuns == 0)) {
+    fprintf(stderr, "Invalid argument\n");
+    return EXIT_FAILURE;
+  }
+
+  // Registered before the first context: the simulated driver is the only one
+  nfc_register_driver(&sim_driver);
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+  if ((nfc_list_devices(context, &connstring, 1) != 1) || ((pnd = nfc_open(context, connstring)) == NULL)) {
+    fprintf(stderr, "Unable to open the simulated device\n");
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+  if ((nfc_initiator_init(pnd) < 0) || (nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, false) < 0)) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+
+  printf("%ld us per exchange with the chip, %ld us to wake it up, %ld us per RF poll, tag arriving after 50 to 300 ms\n",
+         lLatency, lWakeup, lPoll);
+  srand(1);
+  const long alSleepMs[] = { -1, 0, 20, 50, 100, 200 };
+  for (size_t n = 0; n < sizeof(alSleepMs) / sizeof(alSleepMs[0]); n++) {
+    if (bench(pnd, alSleepMs[n], uiRuns) < 0)
+      res = -1;
+  }
+  if ((bench_timeout(pnd) < 0) || (bench_interrupt(pnd, false) < 0))
+    res = -1;
+  // Closes the device
+  if (bench_interrupt(pnd, true) < 0)
+    res = -1;
+
+  nfc_exit(context);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -122,9 +122,7 @@
 typedef struct {
   uint8_t ui8Code;
   uint8_t ui8CompatFlags;
-#ifdef LOG
   const char *abtCommandText;
-#endif
 } pn53x_command;
 
 typedef enum {
@@ -135,11 +133,11 @@ typedef enum {
   RCS360  = 0x08
 } pn53x_type;
 
+// Command names are kept without LOG too: they label the device statistics
+#  define PNCMD( X, Y ) { X , Y, #X }
 #ifndef LOG
-#  define PNCMD( X, Y ) { X , Y }
 #  define PNCMD_TRACE( X ) do {} while(0)
 #else
-#  define PNCMD( X, Y ) { X , Y, #X }
 #  define PNCMD_TRACE( X ) do { \
     for (size_t i=0; i<(sizeof(pn53x_commands)/sizeof(pn53x_command)); i++) { \
       if ( X == pn53x_commands[i].ui8Code ) { \
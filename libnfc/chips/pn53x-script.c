@@ -0,0 +1,621 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file pn53x-script.c
+ * @brief Compiled PN53x command scripts (pn53x-tamashell syntax)
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#  include <time.h>
+#  define msleep(x) do { \
+    struct timespec xsleep; \
+    xsleep.tv_sec = x / 1000; \
+    xsleep.tv_nsec = (x - xsleep.tv_sec * 1000) * 1000 * 1000; \
+    nanosleep(&xsleep, NULL); \
+  } while (0)
+#else
+#  include <windows.h>
+#  define msleep Sleep
+#endif
+
+#include "nfc/nfc.h"
+#include "nfc-internal.h"
+#include "pn53x.h"
+#include "pn53x-internal.h"
+#include "pn53x-script.h"
+
+#define LOG_CATEGORY "libnfc.chip.pn53x.script"
+#define LOG_GROUP NFC_LOG_GROUP_CHIP
+
+#define SCRIPT_MAX_VARIABLES      16
+#define SCRIPT_MAX_VARIABLE_NAME  16
+#define SCRIPT_MAX_LOOP_DEPTH     8
+
+typedef enum {
+  SCRIPT_TRANSCEIVE,
+  SCRIPT_PAUSE,
+  SCRIPT_SET,
+  SCRIPT_INC,
+  SCRIPT_LOOP,
+  SCRIPT_NEXT,
+} script_opcode;
+
+typedef enum {
+  EXPECT_NONE,
+  EXPECT_EXACT,     // response length must match the pattern
+  EXPECT_PREFIX,    // pattern ended with "*"
+} script_expect;
+
+// Frame byte to overwrite with a variable before sending
+struct script_patch {
+  uint16_t offset;
+  uint8_t  variable;
+};
+
+struct script_op {
+  script_opcode opcode;
+  unsigned int line;
+  int      arg;           // PAUSE: ms, SET/INC: value, LOOP: count
+  uint8_t  variable;      // SET/INC
+  size_t   jump;          // LOOP: op following the matching NEXT, NEXT: matching LOOP
+  // TRANSCEIVE
+  size_t   tx;            // frame offset in pbtPool
+  size_t   szTx;
+  size_t   patch;         // first patch in patches
+  size_t   szPatches;
+  script_expect expect;
+  size_t   pattern;       // szPattern values then szPattern masks in pbtPool
+  size_t   szPattern;
+  size_t   step;          // index in stats
+};
+
+struct pn53x_script {
+  struct script_op *ops;
+  size_t   szOps;
+  size_t   szOpsAlloc;
+  uint8_t *pbtPool;
+  size_t   szPool;
+  size_t   szPoolAlloc;
+  struct script_patch *patches;
+  size_t   szPatches;
+  size_t   szPatchesAlloc;
+  struct pn53x_script_step_stats *stats;
+  size_t   szSteps;
+  char     acVariables[SCRIPT_MAX_VARIABLES][SCRIPT_MAX_VARIABLE_NAME];
+  size_t   szVariables;
+  unsigned int uiErrorLine;
+};
+
+static int
+script_grow(void **pp, size_t *pszAlloc, const size_t szNeeded, const size_t szElem)
+{
+  if (szNeeded <= *pszAlloc)
+    return 0;
+  size_t szAlloc = *pszAlloc ? *pszAlloc : 16;
+  while (szAlloc < szNeeded)
+    szAlloc *= 2;
+  void *p = realloc(*pp, szAlloc * szElem);
+  if (!p)
+    return NFC_ESOFT;
+  *pp = p;
+  *pszAlloc = szAlloc;
+  return 0;
+}
+
+static struct script_op *
+script_add_op(pn53x_script *script, const script_opcode opcode, const unsigned int line)
+{
+  if (script_grow((void **) &script->ops, &script->szOpsAlloc, script->szOps + 1, sizeof(struct script_op)) < 0)
+    return NULL;
+  struct script_op *op = &script->ops[script->szOps++];
+  memset(op, 0, sizeof(*op));
+  op->opcode = opcode;
+  op->line = line;
+  return op;
+}
+
+static int
+script_add_byte(pn53x_script *script, const uint8_t byte)
+{
+  if (script_grow((void **) &script->pbtPool, &script->szPoolAlloc, script->szPool + 1, 1) < 0)
+    return NFC_ESOFT;
+  script->pbtPool[script->szPool++] = byte;
+  return 0;
+}
+
+// Returns the character following kw when line starts with keyword kw
+static const char *
+script_keyword(const char *pcLine, const char *kw)
+{
+  size_t szKw = strlen(kw);
+  if (strncmp(pcLine, kw, szKw) || (pcLine[szKw] && !isspace((unsigned char) pcLine[szKw])))
+    return NULL;
+  return pcLine + szKw;
+}
+
+static const char *
+script_skip_spaces(const char *pc)
+{
+  while (isspace((unsigned char) *pc))
+    pc++;
+  return pc;
+}
+
+static bool
+script_is_comment(const char *pc)
+{
+  return (*pc == '\0') || (*pc == ';') || (*pc == '#') || (pc[0] == '/' && pc[1] == '/');
+}
+
+static int
+script_parse_number(const char **ppc, int *piValue)
+{
+  char *end;
+  long l = strtol(*ppc, &end, 0);
+  if (end == *ppc)
+    return NFC_EINVARG;
+  *ppc = end;
+  *piValue = (int) l;
+  return 0;
+}
+
+// Parses "$name", declaring the variable if bDeclare is set
+static int
+script_parse_variable(pn53x_script *script, const char **ppc, const bool bDeclare, uint8_t *pui8Variable)
+{
+  const char *pc = *ppc;
+  if (*pc != '$')
+    return NFC_EINVARG;
+  pc++;
+  size_t szName = 0;
+  while (isalnum((unsigned char) pc[szName]) || pc[szName] == '_')
+    szName++;
+  if ((szName == 0) || (szName >= SCRIPT_MAX_VARIABLE_NAME))
+    return NFC_EINVARG;
+  *ppc = pc + szName;
+  for (size_t n = 0; n < script->szVariables; n++) {
+    if ((strlen(script->acVariables[n]) == szName) && !strncmp(script->acVariables[n], pc, szName)) {
+      *pui8Variable = (uint8_t) n;
+      return 0;
+    }
+  }
+  if (!bDeclare || (script->szVariables == SCRIPT_MAX_VARIABLES))
+    return NFC_EINVARG;
+  memcpy(script->acVariables[script->szVariables], pc, szName);
+  script->acVariables[script->szVariables][szName] = '\0';
+  *pui8Variable = (uint8_t) script->szVariables++;
+  return 0;
+}
+
+// One or two nibbles, "?" matches anything when pbtMask is given
+static int
+script_parse_byte(const char **ppc, uint8_t *pbtValue, uint8_t *pbtMask)
+{
+  const char *pc = *ppc;
+  uint8_t value = 0, mask = 0;
+  int nibbles = 0;
+  while (nibbles < 2) {
+    int c = (unsigned char) pc[nibbles];
+    value <<= 4;
+    mask <<= 4;
+    if (isxdigit(c)) {
+      value |= (uint8_t)(isdigit(c) ? c - '0' : (tolower(c) - 'a' + 10));
+      mask |= 0x0f;
+    } else if ((c != '?') || !pbtMask) {
+      value >>= 4;
+      mask >>= 4;
+      break;
+    }
+    nibbles++;
+  }
+  if (!nibbles)
+    return NFC_EINVARG;
+  *ppc = pc + nibbles;
+  *pbtValue = value;
+  if (pbtMask)
+    *pbtMask = mask;
+  return 0;
+}
+
+static int
+script_compile_command(pn53x_script *script, const char *pc, const unsigned int line)
+{
+  size_t tx = script->szPool;
+  size_t patch = script->szPatches;
+  size_t szTx = 0;
+
+  while (*(pc = script_skip_spaces(pc))) {
+    uint8_t byte = 0;
+    if (*pc == '$') {
+      uint8_t variable;
+      if (script_parse_variable(script, &pc, false, &variable) < 0)
+        return NFC_EINVARG;
+      if (script_grow((void **) &script->patches, &script->szPatchesAlloc, script->szPatches + 1, sizeof(struct script_patch)) < 0)
+        return NFC_ESOFT;
+      script->patches[script->szPatches].offset = (uint16_t) szTx;
+      script->patches[script->szPatches].variable = variable;
+      script->szPatches++;
+    } else if (script_parse_byte(&pc, &byte, NULL) < 0) {
+      break;
+    }
+    if (++szTx > PN53x_EXTENDED_FRAME__DATA_MAX_LEN)
+      return NFC_EOVFLOW;
+    if (script_add_byte(script, byte) < 0)
+      return NFC_ESOFT;
+  }
+  if (szTx == 0) {
+    // Not a command, the interactive parser used to ignore such lines too
+    return (*pc == '=') ? NFC_EINVARG : 0;
+  }
+
+  struct script_op *op = script_add_op(script, SCRIPT_TRANSCEIVE, line);
+  if (!op)
+    return NFC_ESOFT;
+  op->tx = tx;
+  op->szTx = szTx;
+  op->patch = patch;
+  op->szPatches = script->szPatches - patch;
+  op->step = script->szSteps++;
+
+  if (*pc != '=')
+    return 0;
+  pc++;
+
+  // Values and masks are stored separately so matching is two plain loops
+  uint8_t abtValues[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t abtMasks[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t szPattern = 0;
+  op->expect = EXPECT_EXACT;
+  while (*(pc = script_skip_spaces(pc))) {
+    if (*pc == '*') {
+      op->expect = EXPECT_PREFIX;
+      break;
+    }
+    if (szPattern == sizeof(abtValues))
+      return NFC_EOVFLOW;
+    if (script_parse_byte(&pc, &abtValues[szPattern], &abtMasks[szPattern]) < 0)
+      break;
+    szPattern++;
+  }
+  op->pattern = script->szPool;
+  op->szPattern = szPattern;
+  for (size_t n = 0; n < szPattern; n++) {
+    if (script_add_byte(script, abtValues[n]) < 0)
+      return NFC_ESOFT;
+  }
+  for (size_t n = 0; n < szPattern; n++) {
+    if (script_add_byte(script, abtMasks[n]) < 0)
+      return NFC_ESOFT;
+  }
+  return 0;
+}
+
+/**
+ * @brief Compile a script
+ * @return the compiled script or NULL; on syntax errors, the faulty line is stored in \a puiErrorLine if not NULL
+ */
+pn53x_script *
+pn53x_script_compile(const char *pcText, unsigned int *puiErrorLine)
+{
+  pn53x_script *script;
+  char *pcCopy;
+  size_t aszLoops[SCRIPT_MAX_LOOP_DEPTH];
+  size_t szDepth = 0;
+  unsigned int line = 0;
+  int res = 0;
+
+  if (puiErrorLine)
+    *puiErrorLine = 0;
+  if (!(script = calloc(1, sizeof(*script))))
+    return NULL;
+  if (!(pcCopy = strdup(pcText))) {
+    free(script);
+    return NULL;
+  }
+
+  char *pcLine = pcCopy;
+  while (pcLine && (res == 0)) {
+    char *pcEol = strchr(pcLine, '\n');
+    if (pcEol)
+      *pcEol = '\0';
+    line++;
+
+    const char *pc = script_skip_spaces(pcLine);
+    const char *arg;
+    struct script_op *op = NULL;
+    if (script_is_comment(pc)) {
+      // Nothing to do
+    } else if (*pc == 'q') {
+      break;
+    } else if (*pc == 'p') {
+      arg = script_skip_spaces(pc + 1);
+      if ((op = script_add_op(script, SCRIPT_PAUSE, line)) == NULL)
+        res = NFC_ESOFT;
+      else if ((script_parse_number(&arg, &op->arg) < 0) || (op->arg < 0))
+        res = NFC_EINVARG;
+    } else if ((arg = script_keyword(pc, "loop"))) {
+      arg = script_skip_spaces(arg);
+      if (szDepth == SCRIPT_MAX_LOOP_DEPTH)
+        res = NFC_EOVFLOW;
+      else if ((op = script_add_op(script, SCRIPT_LOOP, line)) == NULL)
+        res = NFC_ESOFT;
+      else if ((script_parse_number(&arg, &op->arg) < 0) || (op->arg < 0))
+        res = NFC_EINVARG;
+      else
+        aszLoops[szDepth++] = script->szOps - 1;
+    } else if (script_keyword(pc, "next")) {
+      if (szDepth == 0)
+        res = NFC_EINVARG;
+      else if ((op = script_add_op(script, SCRIPT_NEXT, line)) == NULL)
+        res = NFC_ESOFT;
+      else {
+        op->jump = aszLoops[--szDepth];
+        script->ops[op->jump].jump = script->szOps;
+      }
+    } else if ((arg = script_keyword(pc, "set")) || (arg = script_keyword(pc, "inc"))) {
+      bool bSet = (*pc == 's');
+      arg = script_skip_spaces(arg);
+      if ((op = script_add_op(script, bSet ? SCRIPT_SET : SCRIPT_INC, line)) == NULL)
+        res = NFC_ESOFT;
+      else if (script_parse_variable(script, &arg, bSet, &op->variable) < 0)
+        res = NFC_EINVARG;
+      else {
+        arg = script_skip_spaces(arg);
+        res = script_parse_number(&arg, &op->arg);
+      }
+    } else {
+      res = script_compile_command(script, pc, line);
+    }
+    pcLine = pcEol ? pcEol + 1 : NULL;
+  }
+  free(pcCopy);
+
+  if ((res == 0) && (szDepth > 0)) {
+    line = script->ops[aszLoops[szDepth - 1]].line;
+    res = NFC_EINVARG;
+  }
+  if ((res == 0) && script->szSteps) {
+    if (!(script->stats = calloc(script->szSteps, sizeof(*script->stats))))
+      res = NFC_ESOFT;
+  }
+  if (res < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Script error at line %u", line);
+    if (puiErrorLine)
+      *puiErrorLine = line;
+    pn53x_script_free(script);
+    return NULL;
+  }
+  for (size_t n = 0; n < script->szOps; n++) {
+    if (script->ops[n].opcode == SCRIPT_TRANSCEIVE)
+      script->stats[script->ops[n].step].line = script->ops[n].line;
+  }
+  return script;
+}
+
+/**
+ * @brief Compile a script read from \a input until end of file
+ */
+pn53x_script *
+pn53x_script_compile_file(FILE *input, unsigned int *puiErrorLine)
+{
+  char *pcText = NULL;
+  size_t szText = 0, szAlloc = 0;
+  size_t szRead;
+
+  if (puiErrorLine)
+    *puiErrorLine = 0;
+  do {
+    if (script_grow((void **) &pcText, &szAlloc, szText + 1024, 1) < 0) {
+      free(pcText);
+      return NULL;
+    }
+    szRead = fread(pcText + szText, 1, szAlloc - szText - 1, input);
+    szText += szRead;
+  } while (szRead > 0);
+  if (ferror(input)) {
+    free(pcText);
+    return NULL;
+  }
+  pcText[szText] = '\0';
+
+  pn53x_script *script = pn53x_script_compile(pcText, puiErrorLine);
+  free(pcText);
+  return script;
+}
+
+void
+pn53x_script_free(pn53x_script *script)
+{
+  if (!script)
+    return;
+  free(script->ops);
+  free(script->pbtPool);
+  free(script->patches);
+  free(script->stats);
+  free(script);
+}
+
+static bool
+script_match(const pn53x_script *script, const struct script_op *op, const uint8_t *pbtRx, const size_t szRx)
+{
+  if ((op->expect == EXPECT_EXACT) ? (szRx != op->szPattern) : (szRx < op->szPattern))
+    return false;
+  const uint8_t *pbtValues = script->pbtPool + op->pattern;
+  const uint8_t *pbtMasks = pbtValues + op->szPattern;
+  for (size_t n = 0; n < op->szPattern; n++) {
+    if ((pbtRx[n] & pbtMasks[n]) != pbtValues[n])
+      return false;
+  }
+  return true;
+}
+
+static int
+pn53x_script_run_locked(struct nfc_device *pnd, pn53x_script *script, pn53x_script_trace_cb trace, void *data)
+{
+  uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t aui8Variables[SCRIPT_MAX_VARIABLES];
+  size_t aszLoops[SCRIPT_MAX_LOOP_DEPTH];
+  int aiLoopsLeft[SCRIPT_MAX_LOOP_DEPTH];
+  size_t szDepth = 0;
+  size_t pc = 0;
+
+  memset(aui8Variables, 0, sizeof(aui8Variables));
+  script->uiErrorLine = 0;
+
+  while (pc < script->szOps) {
+    const struct script_op *op = &script->ops[pc];
+    switch (op->opcode) {
+      case SCRIPT_TRANSCEIVE: {
+        uint8_t *pbtTx = script->pbtPool + op->tx;
+        const struct script_patch *patches = script->patches + op->patch;
+        for (size_t n = 0; n < op->szPatches; n++)
+          pbtTx[patches[n].offset] = aui8Variables[patches[n].variable];
+
+        struct pn53x_script_step_stats *stats = &script->stats[op->step];
+        uint64_t start = monotonic_time_us();
+        int res = pn53x_transceive(pnd, pbtTx, op->szTx, abtRx, sizeof(abtRx), 0);
+        uint64_t elapsed = monotonic_time_us() - start;
+        if ((stats->runs == 0) || (elapsed < stats->min_us))
+          stats->min_us = elapsed;
+        if (elapsed > stats->max_us)
+          stats->max_us = elapsed;
+        stats->total_us += elapsed;
+        stats->runs++;
+
+        if (trace)
+          trace(op->line, pbtTx, op->szTx, abtRx, res, data);
+        if ((res >= 0) && (op->expect != EXPECT_NONE) && !script_match(script, op, abtRx, (size_t) res))
+          res = NFC_ESOFT;
+        if (res < 0) {
+          stats->failures++;
+          script->uiErrorLine = op->line;
+          return res;
+        }
+        pc++;
+        break;
+      }
+      case SCRIPT_PAUSE:
+        if (trace)
+          trace(op->line, NULL, 0, NULL, op->arg, data);
+        if (op->arg > 0)
+          msleep(op->arg);
+        pc++;
+        break;
+      case SCRIPT_SET:
+        aui8Variables[op->variable] = (uint8_t) op->arg;
+        pc++;
+        break;
+      case SCRIPT_INC:
+        aui8Variables[op->variable] += (uint8_t) op->arg;
+        pc++;
+        break;
+      case SCRIPT_LOOP:
+        if (op->arg == 0) {
+          pc = op->jump;
+          break;
+        }
+        aszLoops[szDepth] = pc;
+        aiLoopsLeft[szDepth] = op->arg;
+        szDepth++;
+        pc++;
+        break;
+      case SCRIPT_NEXT:
+        if (--aiLoopsLeft[szDepth - 1] > 0) {
+          pc = aszLoops[szDepth - 1] + 1;
+        } else {
+          szDepth--;
+          pc++;
+        }
+        break;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Run a compiled script
+ * @return 0 on success, otherwise the libnfc error code of the failing command, or NFC_ESOFT if a response did not match its pattern
+ *
+ * Commands are sent back to back with no parsing nor output, unless \a trace is set.
+ * \a trace is called after each command, and before each pause with no frame and the pause length in ms as \a res.
+ * Timings are accumulated in the script statistics, see pn53x_script_get_step_stats().
+ */
+int
+pn53x_script_run(struct nfc_device *pnd, pn53x_script *script, pn53x_script_trace_cb trace, void *data)
+{
+  // No command from another thread may come in between those of the script
+  nfc_device_lock(pnd);
+  int res = pn53x_script_run_locked(pnd, script, trace, data);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/**
+ * @brief Line of the command that made the last pn53x_script_run() fail, 0 if it succeeded
+ */
+unsigned int
+pn53x_script_error_line(const pn53x_script *script)
+{
+  return script->uiErrorLine;
+}
+
+/**
+ * @brief Number of commands in the script, i.e. of available step statistics
+ */
+size_t
+pn53x_script_step_count(const pn53x_script *script)
+{
+  return script->szSteps;
+}
+
+int
+pn53x_script_get_step_stats(const pn53x_script *script, const size_t szStep, struct pn53x_script_step_stats *pstats)
+{
+  if (szStep >= script->szSteps)
+    return NFC_EINVARG;
+  *pstats = script->stats[szStep];
+  return NFC_SUCCESS;
+}
+
+void
+pn53x_script_reset_stats(pn53x_script *script)
+{
+  for (size_t n = 0; n < script->szSteps; n++) {
+    unsigned int line = script->stats[n].line;
+    memset(&script->stats[n], 0, sizeof(script->stats[n]));
+    script->stats[n].line = line;
+  }
+}
@@ -0,0 +1,81 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file pn53x-script.h
+ * @brief Compiled PN53x command scripts (pn53x-tamashell syntax)
+ *
+ * A script is parsed once by pn53x_script_compile() into a flat list of
+ * steps, then pn53x_script_run() plays it back to back on a device.
+ *
+ * Syntax, one statement per line:
+ *  - hexadecimal bytes: a PN53x command without the D4 prefix, e.g. "40 01 30 04".
+ *    A "$name" token stands for the current value of a variable.
+ *    An optional "= pattern" checks the response: hexadecimal bytes where
+ *    "?" matches any nibble, and a trailing "*" accepts any further bytes.
+ *  - "p N": pause N milliseconds.
+ *  - "loop N" ... "next": run the enclosed statements N times (nestable).
+ *  - "set $name N", "inc $name N": assign or add to a one-byte variable.
+ *  - "q": end of script.
+ * Anything starting with ";", "#" or "//" is a comment.
+ */
+
+#ifndef __NFC_CHIPS_PN53X_SCRIPT_H__
+#  define __NFC_CHIPS_PN53X_SCRIPT_H__
+
+#  include <stdint.h>
+#  include <stdio.h>
+#  include <nfc/nfc-types.h>
+
+typedef struct pn53x_script pn53x_script;
+
+/* Timing of one command of a script, accumulated over runs */
+struct pn53x_script_step_stats {
+  unsigned int line;      /* line of the command in the script source */
+  size_t   runs;
+  size_t   failures;      /* errors and unexpected responses */
+  uint64_t total_us;
+  uint64_t min_us;
+  uint64_t max_us;
+};
+
+/* Called after each command when tracing: res is the response length or a libnfc error code.
+ * Also called before each pause, with pbtTx NULL and res the pause length in ms. */
+typedef void (*pn53x_script_trace_cb)(unsigned int line, const uint8_t *pbtTx, const size_t szTx,
+                                      const uint8_t *pbtRx, const int res, void *data);
+
+pn53x_script *pn53x_script_compile(const char *pcText, unsigned int *puiErrorLine);
+pn53x_script *pn53x_script_compile_file(FILE *input, unsigned int *puiErrorLine);
+void    pn53x_script_free(pn53x_script *script);
+
+int     pn53x_script_run(struct nfc_device *pnd, pn53x_script *script, pn53x_script_trace_cb trace, void *data);
+unsigned int pn53x_script_error_line(const pn53x_script *script);
+
+size_t  pn53x_script_step_count(const pn53x_script *script);
+int     pn53x_script_get_step_stats(const pn53x_script *script, const size_t szStep, struct pn53x_script_step_stats *pstats);
+void    pn53x_script_reset_stats(pn53x_script *script);
+
+#endif // __NFC_CHIPS_PN53X_SCRIPT_H__
@@ -69,7 +69,6 @@ pn53x_modulation pn53x_nm_to_pm(const nfc_modulation nm);
 pn53x_target_type pn53x_nm_to_ptt(const nfc_modulation nm);
 
 void *pn53x_current_target_new(const struct nfc_device *pnd, const nfc_target *pnt);
-void pn53x_current_target_free(const struct nfc_device *pnd);
 bool pn53x_current_target_is(const struct nfc_device *pnd, const nfc_target *pnt);
 
 /* implementations */
@@ -154,13 +153,78 @@ pn53x_reset_settings(struct nfc_device *pnd)
 int
 pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout)
 {
-  bool mi = false;
-  int res = 0;
-  if (CHIP_DATA(pnd)->wb_trigged) {
-    if ((res = pn53x_writeback_register(pnd)) < 0) {
-      return res;
+  // Exported: applications may call it directly, so the register write-back and the command must not interleave
+  nfc_device_lock(pnd);
+  int res = pn53x_transceive_stream(pnd, pbtTx, szTx, pbtRx, szRxLen, NULL, NULL, timeout);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+static int
+pn53x_io_send(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
+{
+  int res = CHIP_DATA(pnd)->io->send(pnd, pbtTx, szTx, timeout);
+  if (res >= 0) {
+    pthread_mutex_lock(&pnd->stats_lock);
+    pnd->stats.tx_frames++;
+    pnd->stats.tx_bytes += szTx;
+    pthread_mutex_unlock(&pnd->stats_lock);
+  }
+  return res;
+}
+
+static int
+pn53x_io_receive(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  int res = CHIP_DATA(pnd)->io->receive(pnd, pbtRx, szRx, timeout);
+  if (res >= 0) {
+    pthread_mutex_lock(&pnd->stats_lock);
+    pnd->stats.rx_frames++;
+    pnd->stats.rx_bytes += (size_t) res;
+    pthread_mutex_unlock(&pnd->stats_lock);
+  }
+  return res;
+}
+
+static void
+pn53x_stats_update(struct nfc_device *pnd, const uint8_t ui8Command, const int res, const uint64_t ui64Elapsed)
+{
+  nfc_command_stats *pcs = &pnd->stats.commands[CHIP_DATA(pnd)->stats_slot[ui8Command]];
+
+  // Bucket i holds the latencies below NFC_STATS_LATENCY_BASE_US << i
+  size_t szBucket = 0;
+  for (uint64_t t = ui64Elapsed / NFC_STATS_LATENCY_BASE_US; t && (szBucket < NFC_STATS_LATENCY_BUCKETS - 1); t >>= 1) {
+    szBucket++;
+  }
+  pthread_mutex_lock(&pnd->stats_lock);
+  pcs->count++;
+  pcs->latency_us_total += ui64Elapsed;
+  pcs->latency_buckets[szBucket]++;
+
+  if (CHIP_DATA(pnd)->last_status_byte) {
+    pnd->stats.status_errors[CHIP_DATA(pnd)->last_status_byte % NFC_STATS_STATUS_CODES]++;
+  }
+  if (res < 0) {
+    pcs->errors++;
+    if (res == NFC_ETIMEOUT) {
+      pnd->stats.timeouts++;
+    } else if (res == NFC_EOPABORTED) {
+      pnd->stats.aborts++;
     }
   }
+  pthread_mutex_unlock(&pnd->stats_lock);
+}
+
+static int
+pn53x_transceive_frames(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen,
+                        pn53x_chunk_callback cb, void *data, int timeout)
+{
+  bool mi = false;
+  bool chained = false;
+  bool store = true;
+  bool overflow = false;
+  int res = 0;
+  int cb_res = 0;
 
   PNCMD_TRACE(pbtTx[0]);
   if (timeout > 0) {
@@ -173,18 +237,18 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid timeout value: %d", timeout);
   }
 
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t  szRx = sizeof(abtRx);
+  uint8_t *abtScratch = CHIP_DATA(pnd)->abtRxScratch;
+  size_t  szRx = szRxLen;
 
-  // Check if receiving buffers are available, if not, replace them
+  // Check if receiving buffers are available, if not, use the chip scratch buffer
   if (szRxLen == 0 || !pbtRx) {
-    pbtRx = abtRx;
-  } else {
-    szRx = szRxLen;
+    pbtRx = abtScratch;
+    szRx = sizeof(CHIP_DATA(pnd)->abtRxScratch);
+    store = false;
   }
 
   // Call the send/receice callback functions of the current driver
-  if ((res = CHIP_DATA(pnd)->io->send(pnd, pbtTx, szTx, timeout)) < 0) {
+  if ((res = pn53x_io_send(pnd, pbtTx, szTx, timeout)) < 0) {
     return res;
   }
 
@@ -193,17 +257,13 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
 
   // Handle power mode for PN532
   if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) {  // PN532 automatically goes into PowerDown mode when TgInitAsTarget command will be sent
-    CHIP_DATA(pnd)->power_mode = POWERDOWN;
+    pn53x_set_power_mode(pnd, POWERDOWN);
   }
 
-  if ((res = CHIP_DATA(pnd)->io->receive(pnd, pbtRx, szRx, timeout)) < 0) {
+  if ((res = pn53x_io_receive(pnd, pbtRx, szRx, timeout)) < 0) {
     return res;
   }
 
-  if ((CHIP_DATA(pnd)->type == PN532) && (TgInitAsTarget == pbtTx[0])) { // PN532 automatically wakeup on external RF field
-    CHIP_DATA(pnd)->power_mode = NORMAL; // When TgInitAsTarget reply that means an external RF have waken up the chip
-  }
-
   switch (pbtTx[0]) {
     case PowerDown:
     case InDataExchange:
@@ -219,9 +279,14 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
     case TgResponseToInitiator:
     case TgSetGeneralBytes:
     case TgSetMetaData:
-      if (pbtRx[0] & 0x80) { abort(); } // NAD detected
-//      if (pbtRx[0] & 0x40) { abort(); } // MI detected
+      if (pbtRx[0] & 0x80) { // NAD detected
+        // libnfc never asks for NAD, a NAD byte would be taken for data
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unexpected NAD in PN53x response");
+        pnd->last_error = NFC_ECHIP;
+        return pnd->last_error;
+      }
       mi = pbtRx[0] & 0x40;
+      chained = true;
       CHIP_DATA(pnd)->last_status_byte = pbtRx[0] & 0x3f;
       break;
     case Diagnose:
@@ -254,28 +319,96 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
       CHIP_DATA(pnd)->last_status_byte = 0;
   }
 
+  // Power mode changes the PN532 makes on its own once it answered
+  if (CHIP_DATA(pnd)->type == PN532) {
+    switch (pbtTx[0]) {
+      case TgInitAsTarget: // An external RF field has waken up the chip
+      case SAMConfiguration: // Out of LowVBat
+        pn53x_set_power_mode(pnd, NORMAL);
+        break;
+      case PowerDown: // Asleep right after its answer, until a wake-up source fires
+        if (CHIP_DATA(pnd)->last_status_byte == 0)
+          pn53x_set_power_mode(pnd, POWERDOWN);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // Bytes held by pbtRx and bytes of the whole response, status byte included
+  size_t szStored = (size_t) res;
+  size_t szTotal = (size_t) res;
+
+  if (cb && chained && (szTotal > 1) && (CHIP_DATA(pnd)->last_status_byte == 0)) {
+    cb_res = cb(pnd, pbtRx + 1, szTotal - 1, data);
+  }
+
+  // Next frames are requested with the command code, plus the target number for InDataExchange
+  const size_t szMiTx = (szTx < 2) ? szTx : 2;
+
   while (mi) {
-    int res2;
-    uint8_t  abtRx2[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+    uint8_t *pbtFrame;
+    uint8_t btSaved = 0;
+    const bool bInPlace = store && !overflow && (szRx - (szStored - 1) >= PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+
+    if (bInPlace) {
+      pbtFrame = pbtRx + szStored - 1;
+      btSaved = pbtFrame[0];
+    } else {
+      pbtFrame = abtScratch;
+    }
     // Send empty command to card
-    if ((res2 = CHIP_DATA(pnd)->io->send(pnd, pbtTx, 2, timeout)) < 0) {
-      return res2;
+    if ((res = pn53x_io_send(pnd, pbtTx, szMiTx, timeout)) < 0) {
+      return res;
+    }
+    if ((res = pn53x_io_receive(pnd, pbtFrame, bInPlace ? szRx - (szStored - 1) : PN53x_EXTENDED_FRAME__DATA_MAX_LEN, timeout)) < 0) {
+      return res;
     }
-    if ((res2 = CHIP_DATA(pnd)->io->receive(pnd, abtRx2, sizeof(abtRx2), timeout)) < 0) {
-      return res2;
+    if (res < 1) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Empty frame in a chained response");
+      pnd->last_error = NFC_EIO;
+      return pnd->last_error;
     }
-    mi = abtRx2[0] & 0x40;
-    if ((size_t)(res + res2 - 1) > szRx) {
-      CHIP_DATA(pnd)->last_status_byte = ESMALLBUF;
+    const uint8_t btStatus = pbtFrame[0];
+    const size_t szFrameData = (size_t) res - 1;
+    if (btStatus & 0x80) { // NAD detected
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unexpected NAD in PN53x response");
+      pnd->last_error = NFC_ECHIP;
+      return pnd->last_error;
+    }
+    mi = btStatus & 0x40;
+    CHIP_DATA(pnd)->last_status_byte = btStatus & 0x3f;
+    if (bInPlace) {
+      pbtFrame[0] = btSaved;
+    }
+    if (CHIP_DATA(pnd)->last_status_byte != 0) {
       break;
     }
-    memcpy(pbtRx + res, abtRx2 + 1, res2 - 1);
+    if (cb && (cb_res >= 0) && (szFrameData > 0)) {
+      cb_res = cb(pnd, pbtFrame + 1, szFrameData, data);
+    }
+    if (bInPlace) {
+      szStored += szFrameData;
+    } else if (store && !overflow) {
+      if (szStored + szFrameData > szRx) {
+        // Keep draining the chain, but report the response as too large
+        overflow = true;
+      } else {
+        memcpy(pbtRx + szStored, pbtFrame + 1, szFrameData);
+        szStored += szFrameData;
+      }
+    }
+    szTotal += szFrameData;
     // Copy last status byte
-    pbtRx[0] = abtRx2[0];
-    res += res2 - 1;
+    pbtRx[0] = btStatus;
   }
 
-  szRx = (size_t) res;
+  if (overflow && (CHIP_DATA(pnd)->last_status_byte == 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Chained response too large: %lu bytes available, %lu received", (unsigned long) szRx, (unsigned long) szTotal);
+    CHIP_DATA(pnd)->last_status_byte = ESMALLBUF;
+  }
+
+  szRx = store ? szStored : szTotal;
 
   switch (CHIP_DATA(pnd)->last_status_byte) {
     case 0:
@@ -325,6 +458,12 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
       break;
   };
 
+  if ((res >= 0) && (cb_res < 0)) {
+    // The response was fine, the consumer gave up on it
+    pnd->last_error = cb_res;
+    return pnd->last_error;
+  }
+
   if (res < 0) {
     pnd->last_error = res;
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Chip error: \"%s\" (%02x), returned error: \"%s\" (%d))", pn53x_strerror(pnd), CHIP_DATA(pnd)->last_status_byte, nfc_strerror(pnd), res);
@@ -334,6 +473,40 @@ pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx
   return res;
 }
 
+/*
+ * Same as pn53x_transceive(), for responses chained with the MI (More
+ * Information) bit. Every following frame is received directly at its final
+ * offset in pbtRx, which may hold much more than a single PN53x frame: the
+ * frame status byte lands on the last byte already stored, which is saved
+ * and restored around the receive. Only when the room left is shorter than a
+ * full frame does the chip scratch buffer take the frame instead.
+ *
+ * If cb is not NULL, it is given the data of each frame (status byte
+ * excluded) as soon as the frame is received. A negative value returned by
+ * cb stops the callbacks: the chain is still drained so the chip and the
+ * target stay in step, then that value is returned.
+ * When pbtRx is NULL, nothing is stored and the full response length is
+ * returned, which lets cb consume responses of any size.
+ */
+int
+pn53x_transceive_stream(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen,
+                        pn53x_chunk_callback cb, void *data, int timeout)
+{
+  int res;
+  if (CHIP_DATA(pnd)->wb_trigged) {
+    if ((res = pn53x_writeback_register(pnd)) < 0) {
+      return res;
+    }
+  }
+
+  // The status byte is only meaningful for this command, not a stale one
+  CHIP_DATA(pnd)->last_status_byte = 0;
+  const uint64_t ui64Start = monotonic_time_us();
+  res = pn53x_transceive_frames(pnd, pbtTx, szTx, pbtRx, szRxLen, cb, data, timeout);
+  pn53x_stats_update(pnd, pbtTx[0], res, monotonic_time_us() - ui64Start);
+  return res;
+}
+
 int
 pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Parameter, const bool bEnable)
 {
@@ -654,21 +827,27 @@ pn53x_write_register(struct nfc_device *pnd, const uint16_t ui16RegisterAddress,
     if (ui8SymbolMask != 0xff) {
       int res = 0;
       uint8_t ui8CurrentValue;
-      if ((res = pn53x_read_register(pnd, ui16RegisterAddress, &ui8CurrentValue)) < 0)
-        return res;
-      uint8_t ui8NewValue = ((ui8Value & ui8SymbolMask) | (ui8CurrentValue & (~ui8SymbolMask)));
-      if (ui8NewValue != ui8CurrentValue) {
-        return pn53x_WriteRegister(pnd, ui16RegisterAddress, ui8NewValue);
+      // Read-modify-write: no other thread's command may come in between
+      nfc_device_lock(pnd);
+      if ((res = pn53x_read_register(pnd, ui16RegisterAddress, &ui8CurrentValue)) == 0) {
+        uint8_t ui8NewValue = ((ui8Value & ui8SymbolMask) | (ui8CurrentValue & (~ui8SymbolMask)));
+        if (ui8NewValue != ui8CurrentValue) {
+          res = pn53x_WriteRegister(pnd, ui16RegisterAddress, ui8NewValue);
+        }
       }
+      nfc_device_unlock(pnd);
+      return res;
     } else {
       return pn53x_WriteRegister(pnd, ui16RegisterAddress, ui8Value);
     }
   } else {
-    // Write-back cache area
+    // Write-back cache area, flushed by the next command of the thread holding the device lock
+    nfc_device_lock(pnd);
     const int internal_address = ui16RegisterAddress - PN53X_CACHE_REGISTER_MIN_ADDRESS;
     CHIP_DATA(pnd)->wb_data[internal_address] = (CHIP_DATA(pnd)->wb_data[internal_address] & CHIP_DATA(pnd)->wb_mask[internal_address] & (~ui8SymbolMask)) | (ui8Value & ui8SymbolMask);
     CHIP_DATA(pnd)->wb_mask[internal_address] = CHIP_DATA(pnd)->wb_mask[internal_address] | ui8SymbolMask;
     CHIP_DATA(pnd)->wb_trigged = true;
+    nfc_device_unlock(pnd);
   }
   return NFC_SUCCESS;
 }
@@ -1280,6 +1459,121 @@ end:
   return NFC_ECHIP;
 }
 
+/*
+ * Duty-cycled detection: the chip stays in PowerDown, RF field off, between
+ * short poll windows. Each window wakes the chip up with the command which
+ * turns the field on, tries each modulation once and, when nothing answers,
+ * turns the field off and powers the chip down again. The host sleeps
+ * without the device lock, until the next window or nfc_abort_command().
+ * The chip only wakes up on the host interface: cards do not make any RF
+ * field for its level detector. Whatever the outcome, the chip is left
+ * awake with the field on.
+ */
+int
+pn53x_initiator_poll_target_low_power(struct nfc_device *pnd,
+                                      const nfc_modulation *pnmModulations, const size_t szModulations,
+                                      const nfc_low_power_params *pparams,
+                                      nfc_target *pnt, nfc_low_power_stats *pstats)
+{
+  nfc_low_power_stats stats;
+  int res = 0, result = 0;
+
+  if ((CHIP_DATA(pnd)->type != PN532) || !pnd->driver->powerdown) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  if ((szModulations == 0) || !pparams) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+
+  memset(&stats, 0, sizeof(stats));
+  stats.wake_min_us = UINT64_MAX;
+  const unsigned long ulTransitions = CHIP_DATA(pnd)->power_transitions;
+  // One short activation attempt per modulation and window
+  const bool bInfiniteSelect = pnd->bInfiniteSelect;
+  if (bInfiniteSelect && ((res = pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, false)) < 0))
+    return res;
+
+  const uint64_t start = monotonic_time_us();
+  uint64_t now = start;
+  // Set while the chip may be powered down with the field off
+  bool bAsleep = false;
+  for (;;) {
+    const uint64_t window = monotonic_time_us();
+    // The first command of the window wakes the chip up
+    if ((res = pn53x_set_property_bool(pnd, NP_ACTIVATE_FIELD, true)) < 0) {
+      result = res;
+      break;
+    }
+    bAsleep = false;
+    const uint64_t wake = monotonic_time_us() - window;
+    stats.wake_min_us = MIN(stats.wake_min_us, wake);
+    stats.wake_max_us = MAX(stats.wake_max_us, wake);
+    stats.wake_mean_us += (wake - stats.wake_mean_us) / (stats.polls + 1);
+    stats.polls++;
+
+    for (size_t n = 0; (n < szModulations) && (result == 0); n++) {
+      uint8_t *pbtInitiatorData;
+      size_t szInitiatorData;
+      prepare_initiator_data(pnmModulations[n], &pbtInitiatorData, &szInitiatorData);
+      if ((res = pn53x_initiator_select_passive_target_ext(pnd, pnmModulations[n], pbtInitiatorData, szInitiatorData, pnt, -1)) < 0) {
+        if (pnd->last_error != NFC_ETIMEOUT)
+          result = res;
+      } else {
+        result = res;
+      }
+    }
+    if (result != 0) {
+      // The chip is left awake, with the target selected
+      now = monotonic_time_us();
+      stats.awake_us += now - window;
+      stats.window_max_us = MAX(stats.window_max_us, now - window);
+      break;
+    }
+
+    now = monotonic_time_us();
+    // No window would start before the timeout: the chip stays awake
+    if (pparams->timeout_ms && ((now - start) + (uint64_t) pparams->sleep_ms * 1000 >= (uint64_t) pparams->timeout_ms * 1000)) {
+      stats.awake_us += now - window;
+      stats.window_max_us = MAX(stats.window_max_us, now - window);
+      break;
+    }
+    bAsleep = true;
+    if (((res = pn53x_set_property_bool(pnd, NP_ACTIVATE_FIELD, false)) < 0) ||
+        ((res = pn53x_PowerDown(pnd)) < 0)) {
+      result = res;
+      break;
+    }
+    now = monotonic_time_us();
+    stats.awake_us += now - window;
+    stats.window_max_us = MAX(stats.window_max_us, now - window);
+    if ((res = nfc_device_sleep(pnd, pparams->sleep_ms)) < 0) {
+      result = res;
+      now = monotonic_time_us();
+      break;
+    }
+  }
+  // Back to normal mode with the field on: the command wakes the chip up
+  if (bAsleep)
+    pn53x_set_property_bool(pnd, NP_ACTIVATE_FIELD, true);
+  if (bInfiniteSelect)
+    pn53x_set_property_bool(pnd, NP_INFINITE_SELECT, true);
+  if (result < 0)
+    pnd->last_error = result;
+
+  stats.elapsed_us = MAX(now - start, 1);
+  stats.duty_cycle = (double) stats.awake_us / stats.elapsed_us;
+  if (stats.polls == 0)
+    stats.wake_min_us = 0;
+  stats.power_transitions = CHIP_DATA(pnd)->power_transitions - ulTransitions;
+  if (pstats)
+    *pstats = stats;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%lu poll window(s), duty cycle %.2f%%, wake-up %.0f us on average",
+          (unsigned long) stats.polls, stats.duty_cycle * 100, stats.wake_mean_us);
+  return result;
+}
+
 int
 pn53x_initiator_select_dep_target(struct nfc_device *pnd,
                                   const nfc_dep_mode ndm, const nfc_baud_rate nbr,
@@ -1391,6 +1685,498 @@ pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pbtTx, co
   return szRxBits;
 }
 
+/*
+ * Software ISO/IEC 14443-3 type A anticollision
+ *
+ * The PN53x firmware resolves at most two targets per InListPassiveTarget.
+ * Here the REQA, ANTICOLLISION and SELECT frames are sent raw with
+ * InCommunicateThru, the chip only handling the parity bits. Each collision
+ * is located with the CIU Coll register and splits the set of answering tags
+ * by the value of that bit: one half is followed right away, the other one
+ * is kept on a stack. A tag is HALTed as soon as its UID is complete, then
+ * the walk resumes from the stack, replaying the SELECTs of the cascade
+ * levels above the branch after a new REQA.
+ */
+#define PN53X_INVENTORY_LEVELS 3
+#define PN53X_INVENTORY_BLOCK_BITS 40
+// Each collision leaves one branch on the stack, at most one per bit of the UID
+#define PN53X_INVENTORY_STACK (PN53X_INVENTORY_LEVELS * PN53X_INVENTORY_BLOCK_BITS + 1)
+// Tags answer within a few hundreds of microseconds: 0x05 is 1.6 ms instead of 51.2 ms
+#define PN53X_INVENTORY_RETRY_TIMEOUT 0x05
+
+struct pn53x_inventory_branch {
+  size_t  szLevels;           // cascade levels of the branch already known
+  uint8_t abtBlocks[PN53X_INVENTORY_LEVELS][5];
+  size_t  szBits;             // bits known in the block of the current level
+};
+
+struct pn53x_inventory {
+  uint8_t ui8BitFraming;      // last value written in the CIU BitFraming register
+  uint8_t abtAtqa[2];
+};
+
+/*
+ * Sends szTxBits raw bits; the answer is stored from bit ui8RxAlign of pbtRx.
+ * Returns the number of bytes received, 0 when no tag answered, or a libnfc
+ * error code. On a bit collision, *piCollision is set to the number of valid
+ * bits received (counted from pbtRx[0] bit 0) and 0 is returned, else it
+ * is set to -1.
+ */
+static int
+pn53x_inventory_frame(struct nfc_device *pnd, struct pn53x_inventory *pi, const uint8_t *pbtTx, const size_t szTxBits,
+                      const uint8_t ui8RxAlign, uint8_t *pbtRx, const size_t szRx, int *piCollision)
+{
+  uint8_t abtCmd[1 + 2 + 5 + 2] = { InCommunicateThru };
+  uint8_t abtRx[1 + 5 + 2];
+  const size_t szTxBytes = (szTxBits + 7) / 8;
+  const uint8_t ui8BitFraming = (ui8RxAlign << 4) | (szTxBits % 8);
+  int res;
+
+  *piCollision = -1;
+  if (ui8BitFraming != pi->ui8BitFraming) {
+    // Full register write: it goes with the next command, without reading it first
+    if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, 0xff, ui8BitFraming)) < 0)
+      return res;
+    pi->ui8BitFraming = ui8BitFraming;
+    CHIP_DATA(pnd)->ui8TxBits = ui8BitFraming & SYMBOL_TX_LAST_BITS;
+  }
+
+  memcpy(abtCmd + 1, pbtTx, szTxBytes);
+  memset(abtRx, 0x00, sizeof(abtRx));
+  res = pn53x_transceive(pnd, abtCmd, 1 + szTxBytes, abtRx, sizeof(abtRx), -1);
+  if (res >= 1) {
+    res = MIN(res - 1, (int) szRx);
+    memcpy(pbtRx, abtRx + 1, res);
+    return res;
+  }
+  if (res == 0)
+    return NFC_ECHIP;
+  switch (CHIP_DATA(pnd)->last_status_byte) {
+    case ETIMEOUT:
+      pnd->last_error = 0;
+      return 0;
+    case EBITCOLL: {
+      // The chip answers with the bits received, the Coll register tells how many are valid
+      uint8_t ui8Coll;
+      if ((res = pn53x_read_register(pnd, PN53X_REG_CIU_Coll, &ui8Coll)) < 0)
+        return res;
+      if (ui8Coll & 0x20) { // CollPosNotValid
+        pnd->last_error = NFC_ERFTRANS;
+        return pnd->last_error;
+      }
+      *piCollision = ((ui8Coll & 0x1f) ? (ui8Coll & 0x1f) : 32) - 1;
+      memcpy(pbtRx, abtRx + 1, szRx);
+      pnd->last_error = 0;
+      return 0;
+    }
+    default:
+      return res;
+  }
+}
+
+// SELECT of a complete block: returns the SAK, 0x100 when no tag answered, or a libnfc error code
+static int
+pn53x_inventory_select(struct nfc_device *pnd, struct pn53x_inventory *pi, const size_t szLevel, const uint8_t *pbtBlock)
+{
+  uint8_t abtSelect[9] = { 0x93 + 2 * szLevel, 0x70 };
+  uint8_t abtSak[3];
+  int iCollision;
+  int res;
+
+  memcpy(abtSelect + 2, pbtBlock, 5);
+  iso14443a_crc_append(abtSelect, 7);
+  if ((res = pn53x_inventory_frame(pnd, pi, abtSelect, sizeof(abtSelect) * 8, 0, abtSak, sizeof(abtSak), &iCollision)) < 0)
+    return res;
+  if ((res == 0) && (iCollision < 0))
+    return 0x100;
+  uint8_t abtCrc[2];
+  iso14443a_crc(abtSak, 1, abtCrc);
+  if ((res != 3) || memcmp(abtSak + 1, abtCrc, 2)) {
+    pnd->last_error = NFC_ERFTRANS;
+    return pnd->last_error;
+  }
+  return abtSak[0];
+}
+
+int
+pn53x_initiator_inventory_iso14443a(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets)
+{
+  struct pn53x_inventory_branch *pStack;
+  struct pn53x_inventory inventory = { .ui8BitFraming = 0xff };
+  size_t  szStack = 0;
+  size_t  szFound = 0;
+  int     res = 0;
+
+  const bool bCrc = pnd->bCrc;
+  const bool bPar = pnd->bPar;
+  const bool bEasyFraming = pnd->bEasyFraming;
+
+  if ((pStack = malloc(PN53X_INVENTORY_STACK * sizeof(*pStack))) == NULL) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+
+  // Raw frames: CRC computed here, parity bits by the chip, and short timeouts as HALT is never answered
+  if (((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, false)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0) ||
+      ((res = pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), PN53X_INVENTORY_RETRY_TIMEOUT)) < 0))
+    goto out;
+
+  memset(&pStack[0], 0, sizeof(pStack[0]));
+  szStack = 1;
+
+  while ((szStack > 0) && (szFound < szTargets)) {
+    struct pn53x_inventory_branch *pb = &pStack[szStack - 1];
+    uint8_t abtRx[7];
+    int iCollision;
+
+    // Wake up the tags not yet HALTed; a collision between their ATQA is fine
+    const uint8_t abtReqa[] = { 0x26 };
+    if ((res = pn53x_inventory_frame(pnd, &inventory, abtReqa, 7, 0, abtRx, sizeof(abtRx), &iCollision)) < 0)
+      goto out;
+    if ((res == 0) && (iCollision < 0))
+      break;
+    if (iCollision < 0)
+      memcpy(inventory.abtAtqa, abtRx, 2);
+
+    // Back to the branch: tags in other branches of the upper levels leave on these SELECTs
+    size_t szLevel;
+    for (szLevel = 0; szLevel < pb->szLevels; szLevel++) {
+      if ((res = pn53x_inventory_select(pnd, &inventory, szLevel, pb->abtBlocks[szLevel])) < 0)
+        goto out;
+      if (res == 0x100)
+        break;
+    }
+    if (szLevel < pb->szLevels) {
+      szStack--;
+      continue;
+    }
+
+    for (;;) {
+      uint8_t *pbtBlock = pb->abtBlocks[pb->szLevels];
+      uint8_t abtAnticol[7] = { 0x93 + 2 * pb->szLevels, ((2 + pb->szBits / 8) << 4) | (pb->szBits % 8) };
+      memcpy(abtAnticol + 2, pbtBlock, (pb->szBits + 7) / 8);
+
+      // With RxAlign, the answer lines up with the block: it starts at its byte szBits / 8
+      const size_t szOffset = pb->szBits / 8;
+      if ((res = pn53x_inventory_frame(pnd, &inventory, abtAnticol, 16 + pb->szBits, pb->szBits % 8, abtRx, 5 - szOffset, &iCollision)) < 0)
+        goto out;
+      if ((res == 0) && (iCollision < 0)) {
+        // Every tag of this branch is gone
+        szStack--;
+        break;
+      }
+      const size_t szValid = (iCollision < 0) ? PN53X_INVENTORY_BLOCK_BITS : szOffset * 8 + (size_t) iCollision;
+      if ((szValid < pb->szBits) || (szValid > PN53X_INVENTORY_BLOCK_BITS)) {
+        res = NFC_ERFTRANS;
+        goto out;
+      }
+      // Keep the known bits of the first byte, the chip put the answer after them
+      for (size_t n = pb->szBits; n < szValid; n++) {
+        const uint8_t ui8Bit = 1 << (n % 8);
+        pbtBlock[n / 8] = (pbtBlock[n / 8] & ~ui8Bit) | (abtRx[n / 8 - szOffset] & ui8Bit);
+      }
+      pb->szBits = szValid;
+
+      if (iCollision >= 0) {
+        if (szStack == PN53X_INVENTORY_STACK) {
+          res = NFC_ESOFT;
+          goto out;
+        }
+        // The tags with a 1 wait on the stack, the walk goes on with the tags with a 0
+        const uint8_t ui8Bit = 1 << (pb->szBits % 8);
+        pStack[szStack] = *pb;
+        pb->abtBlocks[pb->szLevels][pb->szBits / 8] |= ui8Bit;
+        pb->szBits++;
+        pb = &pStack[szStack++];
+        pb->abtBlocks[pb->szLevels][pb->szBits / 8] &= ~ui8Bit;
+        pb->szBits++;
+        continue;
+      }
+
+      // A single tag answered
+      if ((pbtBlock[0] ^ pbtBlock[1] ^ pbtBlock[2] ^ pbtBlock[3]) != pbtBlock[4]) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Wrong BCC in anticollision answer");
+        res = NFC_ERFTRANS;
+        goto out;
+      }
+      if ((res = pn53x_inventory_select(pnd, &inventory, pb->szLevels, pbtBlock)) < 0)
+        goto out;
+      if (res == 0x100) {
+        // Left the field meanwhile
+        szStack--;
+        break;
+      }
+      const uint8_t btSak = res;
+      pb->szLevels++;
+      pb->szBits = 0;
+      if ((btSak & 0x04) && (pb->szLevels < PN53X_INVENTORY_LEVELS))
+        continue;
+
+      // UID complete: cascade tags (0x88) are dropped from the blocks of the upper levels
+      nfc_target *pnt = &ant[szFound++];
+      memset(pnt, 0, sizeof(*pnt));
+      pnt->nm.nmt = NMT_ISO14443A;
+      pnt->nm.nbr = NBR_106;
+      memcpy(pnt->nti.nai.abtAtqa, inventory.abtAtqa, 2);
+      pnt->nti.nai.btSak = btSak;
+      for (size_t n = 0; n < pb->szLevels; n++) {
+        const size_t szSkip = (n + 1 < pb->szLevels) ? 1 : 0;
+        memcpy(pnt->nti.nai.abtUid + pnt->nti.nai.szUidLen, pb->abtBlocks[n] + szSkip, 4 - szSkip);
+        pnt->nti.nai.szUidLen += 4 - szSkip;
+      }
+
+      // HLTA, never answered
+      uint8_t abtHalt[4] = { 0x50, 0x00 };
+      iso14443a_crc_append(abtHalt, 2);
+      if ((res = pn53x_inventory_frame(pnd, &inventory, abtHalt, sizeof(abtHalt) * 8, 0, abtRx, sizeof(abtRx), &iCollision)) < 0)
+        goto out;
+      szStack--;
+      break;
+    }
+  }
+  res = szFound;
+
+out:
+  free(pStack);
+  // Back to the usual framing and timeouts, whatever happened
+  if (inventory.ui8BitFraming != 0x00) {
+    pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, 0xff, 0x00);
+    CHIP_DATA(pnd)->ui8TxBits = 0;
+  }
+  pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication));
+  pn53x_set_property_bool(pnd, NP_EASY_FRAMING, bEasyFraming);
+  pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, bPar);
+  pn53x_set_property_bool(pnd, NP_HANDLE_CRC, bCrc);
+  pnd->last_error = (res < 0) ? res : 0;
+  return res;
+}
+
+/*
+ * FeliCa inventory with time slots
+ *
+ * FeliCa cards can not be deselected, so InListPassiveTarget keeps returning
+ * the same two cards at most. POLLING however carries a time slot number: each
+ * card picks one of up to 16 slots of 1.208 ms after the first 2.417 ms and
+ * answers in it. InListPassiveTarget is sent first, it sets the CIU up for
+ * FeliCa at the right baud rate and returns up to two cards, none when all
+ * the cards collided. When it returns fewer than two, the CIU Error register
+ * tells whether other cards collided: if none did, the inventory ends right
+ * away, which is the usual single card case.
+ * Otherwise POLLING is sent raw with InCommunicateThru while the
+ * CIU receives multiple frames (RxMultiple): every slot answer lands in the
+ * FIFO, followed by a copy of the CIU Error register. This relies on the
+ * firmware giving back the FIFO content with a success status when its RF
+ * timeout ends the reception. Answers of the cards which
+ * picked the same slot are garbled: POLLING is repeated, as cards pick a new
+ * slot every time, until a round goes without collision or the round limit.
+ * When InListPassiveTarget selected no card, it is sent again until it
+ * selects one of the cards found, which becomes the first one.
+ */
+#define PN53X_FELICA_INVENTORY_TSN 0x0f
+#define PN53X_FELICA_INVENTORY_ROUNDS 8
+// 2.417 ms + 16 slots of 1.208 ms: 21.7 ms, 0x09 is 25.6 ms
+#define PN53X_FELICA_INVENTORY_TIMEOUT 0x09
+// Error register bits of a broken frame: ProtocolErr, ParityErr, CRCErr, CollErr, BufferOvfl
+#define PN53X_FELICA_INVENTORY_RX_ERRORS 0x1f
+
+/*
+ * Adds the card of a POLLING response [LEN, 0x01, IDm, PMm, (System Code)]
+ * unless its IDm is already known. Returns true if the response is valid.
+ */
+static bool
+pn53x_inventory_felica_add(const nfc_baud_rate nbr, const uint8_t *pbtRes, const size_t szRes,
+                           nfc_target ant[], size_t *pszFound, const size_t szTargets)
+{
+  if (((szRes != 18) && (szRes != 20)) || (pbtRes[0] != szRes) || (pbtRes[1] != 0x01))
+    return false;
+  for (size_t n = 0; n < *pszFound; n++) {
+    if (!memcmp(ant[n].nti.nfi.abtId, pbtRes + 2, 8))
+      return true;
+  }
+  if (*pszFound == szTargets)
+    return true;
+
+  nfc_target *pnt = &ant[(*pszFound)++];
+  memset(pnt, 0, sizeof(*pnt));
+  pnt->nm.nmt = NMT_FELICA;
+  pnt->nm.nbr = nbr;
+  pnt->nti.nfi.szLen = szRes;
+  pnt->nti.nfi.btResCode = pbtRes[1];
+  memcpy(pnt->nti.nfi.abtId, pbtRes + 2, 8);
+  memcpy(pnt->nti.nfi.abtPad, pbtRes + 10, 8);
+  if (szRes > 18)
+    memcpy(pnt->nti.nfi.abtSysCode, pbtRes + 18, 2);
+  return true;
+}
+
+/*
+ * All the cards collided in InListPassiveTarget: sends it again, the cards
+ * picking new slots, until it selects one of the \a szFound cards of \a ant,
+ * moved to the first place. Gives up with NFC_ETGRELEASED after as many
+ * tries as inventory rounds.
+ */
+static int
+pn53x_inventory_felica_select(struct nfc_device *pnd, const pn53x_modulation pm, const uint8_t *pbtPolling, const size_t szPolling,
+                              nfc_target ant[], const size_t szFound)
+{
+  for (size_t szRound = 0; szRound < PN53X_FELICA_INVENTORY_ROUNDS; szRound++) {
+    uint8_t abtTargetsData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+    size_t  szTargetsData = sizeof(abtTargetsData);
+    int res;
+
+    if ((res = pn53x_InListPassiveTarget(pnd, pm, 1, pbtPolling, szPolling, abtTargetsData, &szTargetsData, 0)) < 0)
+      return res;
+    // NbTg, Tg, then the POLLING response [LEN, 0x01, IDm, ...]
+    if ((res == 0) || (szTargetsData < 12))
+      continue;
+    for (size_t n = 0; n < szFound; n++) {
+      if (memcmp(ant[n].nti.nfi.abtId, abtTargetsData + 4, 8))
+        continue;
+      const nfc_target nt = ant[n];
+      ant[n] = ant[0];
+      ant[0] = nt;
+      return (pn53x_current_target_new(pnd, &ant[0]) == NULL) ? NFC_ESOFT : NFC_SUCCESS;
+    }
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "FeliCa inventory: no card could be selected");
+  return NFC_ETGRELEASED;
+}
+
+int
+pn53x_initiator_inventory_felica(struct nfc_device *pnd, const nfc_baud_rate nbr, const uint16_t ui16SystemCode, nfc_target ant[], const size_t szTargets)
+{
+  const nfc_modulation nm = { .nmt = NMT_FELICA, .nbr = nbr };
+  const pn53x_modulation pm = pn53x_nm_to_pm(nm);
+  // POLLING with Request Code 0x01: the cards append their System Code
+  const uint8_t abtPolling[] = { 0x06, 0x00, ui16SystemCode >> 8, ui16SystemCode & 0xff, 0x01, PN53X_FELICA_INVENTORY_TSN };
+  uint8_t abtTargetsData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t  szTargetsData = sizeof(abtTargetsData);
+  size_t  szFound = 0;
+  int     res = 0;
+
+  const bool bCrc = pnd->bCrc;
+  const bool bEasyFraming = pnd->bEasyFraming;
+
+  if ((pm != PM_FELICA_212) && (pm != PM_FELICA_424)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+
+  // The firmware answers with two cards at most, the others are collected by the raw POLLINGs
+  if ((res = pn53x_InListPassiveTarget(pnd, pm, 2, abtPolling + 1, sizeof(abtPolling) - 1, abtTargetsData, &szTargetsData, 0)) < 0)
+    return res;
+  const uint8_t *pbtTarget = abtTargetsData + 1;
+  for (int n = 0; (n < res) && (szFound < szTargets); n++) {
+    // Tg, then the POLLING response
+    if ((pbtTarget + 2 > abtTargetsData + szTargetsData) || (pbtTarget + 1 + pbtTarget[1] > abtTargetsData + szTargetsData) ||
+        !pn53x_inventory_felica_add(nbr, pbtTarget + 1, pbtTarget[1], ant, &szFound, szTargets)) {
+      pnd->last_error = NFC_ECHIP;
+      return pnd->last_error;
+    }
+    pbtTarget += 1 + pbtTarget[1];
+  }
+  // Tg 1 is the first target: the firmware sends InDataExchange frames to it
+  if ((szFound > 0) && (pn53x_current_target_new(pnd, &ant[0]) == NULL)) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  if (szFound == szTargets) {
+    pnd->last_error = 0;
+    return szFound;
+  }
+  if (res < 2) {
+    uint8_t ui8Error;
+    if ((res = pn53x_read_register(pnd, PN53X_REG_CIU_Error, &ui8Error)) < 0)
+      return res;
+    // Every card answered alone, or nothing answered: no need to poll again
+    if (!(ui8Error & PN53X_FELICA_INVENTORY_RX_ERRORS)) {
+      pnd->last_error = 0;
+      return szFound;
+    }
+  }
+  const bool bSelected = szFound > 0;
+
+  if (((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_ACCEPT_MULTIPLE_FRAMES, true)) < 0) ||
+      ((res = pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), PN53X_FELICA_INVENTORY_TIMEOUT)) < 0) ||
+      ((res = pn53x_set_tx_bits(pnd, 0)) < 0))
+    goto out;
+
+  for (size_t szRound = 0; (szRound < PN53X_FELICA_INVENTORY_ROUNDS) && (szFound < szTargets); szRound++) {
+    uint8_t abtCmd[1 + sizeof(abtPolling)] = { InCommunicateThru };
+    uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+    bool bCollision = false;
+
+    memcpy(abtCmd + 1, abtPolling, sizeof(abtPolling));
+    res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx), -1);
+    if (res < 0) {
+      if (CHIP_DATA(pnd)->last_status_byte == ETIMEOUT)
+        // No card in any slot
+        break;
+      if (res != NFC_ERFTRANS)
+        goto out;
+      // Garbled beyond the frame boundaries
+      bCollision = true;
+      res = 1;
+    }
+    // Status byte, then each slot answer followed by its error byte
+    for (size_t szPos = 1; szPos < (size_t) res;) {
+      const size_t szLen = abtRx[szPos];
+      if ((szLen == 0) || (szPos + szLen + 1 > (size_t) res)) {
+        bCollision = true;
+        break;
+      }
+      if ((abtRx[szPos + szLen] & PN53X_FELICA_INVENTORY_RX_ERRORS) ||
+          !pn53x_inventory_felica_add(nbr, abtRx + szPos, szLen, ant, &szFound, szTargets))
+        bCollision = true;
+      szPos += szLen + 1;
+    }
+    // Cards left out collide with the others: poll until they answer alone
+    if (!bCollision)
+      break;
+  }
+  res = szFound;
+
+out:
+  pn53x_RFConfiguration__Various_timings(pnd, pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_atr), pn53x_int_to_timeout(CHIP_DATA(pnd)->timeout_communication));
+  pn53x_set_property_bool(pnd, NP_ACCEPT_MULTIPLE_FRAMES, false);
+  pn53x_set_property_bool(pnd, NP_EASY_FRAMING, bEasyFraming);
+  pn53x_set_property_bool(pnd, NP_HANDLE_CRC, bCrc);
+  if ((res > 0) && !bSelected) {
+    const int res2 = pn53x_inventory_felica_select(pnd, pm, abtPolling + 1, sizeof(abtPolling) - 1, ant, szFound);
+    if (res2 < 0)
+      res = res2;
+  }
+  pnd->last_error = (res < 0) ? res : 0;
+  return res;
+}
+
+struct pn53x_rx_sink {
+  uint8_t *pbtRx;
+  size_t  szRx;
+  size_t  szUsed;
+};
+
+static int
+pn53x_rx_sink_append(struct nfc_device *pnd, const uint8_t *pbtChunk, const size_t szChunk, void *data)
+{
+  (void) pnd;
+  struct pn53x_rx_sink *sink = data;
+
+  if (sink->pbtRx != NULL) {
+    if (sink->szUsed + szChunk > sink->szRx) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", sink->szRx, sink->szUsed + szChunk);
+      return NFC_EOVFLOW;
+    }
+    memcpy(sink->pbtRx + sink->szUsed, pbtChunk, szChunk);
+  }
+  sink->szUsed += szChunk;
+  return NFC_SUCCESS;
+}
+
 int
 pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
                                  const size_t szRx, int timeout)
@@ -1425,116 +2211,207 @@ pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, c
 
   // Send the frame to the PN53X chip and get the answer
   // We have to give the amount of bytes + (the two command bytes 0xD4, 0x42)
-  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  if ((res = pn53x_transceive(pnd, abtCmd, szTx + szExtraTxLen, abtRx, sizeof(abtRx), timeout)) < 0) {
+  // Chained answers are appended frame by frame to the caller buffer, whatever its size
+  struct pn53x_rx_sink sink = { pbtRx, szRx, 0 };
+  if ((res = pn53x_transceive_stream(pnd, abtCmd, szTx + szExtraTxLen, NULL, 0, pn53x_rx_sink_append, &sink, timeout)) < 0) {
     pnd->last_error = res;
     return pnd->last_error;
   }
-  const size_t szRxLen = (size_t)res - 1;
-  if (pbtRx != NULL) {
-    if (szRxLen >  szRx) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szRxLen);
+  // Everything went successful, we return received bytes count
+  return (int) sink.szUsed;
+}
+
+/*
+ * Timed exchanges
+ *
+ * The CIU timer starts at the end of the transmission (TAuto) and stops on
+ * the first bits received, so its counter gives the frame delay time of the
+ * target. Firmware commands would reset the timer settings (e.g. on SCL3711,
+ * InCommunicateThru leaves 631a=82 631b=a5 631c=02 631d=00), so the CIU is
+ * driven through its registers: a single WriteRegister frame sets the timer,
+ * clears the interrupt flags, fills the FIFO and starts the transceive, then
+ * each ReadRegister frame drains the bytes the FIFO held at the previous one
+ * and reads the interrupt flags, FIFO level and timer again.
+ */
+#define PN53X_FIFO_SIZE 64
+// Anticollision frames are answered on the bit grid: ISO/IEC 14443-3 6.2.1.1
+#define PN53X_FDT_LAST_BIT_1 1236
+#define PN53X_FDT_LAST_BIT_0 1172
+#define PN53X_TIMER_CALIBRATION_SAMPLES 16
+#define PN53X_TIMER_CALIBRATION_ROUNDS 32
+#define PN53X_TIMER_CALIBRATION_MAX 256
+// Host side guard on top of the timer span, should the CIU never raise an interrupt
+#define PN53X_TIMED_HOST_MARGIN_US 100000
+
+#define BUFFER_APPEND_REGISTER(buffer_name, reg) \
+  do { \
+    BUFFER_APPEND(buffer_name, (reg) >> 8); \
+    BUFFER_APPEND(buffer_name, (reg) & 0xff); \
+  } while (0)
+
+// Value of the last bit on air: parity bit of a complete byte, data bit of a short frame
+static int
+pn53x_timed_last_bit(const uint8_t *pbtTx, const size_t szTxBits)
+{
+  if (szTxBits % 8)
+    return (pbtTx[szTxBits / 8] >> ((szTxBits % 8) - 1)) & 1;
+  uint8_t ui8Parity = pbtTx[(szTxBits / 8) - 1];
+  ui8Parity ^= ui8Parity >> 4;
+  ui8Parity ^= ui8Parity >> 2;
+  ui8Parity ^= ui8Parity >> 1;
+  return (ui8Parity & 1) ? 0 : 1;
+}
+
+static int
+pn53x_timed_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const int iLastBit,
+                       uint8_t *pbtRx, const size_t szRx, size_t *pszRxBits, uint32_t *cycles)
+{
+  const size_t szTx = (szTxBits + 7) / 8;
+  const size_t off = (CHIP_DATA(pnd)->type == PN533) ? 1 : 0; // PN533 prepends its answers by a status byte
+  size_t szTxFifo = MIN(szTx, PN53X_FIFO_SIZE);
+  size_t szRxLen = 0;
+  size_t szToDrain = 0;
+  uint8_t ui8Irq, ui8Level, ui8Error, ui8Control;
+  uint16_t ui16Counter;
+  int res;
+
+  // The prescaler will dictate what will be the precision and
+  // the largest delay to measure before saturation. Some examples:
+  // prescaler =  0 => precision:  ~73ns  timer saturates at    ~5ms
+  // prescaler =  1 => precision: ~221ns  timer saturates at   ~15ms
+  // prescaler =  2 => precision: ~369ns  timer saturates at   ~25ms
+  // prescaler = 10 => precision: ~1.5us  timer saturates at  ~100ms
+  const uint64_t ui64Span = ((uint64_t) *cycles + 0xFFFE) / 0xFFFF;
+  CHIP_DATA(pnd)->timer_prescaler = MIN(ui64Span / 2, 0x0FFF);
+
+  BUFFER_INIT(abtSetup, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+  BUFFER_APPEND(abtSetup, WriteRegister);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_TMode);
+  BUFFER_APPEND(abtSetup, SYMBOL_TAUTO | ((CHIP_DATA(pnd)->timer_prescaler >> 8) & SYMBOL_TPRESCALERHI));
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_TPrescaler);
+  BUFFER_APPEND(abtSetup, CHIP_DATA(pnd)->timer_prescaler & SYMBOL_TPRESCALERLO);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_TReloadVal_hi);
+  BUFFER_APPEND(abtSetup, 0xFF);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_TReloadVal_lo);
+  BUFFER_APPEND(abtSetup, 0xFF);
+  // Set1 bit cleared: the flags written as 1 are cleared
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_CommIrq);
+  BUFFER_APPEND(abtSetup, 0x7F);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_Command);
+  BUFFER_APPEND(abtSetup, SYMBOL_COMMAND & SYMBOL_COMMAND_TRANSCEIVE);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_FIFOLevel);
+  BUFFER_APPEND(abtSetup, SYMBOL_FLUSH_BUFFER);
+  for (size_t i = 0; i < szTxFifo; i++) {
+    BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_FIFOData);
+    BUFFER_APPEND(abtSetup, pbtTx[i]);
+  }
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_BitFraming);
+  BUFFER_APPEND(abtSetup, SYMBOL_START_SEND | ((szTxBits % 8) & SYMBOL_TX_LAST_BITS));
+  if ((res = pn53x_transceive(pnd, abtSetup, BUFFER_SIZE(abtSetup), NULL, 0, -1)) < 0)
+    return res;
+  CHIP_DATA(pnd)->ui8TxBits = szTxBits % 8;
+
+  // The timer raises its interrupt when it saturates, the host deadline is only a safety net
+  const uint64_t ui64Deadline = monotonic_time_us() + (uint64_t) 0xFFFF * (CHIP_DATA(pnd)->timer_prescaler * 2 + 1) / 13 + PN53X_TIMED_HOST_MARGIN_US;
+  for (;;) {
+    BUFFER_INIT(abtPoll, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+    BUFFER_APPEND(abtPoll, ReadRegister);
+    for (size_t i = 0; i < szToDrain; i++)
+      BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_FIFOData);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_CommIrq);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_FIFOLevel);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_Error);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_Control);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_TCounterVal_hi);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_TCounterVal_lo);
+    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+    if ((res = pn53x_transceive(pnd, abtPoll, BUFFER_SIZE(abtPoll), abtRes, sizeof(abtRes), -1)) < 0)
+      return res;
+    if ((size_t) res < off + szToDrain + 6)
+      return NFC_ECHIP;
+
+    if (pbtRx != NULL) {
+      if ((szRxLen + szToDrain) > szRx) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szRxLen + szToDrain);
+        return NFC_EOVFLOW;
+      }
+      memcpy(pbtRx + szRxLen, abtRes + off, szToDrain);
+    }
+    szRxLen += szToDrain;
+    const uint8_t *pbtStatus = abtRes + off + szToDrain;
+    ui8Irq = pbtStatus[0];
+    ui8Level = pbtStatus[1] & SYMBOL_FIFO_LEVEL;
+    ui8Error = pbtStatus[2];
+    ui8Control = pbtStatus[3];
+    ui16Counter = (pbtStatus[4] << 8) | pbtStatus[5];
+    szToDrain = 0;
+
+    if (szTxFifo < szTx) {
+      // Frame longer than the FIFO: top it up while it is being sent
+      if (ui8Irq & (SYMBOL_IDLE_IRQ | SYMBOL_RX_IRQ | SYMBOL_TIMER_IRQ)) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "FIFO ran empty after %" PRIuPTR " of %" PRIuPTR " bytes", szTxFifo, szTx);
+        return NFC_ECHIP;
+      }
+      const size_t szFill = MIN(szTx - szTxFifo, (size_t)(PN53X_FIFO_SIZE - ui8Level));
+      BUFFER_INIT(abtFill, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+      BUFFER_APPEND(abtFill, WriteRegister);
+      for (size_t i = 0; i < szFill; i++) {
+        BUFFER_APPEND_REGISTER(abtFill, PN53X_REG_CIU_FIFOData);
+        BUFFER_APPEND(abtFill, pbtTx[szTxFifo + i]);
+      }
+      if ((szFill > 0) && ((res = pn53x_transceive(pnd, abtFill, BUFFER_SIZE(abtFill), NULL, 0, -1)) < 0))
+        return res;
+      szTxFifo += szFill;
+      continue;
+    }
+    if (ui8Error & SYMBOL_BUFFER_OVFL) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "FIFO overflow while receiving");
       return NFC_EOVFLOW;
     }
-    // Copy the received bytes
-    memcpy(pbtRx, abtRx + 1, szRxLen);
+    // Answers longer than the FIFO are drained while they are received
+    szToDrain = ui8Level;
+    if (ui8Irq & (SYMBOL_IDLE_IRQ | SYMBOL_RX_IRQ | SYMBOL_TIMER_IRQ)) {
+      if (szToDrain == 0)
+        break;
+      continue;
+    }
+    if (monotonic_time_us() > ui64Deadline) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "No CIU interrupt before the timer deadline");
+      return NFC_ETIMEOUT;
+    }
   }
-  // Everything went successful, we return received bytes count
-  return szRxLen;
-}
 
-static void __pn53x_init_timer(struct nfc_device *pnd, const uint32_t max_cycles)
-{
-// The prescaler will dictate what will be the precision and
-// the largest delay to measure before saturation. Some examples:
-// prescaler =  0 => precision:  ~73ns  timer saturates at    ~5ms
-// prescaler =  1 => precision: ~221ns  timer saturates at   ~15ms
-// prescaler =  2 => precision: ~369ns  timer saturates at   ~25ms
-// prescaler = 10 => precision: ~1.5us  timer saturates at  ~100ms
-  if (max_cycles > 0xFFFF) {
-    CHIP_DATA(pnd)->timer_prescaler = ((max_cycles / 0xFFFF) - 1) / 2;
-  } else {
-    CHIP_DATA(pnd)->timer_prescaler = 0;
-  }
-  uint16_t reloadval = 0xFFFF;
-  // Initialize timer
-  pn53x_write_register(pnd, PN53X_REG_CIU_TMode, 0xFF, SYMBOL_TAUTO | ((CHIP_DATA(pnd)->timer_prescaler >> 8) & SYMBOL_TPRESCALERHI));
-  pn53x_write_register(pnd, PN53X_REG_CIU_TPrescaler, 0xFF, (CHIP_DATA(pnd)->timer_prescaler & SYMBOL_TPRESCALERLO));
-  pn53x_write_register(pnd, PN53X_REG_CIU_TReloadVal_hi, 0xFF, (reloadval >> 8) & 0xFF);
-  pn53x_write_register(pnd, PN53X_REG_CIU_TReloadVal_lo, 0xFF, reloadval & 0xFF);
-}
+  *pszRxBits = szRxLen * 8;
+  if ((szRxLen > 0) && (ui8Control & SYMBOL_RX_LAST_BITS))
+    *pszRxBits -= 8 - (ui8Control & SYMBOL_RX_LAST_BITS);
 
-static uint32_t __pn53x_get_timer(struct nfc_device *pnd, const uint8_t last_cmd_byte)
-{
-  uint8_t parity;
-  uint8_t counter_hi, counter_lo;
-  uint16_t counter, u16cycles;
-  uint32_t u32cycles;
-  size_t off = 0;
-  if (CHIP_DATA(pnd)->type == PN533) {
-    // PN533 prepends its answer by a status byte
-    off = 1;
-  }
-  // Read timer
-  BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi  >> 8);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_hi & 0xff);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo  >> 8);
-  BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_TCounterVal_lo & 0xff);
-  uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  size_t szRes = sizeof(abtRes);
-  // Let's send the previously constructed ReadRegister command
-  if (pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1) < 0) {
-    return false;
-  }
-  counter_hi = abtRes[off];
-  counter_lo = abtRes[off + 1];
-  counter = counter_hi;
-  counter = (counter << 8) + counter_lo;
-  if (counter == 0) {
-    // counter saturated
-    u32cycles = 0xFFFFFFFF;
-  } else {
-    u16cycles = 0xFFFF - counter;
-    u32cycles = u16cycles;
-    u32cycles *= (CHIP_DATA(pnd)->timer_prescaler * 2 + 1);
-    u32cycles++;
-    // Correction depending on PN53x Rx detection handling:
-    // timer stops after 5 (or 2 for PN531) bits are received
-    if (CHIP_DATA(pnd)->type == PN531) {
-      u32cycles -= (2 * 128);
-    } else {
-      u32cycles -= (5 * 128);
-    }
-    // Correction depending on last parity bit sent
-    parity = (last_cmd_byte >> 7) ^ ((last_cmd_byte >> 6) & 1) ^
-             ((last_cmd_byte >> 5) & 1) ^ ((last_cmd_byte >> 4) & 1) ^
-             ((last_cmd_byte >> 3) & 1) ^ ((last_cmd_byte >> 2) & 1) ^
-             ((last_cmd_byte >> 1) & 1) ^ (last_cmd_byte & 1);
-    parity = parity ? 0 : 1;
-    // When sent ...YY (cmd ends with logical 1, so when last parity bit is 1):
-    if (parity) {
-      // it finishes 64us sooner than a ...ZY signal
-      u32cycles += 64;
-    }
-    // Correction depending on device design
-    u32cycles += CHIP_DATA(pnd)->timer_correction;
+  if ((szRxLen == 0) || (ui16Counter == 0)) {
+    // No answer, or counter saturated
+    *cycles = 0xFFFFFFFF;
+    return NFC_SUCCESS;
   }
-  return u32cycles;
+  int32_t i32cycles = (int32_t)(0xFFFF - ui16Counter) * (CHIP_DATA(pnd)->timer_prescaler * 2 + 1) + 1;
+  // Correction depending on PN53x Rx detection handling:
+  // timer stops after 5 (or 2 for PN531) bits are received
+  i32cycles -= (CHIP_DATA(pnd)->type == PN531) ? (2 * 128) : (5 * 128);
+  // When sent ...YY (cmd ends with logical 1), it finishes 64 cycles sooner than a ...ZY signal
+  if (iLastBit)
+    i32cycles += 64;
+  // Correction depending on device design, see pn53x_calibrate_timer()
+  i32cycles += CHIP_DATA(pnd)->timer_correction;
+  *cycles = (i32cycles > 0) ? (uint32_t) i32cycles : 0;
+  return NFC_SUCCESS;
 }
 
 int
 pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
-                                      const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles)
+                                      const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar, uint32_t *cycles)
 {
   // TODO Do something with these bytes...
   (void) pbtTxPar;
   (void) pbtRxPar;
-  uint16_t i;
-  uint8_t sz = 0;
-  int res = 0;
   size_t szRxBits = 0;
+  int res = 0;
 
   // Sorry, no arbitrary parity bits support for now
   if (!pnd->bPar) {
@@ -1551,87 +2428,23 @@ pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbt
     pnd->last_error = NFC_ENOTIMPL;
     return pnd->last_error;
   }
-
-  __pn53x_init_timer(pnd, *cycles);
-
-  // Once timer is started, we cannot use Tama commands anymore.
-  // E.g. on SCL3711 timer settings are reset by 0x42 InCommunicateThru command to:
-  //  631a=82 631b=a5 631c=02 631d=00
-  // Prepare FIFO
-  BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtWriteRegisterCmd, WriteRegister);
-
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command  >> 8);
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command & 0xff);
-  BUFFER_APPEND(abtWriteRegisterCmd, SYMBOL_COMMAND & SYMBOL_COMMAND_TRANSCEIVE);
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_FIFOLevel  >> 8);
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_FIFOLevel & 0xff);
-  BUFFER_APPEND(abtWriteRegisterCmd, SYMBOL_FLUSH_BUFFER);
-  for (i = 0; i < ((szTxBits / 8) + 1); i++) {
-    BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_FIFOData  >> 8);
-    BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_FIFOData & 0xff);
-    BUFFER_APPEND(abtWriteRegisterCmd, pbtTx[i]);
-  }
-  // Send data
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_BitFraming  >> 8);
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_BitFraming & 0xff);
-  BUFFER_APPEND(abtWriteRegisterCmd, SYMBOL_START_SEND | ((szTxBits % 8) & SYMBOL_TX_LAST_BITS));
-  // Let's send the previously constructed WriteRegister command
-  if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd), NULL, 0, -1)) < 0) {
-    return res;
+  if (szTxBits == 0) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
   }
 
-  // Recv data
-  // we've to watch for coming data until we decide to timeout.
-  // our PN53x timer saturates after 4.8ms so this function shouldn't be used for
-  // responses coming very late anyway.
-  // Ideally we should implement a real timer here too but looping a few times is good enough.
-  for (i = 0; i < (3 * (CHIP_DATA(pnd)->timer_prescaler * 2 + 1)); i++) {
-    pn53x_read_register(pnd, PN53X_REG_CIU_FIFOLevel, &sz);
-    if (sz > 0)
-      break;
-  }
-  size_t off = 0;
-  if (CHIP_DATA(pnd)->type == PN533) {
-    // PN533 prepends its answer by a status byte
-    off = 1;
-  }
-  while (1) {
-    BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-    BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
-    for (i = 0; i < sz; i++) {
-      BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOData  >> 8);
-      BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOData & 0xff);
-    }
-    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel  >> 8);
-    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel & 0xff);
-    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t szRes = sizeof(abtRes);
-    // Let's send the previously constructed ReadRegister command
-    if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1)) < 0) {
-      return res;
-    }
-    for (i = 0; i < sz; i++) {
-      pbtRx[i + szRxBits] = abtRes[i + off];
-    }
-    szRxBits += (size_t)(sz & SYMBOL_FIFO_LEVEL);
-    sz = abtRes[sz + off];
-    if (sz == 0)
-      break;
+  if ((res = pn53x_timed_transceive(pnd, pbtTx, szTxBits, pn53x_timed_last_bit(pbtTx, szTxBits),
+                                    pbtRx, szRx, &szRxBits, cycles)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
   }
-  szRxBits *= 8; // in bits, not bytes
-
-  // Recv corrected timer value
-  *cycles = __pn53x_get_timer(pnd, pbtTx[szTxBits / 8]);
-
   return szRxBits;
 }
 
 int
 pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles)
 {
-  uint16_t i;
-  uint8_t sz = 0;
+  size_t szRxBits = 0;
   int res = 0;
 
   // We can not just send bytes without parity while the PN53X expects we handled them
@@ -1645,110 +2458,376 @@ pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pb
     pnd->last_error = NFC_ENOTIMPL;
     return pnd->last_error;
   }
+  if (szTx == 0) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
 
-  uint8_t txmode = 0;
-  if (pnd->bCrc) { // check if we're in TypeA or TypeB mode to compute right CRC later
+  // The chip appends the CRC: the last byte on air is the CRC one, computed here for the timer correction
+  uint8_t abtTail[3] = { pbtTx[szTx - 1] };
+  size_t szTail = 1;
+  if (pnd->bCrc) {
+    uint8_t txmode = 0;
     if ((res = pn53x_read_register(pnd, PN53X_REG_CIU_TxMode, &txmode)) < 0) {
-      return res;
+      pnd->last_error = res;
+      return pnd->last_error;
     }
+    uint8_t abtCrc[2] = { 0x00, 0x00 };
+    if ((txmode & SYMBOL_TX_FRAMING) == 0x00)
+      iso14443a_crc((uint8_t *) pbtTx, szTx, abtCrc);
+    else if ((txmode & SYMBOL_TX_FRAMING) == 0x03)
+      iso14443b_crc((uint8_t *) pbtTx, szTx, abtCrc);
+    else
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unsupported framing type %02X, cannot adjust CRC cycles", txmode & SYMBOL_TX_FRAMING);
+    memcpy(abtTail + 1, abtCrc, 2);
+    szTail = 3;
+  }
+
+  if ((res = pn53x_timed_transceive(pnd, pbtTx, szTx * 8, pn53x_timed_last_bit(abtTail, szTail * 8),
+                                    pbtRx, szRx, &szRxBits, cycles)) < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
   }
+  return (szRxBits + 7) / 8;
+}
 
-  __pn53x_init_timer(pnd, *cycles);
+static int
+timer_sample_compare(const void *a, const void *b)
+{
+  const int32_t i32a = *(const int32_t *) a;
+  const int32_t i32b = *(const int32_t *) b;
+  return (i32a > i32b) - (i32a < i32b);
+}
 
-  // Once timer is started, we cannot use Tama commands anymore.
-  // E.g. on SCL3711 timer settings are reset by 0x42 InCommunicateThru command to:
-  //  631a=82 631b=a5 631c=02 631d=00
-  // Prepare FIFO
-  BUFFER_INIT(abtWriteRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-  BUFFER_APPEND(abtWriteRegisterCmd, WriteRegister);
+// Sample of the device dependent part of the cycles count, from a frame answered at a fixed delay
+static int
+pn53x_timer_sample(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const size_t szAnswerBits, int32_t *pi32Sample)
+{
+  uint8_t abtRx[5];
+  size_t szRxBits = 0;
+  uint32_t cycles = 0;
+  int res;
 
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command  >> 8);
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_Command & 0xff);
-  BUFFER_APPEND(abtWriteRegisterCmd, SYMBOL_COMMAND & SYMBOL_COMMAND_TRANSCEIVE);
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_FIFOLevel  >> 8);
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_FIFOLevel & 0xff);
-  BUFFER_APPEND(abtWriteRegisterCmd, SYMBOL_FLUSH_BUFFER);
-  for (i = 0; i < szTx; i++) {
-    BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_FIFOData  >> 8);
-    BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_FIFOData & 0xff);
-    BUFFER_APPEND(abtWriteRegisterCmd, pbtTx[i]);
-  }
-  // Send data
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_BitFraming  >> 8);
-  BUFFER_APPEND(abtWriteRegisterCmd, PN53X_REG_CIU_BitFraming & 0xff);
-  BUFFER_APPEND(abtWriteRegisterCmd, SYMBOL_START_SEND);
-  // Let's send the previously constructed WriteRegister command
-  if ((res = pn53x_transceive(pnd, abtWriteRegisterCmd, BUFFER_SIZE(abtWriteRegisterCmd), NULL, 0, -1)) < 0) {
+  const int iLastBit = pn53x_timed_last_bit(pbtTx, szTxBits);
+  if ((res = pn53x_timed_transceive(pnd, pbtTx, szTxBits, iLastBit, abtRx, sizeof(abtRx), &szRxBits, &cycles)) < 0)
     return res;
+  // No answer, a collision or a counter saturated: no sample
+  if ((szRxBits != szAnswerBits) || (cycles == 0xFFFFFFFF))
+    return 0;
+  *pi32Sample = (iLastBit ? PN53X_FDT_LAST_BIT_1 : PN53X_FDT_LAST_BIT_0) - (int32_t) cycles;
+  return 1;
+}
+
+int
+pn53x_calibrate_timer(struct nfc_device *pnd, int *piCorrection)
+{
+  // WUPA ends with a 1 and ANTICOLLISION with a 0 (parity of 0x20), so both grids are sampled
+  const uint8_t abtWupa[] = { 0x52 };
+  const uint8_t abtAnticol[] = { 0x93, 0x20 };
+  int32_t ai32Samples[PN53X_TIMER_CALIBRATION_SAMPLES];
+  size_t szSamples = 0;
+  int res = 0;
+
+  const bool bCrc = pnd->bCrc;
+  const bool bPar = pnd->bPar;
+  const bool bEasyFraming = pnd->bEasyFraming;
+  const int16_t i16Correction = CHIP_DATA(pnd)->timer_correction;
+
+  if (((res = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, false)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0) ||
+      ((res = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0))
+    goto out;
+
+  // Raw counts: the samples are what the correction has to be
+  CHIP_DATA(pnd)->timer_correction = 0;
+  for (size_t n = 0; (n < PN53X_TIMER_CALIBRATION_ROUNDS) && (szSamples < PN53X_TIMER_CALIBRATION_SAMPLES); n++) {
+    // A target which is not idle ignores the WUPA and goes back to idle, the next round gets it
+    if ((res = pn53x_timer_sample(pnd, abtWupa, 7, 16, &ai32Samples[szSamples])) < 0)
+      goto out;
+    if (res == 0)
+      continue;
+    // A round without an ANTICOLLISION sample leaves an odd count, the array may be full already
+    if (++szSamples == PN53X_TIMER_CALIBRATION_SAMPLES)
+      break;
+    if ((res = pn53x_timer_sample(pnd, abtAnticol, 16, 40, &ai32Samples[szSamples])) < 0)
+      goto out;
+    szSamples += res;
+  }
+  res = NFC_SUCCESS;
+  if (szSamples < PN53X_TIMER_CALIBRATION_SAMPLES / 2) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Timer calibration: %" PRIuPTR " answers only", szSamples);
+    res = NFC_ETIMEOUT;
+    goto out;
+  }
+  // The median ignores the odd answer of another target entering the field
+  qsort(ai32Samples, szSamples, sizeof(ai32Samples[0]), timer_sample_compare);
+  const int32_t i32Median = ai32Samples[szSamples / 2];
+  if ((i32Median <= -PN53X_TIMER_CALIBRATION_MAX) || (i32Median >= PN53X_TIMER_CALIBRATION_MAX)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Timer calibration: correction of %" PRId32 " cycles out of range", i32Median);
+    res = NFC_ERFTRANS;
+    goto out;
+  }
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Timer correction: %" PRId32 " cycles (%" PRIuPTR " samples, was %d)", i32Median, szSamples, i16Correction);
+  CHIP_DATA(pnd)->timer_correction = (int16_t) i32Median;
+  if (piCorrection)
+    *piCorrection = i32Median;
+
+out:
+  if (res < 0)
+    CHIP_DATA(pnd)->timer_correction = i16Correction;
+  // Back to the caller settings, whatever happened
+  const int res2 = pn53x_set_property_bool(pnd, NP_HANDLE_CRC, bCrc);
+  const int res3 = pn53x_set_property_bool(pnd, NP_HANDLE_PARITY, bPar);
+  const int res4 = pn53x_set_property_bool(pnd, NP_EASY_FRAMING, bEasyFraming);
+  if (res >= 0)
+    res = (res2 < 0) ? res2 : ((res3 < 0) ? res3 : res4);
+  if (res < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
   }
+  return NFC_SUCCESS;
+}
 
-  // Recv data
-  size_t szRxLen = 0;
-  // we've to watch for coming data until we decide to timeout.
-  // our PN53x timer saturates after 4.8ms so this function shouldn't be used for
-  // responses coming very late anyway.
-  // Ideally we should implement a real timer here too but looping a few times is good enough.
-  for (i = 0; i < (3 * (CHIP_DATA(pnd)->timer_prescaler * 2 + 1)); i++) {
-    pn53x_read_register(pnd, PN53X_REG_CIU_FIFOLevel, &sz);
-    if (sz > 0)
+/*
+ * Passive sniffer
+ *
+ * The CIU runs its Receive command with RxMultiple set: the receiver stays
+ * on after each frame and appends a copy of the Error register to the FIFO.
+ * The host polls with ReadRegister frames which drain the bytes the FIFO held
+ * at the previous poll, then read CommIrq, FIFOLevel, Error, Control and
+ * Status2. RxIRq tells that frames ended: it is cleared right away, at the
+ * cost of one more exchange, and the bytes the FIFO holds at that time close
+ * the frame. Frames ending between two polls can not be told apart and are
+ * delivered as one. The chip marks frame ends in the FIFO by time only: a
+ * frame starting before the poll which sees the end of the previous one
+ * gets its first bytes delivered with it, the last of them taken for the
+ * error byte. The modem state of that poll tells when it happened: both
+ * frames are then flagged NFC_SNIFF_MERGED.
+ */
+#define PN53X_SNIFF_FRAME_MAX 512
+
+static int
+pn53x_sniff_deliver(struct nfc_device *pnd, nfc_sniff_callback cb, void *data, nfc_sniff_stats *pstats,
+                    const uint8_t *pbtFrame, const size_t szFrame, const uint8_t ui8RxLastBits, const uint64_t ui64Time, const int iFlags)
+{
+  if (szFrame < 2)
+    return 0; // Error byte alone: not a frame
+  nfc_sniffed_frame nsf = {
+    .timestamp_us = ui64Time,
+    .data = pbtFrame,
+    .len = szFrame - 1,
+    .bits = (szFrame - 1) * 8,
+    .flags = iFlags,
+  };
+  if (ui8RxLastBits)
+    nsf.bits -= 8 - ui8RxLastBits;
+  if (pbtFrame[szFrame - 1] & SYMBOL_FRAME_ERRORS) {
+    nsf.flags |= NFC_SNIFF_ERROR;
+    pstats->errors++;
+  }
+  if (iFlags & NFC_SNIFF_MERGED)
+    pstats->merged++;
+  pstats->frames++;
+  return cb(pnd, &nsf, data);
+}
+
+int
+pn53x_sniff(struct nfc_device *pnd, const nfc_modulation nm, const nfc_mode nmFrom, nfc_sniff_callback cb, void *data, int timeout,
+            nfc_sniff_stats *pstats)
+{
+  const size_t off = (CHIP_DATA(pnd)->type == PN533) ? 1 : 0; // PN533 prepends its answers by a status byte
+  nfc_sniff_stats stats;
+  uint8_t abtFrame[PN53X_SNIFF_FRAME_MAX];
+  uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t ui8RxMode;
+  size_t szFrame = 0;
+  size_t szToDrain = 0;
+  bool bEnding = false;
+  int iFlags = 0; // Of the frame being drained
+  int iEndFlags = 0;
+  uint64_t ui64EndTime = 0;
+  uint8_t ui8EndLastBits = 0;
+  int res;
+
+  if (cb == NULL) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  switch (nm.nmt) {
+    case NMT_ISO14443A:
+      ui8RxMode = 0x00;
+      break;
+    case NMT_FELICA:
+      ui8RxMode = 0x02;
+      break;
+    case NMT_ISO14443B:
+      ui8RxMode = 0x03;
       break;
+    default:
+      pnd->last_error = NFC_EINVARG;
+      return pnd->last_error;
   }
-  size_t off = 0;
-  if (CHIP_DATA(pnd)->type == PN533) {
-    // PN533 prepends its answer by a status byte
-    off = 1;
+  switch (nm.nbr) {
+    case NBR_106:
+      break;
+    case NBR_212:
+      ui8RxMode |= 0x10;
+      break;
+    case NBR_424:
+      ui8RxMode |= 0x20;
+      break;
+    case NBR_847:
+      ui8RxMode |= 0x30;
+      break;
+    case NBR_UNDEFINED:
+      pnd->last_error = NFC_EINVARG;
+      return pnd->last_error;
+  }
+
+  // Current receiver settings, put back at the end
+  const uint8_t abtSave[] = { ReadRegister, PN53X_REG_CIU_RxMode >> 8, PN53X_REG_CIU_RxMode & 0xff, PN53X_REG_CIU_Control >> 8, PN53X_REG_CIU_Control & 0xff };
+  if ((res = pn53x_transceive(pnd, abtSave, sizeof(abtSave), abtRes, sizeof(abtRes), -1)) < 0)
+    return res;
+  if ((size_t) res < off + 2) {
+    pnd->last_error = NFC_ECHIP;
+    return pnd->last_error;
   }
-  while (1) {
-    BUFFER_INIT(abtReadRegisterCmd, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
-    BUFFER_APPEND(abtReadRegisterCmd, ReadRegister);
-    for (i = 0; i < sz; i++) {
-      BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOData  >> 8);
-      BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOData & 0xff);
+  const uint8_t ui8SavedRxMode = abtRes[off];
+  const uint8_t ui8SavedControl = abtRes[off + 1] & SYMBOL_INITIATOR;
+
+  // Receive only: frames sent by targets are demodulated on the initiator side, and the other way round
+  BUFFER_INIT(abtSetup, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+  BUFFER_APPEND(abtSetup, WriteRegister);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_Command);
+  BUFFER_APPEND(abtSetup, SYMBOL_COMMAND_IDLE);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_RxMode);
+  BUFFER_APPEND(abtSetup, ui8RxMode | SYMBOL_RX_NO_ERROR | SYMBOL_RX_MULTIPLE);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_Control);
+  BUFFER_APPEND(abtSetup, (nmFrom == N_TARGET) ? SYMBOL_INITIATOR : 0x00);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_CommIrq);
+  BUFFER_APPEND(abtSetup, 0x7F);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_FIFOLevel);
+  BUFFER_APPEND(abtSetup, SYMBOL_FLUSH_BUFFER);
+  BUFFER_APPEND_REGISTER(abtSetup, PN53X_REG_CIU_Command);
+  BUFFER_APPEND(abtSetup, SYMBOL_COMMAND_RECEIVE);
+  if ((res = pn53x_transceive(pnd, abtSetup, BUFFER_SIZE(abtSetup), NULL, 0, -1)) < 0)
+    return res;
+
+  memset(&stats, 0, sizeof(stats));
+  const uint64_t ui64Start = monotonic_time_us();
+  for (;;) {
+    BUFFER_INIT(abtPoll, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+    BUFFER_APPEND(abtPoll, ReadRegister);
+    for (size_t i = 0; i < szToDrain; i++)
+      BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_FIFOData);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_CommIrq);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_FIFOLevel);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_Error);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_Control);
+    BUFFER_APPEND_REGISTER(abtPoll, PN53X_REG_CIU_Status2);
+    if ((res = pn53x_transceive(pnd, abtPoll, BUFFER_SIZE(abtPoll), abtRes, sizeof(abtRes), -1)) < 0)
+      goto out;
+    if ((size_t) res < off + szToDrain + 5) {
+      res = NFC_ECHIP;
+      goto out;
     }
-    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel  >> 8);
-    BUFFER_APPEND(abtReadRegisterCmd, PN53X_REG_CIU_FIFOLevel & 0xff);
-    uint8_t abtRes[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-    size_t szRes = sizeof(abtRes);
-    // Let's send the previously constructed ReadRegister command
-    if ((res = pn53x_transceive(pnd, abtReadRegisterCmd, BUFFER_SIZE(abtReadRegisterCmd), abtRes, szRes, -1)) < 0) {
-      return res;
+    const uint64_t ui64Now = monotonic_time_us();
+    stats.polls++;
+    stats.bytes += szToDrain;
+
+    if (szFrame + szToDrain > sizeof(abtFrame)) {
+      // No frame end seen for too long: keep the tail only
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Sniffed frame too long, dropped");
+      szFrame = 0;
+      if (bEnding)
+        iEndFlags |= NFC_SNIFF_OVERRUN;
+      else
+        iFlags |= NFC_SNIFF_OVERRUN;
     }
-    if (pbtRx != NULL) {
-      if ((szRxLen + sz) > szRx) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Buffer size is too short: %" PRIuPTR " available(s), %" PRIuPTR " needed", szRx, szRxLen + sz);
-        return NFC_EOVFLOW;
-      }
-      // Copy the received bytes
-      for (i = 0; i < sz; i++) {
-        pbtRx[i + szRxLen] = abtRes[i + off];
+    memcpy(abtFrame + szFrame, abtRes + off, szToDrain);
+    szFrame += szToDrain;
+    const uint8_t *pbtStatus = abtRes + off + szToDrain;
+    const uint8_t ui8Irq = pbtStatus[0];
+    const uint8_t ui8Level = pbtStatus[1] & SYMBOL_FIFO_LEVEL;
+    const uint8_t ui8Error = pbtStatus[2];
+    stats.peak_fifo_level = MAX(stats.peak_fifo_level, (size_t) ui8Level);
+
+    if (bEnding) {
+      // The bytes just drained close the frames seen ending by the previous poll
+      bEnding = false;
+      res = pn53x_sniff_deliver(pnd, cb, data, &stats, abtFrame, szFrame, ui8EndLastBits, ui64EndTime, iEndFlags);
+      szFrame = 0;
+      if (res != 0)
+        break;
+    }
+
+    if (ui8Error & SYMBOL_BUFFER_OVFL) {
+      // Frames were overwritten: start again from an empty FIFO
+      stats.overruns++;
+      szFrame = 0;
+      szToDrain = 0;
+      iFlags = NFC_SNIFF_OVERRUN;
+      const uint8_t abtRestart[] = {
+        WriteRegister,
+        PN53X_REG_CIU_FIFOLevel >> 8, PN53X_REG_CIU_FIFOLevel & 0xff, SYMBOL_FLUSH_BUFFER,
+        PN53X_REG_CIU_CommIrq >> 8, PN53X_REG_CIU_CommIrq & 0xff, 0x7F,
+      };
+      if ((res = pn53x_transceive(pnd, abtRestart, sizeof(abtRestart), NULL, 0, -1)) < 0)
+        goto out;
+    } else {
+      szToDrain = ui8Level;
+      if (ui8Irq & SYMBOL_RX_IRQ) {
+        const uint8_t abtClear[] = { WriteRegister, PN53X_REG_CIU_CommIrq >> 8, PN53X_REG_CIU_CommIrq & 0xff, SYMBOL_RX_IRQ };
+        if ((res = pn53x_transceive(pnd, abtClear, sizeof(abtClear), NULL, 0, -1)) < 0)
+          goto out;
+        ui64EndTime = ui64Now;
+        ui8EndLastBits = pbtStatus[3] & SYMBOL_RX_LAST_BITS;
+        if (ui8Level == 0) {
+          res = pn53x_sniff_deliver(pnd, cb, data, &stats, abtFrame, szFrame, ui8EndLastBits, ui64EndTime, iFlags);
+          szFrame = 0;
+          iFlags = 0;
+          if (res != 0)
+            break;
+        } else {
+          bEnding = true;
+          iEndFlags = iFlags;
+          iFlags = 0;
+          if ((pbtStatus[4] & SYMBOL_MODEM_STATE) == SYMBOL_MODEM_RECEIVING) {
+            // Another frame already began: the FIFO holds its head, which goes with this one
+            iEndFlags |= NFC_SNIFF_MERGED;
+            iFlags = NFC_SNIFF_MERGED;
+          }
+        }
       }
     }
-    szRxLen += (size_t)(sz & SYMBOL_FIFO_LEVEL);
-    sz = abtRes[sz + off];
-    if (sz == 0)
+    if ((timeout > 0) && (ui64Now - ui64Start >= (uint64_t) timeout * 1000))
       break;
   }
-
-  // Recv corrected timer value
-  if (pnd->bCrc) {
-    // We've to compute CRC ourselves to know last byte actually sent
-    uint8_t *pbtTxRaw;
-    pbtTxRaw = (uint8_t *) malloc(szTx + 2);
-    if (!pbtTxRaw)
-      return NFC_ESOFT;
-    memcpy(pbtTxRaw, pbtTx, szTx);
-    if ((txmode & SYMBOL_TX_FRAMING) == 0x00)
-      iso14443a_crc_append(pbtTxRaw, szTx);
-    else if ((txmode & SYMBOL_TX_FRAMING) == 0x03)
-      iso14443b_crc_append(pbtTxRaw, szTx);
-    else
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unsupported framing type %02X, cannot adjust CRC cycles", txmode & SYMBOL_TX_FRAMING);
-    *cycles = __pn53x_get_timer(pnd, pbtTxRaw[szTx + 1]);
-    free(pbtTxRaw);
-  } else {
-    *cycles = __pn53x_get_timer(pnd, pbtTx[szTx - 1]);
+  res = NFC_SUCCESS;
+
+out:
+  stats.elapsed_us = monotonic_time_us() - ui64Start;
+  if (pstats)
+    *pstats = stats;
+  // Back to the usual receiver settings, whatever happened
+  BUFFER_INIT(abtRestore, PN53x_EXTENDED_FRAME__DATA_MAX_LEN);
+  BUFFER_APPEND(abtRestore, WriteRegister);
+  BUFFER_APPEND_REGISTER(abtRestore, PN53X_REG_CIU_Command);
+  BUFFER_APPEND(abtRestore, SYMBOL_COMMAND_IDLE);
+  BUFFER_APPEND_REGISTER(abtRestore, PN53X_REG_CIU_FIFOLevel);
+  BUFFER_APPEND(abtRestore, SYMBOL_FLUSH_BUFFER);
+  BUFFER_APPEND_REGISTER(abtRestore, PN53X_REG_CIU_RxMode);
+  BUFFER_APPEND(abtRestore, ui8SavedRxMode);
+  BUFFER_APPEND_REGISTER(abtRestore, PN53X_REG_CIU_Control);
+  BUFFER_APPEND(abtRestore, ui8SavedControl);
+  const int res2 = pn53x_transceive(pnd, abtRestore, BUFFER_SIZE(abtRestore), NULL, 0, -1);
+  if (res < 0) {
+    pnd->last_error = res;
+    return pnd->last_error;
   }
-  return szRxLen;
+  if (res2 < 0)
+    return res2;
+  return (int) stats.frames;
 }
 
 int
@@ -2372,24 +3451,28 @@ pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const size_t s
   return szRxBits;
 }
 
-int
-pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+// Chooses the commands answering and listening to the initiator: TgSetData/TgGetData when the chip handles the framing
+static int
+pn53x_target_data_commands(struct nfc_device *pnd, uint8_t *pbtSendCmd, uint8_t *pbtReceiveCmd)
 {
-  uint8_t  abtCmd[1];
+  *pbtSendCmd = TgResponseToInitiator;
+  *pbtReceiveCmd = TgGetInitiatorCommand;
 
   // XXX I think this is not a clean way to provide some kind of "EasyFraming"
   // but at the moment I have no more better than this
   if (pnd->bEasyFraming) {
     switch (CHIP_DATA(pnd)->current_target->nm.nmt) {
       case NMT_DEP:
-        abtCmd[0] = TgGetData;
+        *pbtSendCmd = TgSetData;
+        *pbtReceiveCmd = TgGetData;
         break;
       case NMT_ISO14443A:
         if (CHIP_DATA(pnd)->current_target->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) {
           // We are dealing with a ISO/IEC 14443-4 compliant target
           if ((CHIP_DATA(pnd)->type == PN532) && (pnd->bAutoIso14443_4)) {
             // We are using ISO/IEC 14443-4 PICC emulation capability from the PN532
-            abtCmd[0] = TgGetData;
+            *pbtSendCmd = TgSetData;
+            *pbtReceiveCmd = TgGetData;
             break;
           } else {
             // TODO Support EasyFraming for other cases by software
@@ -2397,24 +3480,32 @@ pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t
             return pnd->last_error;
           }
         }
-        // NO BREAK
+        break;
       case NMT_JEWEL:
       case NMT_ISO14443B:
       case NMT_ISO14443BI:
       case NMT_ISO14443B2SR:
       case NMT_ISO14443B2CT:
       case NMT_FELICA:
-        abtCmd[0] = TgGetInitiatorCommand;
         break;
     }
-  } else {
-    abtCmd[0] = TgGetInitiatorCommand;
   }
+  return NFC_SUCCESS;
+}
+
+int
+pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout)
+{
+  uint8_t  abtCmd[1];
+  uint8_t  ui8SendCmd;
+  int res;
+
+  if ((res = pn53x_target_data_commands(pnd, &ui8SendCmd, abtCmd)) < 0)
+    return res;
 
   // Try to gather a received frame from the reader
   uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
   size_t szRx = sizeof(abtRx);
-  int res = 0;
   if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, szRx, timeout)) < 0)
     return pnd->last_error;
   szRx = (size_t) res;
@@ -2476,49 +3567,26 @@ int
 pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
 {
   uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t  ui8ReceiveCmd;
   int res = 0;
 
   // We can not just send bytes without parity if while the PN53X expects we handled them
   if (!pnd->bPar)
     return NFC_ECHIP;
 
-  // XXX I think this is not a clean way to provide some kind of "EasyFraming"
-  // but at the moment I have no more better than this
-  if (pnd->bEasyFraming) {
-    switch (CHIP_DATA(pnd)->current_target->nm.nmt) {
-      case NMT_DEP:
-        abtCmd[0] = TgSetData;
-        break;
-      case NMT_ISO14443A:
-        if (CHIP_DATA(pnd)->current_target->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT) {
-          // We are dealing with a ISO/IEC 14443-4 compliant target
-          if ((CHIP_DATA(pnd)->type == PN532) && (pnd->bAutoIso14443_4)) {
-            // We are using ISO/IEC 14443-4 PICC emulation capability from the PN532
-            abtCmd[0] = TgSetData;
-            break;
-          } else {
-            // TODO Support EasyFraming for other cases by software
-            pnd->last_error = NFC_ENOTIMPL;
-            return pnd->last_error;
-          }
-        }
-        // NO BREAK
-      case NMT_JEWEL:
-      case NMT_ISO14443B:
-      case NMT_ISO14443BI:
-      case NMT_ISO14443B2SR:
-      case NMT_ISO14443B2CT:
-      case NMT_FELICA:
-        abtCmd[0] = TgResponseToInitiator;
-        break;
-    }
-  } else {
-    abtCmd[0] = TgResponseToInitiator;
-  }
+  if ((res = pn53x_target_data_commands(pnd, abtCmd, &ui8ReceiveCmd)) < 0)
+    return res;
+
+  if (szTx > sizeof(abtCmd) - 1)
+    return NFC_EOVFLOW;
 
   // Copy the data into the command frame
   memcpy(abtCmd + 1, pbtTx, szTx);
 
+  // To send whole bytes we can not have any leading bits left by pn53x_target_send_bits()
+  if ((res = pn53x_set_tx_bits(pnd, 0)) < 0)
+    return res;
+
   // Try to send the bits to the reader
   if ((res = pn53x_transceive(pnd, abtCmd, szTx + 1, NULL, 0, timeout)) < 0)
     return res;
@@ -2527,6 +3595,43 @@ pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size
   return szTx;
 }
 
+int
+pn53x_target_send_receive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout, uint64_t *pui64SentTime)
+{
+  uint8_t  abtCmd[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t  abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  uint8_t  ui8ReceiveCmd;
+  int res = 0;
+
+  if (!pnd->bPar)
+    return NFC_ECHIP;
+
+  // Both commands are chosen once for the whole exchange
+  if ((res = pn53x_target_data_commands(pnd, abtCmd, &ui8ReceiveCmd)) < 0)
+    return res;
+
+  if (szTx > sizeof(abtCmd) - 1)
+    return NFC_EOVFLOW;
+  memcpy(abtCmd + 1, pbtTx, szTx);
+
+  if ((res = pn53x_set_tx_bits(pnd, 0)) < 0)
+    return res;
+  if ((res = pn53x_transceive(pnd, abtCmd, szTx + 1, NULL, 0, timeout)) < 0)
+    return res;
+  if (pui64SentTime)
+    *pui64SentTime = monotonic_time_us();
+
+  // The PN53x has no command answering and listening at once: listen again right away
+  if ((res = pn53x_transceive(pnd, &ui8ReceiveCmd, 1, abtRx, sizeof(abtRx), timeout)) < 0)
+    return res;
+
+  size_t szRx = (size_t) res - 1;
+  if (szRx > szRxLen)
+    return NFC_EOVFLOW;
+  memcpy(pbtRx, abtRx + 1, szRx);
+  return szRx;
+}
+
 static struct sErrorMessage {
   int     iErrorCode;
   const char *pcErrorMsg;
@@ -2670,15 +3775,27 @@ pn532_SAMConfiguration(struct nfc_device *pnd, const pn532_sam_mode sam_mode, in
   return (pn53x_transceive(pnd, abtCmd, szCmd, NULL, 0, timeout));
 }
 
+/*
+ * Keeps track of the chip power mode: drivers wake the chip up before a
+ * command when it is not NORMAL.
+ */
+void
+pn53x_set_power_mode(struct nfc_device *pnd, const pn53x_power_mode power_mode)
+{
+  static const char *names[] = { "Normal", "PowerDown", "LowVBat" };
+
+  if (CHIP_DATA(pnd)->power_mode == power_mode)
+    return;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Power mode: %s -> %s", names[CHIP_DATA(pnd)->power_mode], names[power_mode]);
+  CHIP_DATA(pnd)->power_mode = power_mode;
+  CHIP_DATA(pnd)->power_transitions++;
+}
+
 int
 pn53x_PowerDown(struct nfc_device *pnd)
 {
-  uint8_t  abtCmd[] = { PowerDown, 0xf0 };
-  int res;
-  if ((res = pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1)) < 0)
-    return res;
-  CHIP_DATA(pnd)->power_mode = LOWVBAT;
-  return res;
+  uint8_t  abtCmd[] = { PowerDown, PN532_WAKEUP_HOST };
+  return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1);
 }
 
 /**
@@ -3546,6 +4663,7 @@ pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
   // Set power mode to normal, if your device starts in LowVBat (ie. PN532
   // UART) the driver layer have to correctly set it.
   CHIP_DATA(pnd)->power_mode = NORMAL;
+  CHIP_DATA(pnd)->power_transitions = 0;
 
   // PN53x starts in initiator mode
   CHIP_DATA(pnd)->operating_mode = INITIATOR;
@@ -3576,6 +4694,15 @@ pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io)
 
   CHIP_DATA(pnd)->supported_modulation_as_target = NULL;
 
+  // Statistics: one slot per known command, the last one for any other code
+  memset(CHIP_DATA(pnd)->stats_slot, NFC_STATS_COMMANDS - 1, sizeof(CHIP_DATA(pnd)->stats_slot));
+  for (size_t n = 0; (n < sizeof(pn53x_commands) / sizeof(pn53x_command)) && (n < NFC_STATS_COMMANDS - 1); n++) {
+    CHIP_DATA(pnd)->stats_slot[pn53x_commands[n].ui8Code] = n;
+    pnd->stats.commands[n].name = pn53x_commands[n].abtCommandText;
+    pnd->stats.commands[n].code = pn53x_commands[n].ui8Code;
+  }
+  pnd->stats.commands[NFC_STATS_COMMANDS - 1].name = "Other";
+
   return pnd->chip_data;
 }
 
@@ -76,10 +76,24 @@
 
 //   PN53X_REG_CIU_Command
 #  define SYMBOL_COMMAND            0x0F
+#  define SYMBOL_COMMAND_IDLE       0x0
+#  define SYMBOL_COMMAND_RECEIVE    0x8
 #  define SYMBOL_COMMAND_TRANSCEIVE 0xC
 
+//   PN53X_REG_CIU_CommIrq
+#  define SYMBOL_TIMER_IRQ          0x01
+#  define SYMBOL_ERR_IRQ            0x02
+#  define SYMBOL_IDLE_IRQ           0x10
+#  define SYMBOL_RX_IRQ             0x20
+
+//   PN53X_REG_CIU_Error
+#  define SYMBOL_FRAME_ERRORS       0x0F     /* CollErr, CRCErr, ParityErr, ProtocolErr */
+#  define SYMBOL_BUFFER_OVFL        0x10
+
 //   PN53X_REG_CIU_Status2
 #  define SYMBOL_MF_CRYPTO1_ON      0x08
+#  define SYMBOL_MODEM_STATE        0x07
+#  define SYMBOL_MODEM_RECEIVING    0x06
 
 //   PN53X_REG_CIU_FIFOLevel
 #  define SYMBOL_FLUSH_BUFFER       0x80
@@ -129,6 +143,13 @@ typedef enum {
   LOWVBAT	// Only on PN532, need to be wake up to process commands with a long preamble and SAMConfiguration command
 } pn53x_power_mode;
 
+/* PN532 PowerDown WakeUpEnable bits */
+#  define PN532_WAKEUP_I2C   0x80
+#  define PN532_WAKEUP_GPIO  0x40
+#  define PN532_WAKEUP_SPI   0x20
+#  define PN532_WAKEUP_HSU   0x10
+#  define PN532_WAKEUP_HOST  (PN532_WAKEUP_I2C | PN532_WAKEUP_GPIO | PN532_WAKEUP_SPI | PN532_WAKEUP_HSU)
+
 /**
  * @enum pn53x_operating_mode
  * @brief PN53x operatin mode enumeration
@@ -175,8 +196,10 @@ struct pn53x_data {
   pn53x_type type;
   /** Chip firmware text */
   char firmware_text[22];
-  /** Current power mode */
+  /** Current power mode, changed with pn53x_set_power_mode() */
   pn53x_power_mode power_mode;
+  /** Power mode changes */
+  unsigned long power_transitions;
   /** Current operating mode */
   pn53x_operating_mode operating_mode;
   /** Current emulated target */
@@ -210,6 +233,10 @@ struct pn53x_data {
   /** Supported modulation type */
   nfc_modulation_type *supported_modulation_as_initiator;
   nfc_modulation_type *supported_modulation_as_target;
+  /** Receive buffer used when the caller provides none, or too little room for a chained frame */
+  uint8_t abtRxScratch[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  /** Slot of each command code in the device statistics */
+  uint8_t stats_slot[256];
 };
 
 #define CHIP_DATA(pnd) ((struct pn53x_data*)(pnd->chip_data))
@@ -295,11 +322,16 @@ typedef enum {
   PTM_ISO14443_4_PICC_ONLY = 0x04
 } pn53x_target_mode;
 
+/* Consumer of a chained response, called with the data of each frame as it is received */
+typedef int (*pn53x_chunk_callback)(struct nfc_device *pnd, const uint8_t *pbtChunk, const size_t szChunk, void *data);
+
 extern const uint8_t pn53x_ack_frame[PN53x_ACK_FRAME__LEN];
 extern const uint8_t pn53x_nack_frame[PN53x_ACK_FRAME__LEN];
 
 int    pn53x_init(struct nfc_device *pnd);
 int    pn53x_transceive(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout);
+int    pn53x_transceive_stream(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen,
+                               pn53x_chunk_callback cb, void *data, int timeout);
 
 int    pn53x_set_parameters(struct nfc_device *pnd, const uint8_t ui8Value, const bool bEnable);
 int    pn53x_set_tx_bits(struct nfc_device *pnd, const uint8_t ui8Bits);
@@ -324,6 +356,12 @@ int    pn53x_initiator_select_passive_target(struct nfc_device *pnd,
                                              const nfc_modulation nm,
                                              const uint8_t *pbtInitData, const size_t szInitData,
                                              nfc_target *pnt);
+int    pn53x_initiator_poll_target_low_power(struct nfc_device *pnd,
+                                             const nfc_modulation *pnmModulations, const size_t szModulations,
+                                             const nfc_low_power_params *pparams,
+                                             nfc_target *pnt, nfc_low_power_stats *pstats);
+int    pn53x_initiator_inventory_iso14443a(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+int    pn53x_initiator_inventory_felica(struct nfc_device *pnd, const nfc_baud_rate nbr, const uint16_t ui16SystemCode, nfc_target ant[], const size_t szTargets);
 int    pn53x_initiator_poll_target(struct nfc_device *pnd,
                                    const nfc_modulation *pnmModulations, const size_t szModulations,
                                    const uint8_t uiPollNr, const uint8_t uiPeriod,
@@ -338,9 +376,12 @@ int    pn53x_initiator_transceive_bits(struct nfc_device *pnd, const uint8_t *pb
 int    pn53x_initiator_transceive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
                                         uint8_t *pbtRx, const size_t szRx, int timeout);
 int    pn53x_initiator_transceive_bits_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
-                                             const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles);
+                                             const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar, uint32_t *cycles);
 int    pn53x_initiator_transceive_bytes_timed(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
                                               uint8_t *pbtRx, const size_t szRx, uint32_t *cycles);
+int    pn53x_calibrate_timer(struct nfc_device *pnd, int *piCorrection);
+int    pn53x_sniff(struct nfc_device *pnd, const nfc_modulation nm, const nfc_mode nmFrom, nfc_sniff_callback cb, void *data, int timeout,
+                   nfc_sniff_stats *pstats);
 int    pn53x_initiator_deselect_target(struct nfc_device *pnd);
 int    pn53x_initiator_target_is_present(struct nfc_device *pnd, const nfc_target *pnt);
 
@@ -350,6 +391,7 @@ int    pn53x_target_receive_bits(struct nfc_device *pnd, uint8_t *pbtRx, const s
 int    pn53x_target_receive_bytes(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout);
 int    pn53x_target_send_bits(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
 int    pn53x_target_send_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
+int    pn53x_target_send_receive_bytes(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout, uint64_t *pui64SentTime);
 
 // Error handling functions
 const char *pn53x_strerror(const struct nfc_device *pnd);
@@ -358,6 +400,7 @@ const char *pn53x_strerror(const struct nfc_device *pnd);
 int    pn53x_SetParameters(struct nfc_device *pnd, const uint8_t ui8Value);
 int    pn532_SAMConfiguration(struct nfc_device *pnd, const pn532_sam_mode mode, int timeout);
 int    pn53x_PowerDown(struct nfc_device *pnd);
+void   pn53x_set_power_mode(struct nfc_device *pnd, const pn53x_power_mode power_mode);
 int    pn53x_InListPassiveTarget(struct nfc_device *pnd, const pn53x_modulation pmInitModulation,
                                  const uint8_t szMaxTargets, const uint8_t *pbtInitiatorData,
                                  const size_t szInitiatorDataLen, uint8_t *pbtTargetsData, size_t *pszTargetsData,
@@ -397,5 +440,6 @@ int    pn53x_get_information_about(nfc_device *pnd, char **pbuf);
 
 void   *pn53x_data_new(struct nfc_device *pnd, const struct pn53x_io *io);
 void    pn53x_data_free(struct nfc_device *pnd);
+void    pn53x_current_target_free(const struct nfc_device *pnd);
 
 #endif // __NFC_CHIPS_PN53X_H__
@@ -0,0 +1,395 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file sniff-bench.c
+ * @brief Passive sniffer benchmark against a simulated PN532 CIU
+ *
+ * This program is linked with the library objects and registers a driver
+ * ("sim") whose PN532 is simulated at the register level (see ciu-sim.h).
+ * The simulated air carries a scripted ISO14443A session, repeated: a tag
+ * is selected, read page by page, then sends a long ISO14443-4 answer. The
+ * frames delivered by nfc_sniff() are matched against the script, for
+ * various durations of the exchanges with the chip: frames received alone
+ * as they were sent, frames delivered together, frames lost to FIFO
+ * overflows, and damaged deliveries. The latter come from the chip, which
+ * tells frame ends apart from data by time only: a frame starting before
+ * the poll which sees the end of the previous one gets its first bytes
+ * delivered with it. Every damaged delivery must be flagged, merged or
+ * overrun, so that callers can discard it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+#include "chips/ciu-sim.h"
+
+#define SIM_DRIVER_NAME "sim"
+
+#define TRAFFIC_MAX 1024
+#define TRAFFIC_SESSIONS 10
+#define TRAFFIC_READS 8
+#define TRAFFIC_LONG_ANSWER 100
+// Frame delay time of the tag, and time the reader takes to send its next command
+#define TRAFFIC_TAG_FDT 1172
+#define TRAFFIC_READER_GAP (500 * 1356 / 100)
+// Closes the script, alone on air: a 3-bit frame
+#define TRAFFIC_END_GAP (20000 * 1356 / 100)
+#define TRAFFIC_END_BITS 3
+
+struct sim_data {
+  struct ciu_sim ciu;
+  uint8_t  abtResponse[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  int      iResponse;
+};
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+
+static long lExchange = 1000;   // µs per exchange with the chip
+
+static struct ciu_sim_frame afTraffic[TRAFFIC_MAX];
+static size_t szTraffic = 0;
+static uint64_t ui64AirEnd = 0;
+
+static int
+sim_send(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+
+  sd->iResponse = ciu_sim_exchange(&sd->ciu, pbtData, szData, sd->abtResponse, sizeof(sd->abtResponse));
+  return (sd->iResponse < 0) ? sd->iResponse : NFC_SUCCESS;
+}
+
+static int
+sim_receive(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  if ((size_t) sd->iResponse > szDataLen)
+    return NFC_EOVFLOW;
+  memcpy(pbtData, sd->abtResponse, sd->iResponse);
+  return sd->iResponse;
+}
+
+static const struct pn53x_io sim_io = {
+  .send    = sim_send,
+  .receive = sim_receive,
+};
+
+static const struct nfc_driver sim_driver;
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  if (connstrings_len == 0)
+    return 0;
+  snprintf(connstrings[0], sizeof(nfc_connstring), "%s:0", SIM_DRIVER_NAME);
+  return 1;
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd)
+    return NULL;
+  pnd->driver_data = calloc(1, sizeof(struct sim_data));
+  if (!pnd->driver_data || !pn53x_data_new(pnd, &sim_io)) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  struct ciu_sim *sim = &DRIVER_DATA(pnd)->ciu;
+  ciu_sim_init(sim);
+  sim->exchange_cycles = (uint32_t)(lExchange * 1356 / 100);
+  sim->traffic = afTraffic;
+  sim->traffic_len = szTraffic;
+  snprintf(pnd->name, sizeof(pnd->name), "simulated PN532 %s", connstring);
+  pnd->driver = &sim_driver;
+  return pnd;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .sniff                            = pn53x_sniff,
+  .device_set_property_bool         = pn53x_set_property_bool,
+  .device_set_property_int          = pn53x_set_property_int,
+};
+
+static void
+traffic_add(const uint64_t ui64Gap, const uint8_t *pbtData, const size_t szBits, const uint8_t ui8Error)
+{
+  struct ciu_sim_frame *pf = &afTraffic[szTraffic++];
+  pf->start = ui64AirEnd + ui64Gap;
+  memcpy(pf->data, pbtData, (szBits + 7) / 8);
+  pf->bits = szBits;
+  pf->error = ui8Error;
+  ui64AirEnd = pf->start + CIU_SIM_BIT_CYCLES + (szBits / 8) * CIU_SIM_BYTE_CYCLES + (szBits % 8) * CIU_SIM_BIT_CYCLES;
+}
+
+// A command of the reader and the answer of the tag, every 7th answer with a CRC error
+static void
+traffic_exchange(const uint8_t *pbtCommand, const size_t szCommandBits, const uint8_t *pbtAnswer, const size_t szAnswerBits)
+{
+  traffic_add(TRAFFIC_READER_GAP, pbtCommand, szCommandBits, 0x00);
+  traffic_add(TRAFFIC_TAG_FDT, pbtAnswer, szAnswerBits, (szTraffic % 14 == 13) ? 0x04 : 0x00);
+}
+
+static void
+traffic_fill(void)
+{
+  const uint8_t abtReqa[] = { 0x26 };
+  const uint8_t abtAtqa[] = { 0x44, 0x00 };
+  const uint8_t abtAnticol[] = { 0x93, 0x20 };
+  const uint8_t abtUid[] = { 0x04, 0x10, 0x20, 0x30, 0x04 ^ 0x10 ^ 0x20 ^ 0x30 };
+  uint8_t abtSelect[9] = { 0x93, 0x70 };
+  const uint8_t abtSak[] = { 0x00, 0xfe, 0x51 };
+  uint8_t abtRead[4] = { 0x30 };
+  uint8_t abtPage[18];
+  uint8_t abtIBlock[4] = { 0x02, 0x00 };
+  uint8_t abtLong[TRAFFIC_LONG_ANSWER + 3] = { 0x02 };
+  const uint8_t abtEnd[] = { 0x05 };
+
+  memcpy(abtSelect + 2, abtUid, sizeof(abtUid));
+  iso14443a_crc_append(abtSelect, 7);
+  for (size_t n = 1; n <= TRAFFIC_LONG_ANSWER; n++)
+    abtLong[n] = (uint8_t) n;
+  iso14443a_crc_append(abtLong, TRAFFIC_LONG_ANSWER + 1);
+  iso14443a_crc_append(abtIBlock, 2);
+
+  szTraffic = 0;
+  ui64AirEnd = 0;
+  for (size_t s = 0; s < TRAFFIC_SESSIONS; s++) {
+    traffic_exchange(abtReqa, 7, abtAtqa, 16);
+    traffic_exchange(abtAnticol, 16, abtUid, 40);
+    traffic_exchange(abtSelect, 72, abtSak, 24);
+    for (size_t p = 0; p < TRAFFIC_READS; p++) {
+      abtRead[1] = (uint8_t)(4 * p);
+      iso14443a_crc_append(abtRead, 2);
+      for (size_t n = 0; n < 16; n++)
+        abtPage[n] = (uint8_t)(s + 4 * p + n);
+      iso14443a_crc_append(abtPage, 16);
+      traffic_exchange(abtRead, 32, abtPage, 144);
+    }
+    traffic_exchange(abtIBlock, 32, abtLong, 8 * sizeof(abtLong));
+  }
+  traffic_add(TRAFFIC_END_GAP, abtEnd, TRAFFIC_END_BITS, 0x00);
+}
+
+struct sniff_result {
+  size_t szNext;          // next frame of the script
+  size_t szExact;         // frames delivered alone, as they were sent
+  size_t szTogether;      // frames delivered with the next or previous ones
+  size_t szDamaged;       // deliveries matching no frames of the script
+  size_t szMissed;        // frames in no delivery: lost in overflows, or split by damaged ones
+  size_t szOverrunFlags;
+  size_t szMergedFlags;
+  size_t szUnflagged;     // damaged deliveries flagged neither NFC_SNIFF_MERGED nor NFC_SNIFF_OVERRUN
+  size_t szWrongErrors;   // NFC_SNIFF_ERROR not matching the script
+  bool   bEnd;
+};
+
+// Number of frames of the script, from the n-th, a delivered frame is made of
+static size_t
+sniff_match(const nfc_sniffed_frame *pnf, size_t n)
+{
+  const size_t szLast = szTraffic - 1;
+  size_t szOffset = 0;
+  size_t szFrames = 0;
+
+  for (; n < szLast; n++) {
+    const struct ciu_sim_frame *pf = &afTraffic[n];
+    const size_t szLen = (pf->bits + 7) / 8;
+    if ((szOffset + szLen > pnf->len) || memcmp(pnf->data + szOffset, pf->data, szLen))
+      return 0;
+    szOffset += szLen;
+    szFrames++;
+    if (szOffset == pnf->len)
+      return (pnf->bits % 8 == pf->bits % 8) ? szFrames : 0;
+    // Frames ending within one poll: the Error register copy of RxMultiple separates them
+    if (pnf->data[szOffset++] != pf->error)
+      return 0;
+  }
+  return 0;
+}
+
+static int
+sniff_cb(nfc_device *pnd, const nfc_sniffed_frame *pnf, void *data)
+{
+  (void) pnd;
+  struct sniff_result *pr = data;
+  const size_t szLast = szTraffic - 1;
+
+  if (pnf->flags & NFC_SNIFF_OVERRUN)
+    pr->szOverrunFlags++;
+  if (pnf->flags & NFC_SNIFF_MERGED)
+    pr->szMergedFlags++;
+  if (pnf->bits == TRAFFIC_END_BITS) {
+    pr->szMissed += szLast - pr->szNext;
+    pr->bEnd = true;
+    return 1;
+  }
+  // Look ahead, past the missed ones: frames delivered together may cover many
+  for (size_t n = pr->szNext; n < szLast; n++) {
+    const size_t szFrames = sniff_match(pnf, n);
+    if (szFrames == 0)
+      continue;
+    const struct ciu_sim_frame *pf = &afTraffic[n + szFrames - 1];
+    if (((pnf->flags & NFC_SNIFF_ERROR) != 0) != ((pf->error & SYMBOL_FRAME_ERRORS) != 0))
+      pr->szWrongErrors++;
+    if (szFrames == 1)
+      pr->szExact++;
+    else
+      pr->szTogether += szFrames;
+    pr->szMissed += n - pr->szNext;
+    pr->szNext = n + szFrames;
+    return 0;
+  }
+  pr->szDamaged++;
+  if (!(pnf->flags & (NFC_SNIFF_MERGED | NFC_SNIFF_OVERRUN)))
+    pr->szUnflagged++;
+  return 0;
+}
+
+static int
+bench(nfc_context *context, const long lUs)
+{
+  const nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  nfc_connstring connstring;
+  nfc_device *pnd;
+  struct sniff_result r;
+  nfc_sniff_stats stats;
+
+  lExchange = lUs;
+  if ((nfc_list_devices(context, &connstring, 1) != 1) || ((pnd = nfc_open(context, connstring)) == NULL)) {
+    fprintf(stderr, "Unable to open the simulated device\n");
+    return -1;
+  }
+  memset(&r, 0, sizeof(r));
+  // The real-time timeout is a safety net only: the script ends the sniffing
+  const int res = nfc_sniff(pnd, nm, N_TARGET, sniff_cb, &r, 60000, &stats);
+  if (res < 0) {
+    nfc_perror(pnd, "nfc_sniff");
+    nfc_close(pnd);
+    return -1;
+  }
+  const unsigned long ulExchanges = DRIVER_DATA(pnd)->ciu.exchanges;
+  nfc_close(pnd);
+
+  const size_t szFrames = szTraffic - 1;
+  printf("%5ld us per exchange: %4lu frames on air, %4lu alone %4lu together %4lu missed, %3lu damaged %3" PRIu64 " merged, %3" PRIu64 " overruns %3" PRIu64 " errors, peak FIFO %2lu, %6lu exchanges\n",
+         lUs, (unsigned long) szFrames, (unsigned long) r.szExact, (unsigned long) r.szTogether, (unsigned long) r.szMissed, (unsigned long) r.szDamaged,
+         stats.merged, stats.overruns, stats.errors, (unsigned long) stats.peak_fifo_level, ulExchanges);
+  if (!r.bEnd) {
+    printf("  script end not seen\n");
+    return -1;
+  }
+  // Overruns must be told, and never happen with a fast host
+  if ((stats.overruns > 0) != (r.szOverrunFlags > 0))
+    return -1;
+  if ((lUs <= 1000) && (stats.overruns > 0))
+    return -1;
+  // Damaged deliveries must be told too
+  if ((stats.merged != r.szMergedFlags) || r.szUnflagged) {
+    printf("  %lu damaged deliveries not flagged\n", (unsigned long) r.szUnflagged);
+    return -1;
+  }
+  // Polls well within the shortest gap on air see every frame end alone
+  if ((lUs <= 100) && ((r.szExact != szFrames) || r.szWrongErrors))
+    return -1;
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  nfc_context *context;
+  int opt;
+  int res = 0;
+  long lUs = 0;
+
+  while ((opt = getopt(argc, argv, "l:")) != -1) {
+    switch (opt) {
+      case 'l':
+        lUs = strtol(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-l chip exchange latency in µs]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((lUs < 0) || (lUs > 999999)) {
+    fprintf(stderr, "Invalid latency\n");
+    return EXIT_FAILURE;
+  }
+
+  // Registered before the first context: the simulated driver is the only one
+  nfc_register_driver(&sim_driver);
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+
+  traffic_fill();
+  if (lUs > 0) {
+    res = bench(context, lUs);
+  } else {
+    const long alUs[] = { 100, 250, 1000, 2000, 4000, 8000 };
+    for (size_t n = 0; n < sizeof(alUs) / sizeof(alUs[0]); n++) {
+      if (bench(context, alUs[n]) < 0)
+        res = -1;
+    }
+  }
+
+  nfc_exit(context);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
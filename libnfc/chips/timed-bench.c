@@ -0,0 +1,420 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file timed-bench.c
+ * @brief Timed exchanges benchmark against a simulated PN532 CIU
+ *
+ * This program is linked with the library objects and registers a driver
+ * ("sim") whose PN532 is simulated at the register level (see ciu-sim.h),
+ * with an ISO14443A tag answering at the frame delay times of
+ * ISO/IEC 14443-3. It counts the chip exchanges of a timed REQA, checks the
+ * cycles counts against the simulated delays, receives an answer longer
+ * than the FIFO with a fast and a slow host, checks the timer settings for
+ * the largest delay, calibrates against a tag silent on ANTICOLLISION, and
+ * shows that a delay added by a relay is only hidden once
+ * nfc_device_calibrate_timer() is called.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+#include "chips/ciu-sim.h"
+
+#define SIM_DRIVER_NAME "sim"
+// Same constant as the PN532 drivers
+#define SIM_TIMER_CORRECTION 48
+#define SIM_LONG_ANSWER 200
+
+struct sim_data {
+  struct ciu_sim ciu;
+  uint8_t  abtResponse[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  int      iResponse;
+};
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+
+// Settings of the next opened device
+static long lExchange = 1000;   // µs per exchange with the chip
+static int32_t i32TimerOffset = SIM_TIMER_CORRECTION;
+static uint32_t u32RelayDelay = 0;
+static bool bSilentAnticol = false; // the tag ignores ANTICOLLISION
+
+static const uint8_t abtUid[] = { 0x04, 0x10, 0x20, 0x30 };
+
+// ISO/IEC 14443-3 6.2.1.1: n = 9 bit periods, plus 84 or 20 cycles after a 1 or a 0
+static size_t
+sim_tag_answer(void *data, const uint8_t *pbtTx, const size_t szTxBits, uint8_t *pbtAnswer, uint32_t *pui32Fdt)
+{
+  (void) data;
+  const size_t szTx = (szTxBits + 7) / 8;
+  const int iLastBit = ciu_sim_last_bit(pbtTx, szTx, szTxBits % 8);
+  *pui32Fdt = 9 * CIU_SIM_BIT_CYCLES + (iLastBit ? 84 : 20) + u32RelayDelay;
+
+  if ((szTxBits == 7) && ((pbtTx[0] == 0x26) || (pbtTx[0] == 0x52))) {
+    pbtAnswer[0] = 0x44;
+    pbtAnswer[1] = 0x00;
+    return 16;
+  }
+  if ((szTxBits == 16) && (pbtTx[0] == 0x93) && (pbtTx[1] == 0x20)) {
+    if (bSilentAnticol)
+      return 0;
+    memcpy(pbtAnswer, abtUid, 4);
+    pbtAnswer[4] = abtUid[0] ^ abtUid[1] ^ abtUid[2] ^ abtUid[3];
+    return 40;
+  }
+  if ((szTxBits == 16) && (pbtTx[0] == 0x30)) {
+    // READ of a tag with large pages: an answer longer than the FIFO
+    for (size_t n = 0; n < SIM_LONG_ANSWER; n++)
+      pbtAnswer[n] = (uint8_t)(pbtTx[1] + n);
+    return SIM_LONG_ANSWER * 8;
+  }
+  return 0;
+}
+
+static int
+sim_send(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+
+  sd->iResponse = ciu_sim_exchange(&sd->ciu, pbtData, szData, sd->abtResponse, sizeof(sd->abtResponse));
+  return (sd->iResponse < 0) ? sd->iResponse : NFC_SUCCESS;
+}
+
+static int
+sim_receive(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  if ((size_t) sd->iResponse > szDataLen)
+    return NFC_EOVFLOW;
+  memcpy(pbtData, sd->abtResponse, sd->iResponse);
+  return sd->iResponse;
+}
+
+static const struct pn53x_io sim_io = {
+  .send    = sim_send,
+  .receive = sim_receive,
+};
+
+static const struct nfc_driver sim_driver;
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  if (connstrings_len == 0)
+    return 0;
+  snprintf(connstrings[0], sizeof(nfc_connstring), "%s:0", SIM_DRIVER_NAME);
+  return 1;
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd)
+    return NULL;
+  pnd->driver_data = calloc(1, sizeof(struct sim_data));
+  if (!pnd->driver_data || !pn53x_data_new(pnd, &sim_io)) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  CHIP_DATA(pnd)->timer_correction = SIM_TIMER_CORRECTION;
+  struct ciu_sim *sim = &DRIVER_DATA(pnd)->ciu;
+  ciu_sim_init(sim);
+  sim->exchange_cycles = (uint32_t)(lExchange * 1356 / 100);
+  sim->timer_offset = i32TimerOffset;
+  sim->responder = sim_tag_answer;
+  snprintf(pnd->name, sizeof(pnd->name), "simulated PN532 %s", connstring);
+  pnd->driver = &sim_driver;
+  return pnd;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .device_calibrate_timer           = pn53x_calibrate_timer,
+  .device_set_property_bool         = pn53x_set_property_bool,
+  .device_set_property_int          = pn53x_set_property_int,
+};
+
+// Frames answered at a fixed delay: 1172 cycles after a last bit 0, 1236 after a 1
+struct timed_frame {
+  const char *pcName;
+  uint8_t  abtTx[2];
+  size_t   szTxBits;
+  uint32_t u32Fdt;
+};
+
+static const struct timed_frame atfFrames[] = {
+  { "REQA", { 0x26 }, 7, 1172 },
+  { "WUPA", { 0x52 }, 7, 1236 },
+  { "ANTICOLLISION", { 0x93, 0x20 }, 16, 1172 },
+};
+#define TIMED_FRAMES (sizeof(atfFrames) / sizeof(atfFrames[0]))
+
+static nfc_device *
+sim_device(nfc_context *context)
+{
+  nfc_connstring connstring;
+  nfc_device *pnd;
+
+  if ((nfc_list_devices(context, &connstring, 1) != 1) || ((pnd = nfc_open(context, connstring)) == NULL)) {
+    fprintf(stderr, "Unable to open the simulated device\n");
+    return NULL;
+  }
+  if ((nfc_initiator_init(pnd) < 0) ||
+      (nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, false) < 0) ||
+      (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false) < 0)) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    return NULL;
+  }
+  return pnd;
+}
+
+// Median cycles count of each frame against its frame delay time, and chip exchanges per frame
+static int
+bench_measure(nfc_device *pnd, const char *pcLabel, const size_t szRuns)
+{
+  uint8_t abtRx[8];
+  nfc_timing_stats ts;
+  int res = 0;
+  const unsigned long ulBefore = DRIVER_DATA(pnd)->ciu.exchanges;
+
+  printf("%-44s", pcLabel);
+  for (size_t n = 0; n < TIMED_FRAMES; n++) {
+    const struct timed_frame *ptf = &atfFrames[n];
+    if (nfc_initiator_measure_bits_timed(pnd, ptf->abtTx, ptf->szTxBits, abtRx, sizeof(abtRx), 0, szRuns, &ts) < 0) {
+      printf("\n");
+      nfc_perror(pnd, "nfc_initiator_measure_bits_timed");
+      return -1;
+    }
+    printf(" %s %5" PRIu32 " (%+5" PRId32 ")", ptf->pcName, ts.median_cycles, (int32_t)(ts.median_cycles - ptf->u32Fdt));
+    if (ts.answers != szRuns)
+      res = -1;
+  }
+  const unsigned long ulExchanges = DRIVER_DATA(pnd)->ciu.exchanges - ulBefore;
+  printf(" cycles, %4.1f exchanges per frame\n", (double) ulExchanges / (TIMED_FRAMES * szRuns));
+  return res;
+}
+
+static int
+bench_long_answer(nfc_device *pnd)
+{
+  const uint8_t abtRead[] = { 0x30, 0x04 };
+  uint8_t abtRx[SIM_LONG_ANSWER + 16];
+  uint32_t cycles = 0;
+
+  const int res = nfc_initiator_transceive_bytes_timed(pnd, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), &cycles);
+  if (res == NFC_EOVFLOW) {
+    printf("%ld us per exchange: %d-byte answer, FIFO overflow reported (%lu bytes lost in the chip)\n",
+           lExchange, SIM_LONG_ANSWER, DRIVER_DATA(pnd)->ciu.overflows);
+    return 1;
+  }
+  if (res < 0) {
+    nfc_perror(pnd, "nfc_initiator_transceive_bytes_timed");
+    return -1;
+  }
+  size_t n;
+  for (n = 0; (n < SIM_LONG_ANSWER) && (abtRx[n] == (uint8_t)(abtRead[1] + n)); n++)
+    ;
+  printf("%ld us per exchange: %d-byte answer, %d bytes received %s, %" PRIu32 " cycles\n",
+         lExchange, SIM_LONG_ANSWER, res, ((res == SIM_LONG_ANSWER) && (n == SIM_LONG_ANSWER)) ? "intact" : "CORRUPT", cycles);
+  return ((res == SIM_LONG_ANSWER) && (n == SIM_LONG_ANSWER)) ? 0 : -1;
+}
+
+static int
+bench_prescaler(nfc_device *pnd, const uint32_t u32Max)
+{
+  uint8_t abtRx[8];
+  uint32_t cycles = u32Max;
+
+  const struct timed_frame *ptf = &atfFrames[0];
+
+  if (nfc_initiator_transceive_bits_timed(pnd, ptf->abtTx, ptf->szTxBits, NULL, abtRx, sizeof(abtRx), NULL, &cycles) < 0) {
+    nfc_perror(pnd, "nfc_initiator_transceive_bits_timed");
+    return -1;
+  }
+  const uint16_t ui16Prescaler = CHIP_DATA(pnd)->timer_prescaler;
+  const uint64_t ui64Span = (uint64_t) 0xFFFF * (2 * ui16Prescaler + 1);
+  printf("up to %10" PRIu32 " cycles: prescaler %4u, span %10" PRIu64 " cycles, %s %5" PRIu32 " cycles\n",
+         u32Max, ui16Prescaler, ui64Span, ptf->pcName, cycles);
+  // The span covers the request, or is the largest one
+  if ((ui64Span < u32Max) && (ui16Prescaler != 0x0FFF))
+    return -1;
+  return (cycles + 2 * ui16Prescaler + 1 < ptf->u32Fdt) || (cycles > ptf->u32Fdt + 2 * ui16Prescaler + 1) ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  nfc_context *context;
+  nfc_device *pnd;
+  int opt;
+  int res = 0;
+  int iCorrection = 0;
+  const size_t szRuns = 50;
+
+  while ((opt = getopt(argc, argv, "l:")) != -1) {
+    switch (opt) {
+      case 'l':
+        lExchange = strtol(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-l chip exchange latency in µs]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((lExchange < 1) || (lExchange > 999999)) {
+    fprintf(stderr, "Invalid latency\n");
+    return EXIT_FAILURE;
+  }
+
+  // Registered before the first context: the simulated driver is the only one
+  nfc_register_driver(&sim_driver);
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+
+  // The device as the driver expects it
+  if ((pnd = sim_device(context)) == NULL) {
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+  if (bench_measure(pnd, "driver constant", szRuns) < 0)
+    res = -1;
+  const uint32_t au32Max[] = { 0, 20000, 1000000, UINT32_MAX };
+  for (size_t n = 0; n < sizeof(au32Max) / sizeof(au32Max[0]); n++) {
+    if (bench_prescaler(pnd, au32Max[n]) < 0)
+      res = -1;
+  }
+  nfc_close(pnd);
+
+  // Answers longer than the FIFO: drained on time by a fast host, lost by a slow one
+  const long lSaved = lExchange;
+  const long alExchange[] = { 500, 1000, 4000 };
+  for (size_t n = 0; n < sizeof(alExchange) / sizeof(alExchange[0]); n++) {
+    lExchange = alExchange[n];
+    if ((pnd = sim_device(context)) == NULL) {
+      res = -1;
+      break;
+    }
+    const int res2 = bench_long_answer(pnd);
+    // Losing the answer is expected with a slow host only, as long as it is reported
+    if ((res2 < 0) || ((res2 > 0) && (lExchange < 4000)))
+      res = -1;
+    nfc_close(pnd);
+  }
+  lExchange = lSaved;
+
+  // Another board: the driver constant is off until calibrated
+  i32TimerOffset = SIM_TIMER_CORRECTION + 40;
+  if ((pnd = sim_device(context)) != NULL) {
+    if (bench_measure(pnd, "board timer 40 cycles late, driver constant", szRuns) < 0)
+      res = -1;
+    if (nfc_device_calibrate_timer(pnd, &iCorrection) < 0) {
+      nfc_perror(pnd, "nfc_device_calibrate_timer");
+      res = -1;
+    }
+    printf("calibrated: correction %d cycles\n", iCorrection);
+    if ((bench_measure(pnd, "board timer 40 cycles late, calibrated", szRuns) < 0) || (iCorrection != i32TimerOffset))
+      res = -1;
+    nfc_close(pnd);
+  } else {
+    res = -1;
+  }
+  i32TimerOffset = SIM_TIMER_CORRECTION;
+
+  // A tag that answers WUPA only: the calibration gets one sample per round
+  i32TimerOffset = SIM_TIMER_CORRECTION + 40;
+  bSilentAnticol = true;
+  if ((pnd = sim_device(context)) != NULL) {
+    if (nfc_device_calibrate_timer(pnd, &iCorrection) < 0) {
+      nfc_perror(pnd, "nfc_device_calibrate_timer");
+      res = -1;
+    }
+    printf("calibrated without ANTICOLLISION answers: correction %d cycles\n", iCorrection);
+    if (iCorrection != i32TimerOffset)
+      res = -1;
+    nfc_close(pnd);
+  } else {
+    res = -1;
+  }
+  bSilentAnticol = false;
+  i32TimerOffset = SIM_TIMER_CORRECTION;
+
+  // A relay adds its delay: seen by default, hidden once calibrated through it
+  u32RelayDelay = 200;
+  if ((pnd = sim_device(context)) != NULL) {
+    if (bench_measure(pnd, "relay 200 cycles, driver constant", szRuns) < 0)
+      res = -1;
+    if (nfc_device_calibrate_timer(pnd, &iCorrection) < 0) {
+      nfc_perror(pnd, "nfc_device_calibrate_timer");
+      res = -1;
+    }
+    printf("calibrated through the relay: correction %d cycles\n", iCorrection);
+    if (bench_measure(pnd, "relay 200 cycles, calibrated", szRuns) < 0)
+      res = -1;
+    nfc_close(pnd);
+  } else {
+    res = -1;
+  }
+  u32RelayDelay = 0;
+
+  nfc_exit(context);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,287 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file conf-bench.c
+ * @brief Context startup benchmark with many device files
+ *
+ * This program is linked with the library objects, the configuration
+ * directory being set at build time to conf-bench.d in the build directory.
+ * It writes there a libnfc.conf and one devices.d file per reader, then
+ * times context creation and release: from the files, and from a buffer
+ * holding the same configuration. The former parser, which compiled its
+ * regular expression for every file and read lines with fgets(), is timed
+ * on the same files for reference.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+
+#define BENCH_CONFDIR LIBNFC_SYSCONFDIR
+#define BENCH_DEVICEDIR LIBNFC_SYSCONFDIR"/devices.d"
+#define BENCH_MAX_DEVICES 4096
+
+static const char acConf[] =
+  "# libnfc.conf written by conf-bench\n"
+  "allow_autoscan = false\n"
+  "allow_intrusive_scan = false\n"
+  "log_level = 1\n";
+
+static int
+device_conf(char *buf, const size_t size, const unsigned int uiDevice, const bool bPrefix)
+{
+  const char *prefix = bPrefix ? "device." : "";
+  return snprintf(buf, size,
+                  "# Reader %u of the rack\n"
+                  "%sname = \"Rack reader %u\"\n"
+                  "%sconnstring = pn532_uart:/dev/ttyRACK%u\n"
+                  "%soptional = false\n",
+                  uiDevice, prefix, uiDevice, prefix, uiDevice, prefix);
+}
+
+static void
+conf_dir_clear(void)
+{
+  DIR *d = opendir(BENCH_DEVICEDIR);
+  if (d) {
+    struct dirent *de;
+    char filename[BUFSIZ];
+    while ((de = readdir(d)) != NULL) {
+      if (de->d_name[0] == '.')
+        continue;
+      snprintf(filename, sizeof(filename), "%s/%s", BENCH_DEVICEDIR, de->d_name);
+      unlink(filename);
+    }
+    closedir(d);
+  }
+}
+
+static int
+conf_dir_write(const unsigned int uiDevices)
+{
+  char acBuf[256], filename[BUFSIZ];
+  FILE *f;
+
+  if (((mkdir(BENCH_CONFDIR, 0755) < 0) && (errno != EEXIST)) ||
+      ((mkdir(BENCH_DEVICEDIR, 0755) < 0) && (errno != EEXIST))) {
+    perror("mkdir");
+    return -1;
+  }
+  conf_dir_clear();
+  if (!(f = fopen(BENCH_CONFDIR"/libnfc.conf", "w")))
+    return -1;
+  fputs(acConf, f);
+  fclose(f);
+  for (unsigned int n = 0; n < uiDevices; n++) {
+    snprintf(filename, sizeof(filename), "%s/reader%04u.conf", BENCH_DEVICEDIR, n);
+    if (!(f = fopen(filename, "w")))
+      return -1;
+    device_conf(acBuf, sizeof(acBuf), n, false);
+    fputs(acBuf, f);
+    fclose(f);
+  }
+  return 0;
+}
+
+static char *
+conf_buffer_new(const unsigned int uiDevices, size_t *pszLen)
+{
+  const size_t szMax = sizeof(acConf) + (size_t) uiDevices * 256;
+  char *buf = malloc(szMax);
+  size_t szLen = 0;
+
+  if (!buf)
+    return NULL;
+  memcpy(buf, acConf, sizeof(acConf) - 1);
+  szLen = sizeof(acConf) - 1;
+  for (unsigned int n = 0; n < uiDevices; n++)
+    szLen += device_conf(buf + szLen, szMax - szLen, n, true);
+  *pszLen = szLen;
+  return buf;
+}
+
+// The former parser, regular expression compiled per file
+static unsigned long
+legacy_parse_file(const char *filename)
+{
+  unsigned long ulPairs = 0;
+  FILE *f = fopen(filename, "r");
+  if (!f)
+    return 0;
+  char line[BUFSIZ];
+  const char *str_regex = "^[[:space:]]*([[:alnum:]_.]+)[[:space:]]*=[[:space:]]*(\"(.+)\"|([^[:space:]]+))[[:space:]]*$";
+  regex_t preg;
+  if (regcomp(&preg, str_regex, REG_EXTENDED | REG_NOTEOL) != 0) {
+    fclose(f);
+    return 0;
+  }
+  size_t nmatch = preg.re_nsub + 1;
+  regmatch_t *pmatch = malloc(sizeof(*pmatch) * nmatch);
+  if (!pmatch) {
+    regfree(&preg);
+    fclose(f);
+    return 0;
+  }
+  while (fgets(line, BUFSIZ, f) != NULL) {
+    if ((line[0] == '#') || (line[0] == '\n'))
+      continue;
+    if (regexec(&preg, line, nmatch, pmatch, 0) == 0) {
+      const size_t key_size = pmatch[1].rm_eo - pmatch[1].rm_so;
+      const off_t  value_pmatch = pmatch[3].rm_eo != -1 ? 3 : 4;
+      const size_t value_size = pmatch[value_pmatch].rm_eo - pmatch[value_pmatch].rm_so;
+      char key[key_size + 1];
+      char value[value_size + 1];
+      strncpy(key, line + (pmatch[1].rm_so), key_size);
+      key[key_size] = '\0';
+      strncpy(value, line + (pmatch[value_pmatch].rm_so), value_size);
+      value[value_size] = '\0';
+      ulPairs++;
+    }
+  }
+  free(pmatch);
+  regfree(&preg);
+  fclose(f);
+  return ulPairs;
+}
+
+static unsigned long
+legacy_load(void)
+{
+  unsigned long ulPairs = legacy_parse_file(BENCH_CONFDIR"/libnfc.conf");
+  DIR *d = opendir(BENCH_DEVICEDIR);
+  if (!d)
+    return ulPairs;
+  struct dirent *de;
+  char filename[BUFSIZ];
+  while ((de = readdir(d)) != NULL) {
+    if (de->d_name[0] == '.')
+      continue;
+    snprintf(filename, sizeof(filename), "%s/%s", BENCH_DEVICEDIR, de->d_name);
+    struct stat s;
+    if ((stat(filename, &s) == 0) && S_ISREG(s.st_mode))
+      ulPairs += legacy_parse_file(filename);
+  }
+  closedir(d);
+  return ulPairs;
+}
+
+static int
+bench(const unsigned int uiDevices, const unsigned int uiIterations)
+{
+  nfc_context *context;
+  unsigned long ulPairs = 0;
+  unsigned int uiFiles = 0, uiBuffer = 0;
+  size_t szBuf;
+  char *buf;
+
+  if (conf_dir_write(uiDevices) < 0) {
+    fprintf(stderr, "Unable to write the configuration in %s\n", BENCH_CONFDIR);
+    return -1;
+  }
+  if (!(buf = conf_buffer_new(uiDevices, &szBuf)))
+    return -1;
+
+  uint64_t start = monotonic_time_us();
+  for (unsigned int i = 0; i < uiIterations; i++)
+    ulPairs = legacy_load();
+  const uint64_t legacy = monotonic_time_us() - start;
+
+  start = monotonic_time_us();
+  for (unsigned int i = 0; i < uiIterations; i++) {
+    nfc_init(&context);
+    if (!context)
+      break;
+    uiFiles = context->user_defined_device_count;
+    nfc_exit(context);
+  }
+  const uint64_t files = monotonic_time_us() - start;
+
+  start = monotonic_time_us();
+  for (unsigned int i = 0; i < uiIterations; i++) {
+    nfc_init_from_buffer(&context, buf, szBuf);
+    if (!context)
+      break;
+    uiBuffer = context->user_defined_device_count;
+    nfc_exit(context);
+  }
+  const uint64_t buffer = monotonic_time_us() - start;
+  free(buf);
+
+  printf("%4u device files: former parser %8.1f us (%lu pairs, 4 devices kept), nfc_init() %8.1f us (%u devices), nfc_init_from_buffer() %8.1f us (%u devices)\n",
+         uiDevices, (double) legacy / uiIterations, ulPairs, (double) files / uiIterations, uiFiles,
+         (double) buffer / uiIterations, uiBuffer);
+  return ((uiFiles == uiDevices) && (uiBuffer == uiDevices)) ? 0 : -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned int auiDevices[] = { 4, 64, 256, 1024 };
+  size_t szSizes = sizeof(auiDevices) / sizeof(auiDevices[0]);
+  unsigned int uiIterations = 20;
+  int ch, res = 0;
+
+  while ((ch = getopt(argc, argv, "n:i:")) != -1) {
+    switch (ch) {
+      case 'n':
+        auiDevices[0] = (unsigned int) strtoul(optarg, NULL, 10);
+        szSizes = 1;
+        break;
+      case 'i':
+        uiIterations = (unsigned int) strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n device files] [-i iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((auiDevices[0] > BENCH_MAX_DEVICES) || (uiIterations == 0)) {
+    fprintf(stderr, "Invalid argument\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("Configuration in %s, %u iterations\n", BENCH_CONFDIR, uiIterations);
+  for (size_t n = 0; (n < szSizes) && (res == 0); n++)
+    res = bench(auiDevices[n], uiIterations);
+  conf_dir_clear();
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -30,13 +30,14 @@
 
 #include "conf.h"
 
-#ifdef CONFFILES
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <dirent.h>
 #include <string.h>
-#include <regex.h>
+#ifdef CONFFILES
+#include <dirent.h>
 #include <sys/stat.h>
+#endif // CONFFILES
 
 #include <nfc/nfc.h>
 #include "nfc-internal.h"
@@ -45,6 +46,7 @@
 #define LOG_CATEGORY "libnfc.config"
 #define LOG_GROUP    NFC_LOG_GROUP_CONFIG
 
+#ifdef CONFFILES
 #ifndef LIBNFC_SYSCONFDIR
 // If this define does not already exists, we build it using SYSCONFDIR
 #ifndef SYSCONFDIR
@@ -55,64 +57,121 @@
 
 #define LIBNFC_CONFFILE        LIBNFC_SYSCONFDIR"/libnfc.conf"
 #define LIBNFC_DEVICECONFDIR   LIBNFC_SYSCONFDIR"/devices.d"
+#endif // CONFFILES
 
+typedef void (*conf_keyvalue_fn)(void *data, const char *key, const char *value);
+
+// '\n' is not a space here, it ends the line
 static bool
-conf_parse_file(const char *filename, void (*conf_keyvalue)(void *data, const char *key, const char *value), void *data)
+conf_isspace(const char c)
 {
-  FILE *f = fopen(filename, "r");
-  if (!f) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unable to open file: %s", filename);
-    return false;
-  }
-  char line[BUFSIZ];
-  const char *str_regex = "^[[:space:]]*([[:alnum:]_.]+)[[:space:]]*=[[:space:]]*(\"(.+)\"|([^[:space:]]+))[[:space:]]*$";
-  regex_t preg;
-  if (regcomp(&preg, str_regex, REG_EXTENDED | REG_NOTEOL) != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Regular expression used for configuration file parsing is not valid.");
-    fclose(f);
-    return false;
-  }
-  size_t nmatch = preg.re_nsub + 1;
-  regmatch_t *pmatch = malloc(sizeof(*pmatch) * nmatch);
-  if (!pmatch) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Not enough memory: malloc failed.");
-    regfree(&preg);
-    fclose(f);
+  return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
+static bool
+conf_iskeychar(const char c)
+{
+  return isalnum((unsigned char) c) || (c == '_') || (c == '.');
+}
+
+/*
+ * Splits the line [p, q) into its key and value, in place: a key made of
+ * alphanumerics, '_' and '.', then '=', then either a double-quoted value,
+ * which may hold spaces, or a value without space.
+ */
+static bool
+conf_parse_line(char *p, char *q, char **key, char **value)
+{
+  while ((q > p) && conf_isspace(q[-1]))
+    q--;
+  while ((p < q) && conf_isspace(*p))
+    p++;
+  *key = p;
+  while ((p < q) && conf_iskeychar(*p))
+    p++;
+  char *key_end = p;
+  while ((p < q) && conf_isspace(*p))
+    p++;
+  if ((key_end == *key) || (p == q) || (*p != '='))
     return false;
+  p++;
+  while ((p < q) && conf_isspace(*p))
+    p++;
+  if ((q - p >= 3) && (*p == '"') && (q[-1] == '"')) {
+    p++;
+    q--;
+  } else {
+    if (p == q)
+      return false;
+    for (const char *c = p; c < q; c++) {
+      if (conf_isspace(*c))
+        return false;
+    }
   }
+  *key_end = '\0';
+  *q = '\0';
+  *value = p;
+  return true;
+}
 
+/*
+ * Parses a whole configuration in place, one pass and no copy per line;
+ * buf[len] must be writable.
+ */
+static void
+conf_parse_lines(char *buf, const size_t len, const char *source, conf_keyvalue_fn conf_keyvalue, void *data)
+{
+  char *const end = buf + len;
   int lineno = 0;
-  while (fgets(line, BUFSIZ, f) != NULL) {
+
+  for (char *line = buf; line < end;) {
+    char *eol = memchr(line, '\n', end - line);
+    if (!eol)
+      eol = end;
     lineno++;
-    switch (line[0]) {
-      case '#':
-      case '\n':
-        break;
-      default: {
-        int match;
-        if ((match = regexec(&preg, line, nmatch, pmatch, 0)) == 0) {
-          const size_t key_size = pmatch[1].rm_eo - pmatch[1].rm_so;
-          const off_t  value_pmatch = pmatch[3].rm_eo != -1 ? 3 : 4;
-          const size_t value_size = pmatch[value_pmatch].rm_eo - pmatch[value_pmatch].rm_so;
-          char key[key_size + 1];
-          char value[value_size + 1];
-          strncpy(key, line + (pmatch[1].rm_so), key_size);
-          key[key_size] = '\0';
-          strncpy(value, line + (pmatch[value_pmatch].rm_so), value_size);
-          value[value_size] = '\0';
-          conf_keyvalue(data, key, value);
-        } else {
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Parse error on line #%d: %s", lineno, line);
-        }
+    const char *c = line;
+    while ((c < eol) && conf_isspace(*c))
+      c++;
+    // Blank lines and comments
+    if ((c < eol) && (*c != '#')) {
+      char *key, *value;
+      const int line_len = (int)(eol - line);
+      if (conf_parse_line(line, eol, &key, &value)) {
+        conf_keyvalue(data, key, value);
+      } else {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Parse error in %s on line #%d: %.*s", source, lineno, line_len, line);
       }
-      break;
     }
+    line = eol + 1;
   }
+}
 
-  free(pmatch);
-  regfree(&preg);
-  fclose(f);
-  return false;
+static void
+conf_keyvalue_user_device(nfc_context *context, const char *key, const char *value)
+{
+  struct nfc_user_defined_device *device = NULL;
+
+  if (context->user_defined_device_count)
+    device = &context->user_defined_devices[context->user_defined_device_count - 1];
+  // A key which is already set on the last device starts a new one
+  if (strcmp(key, "name") == 0) {
+    if ((!device || (device->name[0] != '\0')) && !(device = nfc_context_add_user_defined_device(context)))
+      return;
+    strncpy(device->name, value, DEVICE_NAME_LENGTH - 1);
+    device->name[DEVICE_NAME_LENGTH - 1] = '\0';
+  } else if (strcmp(key, "connstring") == 0) {
+    if ((!device || (device->connstring[0] != '\0')) && !(device = nfc_context_add_user_defined_device(context)))
+      return;
+    strncpy(device->connstring, value, NFC_BUFSIZE_CONNSTRING - 1);
+    device->connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
+  } else if (strcmp(key, "optional") == 0) {
+    if ((!device || device->optional) && !(device = nfc_context_add_user_defined_device(context)))
+      return;
+    if ((strcmp(value, "true") == 0) || (strcmp(value, "True") == 0) || (strcmp(value, "1") == 0)) //optional
+      device->optional = true;
+  } else {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unknown key in config line: device.%s = %s", key, value);
+  }
 }
 
 static void
@@ -126,47 +185,59 @@ conf_keyvalue_context(void *data, const char *key, const char *value)
     string_as_boolean(value, &(context->allow_intrusive_scan));
   } else if (strcmp(key, "log_level") == 0) {
     context->log_level = atoi(value);
-  } else if (strcmp(key, "device.name") == 0) {
-    if ((context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].name, "") != 0) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
-    strncpy(context->user_defined_devices[context->user_defined_device_count - 1].name, value, DEVICE_NAME_LENGTH - 1);
-    context->user_defined_devices[context->user_defined_device_count - 1].name[DEVICE_NAME_LENGTH - 1] = '\0';
-  } else if (strcmp(key, "device.connstring") == 0) {
-    if ((context->user_defined_device_count == 0) || strcmp(context->user_defined_devices[context->user_defined_device_count - 1].connstring, "") != 0) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
-    strncpy(context->user_defined_devices[context->user_defined_device_count - 1].connstring, value, NFC_BUFSIZE_CONNSTRING - 1);
-    context->user_defined_devices[context->user_defined_device_count - 1].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
-  } else if (strcmp(key, "device.optional") == 0) {
-    if ((context->user_defined_device_count == 0) || context->user_defined_devices[context->user_defined_device_count - 1].optional) {
-      if (context->user_defined_device_count >= MAX_USER_DEFINED_DEVICES) {
-        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Configuration exceeded maximum user-defined devices.");
-        return;
-      }
-      context->user_defined_device_count++;
-    }
-    if ((strcmp(value, "true") == 0) || (strcmp(value, "True") == 0) || (strcmp(value, "1") == 0)) //optional
-      context->user_defined_devices[context->user_defined_device_count - 1].optional = true;
+  } else if (strncmp(key, "device.", strlen("device.")) == 0) {
+    conf_keyvalue_user_device(context, key + strlen("device."), value);
   } else {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unknown key in config line: %s = %s", key, value);
   }
 }
 
+void
+conf_parse_buffer(const char *config, const size_t config_len, nfc_context *context)
+{
+  // The caller's buffer is kept intact, lines are split in a copy
+  char *buf = malloc(config_len + 1);
+  if (!buf) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Not enough memory: malloc failed.");
+    return;
+  }
+  memcpy(buf, config, config_len);
+  buf[config_len] = '\0';
+  conf_parse_lines(buf, config_len, "buffer", conf_keyvalue_context, context);
+  free(buf);
+}
+
+#ifdef CONFFILES
 static void
 conf_keyvalue_device(void *data, const char *key, const char *value)
 {
-  char newkey[BUFSIZ];
-  sprintf(newkey, "device.%s", key);
-  conf_keyvalue_context(data, newkey, value);
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "key: [device.%s], value: [%s]", key, value);
+  conf_keyvalue_user_device((nfc_context *)data, key, value);
+}
+
+static bool
+conf_parse_file(const char *filename, conf_keyvalue_fn conf_keyvalue, void *data)
+{
+  FILE *f = fopen(filename, "rb");
+  if (!f) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Unable to open file: %s", filename);
+    return false;
+  }
+  // The whole file is read at once and parsed in place
+  long size;
+  char *buf = NULL;
+  if ((fseek(f, 0, SEEK_END) != 0) || ((size = ftell(f)) < 0) || (fseek(f, 0, SEEK_SET) != 0) ||
+      !(buf = malloc((size_t) size + 1))) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to read file: %s", filename);
+    fclose(f);
+    return false;
+  }
+  const size_t len = fread(buf, 1, (size_t) size, f);
+  fclose(f);
+  buf[len] = '\0';
+  conf_parse_lines(buf, len, filename, conf_keyvalue, data);
+  free(buf);
+  return true;
 }
 
 static void
@@ -190,8 +261,8 @@ conf_devices_load(const char *dirname, nfc_context *context)
         const size_t extension_len = strlen(".conf");
         if ((filename_len > extension_len) &&
             (strncmp(".conf", de->d_name + (filename_len - extension_len), extension_len) == 0)) {
-          char filename[BUFSIZ] = LIBNFC_DEVICECONFDIR"/";
-          strcat(filename, de->d_name);
+          char filename[BUFSIZ];
+          snprintf(filename, sizeof(filename), "%s/%s", dirname, de->d_name);
           struct stat s;
           if (stat(filename, &s) == -1) {
             perror("stat");
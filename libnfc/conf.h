@@ -28,7 +28,10 @@
 
 #include <nfc/nfc-types.h>
 
+void conf_parse_buffer(const char *config, const size_t config_len, nfc_context *context);
+#ifdef CONFFILES
 void conf_load(nfc_context *context);
+#endif // CONFFILES
 
 #endif // __NFC_CONF_H__
 
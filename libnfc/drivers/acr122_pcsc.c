@@ -103,6 +103,7 @@ const char *supported_devices[] = {
 };
 
 struct acr122_pcsc_data {
+  SCARDCONTEXT hContext;
   SCARDHANDLE hCard;
   SCARD_IO_REQUEST ioCard;
   uint8_t  abtRx[ACR122_PCSC_RESPONSE_LEN];
@@ -111,30 +112,12 @@ struct acr122_pcsc_data {
 
 #define DRIVER_DATA(pnd) ((struct acr122_pcsc_data*)(pnd->driver_data))
 
-static SCARDCONTEXT _SCardContext;
-static int _iSCardContextRefCount = 0;
-
-static SCARDCONTEXT *
-acr122_pcsc_get_scardcontext(void)
-{
-  if (_iSCardContextRefCount == 0) {
-    if (SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, &_SCardContext) != SCARD_S_SUCCESS)
-      return NULL;
-  }
-  _iSCardContextRefCount++;
-
-  return &_SCardContext;
-}
-
-static void
-acr122_pcsc_free_scardcontext(void)
+// PC/SC contexts must not be shared between threads: each scan and each
+// opened device establishes its own one.
+static bool
+acr122_pcsc_get_scardcontext(SCARDCONTEXT *phContext)
 {
-  if (_iSCardContextRefCount) {
-    _iSCardContextRefCount--;
-    if (!_iSCardContextRefCount) {
-      SCardReleaseContext(_SCardContext);
-    }
-  }
+  return SCardEstablishContext(SCARD_SCOPE_USER, NULL, NULL, phContext) == SCARD_S_SUCCESS;
 }
 
 #define PCSC_MAX_DEVICES 16
@@ -154,21 +137,23 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
   size_t  szPos = 0;
   char    acDeviceNames[256 + 64 * PCSC_MAX_DEVICES];
   size_t  szDeviceNamesLen = sizeof(acDeviceNames);
-  SCARDCONTEXT *pscc;
+  SCARDCONTEXT hContext;
   int     i;
 
   // Clear the reader list
   memset(acDeviceNames, '\0', szDeviceNamesLen);
 
   // Test if context succeeded
-  if (!(pscc = acr122_pcsc_get_scardcontext())) {
+  if (!acr122_pcsc_get_scardcontext(&hContext)) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "Warning: %s", "PCSC context not found (make sure PCSC daemon is running).");
     return 0;
   }
   // Retrieve the string array of all available pcsc readers
   DWORD dwDeviceNamesLen = szDeviceNamesLen;
-  if (SCardListReaders(*pscc, NULL, acDeviceNames, &dwDeviceNamesLen) != SCARD_S_SUCCESS)
+  if (SCardListReaders(hContext, NULL, acDeviceNames, &dwDeviceNamesLen) != SCARD_S_SUCCESS) {
+    SCardReleaseContext(hContext);
     return 0;
+  }
 
   size_t device_found = 0;
   while ((acDeviceNames[szPos] != '\0') && (device_found < connstrings_len)) {
@@ -189,7 +174,7 @@ acr122_pcsc_scan(const nfc_context *context, nfc_connstring connstrings[], const
     // Find next device name position
     while (acDeviceNames[szPos++] != '\0');
   }
-  acr122_pcsc_free_scardcontext();
+  SCardReleaseContext(hContext);
 
   return device_found;
 }
@@ -262,6 +247,7 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
     perror("malloc");
     goto error;
   }
+  DRIVER_DATA(pnd)->hContext = 0;
 
   // Alloc and init chip's data
   if (pn53x_data_new(pnd, &acr122_pcsc_io) == NULL) {
@@ -269,16 +255,14 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
     goto error;
   }
 
-  SCARDCONTEXT *pscc;
-
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Attempt to open %s", ndd.pcsc_device_name);
   // Test if context succeeded
-  if (!(pscc = acr122_pcsc_get_scardcontext()))
+  if (!acr122_pcsc_get_scardcontext(&DRIVER_DATA(pnd)->hContext))
     goto error;
   // Test if we were able to connect to the "emulator" card
-  if (SCardConnect(*pscc, ndd.pcsc_device_name, SCARD_SHARE_EXCLUSIVE, SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
+  if (SCardConnect(DRIVER_DATA(pnd)->hContext, ndd.pcsc_device_name, SCARD_SHARE_EXCLUSIVE, SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
     // Connect to ACR122 firmware version >2.0
-    if (SCardConnect(*pscc, ndd.pcsc_device_name, SCARD_SHARE_DIRECT, 0, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
+    if (SCardConnect(DRIVER_DATA(pnd)->hContext, ndd.pcsc_device_name, SCARD_SHARE_DIRECT, 0, &(DRIVER_DATA(pnd)->hCard), (void *) & (DRIVER_DATA(pnd)->ioCard.dwProtocol)) != SCARD_S_SUCCESS) {
       // We can not connect to this device.
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "PCSC connect failed");
       goto error;
@@ -308,6 +292,8 @@ acr122_pcsc_open(const nfc_context *context, const nfc_connstring connstring)
 
 error:
   free(ndd.pcsc_device_name);
+  if (pnd && pnd->driver_data && DRIVER_DATA(pnd)->hContext)
+    SCardReleaseContext(DRIVER_DATA(pnd)->hContext);
   nfc_device_free(pnd);
   return NULL;
 }
@@ -318,7 +304,7 @@ acr122_pcsc_close(nfc_device *pnd)
   pn53x_idle(pnd);
 
   SCardDisconnect(DRIVER_DATA(pnd)->hCard, SCARD_LEAVE_CARD);
-  acr122_pcsc_free_scardcontext();
+  SCardReleaseContext(DRIVER_DATA(pnd)->hContext);
 
   pn53x_data_free(pnd);
   nfc_device_free(pnd);
@@ -488,17 +474,22 @@ const struct nfc_driver acr122_pcsc_driver = {
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_felica       = pn53x_initiator_inventory_felica,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .device_calibrate_timer           = pn53x_calibrate_timer,
+  .sniff                            = pn53x_sniff,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
 
@@ -202,7 +202,7 @@ acr122s_send_frame(nfc_device *pnd, uint8_t *frame, int timeout)
   void *abort_p;
 
 #ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->abort_fds[1]);
+  abort_p = &(DRIVER_DATA(pnd)->abort_fds[0]);
 #else
   abort_p = &(DRIVER_DATA(pnd)->abort_flag);
 #endif
@@ -354,7 +354,7 @@ acr122s_activate_sam(nfc_device *pnd)
   if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, 0)) != 0)
     return ret;
 
-  CHIP_DATA(pnd)->power_mode = NORMAL;
+  pn53x_set_power_mode(pnd, NORMAL);
 
   return 0;
 }
@@ -376,7 +376,7 @@ acr122s_deactivate_sam(nfc_device *pnd)
   if ((ret = acr122s_recv_frame(pnd, resp, MAX_FRAME_SIZE, 0, 0)) != 0)
     return ret;
 
-  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+  pn53x_set_power_mode(pnd, LOWVBAT);
 
   return 0;
 }
@@ -460,7 +460,7 @@ acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const siz
       DRIVER_DATA(pnd)->seq = 0;
 
 #ifndef WIN32
-      if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
+      if (uart_abort_fd_open(DRIVER_DATA(pnd)->abort_fds) < 0) {
         uart_close(DRIVER_DATA(pnd)->port);
         nfc_device_free(pnd);
         iDevice = 0;
@@ -486,7 +486,7 @@ acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const siz
         return 0;
       }
       CHIP_DATA(pnd)->type = PN532;
-      CHIP_DATA(pnd)->power_mode = NORMAL;
+      pn53x_set_power_mode(pnd, NORMAL);
 
       char version[32];
       int ret = acr122s_get_firmware_version(pnd, version, sizeof(version));
@@ -495,6 +495,9 @@ acr122s_scan(const nfc_context *context, nfc_connstring connstrings[], const siz
       }
 
       uart_close(DRIVER_DATA(pnd)->port);
+#ifndef WIN32
+      uart_abort_fd_close(DRIVER_DATA(pnd)->abort_fds);
+#endif
       pn53x_data_free(pnd);
       nfc_device_free(pnd);
 
@@ -528,8 +531,7 @@ acr122s_close(nfc_device *pnd)
 
 #ifndef WIN32
   // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->abort_fds[0]);
-  close(DRIVER_DATA(pnd)->abort_fds[1]);
+  uart_abort_fd_close(DRIVER_DATA(pnd)->abort_fds);
 #endif
 
   pn53x_data_free(pnd);
@@ -604,7 +606,7 @@ acr122s_open(const nfc_context *context, const nfc_connstring connstring)
   DRIVER_DATA(pnd)->seq = 0;
 
 #ifndef WIN32
-  if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
+  if (uart_abort_fd_open(DRIVER_DATA(pnd)->abort_fds) < 0) {
     uart_close(DRIVER_DATA(pnd)->port);
     nfc_device_free(pnd);
     return NULL;
@@ -682,7 +684,7 @@ acr122s_receive(nfc_device *pnd, uint8_t *buf, size_t buf_len, int timeout)
   void *abort_p;
 
 #ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->abort_fds[1]);
+  abort_p = &(DRIVER_DATA(pnd)->abort_fds[0]);
 #else
   abort_p = &(DRIVER_DATA(pnd)->abort_flag);
 #endif
@@ -716,11 +718,7 @@ acr122s_abort_command(nfc_device *pnd)
 {
   if (pnd) {
 #ifndef WIN32
-    close(DRIVER_DATA(pnd)->abort_fds[0]);
-    close(DRIVER_DATA(pnd)->abort_fds[1]);
-    if (pipe(DRIVER_DATA(pnd)->abort_fds) < 0) {
-      return NFC_ESOFT;
-    }
+    uart_abort_fd_signal(DRIVER_DATA(pnd)->abort_fds);
 #else
     DRIVER_DATA(pnd)->abort_flag = true;
 #endif
@@ -745,17 +743,22 @@ const struct nfc_driver acr122s_driver = {
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_felica       = pn53x_initiator_inventory_felica,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .device_calibrate_timer           = pn53x_calibrate_timer,
+  .sniff                            = pn53x_sniff,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
 
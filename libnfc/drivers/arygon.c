@@ -159,8 +159,8 @@ arygon_scan(const nfc_context *context, nfc_connstring connstrings[], const size
       }
 
 #ifndef WIN32
-      // pipe-based abort mecanism
-      if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
+      // persistent abort mecanism
+      if (uart_abort_fd_open(DRIVER_DATA(pnd)->iAbortFds) < 0) {
         uart_close(DRIVER_DATA(pnd)->port);
         pn53x_data_free(pnd);
         nfc_device_free(pnd);
@@ -177,6 +177,9 @@ arygon_scan(const nfc_context *context, nfc_connstring connstrings[], const size
 
       int res = arygon_reset_tama(pnd);
       uart_close(DRIVER_DATA(pnd)->port);
+#ifndef WIN32
+      uart_abort_fd_close(DRIVER_DATA(pnd)->iAbortFds);
+#endif
       pn53x_data_free(pnd);
       nfc_device_free(pnd);
       if (res < 0) {
@@ -213,8 +216,7 @@ arygon_close_step2(nfc_device *pnd)
 
 #ifndef WIN32
   // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->iAbortFds[0]);
-  close(DRIVER_DATA(pnd)->iAbortFds[1]);
+  uart_abort_fd_close(DRIVER_DATA(pnd)->iAbortFds);
 #endif
 
   pn53x_data_free(pnd);
@@ -298,15 +300,15 @@ arygon_open(const nfc_context *context, const nfc_connstring connstring)
   }
 
   // The PN53x chip opened to ARYGON MCU doesn't seems to be in LowVBat mode
-  CHIP_DATA(pnd)->power_mode = NORMAL;
+  pn53x_set_power_mode(pnd, NORMAL);
 
   // empirical tuning
   CHIP_DATA(pnd)->timer_correction = 46;
   pnd->driver = &arygon_driver;
 
 #ifndef WIN32
-  // pipe-based abort mecanism
-  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
+  // persistent abort mecanism
+  if (uart_abort_fd_open(DRIVER_DATA(pnd)->iAbortFds) < 0) {
     uart_close(DRIVER_DATA(pnd)->port);
     pn53x_data_free(pnd);
     nfc_device_free(pnd);
@@ -404,7 +406,7 @@ arygon_tama_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, i
   void *abort_p = NULL;
 
 #ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->iAbortFds[1]);
+  abort_p = &(DRIVER_DATA(pnd)->iAbortFds[0]);
 #else
   abort_p = (void *) & (DRIVER_DATA(pnd)->abort_flag);
 #endif
@@ -576,10 +578,7 @@ arygon_abort_command(nfc_device *pnd)
 {
   if (pnd) {
 #ifndef WIN32
-    close(DRIVER_DATA(pnd)->iAbortFds[0]);
-    if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-      return NFC_ESOFT;
-    }
+    uart_abort_fd_signal(DRIVER_DATA(pnd)->iAbortFds);
 #else
     DRIVER_DATA(pnd)->abort_flag = true;
 #endif
@@ -605,17 +604,22 @@ const struct nfc_driver arygon_driver = {
   .initiator_init_secure_element    = NULL, // No secure-element support
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_felica       = pn53x_initiator_inventory_felica,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .device_calibrate_timer           = pn53x_calibrate_timer,
+  .sniff                            = pn53x_sniff,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
 
@@ -0,0 +1,698 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file broker.c
+ * @brief Driver for devices shared through the nfcd broker daemon
+ *
+ * nfcd owns the physical readers. This driver forwards PN53x commands to it
+ * over a Unix socket, so the whole pn53x chip layer runs unchanged on the
+ * client side. Before its first command, a client waits for a lease on the
+ * device; nfcd grants leases by priority and, within a priority, to the
+ * least recently served client. The lease is given back on deselect, idle
+ * and close, and nfcd revokes it from clients that hold it idle while
+ * others are waiting. Targets do not survive a change of lease holder: nfcd
+ * releases them, and a client whose lease was revoked while it had a target
+ * gets NFC_ETGRELEASED.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "broker.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "drivers.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define BROKER_DRIVER_NAME "broker"
+
+#define LOG_CATEGORY "libnfc.driver.broker"
+#define LOG_GROUP    NFC_LOG_GROUP_DRIVER
+
+// Extra time granted to nfcd to report a chip timeout before we abort the command ourselves
+#define BROKER_TIMEOUT_MARGIN 1000
+// Time granted to nfcd to answer an aborted request before the connection is given up
+#define BROKER_ABORT_TIMEOUT 2000
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif
+
+// Internal data structs
+const struct pn53x_io broker_io;
+struct broker_data {
+  int     fd;
+  int     iAbortFds[2];
+  uint32_t device;
+  uint8_t priority;
+  bool    leased;
+  bool    initialized;
+  // Command handed to send(), it is forwarded to nfcd when libnfc asks for the reply
+  uint8_t abtTx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t  szTx;
+  int     timeout;
+};
+
+#define DRIVER_DATA(pnd) ((struct broker_data*)(pnd->driver_data))
+
+static const char *
+broker_socket_path(void)
+{
+#ifdef ENVVARS
+  const char *envvar = getenv("LIBNFC_BROKER_SOCKET");
+  if (envvar) {
+    return envvar;
+  }
+#endif // ENVVARS
+  return BROKER_DEFAULT_SOCKET;
+}
+
+static int
+broker_connect(void)
+{
+  const char *path = broker_socket_path();
+  struct sockaddr_un sa;
+
+  if (strlen(path) >= sizeof(sa.sun_path)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Socket path is too long: %s", path);
+    return -1;
+  }
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to reach nfcd on %s: %s", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static int
+broker_send_message(int fd, const struct broker_header *header, const uint8_t *payload)
+{
+  uint8_t abtMsg[sizeof(struct broker_header) + PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t szMsg = sizeof(*header) + header->length;
+
+  if (header->length > PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
+    return NFC_EINVARG;
+  }
+  // Header and payload go in a single write so nfcd never sees a partial request
+  memcpy(abtMsg, header, sizeof(*header));
+  if (header->length) {
+    memcpy(abtMsg + sizeof(*header), payload, header->length);
+  }
+  size_t szSent = 0;
+  while (szSent < szMsg) {
+    ssize_t res = send(fd, abtMsg + szSent, szMsg - szSent, MSG_NOSIGNAL);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to write to nfcd: %s", strerror(errno));
+      return NFC_EIO;
+    }
+    szSent += res;
+  }
+  return NFC_SUCCESS;
+}
+
+// State of the wait for a reply, shared by the reads of its header and payload
+struct broker_wait {
+  int timeout;              // local deadline in ms, 0 waits forever
+  struct timeval start;
+  bool bAbortSent;
+  struct timeval abort_start;
+  bool bTimedOut;
+};
+
+static int
+broker_elapsed_ms(const struct timeval *start)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (int)((now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000);
+}
+
+/*
+ * Read exactly szLen bytes from nfcd.
+ * nfcd answers every request it accepted, so nothing is given up half-way:
+ * when the local deadline expires or an abort is requested, nfcd is asked to
+ * abort the pending request and we wait for its reply. If that reply does
+ * not come within BROKER_ABORT_TIMEOUT, the connection is out of sync and is
+ * shut down.
+ */
+static int
+broker_recv_bytes(int fd, int abort_fd, uint8_t *pbtData, size_t szLen, struct broker_wait *pw)
+{
+  size_t szReceived = 0;
+
+  while (szReceived < szLen) {
+    struct pollfd pfd[2];
+    nfds_t nfds = 1;
+    int poll_timeout = -1;
+
+    pfd[0].fd = fd;
+    pfd[0].events = POLLIN;
+    if ((abort_fd >= 0) && !pw->bAbortSent) {
+      pfd[1].fd = abort_fd;
+      pfd[1].events = POLLIN;
+      nfds = 2;
+    }
+    if (pw->bAbortSent) {
+      poll_timeout = MAX(BROKER_ABORT_TIMEOUT - broker_elapsed_ms(&pw->abort_start), 0);
+    } else if (pw->timeout > 0) {
+      poll_timeout = MAX(pw->timeout - broker_elapsed_ms(&pw->start), 0);
+    }
+
+    int res = poll(pfd, nfds, poll_timeout);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return NFC_EIO;
+    }
+    if ((res == 0) && pw->bAbortSent) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "nfcd did not answer the aborted request, connection given up");
+      shutdown(fd, SHUT_RDWR);
+      return NFC_EIO;
+    }
+    if ((res == 0) || ((nfds == 2) && (pfd[1].revents & POLLIN))) {
+      if (res == 0) {
+        pw->bTimedOut = true;
+      } else {
+        uint8_t dummy;
+        if (read(abort_fd, &dummy, 1) < 0) {
+          return NFC_ESOFT;
+        }
+      }
+      // nfcd replies to the aborted request, keep reading until then
+      struct broker_header abort_req;
+      memset(&abort_req, 0, sizeof(abort_req));
+      abort_req.command = BROKER_ABORT;
+      if ((res = broker_send_message(fd, &abort_req, NULL)) < 0) {
+        return res;
+      }
+      pw->bAbortSent = true;
+      gettimeofday(&pw->abort_start, NULL);
+      continue;
+    }
+    if (pfd[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t szRead = recv(fd, pbtData + szReceived, szLen - szReceived, 0);
+      if (szRead < 0) {
+        if (errno == EINTR)
+          continue;
+        return NFC_EIO;
+      }
+      if (szRead == 0) {
+        log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Connection to nfcd lost");
+        return NFC_EIO;
+      }
+      szReceived += szRead;
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+/*
+ * Wait for a reply from nfcd. The payload is stored in pbtPayload up to
+ * szPayloadLen bytes, extra bytes are discarded. timeout is the local
+ * deadline in ms, 0 waits forever.
+ */
+static int
+broker_recv_message(int fd, int abort_fd, struct broker_header *reply, uint8_t *pbtPayload, size_t szPayloadLen, int timeout, bool *pbTimedOut)
+{
+  struct broker_wait wait;
+  int res;
+
+  memset(&wait, 0, sizeof(wait));
+  wait.timeout = timeout;
+  gettimeofday(&wait.start, NULL);
+  *pbTimedOut = false;
+  if ((res = broker_recv_bytes(fd, abort_fd, (uint8_t *) reply, sizeof(*reply), &wait)) < 0) {
+    return res;
+  }
+  size_t szStored = MIN(reply->length, szPayloadLen);
+  if (szStored && ((res = broker_recv_bytes(fd, abort_fd, pbtPayload, szStored, &wait)) < 0)) {
+    return res;
+  }
+  for (size_t szLeft = reply->length - szStored; szLeft > 0;) {
+    uint8_t abtDiscard[64];
+    size_t szChunk = MIN(szLeft, sizeof(abtDiscard));
+    if ((res = broker_recv_bytes(fd, abort_fd, abtDiscard, szChunk, &wait)) < 0) {
+      return res;
+    }
+    szLeft -= szChunk;
+  }
+  *pbTimedOut = wait.bTimedOut;
+  return NFC_SUCCESS;
+}
+
+static int
+broker_local_timeout(nfc_device *pnd, int timeout)
+{
+  if (timeout == -1) {
+    timeout = CHIP_DATA(pnd)->timeout_command;
+  }
+  return (timeout > 0) ? timeout + BROKER_TIMEOUT_MARGIN : 0;
+}
+
+/*
+ * Another client drove the chip since we held the device: replay the
+ * settings the pn53x layer caches on the host so our next commands run in
+ * the state we left the chip in. nfcd released the targets on the way.
+ */
+static int
+broker_resync(nfc_device *pnd)
+{
+  int res;
+
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Device was used by another client, restoring chip settings");
+  pn53x_current_target_free(pnd);
+  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_TxMode, SYMBOL_TX_CRC_ENABLE, pnd->bCrc ? SYMBOL_TX_CRC_ENABLE : 0x00)) < 0)
+    return res;
+  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_RxMode, SYMBOL_RX_CRC_ENABLE, pnd->bCrc ? SYMBOL_RX_CRC_ENABLE : 0x00)) < 0)
+    return res;
+  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_ManualRCV, SYMBOL_PARITY_DISABLE, pnd->bPar ? 0x00 : SYMBOL_PARITY_DISABLE)) < 0)
+    return res;
+  if ((res = pn53x_write_register(pnd, PN53X_REG_CIU_BitFraming, SYMBOL_TX_LAST_BITS, CHIP_DATA(pnd)->ui8TxBits)) < 0)
+    return res;
+  // SetParameters goes through pn53x_transceive() which flushes the register writes above
+  if ((res = pn53x_SetParameters(pnd, CHIP_DATA(pnd)->ui8Parameters)) < 0)
+    return res;
+  if (CHIP_DATA(pnd)->operating_mode == INITIATOR) {
+    res = pn53x_RFConfiguration__RF_field(pnd, true);
+  }
+  return res;
+}
+
+static int
+broker_acquire(nfc_device *pnd, int timeout)
+{
+  struct broker_header req;
+  struct broker_header reply;
+  bool bTimedOut;
+  int res;
+
+  memset(&req, 0, sizeof(req));
+  req.command = BROKER_ACQUIRE;
+  req.priority = DRIVER_DATA(pnd)->priority;
+  req.device = DRIVER_DATA(pnd)->device;
+  if ((res = broker_send_message(DRIVER_DATA(pnd)->fd, &req, NULL)) < 0) {
+    return res;
+  }
+  // Waiting for the lease counts against the command timeout
+  if (timeout == -1) {
+    timeout = CHIP_DATA(pnd)->timeout_command;
+  }
+  if ((res = broker_recv_message(DRIVER_DATA(pnd)->fd, DRIVER_DATA(pnd)->iAbortFds[0], &reply, NULL, 0, timeout, &bTimedOut)) < 0) {
+    return res;
+  }
+  if (reply.result < 0) {
+    return (bTimedOut && (reply.result == NFC_EOPABORTED)) ? NFC_ETIMEOUT : reply.result;
+  }
+  DRIVER_DATA(pnd)->leased = true;
+  if ((reply.flags & BROKER_FLAG_PREEMPTED) && DRIVER_DATA(pnd)->initialized) {
+    return broker_resync(pnd);
+  }
+  return NFC_SUCCESS;
+}
+
+static void
+broker_release(nfc_device *pnd)
+{
+  if (!DRIVER_DATA(pnd)->leased)
+    return;
+
+  struct broker_header req;
+  memset(&req, 0, sizeof(req));
+  req.command = BROKER_RELEASE;
+  req.device = DRIVER_DATA(pnd)->device;
+  broker_send_message(DRIVER_DATA(pnd)->fd, &req, NULL);
+  DRIVER_DATA(pnd)->leased = false;
+}
+
+static size_t
+broker_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  size_t device_found = 0;
+
+  int fd = broker_connect();
+  if (fd < 0) {
+    // nfcd is not running
+    return 0;
+  }
+
+  struct broker_header req;
+  struct broker_header reply;
+  bool bTimedOut;
+  memset(&req, 0, sizeof(req));
+  req.command = BROKER_LIST;
+  if ((broker_send_message(fd, &req, NULL) == NFC_SUCCESS) &&
+      (broker_recv_message(fd, -1, &reply, NULL, 0, 0, &bTimedOut) == NFC_SUCCESS) &&
+      (reply.result >= 0)) {
+    for (uint32_t i = 0; (i < reply.device) && (device_found < connstrings_len); i++) {
+      snprintf(connstrings[device_found], sizeof(nfc_connstring), "%s:%"PRIu32, BROKER_DRIVER_NAME, i);
+      device_found++;
+    }
+  }
+  close(fd);
+  return device_found;
+}
+
+static void
+broker_close(nfc_device *pnd)
+{
+  // nfcd puts the reader in idle state once its last client is gone,
+  // switching the RF field off here would disturb the other clients
+  broker_release(pnd);
+  close(DRIVER_DATA(pnd)->fd);
+
+  // Release file descriptors used for abort mecanism
+  close(DRIVER_DATA(pnd)->iAbortFds[0]);
+  close(DRIVER_DATA(pnd)->iAbortFds[1]);
+
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static nfc_device *
+broker_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  char *index_s;
+  char *priority_s;
+  unsigned int device;
+  unsigned int priority = BROKER_PRIORITY_DEFAULT;
+
+  int connstring_decode_level = connstring_decode(connstring, BROKER_DRIVER_NAME, NULL, &index_s, &priority_s);
+  if (connstring_decode_level < 2) {
+    return NULL;
+  }
+  if (sscanf(index_s, "%10u", &device) != 1) {
+    free(index_s);
+    if (connstring_decode_level == 3)
+      free(priority_s);
+    return NULL;
+  }
+  free(index_s);
+  if (connstring_decode_level == 3) {
+    if ((sscanf(priority_s, "%10u", &priority) != 1) || (priority > BROKER_PRIORITY_MAX)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Invalid priority: %s", priority_s);
+      free(priority_s);
+      return NULL;
+    }
+    free(priority_s);
+  }
+
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Attempt to open device #%u with priority %u on %s", device, priority, broker_socket_path());
+  int fd = broker_connect();
+  if (fd < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to reach nfcd on %s", broker_socket_path());
+    return NULL;
+  }
+
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd) {
+    perror("malloc");
+    close(fd);
+    return NULL;
+  }
+  pnd->driver_data = malloc(sizeof(struct broker_data));
+  if (!pnd->driver_data) {
+    perror("malloc");
+    close(fd);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  DRIVER_DATA(pnd)->fd = fd;
+  DRIVER_DATA(pnd)->device = device;
+  DRIVER_DATA(pnd)->priority = priority;
+  DRIVER_DATA(pnd)->leased = false;
+  DRIVER_DATA(pnd)->initialized = false;
+  DRIVER_DATA(pnd)->szTx = 0;
+
+  // pipe-based abort mecanism
+  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
+    close(fd);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+
+  // Bind this connection to the requested device
+  struct broker_header req;
+  struct broker_header reply;
+  char acName[DEVICE_NAME_LENGTH - sizeof(BROKER_DRIVER_NAME)];
+  bool bTimedOut;
+  memset(&req, 0, sizeof(req));
+  req.command = BROKER_ATTACH;
+  req.device = device;
+  req.priority = priority;
+  if ((broker_send_message(fd, &req, NULL) < 0) ||
+      (broker_recv_message(fd, -1, &reply, (uint8_t *) acName, sizeof(acName) - 1, 0, &bTimedOut) < 0) ||
+      (reply.result < 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "nfcd refused to attach device #%u", device);
+    close(DRIVER_DATA(pnd)->iAbortFds[0]);
+    close(DRIVER_DATA(pnd)->iAbortFds[1]);
+    close(fd);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  acName[MIN(reply.length, sizeof(acName) - 1)] = '\0';
+  snprintf(pnd->name, sizeof(pnd->name), "%s:%s", BROKER_DRIVER_NAME, acName);
+
+  // Alloc and init chip's data
+  if (pn53x_data_new(pnd, &broker_io) == NULL) {
+    perror("malloc");
+    close(DRIVER_DATA(pnd)->iAbortFds[0]);
+    close(DRIVER_DATA(pnd)->iAbortFds[1]);
+    close(fd);
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  // Timed commands are computed on this side, use the correction tuned for the real reader
+  CHIP_DATA(pnd)->timer_correction = reply.timer_correction;
+  pnd->driver = &broker_driver;
+
+  // Check communication using "Diagnose" command, with "Communication test" (0x00)
+  if (pn53x_check_communication(pnd) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "pn53x_check_communication error");
+    broker_close(pnd);
+    return NULL;
+  }
+
+  pn53x_init(pnd);
+  DRIVER_DATA(pnd)->initialized = true;
+  return pnd;
+}
+
+static int
+broker_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  int res;
+
+  if (szData > sizeof(DRIVER_DATA(pnd)->abtTx)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if (!DRIVER_DATA(pnd)->leased) {
+    if ((res = broker_acquire(pnd, timeout)) < 0) {
+      pnd->last_error = res;
+      return res;
+    }
+  }
+  // The reply size is only known by receive(), the command is forwarded from there
+  memcpy(DRIVER_DATA(pnd)->abtTx, pbtData, szData);
+  DRIVER_DATA(pnd)->szTx = szData;
+  DRIVER_DATA(pnd)->timeout = timeout;
+  return NFC_SUCCESS;
+}
+
+static int
+broker_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  struct broker_header req;
+  struct broker_header reply;
+  bool bTimedOut;
+  int res;
+
+  (void) timeout;
+  for (;;) {
+    memset(&req, 0, sizeof(req));
+    req.command = BROKER_TRANSCEIVE;
+    req.device = DRIVER_DATA(pnd)->device;
+    req.timeout = DRIVER_DATA(pnd)->timeout;
+    req.rx_len = szDataLen;
+    req.length = DRIVER_DATA(pnd)->szTx;
+    if ((res = broker_send_message(DRIVER_DATA(pnd)->fd, &req, DRIVER_DATA(pnd)->abtTx)) < 0) {
+      pnd->last_error = res;
+      return res;
+    }
+    if ((res = broker_recv_message(DRIVER_DATA(pnd)->fd, DRIVER_DATA(pnd)->iAbortFds[0], &reply, pbtData, szDataLen, broker_local_timeout(pnd, req.timeout), &bTimedOut)) < 0) {
+      pnd->last_error = res;
+      return res;
+    }
+    if (!(reply.flags & BROKER_FLAG_REVOKED))
+      break;
+
+    // nfcd handed the device to someone else while we were idle, and released
+    // our target on the way: the command would run on what the next lease
+    // holder left selected, or on no emulated session at all
+    DRIVER_DATA(pnd)->leased = false;
+    if ((CHIP_DATA(pnd)->current_target != NULL) || (CHIP_DATA(pnd)->operating_mode == TARGET)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Lease revoked, target released");
+      pn53x_current_target_free(pnd);
+      pnd->last_error = NFC_ETGRELEASED;
+      return pnd->last_error;
+    }
+    // No target involved: queue up again, then replay the command (resync
+    // may reuse our command buffer)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%s", "Lease revoked, waiting for the device");
+    uint8_t abtTx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+    const size_t szTx = DRIVER_DATA(pnd)->szTx;
+    const int iTimeout = DRIVER_DATA(pnd)->timeout;
+    memcpy(abtTx, DRIVER_DATA(pnd)->abtTx, szTx);
+    if ((res = broker_acquire(pnd, iTimeout)) < 0) {
+      pnd->last_error = res;
+      return res;
+    }
+    memcpy(DRIVER_DATA(pnd)->abtTx, abtTx, szTx);
+    DRIVER_DATA(pnd)->szTx = szTx;
+    DRIVER_DATA(pnd)->timeout = iTimeout;
+  }
+
+  if (reply.result < 0) {
+    if (reply.status && szDataLen) {
+      // Chip reported an error: hand the status byte to pn53x_transceive() which decodes it
+      pbtData[0] = reply.status;
+      return 1;
+    }
+    pnd->last_error = (bTimedOut && (reply.result == NFC_EOPABORTED)) ? NFC_ETIMEOUT : reply.result;
+    return pnd->last_error;
+  }
+  if (reply.length > szDataLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data: buffer too small");
+    pnd->last_error = NFC_EOVFLOW;
+    return pnd->last_error;
+  }
+  return reply.length;
+}
+
+static int
+broker_initiator_deselect_target(nfc_device *pnd)
+{
+  int res = pn53x_initiator_deselect_target(pnd);
+  // End of a burst: let other clients in
+  broker_release(pnd);
+  return res;
+}
+
+static int
+broker_idle(nfc_device *pnd)
+{
+  int res = pn53x_idle(pnd);
+  broker_release(pnd);
+  return res;
+}
+
+static int
+broker_abort_command(nfc_device *pnd)
+{
+  if (pnd) {
+    const uint8_t btAbort = 0x00;
+    if (write(DRIVER_DATA(pnd)->iAbortFds[1], &btAbort, 1) < 0) {
+      return NFC_ESOFT;
+    }
+  }
+  return NFC_SUCCESS;
+}
+
+const struct pn53x_io broker_io = {
+  .send       = broker_send,
+  .receive    = broker_receive,
+};
+
+const struct nfc_driver broker_driver = {
+  .name                             = BROKER_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = broker_scan,
+  .open                             = broker_open,
+  .close                            = broker_close,
+  .strerror                         = pn53x_strerror,
+
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_init_secure_element    = pn532_initiator_init_secure_element,
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_felica       = pn53x_initiator_inventory_felica,
+  .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
+  .initiator_deselect_target        = broker_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
+  .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
+  .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .device_calibrate_timer           = pn53x_calibrate_timer,
+  .sniff                            = pn53x_sniff,
+  .initiator_target_is_present      = pn53x_initiator_target_is_present,
+
+  .target_init           = pn53x_target_init,
+  .target_send_bytes     = pn53x_target_send_bytes,
+  .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
+  .target_send_bits      = pn53x_target_send_bits,
+  .target_receive_bits   = pn53x_target_receive_bits,
+
+  .device_set_property_bool     = pn53x_set_property_bool,
+  .device_set_property_int      = pn53x_set_property_int,
+  .get_supported_modulation     = pn53x_get_supported_modulation,
+  .get_supported_baud_rate      = pn53x_get_supported_baud_rate,
+  .device_get_information_about = pn53x_get_information_about,
+
+  .abort_command  = broker_abort_command,
+  .idle           = broker_idle,
+  // Power management stays with nfcd which tracks the real chip state
+  .powerdown      = NULL,
+};
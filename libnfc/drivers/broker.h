@@ -0,0 +1,82 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file broker.h
+ * @brief Driver for devices shared through the nfcd broker daemon
+ */
+
+#ifndef __NFC_DRIVER_BROKER_H__
+#define __NFC_DRIVER_BROKER_H__
+
+#include <stdint.h>
+
+#include <nfc/nfc-types.h>
+
+/* Unix socket nfcd listens on, can be overridden with LIBNFC_BROKER_SOCKET */
+#define BROKER_DEFAULT_SOCKET "/var/run/nfcd.sock"
+
+/* Scheduling priorities, a connstring can request one with "broker:<index>:<priority>" */
+#define BROKER_PRIORITY_MIN     0
+#define BROKER_PRIORITY_DEFAULT 1
+#define BROKER_PRIORITY_MAX     3
+
+/*
+ * Wire protocol between the broker driver and nfcd.
+ *
+ * Every message is a struct broker_header immediately followed by
+ * header.length bytes of payload. Both ends live on the same host, so
+ * fields are sent in native byte order.
+ */
+typedef enum {
+  BROKER_LIST = 0x01,   /* reply: header.device = count, payload = NUL-separated device names */
+  BROKER_ATTACH,        /* bind the connection to device header.device, reply payload = device name */
+  BROKER_ACQUIRE,       /* wait for exclusive use of the device (lease) */
+  BROKER_RELEASE,       /* give the lease back, no reply */
+  BROKER_TRANSCEIVE,    /* payload = PN53x command, reply payload = PN53x response */
+  BROKER_ABORT,         /* abort the pending request of this connection, no reply */
+} broker_command;
+
+/* Reply flags */
+#define BROKER_FLAG_PREEMPTED 0x01  /* ACQUIRE: another client drove the chip since our last lease */
+#define BROKER_FLAG_REVOKED   0x02  /* TRANSCEIVE: lease was revoked, command has not been run */
+
+struct broker_header {
+  uint8_t  command;
+  uint8_t  priority;  /* request: scheduling priority */
+  uint8_t  flags;     /* reply: BROKER_FLAG_* */
+  uint8_t  status;    /* reply: PN53x status byte behind a negative result */
+  uint32_t device;
+  int32_t  timeout;   /* request: PN53x command timeout in ms (-1: chip default) */
+  int32_t  result;    /* reply: libnfc result code */
+  int32_t  timer_correction; /* ATTACH reply: timer correction of the reader, in cycles */
+  uint32_t rx_len;    /* request: room available for the reply payload */
+  uint32_t length;    /* payload length */
+};
+
+extern const struct nfc_driver broker_driver;
+
+#endif // ! __NFC_DRIVER_BROKER_H__
@@ -65,15 +65,20 @@ const struct pn53x_io pn532_i2c_io;
 struct pn532_i2c_data {
   i2c_device dev;
   volatile bool abort_flag;
+  /* Smoothed delays before the ACK frame and before the response frame (in µs) */
+  uint32_t ack_latency;
+  uint32_t response_latency;
+  /* Commands sent, for the bus bytes per command figure */
+  unsigned long commands;
 };
 
-/* Delay for the loop waiting for READY frame (in ms) */
+/* Longest delay between two polls of the READY status (in ms) */
 #define PN532_RDY_LOOP_DELAY 90
-
-const struct timespec rdyDelay = {
-  .tv_sec = 0,
-  .tv_nsec = PN532_RDY_LOOP_DELAY * 1000 * 1000
-};
+/* Shortest delay between two polls of the READY status (in µs) */
+#define PN532_RDY_POLL_MIN_DELAY 500
+/* Initial guesses of the ACK and response delays (in µs) */
+#define PN532_ACK_LATENCY_INIT 1000
+#define PN532_RESPONSE_LATENCY_INIT 5000
 
 /* Private Functions Prototypes */
 
@@ -89,7 +94,7 @@ static int pn532_i2c_abort_command(nfc_device *pnd);
 
 static int pn532_i2c_wakeup(nfc_device *pnd);
 
-static int pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout);
+static int pn532_i2c_wait_rdyframe(nfc_device *pnd, uint32_t *pui32Latency, int timeout);
 
 static size_t pn532_i2c_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len);
 
@@ -163,9 +168,12 @@ pn532_i2c_scan(const nfc_context *context, nfc_connstring connstrings[], const s
       // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
       CHIP_DATA(pnd)->type = PN532;
       // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
+      pn53x_set_power_mode(pnd, LOWVBAT);
 
       DRIVER_DATA(pnd)->abort_flag = false;
+      DRIVER_DATA(pnd)->ack_latency = PN532_ACK_LATENCY_INIT;
+      DRIVER_DATA(pnd)->response_latency = PN532_RESPONSE_LATENCY_INIT;
+      DRIVER_DATA(pnd)->commands = 0;
 
       // Check communication using "Diagnose" command, with "Communication test" (0x00)
       int res = pn53x_check_communication(pnd);
@@ -201,6 +209,13 @@ static void
 pn532_i2c_close(nfc_device *pnd)
 {
   pn53x_idle(pnd);
+
+  if (DRIVER_DATA(pnd)->commands) {
+    struct i2c_stats stats;
+    i2c_get_stats(DRIVER_DATA(pnd)->dev, &stats);
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%lu bus bytes per command (%lu commands, %lu transactions)",
+            (stats.bytes_read + stats.bytes_written) / DRIVER_DATA(pnd)->commands, DRIVER_DATA(pnd)->commands, stats.transactions);
+  }
   i2c_close(DRIVER_DATA(pnd)->dev);
 
   pn53x_data_free(pnd);
@@ -266,13 +281,16 @@ pn532_i2c_open(const nfc_context *context, const nfc_connstring connstring)
   // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
   CHIP_DATA(pnd)->type = PN532;
   // This device starts in LowVBat mode
-  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+  pn53x_set_power_mode(pnd, LOWVBAT);
 
   // empirical tuning
   CHIP_DATA(pnd)->timer_correction = 48;
   pnd->driver = &pn532_i2c_driver;
 
   DRIVER_DATA(pnd)->abort_flag = false;
+  DRIVER_DATA(pnd)->ack_latency = PN532_ACK_LATENCY_INIT;
+  DRIVER_DATA(pnd)->response_latency = PN532_RESPONSE_LATENCY_INIT;
+  DRIVER_DATA(pnd)->commands = 0;
 
   // Check communication using "Diagnose" command, with "Communication test" (0x00)
   if (pn53x_check_communication(pnd) < 0) {
@@ -289,7 +307,7 @@ static int
 pn532_i2c_wakeup(nfc_device *pnd)
 {
   /* No specific.  PN532 holds SCL during wakeup time  */
-  CHIP_DATA(pnd)->power_mode = NORMAL; // PN532 should now be awake
+  pn53x_set_power_mode(pnd, NORMAL); // PN532 should now be awake
   return NFC_SUCCESS;
 }
 
@@ -350,10 +368,10 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
     return pnd->last_error;
   }
 
-  uint8_t abtRxBuf[PN53x_ACK_FRAME__LEN];
+  DRIVER_DATA(pnd)->commands++;
 
   // Wait for the ACK frame
-  res = pn532_i2c_wait_rdyframe(pnd, abtRxBuf, sizeof(abtRxBuf), timeout);
+  res = pn532_i2c_wait_rdyframe(pnd, &DRIVER_DATA(pnd)->ack_latency, timeout);
   if (res < 0) {
     if (res == NFC_EOPABORTED) {
       // Send an ACK frame from host to abort the command.
@@ -363,7 +381,15 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
     return pnd->last_error;
   }
 
-  if (pn53x_check_ack_frame(pnd, abtRxBuf, res) == 0) {
+  // Status byte and ACK frame
+  uint8_t abtRxBuf[1 + PN53x_ACK_FRAME__LEN];
+  if ((res = i2c_read(DRIVER_DATA(pnd)->dev, abtRxBuf, sizeof(abtRxBuf))) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to read ACK frame");
+    pnd->last_error = NFC_EIO;
+    return pnd->last_error;
+  }
+
+  if (pn53x_check_ack_frame(pnd, abtRxBuf + 1, res - 1) == 0) {
     // The PN53x is running the sent command
   } else {
     return pnd->last_error;
@@ -372,38 +398,36 @@ pn532_i2c_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
 }
 
 /**
- * @brief Read data from the PN532 device until getting a frame with RDY bit set
+ * @brief Poll the PN532 status byte until it reports a ready frame
+ *
+ * Only the status byte is read while polling. The first poll comes shortly
+ * before the delay observed so far for this kind of frame, later polls back
+ * off up to PN532_RDY_LOOP_DELAY.
  *
  * @param pnd pointer on the NFC device.
- * @param pbtData buffer used to store the received frame data.
- * @param szDataLen allocated size of buffer.
+ * @param pui32Latency smoothed delay before this kind of frame (in µs), updated once the frame is ready.
  * @param timeout timeout delay before aborting the operation (in ms). Use 0 for no timeout.
- * @return length (in bytes) of the received frame, or NFC_ETIMEOUT if timeout delay has expired,
+ * @return NFC_SUCCESS when a frame is ready, or NFC_ETIMEOUT if timeout delay has expired,
  *         NFC_EOPABORTED if operation has been aborted, NFC_EIO in case of IO failure
  */
 static int
-pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+pn532_i2c_wait_rdyframe(nfc_device *pnd, uint32_t *pui32Latency, int timeout)
 {
-  bool done = false;
-  int res;
+  const uint64_t ui64Start = monotonic_time_us();
+  uint64_t ui64Delay = MAX(*pui32Latency / 8 * 7, PN532_RDY_POLL_MIN_DELAY);
+  uint64_t ui64Step = MAX(*pui32Latency / 16, PN532_RDY_POLL_MIN_DELAY);
+  bool bFirstPoll = true;
 
-  struct timeval start_tv, cur_tv;
-  long long duration;
-
-  // Actual I2C response frame includes an additional status byte,
-  // so we use a temporary buffer to read the I2C frame
-  uint8_t i2cRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN + 1];
-
-  if (timeout > 0) {
-    // If a timeout is specified, get current timestamp
-    gettimeofday(&start_tv, NULL);
-  }
-
-  do {
+  for (;;) {
     // Wait a little bit before reading
-    nanosleep(&rdyDelay, (struct timespec *) NULL);
+    const struct timespec delay = {
+      .tv_sec = ui64Delay / 1000000,
+      .tv_nsec = (ui64Delay % 1000000) * 1000
+    };
+    nanosleep(&delay, (struct timespec *) NULL);
 
-    int recCount = i2c_read(DRIVER_DATA(pnd)->dev, i2cRx, szDataLen + 1);
+    uint8_t rdy;
+    int recCount = i2c_read(DRIVER_DATA(pnd)->dev, &rdy, 1);
 
     if (DRIVER_DATA(pnd)->abort_flag) {
       // Reset abort flag
@@ -415,43 +439,40 @@ pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLe
     }
 
     if (recCount <= 0) {
-      done = true;
-      res = NFC_EIO;
-    } else {
-      const uint8_t rdy = i2cRx[0];
-      if (rdy & 1) {
-        int copyLength;
-
-        done = true;
-        res = recCount - 1;
-        copyLength = MIN(res, (int)szDataLen);
-        memcpy(pbtData, &(i2cRx[1]), copyLength);
-      } else {
-        /* Not ready yet. Check for elapsed timeout. */
-
-        if (timeout > 0) {
-          gettimeofday(&cur_tv, NULL);
-          duration = (cur_tv.tv_sec - start_tv.tv_sec) * 1000000L
-                     + (cur_tv.tv_usec - start_tv.tv_usec);
-
-          if (duration / 1000 > timeout) {
-            res = NFC_ETIMEOUT;
-            done = true;
-
-            log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
-                    "timeout reached with no READY frame.");
-          }
-        }
+      return NFC_EIO;
+    }
+
+    uint64_t ui64Elapsed = monotonic_time_us() - ui64Start;
+    if (rdy & 1) {
+      if (bFirstPoll) {
+        // The frame may have been ready much earlier, try sooner next time
+        ui64Elapsed /= 2;
       }
+      // Smooth the observed delay over the last commands
+      *pui32Latency = (uint32_t)((3 * (uint64_t) * pui32Latency + MIN(ui64Elapsed, UINT32_MAX)) / 4);
+      return NFC_SUCCESS;
     }
-  } while (!done);
+    bFirstPoll = false;
 
-  return res;
+    /* Not ready yet. Check for elapsed timeout. */
+    if ((timeout > 0) && (ui64Elapsed / 1000 > (uint64_t) timeout)) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG,
+              "timeout reached with no READY frame.");
+      return NFC_ETIMEOUT;
+    }
+    ui64Delay = ui64Step;
+    ui64Step = MIN(ui64Step * 2, PN532_RDY_LOOP_DELAY * 1000);
+  }
 }
 
 /**
  * @brief Read a response frame from the PN532 device.
  *
+ * Every I2C read returns the status byte, then the pending frame from its
+ * start. Once the status byte reports a frame, its header is read to learn
+ * the exact length, then the whole frame is read again in one transaction
+ * whose payload lands straight in \a pbtData.
+ *
  * @param pnd pointer on the NFC device.
  * @param pbtData buffer used to store the response frame data.
  * @param szDataLen allocated size of buffer.
@@ -462,18 +483,29 @@ pn532_i2c_wait_rdyframe(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLe
 static int
 pn532_i2c_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
-  uint8_t frameBuf[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
-  int frameLength;
+  // Status byte, then up to the extended frame header (00 00 ff ff ff LENm LENl LCS), TFI and PD0
+  uint8_t abtHeader[1 + 8 + 2];
+  uint8_t abtTrailer[2];
+  const uint8_t *frameBuf = abtHeader + 1;
   int TFI_idx;
   size_t len;
+  int res;
 
-  frameLength = pn532_i2c_wait_rdyframe(pnd, frameBuf, sizeof(frameBuf), timeout);
+  res = pn532_i2c_wait_rdyframe(pnd, &DRIVER_DATA(pnd)->response_latency, timeout);
 
-  if (NFC_EOPABORTED == pnd->last_error) {
-    return pn532_i2c_ack(pnd);
+  if (NFC_EOPABORTED == res) {
+    pn532_i2c_ack(pnd);
+    pnd->last_error = NFC_EOPABORTED;
+    goto error;
   }
 
-  if (frameLength < 0) {
+  if (res < 0) {
+    pnd->last_error = res;
+    goto error;
+  }
+
+  if ((res = i2c_read(DRIVER_DATA(pnd)->dev, abtHeader, 1 + 8)) < 0) {
+    pnd->last_error = NFC_EIO;
     goto error;
   }
 
@@ -515,12 +547,36 @@ pn532_i2c_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     TFI_idx = 5;
   }
 
+  if (len < 2) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Frame too short  (len: %" PRIuPTR ")", len);
+    pnd->last_error = NFC_EIO;
+    goto error;
+  }
+
   if ((len - 2) > szDataLen) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %" PRIuPTR ", len: %" PRIuPTR ")", szDataLen, len);
     pnd->last_error = NFC_EIO;
     goto error;
   }
 
+  // Now that the length is known, read the whole frame: header, payload to the caller buffer, DCS and postamble
+  const struct iovec iov[3] = {
+    { abtHeader, 1 + TFI_idx + 2 },
+    { pbtData, len - 2 },
+    { abtTrailer, sizeof(abtTrailer) },
+  };
+  if ((res = i2c_readv(DRIVER_DATA(pnd)->dev, iov, 3)) < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
+    pnd->last_error = NFC_EIO;
+    goto error;
+  }
+
+  if (!(abtHeader[0] & 1)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame vanished before it was read");
+    pnd->last_error = NFC_EIO;
+    goto error;
+  }
+
   uint8_t TFI = frameBuf[TFI_idx];
   if (TFI != 0xD5) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
@@ -535,12 +591,12 @@ pn532_i2c_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     goto error;
   }
 
-  uint8_t DCS = frameBuf[TFI_idx + len];
-  uint8_t btDCS = DCS;
+  uint8_t DCS = abtTrailer[0];
+  uint8_t btDCS = DCS + TFI + frameBuf[TFI_idx + 1];
 
   // Compute data checksum
-  for (size_t i = 0; i < len; i++) {
-    btDCS += frameBuf[TFI_idx + i];
+  for (size_t i = 0; i < len - 2; i++) {
+    btDCS += pbtData[i];
   }
 
   if (btDCS != 0) {
@@ -549,14 +605,12 @@ pn532_i2c_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     goto error;
   }
 
-  if (0x00 != frameBuf[TFI_idx + len + 1]) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Frame postamble mismatch  (got %d)", frameBuf[frameLength - 1]);
+  if (0x00 != abtTrailer[1]) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Frame postamble mismatch  (got %d)", abtTrailer[1]);
     pnd->last_error = NFC_EIO;
     goto error;
   }
 
-  memcpy(pbtData, &frameBuf[TFI_idx + 2], len - 2);
-
   /* The PN53x command is done and we successfully received the reply */
   return len - 2;
 error:
@@ -607,17 +661,23 @@ const struct nfc_driver pn532_i2c_driver = {
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_low_power  = pn53x_initiator_poll_target_low_power,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_felica       = pn53x_initiator_inventory_felica,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .device_calibrate_timer           = pn53x_calibrate_timer,
+  .sniff                            = pn53x_sniff,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
 
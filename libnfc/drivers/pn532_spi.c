@@ -75,6 +75,7 @@ const struct pn53x_io pn532_spi_io;
 struct pn532_spi_data {
   spi_port port;
   volatile bool abort_flag;
+  unsigned long commands;
 };
 
 static const uint8_t pn532_spi_cmd_dataread = 0x03;
@@ -148,9 +149,10 @@ pn532_spi_scan(const nfc_context *context, nfc_connstring connstrings[], const s
       // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
       CHIP_DATA(pnd)->type = PN532;
       // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
+      pn53x_set_power_mode(pnd, LOWVBAT);
 
       DRIVER_DATA(pnd)->abort_flag = false;
+      DRIVER_DATA(pnd)->commands = 0;
 
       // Check communication using "Diagnose" command, with "Communication test" (0x00)
       int res = pn53x_check_communication(pnd);
@@ -187,6 +189,14 @@ pn532_spi_close(nfc_device *pnd)
 {
   pn53x_idle(pnd);
 
+  if (DRIVER_DATA(pnd)->commands) {
+    struct spi_stats stats;
+    spi_get_stats(DRIVER_DATA(pnd)->port, &stats);
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "%lu SPI messages and %lu bus bytes per command (%lu commands)",
+            stats.messages / DRIVER_DATA(pnd)->commands, (stats.bytes_read + stats.bytes_written) / DRIVER_DATA(pnd)->commands,
+            DRIVER_DATA(pnd)->commands);
+  }
+
   // Release SPI port
   spi_close(DRIVER_DATA(pnd)->port);
 
@@ -263,13 +273,14 @@ pn532_spi_open(const nfc_context *context, const nfc_connstring connstring)
   // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
   CHIP_DATA(pnd)->type = PN532;
   // This device starts in LowVBat mode
-  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+  pn53x_set_power_mode(pnd, LOWVBAT);
 
   // empirical tuning
   CHIP_DATA(pnd)->timer_correction = 48;
   pnd->driver = &pn532_spi_driver;
 
   DRIVER_DATA(pnd)->abort_flag = false;
+  DRIVER_DATA(pnd)->commands = 0;
 
   // Check communication using "Diagnose" command, with "Communication test" (0x00)
   if (pn53x_check_communication(pnd) < 0) {
@@ -320,7 +331,7 @@ pn532_spi_wakeup(nfc_device *pnd)
 
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Got %x byte from SPI line before wakeup", spi_byte);
 
-  CHIP_DATA(pnd)->power_mode = NORMAL; // PN532 will be awake soon
+  pn53x_set_power_mode(pnd, NORMAL); // PN532 will be awake soon
   msleep(1);
 
   if (spi_byte == 0xff) {
@@ -345,7 +356,9 @@ pn532_spi_wait_for_data(nfc_device *pnd, int timeout)
   static const uint8_t pn532_spi_ready = 0x01;
   static const int pn532_spi_poll_interval = 10; //ms
 
-
+  // Poll 1 ms after the first status read, then back off to pn532_spi_poll_interval:
+  // ACKs come within a few ms, most responses within a few tens of ms
+  int interval = 1;
   int timer = 0;
 
   int ret;
@@ -360,21 +373,27 @@ pn532_spi_wait_for_data(nfc_device *pnd, int timeout)
     }
 
     if (timeout > 0) {
-      timer += pn532_spi_poll_interval;
+      timer += interval;
       if (timer > timeout) {
         return NFC_ETIMEOUT;
       }
-
-      msleep(pn532_spi_poll_interval);
     }
+
+    // Also without timeout, so that waiting does not flood the bus with status reads
+    msleep(interval);
+    interval = MIN(2 * interval, pn532_spi_poll_interval);
   }
 
   return NFC_SUCCESS;
 }
 
 
+/* Bytes read by the first DATAREAD of a response: the shortest PN53x frame, an error frame
+ * with short preamble (00 FF 01 FF 7F 81 00), is 7 bytes long so this never reads past the frame */
+#define PN532_SPI_HEADER_LEN 7
+
 static int
-pn532_spi_receive_next_chunk(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen)
+pn532_spi_receive_next_chunk(nfc_device *pnd, const struct spi_segment *pParts, const size_t szParts)
 {
   // According to datasheet, the entire read operation should be done at once
   // However, it seems impossible to do since the length of the frame is stored in the frame
@@ -404,23 +423,41 @@ pn532_spi_receive_next_chunk(nfc_device *pnd, uint8_t *pbtData, const size_t szD
 
   //  The response frame is 0x00 0xff 0x02 0xfe 0xd5 0x15 0x16 0x00
 
-
-  int res = spi_receive(DRIVER_DATA(pnd)->port, pbtData, 1, true);
-
-  if (res != NFC_SUCCESS) {
-    return res;
+  // Both reads of a chunk go in the same SPI message, with CS released after the single byte read.
+  // The chunk itself may be scattered over several buffers (pParts), received back to back.
+
+  struct spi_segment segments[SPI_MAX_SEGMENTS];
+  size_t szSegments = 0;
+
+  if ((szParts == 0) || (szParts + 2 > SPI_MAX_SEGMENTS))
+    return NFC_EINVARG;
+
+  const struct spi_segment first = { .pbtTx = NULL, .pbtRx = pParts[0].pbtRx, .szLen = 1, .cs_change = true };
+  const struct spi_segment dataread = { .pbtTx = &pn532_spi_cmd_dataread, .pbtRx = NULL, .szLen = 1, .cs_change = false };
+  segments[szSegments++] = first;
+  segments[szSegments++] = dataread;
+  for (size_t i = 0; i < szParts; i++) {
+    struct spi_segment part = { .pbtTx = NULL, .pbtRx = pParts[i].pbtRx, .szLen = pParts[i].szLen, .cs_change = false };
+    if (i == 0) {
+      // Its first byte has already been received
+      part.pbtRx++;
+      part.szLen--;
+    }
+    if (part.szLen)
+      segments[szSegments++] = part;
   }
 
-  res = spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_cmd_dataread, 1, pbtData + 1, szDataLen - 1, true);
-
-  return res;
+  return spi_transfer(DRIVER_DATA(pnd)->port, segments, szSegments, true);
 }
 
 static int
 pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
 {
-  uint8_t  abtRxBuf[5];
-  size_t len;
+  uint8_t  abtRxBuf[PN532_SPI_HEADER_LEN];
+  // Frame from LEN (normal frame) or from the extended frame marker to CC
+  uint8_t  abtHeader[7];
+  uint8_t  abtTrailer[2];
+  size_t   szHeader, szHave, len;
 
   pnd->last_error = pn532_spi_wait_for_data(pnd, timeout);
 
@@ -433,71 +470,61 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     goto error;
   }
 
-  pnd->last_error = spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_cmd_dataread, 1, abtRxBuf , 4, true);
+  pnd->last_error = spi_send_receive(DRIVER_DATA(pnd)->port, &pn532_spi_cmd_dataread, 1, abtRxBuf, sizeof(abtRxBuf), true);
 
   if (pnd->last_error < 0) {
     goto error;
   }
 
+  // Skip the preamble, which is sometimes shortened to 00 FF
   const uint8_t pn53x_long_preamble[3] = { 0x00, 0x00, 0xff };
-  if (0 == (memcmp(abtRxBuf, pn53x_long_preamble, 3))) {
-    // long preamble
-
-    // omit first byte
-    for (size_t i = 0; i < 3; ++i) {
-      abtRxBuf[i] = abtRxBuf[i + 1];
-    }
-
-    // need one more byte
-    pnd->last_error = pn532_spi_receive_next_chunk(pnd, abtRxBuf + 3, 1);
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive one more byte for long preamble frame. (RX)");
-      goto error;
-    }
-  }
-
-
   const uint8_t pn53x_preamble[2] = { 0x00, 0xff };
-  if (0 != (memcmp(abtRxBuf, pn53x_preamble, 2))) {
+  size_t szPreamble;
+  if (0 == (memcmp(abtRxBuf, pn53x_long_preamble, 3))) {
+    szPreamble = 3;
+  } else if (0 == (memcmp(abtRxBuf, pn53x_preamble, 2))) {
+    szPreamble = 2;
+  } else {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", " preamble+start code mismatch");
     pnd->last_error = NFC_EIO;
     goto error;
   }
+  szHave = sizeof(abtRxBuf) - szPreamble;
+  const uint8_t *pbtHave = abtRxBuf + szPreamble;
 
-  if ((0x01 == abtRxBuf[2]) && (0xff == abtRxBuf[3])) {
-    // Error frame
-    pn532_spi_receive_next_chunk(pnd, abtRxBuf, 3);
+  if ((0x01 == pbtHave[0]) && (0xff == pbtHave[1])) {
+    // Error frame: drain its remaining bytes
+    if (szHave < 5) {
+      uint8_t abtDrain[3];
+      const struct spi_segment drain = { .pbtTx = NULL, .pbtRx = abtDrain, .szLen = 5 - szHave, .cs_change = false };
+      pn532_spi_receive_next_chunk(pnd, &drain, 1);
+    }
 
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Application level error detected");
     pnd->last_error = NFC_EIO;
     goto error;
-  } else if ((0xff == abtRxBuf[2]) && (0xff == abtRxBuf[3])) {
-    // Extended frame
-    pnd->last_error = pn532_spi_receive_next_chunk(pnd, abtRxBuf, 3);
-
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      goto error;
-    }
-    // (abtRxBuf[0] << 8) + abtRxBuf[1] (LEN) include TFI + (CC+1)
-    len = (abtRxBuf[0] << 8) + abtRxBuf[1] - 2;
-    if (((abtRxBuf[0] + abtRxBuf[1] + abtRxBuf[2]) % 256) != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
-      pnd->last_error = NFC_EIO;
-      goto error;
-    }
+  } else if ((0xff == pbtHave[0]) && (0xff == pbtHave[1])) {
+    // Extended frame: FF FF LENm LENl LCS TFI CC, LCS is checked once received
+    szHeader = 7;
+    len = (size_t)(pbtHave[2] << 8) + pbtHave[3];
   } else {
-    // Normal frame
-    if (256 != (abtRxBuf[2] + abtRxBuf[3])) {
+    // Normal frame: LEN LCS TFI CC
+    if (256 != (pbtHave[0] + pbtHave[1])) {
       // TODO: Retry
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
       pnd->last_error = NFC_EIO;
       goto error;
     }
-
-    // abtRxBuf[3] (LEN) include TFI + (CC+1)
-    len = abtRxBuf[2] - 2;
+    szHeader = 4;
+    len = pbtHave[0];
+  }
+  // LEN includes TFI + (CC+1)
+  if (len < 2) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame too short");
+    pnd->last_error = NFC_EIO;
+    goto error;
   }
+  len -= 2;
 
   if (len > szDataLen) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to receive data: buffer too small. (szDataLen: %zu, len: %zu)", szDataLen, len);
@@ -505,40 +532,48 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     goto error;
   }
 
-  // TFI + PD0 (CC+1)
+  // The rest of the frame is header, data and trailer; scatter the bytes already
+  // received over them, then read everything left in a single chunk
+  struct spi_segment parts[3] = {
+    { .pbtTx = NULL, .pbtRx = abtHeader, .szLen = szHeader, .cs_change = false },
+    { .pbtTx = NULL, .pbtRx = pbtData, .szLen = len, .cs_change = false },
+    { .pbtTx = NULL, .pbtRx = abtTrailer, .szLen = sizeof(abtTrailer), .cs_change = false },
+  };
+  size_t szParts = 0;
+  for (size_t i = 0; i < 3; i++) {
+    const size_t szCopy = MIN(szHave, parts[i].szLen);
+    memcpy(parts[i].pbtRx, pbtHave, szCopy);
+    pbtHave += szCopy;
+    szHave -= szCopy;
+    parts[i].pbtRx += szCopy;
+    parts[i].szLen -= szCopy;
+    if (parts[i].szLen)
+      parts[szParts++] = parts[i];
+  }
 
-  pnd->last_error = pn532_spi_receive_next_chunk(pnd, abtRxBuf, 2);
+  pnd->last_error = pn532_spi_receive_next_chunk(pnd, parts, szParts);
 
   if (pnd->last_error != 0) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
     goto error;
   }
 
-  if (abtRxBuf[0] != 0xD5) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
+  if ((szHeader == 7) && (((abtHeader[2] + abtHeader[3] + abtHeader[4]) % 256) != 0)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Length checksum mismatch");
     pnd->last_error = NFC_EIO;
     goto error;
   }
 
-  if (abtRxBuf[1] != CHIP_DATA(pnd)->last_command + 1) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
+  // TFI + PD0 (CC+1)
+  if (abtHeader[szHeader - 2] != 0xD5) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "TFI Mismatch");
     pnd->last_error = NFC_EIO;
     goto error;
   }
 
-  if (len) {
-    pnd->last_error = pn532_spi_receive_next_chunk(pnd, pbtData, len);
-
-    if (pnd->last_error != 0) {
-      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
-      goto error;
-    }
-  }
-
-  pnd->last_error = pn532_spi_receive_next_chunk(pnd, abtRxBuf, 2);
-
-  if (pnd->last_error != 0) {
-    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to receive data. (RX)");
+  if (abtHeader[szHeader - 1] != CHIP_DATA(pnd)->last_command + 1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Command Code verification failed");
+    pnd->last_error = NFC_EIO;
     goto error;
   }
 
@@ -548,13 +583,13 @@ pn532_spi_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int
     btDCS -= pbtData[szPos];
   }
 
-  if (btDCS != abtRxBuf[0]) {
+  if (btDCS != abtTrailer[0]) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Data checksum mismatch");
     pnd->last_error = NFC_EIO;
     goto error;
   }
 
-  if (0x00 != abtRxBuf[1]) {
+  if (0x00 != abtTrailer[1]) {
     log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Frame postamble mismatch");
     pnd->last_error = NFC_EIO;
     goto error;
@@ -593,6 +628,8 @@ pn532_spi_send(nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int
       break;
   };
 
+  DRIVER_DATA(pnd)->commands++;
+
   uint8_t  abtFrame[PN532_BUFFER_LEN + 1] = { pn532_spi_cmd_datawrite, 0x00, 0x00, 0xff };       // SPI data transfer starts with DATAWRITE (0x01) byte,  Every packet must start with "00 00 ff"
   size_t szFrame = 0;
 
@@ -676,17 +713,23 @@ const struct nfc_driver pn532_spi_driver = {
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_low_power  = pn53x_initiator_poll_target_low_power,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_felica       = pn53x_initiator_inventory_felica,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .device_calibrate_timer           = pn53x_calibrate_timer,
+  .sniff                            = pn53x_sniff,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
 
@@ -133,11 +133,11 @@ pn532_uart_scan(const nfc_context *context, nfc_connstring connstrings[], const
       // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
       CHIP_DATA(pnd)->type = PN532;
       // This device starts in LowVBat power mode
-      CHIP_DATA(pnd)->power_mode = LOWVBAT;
+      pn53x_set_power_mode(pnd, LOWVBAT);
 
 #ifndef WIN32
-      // pipe-based abort mecanism
-      if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
+      // persistent abort mecanism
+      if (uart_abort_fd_open(DRIVER_DATA(pnd)->iAbortFds) < 0) {
         uart_close(DRIVER_DATA(pnd)->port);
         pn53x_data_free(pnd);
         nfc_device_free(pnd);
@@ -155,6 +155,9 @@ pn532_uart_scan(const nfc_context *context, nfc_connstring connstrings[], const
       // Check communication using "Diagnose" command, with "Communication test" (0x00)
       int res = pn53x_check_communication(pnd);
       uart_close(DRIVER_DATA(pnd)->port);
+#ifndef WIN32
+      uart_abort_fd_close(DRIVER_DATA(pnd)->iAbortFds);
+#endif
       pn53x_data_free(pnd);
       nfc_device_free(pnd);
       if (res < 0) {
@@ -192,8 +195,7 @@ pn532_uart_close(nfc_device *pnd)
 
 #ifndef WIN32
   // Release file descriptors used for abort mecanism
-  close(DRIVER_DATA(pnd)->iAbortFds[0]);
-  close(DRIVER_DATA(pnd)->iAbortFds[1]);
+  uart_abort_fd_close(DRIVER_DATA(pnd)->iAbortFds);
 #endif
 
   pn53x_data_free(pnd);
@@ -270,15 +272,15 @@ pn532_uart_open(const nfc_context *context, const nfc_connstring connstring)
   // SAMConfiguration command if needed to wakeup the chip and pn53x_SAMConfiguration check if the chip is a PN532
   CHIP_DATA(pnd)->type = PN532;
   // This device starts in LowVBat mode
-  CHIP_DATA(pnd)->power_mode = LOWVBAT;
+  pn53x_set_power_mode(pnd, LOWVBAT);
 
   // empirical tuning
   CHIP_DATA(pnd)->timer_correction = 48;
   pnd->driver = &pn532_uart_driver;
 
 #ifndef WIN32
-  // pipe-based abort mecanism
-  if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
+  // persistent abort mecanism
+  if (uart_abort_fd_open(DRIVER_DATA(pnd)->iAbortFds) < 0) {
     uart_close(DRIVER_DATA(pnd)->port);
     pn53x_data_free(pnd);
     nfc_device_free(pnd);
@@ -305,7 +307,7 @@ pn532_uart_wakeup(nfc_device *pnd)
   /* High Speed Unit (HSU) wake up consist to send 0x55 and wait a "long" delay for PN532 being wakeup. */
   const uint8_t pn532_wakeup_preamble[] = { 0x55, 0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
   int res = uart_send(DRIVER_DATA(pnd)->port, pn532_wakeup_preamble, sizeof(pn532_wakeup_preamble), 0);
-  CHIP_DATA(pnd)->power_mode = NORMAL; // PN532 should now be awake
+  pn53x_set_power_mode(pnd, NORMAL); // PN532 should now be awake
   return res;
 }
 
@@ -379,7 +381,7 @@ pn532_uart_receive(nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, in
   void *abort_p = NULL;
 
 #ifndef WIN32
-  abort_p = &(DRIVER_DATA(pnd)->iAbortFds[1]);
+  abort_p = &(DRIVER_DATA(pnd)->iAbortFds[0]);
 #else
   abort_p = (void *) & (DRIVER_DATA(pnd)->abort_flag);
 #endif
@@ -515,10 +517,7 @@ pn532_uart_abort_command(nfc_device *pnd)
 {
   if (pnd) {
 #ifndef WIN32
-    close(DRIVER_DATA(pnd)->iAbortFds[0]);
-    if (pipe(DRIVER_DATA(pnd)->iAbortFds) < 0) {
-      return NFC_ESOFT;
-    }
+    uart_abort_fd_signal(DRIVER_DATA(pnd)->iAbortFds);
 #else
     DRIVER_DATA(pnd)->abort_flag = true;
 #endif
@@ -543,17 +542,23 @@ const struct nfc_driver pn532_uart_driver = {
   .initiator_init_secure_element    = pn532_initiator_init_secure_element,
   .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
   .initiator_poll_target            = pn53x_initiator_poll_target,
+  .initiator_poll_target_low_power  = pn53x_initiator_poll_target_low_power,
+  .initiator_inventory_iso14443a    = pn53x_initiator_inventory_iso14443a,
+  .initiator_inventory_felica       = pn53x_initiator_inventory_felica,
   .initiator_select_dep_target      = pn53x_initiator_select_dep_target,
   .initiator_deselect_target        = pn53x_initiator_deselect_target,
   .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
   .initiator_transceive_bits        = pn53x_initiator_transceive_bits,
   .initiator_transceive_bytes_timed = pn53x_initiator_transceive_bytes_timed,
   .initiator_transceive_bits_timed  = pn53x_initiator_transceive_bits_timed,
+  .device_calibrate_timer           = pn53x_calibrate_timer,
+  .sniff                            = pn53x_sniff,
   .initiator_target_is_present      = pn53x_initiator_target_is_present,
 
   .target_init           = pn53x_target_init,
   .target_send_bytes     = pn53x_target_send_bytes,
   .target_receive_bytes  = pn53x_target_receive_bytes,
+  .target_send_receive_bytes = pn53x_target_send_receive_bytes,
   .target_send_bits      = pn53x_target_send_bits,
   .target_receive_bits   = pn53x_target_receive_bits,
 
@@ -0,0 +1,257 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file emulation-storage-bench.c
+ * @brief Emulated tag storage benchmark: in-place writes and session resets
+ *
+ * This program feeds a Type 4 Tag dispatcher with the APDUs of an initiator
+ * rewriting a NDEF message: SELECT of the application and of the NDEF file,
+ * NLEN cleared, the message written in UPDATE BINARY commands, then the new
+ * NLEN. No device is involved, the commands go straight to
+ * nfc_emulation_dispatch(). It measures UPDATE BINARY on a mapped file
+ * synced after each write, in batches, or when asked, then the reset of the
+ * tag between test sessions: the image reloaded wholesale from its file
+ * into a static array, as the emulators did, or a storage snapshot rolled
+ * back. The image file is created in the given directory (/tmp by default),
+ * whose file system weighs on the sync costs.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-emulation.h>
+#include "nfc-internal.h"
+#include "iso7816.h"
+
+#define BENCH_FILE_SIZE 0xFFFE
+#define BENCH_UPDATES 2000
+#define BENCH_SESSIONS 2000
+#define BENCH_CHUNK 200
+#define BENCH_CHUNKS 8
+
+static uint8_t abtImage[BENCH_FILE_SIZE];
+static uint8_t abtInitial[BENCH_FILE_SIZE];
+
+static struct nfc_emulation_file application = {
+  .name = { 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01 },
+  .name_len = 7,
+  .by_name = true,
+};
+
+static struct nfc_emulation_file ndef_file = {
+  .name = { 0xE1, 0x04 },
+  .name_len = 2,
+  .writable = true,
+};
+
+static struct nfc_emulation_dispatcher dispatcher;
+static struct nfc_emulation_state_machine state_machine = {
+  .io = nfc_emulation_dispatch,
+  .data = &dispatcher,
+};
+static struct nfc_emulator emulator = {
+  .state_machine = &state_machine,
+};
+
+static int
+apdu(const uint8_t *pbtApdu, const size_t szApdu)
+{
+  uint8_t abtRx[ISO7816_SHORT_R_APDU_MAX_LEN];
+  int res = nfc_emulation_dispatch(&emulator, pbtApdu, szApdu, abtRx, sizeof(abtRx));
+  return ((res == 2) && (abtRx[0] == 0x90) && (abtRx[1] == 0x00)) ? 0 : -1;
+}
+
+static int
+update_binary(const size_t szOffset, const uint8_t *pbtData, const size_t szLen)
+{
+  uint8_t abtApdu[5 + 255] = { 0x00, 0xD6, (uint8_t)(szOffset >> 8), (uint8_t) szOffset, (uint8_t) szLen };
+  memcpy(abtApdu + 5, pbtData, szLen);
+  return apdu(abtApdu, 5 + szLen);
+}
+
+static int
+select_ndef_file(void)
+{
+  const uint8_t abtSelectApp[] = { 0x00, 0xA4, 0x04, 0x00, 0x07, 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, 0x00 };
+  const uint8_t abtSelectNdef[] = { 0x00, 0xA4, 0x00, 0x0C, 0x02, 0xE1, 0x04 };
+  return ((apdu(abtSelectApp, sizeof(abtSelectApp)) < 0) || (apdu(abtSelectNdef, sizeof(abtSelectNdef)) < 0)) ? -1 : 0;
+}
+
+// An initiator writing a new message of BENCH_CHUNKS * BENCH_CHUNK bytes
+static int
+session(const unsigned int uiSession)
+{
+  const uint8_t abtNlen[] = { (BENCH_CHUNKS * BENCH_CHUNK) >> 8, (uint8_t)(BENCH_CHUNKS * BENCH_CHUNK) };
+  const uint8_t abtClear[] = { 0x00, 0x00 };
+  uint8_t abtChunk[BENCH_CHUNK];
+
+  if ((select_ndef_file() < 0) || (update_binary(0, abtClear, sizeof(abtClear)) < 0))
+    return -1;
+  for (size_t c = 0; c < BENCH_CHUNKS; c++) {
+    memset(abtChunk, (int)(uiSession + c), sizeof(abtChunk));
+    if (update_binary(2 + c * BENCH_CHUNK, abtChunk, sizeof(abtChunk)) < 0)
+      return -1;
+  }
+  return update_binary(0, abtNlen, sizeof(abtNlen));
+}
+
+static int
+setup(uint8_t *pbtContent, struct nfc_emulation_storage *storage)
+{
+  ndef_file.content = pbtContent;
+  ndef_file.size = BENCH_FILE_SIZE;
+  ndef_file.storage = storage;
+  nfc_emulation_dispatcher_init(&dispatcher);
+  if ((nfc_emulation_dispatcher_add_file(&dispatcher, &application) < 0) ||
+      (nfc_emulation_dispatcher_add_file(&dispatcher, &ndef_file) < 0) ||
+      (nfc_emulation_dispatcher_build(&dispatcher) < 0))
+    return -1;
+  return 0;
+}
+
+static void
+report(const char *pcWhat, const unsigned long ulCount, const uint64_t ui64Time, const size_t szSyncs)
+{
+  printf("  %-32s %9.2f us each %6lu syncs\n", pcWhat, (double) ui64Time / ulCount, (unsigned long) szSyncs);
+}
+
+static int
+bench_writes(const char *pcPath, const size_t szInterval, const char *pcWhat)
+{
+  struct nfc_emulation_storage storage;
+  uint8_t abtChunk[BENCH_CHUNK];
+
+  unlink(pcPath);
+  if ((nfc_emulation_storage_open(&storage, pcPath, abtInitial, BENCH_FILE_SIZE, szInterval) < 0) || (setup(storage.data, &storage) < 0) ||
+      (select_ndef_file() < 0))
+    return -1;
+  const uint64_t ui64Start = monotonic_time_us();
+  for (unsigned int n = 0; n < BENCH_UPDATES; n++) {
+    memset(abtChunk, (int) n, sizeof(abtChunk));
+    if (update_binary(2 + (n * BENCH_CHUNK) % (BENCH_FILE_SIZE - 2 - BENCH_CHUNK), abtChunk, sizeof(abtChunk)) < 0)
+      return -1;
+  }
+  if (nfc_emulation_storage_sync(&storage) < 0)
+    return -1;
+  report(pcWhat, BENCH_UPDATES, monotonic_time_us() - ui64Start, storage.syncs);
+  nfc_emulation_storage_close(&storage);
+  return 0;
+}
+
+static int
+bench_resets(const char *pcPath)
+{
+  struct nfc_emulation_storage storage;
+  FILE *pf;
+
+  // The image file read wholesale before each session
+  unlink(pcPath);
+  if (!(pf = fopen(pcPath, "wb")) || (fwrite(abtInitial, BENCH_FILE_SIZE, 1, pf) != 1) || fclose(pf))
+    return -1;
+  if (setup(abtImage, NULL) < 0)
+    return -1;
+  uint64_t ui64Start = monotonic_time_us();
+  for (unsigned int n = 0; n < BENCH_SESSIONS; n++) {
+    if (!(pf = fopen(pcPath, "rb")) || (fread(abtImage, BENCH_FILE_SIZE, 1, pf) != 1))
+      return -1;
+    fclose(pf);
+    if (session(n) < 0)
+      return -1;
+  }
+  uint64_t ui64Time = monotonic_time_us() - ui64Start;
+  report("session, image reloaded", BENCH_SESSIONS, ui64Time, 0);
+
+  // Sessions on a snapshot, rolled back after each one
+  unlink(pcPath);
+  if ((nfc_emulation_storage_open(&storage, pcPath, abtInitial, BENCH_FILE_SIZE, 1) < 0) || (setup(storage.data, &storage) < 0) ||
+      (nfc_emulation_storage_snapshot(&storage) < 0))
+    return -1;
+  ui64Start = monotonic_time_us();
+  for (unsigned int n = 0; n < BENCH_SESSIONS; n++) {
+    if ((session(n) < 0) || (nfc_emulation_storage_rollback(&storage) < 0))
+      return -1;
+  }
+  ui64Time = monotonic_time_us() - ui64Start;
+  report("session, snapshot rolled back", BENCH_SESSIONS, ui64Time, storage.syncs);
+  if (memcmp(storage.data, abtInitial, BENCH_FILE_SIZE)) {
+    fprintf(stderr, "Rolled back image differs from the snapshot\n");
+    return -1;
+  }
+
+  // The last session is kept
+  if ((session(BENCH_SESSIONS) < 0) || (nfc_emulation_storage_commit(&storage) < 0))
+    return -1;
+  memcpy(abtImage, storage.data, BENCH_FILE_SIZE);
+  nfc_emulation_storage_close(&storage);
+  if (!(pf = fopen(pcPath, "rb")) || (fread(abtInitial, BENCH_FILE_SIZE, 1, pf) != 1))
+    return -1;
+  fclose(pf);
+  if (memcmp(abtImage, abtInitial, BENCH_FILE_SIZE)) {
+    fprintf(stderr, "Committed session missing from the file\n");
+    return -1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char acPath[256];
+
+  if (argc > 2) {
+    fprintf(stderr, "Usage: %s [directory]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  snprintf(acPath, sizeof(acPath), "%s/nfc-emulation-storage-bench.%ld", (argc > 1) ? argv[1] : "/tmp", (long) getpid());
+  for (size_t n = 0; n < BENCH_FILE_SIZE; n++)
+    abtInitial[n] = (uint8_t)(n * 13);
+
+  printf("%d-byte NDEF file, %d-byte UPDATE BINARY\n", BENCH_FILE_SIZE, BENCH_CHUNK);
+  int res = 0;
+  if ((bench_writes(acPath, 1, "update, synced each write") < 0) ||
+      (bench_writes(acPath, 16, "update, synced every 16 writes") < 0) ||
+      (bench_writes(acPath, 0, "update, synced at the end") < 0)) {
+    res = -1;
+  } else {
+    printf("Test session: %d UPDATE BINARY, then the tag reset\n", BENCH_CHUNKS + 2);
+    res = bench_resets(acPath);
+  }
+  unlink(acPath);
+  if (res < 0) {
+    fprintf(stderr, "Benchmark failed\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,449 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file farm-bench.c
+ * @brief Reader farm benchmark against simulated devices
+ *
+ * This program is linked with the library objects and registers a driver
+ * ("sim") with many devices, each one holding a tag which echoes the frames
+ * it is sent. Every driver operation takes a fixed time, five times longer
+ * on the first devices; one device fails every exchange and another one has
+ * no tag in its field. A mix of read, write, verify and callback jobs is run
+ * once statically partitioned, job n on device n modulo the device count
+ * with one thread per device like as many copies of a tool would do, then
+ * through a farm, whose idle readers steal the jobs of the busy ones and
+ * which retries failed jobs on other readers.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-farm.h>
+#include "nfc-internal.h"
+
+#define SIM_DRIVER_NAME "sim"
+#define SIM_DEVICES 32
+#define SIM_SLOW_DEVICES 4
+#define SIM_SLOW_FACTOR 5
+#define SIM_BROKEN_DEVICE 9
+#define SIM_EMPTY_DEVICE 21
+#define FRAME_LEN 16
+
+struct sim_data {
+  unsigned int uiIndex;
+  bool     bSelected;
+};
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+
+static long lLatency = 100; // µs per operation
+
+static void
+sim_wait(nfc_device *pnd)
+{
+  long lDelay = lLatency * ((DRIVER_DATA(pnd)->uiIndex < SIM_SLOW_DEVICES) ? SIM_SLOW_FACTOR : 1);
+  if (lDelay > 0) {
+    struct timespec ts = { lDelay / 1000000, (lDelay % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+  }
+}
+
+static const struct nfc_driver sim_driver;
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  size_t n;
+  for (n = 0; (n < SIM_DEVICES) && (n < connstrings_len); n++)
+    snprintf(connstrings[n], sizeof(nfc_connstring), "%s:%lu", SIM_DRIVER_NAME, (unsigned long) n);
+  return n;
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd)
+    return NULL;
+  pnd->driver_data = calloc(1, sizeof(struct sim_data));
+  if (!pnd->driver_data) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  DRIVER_DATA(pnd)->uiIndex = (unsigned int) strtoul(connstring + strlen(SIM_DRIVER_NAME ":"), NULL, 10);
+  snprintf(pnd->name, sizeof(pnd->name), "simulated device %s", connstring);
+  pnd->driver = &sim_driver;
+  return pnd;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  nfc_device_free(pnd);
+}
+
+static int
+sim_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable)
+{
+  (void) pnd;
+  (void) property;
+  (void) bEnable;
+  return NFC_SUCCESS;
+}
+
+static int
+sim_initiator_init(nfc_device *pnd)
+{
+  sim_wait(pnd);
+  DRIVER_DATA(pnd)->bSelected = false;
+  return NFC_SUCCESS;
+}
+
+static int
+sim_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt)
+{
+  (void) pbtInitData;
+  (void) szInitData;
+
+  sim_wait(pnd);
+  if (DRIVER_DATA(pnd)->uiIndex == SIM_EMPTY_DEVICE)
+    return 0;
+  DRIVER_DATA(pnd)->bSelected = true;
+  if (pnt) {
+    memset(pnt, 0, sizeof(*pnt));
+    pnt->nm = nm;
+    pnt->nti.nai.abtAtqa[1] = 0x44;
+    pnt->nti.nai.szUidLen = 7;
+    memcpy(pnt->nti.nai.abtUid, "\x04\x10\x20\x30\x40\x50", 6);
+    pnt->nti.nai.abtUid[6] = (uint8_t) DRIVER_DATA(pnd)->uiIndex;
+  }
+  return 1;
+}
+
+static int
+sim_initiator_deselect_target(nfc_device *pnd)
+{
+  sim_wait(pnd);
+  DRIVER_DATA(pnd)->bSelected = false;
+  return NFC_SUCCESS;
+}
+
+static int
+sim_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  (void) timeout;
+
+  sim_wait(pnd);
+  if (!DRIVER_DATA(pnd)->bSelected || (DRIVER_DATA(pnd)->uiIndex == SIM_BROKEN_DEVICE))
+    return NFC_ERFTRANS;
+  if (szTx > szRx)
+    return NFC_EOVFLOW;
+  memcpy(pbtRx, pbtTx, szTx);
+  return (int) szTx;
+}
+
+static const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .initiator_init                   = sim_initiator_init,
+  .initiator_select_passive_target  = sim_initiator_select_passive_target,
+  .initiator_deselect_target        = sim_initiator_deselect_target,
+  .initiator_transceive_bytes       = sim_initiator_transceive_bytes,
+  .device_set_property_bool         = sim_set_property_bool,
+};
+
+static const nfc_modulation nmIso14443a = {
+  .nmt = NMT_ISO14443A,
+  .nbr = NBR_106,
+};
+
+struct bench_job {
+  struct nfc_farm_job job;
+  uint8_t  abtTx[FRAME_LEN];
+  uint8_t  abtRx[FRAME_LEN];
+};
+
+// Read then write back, as a tool updating a tag would do
+static int
+callback_update(nfc_device *pnd, const nfc_target *pnt, struct nfc_farm_job *job)
+{
+  (void) pnt;
+  int res;
+
+  if ((res = nfc_initiator_transceive_bytes(pnd, job->tx, job->tx_len, job->rx, job->rx_size, -1)) < 0)
+    return res;
+  if ((res = nfc_initiator_transceive_bytes(pnd, job->rx, (size_t) res, job->rx, job->rx_size, -1)) < 0)
+    return res;
+  job->rx_len = (size_t) res;
+  return NFC_SUCCESS;
+}
+
+static void
+jobs_prepare(struct bench_job *abj, const size_t szJobs)
+{
+  static const nfc_farm_job_type types[] = { NFC_FARM_READ, NFC_FARM_WRITE, NFC_FARM_VERIFY, NFC_FARM_CALLBACK };
+
+  for (size_t n = 0; n < szJobs; n++) {
+    struct bench_job *bj = &abj[n];
+    memset(bj, 0, sizeof(*bj));
+    memset(bj->abtTx, (int)(n & 0xff), sizeof(bj->abtTx));
+    bj->job.type = types[n % 4];
+    bj->job.nm = nmIso14443a;
+    bj->job.tx = bj->abtTx;
+    bj->job.tx_len = sizeof(bj->abtTx);
+    bj->job.rx = bj->abtRx;
+    bj->job.rx_size = sizeof(bj->abtRx);
+    bj->job.expected = bj->abtTx;
+    bj->job.expected_len = sizeof(bj->abtTx);
+    bj->job.callback = callback_update;
+  }
+}
+
+static void
+utilisation_print(const double adUtilisation[], const size_t szReaders)
+{
+  double dMin = 1, dMax = 0, dSum = 0;
+  for (size_t n = 0; n < szReaders; n++) {
+    dMin = MIN(dMin, adUtilisation[n]);
+    dMax = MAX(dMax, adUtilisation[n]);
+    dSum += adUtilisation[n];
+  }
+  printf("    reader utilisation: min %3.0f%%, avg %3.0f%%, max %3.0f%%\n", dMin * 100, dSum * 100 / szReaders, dMax * 100);
+}
+
+struct partition {
+  pthread_t thread;
+  nfc_context *context;
+  const char *connstring;
+  struct bench_job *abj;
+  size_t   szJobs;
+  size_t   szFirst;
+  size_t   szStep;
+  unsigned long ulDone;
+  unsigned long ulFailed;
+  uint64_t busy_us;
+};
+
+// One tool copy: it opens its device and runs its share of the jobs, once each
+static void *
+partition_run(void *arg)
+{
+  struct partition *p = arg;
+  nfc_device *pnd;
+
+  if (!(pnd = nfc_open(p->context, p->connstring)) || (nfc_initiator_init(pnd) < 0) ||
+      (nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, false) < 0)) {
+    for (size_t n = p->szFirst; n < p->szJobs; n += p->szStep)
+      p->ulFailed++;
+    if (pnd)
+      nfc_close(pnd);
+    return NULL;
+  }
+  for (size_t n = p->szFirst; n < p->szJobs; n += p->szStep) {
+    struct nfc_farm_job *job = &p->abj[n].job;
+    const uint64_t start = monotonic_time_us();
+    int res = nfc_initiator_select_passive_target(pnd, job->nm, NULL, 0, &job->target);
+    if (res > 0) {
+      if (job->type == NFC_FARM_CALLBACK) {
+        res = job->callback(pnd, &job->target, job);
+      } else if ((res = nfc_initiator_transceive_bytes(pnd, job->tx, job->tx_len, job->rx, job->rx_size, -1)) >= 0) {
+        res = ((job->type == NFC_FARM_VERIFY) && ((res != (int) job->expected_len) || memcmp(job->rx, job->expected, job->expected_len))) ? NFC_ESOFT : NFC_SUCCESS;
+      }
+      nfc_initiator_deselect_target(pnd);
+    } else if (res == 0) {
+      res = NFC_ENOTSUCHDEV;
+    }
+    if (res < 0) {
+      nfc_initiator_init(pnd);
+      p->ulFailed++;
+    } else {
+      p->ulDone++;
+    }
+    p->busy_us += monotonic_time_us() - start;
+  }
+  nfc_close(pnd);
+  return NULL;
+}
+
+static void
+bench_partition(nfc_context *context, nfc_connstring connstrings[], const size_t szReaders, struct bench_job *abj, const size_t szJobs)
+{
+  struct partition ap[SIM_DEVICES];
+  double adUtilisation[SIM_DEVICES];
+  unsigned long ulDone = 0, ulFailed = 0;
+
+  jobs_prepare(abj, szJobs);
+  const uint64_t start = monotonic_time_us();
+  for (size_t r = 0; r < szReaders; r++) {
+    memset(&ap[r], 0, sizeof(ap[r]));
+    ap[r].context = context;
+    ap[r].connstring = connstrings[r];
+    ap[r].abj = abj;
+    ap[r].szJobs = szJobs;
+    ap[r].szFirst = r;
+    ap[r].szStep = szReaders;
+    pthread_create(&ap[r].thread, NULL, partition_run, &ap[r]);
+  }
+  for (size_t r = 0; r < szReaders; r++) {
+    pthread_join(ap[r].thread, NULL);
+    ulDone += ap[r].ulDone;
+    ulFailed += ap[r].ulFailed;
+  }
+  const uint64_t elapsed = monotonic_time_us() - start;
+  for (size_t r = 0; r < szReaders; r++)
+    adUtilisation[r] = (double) ap[r].busy_us / elapsed;
+
+  printf("static partition: %4lu jobs done, %3lu failed, no retry, makespan %7.1f ms, %7.0f jobs/s\n",
+         ulDone, ulFailed, elapsed / 1e3, ulDone * 1e6 / elapsed);
+  utilisation_print(adUtilisation, szReaders);
+}
+
+static int
+bench_farm(nfc_context *context, nfc_connstring connstrings[], const size_t szReaders, struct bench_job *abj, const size_t szJobs, const bool bVerbose)
+{
+  struct nfc_farm_stats stats;
+  struct nfc_farm_reader_stats ars[SIM_DEVICES];
+  double adUtilisation[SIM_DEVICES];
+  unsigned long ulWrong = 0;
+  nfc_farm *farm;
+
+  jobs_prepare(abj, szJobs);
+  if (!(farm = nfc_farm_new(context, connstrings, szReaders))) {
+    fprintf(stderr, "Unable to create the farm\n");
+    return -1;
+  }
+  // The farm counts from its creation, devices opening included, as the partition does
+  for (size_t n = 0; n < szJobs; n++) {
+    if (nfc_farm_submit(farm, &abj[n].job) < 0) {
+      fprintf(stderr, "Unable to submit job %lu\n", (unsigned long) n);
+      nfc_farm_free(farm);
+      return -1;
+    }
+  }
+  nfc_farm_wait(farm);
+  nfc_farm_get_stats(farm, &stats, ars, SIM_DEVICES);
+  for (size_t n = 0; n < szJobs; n++) {
+    const struct nfc_farm_job *job = &abj[n].job;
+    if ((job->result == 0) && ((job->rx_len != FRAME_LEN) || memcmp(abj[n].abtRx, abj[n].abtTx, FRAME_LEN)))
+      ulWrong++;
+    if ((job->result == 0) && ((job->reader == SIM_BROKEN_DEVICE) || (job->reader == SIM_EMPTY_DEVICE)))
+      ulWrong++;
+  }
+  for (size_t r = 0; r < szReaders; r++)
+    adUtilisation[r] = ars[r].utilisation;
+
+  printf("reader farm:      %4lu jobs done, %3lu failed, %3lu retries, makespan %7.1f ms, %7.0f jobs/s\n",
+         (unsigned long) stats.jobs_done, (unsigned long) stats.jobs_failed, (unsigned long) stats.retries,
+         stats.elapsed_us / 1e3, stats.jobs_per_second);
+  utilisation_print(adUtilisation, szReaders);
+  if (bVerbose) {
+    for (size_t r = 0; r < szReaders; r++)
+      printf("    %-8s %4lu attempts, %3lu failures, %4lu steals, %3.0f%% busy\n", ars[r].connstring,
+             (unsigned long) ars[r].attempts, (unsigned long) ars[r].failures, (unsigned long) ars[r].steals, ars[r].utilisation * 100);
+  }
+  if (ulWrong)
+    printf("    wrong results: %lu\n", ulWrong);
+  nfc_farm_free(farm);
+  return ((stats.jobs_done + stats.jobs_failed != szJobs) || ulWrong) ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned long ulJobs = 2000;
+  bool bVerbose = false;
+  nfc_context *context;
+  nfc_connstring connstrings[SIM_DEVICES];
+  struct bench_job *abj;
+  int ch, res;
+
+  while ((ch = getopt(argc, argv, "n:l:v")) != -1) {
+    switch (ch) {
+      case 'n':
+        ulJobs = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        lLatency = strtol(optarg, NULL, 10);
+        break;
+      case 'v':
+        bVerbose = true;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n jobs] [-l operation latency in µs] [-v]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((lLatency < 0) || (lLatency > 999999) || (ulJobs == 0)) {
+    fprintf(stderr, "Invalid argument\n");
+    return EXIT_FAILURE;
+  }
+  if (!(abj = malloc(ulJobs * sizeof(*abj)))) {
+    fprintf(stderr, "Unable to allocate the jobs\n");
+    return EXIT_FAILURE;
+  }
+
+  // Registered before the first context: the simulated driver is the only one
+  nfc_register_driver(&sim_driver);
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    free(abj);
+    return EXIT_FAILURE;
+  }
+  if (nfc_list_devices(context, connstrings, SIM_DEVICES) != SIM_DEVICES) {
+    fprintf(stderr, "Unable to list the simulated devices\n");
+    nfc_exit(context);
+    free(abj);
+    return EXIT_FAILURE;
+  }
+
+  printf("%lu jobs (read, write, verify, read and write back) on %d devices, %ld us per driver operation\n",
+         ulJobs, SIM_DEVICES, lLatency);
+  printf("devices 0 to %d are %d times slower, device %d fails every exchange, device %d has no tag\n",
+         SIM_SLOW_DEVICES - 1, SIM_SLOW_FACTOR, SIM_BROKEN_DEVICE, SIM_EMPTY_DEVICE);
+  bench_partition(context, connstrings, SIM_DEVICES, abj, ulJobs);
+  res = bench_farm(context, connstrings, SIM_DEVICES, abj, ulJobs, bVerbose);
+
+  nfc_exit(context);
+  free(abj);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
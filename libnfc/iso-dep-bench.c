@@ -0,0 +1,745 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file iso-dep-bench.c
+ * @brief Host-side ISO14443-4 engine benchmark against a simulated Type 4 card
+ *
+ * This program is linked with the library objects and registers a driver
+ * ("sim") whose PN532 chip is simulated at the command level. Its field
+ * holds one ISO14443-4 card implementing RATS and the I-, R- and S-block
+ * rules of the PICC, optionally asking for waiting time extensions: valid
+ * ones, whose timeout must be restored afterwards, and invalid WTXM values
+ * 0 and above 59, which must end the exchange. With
+ * NP_EASY_FRAMING the simulated firmware does the block protocol itself with
+ * a FSD of 64 bytes (the PN532 sends RATS E0 50), and hands responses larger
+ * than its frame back in chained InDataExchange answers. Without it, every
+ * block goes through InCommunicateThru and nfc_initiator_iso_dep_*() runs
+ * the protocol. Every exchange with the chip costs a fixed time, every RF
+ * frame its air time at 106 kbps and every block the card processing time;
+ * a lost frame costs the chip RF timeout. The card checks each command and
+ * the benchmark checks each response.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "chips/pn53x-internal.h"
+
+#define SIM_DRIVER_NAME "sim"
+#define SIM_APDU_MAX 4096
+// RATS parameter of the PN532 firmware: FSD 64, CID 0
+#define SIM_FIRMWARE_RATS_PARAM 0x50
+// Data bytes of an InDataExchange answer, status byte excluded
+#define SIM_FIRMWARE_FRAME 262
+// Frame delay time, SOF and EOF
+#define SIM_FDT_US 90
+#define SIM_CARD_BLOCK_US 200
+#define SIM_CARD_APDU_US 1500
+
+static const size_t aszFrameSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+
+enum sim_card_state {
+  CARD_HALT,
+  CARD_ACTIVE,                // selected, waiting for RATS
+  CARD_PROTOCOL,              // ISO14443-4 activated
+};
+
+struct sim_card {
+  enum sim_card_state state;
+  uint8_t  ui8Fsci;
+  uint8_t  ui8Fwi;
+  size_t   szFsd;
+  uint8_t  btCid;
+  uint8_t  btBlockNumber;
+  uint8_t  abtWtxm[2];        // S(WTX) asked for before each response, in turn
+  size_t   szWtxm;
+  size_t   szWtxSent;
+  bool     bWtxPending;
+  uint8_t  ui8WtxTimeout;     // chip RF timeout when the last S(WTX) was answered
+  uint8_t  abtCmd[SIM_APDU_MAX];
+  size_t   szCmd;
+  uint8_t  abtResp[SIM_APDU_MAX];
+  size_t   szResp;
+  size_t   szRespSent;
+  bool     bRespChaining;
+  uint8_t  abtLast[256];      // last block sent, for retransmissions
+  size_t   szLast;
+  unsigned long ulLoss;       // every ulLoss-th frame is lost, 0 for none
+  unsigned long ulReceived;
+};
+
+struct sim_data {
+  uint8_t  abtRegs[256];      // CIU registers, 0x6300 to 0x63ff
+  uint8_t  ui8RetryTimeout;   // RFConfiguration timing, non-DEP communications
+  uint8_t  ui8Parameters;     // SetParameters flags
+  uint8_t  abtResponse[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t   szResponse;
+  struct sim_card card;
+  uint8_t  btFwBlockNumber;   // firmware side ISO14443-4 state
+  size_t   szFwFsc;
+  uint8_t  abtFw[SIM_APDU_MAX];
+  size_t   szFw;
+  size_t   szFwSent;
+  unsigned long ulFrames;     // RF round trips
+  uint64_t ui64Time;          // simulated time, in µs
+};
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+#define REG(sd, reg) ((sd)->abtRegs[(reg) & 0xff])
+
+static long lLatency = 1000; // µs per exchange with the chip
+static uint8_t ui8WtxmAll = 0; // WTX before each response, whatever the mode
+
+static uint64_t
+sim_air_us(const size_t szFrame)
+{
+  // 9 bits per byte with the parity, CRC included
+  return SIM_FDT_US + (szFrame + 2) * 9 * 1000000 / 105938;
+}
+
+// Command of the benchmark: response length, then a pattern the card checks
+static void
+apdu_command(uint8_t *pbtCmd, const size_t szCmd, const size_t szResp)
+{
+  pbtCmd[0] = (uint8_t)(szResp >> 8);
+  pbtCmd[1] = (uint8_t) szResp;
+  for (size_t n = 2; n < szCmd; n++)
+    pbtCmd[n] = (uint8_t)(n ^ 0x5a);
+}
+
+static size_t
+apdu_response(const uint8_t *pbtCmd, const size_t szCmd, uint8_t *pbtResp)
+{
+  size_t szResp = 0;
+  bool bValid = (szCmd >= 2);
+  for (size_t n = 2; bValid && (n < szCmd); n++)
+    bValid = (pbtCmd[n] == (uint8_t)(n ^ 0x5a));
+  if (bValid) {
+    szResp = MIN(((size_t) pbtCmd[0] << 8) | pbtCmd[1], SIM_APDU_MAX - 2);
+    for (size_t n = 0; n < szResp; n++)
+      pbtResp[n] = (uint8_t)(n * 7 + szCmd);
+    pbtResp[szResp++] = 0x90;
+    pbtResp[szResp++] = 0x00;
+  } else {
+    pbtResp[szResp++] = 0x6a;
+    pbtResp[szResp++] = 0x80;
+  }
+  return szResp;
+}
+
+static size_t
+card_prologue(const struct sim_card *pc, const uint8_t btPcb, const bool bCid, uint8_t *pbtOut)
+{
+  pbtOut[0] = btPcb | (bCid ? 0x08 : 0x00);
+  if (bCid)
+    pbtOut[1] = pc->btCid;
+  return bCid ? 2 : 1;
+}
+
+static size_t
+card_wtx(struct sim_card *pc, const bool bCid, uint8_t *pbtOut)
+{
+  size_t szOut = card_prologue(pc, 0xf2, bCid, pbtOut);
+  pbtOut[szOut++] = pc->abtWtxm[pc->szWtxSent++];
+  pc->bWtxPending = true;
+  return szOut;
+}
+
+// Next block of the response, from szRespSent
+static size_t
+card_response_block(struct sim_card *pc, const bool bCid, uint8_t *pbtOut)
+{
+  size_t szOut = card_prologue(pc, 0x02 | pc->btBlockNumber, bCid, pbtOut);
+  const size_t szMax = pc->szFsd - szOut - 2;
+  const size_t szChunk = MIN(szMax, pc->szResp - pc->szRespSent);
+
+  memcpy(pbtOut + szOut, pc->abtResp + pc->szRespSent, szChunk);
+  pc->szRespSent += szChunk;
+  pc->bRespChaining = (pc->szRespSent < pc->szResp);
+  if (pc->bRespChaining)
+    pbtOut[0] |= 0x10;
+  return szOut + szChunk;
+}
+
+/*
+ * The card: a frame from the reader, CRC removed by the chip, and its answer.
+ * Returns false when the card does not answer.
+ */
+static bool
+card_frame(struct sim_data *sd, const uint8_t *pbtIn, const size_t szIn, uint8_t *pbtOut, size_t *pszOut, const bool bLossy)
+{
+  struct sim_card *pc = &sd->card;
+  size_t szOut = 0;
+
+  sd->ulFrames++;
+  sd->ui64Time += sim_air_us(szIn);
+  if ((szIn == 0) || (pc->state == CARD_HALT))
+    return false;
+  // Lost frames are in turn commands and answers
+  const bool bLost = bLossy && pc->ulLoss && ((++pc->ulReceived % pc->ulLoss) == 0);
+  const bool bAnswerLost = bLost && ((pc->ulReceived / pc->ulLoss) % 2 == 0);
+  if (bLost && !bAnswerLost)
+    return false;
+  sd->ui64Time += SIM_CARD_BLOCK_US;
+
+  if (pc->state == CARD_ACTIVE) {
+    if ((szIn != 2) || (pbtIn[0] != 0xe0))
+      return false;
+    // RATS: FSD and CID, then the ATS with TA, TB and TC
+    pc->szFsd = aszFrameSizes[MIN(pbtIn[1] >> 4, 8)];
+    pc->btCid = pbtIn[1] & 0x0f;
+    pbtOut[szOut++] = 0x05;
+    pbtOut[szOut++] = 0x70 | pc->ui8Fsci;
+    pbtOut[szOut++] = 0x00;
+    pbtOut[szOut++] = (uint8_t)(pc->ui8Fwi << 4);
+    pbtOut[szOut++] = 0x02;
+    pc->state = CARD_PROTOCOL;
+    pc->btBlockNumber = 1;
+    pc->szCmd = 0;
+  } else {
+    const uint8_t btPcb = pbtIn[0];
+    const bool bCid = btPcb & 0x08;
+    size_t szPrologue = 1;
+    if (bCid) {
+      if ((szIn < 2) || ((pbtIn[1] & 0x0f) != pc->btCid))
+        return false;
+      szPrologue++;
+    } else if (pc->btCid) {
+      return false;
+    }
+    switch (btPcb & 0xe6) {
+      case 0x02: // I-block
+        pc->btBlockNumber ^= 1;
+        if (pc->szCmd + szIn - szPrologue > SIM_APDU_MAX)
+          return false;
+        memcpy(pc->abtCmd + pc->szCmd, pbtIn + szPrologue, szIn - szPrologue);
+        pc->szCmd += szIn - szPrologue;
+        if (btPcb & 0x10) {
+          szOut = card_prologue(pc, 0xa2 | pc->btBlockNumber, bCid, pbtOut);
+          break;
+        }
+        sd->ui64Time += SIM_CARD_APDU_US;
+        pc->szResp = apdu_response(pc->abtCmd, pc->szCmd, pc->abtResp);
+        pc->szRespSent = 0;
+        pc->szCmd = 0;
+        pc->szWtxSent = 0;
+        if (pc->szWtxm) {
+          szOut = card_wtx(pc, bCid, pbtOut);
+          break;
+        }
+        szOut = card_response_block(pc, bCid, pbtOut);
+        break;
+      case 0xa2: // R-block
+        if ((btPcb & 0x01) == pc->btBlockNumber) {
+          // Retransmission of the last block
+          memcpy(pbtOut, pc->abtLast, pc->szLast);
+          szOut = pc->szLast;
+        } else if (btPcb & 0x10) {
+          // R(NAK) for a block not received
+          szOut = card_prologue(pc, 0xa2 | pc->btBlockNumber, bCid, pbtOut);
+        } else if (pc->bRespChaining) {
+          pc->btBlockNumber ^= 1;
+          szOut = card_response_block(pc, bCid, pbtOut);
+        } else {
+          return false;
+        }
+        break;
+      case 0xc2: // S(DESELECT)
+        szOut = card_prologue(pc, 0xc2, bCid, pbtOut);
+        pc->state = CARD_HALT;
+        break;
+      case 0xe2: // S(WTX) response, the WTXM asked for
+        if (!pc->bWtxPending || (szIn != szPrologue + 1) || (pbtIn[szPrologue] != pc->abtWtxm[pc->szWtxSent - 1]))
+          return false;
+        pc->bWtxPending = false;
+        pc->ui8WtxTimeout = sd->ui8RetryTimeout;
+        if (pc->szWtxSent < pc->szWtxm)
+          szOut = card_wtx(pc, bCid, pbtOut);
+        else
+          szOut = card_response_block(pc, bCid, pbtOut);
+        break;
+      default:
+        return false;
+    }
+    memcpy(pc->abtLast, pbtOut, szOut);
+    pc->szLast = szOut;
+  }
+  if (bAnswerLost)
+    return false;
+  sd->ui64Time += sim_air_us(szOut);
+  *pszOut = szOut;
+  return true;
+}
+
+/*
+ * The PN532 firmware side of InDataExchange: chained I-blocks, S(WTX)
+ * answers and R(ACK) for the chained response, without error recovery.
+ */
+static uint8_t
+firmware_exchange(struct sim_data *sd, const uint8_t *pbtCmd, const size_t szCmd)
+{
+  uint8_t abtBlock[256], abtAnswer[256];
+  size_t  szAnswer, szUsed = 0;
+  const size_t szMaxInf = sd->szFwFsc - 3;
+
+  sd->szFw = sd->szFwSent = 0;
+  do {
+    const size_t szChunk = MIN(szMaxInf, szCmd - szUsed);
+    const bool bChaining = (szUsed + szChunk < szCmd);
+    abtBlock[0] = 0x02 | sd->btFwBlockNumber | (bChaining ? 0x10 : 0x00);
+    memcpy(abtBlock + 1, pbtCmd + szUsed, szChunk);
+    szUsed += szChunk;
+    if (!card_frame(sd, abtBlock, 1 + szChunk, abtAnswer, &szAnswer, false))
+      return ETIMEOUT;
+    if (bChaining) {
+      if ((abtAnswer[0] & 0xf7) != (0xa2 | sd->btFwBlockNumber))
+        return ERFPROTO;
+      sd->btFwBlockNumber ^= 1;
+    }
+  } while (szUsed < szCmd);
+  while (true) {
+    while ((abtAnswer[0] & 0xf7) == 0xf2) {
+      abtBlock[0] = 0xf2;
+      abtBlock[1] = abtAnswer[1];
+      if (!card_frame(sd, abtBlock, 2, abtAnswer, &szAnswer, false))
+        return ETIMEOUT;
+    }
+    if ((abtAnswer[0] & 0xe6) != 0x02)
+      return ERFPROTO;
+    sd->btFwBlockNumber ^= 1;
+    if (sd->szFw + szAnswer - 1 > sizeof(sd->abtFw))
+      return EOVCURRENT;
+    memcpy(sd->abtFw + sd->szFw, abtAnswer + 1, szAnswer - 1);
+    sd->szFw += szAnswer - 1;
+    if (!(abtAnswer[0] & 0x10))
+      return 0;
+    abtBlock[0] = 0xa2 | sd->btFwBlockNumber;
+    if (!card_frame(sd, abtBlock, 1, abtAnswer, &szAnswer, false))
+      return ETIMEOUT;
+  }
+}
+
+static void
+firmware_answer(struct sim_data *sd, const uint8_t btStatus)
+{
+  const size_t szChunk = btStatus ? 0 : MIN(SIM_FIRMWARE_FRAME, sd->szFw - sd->szFwSent);
+  sd->abtResponse[0] = btStatus;
+  memcpy(sd->abtResponse + 1, sd->abtFw + sd->szFwSent, szChunk);
+  sd->szFwSent += szChunk;
+  if (sd->szFwSent < sd->szFw)
+    sd->abtResponse[0] |= 0x40;
+  sd->szResponse = 1 + szChunk;
+}
+
+static void
+sim_in_list_passive_target(struct sim_data *sd)
+{
+  struct sim_card *pc = &sd->card;
+  static const uint8_t abtUid[] = { 0x08, 0x12, 0x34, 0x56 };
+  uint8_t abtAts[8];
+  size_t  szAts = 0;
+
+  sd->ulFrames += 4; // REQA, ANTICOLLISION, SELECT and their answers
+  sd->ui64Time += 4 * sim_air_us(4);
+  pc->state = CARD_ACTIVE;
+  pc->bWtxPending = false;
+  pc->szWtxSent = 0;
+  sd->abtResponse[0] = 1;
+  sd->abtResponse[1] = 1;
+  sd->abtResponse[2] = 0x00;
+  sd->abtResponse[3] = 0x04;
+  sd->abtResponse[4] = 0x20;
+  sd->abtResponse[5] = sizeof(abtUid);
+  memcpy(sd->abtResponse + 6, abtUid, sizeof(abtUid));
+  sd->szResponse = 6 + sizeof(abtUid);
+  if (sd->ui8Parameters & PARAM_AUTO_RATS) {
+    const uint8_t abtRats[] = { 0xe0, SIM_FIRMWARE_RATS_PARAM };
+    if (card_frame(sd, abtRats, sizeof(abtRats), abtAts, &szAts, false)) {
+      memcpy(sd->abtResponse + sd->szResponse, abtAts, szAts);
+      sd->szResponse += szAts;
+      sd->szFwFsc = aszFrameSizes[MIN(abtAts[1] & 0x0f, 8)];
+      sd->btFwBlockNumber = 0;
+    }
+  }
+}
+
+static int
+sim_send(struct nfc_device *pnd, const uint8_t *pbtData, const size_t szData, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  size_t  szAnswer;
+
+  sd->ui64Time += lLatency;
+  sd->szResponse = 0;
+  switch (pbtData[0]) {
+    case ReadRegister:
+      for (size_t n = 1; n + 1 < szData; n += 2)
+        sd->abtResponse[sd->szResponse++] = sd->abtRegs[pbtData[n + 1]];
+      break;
+    case WriteRegister:
+      for (size_t n = 1; n + 2 < szData; n += 3)
+        sd->abtRegs[pbtData[n + 1]] = pbtData[n + 2];
+      break;
+    case RFConfiguration:
+      if ((szData >= 5) && (pbtData[1] == RFCI_TIMING))
+        sd->ui8RetryTimeout = pbtData[4];
+      break;
+    case SetParameters:
+      sd->ui8Parameters = pbtData[1];
+      break;
+    case InListPassiveTarget:
+      sim_in_list_passive_target(sd);
+      break;
+    case InDeselect:
+    case InRelease:
+      sd->card.state = CARD_HALT;
+      sd->abtResponse[sd->szResponse++] = 0x00;
+      break;
+    case InDataExchange:
+      if (szData == 2) {
+        // Next frame of a chained answer
+        firmware_answer(sd, 0);
+      } else {
+        firmware_answer(sd, firmware_exchange(sd, pbtData + 2, szData - 2));
+      }
+      break;
+    case InCommunicateThru:
+      // The card only understands frames whose CRC is handled by the chip
+      if ((REG(sd, PN53X_REG_CIU_TxMode) & SYMBOL_TX_CRC_ENABLE) &&
+          card_frame(sd, pbtData + 1, szData - 1, sd->abtResponse + 1, &szAnswer, true)) {
+        sd->abtResponse[0] = 0x00;
+        sd->szResponse = 1 + szAnswer;
+      } else {
+        sd->ui64Time += (sd->ui8RetryTimeout ? (100 << (sd->ui8RetryTimeout - 1)) : 0);
+        sd->abtResponse[0] = ETIMEOUT;
+        sd->szResponse = 1;
+      }
+      break;
+    default:
+      // Other commands succeed without data
+      break;
+  }
+  return NFC_SUCCESS;
+}
+
+static int
+sim_receive(struct nfc_device *pnd, uint8_t *pbtData, const size_t szDataLen, int timeout)
+{
+  (void) timeout;
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  if (sd->szResponse > szDataLen)
+    return NFC_EOVFLOW;
+  memcpy(pbtData, sd->abtResponse, sd->szResponse);
+  return (int) sd->szResponse;
+}
+
+static const struct pn53x_io sim_io = {
+  .send    = sim_send,
+  .receive = sim_receive,
+};
+
+static const struct nfc_driver sim_driver;
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  if (connstrings_len == 0)
+    return 0;
+  snprintf(connstrings[0], sizeof(nfc_connstring), "%s:0", SIM_DRIVER_NAME);
+  return 1;
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd)
+    return NULL;
+  pnd->driver_data = calloc(1, sizeof(struct sim_data));
+  if (!pnd->driver_data || !pn53x_data_new(pnd, &sim_io)) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  CHIP_DATA(pnd)->type = PN532;
+  DRIVER_DATA(pnd)->ui8RetryTimeout = 0x0a;
+  snprintf(pnd->name, sizeof(pnd->name), "simulated PN532 %s", connstring);
+  pnd->driver = &sim_driver;
+  return pnd;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  pn53x_data_free(pnd);
+  nfc_device_free(pnd);
+}
+
+static const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .initiator_init                   = pn53x_initiator_init,
+  .initiator_select_passive_target  = pn53x_initiator_select_passive_target,
+  .initiator_deselect_target        = pn53x_initiator_deselect_target,
+  .initiator_transceive_bytes       = pn53x_initiator_transceive_bytes,
+  .device_set_property_bool         = pn53x_set_property_bool,
+  .device_set_property_int          = pn53x_set_property_int,
+};
+
+struct bench_mode {
+  const char *pcName;
+  bool     bFirmware;
+  nfc_iso_dep_params params;
+  unsigned long ulLoss;
+  uint8_t  ui8Wtxm;           // WTX before each response, 0 for none
+};
+
+#define BENCH_RUNS 20
+
+static int
+bench(nfc_device *pnd, const struct bench_mode *pmode, const size_t szCmd, const size_t szResp)
+{
+  static const nfc_modulation nmIso14443A = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  uint8_t abtCmd[SIM_APDU_MAX], abtRx[SIM_APDU_MAX], abtExpected[SIM_APDU_MAX];
+  nfc_target nt;
+  nfc_iso_dep_info info;
+  int     res;
+
+  // The firmware takes at most one extended frame of command
+  if (pmode->bFirmware && (szCmd > SIM_FIRMWARE_FRAME)) {
+    printf("%-40s %5lu %5lu            -\n", pmode->pcName, (unsigned long) szCmd, (unsigned long) szResp);
+    return 0;
+  }
+  sd->card.ulLoss = pmode->ulLoss;
+  sd->card.ulReceived = 0;
+  sd->card.abtWtxm[0] = pmode->ui8Wtxm ? pmode->ui8Wtxm : ui8WtxmAll;
+  sd->card.szWtxm = sd->card.abtWtxm[0] ? 1 : 0;
+  sd->card.ui8WtxTimeout = 0;
+  if (((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true)) < 0) ||
+      ((res = nfc_device_set_property_bool(pnd, NP_AUTO_ISO14443_4, pmode->bFirmware)) < 0) ||
+      ((res = nfc_initiator_select_passive_target(pnd, nmIso14443A, NULL, 0, &nt)) <= 0)) {
+    nfc_perror(pnd, "select");
+    return -1;
+  }
+  if (!pmode->bFirmware && ((res = nfc_initiator_iso_dep_activate(pnd, &nt, &pmode->params)) < 0)) {
+    nfc_perror(pnd, "nfc_initiator_iso_dep_activate");
+    return -1;
+  }
+
+  apdu_command(abtCmd, szCmd, szResp);
+  const size_t szExpected = apdu_response(abtCmd, szCmd, abtExpected);
+  const int iTimeout = CHIP_DATA(pnd)->timeout_communication;
+  const uint8_t ui8Timeout = sd->ui8RetryTimeout;
+  sd->ulFrames = 0;
+  sd->ui64Time = 0;
+  for (int n = 0; n < BENCH_RUNS; n++) {
+    if (pmode->bFirmware)
+      res = nfc_initiator_transceive_bytes(pnd, abtCmd, szCmd, abtRx, sizeof(abtRx), 0);
+    else
+      res = nfc_initiator_iso_dep_transceive(pnd, abtCmd, szCmd, abtRx, sizeof(abtRx));
+    if (res < 0) {
+      nfc_perror(pnd, "transceive");
+      return -1;
+    }
+    if (((size_t) res != szExpected) || memcmp(abtRx, abtExpected, szExpected)) {
+      fprintf(stderr, "%s: wrong response to APDU %d\n", pmode->pcName, n);
+      return -1;
+    }
+    // A waiting time extension lasts for one block only
+    if ((CHIP_DATA(pnd)->timeout_communication != iTimeout) || (sd->ui8RetryTimeout != ui8Timeout)) {
+      fprintf(stderr, "%s: timeout not restored after APDU %d\n", pmode->pcName, n);
+      return -1;
+    }
+  }
+  const double dMs = sd->ui64Time / 1000.0 / BENCH_RUNS;
+  printf("%-40s %5lu %5lu %9.2f ms %7.2f KiB/s %5.1f RF round trips",
+         pmode->pcName, (unsigned long) szCmd, (unsigned long) szResp, dMs,
+         (szCmd + szExpected) / 1.024 / dMs, (double) sd->ulFrames / BENCH_RUNS);
+  if (pmode->bFirmware) {
+    printf("\n");
+    return nfc_initiator_deselect_target(pnd) < 0 ? -1 : 0;
+  }
+  nfc_initiator_iso_dep_get_info(pnd, &info);
+  printf(" %4lu retransmissions %3lu WTX\n", info.retransmissions, info.wtx);
+  // Each S(WTX) is answered with the timeout extended WTXM times
+  if (sd->card.szWtxm && (((sd->card.abtWtxm[0] > 1) && (sd->card.ui8WtxTimeout <= ui8Timeout)) ||
+                          (!pmode->ulLoss && (info.wtx != BENCH_RUNS)))) {
+    fprintf(stderr, "%s: waiting time extensions not granted\n", pmode->pcName);
+    return -1;
+  }
+  // A card answering S(DESELECT) is halted: when the answer is lost, the retries are not answered
+  if (((res = nfc_initiator_iso_dep_deselect(pnd)) < 0) && !pmode->ulLoss) {
+    nfc_perror(pnd, "nfc_initiator_iso_dep_deselect");
+    return -1;
+  }
+  return 0;
+}
+
+// S(WTX) sequences before one response: WTXM 0 and above 59 must end the exchange
+static int
+bench_wtx(nfc_device *pnd, const uint8_t *pbtWtxm, const size_t szWtxm, const bool bValid)
+{
+  static const nfc_modulation nmIso14443A = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  const nfc_iso_dep_params params = { 8, -1, -1, 0 };
+  struct sim_data *sd = DRIVER_DATA(pnd);
+  uint8_t abtCmd[16], abtRx[SIM_APDU_MAX];
+  char acName[41];
+  nfc_target nt;
+  nfc_iso_dep_info info;
+  int     res;
+
+  sd->card.ulLoss = 0;
+  memcpy(sd->card.abtWtxm, pbtWtxm, szWtxm);
+  sd->card.szWtxm = szWtxm;
+  if (((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true)) < 0) ||
+      ((res = nfc_device_set_property_bool(pnd, NP_AUTO_ISO14443_4, false)) < 0) ||
+      ((res = nfc_initiator_select_passive_target(pnd, nmIso14443A, NULL, 0, &nt)) <= 0) ||
+      ((res = nfc_initiator_iso_dep_activate(pnd, &nt, &params)) < 0)) {
+    nfc_perror(pnd, "select");
+    return -1;
+  }
+  const int iTimeout = CHIP_DATA(pnd)->timeout_communication;
+  const uint8_t ui8Timeout = sd->ui8RetryTimeout;
+  apdu_command(abtCmd, sizeof(abtCmd), 16);
+  res = nfc_initiator_iso_dep_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx));
+  nfc_initiator_iso_dep_get_info(pnd, &info);
+  if (szWtxm > 1)
+    snprintf(acName, sizeof(acName), "host, FSD 256, WTXM %u then %u", pbtWtxm[0], pbtWtxm[1]);
+  else
+    snprintf(acName, sizeof(acName), "host, FSD 256, WTXM %u", pbtWtxm[0]);
+  printf("%-40s %s, %lu WTX, timeout %s\n", acName, (res >= 0) ? "answered" : "rejected", info.wtx,
+         (CHIP_DATA(pnd)->timeout_communication == iTimeout) && (sd->ui8RetryTimeout == ui8Timeout) ? "restored" : "NOT restored");
+  sd->card.szWtxm = 0;
+  if (((res >= 0) != bValid) || ((res < 0) && (res != NFC_EIO)) ||
+      (info.wtx != (bValid ? szWtxm : szWtxm - 1)) ||
+      (CHIP_DATA(pnd)->timeout_communication != iTimeout) || (sd->ui8RetryTimeout != ui8Timeout))
+    return -1;
+  return (nfc_initiator_deselect_target(pnd) < 0) ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  nfc_context *context;
+  nfc_connstring connstring;
+  nfc_device *pnd;
+  int opt;
+  long lFsci = 8;
+  int res = 0;
+
+  while ((opt = getopt(argc, argv, "l:c:w")) != -1) {
+    switch (opt) {
+      case 'l':
+        lLatency = strtol(optarg, NULL, 10);
+        break;
+      case 'c':
+        lFsci = strtol(optarg, NULL, 10);
+        break;
+      case 'w':
+        ui8WtxmAll = 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-l chip exchange latency in µs] [-c card FSCI] [-w]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((lLatency < 0) || (lLatency > 999999) || (lFsci < 0) || (lFsci > 8)) {
+    fprintf(stderr, "Invalid parameter\n");
+    return EXIT_FAILURE;
+  }
+
+  // Registered before the first context: the simulated driver is the only one
+  nfc_register_driver(&sim_driver);
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+  if ((nfc_list_devices(context, &connstring, 1) != 1) || ((pnd = nfc_open(context, connstring)) == NULL)) {
+    fprintf(stderr, "Unable to open the simulated device\n");
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+  if (nfc_initiator_init(pnd) < 0) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+  DRIVER_DATA(pnd)->card.ui8Fsci = (uint8_t) lFsci;
+  DRIVER_DATA(pnd)->card.ui8Fwi = 4;
+
+  printf("%ld us per exchange with the chip, card FSC %lu%s, %d APDUs per line\n", lLatency,
+         (unsigned long) aszFrameSizes[lFsci], ui8WtxmAll ? ", WTX before each response" : "", BENCH_RUNS);
+  printf("%-40s %5s %5s\n", "", "cmd", "resp");
+  const struct bench_mode amodes[] = {
+    { "firmware, FSD 64", true, { 5, -1, -1, 0 }, 0 },
+    { "host, FSD 64", false, { 5, -1, -1, 0 }, 0 },
+    { "host, FSD 256", false, { 8, -1, -1, 0 }, 0 },
+    { "host, FSD 256, CID 1, 1 frame in 7 lost", false, { 8, 1, -1, 0 }, 7 },
+    { "host, FSD 256, WTXM 4", false, { 8, -1, -1, 0 }, 0, 4 },
+  };
+  const size_t aszApdus[][2] = { { 5, 16 }, { 5, 256 }, { 5, 1024 }, { 255, 2 }, { 1024, 2 } };
+  for (size_t a = 0; (a < sizeof(aszApdus) / sizeof(aszApdus[0])) && (res == 0); a++) {
+    for (size_t m = 0; (m < sizeof(amodes) / sizeof(amodes[0])) && (res == 0); m++)
+      res = bench(pnd, &amodes[m], aszApdus[a][0], aszApdus[a][1]);
+  }
+  const struct {
+    uint8_t abtWtxm[2];
+    size_t  szWtxm;
+    bool    bValid;
+  } awtx[] = {
+    { { 59 }, 1, true },
+    { { 4, 59 }, 2, true },
+    { { 0 }, 1, false },
+    { { 60 }, 1, false },
+    { { 4, 0 }, 2, false },
+    { { 4, 63 }, 2, false },
+  };
+  for (size_t n = 0; (n < sizeof(awtx) / sizeof(awtx[0])) && (res == 0); n++)
+    res = bench_wtx(pnd, awtx[n].abtWtxm, awtx[n].szWtxm, awtx[n].bValid);
+
+  nfc_close(pnd);
+  nfc_exit(context);
+  return (res == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,640 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/**
+ * @file iso-dep.c
+ * @brief Host-side ISO/IEC 14443-4 (ISO-DEP) engine
+ *
+ * With NP_EASY_FRAMING the chip firmware does the ISO14443-4 block framing,
+ * chaining and waiting time extensions, with its own frame sizes and no NAD.
+ * This engine does it on the host instead, over raw frames
+ * (nfc_initiator_transceive_bytes() without easy framing, the chip handling
+ * CRC and parity): RATS with the chosen FSD, I-, R- and S-blocks, chaining
+ * both ways, S(WTX) and the error recovery rules of ISO/IEC 14443-4 7.5.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <string.h>
+
+#ifndef _WIN32
+#  include <time.h>
+#  define msleep(x) do { \
+    struct timespec xsleep; \
+    xsleep.tv_sec = x / 1000; \
+    xsleep.tv_nsec = (x - xsleep.tv_sec * 1000) * 1000 * 1000; \
+    nanosleep(&xsleep, NULL); \
+  } while (0)
+#else
+#  include <windows.h>
+#  define msleep Sleep
+#endif
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+
+#include "log.h"
+
+#define LOG_CATEGORY "libnfc.iso-dep"
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+
+// Block types and PCB bits
+#define PCB_I          0x02
+#define PCB_R          0xa2
+#define PCB_S          0xc2
+#define PCB_TYPE_MASK  0xc0
+#define PCB_TYPE_I     0x00
+#define PCB_TYPE_R     0x80
+#define PCB_TYPE_S     0xc0
+#define PCB_CHAINING   0x10
+#define PCB_NAK        0x10
+#define PCB_CID        0x08
+#define PCB_NAD        0x04
+#define PCB_BN         0x01
+#define PCB_S_DESELECT 0x00
+#define PCB_S_WTX      0x30
+#define PCB_S_MASK     0x30
+#define WTXM_MASK      0x3f
+
+// Transmission errors recovered by R(NAK) or by sending a block again
+#define ISO_DEP_RETRIES 2
+// Activation frame waiting time: 65536 / fc
+#define ISO_DEP_FWT_ACTIVATION_MS 5
+// Host side guard on top of the chip RF timeout
+#define ISO_DEP_HOST_MARGIN_MS 1000
+
+static const size_t aszFrameSizes[] = { 16, 24, 32, 40, 48, 64, 96, 128, 256 };
+
+static size_t
+iso_dep_frame_size(const uint8_t ui8Index)
+{
+  return aszFrameSizes[(ui8Index > 8) ? 8 : ui8Index];
+}
+
+// (256 x 16 / fc) x 2^n, in µs
+static uint32_t
+iso_dep_time_us(const uint8_t ui8Exponent)
+{
+  return (uint32_t)((4096ULL << ui8Exponent) * 1000000 / 13560000);
+}
+
+// PCB, then CID and NAD when they are used
+static size_t
+iso_dep_prologue(const struct iso_dep_state *pid, uint8_t btPcb, uint8_t *pbt)
+{
+  size_t  sz = 1;
+
+  if (pid->info.cid_used) {
+    btPcb |= PCB_CID;
+    pbt[sz++] = pid->btCid;
+  }
+  if (pid->info.nad_used && ((btPcb & PCB_TYPE_MASK) == PCB_TYPE_I)) {
+    btPcb |= PCB_NAD;
+    pbt[sz++] = pid->btNad;
+  }
+  pbt[0] = btPcb;
+  return sz;
+}
+
+// Locates the information field of a block from the card
+static int
+iso_dep_parse(nfc_device *pnd, const uint8_t *pbtRx, const size_t szRx, size_t *pszPrologue)
+{
+  size_t  sz = 1;
+
+  if (szRx < 1) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Empty block");
+    return NFC_EIO;
+  }
+  if (pbtRx[0] & PCB_CID)
+    sz++;
+  if (((pbtRx[0] & PCB_TYPE_MASK) == PCB_TYPE_I) && (pbtRx[0] & PCB_NAD))
+    sz++;
+  if (szRx < sz) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Truncated block (PCB %02x)", pbtRx[0]);
+    return NFC_EIO;
+  }
+  if ((pbtRx[0] & PCB_CID) && ((pbtRx[1] & 0x0f) != pnd->iso_dep.btCid)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Block for CID %d", pbtRx[1] & 0x0f);
+    return NFC_EIO;
+  }
+  *pszPrologue = sz;
+  return NFC_SUCCESS;
+}
+
+static int
+iso_dep_protocol_error(nfc_device *pnd, const uint8_t btPcb)
+{
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unexpected block (PCB %02x)", btPcb);
+  pnd->last_error = NFC_EIO;
+  return pnd->last_error;
+}
+
+/*
+ * Sends a block and returns the answer of the card. S(WTX) requests are
+ * granted on the way: the chip waits FWT x WTXM for the next block only.
+ */
+static int
+iso_dep_exchange(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx)
+{
+  struct iso_dep_state *pid = &pnd->iso_dep;
+  uint8_t abtWtx[3];
+  size_t  szPrologue, szWtx;
+  int     res, iFwtMs = pid->iFwtMs;
+
+  pid->info.blocks_sent++;
+  res = nfc_initiator_transceive_bytes(pnd, pbtTx, szTx, pbtRx, szRx, iFwtMs + ISO_DEP_HOST_MARGIN_MS);
+  while ((res > 0) && ((pbtRx[0] & (PCB_TYPE_MASK | PCB_S_MASK)) == (PCB_TYPE_S | PCB_S_WTX))) {
+    int res2;
+    if (((res2 = iso_dep_parse(pnd, pbtRx, res, &szPrologue)) < 0) || ((size_t) res <= szPrologue)) {
+      res = (res2 < 0) ? res2 : iso_dep_protocol_error(pnd, pbtRx[0]);
+      break;
+    }
+    const uint8_t ui8Wtxm = pbtRx[szPrologue] & WTXM_MASK;
+    if ((ui8Wtxm == 0) || (ui8Wtxm > 59)) {
+      res = iso_dep_protocol_error(pnd, pbtRx[0]);
+      break;
+    }
+    pid->info.blocks_received++;
+    pid->info.wtx++;
+    iFwtMs = pid->iFwtMs * ui8Wtxm;
+    if ((res = nfc_device_set_property_int(pnd, NP_TIMEOUT_COM, iFwtMs)) < 0)
+      break;
+    szWtx = iso_dep_prologue(pid, PCB_S | PCB_S_WTX, abtWtx);
+    abtWtx[szWtx++] = ui8Wtxm;
+    pid->info.blocks_sent++;
+    res = nfc_initiator_transceive_bytes(pnd, abtWtx, szWtx, pbtRx, szRx, iFwtMs + ISO_DEP_HOST_MARGIN_MS);
+  }
+  if (iFwtMs != pid->iFwtMs) {
+    const int res2 = nfc_device_set_property_int(pnd, NP_TIMEOUT_COM, pid->iFwtMs);
+    if ((res >= 0) && (res2 < 0))
+      res = res2;
+  }
+  if (res > 0)
+    pid->info.blocks_received++;
+  return res;
+}
+
+// Transmission errors: no answer, CRC or framing error. Everything else ends the exchange
+static bool
+iso_dep_recoverable(const int res)
+{
+  return (res == NFC_ERFTRANS) || (res == NFC_ETIMEOUT);
+}
+
+// Keeps a received I-block for nfc_initiator_iso_dep_receive()
+static void
+iso_dep_store(struct iso_dep_state *pid, const uint8_t *pbtRx, const size_t szRx, const size_t szPrologue)
+{
+  pid->szInf = szRx - szPrologue;
+  memcpy(pid->abtInf, pbtRx + szPrologue, pid->szInf);
+  pid->bInfPending = true;
+  pid->bRxChaining = (pbtRx[0] & PCB_CHAINING) != 0;
+  pid->btBlockNumber ^= 1;
+}
+
+/*
+ * Sends an I-block. A chained block must be acknowledged by R(ACK), the
+ * last one is answered by the first I-block of the response.
+ */
+static int
+iso_dep_send_i_block(nfc_device *pnd, const uint8_t *pbtInf, const size_t szInf, const bool bChaining)
+{
+  struct iso_dep_state *pid = &pnd->iso_dep;
+  uint8_t abtI[ISO_DEP_FRAME_MAX], abtNak[2], abtRx[ISO_DEP_FRAME_MAX];
+  size_t  szI, szNak, szTx, szRx, szPrologue;
+  const uint8_t *pbtTx;
+  int     res, iAttempts = 0;
+
+  szI = iso_dep_prologue(pid, PCB_I | pid->btBlockNumber | (bChaining ? PCB_CHAINING : 0), abtI);
+  memcpy(abtI + szI, pbtInf, szInf);
+  szI += szInf;
+  szNak = iso_dep_prologue(pid, PCB_R | PCB_NAK | pid->btBlockNumber, abtNak);
+  pbtTx = abtI;
+  szTx = szI;
+
+  while (true) {
+    if ((res = iso_dep_exchange(pnd, pbtTx, szTx, abtRx, sizeof(abtRx))) < 0) {
+      if (!iso_dep_recoverable(res) || (++iAttempts > ISO_DEP_RETRIES))
+        return res;
+      // Rule 4: R(NAK), the card answers with its last block or with R(ACK) when our block was lost
+      pid->info.retransmissions++;
+      pbtTx = abtNak;
+      szTx = szNak;
+      continue;
+    }
+    szRx = (size_t) res;
+    if ((res = iso_dep_parse(pnd, abtRx, szRx, &szPrologue)) < 0)
+      return res;
+    const uint8_t btPcb = abtRx[0];
+    switch (btPcb & PCB_TYPE_MASK) {
+      case PCB_TYPE_I:
+        if (bChaining || ((btPcb & PCB_BN) != pid->btBlockNumber))
+          return iso_dep_protocol_error(pnd, btPcb);
+        iso_dep_store(pid, abtRx, szRx, szPrologue);
+        return NFC_SUCCESS;
+      case PCB_TYPE_R:
+        if (btPcb & PCB_NAK)
+          return iso_dep_protocol_error(pnd, btPcb);
+        if ((btPcb & PCB_BN) == pid->btBlockNumber) {
+          if (!bChaining)
+            return iso_dep_protocol_error(pnd, btPcb);
+          pid->btBlockNumber ^= 1;
+          return NFC_SUCCESS;
+        }
+        // Rule 6: the card did not get our block, send it again
+        if (++iAttempts > ISO_DEP_RETRIES) {
+          pnd->last_error = NFC_ERFTRANS;
+          return pnd->last_error;
+        }
+        pid->info.retransmissions++;
+        pbtTx = abtI;
+        szTx = szI;
+        continue;
+      default:
+        return iso_dep_protocol_error(pnd, btPcb);
+    }
+  }
+}
+
+// Asks the card for the next block of a chained response
+static int
+iso_dep_receive_i_block(nfc_device *pnd)
+{
+  struct iso_dep_state *pid = &pnd->iso_dep;
+  uint8_t abtAck[2], abtRx[ISO_DEP_FRAME_MAX];
+  size_t  szAck, szRx, szPrologue;
+  int     res, iAttempts = 0;
+
+  szAck = iso_dep_prologue(pid, PCB_R | pid->btBlockNumber, abtAck);
+  while (true) {
+    // Rule 5: on a transmission error the R(ACK) is sent again
+    if ((res = iso_dep_exchange(pnd, abtAck, szAck, abtRx, sizeof(abtRx))) < 0) {
+      if (!iso_dep_recoverable(res) || (++iAttempts > ISO_DEP_RETRIES))
+        return res;
+      pid->info.retransmissions++;
+      continue;
+    }
+    szRx = (size_t) res;
+    if ((res = iso_dep_parse(pnd, abtRx, szRx, &szPrologue)) < 0)
+      return res;
+    if (((abtRx[0] & PCB_TYPE_MASK) != PCB_TYPE_I) || ((abtRx[0] & PCB_BN) != pid->btBlockNumber))
+      return iso_dep_protocol_error(pnd, abtRx[0]);
+    iso_dep_store(pid, abtRx, szRx, szPrologue);
+    return NFC_SUCCESS;
+  }
+}
+
+static int
+iso_dep_check_active(nfc_device *pnd)
+{
+  if (!pnd->iso_dep.bActive) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "ISO14443-4 not activated by nfc_initiator_iso_dep_activate()");
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  return NFC_SUCCESS;
+}
+
+/** @ingroup initiator
+ * @brief Activate ISO14443-4 on the host side: send RATS and set up the engine of nfc_initiator_iso_dep_*()
+ * @return Returns 0 on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt selected ISO14443A target, its ATS is filled
+ * @param pparams \a nfc_iso_dep_params struct pointer, NULL for FSD 256 without CID nor NAD
+ *
+ * The target must have been selected with NP_AUTO_ISO14443_4 disabled, so the
+ * device did not send RATS itself. NP_EASY_FRAMING is disabled and CRC and
+ * parity are left to the device: the blocks go through
+ * nfc_initiator_transceive_bytes() as raw frames. The chip RF timeout
+ * (NP_TIMEOUT_COM) follows the frame waiting time given by the ATS.
+ */
+int
+nfc_initiator_iso_dep_activate(nfc_device *pnd, nfc_target *pnt, const nfc_iso_dep_params *pparams)
+{
+  static const nfc_iso_dep_params default_params = { .fsdi = 8, .cid = -1, .nad = -1, .block_size = 0 };
+  struct iso_dep_state *pid = &pnd->iso_dep;
+  const nfc_iso_dep_params *pp = pparams ? pparams : &default_params;
+  uint8_t abtRats[2], abtAts[ISO_DEP_FRAME_MAX];
+  uint8_t ui8Fsci = 2, ui8Fwi = 4, ui8Sfgi = 0, ui8Tc = 0x02;
+  size_t  szAts, szPos, szOverhead;
+  int     res;
+
+  if ((pnt->nm.nmt != NMT_ISO14443A) || (pp->fsdi > 8) || (pp->cid > 14) || (pp->nad > 0xff)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if (!(pnt->nti.nai.btSak & 0x20)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Target not compliant with ISO14443-4");
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  if (pnt->nti.nai.szAtsLen) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "ISO14443-4 already activated by the device, disable NP_AUTO_ISO14443_4");
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+
+  nfc_device_lock(pnd);
+  memset(pid, 0, sizeof(*pid));
+  if (((res = nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false)) < 0) ||
+      ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_CRC, true)) < 0) ||
+      ((res = nfc_device_set_property_bool(pnd, NP_HANDLE_PARITY, true)) < 0) ||
+      ((res = nfc_device_set_property_int(pnd, NP_TIMEOUT_COM, ISO_DEP_FWT_ACTIVATION_MS)) < 0))
+    goto out;
+
+  abtRats[0] = 0xe0;
+  abtRats[1] = (pp->fsdi << 4) | ((pp->cid >= 0) ? pp->cid : 0);
+  if ((res = nfc_initiator_transceive_bytes(pnd, abtRats, sizeof(abtRats), abtAts, sizeof(abtAts),
+                                            ISO_DEP_FWT_ACTIVATION_MS + ISO_DEP_HOST_MARGIN_MS)) < 0)
+    goto out;
+  // TL counts itself
+  szAts = (size_t) res;
+  if ((szAts < 1) || (abtAts[0] > szAts) || (abtAts[0] < 1)) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Invalid ATS");
+    res = pnd->last_error = NFC_EIO;
+    goto out;
+  }
+  szAts = abtAts[0];
+  if (szAts > 1) {
+    const uint8_t ui8T0 = abtAts[1];
+    ui8Fsci = ui8T0 & 0x0f;
+    szPos = 2;
+    if ((ui8T0 & 0x10) && (szPos < szAts))
+      szPos++; // TA: bit rates, left at 106 kbps
+    if ((ui8T0 & 0x20) && (szPos < szAts)) {
+      ui8Fwi = abtAts[szPos] >> 4;
+      ui8Sfgi = abtAts[szPos] & 0x0f;
+      szPos++;
+    }
+    if ((ui8T0 & 0x40) && (szPos < szAts))
+      ui8Tc = abtAts[szPos];
+  }
+  pnt->nti.nai.szAtsLen = szAts - 1;
+  memcpy(pnt->nti.nai.abtAts, abtAts + 1, szAts - 1);
+
+  // RFU values stand for the defaults
+  if (ui8Fwi == 15)
+    ui8Fwi = 4;
+  if (ui8Sfgi == 15)
+    ui8Sfgi = 0;
+  pid->info.fsd = iso_dep_frame_size(pp->fsdi);
+  pid->info.fsc = iso_dep_frame_size(ui8Fsci);
+  pid->info.fwt_us = iso_dep_time_us(ui8Fwi);
+  pid->info.sfgt_us = ui8Sfgi ? iso_dep_time_us(ui8Sfgi) : 0;
+  pid->info.cid_used = (pp->cid >= 0) && (ui8Tc & 0x02);
+  pid->info.nad_used = (pp->nad >= 0) && (ui8Tc & 0x01);
+  pid->btCid = (pp->cid >= 0) ? pp->cid : 0;
+  pid->btNad = (pp->nad >= 0) ? pp->nad : 0;
+  // FWT and its ΔFWT margin, ISO/IEC 14443-4 7.2
+  pid->iFwtMs = (int)((pid->info.fwt_us + pid->info.fwt_us / 16 + 999) / 1000);
+  // PCB, CID, NAD and CRC
+  szOverhead = 1 + (pid->info.cid_used ? 1 : 0) + (pid->info.nad_used ? 1 : 0) + 2;
+  pid->szTxInf = pid->info.fsc - szOverhead;
+  if (pp->block_size && (pp->block_size < pid->szTxInf))
+    pid->szTxInf = pp->block_size;
+  if ((res = nfc_device_set_property_int(pnd, NP_TIMEOUT_COM, pid->iFwtMs)) < 0)
+    goto out;
+
+  // The card listens again after the start-up frame guard time, up to 5 s:
+  // sleep it off, spinning only through the last millisecond
+  if (pid->info.sfgt_us) {
+    const uint64_t ui64End = monotonic_time_us() + pid->info.sfgt_us;
+    uint64_t ui64Now;
+    while ((ui64Now = monotonic_time_us()) + 1000 < ui64End) {
+      const unsigned int uiMs = (unsigned int)((ui64End - ui64Now) / 1000);
+      msleep(uiMs);
+    }
+    while (monotonic_time_us() < ui64End)
+      ;
+  }
+  pid->bActive = true;
+  res = NFC_SUCCESS;
+  log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "FSD %lu, FSC %lu, FWT %lu us, CID %s, NAD %s",
+          (unsigned long) pid->info.fsd, (unsigned long) pid->info.fsc, (unsigned long) pid->info.fwt_us,
+          pid->info.cid_used ? "yes" : "no", pid->info.nad_used ? "yes" : "no");
+out:
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief Send (part of) a command through the host-side ISO14443-4 engine
+ * @return Returns the number of bytes taken, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx bytes of the command
+ * @param szTx number of bytes
+ * @param bMore true when more bytes of the same command follow in a next call
+ *
+ * The command is split into chained I-blocks of the size given by the FSC of
+ * the card, or by \a block_size of nfc_iso_dep_params. When \a bMore is set,
+ * only full blocks are sent and the rest is kept for the next call: a caller
+ * can send a large command while it is still producing it. The call ending
+ * the command also gets the first block of the response, read it with
+ * nfc_initiator_iso_dep_receive().
+ */
+int
+nfc_initiator_iso_dep_send(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, const bool bMore)
+{
+  struct iso_dep_state *pid = &pnd->iso_dep;
+  size_t  szUsed = 0;
+  int     res;
+
+  nfc_device_lock(pnd);
+  if ((res = iso_dep_check_active(pnd)) < 0)
+    goto out;
+  if (pid->bInfPending || pid->bRxChaining) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Previous response not read");
+    res = pnd->last_error = NFC_EINVARG;
+    goto out;
+  }
+  while (true) {
+    const size_t szTake = MIN(pid->szTxInf - pid->szTx, szTx - szUsed);
+    memcpy(pid->abtTx + pid->szTx, pbtTx + szUsed, szTake);
+    pid->szTx += szTake;
+    szUsed += szTake;
+    if (szUsed < szTx) {
+      // A full block with more bytes behind it
+      if ((res = iso_dep_send_i_block(pnd, pid->abtTx, pid->szTx, true)) < 0)
+        goto out;
+      pid->szTx = 0;
+    } else {
+      if (!bMore) {
+        res = iso_dep_send_i_block(pnd, pid->abtTx, pid->szTx, false);
+        pid->szTx = 0;
+        if (res < 0)
+          goto out;
+      }
+      break;
+    }
+  }
+  res = (int) szTx;
+out:
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief Receive the next block of a response from the host-side ISO14443-4 engine
+ * @return Returns the number of bytes received, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pbtRx information field of the block
+ * @param szRx size of \a pbtRx, the largest block is FSD - 3 bytes
+ * @param[out] pbMore set when the card chains more blocks: call again to get them
+ *
+ * The card sends the next block of a chained response when it is asked for
+ * it by this call, so the caller can process a large response block by block.
+ */
+int
+nfc_initiator_iso_dep_receive(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, bool *pbMore)
+{
+  struct iso_dep_state *pid = &pnd->iso_dep;
+  int     res;
+
+  nfc_device_lock(pnd);
+  if ((res = iso_dep_check_active(pnd)) < 0)
+    goto out;
+  if (!pid->bInfPending) {
+    if (!pid->bRxChaining) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "No response to receive");
+      res = pnd->last_error = NFC_EINVARG;
+      goto out;
+    }
+    if ((res = iso_dep_receive_i_block(pnd)) < 0)
+      goto out;
+  }
+  if (pid->szInf > szRx) {
+    res = pnd->last_error = NFC_EOVFLOW;
+    goto out;
+  }
+  memcpy(pbtRx, pid->abtInf, pid->szInf);
+  pid->bInfPending = false;
+  *pbMore = pid->bRxChaining;
+  res = (int) pid->szInf;
+out:
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief Send a command and receive its whole response through the host-side ISO14443-4 engine
+ * @return Returns the number of bytes received, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx bytes of the command
+ * @param szTx number of bytes
+ * @param[out] pbtRx response
+ * @param szRx size of \a pbtRx
+ *
+ * A response larger than \a pbtRx is read to its end, then NFC_EOVFLOW is returned.
+ */
+int
+nfc_initiator_iso_dep_transceive(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx)
+{
+  struct iso_dep_state *pid = &pnd->iso_dep;
+  size_t  szUsed = 0;
+  bool    bMore = true, bOverflow = false;
+  int     res;
+
+  nfc_device_lock(pnd);
+  if ((res = nfc_initiator_iso_dep_send(pnd, pbtTx, szTx, false)) < 0)
+    goto out;
+  while (bMore) {
+    if (pid->bInfPending && (pid->szInf > szRx - szUsed)) {
+      bOverflow = true;
+      pid->bInfPending = false;
+      bMore = pid->bRxChaining;
+      if (bMore && ((res = iso_dep_receive_i_block(pnd)) < 0))
+        goto out;
+      continue;
+    }
+    if ((res = nfc_initiator_iso_dep_receive(pnd, pbtRx + szUsed, szRx - szUsed, &bMore)) < 0)
+      goto out;
+    szUsed += (size_t) res;
+  }
+  if (bOverflow) {
+    res = pnd->last_error = NFC_EOVFLOW;
+  } else {
+    res = (int) szUsed;
+  }
+out:
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief Deselect the card with S(DESELECT) and stop the host-side ISO14443-4 engine
+ * @return Returns 0 on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ */
+int
+nfc_initiator_iso_dep_deselect(nfc_device *pnd)
+{
+  struct iso_dep_state *pid = &pnd->iso_dep;
+  uint8_t abtDeselect[2], abtRx[ISO_DEP_FRAME_MAX];
+  size_t  szDeselect;
+  int     res, iAttempts = 0;
+
+  nfc_device_lock(pnd);
+  if ((res = iso_dep_check_active(pnd)) < 0)
+    goto out;
+  szDeselect = iso_dep_prologue(pid, PCB_S | PCB_S_DESELECT, abtDeselect);
+  while (((res = iso_dep_exchange(pnd, abtDeselect, szDeselect, abtRx, sizeof(abtRx))) < 0) &&
+         iso_dep_recoverable(res) && (++iAttempts <= ISO_DEP_RETRIES))
+    pid->info.retransmissions++;
+  if ((res > 0) && ((abtRx[0] & (PCB_TYPE_MASK | PCB_S_MASK)) != (PCB_TYPE_S | PCB_S_DESELECT)))
+    res = iso_dep_protocol_error(pnd, abtRx[0]);
+  pid->bActive = false;
+  pid->bInfPending = false;
+  pid->bRxChaining = false;
+  if (res > 0)
+    res = NFC_SUCCESS;
+out:
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup initiator
+ * @brief Get the parameters and counters of the host-side ISO14443-4 engine
+ * @return Returns 0 on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] pinfo \a nfc_iso_dep_info struct pointer which will be filled
+ */
+int
+nfc_initiator_iso_dep_get_info(nfc_device *pnd, nfc_iso_dep_info *pinfo)
+{
+  nfc_device_lock(pnd);
+  *pinfo = pnd->iso_dep.info;
+  nfc_device_unlock(pnd);
+  return NFC_SUCCESS;
+}
@@ -54,16 +54,41 @@ log_priority_to_str(const int priority)
 
 #include "log-internal.h"
 
+#include <pthread.h>
+
+// Logging state of a thread. The log level is the one of the context the
+// thread last worked on, so contexts with different levels used from
+// different threads do not override each other.
+struct log_thread_state {
+  bool     level_set;
+  uint32_t level;
+  bool     muted;
+};
+
+static pthread_once_t log_once = PTHREAD_ONCE_INIT;
+static pthread_key_t log_key;
+
+static void
+log_key_create(void)
+{
+  pthread_key_create(&log_key, free);
+}
+
+static struct log_thread_state *
+log_thread_state(void)
+{
+  pthread_once(&log_once, log_key_create);
+  struct log_thread_state *state = pthread_getspecific(log_key);
+  if (!state && (state = calloc(1, sizeof(*state)))) {
+    pthread_setspecific(log_key, state);
+  }
+  return state;
+}
+
 void
 log_init(const nfc_context *context)
 {
-#ifdef ENVVARS
-  char str[32];
-  sprintf(str, "%"PRIu32, context->log_level);
-  setenv("LIBNFC_LOG_LEVEL", str, 1);
-#else
-  (void)context;
-#endif
+  log_use_context(context);
 }
 
 void
@@ -71,29 +96,64 @@ log_exit(void)
 {
 }
 
+/**
+ * @brief Log at the level of \a context in the calling thread
+ *
+ * Called by every entry point working on a context or on one of its devices.
+ */
+void
+log_use_context(const nfc_context *context)
+{
+  struct log_thread_state *state = log_thread_state();
+  if (state) {
+    state->level = context->log_level;
+    state->level_set = true;
+  }
+}
+
+/**
+ * @brief Enable or disable logging for the calling thread only
+ */
+void
+log_mute(const bool bMute)
+{
+  struct log_thread_state *state = log_thread_state();
+  if (state)
+    state->muted = bMute;
+}
+
 void
 log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
 {
-  char *env_log_level = NULL;
+  const struct log_thread_state *state = log_thread_state();
+  uint32_t level;
+  if (state && state->level_set) {
+    level = state->level;
+  } else {
+    // No context used by this thread yet
+    char *env_log_level = NULL;
 #ifdef ENVVARS
-  env_log_level = getenv("LIBNFC_LOG_LEVEL");
+    env_log_level = getenv("LIBNFC_LOG_LEVEL");
 #endif
-  uint32_t log_level;
-  if (NULL == env_log_level) {
-    // LIBNFC_LOG_LEVEL is not set
+    if (NULL == env_log_level) {
+      // LIBNFC_LOG_LEVEL is not set
 #ifdef DEBUG
-    log_level = 3;
+      level = 3;
 #else
-    log_level = 1;
+      level = 1;
 #endif
-  } else {
-    log_level = atoi(env_log_level);
+    } else {
+      level = atoi(env_log_level);
+    }
   }
 
-  //  printf("log_level = %"PRIu32" group = %"PRIu8" priority = %"PRIu8"\n", log_level, group, priority);
-  if (log_level) { // If log is not disabled by log_level=none
-    if (((log_level & 0x00000003) >= priority) ||   // Global log level
-        (((log_level >> (group * 2)) & 0x00000003) >= priority)) { // Group log level
+  //  printf("log_level = %"PRIu32" group = %"PRIu8" priority = %"PRIu8"\n", level, group, priority);
+  if (level) { // If log is not disabled by log_level=none
+    if (((level & 0x00000003) >= priority) ||   // Global log level
+        (((level >> (group * 2)) & 0x00000003) >= priority)) { // Group log level
+
+      if (state && state->muted)
+        return;
 
       va_list va;
       va_start(va, format);
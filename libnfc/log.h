@@ -73,6 +73,8 @@ const char *log_priority_to_str(const int priority);
 
 void log_init(const nfc_context *context);
 void log_exit(void);
+void log_use_context(const nfc_context *context);
+void log_mute(const bool bMute);
 void log_put(const uint8_t group, const char *category, const uint8_t priority, const char *format, ...)
 #  if __has_attribute_format
 __attribute__((format(printf, 4, 5)))
@@ -82,6 +84,8 @@ __attribute__((format(printf, 4, 5)))
 // No logging
 #define log_init(nfc_context) ((void) 0)
 #define log_exit() ((void) 0)
+#define log_use_context(context) ((void) 0)
+#define log_mute(bMute) ((void) 0)
 #define log_put(group, category, priority, format, ...) do {} while (0)
 
 #endif // LOG
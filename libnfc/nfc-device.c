@@ -29,13 +29,16 @@
  * @brief Provide internal function to manipulate nfc_device type
  */
 
-#include <stdlib.h>
-#include <string.h>
-
 #ifdef HAVE_CONFIG_H
 #  include "config.h"
 #endif // HAVE_CONFIG_H
 
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#  include <time.h>
+#endif
+
 #include "nfc-internal.h"
 
 nfc_device *
@@ -63,6 +66,40 @@ nfc_device_new(const nfc_context *context, const nfc_connstring connstring)
   memcpy(res->connstring, connstring, sizeof(res->connstring));
   res->driver_data = NULL;
   res->chip_data   = NULL;
+  memset(&res->stats, 0, sizeof(res->stats));
+  memset(&res->iso_dep, 0, sizeof(res->iso_dep));
+  res->bClosing = false;
+  res->szSleepers = 0;
+  res->bSleepAborted = false;
+
+  // Public functions taking the lock call each other: it must be recursive
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  if (pthread_mutex_init(&res->lock, &attr) != 0) {
+    pthread_mutexattr_destroy(&attr);
+    free(res);
+    return NULL;
+  }
+  pthread_mutexattr_destroy(&attr);
+  if (pthread_mutex_init(&res->stats_lock, NULL) != 0) {
+    pthread_mutex_destroy(&res->lock);
+    free(res);
+    return NULL;
+  }
+  if (pthread_mutex_init(&res->sleep_lock, NULL) != 0) {
+    pthread_mutex_destroy(&res->stats_lock);
+    pthread_mutex_destroy(&res->lock);
+    free(res);
+    return NULL;
+  }
+  if (pthread_cond_init(&res->sleep_cond, NULL) != 0) {
+    pthread_mutex_destroy(&res->sleep_lock);
+    pthread_mutex_destroy(&res->stats_lock);
+    pthread_mutex_destroy(&res->lock);
+    free(res);
+    return NULL;
+  }
 
   return res;
 }
@@ -71,7 +108,128 @@ void
 nfc_device_free(nfc_device *dev)
 {
   if (dev) {
+    // nfc_close() held the lock during the driver close
+    if (dev->bClosing)
+      pthread_mutex_unlock(&dev->lock);
+    pthread_cond_destroy(&dev->sleep_cond);
+    pthread_mutex_destroy(&dev->sleep_lock);
+    pthread_mutex_destroy(&dev->stats_lock);
+    pthread_mutex_destroy(&dev->lock);
     free(dev->driver_data);
     free(dev);
   }
 }
+
+/**
+ * @brief Take the device lock
+ *
+ * Every public function operating on a device holds it, so that multi-step
+ * operations (property save/restore, register write-back, ...) of one thread
+ * do not interleave with those of another thread using the same device.
+ */
+void
+nfc_device_lock(nfc_device *dev)
+{
+  pthread_mutex_lock(&dev->lock);
+  if (dev->context)
+    log_use_context(dev->context);
+}
+
+void
+nfc_device_unlock(nfc_device *dev)
+{
+  pthread_mutex_unlock(&dev->lock);
+}
+
+// Waits on sleep_cond, sleep_lock held, for at most us microseconds
+static void
+device_sleep_wait(nfc_device *dev, const uint64_t us)
+{
+#ifndef _WIN32
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += us / 1000000;
+  deadline.tv_nsec += (us % 1000000) * 1000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  pthread_cond_timedwait(&dev->sleep_cond, &dev->sleep_lock, &deadline);
+#else
+  pthread_cond_timedwait_ms(&dev->sleep_cond, &dev->sleep_lock, (DWORD)((us + 999) / 1000));
+#endif
+}
+
+/**
+ * @brief Sleep between two commands without holding the device lock
+ * @return Returns 0 once \a ms elapsed, NFC_EOPABORTED when woken up by nfc_abort_command() or nfc_close()
+ *
+ * The caller holds the device lock once, as the public functions do: other
+ * threads may use the device meanwhile, so the device state must be checked
+ * again afterwards.
+ */
+int
+nfc_device_sleep(nfc_device *dev, const uint32_t ms)
+{
+  const uint64_t end = monotonic_time_us() + (uint64_t) ms * 1000;
+  uint64_t now;
+
+  pthread_mutex_lock(&dev->sleep_lock);
+  dev->szSleepers++;
+  nfc_device_unlock(dev);
+  while (!dev->bSleepAborted && ((now = monotonic_time_us()) < end))
+    device_sleep_wait(dev, end - now);
+  pthread_mutex_unlock(&dev->sleep_lock);
+
+  // Same lock order as nfc_close(): the device, then the sleepers
+  nfc_device_lock(dev);
+  pthread_mutex_lock(&dev->sleep_lock);
+  const bool aborted = dev->bSleepAborted;
+  if (--dev->szSleepers == 0)
+    dev->bSleepAborted = false;
+  pthread_cond_broadcast(&dev->sleep_cond);
+  pthread_mutex_unlock(&dev->sleep_lock);
+  return aborted ? NFC_EOPABORTED : NFC_SUCCESS;
+}
+
+/**
+ * @brief Wake up the calls sleeping in nfc_device_sleep()
+ * @return Returns true when a call was sleeping
+ */
+bool
+nfc_device_abort_sleep(nfc_device *dev)
+{
+  pthread_mutex_lock(&dev->sleep_lock);
+  const bool sleeping = dev->szSleepers > 0;
+  if (sleeping) {
+    dev->bSleepAborted = true;
+    pthread_cond_broadcast(&dev->sleep_cond);
+  }
+  pthread_mutex_unlock(&dev->sleep_lock);
+  return sleeping;
+}
+
+/**
+ * @brief Wake up the calls sleeping in nfc_device_sleep() and let them complete
+ *
+ * The caller holds the device lock once; it is released while the sleeping
+ * calls take it back and return, and held again afterwards.
+ */
+void
+nfc_device_wait_sleepers(nfc_device *dev)
+{
+  pthread_mutex_lock(&dev->sleep_lock);
+  while (dev->szSleepers > 0) {
+    dev->bSleepAborted = true;
+    pthread_cond_broadcast(&dev->sleep_cond);
+    pthread_mutex_unlock(&dev->sleep_lock);
+    nfc_device_unlock(dev);
+    pthread_mutex_lock(&dev->sleep_lock);
+    while (dev->szSleepers > 0)
+      pthread_cond_wait(&dev->sleep_cond, &dev->sleep_lock);
+    pthread_mutex_unlock(&dev->sleep_lock);
+    nfc_device_lock(dev);
+    pthread_mutex_lock(&dev->sleep_lock);
+  }
+  pthread_mutex_unlock(&dev->sleep_lock);
+}
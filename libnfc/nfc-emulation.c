@@ -29,11 +29,64 @@
  * @brief Provide a small API to ease emulation in libnfc
  */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
 #include <nfc/nfc.h>
 #include <nfc/nfc-emulation.h>
 
+#include "nfc-internal.h"
 #include "iso7816.h"
 
+/* C-APDU offsets */
+#define CLA  0
+#define INS  1
+#define P1   2
+#define P2   3
+#define LC   4
+#define DATA 5
+
+#define ISO7816_SELECT         0xA4
+#define ISO7816_READ_BINARY    0xB0
+#define ISO7816_UPDATE_BINARY  0xD6
+
+#define SAK_ISO14443_4_COMPLIANT 0x20
+
+static void
+emulation_record(struct nfc_emulation_dispatcher *dispatcher, const uint8_t *header, const size_t header_len,
+                 const uint8_t *data_out, const int io_res, const uint64_t latency_us);
+
+// Frame waiting time advertised by the emulated ATS, 0 when the target is not ISO/IEC 14443-4
+static uint32_t
+emulation_fwt_us(const nfc_target *pnt)
+{
+  if ((pnt->nm.nmt != NMT_ISO14443A) || !(pnt->nti.nai.btSak & SAK_ISO14443_4_COMPLIANT))
+    return 0;
+
+  uint8_t fwi = 4; // Default when the ATS has no TB(1)
+  const uint8_t *ats = pnt->nti.nai.abtAts;
+  if ((pnt->nti.nai.szAtsLen > 0) && (ats[0] & 0x20)) {
+    size_t tb = (ats[0] & 0x10) ? 2 : 1;
+    if (tb < pnt->nti.nai.szAtsLen)
+      fwi = ats[tb] >> 4;
+  }
+  if (fwi == 15) // RFU
+    fwi = 4;
+  // FWT = (256 * 16 / fc) * 2^FWI, fc = 13.56 MHz
+  return (uint32_t)(((uint64_t) 4096 << fwi) * 100 / 1356);
+}
+
 /** @ingroup emulation
  * @brief Emulate a target
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
@@ -55,22 +108,579 @@ nfc_emulate_target(nfc_device *pnd, struct nfc_emulator *emulator, const int tim
     return res;
   }
 
+  // Latencies are only recorded for declarative emulators
+  struct nfc_emulation_dispatcher *dispatcher = NULL;
+  if (emulator->state_machine->io == nfc_emulation_dispatch) {
+    dispatcher = emulator->state_machine->data;
+    dispatcher->fwt_us = emulation_fwt_us(emulator->target);
+  }
+
   size_t szRx = res;
   int io_res = res;
+  uint64_t rx_time = monotonic_time_us();
   while (io_res >= 0) {
     io_res = emulator->state_machine->io(emulator, abtRx, szRx, abtTx, sizeof(abtTx));
+    // The next command overwrites abtRx
+    uint8_t abtHeader[NFC_EMULATION_HEADER_LEN];
+    size_t szHeader = MIN(szRx, sizeof(abtHeader));
+    memcpy(abtHeader, abtRx, szHeader);
+    uint64_t sent_time = 0;
     if (io_res > 0) {
-      if ((res = nfc_target_send_bytes(pnd, abtTx, io_res, timeout)) < 0) {
-        return res;
-      }
+      res = nfc_target_send_receive_bytes_ext(pnd, abtTx, io_res, abtRx, sizeof(abtRx), timeout, &sent_time);
+    } else {
+      sent_time = monotonic_time_us();
+      if (io_res == 0)
+        res = nfc_target_receive_bytes(pnd, abtRx, sizeof(abtRx), timeout);
     }
+    if (dispatcher && (szRx > 0) && sent_time)
+      emulation_record(dispatcher, abtHeader, szHeader, abtTx, io_res, sent_time - rx_time);
     if (io_res >= 0) {
-      if ((res = nfc_target_receive_bytes(pnd, abtRx, sizeof(abtRx), timeout)) < 0) {
+      if (res < 0) {
         return res;
       }
       szRx = res;
+      rx_time = monotonic_time_us();
     }
   }
   return io_res;
 }
 
+
+static const uint8_t sw_ok[] = { 0x90, 0x00 };
+static const uint8_t sw_end_of_file[] = { 0x62, 0x82 };
+static const uint8_t sw_wrong_length[] = { 0x67, 0x00 };
+static const uint8_t sw_not_allowed[] = { 0x69, 0x82 };
+static const uint8_t sw_not_found[] = { 0x6A, 0x82 };
+static const uint8_t sw_wrong_offset[] = { 0x6B, 0x00 };
+static const uint8_t sw_memory_failure[] = { 0x65, 0x81 };
+
+static uint32_t
+emulation_pack_key(const uint8_t *key, const size_t key_len)
+{
+  uint32_t packed = (uint32_t) key_len << 24;
+  for (size_t n = 0; n < key_len; n++)
+    packed |= (uint32_t) key[n] << (16 - 8 * n);
+  return packed;
+}
+
+static inline size_t
+emulation_slot(const struct nfc_emulation_dispatcher *dispatcher, const uint32_t packed_key)
+{
+  return (uint32_t)(packed_key * dispatcher->table_seed) >> dispatcher->table_shift;
+}
+
+static inline int
+emulation_sw(uint8_t *data_out, const size_t data_out_len, const uint8_t *sw)
+{
+  if (data_out_len < 2)
+    return -ENOSPC;
+  data_out[0] = sw[0];
+  data_out[1] = sw[1];
+  return 2;
+}
+
+static void
+emulation_record(struct nfc_emulation_dispatcher *dispatcher, const uint8_t *header, const size_t header_len,
+                 const uint8_t *data_out, const int io_res, const uint64_t latency_us)
+{
+  if (dispatcher->fwt_us && (latency_us > dispatcher->fwt_us))
+    dispatcher->fwt_overruns++;
+
+  if (dispatcher->pending >= 0) {
+    struct nfc_emulation_command *command = &dispatcher->commands[dispatcher->pending];
+    if ((command->count == 0) || (latency_us < command->min_us))
+      command->min_us = latency_us;
+    if (latency_us > command->max_us)
+      command->max_us = latency_us;
+    command->total_us += latency_us;
+    command->count++;
+  }
+
+  struct nfc_emulation_log_entry *entry = &dispatcher->log[dispatcher->log_count++ % NFC_EMULATION_LOG_SIZE];
+  entry->header_len = header_len;
+  memcpy(entry->header, header, header_len);
+  entry->result = io_res;
+  entry->trailer[0] = (io_res >= 2) ? data_out[io_res - 2] : 0;
+  entry->trailer[1] = (io_res >= 1) ? data_out[io_res - 1] : 0;
+  entry->latency_us = (uint32_t) latency_us;
+}
+
+static int
+emulation_select(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+{
+  struct nfc_emulation_dispatcher *dispatcher = emulator->state_machine->data;
+  const bool by_name = (data_in[P1] == 0x04);
+
+  if (data_in_len < 4)
+    return -ENOTSUP;
+  if (by_name ? (data_in[P2] != 0x00) : ((data_in[P2] | 0x0C) != 0x0C))
+    return -ENOTSUP;
+  if ((data_in_len < DATA) || (data_in_len < (size_t)(DATA + data_in[LC])))
+    return emulation_sw(data_out, data_out_len, sw_wrong_length);
+
+  for (size_t n = 0; n < dispatcher->file_count; n++) {
+    const struct nfc_emulation_file *file = dispatcher->files[n];
+    if ((file->by_name == by_name) && (file->name_len == data_in[LC]) && (0 == memcmp(file->name, data_in + DATA, file->name_len))) {
+      // Selecting an application keeps the current file
+      if (file->content)
+        dispatcher->current_file = file;
+      return emulation_sw(data_out, data_out_len, sw_ok);
+    }
+  }
+  if (!by_name)
+    dispatcher->current_file = NULL;
+  return emulation_sw(data_out, data_out_len, sw_not_found);
+}
+
+static int
+emulation_read_binary(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+{
+  struct nfc_emulation_dispatcher *dispatcher = emulator->state_machine->data;
+  const struct nfc_emulation_file *file = dispatcher->current_file;
+
+  if (data_in_len < 4)
+    return -ENOTSUP;
+  if (!file)
+    return emulation_sw(data_out, data_out_len, sw_not_found);
+
+  size_t offset = (data_in[P1] << 8) + data_in[P2];
+  size_t le = ((data_in_len > LC) && data_in[LC]) ? data_in[LC] : ISO7816_SHORT_APDU_MAX_DATA_LEN;
+  const uint8_t *sw = sw_ok;
+  if (offset >= file->size)
+    return emulation_sw(data_out, data_out_len, sw_wrong_offset);
+  if (le > file->size - offset) {
+    le = file->size - offset;
+    sw = sw_end_of_file;
+  }
+  if (le + 2 > data_out_len)
+    return -ENOSPC;
+  // Static files are served straight from their image, with a constant status word
+  memcpy(data_out, file->content + offset, le);
+  data_out[le] = sw[0];
+  data_out[le + 1] = sw[1];
+  return (int)(le + 2);
+}
+
+static int
+emulation_update_binary(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+{
+  struct nfc_emulation_dispatcher *dispatcher = emulator->state_machine->data;
+  const struct nfc_emulation_file *file = dispatcher->current_file;
+
+  if (data_in_len < 4)
+    return -ENOTSUP;
+  if (!file)
+    return emulation_sw(data_out, data_out_len, sw_not_found);
+  if (!file->writable)
+    return emulation_sw(data_out, data_out_len, sw_not_allowed);
+  if ((data_in_len < DATA) || (data_in_len < (size_t)(DATA + data_in[LC])))
+    return emulation_sw(data_out, data_out_len, sw_wrong_length);
+
+  size_t offset = (data_in[P1] << 8) + data_in[P2];
+  if (offset + data_in[LC] > file->size)
+    return emulation_sw(data_out, data_out_len, sw_wrong_offset);
+  if (file->storage) {
+    if (nfc_emulation_storage_write(file->storage, (size_t)(file->content - file->storage->data) + offset, data_in + DATA, data_in[LC]) < 0)
+      return emulation_sw(data_out, data_out_len, sw_memory_failure);
+  } else {
+    memcpy(file->content + offset, data_in + DATA, data_in[LC]);
+  }
+  return emulation_sw(data_out, data_out_len, sw_ok);
+}
+
+/** @ingroup emulation
+ * @brief Initialize an empty dispatcher
+ *
+ * @param dispatcher \a nfc_emulation_dispatcher struct pointer to initialize
+ */
+void
+nfc_emulation_dispatcher_init(struct nfc_emulation_dispatcher *dispatcher)
+{
+  memset(dispatcher, 0, sizeof(*dispatcher));
+  dispatcher->pending = -1;
+}
+
+/** @ingroup emulation
+ * @brief Register a command handler
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param dispatcher \a nfc_emulation_dispatcher struct pointer
+ * @param key first bytes of the command, e.g. CLA, INS and P1 of an APDU
+ * @param key_len number of bytes of \a key, from 1 to NFC_EMULATION_KEY_MAX_LEN
+ * @param handler function answering the command, with the same contract than nfc_emulation_state_machine's io()
+ *
+ * Commands matching several keys are handled by the longest one.
+ */
+int
+nfc_emulation_dispatcher_add_command(struct nfc_emulation_dispatcher *dispatcher, const uint8_t *key, const size_t key_len, nfc_emulation_handler handler)
+{
+  if ((key_len == 0) || (key_len > NFC_EMULATION_KEY_MAX_LEN) || !handler)
+    return NFC_EINVARG;
+  uint32_t packed_key = emulation_pack_key(key, key_len);
+  for (size_t n = 0; n < dispatcher->command_count; n++) {
+    if (dispatcher->commands[n].packed_key == packed_key)
+      return NFC_EINVARG;
+  }
+  if (dispatcher->command_count == NFC_EMULATION_MAX_COMMANDS)
+    return NFC_EOVFLOW;
+
+  struct nfc_emulation_command *command = &dispatcher->commands[dispatcher->command_count++];
+  memset(command, 0, sizeof(*command));
+  memcpy(command->key, key, key_len);
+  command->key_len = key_len;
+  command->handler = handler;
+  command->packed_key = packed_key;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup emulation
+ * @brief Register a file, served by built-in SELECT, READ BINARY and UPDATE BINARY commands (CLA 00)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param dispatcher \a nfc_emulation_dispatcher struct pointer
+ * @param file \a nfc_emulation_file struct pointer, which must stay valid during the emulation
+ */
+int
+nfc_emulation_dispatcher_add_file(struct nfc_emulation_dispatcher *dispatcher, const struct nfc_emulation_file *file)
+{
+  int res;
+  if ((file->name_len == 0) || (file->name_len > NFC_EMULATION_NAME_MAX_LEN))
+    return NFC_EINVARG;
+  if (dispatcher->file_count == NFC_EMULATION_MAX_FILES)
+    return NFC_EOVFLOW;
+
+  if (dispatcher->file_count == 0) {
+    const uint8_t select_by_id[] = { 0x00, ISO7816_SELECT, 0x00 };
+    const uint8_t select_by_name[] = { 0x00, ISO7816_SELECT, 0x04 };
+    const uint8_t read_binary[] = { 0x00, ISO7816_READ_BINARY };
+    const uint8_t update_binary[] = { 0x00, ISO7816_UPDATE_BINARY };
+    if (((res = nfc_emulation_dispatcher_add_command(dispatcher, select_by_id, sizeof(select_by_id), emulation_select)) < 0) ||
+        ((res = nfc_emulation_dispatcher_add_command(dispatcher, select_by_name, sizeof(select_by_name), emulation_select)) < 0) ||
+        ((res = nfc_emulation_dispatcher_add_command(dispatcher, read_binary, sizeof(read_binary), emulation_read_binary)) < 0) ||
+        ((res = nfc_emulation_dispatcher_add_command(dispatcher, update_binary, sizeof(update_binary), emulation_update_binary)) < 0))
+      return res;
+  }
+  dispatcher->files[dispatcher->file_count++] = file;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup emulation
+ * @brief Build the dispatch table once all commands and files are registered
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param dispatcher \a nfc_emulation_dispatcher struct pointer
+ *
+ * Keys are hashed with a multiplicative hash whose seed is searched until no
+ * two keys share a slot, so dispatching a command costs one probe per key length.
+ */
+int
+nfc_emulation_dispatcher_build(struct nfc_emulation_dispatcher *dispatcher)
+{
+  dispatcher->key_lens = 0;
+  for (size_t n = 0; n < dispatcher->command_count; n++)
+    dispatcher->key_lens |= 1 << dispatcher->commands[n].key_len;
+
+  for (unsigned int bits = 1; (1u << bits) <= NFC_EMULATION_TABLE_SIZE; bits++) {
+    if ((1u << bits) < dispatcher->command_count)
+      continue;
+    dispatcher->table_shift = 32 - bits;
+    uint32_t seed = 0x9E3779B1;
+    for (int attempt = 0; attempt < 1024; attempt++, seed = seed * 0x01000193 + 0x2u) {
+      dispatcher->table_seed = seed | 1;
+      memset(dispatcher->table, 0, sizeof(dispatcher->table));
+      size_t n;
+      for (n = 0; n < dispatcher->command_count; n++) {
+        size_t slot = emulation_slot(dispatcher, dispatcher->commands[n].packed_key);
+        if (dispatcher->table[slot])
+          break;
+        dispatcher->table[slot] = (uint8_t)(n + 1);
+      }
+      if (n == dispatcher->command_count)
+        return NFC_SUCCESS;
+    }
+  }
+  return NFC_ESOFT;
+}
+
+/** @ingroup emulation
+ * @brief io() function of declarative emulators
+ * @return Returns the response length, 0 when there is nothing to answer, otherwise a negative error code
+ *
+ * The state machine data must be a \a nfc_emulation_dispatcher built with nfc_emulation_dispatcher_build().
+ * Commands without handler return -ENOTSUP, which ends the emulation.
+ */
+int
+nfc_emulation_dispatch(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
+{
+  struct nfc_emulation_dispatcher *dispatcher = emulator->state_machine->data;
+
+  dispatcher->pending = -1;
+  if (data_in_len == 0)
+    return 0;
+
+  for (size_t key_len = NFC_EMULATION_KEY_MAX_LEN; key_len > 0; key_len--) {
+    if (!(dispatcher->key_lens & (1 << key_len)) || (key_len > data_in_len))
+      continue;
+    uint32_t packed_key = emulation_pack_key(data_in, key_len);
+    uint8_t index = dispatcher->table[emulation_slot(dispatcher, packed_key)];
+    if (index && (dispatcher->commands[index - 1].packed_key == packed_key)) {
+      dispatcher->pending = index - 1;
+      return dispatcher->commands[index - 1].handler(emulator, data_in, data_in_len, data_out, data_out_len);
+    }
+  }
+  return -ENOTSUP;
+}
+
+#ifndef _WIN32
+// Maps the file over the image, at the same address once mapped
+static int
+emulation_storage_map(struct nfc_emulation_storage *storage, const bool shared)
+{
+  void *addr = mmap(storage->data, storage->size, PROT_READ | PROT_WRITE,
+                    (shared ? MAP_SHARED : MAP_PRIVATE) | (storage->data ? MAP_FIXED : 0), storage->fd, 0);
+  if (addr == MAP_FAILED)
+    return NFC_ESOFT;
+  storage->data = addr;
+  storage->snapshot = !shared;
+  storage->pending_writes = 0;
+  storage->dirty_start = storage->size;
+  storage->dirty_end = 0;
+  return NFC_SUCCESS;
+}
+#endif
+
+/** @ingroup emulation
+ * @brief Map a tag image from a file
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param storage \a nfc_emulation_storage struct pointer to initialize
+ * @param path image file, created when missing
+ * @param initial content of a new or empty file, may be NULL for zeroes
+ * @param size image size; 0 to take the size of an existing file
+ * @param sync_interval writes between two syncs to the file, 0 to only sync when asked
+ *
+ * Files shorter than \a size are extended with zeroes.
+ */
+int
+nfc_emulation_storage_open(struct nfc_emulation_storage *storage, const char *path, const uint8_t *initial, const size_t size, const size_t sync_interval)
+{
+  memset(storage, 0, sizeof(*storage));
+  storage->fd = -1;
+  storage->sync_interval = sync_interval;
+#ifndef _WIN32
+  struct stat st;
+  int res;
+
+  if ((storage->fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+    return NFC_EIO;
+  if (fstat(storage->fd, &st) < 0) {
+    nfc_emulation_storage_close(storage);
+    return NFC_EIO;
+  }
+  const bool empty = (st.st_size == 0);
+  storage->size = size ? size : (size_t) st.st_size;
+  if (storage->size == 0) {
+    nfc_emulation_storage_close(storage);
+    return NFC_EINVARG;
+  }
+  if (((size_t) st.st_size < storage->size) && (ftruncate(storage->fd, storage->size) < 0)) {
+    nfc_emulation_storage_close(storage);
+    return NFC_EIO;
+  }
+  if ((res = emulation_storage_map(storage, true)) < 0) {
+    nfc_emulation_storage_close(storage);
+    return res;
+  }
+  if (empty && initial) {
+    memcpy(storage->data, initial, storage->size);
+    if (msync(storage->data, storage->size, MS_SYNC) < 0) {
+      nfc_emulation_storage_close(storage);
+      return NFC_EIO;
+    }
+  }
+  return NFC_SUCCESS;
+#else
+  (void) path;
+  (void) initial;
+  (void) size;
+  return NFC_ENOTIMPL;
+#endif
+}
+
+/** @ingroup emulation
+ * @brief Write to the tag image in place
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param storage \a nfc_emulation_storage struct pointer
+ * @param offset position in the image
+ * @param data bytes to write
+ * @param len number of bytes
+ *
+ * Outside of a snapshot, the written range is synced to the file every sync_interval writes.
+ * When that sync fails, the write is undone: the image keeps its previous bytes.
+ */
+int
+nfc_emulation_storage_write(struct nfc_emulation_storage *storage, const size_t offset, const uint8_t *data, const size_t len)
+{
+  if ((offset > storage->size) || (len > storage->size - offset))
+    return NFC_EINVARG;
+  const bool sync = !storage->snapshot && storage->sync_interval && (storage->pending_writes + 1 >= storage->sync_interval);
+  const size_t dirty_start = storage->dirty_start;
+  const size_t dirty_end = storage->dirty_end;
+  const size_t pending_writes = storage->pending_writes;
+  uint8_t *previous = NULL;
+  if (sync && len) {
+    if (!(previous = malloc(len)))
+      return NFC_ESOFT;
+    memcpy(previous, storage->data + offset, len);
+  }
+
+  memcpy(storage->data + offset, data, len);
+  storage->dirty_start = MIN(storage->dirty_start, offset);
+  storage->dirty_end = MAX(storage->dirty_end, offset + len);
+  storage->pending_writes++;
+  if (sync) {
+    int res;
+    if ((res = nfc_emulation_storage_sync(storage)) < 0) {
+      if (previous)
+        memcpy(storage->data + offset, previous, len);
+      storage->dirty_start = dirty_start;
+      storage->dirty_end = dirty_end;
+      storage->pending_writes = pending_writes;
+      free(previous);
+      return res;
+    }
+    free(previous);
+  }
+  storage->writes++;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup emulation
+ * @brief Sync the bytes written since the last sync to the file
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param storage \a nfc_emulation_storage struct pointer
+ *
+ * Nothing is synced during a snapshot.
+ */
+int
+nfc_emulation_storage_sync(struct nfc_emulation_storage *storage)
+{
+  storage->pending_writes = 0;
+  if (storage->snapshot || (storage->dirty_start >= storage->dirty_end))
+    return NFC_SUCCESS;
+#ifndef _WIN32
+  // msync() wants a page-aligned start
+  const size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  const size_t start = storage->dirty_start / page * page;
+  if (msync(storage->data + start, storage->dirty_end - start, MS_SYNC) < 0)
+    return NFC_EIO;
+#endif
+  storage->syncs++;
+  storage->dirty_start = storage->size;
+  storage->dirty_end = 0;
+  return NFC_SUCCESS;
+}
+
+/** @ingroup emulation
+ * @brief Take a copy-on-write snapshot of the tag image
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param storage \a nfc_emulation_storage struct pointer
+ *
+ * The image is synced, then mapped privately: nothing is copied until written,
+ * and the next writes no longer reach the file. Taking a snapshot during a
+ * snapshot rolls back the writes since the previous one.
+ */
+int
+nfc_emulation_storage_snapshot(struct nfc_emulation_storage *storage)
+{
+#ifndef _WIN32
+  int res;
+  if ((res = nfc_emulation_storage_sync(storage)) < 0)
+    return res;
+  return emulation_storage_map(storage, false);
+#else
+  (void) storage;
+  return NFC_ENOTIMPL;
+#endif
+}
+
+/** @ingroup emulation
+ * @brief Drop the writes done since the snapshot, which stays in effect
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param storage \a nfc_emulation_storage struct pointer
+ *
+ * The file still holds the snapshot: the written range is read back from it,
+ * whatever the image size. Ranges of more than NFC_EMULATION_STORAGE_REMAP_PAGES
+ * pages are dropped by mapping the file again, which releases their copies.
+ */
+int
+nfc_emulation_storage_rollback(struct nfc_emulation_storage *storage)
+{
+  if (!storage->snapshot)
+    return NFC_EINVARG;
+  storage->rollbacks++;
+  if (storage->dirty_start >= storage->dirty_end)
+    return NFC_SUCCESS;
+#ifndef _WIN32
+  const size_t len = storage->dirty_end - storage->dirty_start;
+  if (len > NFC_EMULATION_STORAGE_REMAP_PAGES * (size_t) sysconf(_SC_PAGESIZE))
+    return emulation_storage_map(storage, false);
+  if (pread(storage->fd, storage->data + storage->dirty_start, len, storage->dirty_start) != (ssize_t) len)
+    return NFC_EIO;
+  storage->dirty_start = storage->size;
+  storage->dirty_end = 0;
+  return NFC_SUCCESS;
+#else
+  return NFC_ENOTIMPL;
+#endif
+}
+
+/** @ingroup emulation
+ * @brief End the snapshot, keeping the writes done since
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param storage \a nfc_emulation_storage struct pointer
+ *
+ * The written range is stored to the file, which is mapped shared again.
+ */
+int
+nfc_emulation_storage_commit(struct nfc_emulation_storage *storage)
+{
+  if (!storage->snapshot)
+    return NFC_SUCCESS;
+#ifndef _WIN32
+  if (storage->dirty_start < storage->dirty_end) {
+    const size_t len = storage->dirty_end - storage->dirty_start;
+    if ((pwrite(storage->fd, storage->data + storage->dirty_start, len, storage->dirty_start) != (ssize_t) len) || (fdatasync(storage->fd) < 0))
+      return NFC_EIO;
+    storage->syncs++;
+  }
+  return emulation_storage_map(storage, true);
+#else
+  return NFC_ENOTIMPL;
+#endif
+}
+
+/** @ingroup emulation
+ * @brief Unmap the tag image, syncing it unless in a snapshot
+ *
+ * @param storage \a nfc_emulation_storage struct pointer
+ */
+void
+nfc_emulation_storage_close(struct nfc_emulation_storage *storage)
+{
+#ifndef _WIN32
+  if (storage->data) {
+    nfc_emulation_storage_sync(storage);
+    munmap(storage->data, storage->size);
+  }
+  if (storage->fd >= 0)
+    close(storage->fd);
+#endif
+  storage->data = NULL;
+  storage->fd = -1;
+}
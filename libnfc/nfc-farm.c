@@ -0,0 +1,489 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file nfc-farm.c
+ * @brief Run jobs on a set of devices, each one driven by its own thread
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdlib.h>
+#include <string.h>
+// The pthread.h of contrib/win32 on Windows
+#include <pthread.h>
+
+#include <nfc/nfc.h>
+#include <nfc/nfc-farm.h>
+
+#include "nfc-internal.h"
+
+#define LOG_GROUP    NFC_LOG_GROUP_GENERAL
+#define LOG_CATEGORY "libnfc.general"
+
+// Response buffer of the jobs which have none
+#define FARM_FRAME_MAX 264
+
+struct farm_reader {
+  nfc_farm *farm;
+  size_t   index;
+  pthread_t thread;
+  bool     started;
+  nfc_connstring connstring;
+  nfc_device *pnd;
+  bool     open;
+  /* Ring of jobs: the worker pushes and pops at the bottom, thieves take the top */
+  pthread_mutex_t lock;
+  struct nfc_farm_job **jobs;
+  size_t   capacity;
+  size_t   top;
+  size_t   count;
+  size_t   victim;            // next reader to steal from
+  /* Counters, under lock */
+  size_t   attempts;
+  size_t   failures;
+  size_t   steals;
+  uint64_t busy_us;
+};
+
+struct nfc_farm {
+  nfc_context *context;
+  struct farm_reader readers[NFC_FARM_MAX_DEVICES];
+  size_t   reader_count;
+  pthread_mutex_t lock;
+  pthread_cond_t work;        // jobs pushed or stop asked
+  pthread_cond_t state;       // reader opened or job done
+  uint64_t open_readers;      // bit n set when reader n is open
+  size_t   opened;            // readers which tried to open their device
+  uint64_t generation;        // pushes so far, idle workers wait for a new one
+  size_t   pending;           // jobs submitted and not done
+  size_t   next_reader;
+  bool     stop;
+  size_t   jobs_done;
+  size_t   jobs_failed;
+  size_t   retries;
+  uint64_t start_us;
+};
+
+static int
+farm_push(struct farm_reader *reader, struct nfc_farm_job *job)
+{
+  nfc_farm *farm = reader->farm;
+
+  pthread_mutex_lock(&reader->lock);
+  if (reader->count == reader->capacity) {
+    const size_t capacity = reader->capacity ? 2 * reader->capacity : 64;
+    struct nfc_farm_job **jobs = malloc(capacity * sizeof(*jobs));
+    if (!jobs) {
+      pthread_mutex_unlock(&reader->lock);
+      return NFC_ESOFT;
+    }
+    for (size_t n = 0; n < reader->count; n++)
+      jobs[n] = reader->jobs[(reader->top + n) % reader->capacity];
+    free(reader->jobs);
+    reader->jobs = jobs;
+    reader->capacity = capacity;
+    reader->top = 0;
+  }
+  reader->jobs[(reader->top + reader->count++) % reader->capacity] = job;
+  pthread_mutex_unlock(&reader->lock);
+
+  pthread_mutex_lock(&farm->lock);
+  farm->generation++;
+  pthread_cond_broadcast(&farm->work);
+  pthread_mutex_unlock(&farm->lock);
+  return NFC_SUCCESS;
+}
+
+// The newest job of the worker's own deque
+static struct nfc_farm_job *
+farm_pop(struct farm_reader *reader)
+{
+  struct nfc_farm_job *job = NULL;
+
+  pthread_mutex_lock(&reader->lock);
+  if (reader->count > 0)
+    job = reader->jobs[(reader->top + --reader->count) % reader->capacity];
+  pthread_mutex_unlock(&reader->lock);
+  return job;
+}
+
+// The oldest job of another deque, unless it already failed on the thief
+static struct nfc_farm_job *
+farm_steal(struct farm_reader *thief)
+{
+  nfc_farm *farm = thief->farm;
+  const uint64_t bit = (uint64_t) 1 << thief->index;
+
+  for (size_t n = 0; n < farm->reader_count; n++) {
+    struct farm_reader *victim = &farm->readers[(thief->victim + n) % farm->reader_count];
+    struct nfc_farm_job *job = NULL;
+    if (victim == thief)
+      continue;
+    pthread_mutex_lock(&victim->lock);
+    if ((victim->count > 0) && !(victim->jobs[victim->top]->failed_readers & bit)) {
+      job = victim->jobs[victim->top];
+      victim->top = (victim->top + 1) % victim->capacity;
+      victim->count--;
+    }
+    pthread_mutex_unlock(&victim->lock);
+    if (job) {
+      // Steal from the same reader next time, it had work left
+      thief->victim = victim->index;
+      pthread_mutex_lock(&thief->lock);
+      thief->steals++;
+      pthread_mutex_unlock(&thief->lock);
+      return job;
+    }
+  }
+  return NULL;
+}
+
+static int
+farm_run_job(struct farm_reader *reader, struct nfc_farm_job *job)
+{
+  uint8_t abtRx[FARM_FRAME_MAX];
+  uint8_t *pbtRx = job->rx ? job->rx : abtRx;
+  const size_t szRx = job->rx ? job->rx_size : sizeof(abtRx);
+  int res;
+
+  job->rx_len = 0;
+  if ((res = nfc_initiator_select_passive_target(reader->pnd, job->nm, NULL, 0, &job->target)) <= 0)
+    return res ? res : NFC_ENOTSUCHDEV;
+  switch (job->type) {
+    case NFC_FARM_READ:
+    case NFC_FARM_WRITE:
+    case NFC_FARM_VERIFY:
+      if ((res = nfc_initiator_transceive_bytes(reader->pnd, job->tx, job->tx_len, pbtRx, szRx, -1)) < 0)
+        break;
+      job->rx_len = res;
+      res = NFC_SUCCESS;
+      if ((job->type == NFC_FARM_VERIFY) && ((job->rx_len != job->expected_len) || memcmp(pbtRx, job->expected, job->expected_len)))
+        res = NFC_ESOFT;
+      break;
+    case NFC_FARM_CALLBACK:
+      res = job->callback ? job->callback(reader->pnd, &job->target, job) : NFC_EINVARG;
+      break;
+    default:
+      res = NFC_EINVARG;
+      break;
+  }
+  nfc_initiator_deselect_target(reader->pnd);
+  return res;
+}
+
+// Next open reader on which the job did not fail yet
+static struct farm_reader *
+farm_retry_reader(nfc_farm *farm, const struct nfc_farm_job *job)
+{
+  for (size_t n = 1; n < farm->reader_count; n++) {
+    const size_t index = (job->reader + n) % farm->reader_count;
+    const uint64_t bit = (uint64_t) 1 << index;
+    if ((farm->open_readers & bit) && !(job->failed_readers & bit))
+      return &farm->readers[index];
+  }
+  return NULL;
+}
+
+static void
+farm_process(struct farm_reader *reader, struct nfc_farm_job *job)
+{
+  nfc_farm *farm = reader->farm;
+  const uint64_t start = monotonic_time_us();
+  int res = farm_run_job(reader, job);
+  const uint64_t busy = monotonic_time_us() - start;
+
+  job->attempts++;
+  job->reader = reader->index;
+  pthread_mutex_lock(&reader->lock);
+  reader->attempts++;
+  reader->busy_us += busy;
+  if (res < 0)
+    reader->failures++;
+  pthread_mutex_unlock(&reader->lock);
+
+  if (res < 0) {
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Job failed on %s (attempt %d): %s", reader->connstring, job->attempts, nfc_strerror(reader->pnd));
+    job->failed_readers |= (uint64_t) 1 << reader->index;
+    // The chip may be left in any state
+    nfc_initiator_init(reader->pnd);
+    nfc_device_set_property_bool(reader->pnd, NP_INFINITE_SELECT, false);
+    struct farm_reader *next;
+    const int max_attempts = job->max_attempts ? job->max_attempts : NFC_FARM_DEFAULT_ATTEMPTS;
+    if ((job->attempts < max_attempts) && ((next = farm_retry_reader(farm, job)) != NULL) && (farm_push(next, job) == NFC_SUCCESS)) {
+      pthread_mutex_lock(&farm->lock);
+      farm->retries++;
+      pthread_mutex_unlock(&farm->lock);
+      return;
+    }
+  }
+
+  job->result = res;
+  if (job->done)
+    job->done(job);
+  pthread_mutex_lock(&farm->lock);
+  if (res < 0)
+    farm->jobs_failed++;
+  else
+    farm->jobs_done++;
+  if (--farm->pending == 0)
+    pthread_cond_broadcast(&farm->state);
+  pthread_mutex_unlock(&farm->lock);
+}
+
+static void *
+farm_worker(void *arg)
+{
+  struct farm_reader *reader = arg;
+  nfc_farm *farm = reader->farm;
+
+  // The device is opened by the thread which drives it
+  if ((reader->pnd = nfc_open(farm->context, reader->connstring)) != NULL) {
+    if ((nfc_initiator_init(reader->pnd) < 0) || (nfc_device_set_property_bool(reader->pnd, NP_INFINITE_SELECT, false) < 0)) {
+      nfc_close(reader->pnd);
+      reader->pnd = NULL;
+    }
+  }
+  if (!reader->pnd)
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to open %s, no job will run on it", reader->connstring);
+  pthread_mutex_lock(&farm->lock);
+  reader->open = (reader->pnd != NULL);
+  if (reader->open)
+    farm->open_readers |= (uint64_t) 1 << reader->index;
+  farm->opened++;
+  pthread_cond_broadcast(&farm->state);
+  pthread_mutex_unlock(&farm->lock);
+  if (!reader->open)
+    return NULL;
+
+  for (;;) {
+    pthread_mutex_lock(&farm->lock);
+    const uint64_t generation = farm->generation;
+    const bool stop = farm->stop;
+    pthread_mutex_unlock(&farm->lock);
+    if (stop)
+      break;
+
+    struct nfc_farm_job *job = farm_pop(reader);
+    if (!job)
+      job = farm_steal(reader);
+    if (job) {
+      farm_process(reader, job);
+      continue;
+    }
+    // Nothing this reader may run: sleep until a job is pushed
+    pthread_mutex_lock(&farm->lock);
+    while (!farm->stop && (farm->generation == generation))
+      pthread_cond_wait(&farm->work, &farm->lock);
+    pthread_mutex_unlock(&farm->lock);
+  }
+  nfc_close(reader->pnd);
+  reader->pnd = NULL;
+  return NULL;
+}
+
+/** @ingroup farm
+ * @brief Open a set of devices, each one on its own worker thread
+ * @return Returns the farm, or NULL on error
+ *
+ * @param context The context to operate on
+ * @param connstrings devices of the farm, up to NFC_FARM_MAX_DEVICES
+ * @param connstrings_len number of devices
+ *
+ * The function returns once every worker tried to open its device; devices
+ * which could not be opened get no job.
+ */
+nfc_farm *
+nfc_farm_new(nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  nfc_farm *farm;
+
+  if ((connstrings_len == 0) || (connstrings_len > NFC_FARM_MAX_DEVICES))
+    return NULL;
+  if (!(farm = calloc(1, sizeof(*farm))))
+    return NULL;
+  farm->context = context;
+  farm->reader_count = connstrings_len;
+  farm->start_us = monotonic_time_us();
+  pthread_mutex_init(&farm->lock, NULL);
+  pthread_cond_init(&farm->work, NULL);
+  pthread_cond_init(&farm->state, NULL);
+  for (size_t n = 0; n < connstrings_len; n++) {
+    struct farm_reader *reader = &farm->readers[n];
+    reader->farm = farm;
+    reader->index = n;
+    reader->victim = (n + 1) % connstrings_len;
+    strncpy(reader->connstring, connstrings[n], sizeof(nfc_connstring) - 1);
+    pthread_mutex_init(&reader->lock, NULL);
+  }
+  size_t started = 0;
+  for (size_t n = 0; n < connstrings_len; n++) {
+    if (pthread_create(&farm->readers[n].thread, NULL, farm_worker, &farm->readers[n]) != 0) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "Unable to start the worker of %s", connstrings[n]);
+      continue;
+    }
+    farm->readers[n].started = true;
+    started++;
+  }
+
+  pthread_mutex_lock(&farm->lock);
+  while (farm->opened < started)
+    pthread_cond_wait(&farm->state, &farm->lock);
+  pthread_mutex_unlock(&farm->lock);
+  return farm;
+}
+
+/** @ingroup farm
+ * @brief Queue a job
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param farm \a nfc_farm struct pointer
+ * @param job \a nfc_farm_job struct pointer, which must stay valid until done
+ *
+ * Jobs are spread over the open readers in turn, idle readers steal them.
+ */
+int
+nfc_farm_submit(nfc_farm *farm, struct nfc_farm_job *job)
+{
+  struct farm_reader *reader = NULL;
+  int res;
+
+  job->result = 0;
+  job->rx_len = 0;
+  job->attempts = 0;
+  job->failed_readers = 0;
+
+  pthread_mutex_lock(&farm->lock);
+  for (size_t n = 0; (n < farm->reader_count) && !reader; n++) {
+    const size_t index = (farm->next_reader + n) % farm->reader_count;
+    if (farm->open_readers & ((uint64_t) 1 << index)) {
+      reader = &farm->readers[index];
+      farm->next_reader = index + 1;
+    }
+  }
+  if (reader)
+    farm->pending++;
+  pthread_mutex_unlock(&farm->lock);
+  if (!reader)
+    return NFC_ENOTSUCHDEV;
+
+  job->reader = reader->index;
+  if ((res = farm_push(reader, job)) < 0) {
+    pthread_mutex_lock(&farm->lock);
+    if (--farm->pending == 0)
+      pthread_cond_broadcast(&farm->state);
+    pthread_mutex_unlock(&farm->lock);
+  }
+  return res;
+}
+
+/** @ingroup farm
+ * @brief Wait until every submitted job is done
+ *
+ * @param farm \a nfc_farm struct pointer
+ */
+void
+nfc_farm_wait(nfc_farm *farm)
+{
+  pthread_mutex_lock(&farm->lock);
+  while (farm->pending > 0)
+    pthread_cond_wait(&farm->state, &farm->lock);
+  pthread_mutex_unlock(&farm->lock);
+}
+
+/** @ingroup farm
+ * @brief Get the throughput of a farm and the utilisation of its readers
+ * @return Returns the number of readers of the farm
+ *
+ * @param farm \a nfc_farm struct pointer
+ * @param stats \a nfc_farm_stats struct pointer to fill, may be NULL
+ * @param readers array filled with the counters of the first \a readers_len readers, may be NULL
+ * @param readers_len size of \a readers
+ */
+size_t
+nfc_farm_get_stats(nfc_farm *farm, struct nfc_farm_stats *stats, struct nfc_farm_reader_stats readers[], const size_t readers_len)
+{
+  const uint64_t elapsed = MAX(monotonic_time_us() - farm->start_us, 1);
+
+  if (stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&farm->lock);
+    stats->readers = farm->reader_count;
+    for (size_t n = 0; n < farm->reader_count; n++)
+      stats->readers_open += (farm->open_readers >> n) & 1;
+    stats->jobs_done = farm->jobs_done;
+    stats->jobs_failed = farm->jobs_failed;
+    stats->retries = farm->retries;
+    pthread_mutex_unlock(&farm->lock);
+    stats->elapsed_us = elapsed;
+    stats->jobs_per_second = stats->jobs_done * 1e6 / elapsed;
+  }
+  for (size_t n = 0; readers && (n < readers_len) && (n < farm->reader_count); n++) {
+    struct farm_reader *reader = &farm->readers[n];
+    memcpy(readers[n].connstring, reader->connstring, sizeof(nfc_connstring));
+    pthread_mutex_lock(&reader->lock);
+    readers[n].attempts = reader->attempts;
+    readers[n].failures = reader->failures;
+    readers[n].steals = reader->steals;
+    readers[n].busy_us = reader->busy_us;
+    pthread_mutex_unlock(&reader->lock);
+    pthread_mutex_lock(&farm->lock);
+    readers[n].open = (farm->open_readers >> n) & 1;
+    pthread_mutex_unlock(&farm->lock);
+    readers[n].utilisation = (double) readers[n].busy_us / elapsed;
+  }
+  return farm->reader_count;
+}
+
+/** @ingroup farm
+ * @brief Stop the workers and close the devices
+ *
+ * @param farm \a nfc_farm struct pointer
+ *
+ * Jobs still queued are not run, nfc_farm_wait() lets them finish first.
+ */
+void
+nfc_farm_free(nfc_farm *farm)
+{
+  pthread_mutex_lock(&farm->lock);
+  farm->stop = true;
+  pthread_cond_broadcast(&farm->work);
+  pthread_mutex_unlock(&farm->lock);
+  for (size_t n = 0; n < farm->reader_count; n++) {
+    struct farm_reader *reader = &farm->readers[n];
+    if (reader->started)
+      pthread_join(reader->thread, NULL);
+    free(reader->jobs);
+    pthread_mutex_destroy(&reader->lock);
+  }
+  pthread_cond_destroy(&farm->state);
+  pthread_cond_destroy(&farm->work);
+  pthread_mutex_destroy(&farm->lock);
+  free(farm);
+}
@@ -29,20 +29,23 @@
 * @brief Provide some useful internal functions
 */
 
-#include <nfc/nfc.h>
-#include "nfc-internal.h"
-
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
-#ifdef CONFFILES
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+
 #include "conf.h"
-#endif
 
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#ifndef _WIN32
+#  include <time.h>
+#else
+#  include <windows.h>
+#endif
 
 #define LOG_GROUP    NFC_LOG_GROUP_GENERAL
 #define LOG_CATEGORY "libnfc.general"
@@ -69,8 +72,88 @@ string_as_boolean(const char *s, bool *value)
   }
 }
 
+/*
+ * Returns a cleared entry at the end of the user-defined device table, which
+ * grows as needed: configurations may define any number of devices.
+ */
+struct nfc_user_defined_device *
+nfc_context_add_user_defined_device(nfc_context *context)
+{
+  if (context->user_defined_device_count == context->user_defined_device_capacity) {
+    const unsigned int capacity = context->user_defined_device_capacity ? 2 * context->user_defined_device_capacity : 4;
+    struct nfc_user_defined_device *devices = realloc(context->user_defined_devices, capacity * sizeof(*devices));
+    if (!devices) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Not enough memory: realloc failed.");
+      return NULL;
+    }
+    context->user_defined_devices = devices;
+    context->user_defined_device_capacity = capacity;
+  }
+  struct nfc_user_defined_device *device = &context->user_defined_devices[context->user_defined_device_count++];
+  memset(device, 0, sizeof(*device));
+  return device;
+}
+
+// Orders by connstring, then by position in the table
+static int
+user_defined_device_cmp(const void *a, const void *b)
+{
+  const struct nfc_user_defined_device *da = *(const struct nfc_user_defined_device * const *) a;
+  const struct nfc_user_defined_device *db = *(const struct nfc_user_defined_device * const *) b;
+  const int res = strcmp(da->connstring, db->connstring);
+  return res ? res : ((da < db) ? -1 : 1);
+}
+
+// Checks the user-defined devices once, so that listing and opening them can trust the table
+static void
+nfc_context_validate(nfc_context *context)
+{
+  const unsigned int device_count = context->user_defined_device_count;
+  struct nfc_user_defined_device **sorted = NULL;
+  bool *ignored = NULL;
+  unsigned int count = 0;
+
+  if (device_count == 0)
+    return;
+  if (!(sorted = malloc(device_count * sizeof(*sorted))) || !(ignored = calloc(device_count, sizeof(*ignored)))) {
+    free(sorted);
+    log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Not enough memory: malloc failed.");
+    return;
+  }
+  // Duplicates are found sorted by connstring, the first definition is kept
+  for (unsigned int i = 0; i < device_count; i++)
+    sorted[i] = &context->user_defined_devices[i];
+  qsort(sorted, device_count, sizeof(*sorted), user_defined_device_cmp);
+  for (unsigned int i = 1; i < device_count; i++) {
+    if (strcmp(sorted[i - 1]->connstring, sorted[i]->connstring) == 0)
+      ignored[sorted[i] - context->user_defined_devices] = true;
+  }
+  free(sorted);
+
+  for (unsigned int i = 0; i < device_count; i++) {
+    struct nfc_user_defined_device *device = &context->user_defined_devices[i];
+    if (device->connstring[0] == '\0') {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "User device \"%s\" has no connstring, ignored", device->name);
+      continue;
+    }
+    if (ignored[i]) {
+      log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_INFO, "User device \"%s\" (%s) is already defined, ignored", device->name, device->connstring);
+      continue;
+    }
+    if (count != i)
+      context->user_defined_devices[count] = *device;
+    count++;
+  }
+  context->user_defined_device_count = count;
+  free(ignored);
+}
+
+/*
+ * The configuration comes from \a config when given, in libnfc.conf syntax,
+ * otherwise from the configuration files; environment variables apply to both.
+ */
 nfc_context *
-nfc_context_new(void)
+nfc_context_new(const char *config, const size_t config_len)
 {
   nfc_context *res = malloc(sizeof(*res));
 
@@ -87,30 +170,32 @@ nfc_context_new(void)
   res->log_level = 1;
 #endif
 
-  // Clear user defined devices array
-  for (int i = 0; i < MAX_USER_DEFINED_DEVICES; i++) {
-    strcpy(res->user_defined_devices[i].name, "");
-    strcpy(res->user_defined_devices[i].connstring, "");
-    res->user_defined_devices[i].optional = false;
-  }
+  // User defined devices table is allocated on the first device
+  res->user_defined_devices = NULL;
   res->user_defined_device_count = 0;
+  res->user_defined_device_capacity = 0;
 
 #ifdef ENVVARS
   // Load user defined device from environment variable at first
   char *envvar = getenv("LIBNFC_DEFAULT_DEVICE");
-  if (envvar) {
-    strcpy(res->user_defined_devices[0].name, "user defined default device");
-    strncpy(res->user_defined_devices[0].connstring, envvar, NFC_BUFSIZE_CONNSTRING);
-    res->user_defined_devices[0].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
-    res->user_defined_device_count++;
+  struct nfc_user_defined_device *device;
+  if (envvar && (device = nfc_context_add_user_defined_device(res))) {
+    strcpy(device->name, "user defined default device");
+    strncpy(device->connstring, envvar, NFC_BUFSIZE_CONNSTRING);
+    device->connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
   }
 
 #endif // ENVVARS
 
+  if (config) {
+    // Load options from the caller's buffer, no file is read
+    conf_parse_buffer(config, config_len, res);
+  } else {
 #ifdef CONFFILES
-  // Load options from configuration file (ie. /etc/nfc/libnfc.conf)
-  conf_load(res);
+    // Load options from configuration file (ie. /etc/nfc/libnfc.conf)
+    conf_load(res);
 #endif // CONFFILES
+  }
 
 #ifdef ENVVARS
   // Environment variables
@@ -118,10 +203,12 @@ nfc_context_new(void)
   // Load user defined device from environment variable as the only reader
   envvar = getenv("LIBNFC_DEVICE");
   if (envvar) {
-    strcpy(res->user_defined_devices[0].name, "user defined device");
-    strncpy(res->user_defined_devices[0].connstring, envvar, NFC_BUFSIZE_CONNSTRING);
-    res->user_defined_devices[0].connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
-    res->user_defined_device_count = 1;
+    res->user_defined_device_count = 0;
+    if ((device = nfc_context_add_user_defined_device(res))) {
+      strcpy(device->name, "user defined device");
+      strncpy(device->connstring, envvar, NFC_BUFSIZE_CONNSTRING);
+      device->connstring[NFC_BUFSIZE_CONNSTRING - 1] = '\0';
+    }
   }
 
   // Load "auto scan" option
@@ -142,6 +229,8 @@ nfc_context_new(void)
   // Initialize log before use it...
   log_init(res);
 
+  nfc_context_validate(res);
+
   // Debug context state
 #if defined DEBUG
   log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_NONE,  "log_level is set to %"PRIu32, res->log_level);
@@ -162,6 +251,7 @@ void
 nfc_context_free(nfc_context *context)
 {
   log_exit();
+  free(context->user_defined_devices);
   free(context);
 }
 
@@ -271,3 +361,20 @@ connstring_decode(const nfc_connstring connstring, const char *driver_name, cons
   return res;
 }
 
+/**
+ * @brief Monotonic clock in microseconds, for latency measurements
+ */
+uint64_t
+monotonic_time_us(void)
+{
+#ifndef _WIN32
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  LARGE_INTEGER freq, now;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&now);
+  return (uint64_t)(now.QuadPart * 1000000 / freq.QuadPart);
+#endif
+}
@@ -34,6 +34,7 @@
 
 #include <stdbool.h>
 #include <err.h>
+#include <pthread.h>
 #  include <sys/time.h>
 
 #include "nfc/nfc.h"
@@ -42,15 +43,21 @@
 
 /**
  * @macro HAL
- * @brief Execute corresponding driver function if exists.
+ * @brief Execute corresponding driver function if exists, holding the device lock.
  */
-#define HAL( FUNCTION, ... ) pnd->last_error = 0; \
-  if (pnd->driver->FUNCTION) { \
-    return pnd->driver->FUNCTION( __VA_ARGS__ ); \
-  } else { \
-    pnd->last_error = NFC_EDEVNOTSUPP; \
-    return false; \
-  }
+#define HAL( FUNCTION, ... ) do { \
+    int __res; \
+    nfc_device_lock(pnd); \
+    pnd->last_error = 0; \
+    if (pnd->driver->FUNCTION) { \
+      __res = pnd->driver->FUNCTION( __VA_ARGS__ ); \
+    } else { \
+      pnd->last_error = NFC_EDEVNOTSUPP; \
+      __res = false; \
+    } \
+    nfc_device_unlock(pnd); \
+    return __res; \
+  } while (0)
 
 #ifndef MIN
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
@@ -131,17 +138,23 @@ struct nfc_driver {
   int (*initiator_init_secure_element)(struct nfc_device *pnd);
   int (*initiator_select_passive_target)(struct nfc_device *pnd,  const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt);
   int (*initiator_poll_target)(struct nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const uint8_t uiPollNr, const uint8_t btPeriod, nfc_target *pnt);
+  int (*initiator_poll_target_low_power)(struct nfc_device *pnd, const nfc_modulation *pnmModulations, const size_t szModulations, const nfc_low_power_params *pparams, nfc_target *pnt, nfc_low_power_stats *pstats);
+  int (*initiator_inventory_iso14443a)(struct nfc_device *pnd, nfc_target ant[], const size_t szTargets);
+  int (*initiator_inventory_felica)(struct nfc_device *pnd, const nfc_baud_rate nbr, const uint16_t ui16SystemCode, nfc_target ant[], const size_t szTargets);
   int (*initiator_select_dep_target)(struct nfc_device *pnd, const nfc_dep_mode ndm, const nfc_baud_rate nbr, const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout);
   int (*initiator_deselect_target)(struct nfc_device *pnd);
   int (*initiator_transceive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout);
   int (*initiator_transceive_bits)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar);
   int (*initiator_transceive_bytes_timed)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, uint32_t *cycles);
-  int (*initiator_transceive_bits_timed)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, uint8_t *pbtRxPar, uint32_t *cycles);
+  int (*initiator_transceive_bits_timed)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar, uint8_t *pbtRx, const size_t szRx, uint8_t *pbtRxPar, uint32_t *cycles);
+  int (*device_calibrate_timer)(struct nfc_device *pnd, int *piCorrection);
+  int (*sniff)(struct nfc_device *pnd, const nfc_modulation nm, const nfc_mode nmFrom, nfc_sniff_callback cb, void *data, int timeout, nfc_sniff_stats *pstats);
   int (*initiator_target_is_present)(struct nfc_device *pnd, const nfc_target *pnt);
 
   int (*target_init)(struct nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout);
   int (*target_send_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout);
   int (*target_receive_bytes)(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, int timeout);
+  int (*target_send_receive_bytes)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRxLen, int timeout, uint64_t *pui64SentTime);
   int (*target_send_bits)(struct nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits, const uint8_t *pbtTxPar);
   int (*target_receive_bits)(struct nfc_device *pnd, uint8_t *pbtRx, const size_t szRxLen, uint8_t *pbtRxPar);
 
@@ -159,8 +172,6 @@ struct nfc_driver {
 #  define DEVICE_NAME_LENGTH  256
 #  define DEVICE_PORT_LENGTH  64
 
-#define MAX_USER_DEFINED_DEVICES 4
-
 struct nfc_user_defined_device {
   char name[DEVICE_NAME_LENGTH];
   nfc_connstring connstring;
@@ -176,12 +187,40 @@ struct nfc_context {
   bool allow_autoscan;
   bool allow_intrusive_scan;
   uint32_t  log_level;
-  struct nfc_user_defined_device user_defined_devices[MAX_USER_DEFINED_DEVICES];
+  struct nfc_user_defined_device *user_defined_devices;
   unsigned int user_defined_device_count;
+  unsigned int user_defined_device_capacity;
 };
 
-nfc_context *nfc_context_new(void);
+nfc_context *nfc_context_new(const char *config, const size_t config_len);
 void nfc_context_free(nfc_context *context);
+struct nfc_user_defined_device *nfc_context_add_user_defined_device(nfc_context *context);
+
+/** Largest ISO14443-4 frame, CRC included (FSDI 8) */
+#define ISO_DEP_FRAME_MAX 256
+
+/** State of the host-side ISO14443-4 engine, see iso-dep.c */
+struct iso_dep_state {
+  bool     bActive;
+  uint8_t  btBlockNumber;
+  /** PCB bits and prologue bytes of the blocks sent: CID and NAD */
+  uint8_t  btCid;
+  uint8_t  btNad;
+  /** Largest information field of the I-blocks sent */
+  size_t   szTxInf;
+  /** Chip RF timeout, in ms, for the frame waiting time */
+  int      iFwtMs;
+  /** Start of the next I-block, kept by nfc_initiator_iso_dep_send() until it is full or the command ends */
+  uint8_t  abtTx[ISO_DEP_FRAME_MAX];
+  size_t   szTx;
+  /** Last received I-block, not yet read by nfc_initiator_iso_dep_receive() */
+  uint8_t  abtInf[ISO_DEP_FRAME_MAX];
+  size_t   szInf;
+  bool     bInfPending;
+  /** The card chains its response: the next block comes after a R(ACK) */
+  bool     bRxChaining;
+  nfc_iso_dep_info info;
+};
 
 /**
  * @struct nfc_device
@@ -212,10 +251,32 @@ struct nfc_device {
   uint8_t  btSupportByte;
   /** Last reported error */
   int     last_error;
+  /** Serializes the public API calls on this device (recursive) */
+  pthread_mutex_t lock;
+  /** Counters filled by the chip layer, read with nfc_device_get_stats() */
+  nfc_device_stats stats;
+  /** Guards stats alone, so they can be read while a command blocks the device */
+  pthread_mutex_t stats_lock;
+  /** Set by nfc_close(), which holds the lock until the device is freed */
+  bool bClosing;
+  /** Calls sleeping in nfc_device_sleep(), without the lock, and their wake-up */
+  pthread_mutex_t sleep_lock;
+  pthread_cond_t sleep_cond;
+  size_t  szSleepers;
+  bool    bSleepAborted;
+  /** Host-side ISO14443-4 engine */
+  struct iso_dep_state iso_dep;
 };
 
 nfc_device *nfc_device_new(const nfc_context *context, const nfc_connstring connstring);
 void        nfc_device_free(nfc_device *dev);
+void        nfc_device_lock(nfc_device *dev);
+void        nfc_device_unlock(nfc_device *dev);
+int         nfc_device_sleep(nfc_device *dev, const uint32_t ms);
+bool        nfc_device_abort_sleep(nfc_device *dev);
+void        nfc_device_wait_sleepers(nfc_device *dev);
+
+int nfc_target_send_receive_bytes_ext(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, uint64_t *pui64SentTime);
 
 void string_as_boolean(const char *s, bool *value);
 
@@ -225,4 +286,6 @@ void prepare_initiator_data(const nfc_modulation nm, uint8_t **ppbtInitiatorData
 
 int connstring_decode(const nfc_connstring connstring, const char *driver_name, const char *bus_name, char **pparam1, char **pparam2);
 
+uint64_t monotonic_time_us(void);
+
 #endif // __NFC_INTERNAL_H__
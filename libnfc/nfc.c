@@ -118,6 +118,10 @@
 #  include "drivers/pn532_i2c.h"
 #endif /* DRIVER_PN532_I2C_ENABLED */
 
+#if defined (DRIVER_BROKER_ENABLED)
+#  include "drivers/broker.h"
+#endif /* DRIVER_BROKER_ENABLED */
+
 
 #define LOG_CATEGORY "libnfc.general"
 #define LOG_GROUP    NFC_LOG_GROUP_GENERAL
@@ -129,32 +133,65 @@ struct nfc_driver_list {
 
 const struct nfc_driver_list *nfc_drivers = NULL;
 
+// Protects nfc_drivers and nfc_contexts. Nodes are only prepended and are freed
+// when the last context exits, so a list head read under the lock can be
+// walked without it for as long as the caller holds a context.
+static pthread_mutex_t nfc_drivers_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int nfc_contexts = 0;
+
+static int
+nfc_drivers_add(const struct nfc_driver *ndr)
+{
+  struct nfc_driver_list *pndl = (struct nfc_driver_list *)malloc(sizeof(struct nfc_driver_list));
+  if (!pndl)
+    return NFC_ESOFT;
+
+  pndl->driver = ndr;
+  pndl->next = nfc_drivers;
+  nfc_drivers = pndl;
+
+  return NFC_SUCCESS;
+}
+
+static const struct nfc_driver_list *
+nfc_drivers_get(void)
+{
+  pthread_mutex_lock(&nfc_drivers_lock);
+  const struct nfc_driver_list *pndl = nfc_drivers;
+  pthread_mutex_unlock(&nfc_drivers_lock);
+  return pndl;
+}
+
 static void
 nfc_drivers_init(void)
 {
+  // Registered first so that devices shared by nfcd are listed after local ones
+#if defined (DRIVER_BROKER_ENABLED)
+  nfc_drivers_add(&broker_driver);
+#endif /* DRIVER_BROKER_ENABLED */
 #if defined (DRIVER_PN53X_USB_ENABLED)
-  nfc_register_driver(&pn53x_usb_driver);
+  nfc_drivers_add(&pn53x_usb_driver);
 #endif /* DRIVER_PN53X_USB_ENABLED */
 #if defined (DRIVER_ACR122_PCSC_ENABLED)
-  nfc_register_driver(&acr122_pcsc_driver);
+  nfc_drivers_add(&acr122_pcsc_driver);
 #endif /* DRIVER_ACR122_PCSC_ENABLED */
 #if defined (DRIVER_ACR122_USB_ENABLED)
-  nfc_register_driver(&acr122_usb_driver);
+  nfc_drivers_add(&acr122_usb_driver);
 #endif /* DRIVER_ACR122_USB_ENABLED */
 #if defined (DRIVER_ACR122S_ENABLED)
-  nfc_register_driver(&acr122s_driver);
+  nfc_drivers_add(&acr122s_driver);
 #endif /* DRIVER_ACR122S_ENABLED */
 #if defined (DRIVER_PN532_UART_ENABLED)
-  nfc_register_driver(&pn532_uart_driver);
+  nfc_drivers_add(&pn532_uart_driver);
 #endif /* DRIVER_PN532_UART_ENABLED */
 #if defined (DRIVER_PN532_SPI_ENABLED)
-  nfc_register_driver(&pn532_spi_driver);
+  nfc_drivers_add(&pn532_spi_driver);
 #endif /* DRIVER_PN532_SPI_ENABLED */
 #if defined (DRIVER_PN532_I2C_ENABLED)
-  nfc_register_driver(&pn532_i2c_driver);
+  nfc_drivers_add(&pn532_i2c_driver);
 #endif /* DRIVER_PN532_I2C_ENABLED */
 #if defined (DRIVER_ARYGON_ENABLED)
-  nfc_register_driver(&arygon_driver);
+  nfc_drivers_add(&arygon_driver);
 #endif /* DRIVER_ARYGON_ENABLED */
 }
 
@@ -172,32 +209,56 @@ nfc_register_driver(const struct nfc_driver *ndr)
   if (!ndr)
     return NFC_EINVARG;
 
-  struct nfc_driver_list *pndl = (struct nfc_driver_list *)malloc(sizeof(struct nfc_driver_list));
-  if (!pndl)
-    return NFC_ESOFT;
+  pthread_mutex_lock(&nfc_drivers_lock);
+  int res = nfc_drivers_add(ndr);
+  pthread_mutex_unlock(&nfc_drivers_lock);
 
-  pndl->driver = ndr;
-  pndl->next = nfc_drivers;
-  nfc_drivers = pndl;
+  return res;
+}
 
-  return NFC_SUCCESS;
+static void
+nfc_init_context(nfc_context **context, const char *config, const size_t config_len)
+{
+  *context = nfc_context_new(config, config_len);
+  if (!*context) {
+    perror("malloc");
+    return;
+  }
+  pthread_mutex_lock(&nfc_drivers_lock);
+  if (!nfc_drivers)
+    nfc_drivers_init();
+  nfc_contexts++;
+  pthread_mutex_unlock(&nfc_drivers_lock);
 }
 
 /** @ingroup lib
  * @brief Initialize libnfc.
  * This function must be called before calling any other libnfc function
  * @param context Output location for nfc_context
+ *
+ * @note Contexts and devices may be used from several threads: calls on one
+ * device are serialized, so one worker thread per device needs no locking.
  */
 void
 nfc_init(nfc_context **context)
 {
-  *context = nfc_context_new();
-  if (!*context) {
-    perror("malloc");
-    return;
-  }
-  if (!nfc_drivers)
-    nfc_drivers_init();
+  nfc_init_context(context, NULL, 0);
+}
+
+/** @ingroup lib
+ * @brief Initialize libnfc from an in-memory configuration.
+ * Same as nfc_init() but the configuration is read from \a config, in the
+ * libnfc.conf syntax, instead of the configuration files: neither libnfc.conf
+ * nor devices.d is read. Several devices may be defined, each one starting
+ * with its own device.name or device.connstring line.
+ * @param context Output location for nfc_context
+ * @param config Configuration text, which does not need to be NUL-terminated
+ * @param config_len Length of \a config
+ */
+void
+nfc_init_from_buffer(nfc_context **context, const char *config, const size_t config_len)
+{
+  nfc_init_context(context, config ? config : "", config ? config_len : 0);
 }
 
 /** @ingroup lib
@@ -208,11 +269,16 @@ nfc_init(nfc_context **context)
 void
 nfc_exit(nfc_context *context)
 {
-  while (nfc_drivers) {
-    struct nfc_driver_list *pndl = (struct nfc_driver_list *) nfc_drivers;
-    nfc_drivers = pndl->next;
-    free(pndl);
+  pthread_mutex_lock(&nfc_drivers_lock);
+  // Other contexts may still be walking the driver list
+  if (nfc_contexts && !--nfc_contexts) {
+    while (nfc_drivers) {
+      struct nfc_driver_list *pndl = (struct nfc_driver_list *) nfc_drivers;
+      nfc_drivers = pndl->next;
+      free(pndl);
+    }
   }
+  pthread_mutex_unlock(&nfc_drivers_lock);
 
   nfc_context_free(context);
 }
@@ -239,6 +305,7 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
 {
   nfc_device *pnd = NULL;
 
+  log_use_context(context);
   nfc_connstring ncs;
   if (connstring == NULL) {
     if (!nfc_list_devices(context, &ncs, 1)) {
@@ -250,7 +317,7 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
   }
 
   // Search through the device list for an available device
-  const struct nfc_driver_list *pndl = nfc_drivers;
+  const struct nfc_driver_list *pndl = nfc_drivers_get();
   while (pndl) {
     const struct nfc_driver *ndr = pndl->driver;
 
@@ -274,10 +341,11 @@ nfc_open(nfc_context *context, const nfc_connstring connstring)
       log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_DEBUG, "Unable to open \"%s\".", ncs);
       return NULL;
     }
-    for (uint32_t i = 0; i > context->user_defined_device_count; i++) {
+    for (uint32_t i = 0; i < context->user_defined_device_count; i++) {
       if (strcmp(ncs, context->user_defined_devices[i].connstring) == 0) {
         // This is a device sets by user, we use the device name given by user
-        strcpy(pnd->name, context->user_defined_devices[i].name);
+        if (context->user_defined_devices[i].name[0] != '\0')
+          strcpy(pnd->name, context->user_defined_devices[i].name);
         break;
       }
     }
@@ -300,6 +368,12 @@ void
 nfc_close(nfc_device *pnd)
 {
   if (pnd) {
+    // Let a call running in another thread complete, and keep further calls
+    // out: the lock is released by nfc_device_free(), right before the free
+    nfc_device_lock(pnd);
+    pnd->bClosing = true;
+    // A call sleeping without the lock, e.g. between two low-power polls, is woken up and completes first
+    nfc_device_wait_sleepers(pnd);
     // Close, clean up and release the device
     pnd->driver->close(pnd);
   }
@@ -318,38 +392,17 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
 {
   size_t device_found = 0;
 
-#ifdef CONFFILES
-  // Load manually configured devices (from config file and env variables)
-  // TODO From env var...
+  log_use_context(context);
+  // Load manually configured devices (from config file, configuration buffer and env variables)
   for (uint32_t i = 0; i < context->user_defined_device_count; i++) {
     if (context->user_defined_devices[i].optional) {
       // let's make sure the device exists
       nfc_device *pnd = NULL;
 
-#ifdef ENVVARS
-      char *env_log_level = getenv("LIBNFC_LOG_LEVEL");
-      char *old_env_log_level = NULL;
-      // do it silently
-      if (env_log_level) {
-        if ((old_env_log_level = malloc(strlen(env_log_level) + 1)) == NULL) {
-          log_put(LOG_GROUP, LOG_CATEGORY, NFC_LOG_PRIORITY_ERROR, "%s", "Unable to malloc()");
-          return 0;
-        }
-        strcpy(old_env_log_level, env_log_level);
-      }
-      setenv("LIBNFC_LOG_LEVEL", "0", 1);
-#endif // ENVVARS
-
+      // do it silently, only in this thread
+      log_mute(true);
       pnd = nfc_open(context, context->user_defined_devices[i].connstring);
-
-#ifdef ENVVARS
-      if (old_env_log_level) {
-        setenv("LIBNFC_LOG_LEVEL", old_env_log_level, 1);
-        free(old_env_log_level);
-      } else {
-        unsetenv("LIBNFC_LOG_LEVEL");
-      }
-#endif // ENVVARS
+      log_mute(false);
 
       if (pnd) {
         nfc_close(pnd);
@@ -367,11 +420,10 @@ nfc_list_devices(nfc_context *context, nfc_connstring connstrings[], const size_
         return device_found;
     }
   }
-#endif // CONFFILES
 
   // Device auto-detection
   if (context->allow_autoscan) {
-    const struct nfc_driver_list *pndl = nfc_drivers;
+    const struct nfc_driver_list *pndl = nfc_drivers_get();
     while (pndl) {
       const struct nfc_driver *ndr = pndl->driver;
       if ((ndr->scan_type == NOT_INTRUSIVE) || ((context->allow_intrusive_scan) && (ndr->scan_type == INTRUSIVE))) {
@@ -428,28 +480,8 @@ nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const
   HAL(device_set_property_bool, pnd, property, bEnable);
 }
 
-/** @ingroup initiator
- * @brief Initialize NFC device as initiator (reader)
- * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
- * @param pnd \a nfc_device struct pointer that represent currently used device
- *
- * The NFC device is configured to function as RFID reader.
- * After initialization it can be used to communicate to passive RFID tags and active NFC devices.
- * The reader will act as initiator to communicate peer 2 peer (NFCIP) to other active NFC devices.
- * - Crc is handled by the device (NP_HANDLE_CRC = true)
- * - Parity is handled the device (NP_HANDLE_PARITY = true)
- * - Cryto1 cipher is disabled (NP_ACTIVATE_CRYPTO1 = false)
- * - Easy framing is enabled (NP_EASY_FRAMING = true)
- * - Auto-switching in ISO14443-4 mode is enabled (NP_AUTO_ISO14443_4 = true)
- * - Invalid frames are not accepted (NP_ACCEPT_INVALID_FRAMES = false)
- * - Multiple frames are not accepted (NP_ACCEPT_MULTIPLE_FRAMES = false)
- * - 14443-A mode is activated (NP_FORCE_ISO14443_A = true)
- * - speed is set to 106 kbps (NP_FORCE_SPEED_106 = true)
- * - Let the device try forever to find a target (NP_INFINITE_SELECT = true)
- * - RF field is shortly dropped (if it was enabled) then activated again
- */
-int
-nfc_initiator_init(nfc_device *pnd)
+static int
+nfc_initiator_init_locked(nfc_device *pnd)
 {
   int res = 0;
   // Drop the field for a while
@@ -479,6 +511,35 @@ nfc_initiator_init(nfc_device *pnd)
   HAL(initiator_init, pnd);
 }
 
+/** @ingroup initiator
+ * @brief Initialize NFC device as initiator (reader)
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ *
+ * The NFC device is configured to function as RFID reader.
+ * After initialization it can be used to communicate to passive RFID tags and active NFC devices.
+ * The reader will act as initiator to communicate peer 2 peer (NFCIP) to other active NFC devices.
+ * - Crc is handled by the device (NP_HANDLE_CRC = true)
+ * - Parity is handled the device (NP_HANDLE_PARITY = true)
+ * - Cryto1 cipher is disabled (NP_ACTIVATE_CRYPTO1 = false)
+ * - Easy framing is enabled (NP_EASY_FRAMING = true)
+ * - Auto-switching in ISO14443-4 mode is enabled (NP_AUTO_ISO14443_4 = true)
+ * - Invalid frames are not accepted (NP_ACCEPT_INVALID_FRAMES = false)
+ * - Multiple frames are not accepted (NP_ACCEPT_MULTIPLE_FRAMES = false)
+ * - 14443-A mode is activated (NP_FORCE_ISO14443_A = true)
+ * - speed is set to 106 kbps (NP_FORCE_SPEED_106 = true)
+ * - Let the device try forever to find a target (NP_INFINITE_SELECT = true)
+ * - RF field is shortly dropped (if it was enabled) then activated again
+ */
+int
+nfc_initiator_init(nfc_device *pnd)
+{
+  nfc_device_lock(pnd);
+  int res = nfc_initiator_init_locked(pnd);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
 /** @ingroup initiator
  * @brief Initialize NFC device as initiator with its secure element initiator (reader)
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
@@ -541,26 +602,10 @@ nfc_initiator_select_passive_target(nfc_device *pnd,
   HAL(initiator_select_passive_target, pnd, nm, abtInit, szInit, pnt);
 }
 
-/** @ingroup initiator
- * @brief List passive or emulated tags
- * @return Returns the number of targets found on success, otherwise returns libnfc's error code (negative value)
- *
- * @param pnd \a nfc_device struct pointer that represent currently used device
- * @param nm desired modulation
- * @param[out] ant array of \a nfc_target that will be filled with targets info
- * @param szTargets size of \a ant (will be the max targets listed)
- *
- * The NFC device will try to find the available passive tags. Some NFC devices
- * are capable to emulate passive tags. The standards (ISO18092 and ECMA-340)
- * describe the modulation that can be used for reader to passive
- * communications. The chip needs to know with what kind of tag it is dealing
- * with, therefore the initial modulation and speed (106, 212 or 424 kbps)
- * should be supplied.
- */
-int
-nfc_initiator_list_passive_targets(nfc_device *pnd,
-                                   const nfc_modulation nm,
-                                   nfc_target ant[], const size_t szTargets)
+static int
+nfc_initiator_list_passive_targets_locked(nfc_device *pnd,
+                                          const nfc_modulation nm,
+                                          nfc_target ant[], const size_t szTargets)
 {
   nfc_target nt;
   size_t  szTargetFound = 0;
@@ -576,6 +621,18 @@ nfc_initiator_list_passive_targets(nfc_device *pnd,
     return res;
   }
 
+  // FeliCa cards are never deselected: they are told apart by the time slot they answer POLLING in
+  if ((nm.nmt == NMT_FELICA) && pnd->driver->initiator_inventory_felica) {
+    res = nfc_initiator_inventory_felica(pnd, nm.nbr, 0xffff, ant, szTargets);
+    if (bInfiniteSelect) {
+      int res2;
+      if ((res2 = nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, true)) < 0) {
+        return res2;
+      }
+    }
+    return res;
+  }
+
   prepare_initiator_data(nm, &pbtInitData, &szInitDataLen);
 
   while (nfc_initiator_select_passive_target(pnd, nm, pbtInitData, szInitDataLen, &nt) > 0) {
@@ -610,6 +667,33 @@ nfc_initiator_list_passive_targets(nfc_device *pnd,
   return szTargetFound;
 }
 
+/** @ingroup initiator
+ * @brief List passive or emulated tags
+ * @return Returns the number of targets found on success, otherwise returns libnfc's error code (negative value)
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param nm desired modulation
+ * @param[out] ant array of \a nfc_target that will be filled with targets info
+ * @param szTargets size of \a ant (will be the max targets listed)
+ *
+ * The NFC device will try to find the available passive tags. Some NFC devices
+ * are capable to emulate passive tags. The standards (ISO18092 and ECMA-340)
+ * describe the modulation that can be used for reader to passive
+ * communications. The chip needs to know with what kind of tag it is dealing
+ * with, therefore the initial modulation and speed (106, 212 or 424 kbps)
+ * should be supplied.
+ */
+int
+nfc_initiator_list_passive_targets(nfc_device *pnd,
+                                   const nfc_modulation nm,
+                                   nfc_target ant[], const size_t szTargets)
+{
+  nfc_device_lock(pnd);
+  int res = nfc_initiator_list_passive_targets_locked(pnd, nm, ant, szTargets);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
 /** @ingroup initiator
  * @brief Polling for NFC targets
  * @return Returns polled targets count, otherwise returns libnfc's error code (negative value).
@@ -632,37 +716,90 @@ nfc_initiator_poll_target(nfc_device *pnd,
   HAL(initiator_poll_target, pnd, pnmModulations, szModulations, uiPollNr, uiPeriod, pnt);
 }
 
+/** @ingroup initiator
+ * @brief Poll for NFC targets with the chip powered down between polls
+ * @return Returns polled targets count, 0 when \a pparams timeout expired, NFC_EOPABORTED after nfc_abort_command(), otherwise returns libnfc's error code (negative value).
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnmModulations desired modulations
+ * @param szModulations size of \a pnmModulations
+ * @param pparams sleep time between polls and timeout
+ * @param[out] pnt pointer on \a nfc_target (over)writable struct
+ * @param[out] pstats \a nfc_low_power_stats struct pointer which will be filled, may be NULL
+ *
+ * Between two short poll windows the RF field is off and the chip is in
+ * PowerDown, so a battery-powered reader only draws power during the windows.
+ * Each window tries every modulation once. \a pstats reports the share of
+ * time the chip was awake and how long waking it up took; the worst-case
+ * detection latency is \a sleep_ms plus the longest window.
+ *
+ * The device lock is released while the chip sleeps: other threads may use
+ * the device, and nfc_abort_command() or nfc_close() end the call right away.
+ *
+ * @note Only supported by PN532 devices. The chip only wakes up for the
+ * host, which sleeps on its own clock. On return the chip is awake with the
+ * field on.
+ */
+int
+nfc_initiator_poll_target_low_power(nfc_device *pnd,
+                                    const nfc_modulation *pnmModulations, const size_t szModulations,
+                                    const nfc_low_power_params *pparams,
+                                    nfc_target *pnt, nfc_low_power_stats *pstats)
+{
+  HAL(initiator_poll_target_low_power, pnd, pnmModulations, szModulations, pparams, pnt, pstats);
+}
 
 /** @ingroup initiator
- * @brief Select a target and request active or passive mode for D.E.P. (Data Exchange Protocol)
- * @return Returns selected D.E.P targets count on success, otherwise returns libnfc's error code (negative value).
+ * @brief Inventory every ISO14443A tag of the field
+ * @return Returns the number of targets found on success, otherwise returns libnfc's error code (negative value)
  *
  * @param pnd \a nfc_device struct pointer that represent currently used device
- * @param ndm desired D.E.P. mode (\a NDM_ACTIVE or \a NDM_PASSIVE for active, respectively passive mode)
- * @param nbr desired baud rate
- * @param ndiInitiator pointer \a nfc_dep_info struct that contains \e NFCID3 and \e General \e Bytes to set to the initiator device (optionnal, can be \e NULL)
- * @param[out] pnt is a \a nfc_target struct pointer where target information will be put.
- * @param timeout in milliseconds
+ * @param[out] ant array of \a nfc_target that will be filled with targets info
+ * @param szTargets size of \a ant (will be the max targets listed)
  *
- * The NFC device will try to find an available D.E.P. target. The standards
- * (ISO18092 and ECMA-340) describe the modulation that can be used for reader
- * to passive communications.
+ * Unlike nfc_initiator_list_passive_targets(), the anticollision is run by
+ * libnfc with raw frames, bit by bit: it resolves any number of tags stacked
+ * in the field, including tags whose UIDs share their first bytes.
+ * Each tag found is left HALTed; its ATQA is the one seen when it was found,
+ * it may be the OR of several tags ones.
  *
- * @note \a nfc_dep_info will be returned when the target was acquired successfully.
+ * @warning The device must be initialized as initiator with the RF field on.
+ */
+int
+nfc_initiator_inventory_iso14443a(nfc_device *pnd, nfc_target ant[], const size_t szTargets)
+{
+  HAL(initiator_inventory_iso14443a, pnd, ant, szTargets);
+}
+
+/** @ingroup initiator
+ * @brief Inventory every FeliCa card of the field
+ * @return Returns the number of targets found on success, otherwise returns libnfc's error code (negative value)
  *
- * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
- * If timeout equals to -1, the default timeout will be used
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param nbr baud rate of the cards, \a NBR_212 or \a NBR_424
+ * @param ui16SystemCode system code the cards must hold, 0xffff for any
+ * @param[out] ant array of \a nfc_target that will be filled with targets info
+ * @param szTargets size of \a ant (will be the max targets listed)
+ *
+ * POLLING is sent with 16 time slots: each card answers in a slot of its
+ * choice, so a single exchange collects the cards which did not pick the same
+ * slot. Cards are told apart by their IDm; POLLING is repeated, a few times
+ * at most, while some slots held colliding answers. A field with a single
+ * card costs one POLLING.
+ * The first target, if any, is the selected one: when the cards keep
+ * colliding so that none can be selected, NFC_ETGRELEASED is returned.
+ *
+ * @warning The device must be initialized as initiator with the RF field on.
  */
 int
-nfc_initiator_select_dep_target(nfc_device *pnd,
-                                const nfc_dep_mode ndm, const nfc_baud_rate nbr,
-                                const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout)
+nfc_initiator_inventory_felica(nfc_device *pnd, const nfc_baud_rate nbr, const uint16_t ui16SystemCode, nfc_target ant[], const size_t szTargets)
 {
-  HAL(initiator_select_dep_target, pnd, ndm, nbr, pndiInitiator, pnt, timeout);
+  HAL(initiator_inventory_felica, pnd, nbr, ui16SystemCode, ant, szTargets);
 }
 
+
 /** @ingroup initiator
- * @brief Poll a target and request active or passive mode for D.E.P. (Data Exchange Protocol)
+ * @brief Select a target and request active or passive mode for D.E.P. (Data Exchange Protocol)
  * @return Returns selected D.E.P targets count on success, otherwise returns libnfc's error code (negative value).
  *
  * @param pnd \a nfc_device struct pointer that represent currently used device
@@ -677,13 +814,24 @@ nfc_initiator_select_dep_target(nfc_device *pnd,
  * to passive communications.
  *
  * @note \a nfc_dep_info will be returned when the target was acquired successfully.
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
  */
 int
-nfc_initiator_poll_dep_target(struct nfc_device *pnd,
-                              const nfc_dep_mode ndm, const nfc_baud_rate nbr,
-                              const nfc_dep_info *pndiInitiator,
-                              nfc_target *pnt,
-                              const int timeout)
+nfc_initiator_select_dep_target(nfc_device *pnd,
+                                const nfc_dep_mode ndm, const nfc_baud_rate nbr,
+                                const nfc_dep_info *pndiInitiator, nfc_target *pnt, const int timeout)
+{
+  HAL(initiator_select_dep_target, pnd, ndm, nbr, pndiInitiator, pnt, timeout);
+}
+
+static int
+nfc_initiator_poll_dep_target_locked(struct nfc_device *pnd,
+                                     const nfc_dep_mode ndm, const nfc_baud_rate nbr,
+                                     const nfc_dep_info *pndiInitiator,
+                                     nfc_target *pnt,
+                                     const int timeout)
 {
   const int period = 300;
   int remaining_time = timeout;
@@ -714,6 +862,36 @@ end:
   return result;
 }
 
+/** @ingroup initiator
+ * @brief Poll a target and request active or passive mode for D.E.P. (Data Exchange Protocol)
+ * @return Returns selected D.E.P targets count on success, otherwise returns libnfc's error code (negative value).
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param ndm desired D.E.P. mode (\a NDM_ACTIVE or \a NDM_PASSIVE for active, respectively passive mode)
+ * @param nbr desired baud rate
+ * @param ndiInitiator pointer \a nfc_dep_info struct that contains \e NFCID3 and \e General \e Bytes to set to the initiator device (optionnal, can be \e NULL)
+ * @param[out] pnt is a \a nfc_target struct pointer where target information will be put.
+ * @param timeout in milliseconds
+ *
+ * The NFC device will try to find an available D.E.P. target. The standards
+ * (ISO18092 and ECMA-340) describe the modulation that can be used for reader
+ * to passive communications.
+ *
+ * @note \a nfc_dep_info will be returned when the target was acquired successfully.
+ */
+int
+nfc_initiator_poll_dep_target(struct nfc_device *pnd,
+                              const nfc_dep_mode ndm, const nfc_baud_rate nbr,
+                              const nfc_dep_info *pndiInitiator,
+                              nfc_target *pnt,
+                              const int timeout)
+{
+  nfc_device_lock(pnd);
+  int res = nfc_initiator_poll_dep_target_locked(pnd, ndm, nbr, pndiInitiator, pnt, timeout);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
 /** @ingroup initiator
  * @brief Deselect a selected passive or emulated tag
  * @return Returns 0 on success, otherwise returns libnfc's error code (negative value).
@@ -764,7 +942,7 @@ int
 nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
                                const size_t szRx, int timeout)
 {
-  HAL(initiator_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout)
+  HAL(initiator_transceive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout);
 }
 
 /** @ingroup initiator
@@ -827,6 +1005,8 @@ nfc_initiator_transceive_bits(nfc_device *pnd,
  * - A precise cycles counter will indicate the number of cycles between emission & reception of frames.
  * - It only supports mode with \a NP_EASY_FRAMING option disabled.
  * - Overall communication with the host is heavier and slower.
+ * - The device dependent part of the cycles count is a constant of the driver, see
+ *   nfc_device_calibrate_timer() to measure it instead.
  *
  * Timer control:
  * By default timer configuration tries to maximize the precision, which also limits the maximum
@@ -872,6 +1052,8 @@ nfc_initiator_target_is_present(nfc_device *pnd, const nfc_target *pnt)
  * - A precise cycles counter will indicate the number of cycles between emission & reception of frames.
  * - It only supports mode with \a NP_EASY_FRAMING option disabled and CRC must be handled manually.
  * - Overall communication with the host is heavier and slower.
+ * - The device dependent part of the cycles count is a constant of the driver, see
+ *   nfc_device_calibrate_timer() to measure it instead.
  *
  * Timer control:
  * By default timer configuration tries to maximize the precision, which also limits the maximum
@@ -892,45 +1074,187 @@ nfc_initiator_transceive_bits_timed(nfc_device *pnd,
                                     uint8_t *pbtRxPar,
                                     uint32_t *cycles)
 {
-  (void)szRx;
-  HAL(initiator_transceive_bits_timed, pnd, pbtTx, szTxBits, pbtTxPar, pbtRx, pbtRxPar, cycles);
+  HAL(initiator_transceive_bits_timed, pnd, pbtTx, szTxBits, pbtTxPar, pbtRx, szRx, pbtRxPar, cycles);
 }
 
-/** @ingroup target
- * @brief Initialize NFC device as an emulated tag
- * @return Returns received bytes count on success, otherwise returns libnfc's error code
+static int
+timing_compare(const void *a, const void *b)
+{
+  const uint32_t u32a = *(const uint32_t *) a;
+  const uint32_t u32b = *(const uint32_t *) b;
+  return (u32a > u32b) - (u32a < u32b);
+}
+
+static int
+nfc_initiator_measure_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, const bool bBits,
+                            uint8_t *pbtRx, const size_t szRx, const uint32_t max_cycles, const size_t szRuns, nfc_timing_stats *pstats)
+{
+  uint32_t *pu32Cycles;
+  int res = 0;
+
+  if ((szRuns == 0) || (pstats == NULL)) {
+    pnd->last_error = NFC_EINVARG;
+    return pnd->last_error;
+  }
+  if ((bBits && !pnd->driver->initiator_transceive_bits_timed) || (!bBits && !pnd->driver->initiator_transceive_bytes_timed)) {
+    pnd->last_error = NFC_EDEVNOTSUPP;
+    return pnd->last_error;
+  }
+  if ((pu32Cycles = malloc(szRuns * sizeof(*pu32Cycles))) == NULL) {
+    pnd->last_error = NFC_ESOFT;
+    return pnd->last_error;
+  }
+  memset(pstats, 0, sizeof(*pstats));
+
+  // The device is held for the whole series: no other thread's command comes in between
+  nfc_device_lock(pnd);
+  pnd->last_error = 0;
+  uint64_t ui64Sum = 0;
+  for (size_t n = 0; n < szRuns; n++) {
+    uint32_t cycles = max_cycles;
+    if (bBits)
+      res = pnd->driver->initiator_transceive_bits_timed(pnd, pbtTx, szTx, NULL, pbtRx, szRx, NULL, &cycles);
+    else
+      res = pnd->driver->initiator_transceive_bytes_timed(pnd, pbtTx, szTx, pbtRx, szRx, &cycles);
+    if (res < 0)
+      break;
+    pstats->runs++;
+    if ((res == 0) || (cycles == 0xFFFFFFFF))
+      continue;
+    pu32Cycles[pstats->answers++] = cycles;
+    ui64Sum += cycles;
+  }
+  nfc_device_unlock(pnd);
+
+  if (pstats->answers > 0) {
+    const size_t szAnswers = pstats->answers;
+    qsort(pu32Cycles, szAnswers, sizeof(*pu32Cycles), timing_compare);
+    pstats->min_cycles = pu32Cycles[0];
+    pstats->median_cycles = pu32Cycles[szAnswers / 2];
+    pstats->max_cycles = pu32Cycles[szAnswers - 1];
+    pstats->mean_cycles = (double) ui64Sum / szAnswers;
+    for (size_t n = 0; n < szAnswers; n++) {
+      pu32Cycles[n] = (pu32Cycles[n] > pstats->median_cycles) ? pu32Cycles[n] - pstats->median_cycles : pstats->median_cycles - pu32Cycles[n];
+    }
+    qsort(pu32Cycles, szAnswers, sizeof(*pu32Cycles), timing_compare);
+    pstats->mad_cycles = pu32Cycles[szAnswers / 2];
+  }
+  free(pu32Cycles);
+  return (res < 0) ? res : (int) pstats->answers;
+}
+
+/** @ingroup initiator
+ * @brief Repeat a timed bit-frame exchange and give statistics of the frame delay times
+ * @return Returns the number of exchanges answered by the target, otherwise returns libnfc's error code
  *
  * @param pnd \a nfc_device struct pointer that represent currently used device
- * @param pnt pointer to \a nfc_target struct that represents the wanted emulated target
+ * @param pbtTx contains a byte array of the frame that needs to be transmitted.
+ * @param szTxBits contains the length in bits.
+ * @param[out] pbtRx last answer of the target
+ * @param szRx size of \a pbtRx
+ * @param max_cycles largest delay to measure, 0 for the most precise timer settings (see nfc_initiator_transceive_bits_timed())
+ * @param szRuns number of exchanges
+ * @param[out] pstats \a nfc_timing_stats struct pointer which will be filled
  *
- * @note \a pnt can be updated by this function: if you set NBR_UNDEFINED
- * and/or NDM_UNDEFINED (ie. for DEP mode), these fields will be updated.
+ * The exchanges are done back to back while the device is held, e.g. for
+ * distance-bounding measurements. Unanswered exchanges are counted in
+ * \a runs only. On error, \a pstats covers the exchanges done so far.
  *
- * @param[out] pbtRx Rx buffer pointer
- * @param[out] szRx received bytes count
- * @param timeout in milliseconds
+ * @warning Same configuration requirements as nfc_initiator_transceive_bits_timed().
+ */
+int
+nfc_initiator_measure_bits_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTxBits,
+                                 uint8_t *pbtRx, const size_t szRx, const uint32_t max_cycles,
+                                 const size_t szRuns, nfc_timing_stats *pstats)
+{
+  return nfc_initiator_measure_timed(pnd, pbtTx, szTxBits, true, pbtRx, szRx, max_cycles, szRuns, pstats);
+}
+
+/** @ingroup initiator
+ * @brief Repeat a timed exchange and give statistics of the frame delay times
+ * @return Returns the number of exchanges answered by the target, otherwise returns libnfc's error code
  *
- * This function initializes NFC device in \e target mode in order to emulate a
- * tag using the specified \a nfc_target_mode_t.
- * - Crc is handled by the device (NP_HANDLE_CRC = true)
- * - Parity is handled the device (NP_HANDLE_PARITY = true)
- * - Cryto1 cipher is disabled (NP_ACTIVATE_CRYPTO1 = false)
- * - Auto-switching in ISO14443-4 mode is enabled (NP_AUTO_ISO14443_4 = true)
- * - Easy framing is disabled (NP_EASY_FRAMING = false)
- * - Invalid frames are not accepted (NP_ACCEPT_INVALID_FRAMES = false)
- * - Multiple frames are not accepted (NP_ACCEPT_MULTIPLE_FRAMES = false)
- * - RF field is dropped
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx contains a byte array of the frame that needs to be transmitted.
+ * @param szTx contains the length in bytes.
+ * @param[out] pbtRx last answer of the target
+ * @param szRx size of \a pbtRx
+ * @param max_cycles largest delay to measure, 0 for the most precise timer settings (see nfc_initiator_transceive_bytes_timed())
+ * @param szRuns number of exchanges
+ * @param[out] pstats \a nfc_timing_stats struct pointer which will be filled
+ *
+ * @see nfc_initiator_measure_bits_timed()
+ * @warning Same configuration requirements as nfc_initiator_transceive_bytes_timed().
+ */
+int
+nfc_initiator_measure_bytes_timed(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx,
+                                  uint8_t *pbtRx, const size_t szRx, const uint32_t max_cycles,
+                                  const size_t szRuns, nfc_timing_stats *pstats)
+{
+  return nfc_initiator_measure_timed(pnd, pbtTx, szTx, false, pbtRx, szRx, max_cycles, szRuns, pstats);
+}
+
+/** @ingroup dev
+ * @brief Measure the device dependent part of the timed exchanges cycles count
+ * @return Returns 0 on success, otherwise returns libnfc's error code
  *
- * @warning Be aware that this function will wait (hang) until a command is
- * received that is not part of the anti-collision. The RATS command for
- * example would wake up the emulator. After this is received, the send and
- * receive functions can be used.
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param[out] piCorrection correction now applied, in carrier cycles (optional, can be \e NULL)
+ *
+ * WUPA and ANTICOLLISION frames are exchanged with the ISO14443A target in
+ * the field, whose answers come after a delay fixed by ISO/IEC 14443-3
+ * (1172 or 1236 carrier cycles). The median of the differences with the
+ * counted cycles replaces the driver constant for the next
+ * nfc_initiator_transceive_bits_timed() and nfc_initiator_transceive_bytes_timed()
+ * calls, until the device is closed. \a NP_HANDLE_CRC, \a NP_HANDLE_PARITY
+ * and \a NP_EASY_FRAMING are left as they were.
+ *
+ * Nothing is calibrated behind the caller's back: any delay added between
+ * the device and the target, e.g. by a relay, is taken for a part of the
+ * device and hidden from the next measures.
+ *
+ * @warning The device must be set as initiator with only one genuine target
+ * in the field. The target is left in IDLE or READY state.
+ */
+int
+nfc_device_calibrate_timer(nfc_device *pnd, int *piCorrection)
+{
+  HAL(device_calibrate_timer, pnd, piCorrection);
+}
+
+/** @ingroup dev
+ * @brief Listen to the frames exchanged by other devices
+ * @return Returns the number of frames received, otherwise returns libnfc's error code
  *
- * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
- * If timeout equals to -1, the default timeout will be used
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param nm modulation and baud rate of the frames
+ * @param nmFrom \a N_TARGET to receive the frames sent by targets, \a N_INITIATOR for those sent by initiators
+ * @param cb function called for each frame; the sniffing stops when it returns non-zero
+ * @param data pointer passed to \a cb
+ * @param timeout duration of the sniffing in milliseconds, 0 or less to stop on \a cb only
+ * @param[out] pstats \a nfc_sniff_stats struct pointer which will be filled (optional, can be \e NULL)
+ *
+ * The device only receives: the RF field is left as it is, it should
+ * usually be turned off with \a NP_ACTIVATE_FIELD first. The chip buffers
+ * the frames (\a NP_ACCEPT_MULTIPLE_FRAMES) and the host drains its FIFO as
+ * fast as the transport allows, \a pstats tells how often it overflowed.
+ * Frames ending within one poll of each other are delivered as one. A frame
+ * starting less than one poll after the end of the previous one may have its
+ * first bytes delivered with it: when the chip was already receiving it at
+ * that poll, both are flagged \a NFC_SNIFF_MERGED, intact or not, and should
+ * be discarded.
+ *
+ * @warning \a cb runs with the device held: it must not use \a pnd.
  */
 int
-nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
+nfc_sniff(nfc_device *pnd, const nfc_modulation nm, const nfc_mode nmFrom, nfc_sniff_callback cb, void *data, int timeout,
+          nfc_sniff_stats *pstats)
+{
+  HAL(sniff, pnd, nm, nmFrom, cb, data, timeout, pstats);
+}
+
+static int
+nfc_target_init_locked(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
 {
   int res = 0;
   // Disallow invalid frame
@@ -960,6 +1284,48 @@ nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t s
   HAL(target_init, pnd, pnt, pbtRx, szRx, timeout);
 }
 
+/** @ingroup target
+ * @brief Initialize NFC device as an emulated tag
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pnt pointer to \a nfc_target struct that represents the wanted emulated target
+ *
+ * @note \a pnt can be updated by this function: if you set NBR_UNDEFINED
+ * and/or NDM_UNDEFINED (ie. for DEP mode), these fields will be updated.
+ *
+ * @param[out] pbtRx Rx buffer pointer
+ * @param[out] szRx received bytes count
+ * @param timeout in milliseconds
+ *
+ * This function initializes NFC device in \e target mode in order to emulate a
+ * tag using the specified \a nfc_target_mode_t.
+ * - Crc is handled by the device (NP_HANDLE_CRC = true)
+ * - Parity is handled the device (NP_HANDLE_PARITY = true)
+ * - Cryto1 cipher is disabled (NP_ACTIVATE_CRYPTO1 = false)
+ * - Auto-switching in ISO14443-4 mode is enabled (NP_AUTO_ISO14443_4 = true)
+ * - Easy framing is disabled (NP_EASY_FRAMING = false)
+ * - Invalid frames are not accepted (NP_ACCEPT_INVALID_FRAMES = false)
+ * - Multiple frames are not accepted (NP_ACCEPT_MULTIPLE_FRAMES = false)
+ * - RF field is dropped
+ *
+ * @warning Be aware that this function will wait (hang) until a command is
+ * received that is not part of the anti-collision. The RATS command for
+ * example would wake up the emulator. After this is received, the send and
+ * receive functions can be used.
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_target_init(nfc_device *pnd, nfc_target *pnt, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  nfc_device_lock(pnd);
+  int res = nfc_target_init_locked(pnd, pnt, pbtRx, szRx, timeout);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
 /** @ingroup dev
  * @brief Turn NFC device in idle mode
  * @return Returns 0 on success, otherwise returns libnfc's error code.
@@ -986,11 +1352,18 @@ nfc_idle(nfc_device *pnd)
  * This function attempt to abort the current running command.
  *
  * @note The blocking function (ie. nfc_target_init()) will failed with DEABORT error.
+ * @note This function does not wait for the device lock held by the blocking function, it can be called from another thread.
  */
 int
 nfc_abort_command(nfc_device *pnd)
 {
-  HAL(abort_command, pnd);
+  // Not serialized: the command to abort runs in another thread, which holds the device lock
+  if (nfc_device_abort_sleep(pnd))
+    return NFC_SUCCESS;
+  if (pnd->driver->abort_command)
+    return pnd->driver->abort_command(pnd);
+  pnd->last_error = NFC_EDEVNOTSUPP;
+  return false;
 }
 
 /** @ingroup target
@@ -1034,6 +1407,57 @@ nfc_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int
   HAL(target_receive_bytes, pnd, pbtRx, szRx, timeout);
 }
 
+static int
+nfc_target_send_receive_bytes_locked(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, uint64_t *pui64SentTime)
+{
+  int res;
+  if (pnd->driver->target_send_receive_bytes) {
+    HAL(target_send_receive_bytes, pnd, pbtTx, szTx, pbtRx, szRx, timeout, pui64SentTime);
+  }
+  if ((res = nfc_target_send_bytes(pnd, pbtTx, szTx, timeout)) < 0)
+    return res;
+  if (pui64SentTime)
+    *pui64SentTime = monotonic_time_us();
+  return nfc_target_receive_bytes(pnd, pbtRx, szRx, timeout);
+}
+
+/*
+ * Same as nfc_target_send_receive_bytes(), also reports in *pui64SentTime
+ * (if not NULL) when the response was sent, see monotonic_time_us().
+ */
+int
+nfc_target_send_receive_bytes_ext(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout, uint64_t *pui64SentTime)
+{
+  nfc_device_lock(pnd);
+  int res = nfc_target_send_receive_bytes_locked(pnd, pbtTx, szTx, pbtRx, szRx, timeout, pui64SentTime);
+  nfc_device_unlock(pnd);
+  return res;
+}
+
+/** @ingroup target
+ * @brief Send a response then receive the next frame
+ * @return Returns received bytes count on success, otherwise returns libnfc's error code
+ *
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pbtTx pointer to Tx buffer
+ * @param szTx size of Tx buffer
+ * @param pbtRx pointer to Rx buffer
+ * @param szRx size of Rx buffer
+ * @param timeout in milliseconds, for each of both operations
+ *
+ * This function is equivalent to nfc_target_send_bytes() followed by
+ * nfc_target_receive_bytes(), but lets the driver re-arm the reception as soon
+ * as the response is sent, which shortens the turnaround of emulated targets.
+ *
+ * If timeout equals to 0, the function blocks indefinitely (until an error is raised or function is completed)
+ * If timeout equals to -1, the default timeout will be used
+ */
+int
+nfc_target_send_receive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  return nfc_target_send_receive_bytes_ext(pnd, pbtTx, szTx, pbtRx, szRx, timeout, NULL);
+}
+
 /** @ingroup target
  * @brief Send raw bit-frames
  * @return Returns sent bits count on success, otherwise returns libnfc's error code.
@@ -1206,6 +1630,27 @@ nfc_device_get_supported_baud_rate(nfc_device *pnd, const nfc_modulation_type nm
   HAL(get_supported_baud_rate, pnd, nmt, supported_br);
 }
 
+/** @ingroup data
+ * @brief Get the device counters
+ * @return Returns 0 on success, otherwise returns libnfc's error code (negative value)
+ * @param pnd \a nfc_device struct pointer that represent currently used device
+ * @param pstats \a nfc_device_stats struct pointer which will be filled
+ *
+ * The counters are updated for every command sent to the chip since the
+ * device was opened. They have their own lock: a snapshot can be taken from
+ * another thread while the device is busy, e.g. waiting for a target.
+ */
+int
+nfc_device_get_stats(nfc_device *pnd, nfc_device_stats *pstats)
+{
+  if (!pstats)
+    return NFC_EINVARG;
+  pthread_mutex_lock(&pnd->stats_lock);
+  *pstats = pnd->stats;
+  pthread_mutex_unlock(&pnd->stats_lock);
+  return NFC_SUCCESS;
+}
+
 /* Misc. functions */
 
 /** @ingroup misc
@@ -0,0 +1,408 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>
+ *
+ */
+
+/**
+ * @file threads-bench.c
+ * @brief Multi-threaded stress benchmark against simulated devices
+ *
+ * This program is linked with the library objects and registers a driver
+ * ("sim") whose devices hold three ISO14443-A tags in their field and echo
+ * the frames they are sent, each operation taking a fixed time. The driver
+ * detects operations running concurrently on one device and selections made
+ * while NP_INFINITE_SELECT is set, i.e. in the middle of another thread's
+ * nfc_initiator_list_passive_targets(). Workers run initiator setup, target
+ * listing and transceive loops, one per device or several per device, while
+ * other threads create and destroy contexts and scan the devices.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+#include "nfc-internal.h"
+
+#define SIM_DRIVER_NAME "sim"
+#define SIM_DEVICES 8
+#define SIM_TAGS 3
+#define SIM_MAX_THREADS 32
+
+struct sim_data {
+  int      iInFlight;
+  bool     bInfiniteSelect;
+  bool     abHalted[SIM_TAGS];
+  int      iSelected;
+  unsigned long ulOverlaps;           // operations started while another was running
+  unsigned long ulInterleaved;        // selections with NP_INFINITE_SELECT set
+};
+
+#define DRIVER_DATA(pnd) ((struct sim_data*)(pnd->driver_data))
+
+static long lLatency = 20; // µs per operation
+
+static void
+sim_enter(nfc_device *pnd)
+{
+  if (__sync_fetch_and_add(&DRIVER_DATA(pnd)->iInFlight, 1) != 0)
+    __sync_fetch_and_add(&DRIVER_DATA(pnd)->ulOverlaps, 1);
+  if (lLatency > 0) {
+    struct timespec ts = { 0, lLatency * 1000 };
+    nanosleep(&ts, NULL);
+  }
+}
+
+static void
+sim_leave(nfc_device *pnd)
+{
+  __sync_fetch_and_sub(&DRIVER_DATA(pnd)->iInFlight, 1);
+}
+
+static const struct nfc_driver sim_driver;
+
+static size_t
+sim_scan(const nfc_context *context, nfc_connstring connstrings[], const size_t connstrings_len)
+{
+  (void) context;
+  size_t n;
+  for (n = 0; (n < SIM_DEVICES) && (n < connstrings_len); n++)
+    snprintf(connstrings[n], sizeof(nfc_connstring), "%s:%lu", SIM_DRIVER_NAME, (unsigned long) n);
+  return n;
+}
+
+static nfc_device *
+sim_open(const nfc_context *context, const nfc_connstring connstring)
+{
+  nfc_device *pnd = nfc_device_new(context, connstring);
+  if (!pnd)
+    return NULL;
+  pnd->driver_data = calloc(1, sizeof(struct sim_data));
+  if (!pnd->driver_data) {
+    nfc_device_free(pnd);
+    return NULL;
+  }
+  DRIVER_DATA(pnd)->iSelected = -1;
+  snprintf(pnd->name, sizeof(pnd->name), "simulated device %s", connstring);
+  pnd->driver = &sim_driver;
+  return pnd;
+}
+
+static void
+sim_close(nfc_device *pnd)
+{
+  nfc_device_free(pnd);
+}
+
+static int
+sim_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable)
+{
+  sim_enter(pnd);
+  if (property == NP_INFINITE_SELECT)
+    DRIVER_DATA(pnd)->bInfiniteSelect = bEnable;
+  sim_leave(pnd);
+  return NFC_SUCCESS;
+}
+
+static int
+sim_initiator_init(nfc_device *pnd)
+{
+  sim_enter(pnd);
+  for (int n = 0; n < SIM_TAGS; n++)
+    DRIVER_DATA(pnd)->abHalted[n] = false;
+  DRIVER_DATA(pnd)->iSelected = -1;
+  sim_leave(pnd);
+  return NFC_SUCCESS;
+}
+
+// Selects the first tag which is not halted; when all are, they answer again from the next selection on
+static int
+sim_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData, const size_t szInitData, nfc_target *pnt)
+{
+  (void) pbtInitData;
+  (void) szInitData;
+  int res = 0;
+
+  sim_enter(pnd);
+  if (DRIVER_DATA(pnd)->bInfiniteSelect)
+    DRIVER_DATA(pnd)->ulInterleaved++;
+  DRIVER_DATA(pnd)->iSelected = -1;
+  for (int n = 0; n < SIM_TAGS; n++) {
+    if (!DRIVER_DATA(pnd)->abHalted[n]) {
+      DRIVER_DATA(pnd)->iSelected = n;
+      break;
+    }
+  }
+  if (DRIVER_DATA(pnd)->iSelected < 0) {
+    for (int n = 0; n < SIM_TAGS; n++)
+      DRIVER_DATA(pnd)->abHalted[n] = false;
+  } else if (pnt) {
+    memset(pnt, 0, sizeof(*pnt));
+    pnt->nm = nm;
+    pnt->nti.nai.abtAtqa[1] = 0x44;
+    pnt->nti.nai.szUidLen = 7;
+    memcpy(pnt->nti.nai.abtUid, "\x04\x10\x20\x30\x40\x50", 6);
+    pnt->nti.nai.abtUid[6] = (uint8_t) DRIVER_DATA(pnd)->iSelected;
+    res = 1;
+  }
+  sim_leave(pnd);
+  return res;
+}
+
+static int
+sim_initiator_deselect_target(nfc_device *pnd)
+{
+  sim_enter(pnd);
+  if (DRIVER_DATA(pnd)->iSelected >= 0)
+    DRIVER_DATA(pnd)->abHalted[DRIVER_DATA(pnd)->iSelected] = true;
+  DRIVER_DATA(pnd)->iSelected = -1;
+  sim_leave(pnd);
+  return NFC_SUCCESS;
+}
+
+static int
+sim_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  (void) timeout;
+  int res;
+
+  sim_enter(pnd);
+  if (szTx > szRx) {
+    res = NFC_EOVFLOW;
+  } else {
+    memcpy(pbtRx, pbtTx, szTx);
+    res = (int) szTx;
+  }
+  sim_leave(pnd);
+  return res;
+}
+
+static const struct nfc_driver sim_driver = {
+  .name                             = SIM_DRIVER_NAME,
+  .scan_type                        = NOT_INTRUSIVE,
+  .scan                             = sim_scan,
+  .open                             = sim_open,
+  .close                            = sim_close,
+  .initiator_init                   = sim_initiator_init,
+  .initiator_select_passive_target  = sim_initiator_select_passive_target,
+  .initiator_deselect_target        = sim_initiator_deselect_target,
+  .initiator_transceive_bytes       = sim_initiator_transceive_bytes,
+  .device_set_property_bool         = sim_set_property_bool,
+};
+
+struct worker {
+  pthread_t thread;
+  nfc_device *pnd;
+  unsigned int uiId;
+  unsigned long ulIterations;
+  unsigned long ulOperations;
+  unsigned long ulErrors;             // wrong target lists or echoes
+};
+
+static const nfc_modulation nmIso14443a = {
+  .nmt = NMT_ISO14443A,
+  .nbr = NBR_106,
+};
+
+static void *
+worker_run(void *arg)
+{
+  struct worker *w = arg;
+  nfc_target ant[SIM_TAGS + 1];
+  uint8_t abtTx[16], abtRx[16];
+
+  for (unsigned long i = 0; i < w->ulIterations; i++) {
+    if (i % 16 == 0) {
+      if (nfc_initiator_init(w->pnd) < 0)
+        w->ulErrors++;
+      w->ulOperations++;
+    }
+    int res = nfc_initiator_list_passive_targets(w->pnd, nmIso14443a, ant, SIM_TAGS + 1);
+    if ((res != SIM_TAGS) || (ant[0].nti.nai.abtUid[6] != 0) || (ant[SIM_TAGS - 1].nti.nai.abtUid[6] != SIM_TAGS - 1))
+      w->ulErrors++;
+    w->ulOperations++;
+    for (int n = 0; n < 4; n++) {
+      memset(abtTx, (int)(w->uiId * 16 + n), sizeof(abtTx));
+      if ((nfc_initiator_transceive_bytes(w->pnd, abtTx, sizeof(abtTx), abtRx, sizeof(abtRx), 0) != (int) sizeof(abtTx)) ||
+          memcmp(abtTx, abtRx, sizeof(abtTx)))
+        w->ulErrors++;
+      w->ulOperations++;
+    }
+  }
+  return NULL;
+}
+
+struct churner {
+  pthread_t thread;
+  volatile bool *pbStop;
+  unsigned long ulContexts;
+  unsigned long ulErrors;
+};
+
+// Contexts come and go while the workers use theirs
+static void *
+churner_run(void *arg)
+{
+  struct churner *c = arg;
+  nfc_connstring connstrings[SIM_DEVICES];
+
+  while (!*c->pbStop) {
+    nfc_context *context;
+    nfc_init(&context);
+    if (!context) {
+      c->ulErrors++;
+      continue;
+    }
+    if (nfc_list_devices(context, connstrings, SIM_DEVICES) != SIM_DEVICES)
+      c->ulErrors++;
+    nfc_exit(context);
+    c->ulContexts++;
+  }
+  return NULL;
+}
+
+static int
+bench(nfc_device *apnd[], const unsigned int uiDevices, const unsigned int uiThreads, const unsigned int uiChurners, const unsigned long ulIterations)
+{
+  struct worker aw[SIM_MAX_THREADS];
+  struct churner ac[SIM_MAX_THREADS];
+  volatile bool bStop = false;
+  unsigned long ulOperations = 0, ulErrors = 0, ulOverlaps = 0, ulInterleaved = 0, ulContexts = 0, ulChurnErrors = 0;
+
+  for (unsigned int d = 0; d < uiDevices; d++) {
+    DRIVER_DATA(apnd[d])->ulOverlaps = 0;
+    DRIVER_DATA(apnd[d])->ulInterleaved = 0;
+  }
+  for (unsigned int c = 0; c < uiChurners; c++) {
+    memset(&ac[c], 0, sizeof(ac[c]));
+    ac[c].pbStop = &bStop;
+    pthread_create(&ac[c].thread, NULL, churner_run, &ac[c]);
+  }
+  const uint64_t start = monotonic_time_us();
+  for (unsigned int t = 0; t < uiThreads; t++) {
+    memset(&aw[t], 0, sizeof(aw[t]));
+    aw[t].pnd = apnd[t % uiDevices];
+    aw[t].uiId = t;
+    aw[t].ulIterations = ulIterations;
+    pthread_create(&aw[t].thread, NULL, worker_run, &aw[t]);
+  }
+  for (unsigned int t = 0; t < uiThreads; t++) {
+    pthread_join(aw[t].thread, NULL);
+    ulOperations += aw[t].ulOperations;
+    ulErrors += aw[t].ulErrors;
+  }
+  const uint64_t elapsed = monotonic_time_us() - start;
+  bStop = true;
+  for (unsigned int c = 0; c < uiChurners; c++) {
+    pthread_join(ac[c].thread, NULL);
+    ulContexts += ac[c].ulContexts;
+    ulChurnErrors += ac[c].ulErrors;
+  }
+  for (unsigned int d = 0; d < uiDevices; d++) {
+    ulOverlaps += DRIVER_DATA(apnd[d])->ulOverlaps;
+    ulInterleaved += DRIVER_DATA(apnd[d])->ulInterleaved;
+  }
+
+  printf("%2u thread(s) on %u device(s), %u context churner(s): %7lu ops in %6.3f s, %8.0f ops/s\n",
+         uiThreads, uiDevices, uiChurners, ulOperations, elapsed / 1e6, ulOperations * 1e6 / elapsed);
+  printf("    overlapping driver calls: %lu, interleaved target listings: %lu, wrong results: %lu",
+         ulOverlaps, ulInterleaved, ulErrors);
+  if (uiChurners)
+    printf(", contexts created: %lu (%lu failed scans)", ulContexts, ulChurnErrors);
+  printf("\n");
+  return (ulOverlaps || ulInterleaved || ulErrors || ulChurnErrors) ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned long ulIterations = 200;
+  nfc_context *context;
+  nfc_connstring connstrings[SIM_DEVICES];
+  nfc_device *apnd[SIM_DEVICES];
+  int ch, res = 0;
+
+  while ((ch = getopt(argc, argv, "n:l:")) != -1) {
+    switch (ch) {
+      case 'n':
+        ulIterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'l':
+        lLatency = strtol(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n iterations per thread] [-l operation latency in µs]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if ((lLatency < 0) || (lLatency > 999999)) {
+    fprintf(stderr, "Invalid latency\n");
+    return EXIT_FAILURE;
+  }
+
+  // Registered before the first context: the simulated driver is the only one
+  nfc_register_driver(&sim_driver);
+  nfc_init(&context);
+  if (context == NULL) {
+    fprintf(stderr, "Unable to init libnfc\n");
+    return EXIT_FAILURE;
+  }
+  if (nfc_list_devices(context, connstrings, SIM_DEVICES) != SIM_DEVICES) {
+    fprintf(stderr, "Unable to list the simulated devices\n");
+    nfc_exit(context);
+    return EXIT_FAILURE;
+  }
+  for (unsigned int d = 0; d < SIM_DEVICES; d++) {
+    if ((apnd[d] = nfc_open(context, connstrings[d])) == NULL) {
+      fprintf(stderr, "Unable to open %s\n", connstrings[d]);
+      nfc_exit(context);
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("%lu iterations per thread (1 listing of %d tags, 4 transceives), %ld us per driver operation\n",
+         ulIterations, SIM_TAGS, lLatency);
+  if ((bench(apnd, 1, 1, 0, ulIterations) < 0) ||
+      (bench(apnd, 4, 4, 0, ulIterations) < 0) ||
+      (bench(apnd, 8, 8, 0, ulIterations) < 0) ||
+      (bench(apnd, 1, 4, 0, ulIterations) < 0) ||
+      (bench(apnd, 2, 16, 0, ulIterations) < 0) ||
+      (bench(apnd, 8, 8, 4, ulIterations) < 0)) {
+    res = -1;
+  }
+
+  for (unsigned int d = 0; d < SIM_DEVICES; d++)
+    nfc_close(apnd[d]);
+  nfc_exit(context);
+  return (res < 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,315 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file felica-bench.c
+ * @brief FeliCa and NFC Forum Type 3 Tag engine benchmark against simulated cards
+ *
+ * This program is linked with nfc_initiator_transceive_bytes() wrapped
+ * (ld --wrap): the CHECK and UPDATE frames sent by felica.c reach a FeliCa
+ * card simulated here, which enforces its own limit of blocks per command.
+ * Each command costs a fixed time for the exchange with the chip, the air
+ * time of both frames at 212 kbps and the card processing time of its
+ * blocks. It compares whole NDEF reads one block per CHECK, as a
+ * conservative reader does, with reads using the blocks per CHECK of the
+ * attribute block, and reads of blocks spread over several services, one
+ * command per service or batched.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "felica.h"
+#include "nfc-utils.h"
+
+#define SIM_NDEF_BLOCKS 4096
+#define SIM_OTHER_BLOCKS 32
+// Preamble, sync code and CRC around each frame
+#define SIM_FRAME_OVERHEAD 10
+// Card processing time per command and per block
+#define SIM_CARD_CMD_US 300
+#define SIM_CARD_BLOCK_US 150
+#define SIM_CHIP_US 1000
+
+static const uint8_t abtSimIdm[8] = { 0x01, 0x2e, 0x4c, 0xd5, 0x8a, 0x31, 0x17, 0x42 };
+
+static struct {
+  uint8_t  ui8MaxBlocks;      // per CHECK or UPDATE, the card answers with an error above
+  uint8_t  abtNdef[(1 + SIM_NDEF_BLOCKS) * FELICA_BLOCK_SIZE];     // service 0x000B/0x0009
+  uint8_t  abtHistory[SIM_OTHER_BLOCKS * FELICA_BLOCK_SIZE];       // service 0x090F
+  uint8_t  abtBalance[SIM_OTHER_BLOCKS * FELICA_BLOCK_SIZE];       // service 0x1017
+  unsigned long ulCommands;
+  unsigned long ulBlocks;
+  uint64_t ui64Time;          // µs
+} sim;
+
+static uint8_t *
+sim_block(const uint16_t ui16Service, const uint16_t ui16Block)
+{
+  // The service number ignores the access attributes (6 low bits)
+  switch (ui16Service >> 6) {
+    case 0x0000:
+      return (ui16Block <= SIM_NDEF_BLOCKS) ? sim.abtNdef + ui16Block * FELICA_BLOCK_SIZE : NULL;
+    case 0x0024:
+      return (ui16Block < SIM_OTHER_BLOCKS) ? sim.abtHistory + ui16Block * FELICA_BLOCK_SIZE : NULL;
+    case 0x0040:
+      return (ui16Block < SIM_OTHER_BLOCKS) ? sim.abtBalance + ui16Block * FELICA_BLOCK_SIZE : NULL;
+  }
+  return NULL;
+}
+
+static uint64_t
+sim_air_us(const size_t szFrame)
+{
+  return (szFrame + SIM_FRAME_OVERHEAD) * 8 * 1000000 / 211875;
+}
+
+int
+__wrap_nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                                      const size_t szRx, int timeout)
+{
+  (void) pnd;
+  (void) timeout;
+  uint16_t aui16Services[FELICA_MAX_SERVICES];
+  uint8_t *apbtBlocks[FELICA_MAX_CHECK_BLOCKS];
+  size_t szPos = 10, szRes;
+
+  sim.ulCommands++;
+  sim.ui64Time += SIM_CHIP_US + sim_air_us(szTx) + SIM_CARD_CMD_US;
+  if ((szTx < 12) || (pbtTx[0] != szTx) || ((pbtTx[1] != FC_CHECK) && (pbtTx[1] != FC_UPDATE)) ||
+      memcmp(pbtTx + 2, abtSimIdm, sizeof(abtSimIdm)))
+    return NFC_ERFTRANS;
+
+  pbtRx[1] = pbtTx[1] + 1;
+  memcpy(pbtRx + 2, abtSimIdm, sizeof(abtSimIdm));
+  pbtRx[10] = pbtRx[11] = 0x00;
+  const size_t szServices = pbtTx[szPos++];
+  if ((szServices == 0) || (szServices > FELICA_MAX_SERVICES) || (szPos + 2 * szServices + 1 > szTx))
+    return NFC_ERFTRANS;
+  for (size_t n = 0; n < szServices; n++, szPos += 2)
+    aui16Services[n] = pbtTx[szPos] | (pbtTx[szPos + 1] << 8);
+  const size_t szBlocks = pbtTx[szPos++];
+  if ((szBlocks == 0) || (szBlocks > sim.ui8MaxBlocks)) {
+    // Illegal number of blocks
+    pbtRx[10] = 0xff;
+    pbtRx[11] = 0xa2;
+  }
+  for (size_t n = 0; (n < szBlocks) && !pbtRx[10]; n++) {
+    if (szPos + 2 > szTx)
+      return NFC_ERFTRANS;
+    const uint8_t btHead = pbtTx[szPos++];
+    uint16_t ui16Block = pbtTx[szPos++];
+    if (!(btHead & 0x80)) {
+      if (szPos + 1 > szTx)
+        return NFC_ERFTRANS;
+      ui16Block |= pbtTx[szPos++] << 8;
+    }
+    const size_t szService = btHead & 0x0f;
+    if ((szService >= szServices) || !(apbtBlocks[n] = sim_block(aui16Services[szService], ui16Block))) {
+      pbtRx[10] = 0xff;
+      pbtRx[11] = 0xa8;
+    }
+  }
+  sim.ui64Time += szBlocks * SIM_CARD_BLOCK_US;
+
+  if (pbtRx[10]) {
+    szRes = 12;
+  } else if (pbtTx[1] == FC_CHECK) {
+    pbtRx[12] = (uint8_t) szBlocks;
+    for (size_t n = 0; n < szBlocks; n++)
+      memcpy(pbtRx + 13 + n * FELICA_BLOCK_SIZE, apbtBlocks[n], FELICA_BLOCK_SIZE);
+    szRes = 13 + szBlocks * FELICA_BLOCK_SIZE;
+  } else {
+    if (szPos + szBlocks * FELICA_BLOCK_SIZE != szTx)
+      return NFC_ERFTRANS;
+    for (size_t n = 0; n < szBlocks; n++)
+      memcpy(apbtBlocks[n], pbtTx + szPos + n * FELICA_BLOCK_SIZE, FELICA_BLOCK_SIZE);
+    szRes = 12;
+  }
+  if (!pbtRx[10])
+    sim.ulBlocks += szBlocks;
+  if (szRes > szRx)
+    return NFC_EOVFLOW;
+  pbtRx[0] = (uint8_t) szRes;
+  sim.ui64Time += sim_air_us(szRes);
+  return (int) szRes;
+}
+
+// Blank NFC Forum Type 3 Tag, its attribute block announcing ui8Nbr blocks per CHECK and UPDATE
+static void
+sim_reset(const uint8_t ui8Nbr)
+{
+  memset(&sim, 0, sizeof(sim));
+  sim.ui8MaxBlocks = ui8Nbr;
+  uint8_t *pbt = sim.abtNdef;
+  pbt[0] = 0x10;
+  pbt[1] = ui8Nbr;
+  pbt[2] = ui8Nbr;
+  pbt[3] = (uint8_t)(SIM_NDEF_BLOCKS >> 8);
+  pbt[4] = (uint8_t) SIM_NDEF_BLOCKS;
+  pbt[10] = 0x01;
+  uint16_t ui16Sum = 0;
+  for (size_t n = 0; n < 14; n++)
+    ui16Sum += pbt[n];
+  pbt[14] = (uint8_t)(ui16Sum >> 8);
+  pbt[15] = (uint8_t) ui16Sum;
+  for (size_t n = 0; n < sizeof(sim.abtHistory); n++) {
+    sim.abtHistory[n] = (uint8_t)(n * 3);
+    sim.abtBalance[n] = (uint8_t)(n * 5);
+  }
+}
+
+static void
+report(const char *pcWhat, const unsigned long ulCommands, const unsigned long ulBlocks, const uint64_t ui64Time)
+{
+  printf("  %-36s %5lu commands %5lu blocks %9.1f ms\n", pcWhat, ulCommands, ulBlocks, ui64Time / 1000.0);
+}
+
+#define MEASURE(pcWhat, code) do { \
+    const unsigned long ulCommands = sim.ulCommands, ulBlocks = sim.ulBlocks; \
+    const uint64_t ui64Time = sim.ui64Time; \
+    code; \
+    report(pcWhat, sim.ulCommands - ulCommands, sim.ulBlocks - ulBlocks, sim.ui64Time - ui64Time); \
+  } while (0)
+
+static int
+bench_ndef(const uint8_t ui8Nbr, const uint32_t ui32Len)
+{
+  static uint8_t abtNdef[SIM_NDEF_BLOCKS * FELICA_BLOCK_SIZE], abtRead[SIM_NDEF_BLOCKS * FELICA_BLOCK_SIZE];
+  nfc_target nt;
+  felica_card fc;
+  felica_t3t_attribute attr;
+
+  memset(&nt, 0, sizeof(nt));
+  memcpy(nt.nti.nfi.abtId, abtSimIdm, sizeof(abtSimIdm));
+  sim_reset(ui8Nbr);
+  printf("%lu-byte NDEF message, %u blocks per command\n", (unsigned long) ui32Len, ui8Nbr);
+  for (size_t n = 0; n < ui32Len; n++)
+    abtNdef[n] = (uint8_t)(n * 7 + 1);
+
+  felica_card_init(&fc, &nt);
+  if (!felica_t3t_read_attribute(NULL, &fc, &attr) || !attr.bChecksumOk) {
+    fprintf(stderr, "Unable to read the attribute block\n");
+    return -1;
+  }
+  MEASURE("write, Nbw from the attribute block", if (!felica_t3t_write_ndef(NULL, &fc, &attr, abtNdef, ui32Len)) return -1);
+
+  // A conservative reader: one block per CHECK
+  felica_card_init(&fc, &nt);
+  MEASURE("read, one block per CHECK", {
+    if (!felica_t3t_read_attribute(NULL, &fc, &attr))
+      return -1;
+    fc.btNbr = 1;
+    if (!felica_t3t_read_ndef(NULL, &fc, &attr, abtRead))
+      return -1;
+  });
+  felica_card_init(&fc, &nt);
+  memset(abtRead, 0, ui32Len);
+  MEASURE("read, Nbr from the attribute block", {
+    if (!felica_t3t_read_attribute(NULL, &fc, &attr) || !felica_t3t_read_ndef(NULL, &fc, &attr, abtRead))
+      return -1;
+  });
+  if ((attr.ui32Ln != ui32Len) || memcmp(abtRead, abtNdef, ui32Len)) {
+    fprintf(stderr, "NDEF message read differs from the one written\n");
+    return -1;
+  }
+  return 0;
+}
+
+// Transit-like read: the balance and the last history records, in two services
+static int
+bench_services(const uint8_t ui8Nbr)
+{
+  static const uint16_t aui16Services[] = { 0x1017, 0x090f };
+  felica_block ablocks[2 * SIM_OTHER_BLOCKS];
+  uint8_t abtData[2 * SIM_OTHER_BLOCKS * FELICA_BLOCK_SIZE];
+  nfc_target nt;
+  felica_card fc;
+  const size_t szPerService = 6;
+
+  memset(&nt, 0, sizeof(nt));
+  memcpy(nt.nti.nfi.abtId, abtSimIdm, sizeof(abtSimIdm));
+  sim_reset(ui8Nbr);
+  felica_card_init(&fc, &nt);
+  fc.btNbr = ui8Nbr;
+  printf("%lu blocks in each of 2 services, %u blocks per command\n", (unsigned long) szPerService, ui8Nbr);
+  for (size_t s = 0; s < 2; s++) {
+    for (size_t n = 0; n < szPerService; n++) {
+      ablocks[s * szPerService + n].ui16Service = aui16Services[s];
+      ablocks[s * szPerService + n].ui16Block = (uint16_t) n;
+    }
+  }
+  MEASURE("read, one command per service", {
+    for (size_t s = 0; s < 2; s++) {
+      if (!felica_check(NULL, &fc, ablocks + s * szPerService, szPerService, abtData + s * szPerService * FELICA_BLOCK_SIZE))
+        return -1;
+    }
+  });
+  MEASURE("read, services batched", if (!felica_check(NULL, &fc, ablocks, 2 * szPerService, abtData)) return -1);
+  if (memcmp(abtData, sim.abtBalance, szPerService * FELICA_BLOCK_SIZE) ||
+      memcmp(abtData + szPerService * FELICA_BLOCK_SIZE, sim.abtHistory, szPerService * FELICA_BLOCK_SIZE)) {
+    fprintf(stderr, "Blocks read differ from the card content\n");
+    return -1;
+  }
+  return 0;
+}
+
+int
+main(void)
+{
+  const uint8_t aui8Nbr[] = { 4, 8, 12, 15 };
+  const uint32_t aui32Len[] = { 1024, 8192, 65535 };
+
+  printf("%d us per exchange with the chip, 212 kbps\n", SIM_CHIP_US);
+  for (size_t l = 0; l < sizeof(aui32Len) / sizeof(aui32Len[0]); l++) {
+    for (size_t n = 0; n < sizeof(aui8Nbr) / sizeof(aui8Nbr[0]); n++) {
+      if (bench_ndef(aui8Nbr[n], aui32Len[l]) < 0)
+        return EXIT_FAILURE;
+    }
+  }
+  for (size_t n = 0; n < sizeof(aui8Nbr) / sizeof(aui8Nbr[0]); n++) {
+    if (bench_services(aui8Nbr[n]) < 0)
+      return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
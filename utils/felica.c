@@ -0,0 +1,385 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file felica.c
+ * @brief provide samples structs and functions to read and write FeliCa and NFC Forum Type 3 tags using libnfc
+ *
+ * Frames are sent with nfc_initiator_transceive_bytes() without easy
+ * framing: LEN byte, command code, IDm, then the service and block lists.
+ * The head of each frame is prepared once per card by felica_card_init().
+ */
+#include "felica.h"
+
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+
+// LEN, command or response code and IDm
+#define FELICA_HEADER_SIZE 10
+#define FELICA_FRAME_MAX 255
+
+/**
+ * @brief Prepare the frames of a selected FeliCa card
+ *
+ * Blocks per command are 1 until felica_t3t_read_attribute() reads them, or the caller sets btNbr and btNbw.
+ */
+void
+felica_card_init(felica_card *pfc, const nfc_target *pnt)
+{
+  memset(pfc, 0, sizeof(*pfc));
+  memcpy(pfc->abtIdm, pnt->nti.nfi.abtId, sizeof(pfc->abtIdm));
+  pfc->btNbr = 1;
+  pfc->btNbw = 1;
+  pfc->abtCheck[1] = FC_CHECK;
+  memcpy(pfc->abtCheck + 2, pfc->abtIdm, sizeof(pfc->abtIdm));
+  pfc->abtUpdate[1] = FC_UPDATE;
+  memcpy(pfc->abtUpdate + 2, pfc->abtIdm, sizeof(pfc->abtIdm));
+}
+
+/*
+ * Build a CHECK or UPDATE frame for at most *pszCount blocks, with szBlockData
+ * bytes of data per block following the block list. *pszCount is lowered to
+ * what fits in one frame: 16 services and 255 bytes.
+ */
+static size_t
+felica_build_frame(const uint8_t *pbtTemplate, const felica_block *pblocks, size_t *pszCount,
+                   const size_t szBlockData, uint8_t *pbtFrame)
+{
+  uint16_t aui16Services[FELICA_MAX_SERVICES];
+  uint8_t abtList[3 * FELICA_MAX_CHECK_BLOCKS];
+  size_t szServices = 0, szList = 0, szBlocks;
+
+  for (szBlocks = 0; szBlocks < *pszCount; szBlocks++) {
+    const felica_block *pb = &pblocks[szBlocks];
+    size_t szService;
+    for (szService = 0; (szService < szServices) && (aui16Services[szService] != pb->ui16Service); szService++)
+      ;
+    if (szService == FELICA_MAX_SERVICES)
+      break;
+    const size_t szElement = (pb->ui16Block < 0x100) ? 2 : 3;
+    const size_t szNewServices = (szService == szServices) ? szServices + 1 : szServices;
+    if (FELICA_HEADER_SIZE + 1 + 2 * szNewServices + 1 + szList + szElement + (szBlocks + 1) * szBlockData > FELICA_FRAME_MAX)
+      break;
+    aui16Services[szService] = pb->ui16Service;
+    szServices = szNewServices;
+    // Block list element: 2-byte form below block 256, else 3-byte form, little endian
+    if (szElement == 2) {
+      abtList[szList++] = 0x80 | (uint8_t) szService;
+      abtList[szList++] = (uint8_t) pb->ui16Block;
+    } else {
+      abtList[szList++] = (uint8_t) szService;
+      abtList[szList++] = (uint8_t) pb->ui16Block;
+      abtList[szList++] = (uint8_t)(pb->ui16Block >> 8);
+    }
+  }
+  *pszCount = szBlocks;
+
+  size_t szFrame = FELICA_HEADER_SIZE;
+  memcpy(pbtFrame, pbtTemplate, FELICA_HEADER_SIZE);
+  pbtFrame[szFrame++] = (uint8_t) szServices;
+  for (size_t n = 0; n < szServices; n++) {
+    pbtFrame[szFrame++] = (uint8_t) aui16Services[n];
+    pbtFrame[szFrame++] = (uint8_t)(aui16Services[n] >> 8);
+  }
+  pbtFrame[szFrame++] = (uint8_t) szBlocks;
+  memcpy(pbtFrame + szFrame, abtList, szList);
+  szFrame += szList;
+  // LEN, its data follows
+  pbtFrame[0] = (uint8_t)(szFrame + szBlocks * szBlockData);
+  return szFrame;
+}
+
+// Send a frame, check the response code, IDm and status flags
+static int
+felica_transceive(nfc_device *pnd, felica_card *pfc, const uint8_t *pbtFrame, uint8_t *pbtRx, const size_t szRx)
+{
+  int res;
+
+  pfc->ulCommands++;
+  if ((res = nfc_initiator_transceive_bytes(pnd, pbtFrame, pbtFrame[0], pbtRx, szRx, 0)) < 0)
+    return res;
+  if ((res < FELICA_HEADER_SIZE + 2) || (pbtRx[0] != res) || (pbtRx[1] != pbtFrame[1] + 1) ||
+      memcmp(pbtRx + 2, pfc->abtIdm, sizeof(pfc->abtIdm)))
+    return -1;
+  // Status flags
+  if (pbtRx[10] || pbtRx[11])
+    return -1;
+  return res;
+}
+
+// One CHECK for the first blocks of the list: returns how many were read, 0 on failure
+static size_t
+felica_check_once(nfc_device *pnd, felica_card *pfc, const felica_block *pblocks, const size_t szBlocks, uint8_t *pbtData)
+{
+  uint8_t abtFrame[FELICA_FRAME_MAX], abtRx[FELICA_FRAME_MAX + 1];
+  size_t szCount = (pfc->btNbr && (pfc->btNbr < FELICA_MAX_CHECK_BLOCKS)) ? pfc->btNbr : FELICA_MAX_CHECK_BLOCKS;
+
+  szCount = MIN(szCount, szBlocks);
+  felica_build_frame(pfc->abtCheck, pblocks, &szCount, 0, abtFrame);
+  const int res = felica_transceive(pnd, pfc, abtFrame, abtRx, sizeof(abtRx));
+  // Number of blocks, then their data
+  if ((res != (int)(FELICA_HEADER_SIZE + 3 + szCount * FELICA_BLOCK_SIZE)) || (abtRx[12] != szCount))
+    return 0;
+  memcpy(pbtData, abtRx + 13, szCount * FELICA_BLOCK_SIZE);
+  return szCount;
+}
+
+// One UPDATE for the first blocks of the list: returns how many were written, 0 on failure
+static size_t
+felica_update_once(nfc_device *pnd, felica_card *pfc, const felica_block *pblocks, const size_t szBlocks, const uint8_t *pbtData)
+{
+  uint8_t abtFrame[FELICA_FRAME_MAX], abtRx[FELICA_FRAME_MAX + 1];
+  size_t szCount = (pfc->btNbw && (pfc->btNbw < FELICA_MAX_UPDATE_BLOCKS)) ? pfc->btNbw : FELICA_MAX_UPDATE_BLOCKS;
+
+  szCount = MIN(szCount, szBlocks);
+  const size_t szFrame = felica_build_frame(pfc->abtUpdate, pblocks, &szCount, FELICA_BLOCK_SIZE, abtFrame);
+  memcpy(abtFrame + szFrame, pbtData, szCount * FELICA_BLOCK_SIZE);
+  if (felica_transceive(pnd, pfc, abtFrame, abtRx, sizeof(abtRx)) != FELICA_HEADER_SIZE + 2)
+    return 0;
+  return szCount;
+}
+
+/**
+ * @brief Read blocks with CHECK commands of up to btNbr blocks each
+ *
+ * The blocks may belong to different services: a command holds up to 16 of them.
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ * @param pbtData receives 16 bytes per block, in the order of \a pblocks
+ */
+bool
+felica_check(nfc_device *pnd, felica_card *pfc, const felica_block *pblocks, const size_t szBlocks, uint8_t *pbtData)
+{
+  for (size_t szDone = 0; szDone < szBlocks;) {
+    const size_t szCount = felica_check_once(pnd, pfc, pblocks + szDone, szBlocks - szDone, pbtData + szDone * FELICA_BLOCK_SIZE);
+    if (szCount == 0)
+      return false;
+    szDone += szCount;
+  }
+  return true;
+}
+
+/**
+ * @brief Write blocks with UPDATE commands of up to btNbw blocks each
+ *
+ * The blocks may belong to different services: a command holds up to 16 of them.
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ * @param pbtData 16 bytes per block, in the order of \a pblocks
+ */
+bool
+felica_update(nfc_device *pnd, felica_card *pfc, const felica_block *pblocks, const size_t szBlocks, const uint8_t *pbtData)
+{
+  for (size_t szDone = 0; szDone < szBlocks;) {
+    const size_t szCount = felica_update_once(pnd, pfc, pblocks + szDone, szBlocks - szDone, pbtData + szDone * FELICA_BLOCK_SIZE);
+    if (szCount == 0)
+      return false;
+    szDone += szCount;
+  }
+  return true;
+}
+
+static void
+felica_t3t_blocks(felica_block *pblocks, const uint16_t ui16Service, const size_t szFirst, const size_t szCount)
+{
+  for (size_t n = 0; n < szCount; n++) {
+    pblocks[n].ui16Service = ui16Service;
+    pblocks[n].ui16Block = (uint16_t)(szFirst + n);
+  }
+}
+
+/**
+ * @brief Read consecutive blocks of one service, each CHECK as full as the frame allows
+ *
+ * The block list is built one command at a time, the range may be of any length.
+ * @return Returns the number of blocks read, fewer than \a szBlocks on failure
+ * @param pbtData receives 16 bytes per block
+ */
+size_t
+felica_check_range(nfc_device *pnd, felica_card *pfc, const uint16_t ui16Service, const size_t szFirst, const size_t szBlocks, uint8_t *pbtData)
+{
+  felica_block ablocks[FELICA_MAX_CHECK_BLOCKS];
+  size_t szDone = 0;
+
+  while (szDone < szBlocks) {
+    const size_t szList = MIN(FELICA_MAX_CHECK_BLOCKS, szBlocks - szDone);
+    felica_t3t_blocks(ablocks, ui16Service, szFirst + szDone, szList);
+    const size_t szCount = felica_check_once(pnd, pfc, ablocks, szList, pbtData + szDone * FELICA_BLOCK_SIZE);
+    if (szCount == 0)
+      break;
+    szDone += szCount;
+  }
+  return szDone;
+}
+
+static uint16_t
+felica_t3t_checksum(const uint8_t *pbtBlock)
+{
+  uint16_t ui16Sum = 0;
+  for (size_t n = 0; n < 14; n++)
+    ui16Sum += pbtBlock[n];
+  return ui16Sum;
+}
+
+/**
+ * @brief Decode the Attribute Information Block held by pattr->abtBlock
+ *
+ * When its checksum is valid, the blocks per CHECK and UPDATE of the card are taken from it.
+ */
+void
+felica_t3t_decode_attribute(felica_card *pfc, felica_t3t_attribute *pattr)
+{
+  const uint8_t *pbt = pattr->abtBlock;
+
+  pattr->btVersion = pbt[0];
+  pattr->btNbr = pbt[1];
+  pattr->btNbw = pbt[2];
+  pattr->ui16Nmaxb = (uint16_t)((pbt[3] << 8) | pbt[4]);
+  pattr->btWriteFlag = pbt[9];
+  pattr->btRwFlag = pbt[10];
+  pattr->ui32Ln = ((uint32_t) pbt[11] << 16) | ((uint32_t) pbt[12] << 8) | pbt[13];
+  pattr->bChecksumOk = (felica_t3t_checksum(pbt) == ((pbt[14] << 8) | pbt[15]));
+  if (pattr->bChecksumOk) {
+    pfc->btNbr = pattr->btNbr ? MIN(pattr->btNbr, FELICA_MAX_CHECK_BLOCKS) : 1;
+    pfc->btNbw = pattr->btNbw ? MIN(pattr->btNbw, FELICA_MAX_UPDATE_BLOCKS) : 1;
+  }
+}
+
+/**
+ * @brief Read the Attribute Information Block of a NFC Forum Type 3 Tag
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+felica_t3t_read_attribute(nfc_device *pnd, felica_card *pfc, felica_t3t_attribute *pattr)
+{
+  const felica_block fb = { FELICA_T3T_SERVICE_READ, 0 };
+
+  if (!felica_check(pnd, pfc, &fb, 1, pattr->abtBlock))
+    return false;
+  felica_t3t_decode_attribute(pfc, pattr);
+  return true;
+}
+
+/**
+ * @brief Read the NDEF message of a NFC Forum Type 3 Tag
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ * @param pbtNdef receives the \a ui32Ln bytes of the message
+ */
+bool
+felica_t3t_read_ndef(nfc_device *pnd, felica_card *pfc, const felica_t3t_attribute *pattr, uint8_t *pbtNdef)
+{
+  felica_block fb = { FELICA_T3T_SERVICE_READ, 0 };
+  uint8_t abtLast[FELICA_BLOCK_SIZE];
+  const size_t szFull = pattr->ui32Ln / FELICA_BLOCK_SIZE;
+  const size_t szRest = pattr->ui32Ln % FELICA_BLOCK_SIZE;
+
+  if (!pattr->bChecksumOk || (szFull + (szRest ? 1 : 0) > pattr->ui16Nmaxb))
+    return false;
+  // Data blocks follow the attribute block; whole blocks go straight to the caller buffer
+  if (felica_check_range(pnd, pfc, FELICA_T3T_SERVICE_READ, 1, szFull, pbtNdef) != szFull)
+    return false;
+  if (szRest) {
+    fb.ui16Block = (uint16_t)(1 + szFull);
+    if (!felica_check(pnd, pfc, &fb, 1, abtLast))
+      return false;
+    memcpy(pbtNdef + szFull * FELICA_BLOCK_SIZE, abtLast, szRest);
+  }
+  return true;
+}
+
+/**
+ * @brief Store the write flag and message length of \a pattr in pattr->abtBlock, checksum included
+ */
+void
+felica_t3t_encode_attribute(felica_t3t_attribute *pattr)
+{
+  uint8_t *pbt = pattr->abtBlock;
+
+  pbt[9] = pattr->btWriteFlag;
+  pbt[11] = (uint8_t)(pattr->ui32Ln >> 16);
+  pbt[12] = (uint8_t)(pattr->ui32Ln >> 8);
+  pbt[13] = (uint8_t) pattr->ui32Ln;
+  const uint16_t ui16Sum = felica_t3t_checksum(pbt);
+  pbt[14] = (uint8_t)(ui16Sum >> 8);
+  pbt[15] = (uint8_t) ui16Sum;
+}
+
+static bool
+felica_t3t_write_attribute(nfc_device *pnd, felica_card *pfc, felica_t3t_attribute *pattr)
+{
+  const felica_block fb = { FELICA_T3T_SERVICE_WRITE, 0 };
+
+  felica_t3t_encode_attribute(pattr);
+  return felica_update(pnd, pfc, &fb, 1, pattr->abtBlock);
+}
+
+/**
+ * @brief Write a NDEF message to a NFC Forum Type 3 Tag
+ *
+ * The attribute block, read by felica_t3t_read_attribute(), flags the write
+ * as in progress, then gives the new message length once the data is written.
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+felica_t3t_write_ndef(nfc_device *pnd, felica_card *pfc, felica_t3t_attribute *pattr, const uint8_t *pbtNdef, const uint32_t ui32Len)
+{
+  felica_block ablocks[FELICA_MAX_UPDATE_BLOCKS];
+  uint8_t abtChunk[FELICA_MAX_UPDATE_BLOCKS * FELICA_BLOCK_SIZE];
+  const size_t szBlocks = (ui32Len + FELICA_BLOCK_SIZE - 1) / FELICA_BLOCK_SIZE;
+
+  if (!pattr->bChecksumOk || (pattr->btRwFlag != 0x01) || (szBlocks > pattr->ui16Nmaxb))
+    return false;
+  pattr->btWriteFlag = FELICA_T3T_WRITEF_BUSY;
+  if (!felica_t3t_write_attribute(pnd, pfc, pattr))
+    return false;
+  // One UPDATE at a time, as full as the frame allows; the last block is padded with zeros
+  for (size_t szDone = 0; szDone < szBlocks;) {
+    const size_t szList = MIN(FELICA_MAX_UPDATE_BLOCKS, szBlocks - szDone);
+    const size_t szOffset = szDone * FELICA_BLOCK_SIZE;
+    const size_t szBytes = MIN(szList * FELICA_BLOCK_SIZE, ui32Len - szOffset);
+    memset(abtChunk, 0, sizeof(abtChunk));
+    memcpy(abtChunk, pbtNdef + szOffset, szBytes);
+    felica_t3t_blocks(ablocks, FELICA_T3T_SERVICE_WRITE, 1 + szDone, szList);
+    const size_t szCount = felica_update_once(pnd, pfc, ablocks, szList, abtChunk);
+    if (szCount == 0)
+      return false;
+    szDone += szCount;
+  }
+  pattr->btWriteFlag = FELICA_T3T_WRITEF_DONE;
+  pattr->ui32Ln = ui32Len;
+  return felica_t3t_write_attribute(pnd, pfc, pattr);
+}
@@ -0,0 +1,103 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file felica.h
+ * @brief provide samples structs and functions to read and write FeliCa and NFC Forum Type 3 tags using libnfc
+ */
+
+#ifndef _LIBNFC_FELICA_H_
+#  define _LIBNFC_FELICA_H_
+
+#  include <nfc/nfc-types.h>
+
+#  define FELICA_BLOCK_SIZE 16
+// Services of one CHECK or UPDATE command
+#  define FELICA_MAX_SERVICES 16
+// Frames hold at most 255 bytes: 15 blocks in a CHECK response, 13 blocks in an UPDATE command
+#  define FELICA_MAX_CHECK_BLOCKS 15
+#  define FELICA_MAX_UPDATE_BLOCKS 13
+
+typedef enum {
+  FC_CHECK = 0x06,          // Read Without Encryption
+  FC_UPDATE = 0x08,         // Write Without Encryption
+} felica_cmd;
+
+// NFC Forum Type 3 Tag services and attribute block
+#  define FELICA_T3T_SERVICE_READ  0x000B
+#  define FELICA_T3T_SERVICE_WRITE 0x0009
+#  define FELICA_T3T_WRITEF_DONE   0x00
+#  define FELICA_T3T_WRITEF_BUSY   0x0F
+
+// One block: its service code and its number in that service
+typedef struct {
+  uint16_t ui16Service;
+  uint16_t ui16Block;
+} felica_block;
+
+typedef struct {
+  uint8_t  abtIdm[8];
+  uint8_t  btNbr;           // blocks per CHECK, 1 until felica_t3t_read_attribute() found it
+  uint8_t  btNbw;           // blocks per UPDATE
+  uint8_t  abtCheck[10];    // LEN, command code and IDm of CHECK frames
+  uint8_t  abtUpdate[10];   // and of UPDATE frames
+  unsigned long ulCommands; // round trips to the card
+} felica_card;
+
+typedef struct {
+  uint8_t  btVersion;
+  uint8_t  btNbr;
+  uint8_t  btNbw;
+  uint16_t ui16Nmaxb;       // blocks available for the NDEF message
+  uint8_t  btWriteFlag;
+  uint8_t  btRwFlag;
+  uint32_t ui32Ln;          // NDEF message length
+  bool     bChecksumOk;
+  uint8_t  abtBlock[FELICA_BLOCK_SIZE];
+} felica_t3t_attribute;
+
+void felica_card_init(felica_card *pfc, const nfc_target *pnt);
+bool felica_check(nfc_device *pnd, felica_card *pfc, const felica_block *pblocks, const size_t szBlocks, uint8_t *pbtData);
+bool felica_update(nfc_device *pnd, felica_card *pfc, const felica_block *pblocks, const size_t szBlocks, const uint8_t *pbtData);
+size_t felica_check_range(nfc_device *pnd, felica_card *pfc, const uint16_t ui16Service, const size_t szFirst, const size_t szBlocks, uint8_t *pbtData);
+
+void felica_t3t_decode_attribute(felica_card *pfc, felica_t3t_attribute *pattr);
+void felica_t3t_encode_attribute(felica_t3t_attribute *pattr);
+bool felica_t3t_read_attribute(nfc_device *pnd, felica_card *pfc, felica_t3t_attribute *pattr);
+bool felica_t3t_read_ndef(nfc_device *pnd, felica_card *pfc, const felica_t3t_attribute *pattr, uint8_t *pbtNdef);
+bool felica_t3t_write_ndef(nfc_device *pnd, felica_card *pfc, felica_t3t_attribute *pattr, const uint8_t *pbtNdef, const uint32_t ui32Len);
+
+#endif // _LIBNFC_FELICA_H_
@@ -0,0 +1,255 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ * Copyright (C) 2014      Pim 't Hart
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file jewel-bench.c
+ * @brief Jewel/Topaz memory engine benchmark against simulated tags
+ *
+ * This program is linked with nfc_initiator_transceive_bytes() wrapped
+ * (ld --wrap): the Jewel commands sent by jewel.c reach a Topaz 96 (static
+ * memory model) or Topaz 512 (dynamic memory model) simulated here. It
+ * counts the round trips and the EEPROM erase cycles of whole tag reads and
+ * writes, done byte by byte with READ/WRITE-E as nfc-jewel used to, then
+ * with the memory engine.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "jewel.h"
+
+static struct {
+  uint8_t  abtHr[2];
+  size_t   szSize;
+  uint8_t  abtMemory[JEWEL_MEMORY_MAX_SIZE];
+  unsigned long ulCommands;
+  unsigned long ulErases;     // bytes erased before being written
+  unsigned long ulBytes;      // bytes sent and received over the air
+} sim;
+
+static void
+sim_write(const size_t szAddr, const uint8_t btData, const bool bErase)
+{
+  // Block 0 (UID) is read-only
+  if (szAddr < 8)
+    return;
+  if (bErase) {
+    sim.abtMemory[szAddr] = btData;
+    sim.ulErases++;
+  } else {
+    sim.abtMemory[szAddr] |= btData;
+  }
+}
+
+int
+__wrap_nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                                      const size_t szRx, int timeout)
+{
+  size_t szRes = 0, szAddr;
+  (void) pnd;
+  (void) timeout;
+
+  sim.ulCommands++;
+  switch (pbtTx[0]) {
+    case TC_RALL:
+      memcpy(pbtRx, sim.abtHr, 2);
+      memcpy(pbtRx + 2, sim.abtMemory, JEWEL_STATIC_SIZE);
+      szRes = 2 + JEWEL_STATIC_SIZE;
+      break;
+    case TC_READ:
+      pbtRx[0] = sim.abtMemory[pbtTx[1] & 0x7f];
+      szRes = 1;
+      break;
+    case TC_WRITEE:
+    case TC_WRITENE:
+      szAddr = pbtTx[1] & 0x7f;
+      sim_write(szAddr, pbtTx[2], pbtTx[0] == TC_WRITEE);
+      pbtRx[0] = sim.abtMemory[szAddr];
+      szRes = 1;
+      break;
+    case TC_RSEG:
+      if (sim.szSize == JEWEL_STATIC_SIZE)
+        return NFC_ERFTRANS;
+      memcpy(pbtRx, sim.abtMemory + (pbtTx[1] >> 4) * 128, 128);
+      szRes = 128;
+      break;
+    case TC_READ8:
+      if (sim.szSize == JEWEL_STATIC_SIZE)
+        return NFC_ERFTRANS;
+      memcpy(pbtRx, sim.abtMemory + pbtTx[1] * 8, 8);
+      szRes = 8;
+      break;
+    case TC_WRITEE8:
+    case TC_WRITENE8:
+      if (sim.szSize == JEWEL_STATIC_SIZE)
+        return NFC_ERFTRANS;
+      for (size_t n = 0; n < 8; n++)
+        sim_write(pbtTx[1] * 8 + n, pbtTx[2 + n], pbtTx[0] == TC_WRITEE8);
+      memcpy(pbtRx, sim.abtMemory + pbtTx[1] * 8, 8);
+      szRes = 8;
+      break;
+    default:
+      return NFC_ERFTRANS;
+  }
+  if (szRes > szRx)
+    return NFC_EOVFLOW;
+  sim.ulBytes += szTx + szRes;
+  return (int) szRes;
+}
+
+static void
+sim_reset(const uint8_t btHr0, const size_t szSize)
+{
+  memset(&sim, 0, sizeof(sim));
+  sim.abtHr[0] = btHr0;
+  sim.abtHr[1] = 0x48;
+  sim.szSize = szSize;
+  memcpy(sim.abtMemory, "\x01\x02\x03\x04\x05\x06\x07\x00", 8);
+  sim.abtMemory[8] = 0xE1;
+  sim.abtMemory[9] = 0x10;
+  sim.abtMemory[10] = (uint8_t)(szSize / 8 - 1);
+}
+
+static void
+report(const char *pcWhat, const unsigned long ulCommands, const unsigned long ulErases, const unsigned long ulBytes)
+{
+  printf("  %-34s %4lu round trips %4lu erased bytes %6lu bytes over the air\n", pcWhat, ulCommands, ulErases, ulBytes);
+}
+
+#define MEASURE(pcWhat, code) do { \
+    const unsigned long ulCommands = sim.ulCommands, ulErases = sim.ulErases, ulBytes = sim.ulBytes; \
+    code; \
+    report(pcWhat, sim.ulCommands - ulCommands, sim.ulErases - ulErases, sim.ulBytes - ulBytes); \
+  } while (0)
+
+// Per-byte access, the way nfc-jewel used to work on the static memory area
+static void
+legacy_read(uint8_t *pbtData)
+{
+  jewel_req req;
+  uint8_t btData;
+  for (size_t n = 0; n < JEWEL_STATIC_SIZE; n++) {
+    req.read.btCmd = TC_READ;
+    req.read.btAdd = (uint8_t) n;
+    __wrap_nfc_initiator_transceive_bytes(NULL, (uint8_t *)&req, sizeof(req.read), &btData, 1, -1);
+    pbtData[n] = btData;
+  }
+}
+
+static void
+legacy_write(const uint8_t *pbtData)
+{
+  jewel_req req;
+  uint8_t btData;
+  for (size_t n = 8; n < JEWEL_STATIC_SIZE; n++) {
+    if ((n / 8 == 0x0D) || (n / 8 == 0x0E))
+      continue;
+    req.writee.btCmd = TC_WRITEE;
+    req.writee.btAdd = (uint8_t) n;
+    req.writee.btDat = pbtData[n];
+    __wrap_nfc_initiator_transceive_bytes(NULL, (uint8_t *)&req, sizeof(req.writee), &btData, 1, -1);
+  }
+}
+
+static int
+bench(const char *pcName, const uint8_t btHr0, const size_t szSize)
+{
+  static jewel_memory jm;
+  uint8_t abtImage[JEWEL_MEMORY_MAX_SIZE];
+
+  sim_reset(btHr0, szSize);
+  printf("%s (%lu bytes)\n", pcName, (unsigned long) szSize);
+
+  MEASURE("per-byte READ (static area)", legacy_read(abtImage));
+  memset(&jm, 0, sizeof(jm));
+  MEASURE("engine read", if (!jewel_memory_read(NULL, &jm)) return -1);
+  if (jm.szSize != szSize) {
+    fprintf(stderr, "Wrong memory size %lu\n", (unsigned long) jm.szSize);
+    return -1;
+  }
+
+  // Fill the data area, starting from a blank tag
+  for (size_t n = 16; n < szSize; n++)
+    abtImage[n] = (uint8_t)(n * 7);
+  memcpy(abtImage, jm.abtData, 16);
+  memcpy(abtImage + 0x0D * 8, jm.abtData + 0x0D * 8, 16);
+  if (szSize > JEWEL_STATIC_SIZE)
+    memcpy(abtImage + 0x0F * 8, jm.abtData + 0x0F * 8, 8);
+
+  MEASURE("per-byte WRITE-E (static area)", legacy_write(abtImage));
+  memset(sim.abtMemory + 16, 0, szSize - 16);
+  memcpy(jm.abtData, abtImage, szSize);
+  jm.bCached = false;
+  MEASURE("engine write, no cache", if (!jewel_memory_write(NULL, &jm, 0)) return -1);
+  if (memcmp(sim.abtMemory, abtImage, szSize)) {
+    fprintf(stderr, "Tag content differs from the written image\n");
+    return -1;
+  }
+  MEASURE("engine write, same image", if (!jewel_memory_write(NULL, &jm, 0)) return -1);
+  jm.abtData[0x20] ^= 0x5a;
+  MEASURE("engine write, one byte changed", if (!jewel_memory_write(NULL, &jm, 0)) return -1);
+  // Rewrite a 48-byte NDEF message, some bytes keep their value
+  for (size_t n = 0x10; n < 0x40; n++)
+    jm.abtData[n] = (uint8_t)(jm.abtData[n] + (n & 1));
+  MEASURE("engine write, 48-byte message", if (!jewel_memory_write(NULL, &jm, 0)) return -1);
+  // Only set bits: write without erase
+  for (size_t n = 0x48; n < 0x60; n++)
+    jm.abtData[n] |= 0x01;
+  MEASURE("engine write, set bits only", if (!jewel_memory_write(NULL, &jm, 0)) return -1);
+  if (memcmp(sim.abtMemory, jm.abtData, szSize)) {
+    fprintf(stderr, "Tag content differs from the written image\n");
+    return -1;
+  }
+  return 0;
+}
+
+int
+main(void)
+{
+  if ((bench("Topaz 96, static memory", 0x11, JEWEL_STATIC_SIZE) < 0) ||
+      (bench("Topaz 512, dynamic memory", 0x12, 512) < 0)) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
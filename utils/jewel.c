@@ -107,3 +107,219 @@ nfc_initiator_jewel_cmd(nfc_device *pnd, const jewel_req req, jewel_res *pres)
 
   return true;
 }
+
+/*
+ * Jewel/Topaz memory engine
+ *
+ * A whole tag is read with one RALL, plus one RSEG per 128-byte segment on
+ * tags with the dynamic memory model (Topaz 512). Writes are diffed against
+ * the image last read from or written to the tag (abtCache, fetched first
+ * when unknown) and only send the bytes, or on dynamic tags the 8-byte
+ * blocks, that changed. When the
+ * new value only sets bits, the write-without-erase variant is used: it
+ * skips the EEPROM erase cycle.
+ * Responses are taken as either the bare data, or the data preceded by its
+ * address byte (ADD, ADD8, ADDS) as sent by the tag.
+ */
+
+#define JEWEL_BLOCK_SIZE   8
+#define JEWEL_SEGMENT_SIZE 128
+#define JEWEL_BLOCK_RESERVED 0x0D
+#define JEWEL_BLOCK_LOCKOTP  0x0E
+#define JEWEL_BLOCK_RESERVED_DYNAMIC 0x0F
+
+static int
+jewel_memory_cmd(nfc_device *pnd, jewel_memory *pjm, const jewel_req *preq, const size_t szReq, uint8_t *pbtRes, const size_t szRes)
+{
+  int res;
+
+  pjm->ulCommands++;
+  if ((res = nfc_initiator_transceive_bytes(pnd, (const uint8_t *)preq, szReq, pbtRes, szRes, -1)) < 0) {
+    nfc_perror(pnd, "nfc_initiator_transceive_bytes");
+  }
+  return res;
+}
+
+// Receive szData bytes, possibly preceded by their address byte
+static bool
+jewel_memory_cmd_data(nfc_device *pnd, jewel_memory *pjm, const jewel_req *preq, const size_t szReq, uint8_t *pbtData, const size_t szData)
+{
+  uint8_t abtRes[1 + JEWEL_SEGMENT_SIZE];
+  const int res = jewel_memory_cmd(pnd, pjm, preq, szReq, abtRes, szData + 1);
+
+  if ((res != (int) szData) && (res != (int) szData + 1))
+    return false;
+  memcpy(pbtData, abtRes + (res - szData), szData);
+  return true;
+}
+
+/**
+ * @brief Tell if the tag uses the dynamic memory model (more than 120 bytes, RSEG/READ8/WRITE-E8)
+ */
+bool
+jewel_memory_is_dynamic(const jewel_memory *pjm)
+{
+  return (pjm->abtHr[0] & 0x0F) != 0x01;
+}
+
+static bool
+jewel_memory_writable(const jewel_memory *pjm, const size_t szAddr, const int iFlags)
+{
+  const size_t block = szAddr / JEWEL_BLOCK_SIZE;
+
+  // Block 0 holds the UID
+  if ((block == 0) || (block == JEWEL_BLOCK_RESERVED))
+    return false;
+  if ((block == JEWEL_BLOCK_RESERVED_DYNAMIC) && jewel_memory_is_dynamic(pjm))
+    return false;
+  if (block == JEWEL_BLOCK_LOCKOTP)
+    return (szAddr % JEWEL_BLOCK_SIZE < 2) ? (iFlags & JEWEL_WRITE_LOCK) : (iFlags & JEWEL_WRITE_OTP);
+  return true;
+}
+
+// Read the whole tag memory into pbtData, learning the memory model and size on the way
+static bool
+jewel_memory_fetch(nfc_device *pnd, jewel_memory *pjm, uint8_t *pbtData)
+{
+  jewel_req req;
+  uint8_t abtRes[sizeof(jewel_res_rall)];
+  int res;
+
+  req.rall.btCmd = TC_RALL;
+  if ((res = jewel_memory_cmd(pnd, pjm, &req, sizeof(req.rall), abtRes, sizeof(abtRes))) < 0)
+    return false;
+
+  const jewel_res_rall *prall = (const jewel_res_rall *) abtRes;
+  memcpy(pjm->abtHr, prall->abtHr, sizeof(pjm->abtHr));
+  memset(pbtData, 0x00, JEWEL_MEMORY_MAX_SIZE);
+  if (res == (int) sizeof(jewel_res_rall)) {
+    memcpy(pbtData, prall->abtDat, JEWEL_STATIC_SIZE);
+  } else if (res == (int) sizeof(jewel_res_rall) - JEWEL_BLOCK_SIZE) {
+    // Some readers leave the reserved block out
+    memcpy(pbtData, prall->abtDat, JEWEL_BLOCK_RESERVED * JEWEL_BLOCK_SIZE);
+    memcpy(pbtData + JEWEL_BLOCK_LOCKOTP * JEWEL_BLOCK_SIZE, prall->abtDat + JEWEL_BLOCK_RESERVED * JEWEL_BLOCK_SIZE, JEWEL_BLOCK_SIZE);
+  } else {
+    return false;
+  }
+  pjm->szSize = JEWEL_STATIC_SIZE;
+
+  if (jewel_memory_is_dynamic(pjm)) {
+    // Capability Container (block 1) gives the memory size when the tag is NDEF formatted
+    pjm->szSize = 512;
+    if (pbtData[JEWEL_BLOCK_SIZE] == 0xE1)
+      pjm->szSize = (pbtData[JEWEL_BLOCK_SIZE + 2] + 1) * JEWEL_BLOCK_SIZE;
+    pjm->szSize = (pjm->szSize + JEWEL_SEGMENT_SIZE - 1) / JEWEL_SEGMENT_SIZE * JEWEL_SEGMENT_SIZE;
+    if (pjm->szSize > JEWEL_MEMORY_MAX_SIZE)
+      pjm->szSize = JEWEL_MEMORY_MAX_SIZE;
+
+    for (size_t segment = 0; segment < pjm->szSize / JEWEL_SEGMENT_SIZE; segment++) {
+      req.rseg.btCmd = TC_RSEG;
+      req.rseg.btAddS = (uint8_t)(segment << 4);
+      if (!jewel_memory_cmd_data(pnd, pjm, &req, sizeof(req.rseg), pbtData + segment * JEWEL_SEGMENT_SIZE, JEWEL_SEGMENT_SIZE))
+        return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Read the whole tag memory into abtData and abtCache
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+jewel_memory_read(nfc_device *pnd, jewel_memory *pjm)
+{
+  pjm->bCached = false;
+  if (!jewel_memory_fetch(pnd, pjm, pjm->abtData))
+    return false;
+
+  memcpy(pjm->abtCache, pjm->abtData, pjm->szSize);
+  pjm->bCached = true;
+  return true;
+}
+
+// Write one byte, without erase when that gives the wanted value
+static bool
+jewel_memory_write_byte(nfc_device *pnd, jewel_memory *pjm, const size_t szAddr)
+{
+  jewel_req req;
+  const uint8_t btOld = pjm->abtCache[szAddr], btNew = pjm->abtData[szAddr];
+
+  req.writee.btCmd = (btOld & ~btNew) ? TC_WRITEE : TC_WRITENE;
+  req.writee.btAdd = (uint8_t) szAddr;
+  req.writee.btDat = btNew;
+  if (!jewel_memory_cmd_data(pnd, pjm, &req, sizeof(req.writee), &pjm->abtCache[szAddr], 1))
+    return false;
+  return true;
+}
+
+// Write one 8-byte block (dynamic memory model)
+static bool
+jewel_memory_write_block(nfc_device *pnd, jewel_memory *pjm, const size_t block)
+{
+  jewel_req req;
+  const uint8_t *pbtOld = pjm->abtCache + block * JEWEL_BLOCK_SIZE, *pbtNew = pjm->abtData + block * JEWEL_BLOCK_SIZE;
+  bool bErase = false;
+
+  for (size_t n = 0; n < JEWEL_BLOCK_SIZE; n++)
+    bErase |= (pbtOld[n] & ~pbtNew[n]) != 0;
+
+  req.writee8.btCmd = bErase ? TC_WRITEE8 : TC_WRITENE8;
+  req.writee8.btAdd8 = (uint8_t) block;
+  memcpy(req.writee8.abtDat, pbtNew, JEWEL_BLOCK_SIZE);
+  return jewel_memory_cmd_data(pnd, pjm, &req, sizeof(req.writee8), pjm->abtCache + block * JEWEL_BLOCK_SIZE, JEWEL_BLOCK_SIZE);
+}
+
+/**
+ * @brief Write the bytes of abtData which differ from abtCache
+ *
+ * Without cache, the tag content is read first into abtCache; its memory size must match szSize.
+ * The UID and reserved blocks are never written, lock and OTP bytes only when asked by \a iFlags.
+ * On failure abtCache still describes what has been written, so a new call after re-selecting
+ * the tag only writes what is left.
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+jewel_memory_write(nfc_device *pnd, jewel_memory *pjm, const int iFlags)
+{
+  if (!pjm->bCached) {
+    const size_t szSize = pjm->szSize;
+    if (!jewel_memory_fetch(pnd, pjm, pjm->abtCache))
+      return false;
+    if (pjm->szSize != szSize)
+      return false;
+    pjm->bCached = true;
+  }
+
+  const bool bDynamic = jewel_memory_is_dynamic(pjm);
+
+  for (size_t block = 0; block < pjm->szSize / JEWEL_BLOCK_SIZE; block++) {
+    const size_t szBase = block * JEWEL_BLOCK_SIZE;
+    size_t szChanged = 0, szWritable = 0;
+
+    for (size_t n = 0; n < JEWEL_BLOCK_SIZE; n++) {
+      if (jewel_memory_writable(pjm, szBase + n, iFlags)) {
+        szWritable++;
+        if (pjm->abtData[szBase + n] != pjm->abtCache[szBase + n])
+          szChanged++;
+      }
+    }
+    if (szChanged == 0)
+      continue;
+
+    // Byte writes only address the first 128 bytes
+    if (bDynamic && (block != JEWEL_BLOCK_LOCKOTP) && (szWritable == JEWEL_BLOCK_SIZE) &&
+        ((szChanged > 1) || (szBase >= JEWEL_SEGMENT_SIZE))) {
+      if (!jewel_memory_write_block(pnd, pjm, block))
+        return false;
+      continue;
+    }
+    for (size_t n = 0; n < JEWEL_BLOCK_SIZE; n++) {
+      if (jewel_memory_writable(pjm, szBase + n, iFlags) && (pjm->abtData[szBase + n] != pjm->abtCache[szBase + n])) {
+        if (!jewel_memory_write_byte(pnd, pjm, szBase + n))
+          return false;
+      }
+    }
+  }
+  return true;
+}
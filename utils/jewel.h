@@ -130,7 +130,7 @@ typedef struct {
 
 typedef struct {
   uint8_t abtHr[2];
-  uint8_t abtDat[104];		// Block 0 - E, but not block D (reserved)
+  uint8_t abtDat[120];		// Block 0 - E
 } jewel_res_rall;
 
 typedef struct {
@@ -213,4 +213,28 @@ typedef union {
 
 bool nfc_initiator_jewel_cmd(nfc_device *pnd, const jewel_req req, jewel_res *pres);
 
+// Jewel/Topaz memory engine
+
+// Largest tag memory: 16 segments of 128 bytes
+#  define JEWEL_MEMORY_MAX_SIZE 2048
+// Static memory model (Topaz 96): blocks 0 - E
+#  define JEWEL_STATIC_SIZE 120
+
+// jewel_memory_write() flags
+#  define JEWEL_WRITE_LOCK 0x01   // lock bytes (block E, bytes 0 - 1)
+#  define JEWEL_WRITE_OTP  0x02   // OTP bytes (block E, bytes 2 - 7)
+
+typedef struct {
+  uint8_t  abtHr[2];                          // Header ROM, HR0 gives the memory model
+  size_t   szSize;                            // memory size in bytes
+  uint8_t  abtData[JEWEL_MEMORY_MAX_SIZE];    // image to write to the tag
+  uint8_t  abtCache[JEWEL_MEMORY_MAX_SIZE];   // tag content, as last read or written
+  bool     bCached;                           // abtCache is valid
+  unsigned long ulCommands;                   // round trips to the tag
+} jewel_memory;
+
+bool jewel_memory_is_dynamic(const jewel_memory *pjm);
+bool jewel_memory_read(nfc_device *pnd, jewel_memory *pjm);
+bool jewel_memory_write(nfc_device *pnd, jewel_memory *pjm, const int iFlags);
+
 #endif // _LIBNFC_JEWEL_H_
@@ -0,0 +1,414 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file llcp-bench.c
+ * @brief LLCP throughput benchmark between two simulated devices
+ *
+ * This program is linked with nfc_initiator_transceive_bytes(), nfc_target_send_bytes()
+ * and nfc_target_receive_bytes() wrapped (ld --wrap): the DEP frames of an initiator link
+ * and a target link cross a simulated RF channel, 424 kbps with a fixed host latency per
+ * exchange. A connection moves the same data with a lock-step configuration (receive window
+ * of 1, no aggregation), then with larger windows, AGF PDUs and larger link MIUs. The
+ * connectionless transport and the SYMM traffic of an idle link are measured as well.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "llcp.h"
+
+#define SIM_SAP 0x10
+#define SIM_BITRATE 424000
+// DEP header, start byte and CRC of a frame
+#define SIM_FRAME_OVERHEAD 6
+
+static struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  uint8_t  abtReq[2 + 3 + LLCP_MIU_MAX];
+  size_t   szReq;
+  bool     bReq;
+  uint8_t  abtRes[2 + 3 + LLCP_MIU_MAX];
+  size_t   szRes;
+  bool     bRes;
+  long     lLatency;        // host round trip of an exchange, in µs
+  unsigned long ulExchanges;
+  unsigned long ulAirBytes;
+} sim = {
+  .mutex = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+  .lLatency = 1000,
+};
+
+static void
+sim_sleep(const long lMicros)
+{
+  struct timespec ts = { .tv_sec = lMicros / 1000000, .tv_nsec = (lMicros % 1000000) * 1000 };
+  nanosleep(&ts, NULL);
+}
+
+static long
+sim_air_time(const size_t sz)
+{
+  return (long)((sz + SIM_FRAME_OVERHEAD) * 8 * 1000000ULL / SIM_BITRATE);
+}
+
+static double
+now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Waits for a flag, timeout in ms
+static bool
+sim_wait(bool *pbFlag, const int timeout)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += timeout / 1000;
+  ts.tv_nsec += (long)(timeout % 1000) * 1000000;
+  ts.tv_sec += ts.tv_nsec / 1000000000;
+  ts.tv_nsec %= 1000000000;
+  while (!*pbFlag) {
+    if (pthread_cond_timedwait(&sim.cond, &sim.mutex, &ts))
+      return *pbFlag;
+  }
+  return true;
+}
+
+int
+__wrap_nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                                      const size_t szRx, int timeout)
+{
+  int     res;
+  (void) pnd;
+
+  sim_sleep(sim.lLatency / 2 + sim_air_time(szTx));
+  pthread_mutex_lock(&sim.mutex);
+  memcpy(sim.abtReq, pbtTx, szTx);
+  sim.szReq = szTx;
+  sim.bReq = true;
+  sim.ulExchanges++;
+  sim.ulAirBytes += szTx;
+  pthread_cond_broadcast(&sim.cond);
+  if (!sim_wait(&sim.bRes, timeout)) {
+    pthread_mutex_unlock(&sim.mutex);
+    return NFC_ETIMEOUT;
+  }
+  sim.bRes = false;
+  if (sim.szRes > szRx) {
+    res = NFC_EOVFLOW;
+  } else {
+    memcpy(pbtRx, sim.abtRes, sim.szRes);
+    res = sim.szRes;
+  }
+  sim.ulAirBytes += sim.szRes;
+  pthread_mutex_unlock(&sim.mutex);
+  sim_sleep(sim.lLatency / 2 + sim_air_time(res > 0 ? res : 0));
+  return res;
+}
+
+int
+__wrap_nfc_target_receive_bytes(nfc_device *pnd, uint8_t *pbtRx, const size_t szRx, int timeout)
+{
+  int     res;
+  (void) pnd;
+
+  pthread_mutex_lock(&sim.mutex);
+  if (!sim_wait(&sim.bReq, timeout)) {
+    pthread_mutex_unlock(&sim.mutex);
+    return NFC_ETIMEOUT;
+  }
+  sim.bReq = false;
+  if (sim.szReq > szRx) {
+    res = NFC_EOVFLOW;
+  } else {
+    memcpy(pbtRx, sim.abtReq, sim.szReq);
+    res = sim.szReq;
+  }
+  pthread_mutex_unlock(&sim.mutex);
+  return res;
+}
+
+int
+__wrap_nfc_target_send_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, int timeout)
+{
+  (void) pnd;
+  (void) timeout;
+
+  pthread_mutex_lock(&sim.mutex);
+  memcpy(sim.abtRes, pbtTx, szTx);
+  sim.szRes = szTx;
+  sim.bRes = true;
+  pthread_cond_broadcast(&sim.cond);
+  pthread_mutex_unlock(&sim.mutex);
+  return szTx;
+}
+
+struct peer {
+  llcp_link *pll;
+  pthread_t mac;
+  pthread_t app;
+  int      iMacResult;
+  size_t   szData;          // bytes to send or received
+  unsigned long ulSdus;
+  unsigned long ulErrors;   // corrupted SDUs, or received out of order
+  bool     bConnectionless;
+};
+
+static void *
+mac_thread(void *arg)
+{
+  struct peer *ppeer = arg;
+  ppeer->iMacResult = llcp_link_run(ppeer->pll);
+  return NULL;
+}
+
+// Target side service: checks the pattern of every SDU
+static void *
+sink_thread(void *arg)
+{
+  struct peer *ppeer = arg;
+  uint8_t abtSdu[LLCP_MIU_MAX];
+  llcp_conn *pconn;
+  int     res;
+
+  if (ppeer->bConnectionless) {
+    while ((res = llcp_recv_ui(ppeer->pll, SIM_SAP, abtSdu, sizeof(abtSdu), NULL)) > 0) {
+      ppeer->ulSdus++;
+      ppeer->szData += res;
+    }
+    return NULL;
+  }
+  if ((pconn = llcp_accept(ppeer->pll, SIM_SAP, &res)) == NULL)
+    return NULL;
+  while ((res = llcp_recv(pconn, abtSdu, sizeof(abtSdu))) > 0) {
+    for (int n = 0; n < res; n++) {
+      if (abtSdu[n] != (uint8_t)(ppeer->szData + n)) {
+        ppeer->ulErrors++;
+        break;
+      }
+    }
+    ppeer->ulSdus++;
+    ppeer->szData += res;
+  }
+  if (res < 0)
+    ppeer->ulErrors++;
+  llcp_close(pconn);
+  return NULL;
+}
+
+static int
+link_up(struct peer *pinitiator, struct peer *ptarget, const llcp_params *pparams)
+{
+  uint8_t abtGbInitiator[48], abtGbTarget[48];
+  size_t  szGbInitiator, szGbTarget;
+
+  memset(pinitiator, 0, sizeof(*pinitiator));
+  memset(ptarget, 0, sizeof(*ptarget));
+  pinitiator->pll = llcp_link_new(NULL, true, pparams);
+  ptarget->pll = llcp_link_new(NULL, false, pparams);
+  if (!pinitiator->pll || !ptarget->pll)
+    return -1;
+  llcp_bind(ptarget->pll, SIM_SAP);
+  // What nfc_initiator_select_dep_target() and nfc_target_init() would carry in ATR_REQ and ATR_RES
+  szGbInitiator = llcp_link_general_bytes(pinitiator->pll, abtGbInitiator, sizeof(abtGbInitiator));
+  szGbTarget = llcp_link_general_bytes(ptarget->pll, abtGbTarget, sizeof(abtGbTarget));
+  if ((llcp_link_activate(pinitiator->pll, abtGbTarget, szGbTarget) < 0) ||
+      (llcp_link_activate(ptarget->pll, abtGbInitiator, szGbInitiator) < 0))
+    return -1;
+  sim.bReq = sim.bRes = false;
+  sim.ulExchanges = 0;
+  sim.ulAirBytes = 0;
+  pthread_create(&ptarget->mac, NULL, mac_thread, ptarget);
+  pthread_create(&pinitiator->mac, NULL, mac_thread, pinitiator);
+  return 0;
+}
+
+static void
+link_down(struct peer *pinitiator, struct peer *ptarget)
+{
+  llcp_link_deactivate(pinitiator->pll);
+  pthread_join(pinitiator->mac, NULL);
+  pthread_join(ptarget->mac, NULL);
+  llcp_link_free(pinitiator->pll);
+  llcp_link_free(ptarget->pll);
+}
+
+static int
+bench_transfer(const char *pcMode, const bool bConnectionless, const size_t szMaxSdu, const uint8_t btRw,
+               const uint16_t ui16Miu, const bool bAggregate, const size_t szTotal)
+{
+  struct peer initiator, target;
+  uint8_t abtSdu[LLCP_MIU_MAX];
+  llcp_params params;
+  llcp_stats stats;
+  llcp_conn *pconn = NULL;
+  size_t  szSent, szSdu;
+  double  dStart, dElapsed;
+  int     res = 0;
+
+  llcp_params_default(&params);
+  params.btRw = btRw;
+  params.ui16Miu = ui16Miu;
+  params.bAggregate = bAggregate;
+  if (link_up(&initiator, &target, &params) < 0) {
+    fprintf(stderr, "Link activation failed\n");
+    return -1;
+  }
+  target.bConnectionless = bConnectionless;
+  pthread_create(&target.app, NULL, sink_thread, &target);
+
+  dStart = now_ms();
+  if (!bConnectionless && ((pconn = llcp_connect(initiator.pll, SIM_SAP, &res)) == NULL)) {
+    fprintf(stderr, "Connection failed (%d)\n", res);
+    return -1;
+  }
+  for (szSent = 0; (szSent < szTotal) && (res >= 0); szSent += szSdu) {
+    szSdu = (szTotal - szSent < szMaxSdu) ? szTotal - szSent : szMaxSdu;
+    for (size_t n = 0; n < szSdu; n++)
+      abtSdu[n] = (uint8_t)(szSent + n);
+    res = bConnectionless ? llcp_send_ui(initiator.pll, SIM_SAP, SIM_SAP, abtSdu, szSdu) : llcp_send(pconn, abtSdu, szSdu);
+  }
+  // All SDUs are acknowledged when the connection is closed, the UI PDUs are sent once the peer idles
+  if (pconn)
+    llcp_close(pconn);
+  else
+    while (llcp_link_get_stats(initiator.pll, &stats), stats.ulBytesSent < szSent)
+      sim_sleep(100);
+  dElapsed = now_ms() - dStart;
+  llcp_link_get_stats(initiator.pll, &stats);
+  link_down(&initiator, &target);
+  pthread_join(target.app, NULL);
+
+  printf("  %-15s %4lu %2u %5u %-3s %6lu %6.2f %6lu %6lu %8.1f %8.1f\n", pcMode, (unsigned long) szMaxSdu, btRw, ui16Miu,
+         bAggregate ? "yes" : "no",
+         sim.ulExchanges, (double) stats.ulPdusSent / sim.ulExchanges, (unsigned long) target.szData, target.ulErrors,
+         dElapsed, target.szData / 1.024 / dElapsed);
+  if ((res < 0) || target.ulErrors || (!bConnectionless && (target.szData != szTotal))) {
+    fprintf(stderr, "Transfer failed\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int
+bench_idle(const uint16_t ui16Lto, const int iMillis)
+{
+  struct peer initiator, target;
+  llcp_params params;
+  llcp_stats stats;
+
+  llcp_params_default(&params);
+  params.ui16Lto = ui16Lto;
+  if (link_up(&initiator, &target, &params) < 0)
+    return -1;
+  sim_sleep(iMillis * 1000L);
+  llcp_link_get_stats(initiator.pll, &stats);
+  link_down(&initiator, &target);
+  printf("  LTO %4u ms: %5lu exchanges in %d ms, %lu SYMM PDUs sent by the initiator\n", ui16Lto, sim.ulExchanges,
+         iMillis, stats.ulSymmSent);
+  return (initiator.iMacResult < 0) || (target.iMacResult < 0) ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static const struct {
+    size_t   szSdu;
+    uint8_t  btRw;
+    uint16_t ui16Miu;
+    bool     bAggregate;
+  } acfg[] = {
+    // Lock-step: one I-PDU per exchange
+    { 128, 1, 128, false },
+    { 128, 4, 512, true },
+    { 128, 15, 2175, true },
+    // Small SDUs, the window bounds what an AGF PDU carries
+    { 32, 1, 512, false },
+    { 32, 1, 512, true },
+    { 32, 4, 512, true },
+    { 32, 15, 512, true },
+    { 32, 15, 2175, true },
+  };
+  size_t  szTotal = 64 * 1024;
+  int     opt;
+
+  while ((opt = getopt(argc, argv, "l:n:")) != -1) {
+    switch (opt) {
+      case 'l':
+        sim.lLatency = strtol(optarg, NULL, 10);
+        break;
+      case 'n':
+        szTotal = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-l host latency of an exchange in µs] [-n bytes to transfer]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+
+  printf("%lu bytes at 424 kbps, %ld µs host latency per exchange\n", (unsigned long) szTotal, sim.lLatency);
+  printf("  %-15s %4s %2s %5s %-3s %6s %6s %6s %6s %8s %8s\n", "transport", "SDU", "RW", "MIU", "AGF", "exch", "PDU/ex",
+         "bytes", "errors", "ms", "KiB/s");
+  for (size_t n = 0; n < sizeof(acfg) / sizeof(acfg[0]); n++) {
+    if (bench_transfer("connection", false, acfg[n].szSdu, acfg[n].btRw, acfg[n].ui16Miu, acfg[n].bAggregate,
+                       szTotal) < 0)
+      return EXIT_FAILURE;
+  }
+  if ((bench_transfer("connectionless", true, 32, 4, 512, false, szTotal) < 0) ||
+      (bench_transfer("connectionless", true, 32, 4, 512, true, szTotal) < 0))
+    return EXIT_FAILURE;
+
+  printf("Idle link, SYMM PDUs held back up to LTO / 2\n");
+  if ((bench_idle(100, 1000) < 0) || (bench_idle(500, 1000) < 0))
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
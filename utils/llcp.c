@@ -0,0 +1,1178 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file llcp.c
+ * @brief NFC Forum Logical Link Control Protocol (LLCP) over NFC-DEP
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "llcp.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nfc/nfc.h>
+
+// SDUs held per queue: twice the largest window, see llcp_conn_room()
+#  define LLCP_QUEUE_LEN (2 * (LLCP_RW_MAX + 1))
+#  define LLCP_CONNS 16
+// Largest PDU: header, sequence and a MIU sized information field
+#  define LLCP_FRAME_MAX (3 + LLCP_MIU_MAX)
+// Time allowed to the transport on top of the remote link timeout, in ms
+#  define LLCP_LTO_MARGIN 100
+// First delay of a SYMM PDU on an idle link, it doubles up to half the local link timeout
+#  define LLCP_SYMM_DELAY_MIN 1
+
+// Parameter types
+#  define LLCP_PARAM_VERSION 0x01
+#  define LLCP_PARAM_MIUX    0x02
+#  define LLCP_PARAM_WKS     0x03
+#  define LLCP_PARAM_LTO     0x04
+#  define LLCP_PARAM_RW      0x05
+#  define LLCP_PARAM_OPT     0x07
+// Link service class 3: connectionless and connection-oriented transport
+#  define LLCP_OPT_LSC       0x03
+
+// FRMR flag: invalid sequence number
+#  define LLCP_FRMR_S 0x10
+
+static const uint8_t abtLlcpMagic[] = { 0x46, 0x66, 0x6d };
+
+struct llcp_sdu {
+  uint8_t *pbtData;
+  size_t   szData;
+  uint8_t  btSsap;
+  uint8_t  btDsap;
+};
+
+struct llcp_queue {
+  struct llcp_sdu asdu[LLCP_QUEUE_LEN];
+  size_t   szHead;
+  size_t   szCount;
+};
+
+typedef enum {
+  LLCP_CONN_FREE = 0,
+  LLCP_CONN_CONNECTING,
+  LLCP_CONN_CONNECTED,
+  LLCP_CONN_DISCONNECTING,
+  LLCP_CONN_CLOSED,
+} llcp_conn_state;
+
+struct llcp_conn {
+  llcp_link *pll;
+  llcp_conn_state state;
+  uint8_t  btSsap;        // local SAP
+  uint8_t  btDsap;        // remote SAP
+  uint16_t ui16Miu;       // remote MIU of the connection
+  uint8_t  btRw;          // remote receive window
+  uint8_t  btVs, btVsa;   // send state variable and acknowledged send state variable
+  uint8_t  btVr, btVra;   // receive state variable and acknowledged receive state variable
+  bool     bRemoteBusy;   // RNR received
+  bool     bLocalBusy;    // RNR sent
+  bool     bAccepted;     // incoming connection handed out by llcp_accept()
+  int      iError;
+  // Sent and not acknowledged SDUs first ((V(S) - V(SA)) mod 16 of them), then the SDUs to send
+  struct llcp_queue tx;
+  struct llcp_queue rx;
+};
+
+typedef enum {
+  LLCP_LINK_IDLE = 0,
+  LLCP_LINK_ACTIVE,
+  LLCP_LINK_DOWN,
+} llcp_link_state;
+
+struct llcp_link {
+  nfc_device *pnd;
+  bool     bInitiator;
+  llcp_params local;
+  llcp_params remote;
+  llcp_link_state state;
+  int      iError;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;      // broadcast on every change of the link, the connections or the queues
+  uint64_t ui64Bound;       // SAPs bound by llcp_bind()
+  llcp_conn aconn[LLCP_CONNS];
+  size_t   szNextConn;      // round robin between the connections
+  struct llcp_queue ctrl;   // built CONNECT, CC, DISC, DM and FRMR PDUs
+  struct llcp_queue uitx;
+  struct llcp_queue uirx;
+  bool     bDeactivate;     // DISC(0, 0) to send
+  bool     bDiscSent;
+  bool     bDiscReceived;
+  bool     bTxSymm, bRxSymm;
+  int      iSymmDelay;
+  llcp_stats stats;
+  uint8_t  abtTx[2 + LLCP_FRAME_MAX];
+  uint8_t  abtRx[2 + LLCP_FRAME_MAX];
+};
+
+static struct llcp_sdu *
+llcp_queue_at(struct llcp_queue *pq, const size_t szIndex)
+{
+  return &pq->asdu[(pq->szHead + szIndex) % LLCP_QUEUE_LEN];
+}
+
+static bool
+llcp_queue_push(struct llcp_queue *pq, const uint8_t *pbtData, const size_t szData, const uint8_t btSsap, const uint8_t btDsap)
+{
+  struct llcp_sdu *psdu;
+
+  if (pq->szCount == LLCP_QUEUE_LEN)
+    return false;
+  psdu = llcp_queue_at(pq, pq->szCount);
+  if ((psdu->pbtData = malloc(szData ? szData : 1)) == NULL)
+    return false;
+  memcpy(psdu->pbtData, pbtData, szData);
+  psdu->szData = szData;
+  psdu->btSsap = btSsap;
+  psdu->btDsap = btDsap;
+  pq->szCount++;
+  return true;
+}
+
+static void
+llcp_queue_remove(struct llcp_queue *pq, const size_t szIndex)
+{
+  size_t  szPos;
+
+  free(llcp_queue_at(pq, szIndex)->pbtData);
+  for (szPos = szIndex; szPos > 0; szPos--)
+    *llcp_queue_at(pq, szPos) = *llcp_queue_at(pq, szPos - 1);
+  pq->szHead = (pq->szHead + 1) % LLCP_QUEUE_LEN;
+  pq->szCount--;
+}
+
+static void
+llcp_queue_clear(struct llcp_queue *pq)
+{
+  while (pq->szCount)
+    llcp_queue_remove(pq, 0);
+}
+
+static size_t
+llcp_pdu_header(uint8_t *pbt, const uint8_t btDsap, const llcp_pdu_type ptype, const uint8_t btSsap)
+{
+  pbt[0] = (btDsap << 2) | (ptype >> 2);
+  pbt[1] = ((ptype & 0x3) << 6) | btSsap;
+  return 2;
+}
+
+static void
+llcp_params_parse(const uint8_t *pbt, const size_t sz, llcp_params *pparams)
+{
+  size_t  szPos = 0;
+
+  while (szPos + 2 <= sz) {
+    const uint8_t btType = pbt[szPos];
+    const uint8_t btLen = pbt[szPos + 1];
+    const uint8_t *pbtValue = pbt + szPos + 2;
+
+    if (szPos + 2 + btLen > sz)
+      break;
+    switch (btType) {
+      case LLCP_PARAM_VERSION:
+        if (btLen >= 1)
+          pparams->btVersion = pbtValue[0];
+        break;
+      case LLCP_PARAM_MIUX:
+        if (btLen >= 2)
+          pparams->ui16Miu = LLCP_MIU_DEFAULT + (((pbtValue[0] << 8) | pbtValue[1]) & 0x7ff);
+        break;
+      case LLCP_PARAM_WKS:
+        if (btLen >= 2)
+          pparams->ui16Wks = (pbtValue[0] << 8) | pbtValue[1];
+        break;
+      case LLCP_PARAM_LTO:
+        // 10 ms units, 0 stands for the default value
+        if (btLen >= 1)
+          pparams->ui16Lto = pbtValue[0] ? pbtValue[0] * 10 : LLCP_LTO_DEFAULT;
+        break;
+      case LLCP_PARAM_RW:
+        if (btLen >= 1)
+          pparams->btRw = pbtValue[0] & 0x0f;
+        break;
+    }
+    szPos += 2 + btLen;
+  }
+}
+
+static size_t
+llcp_param_miux(const uint16_t ui16Miu, uint8_t *pbt)
+{
+  if (ui16Miu <= LLCP_MIU_DEFAULT)
+    return 0;
+  pbt[0] = LLCP_PARAM_MIUX;
+  pbt[1] = 2;
+  pbt[2] = (ui16Miu - LLCP_MIU_DEFAULT) >> 8;
+  pbt[3] = (ui16Miu - LLCP_MIU_DEFAULT) & 0xff;
+  return 4;
+}
+
+// CONNECT and CC parameters
+static size_t
+llcp_conn_params(const llcp_link *pll, uint8_t *pbt)
+{
+  size_t  sz = llcp_param_miux(pll->local.ui16Miu, pbt);
+
+  pbt[sz++] = LLCP_PARAM_RW;
+  pbt[sz++] = 1;
+  pbt[sz++] = pll->local.btRw;
+  return sz;
+}
+
+static void
+llcp_ctrl_push(llcp_link *pll, const uint8_t btDsap, const llcp_pdu_type ptype, const uint8_t btSsap,
+               const uint8_t *pbtInfo, const size_t szInfo)
+{
+  uint8_t abtPdu[16];
+  size_t  sz = llcp_pdu_header(abtPdu, btDsap, ptype, btSsap);
+
+  if (szInfo)
+    memcpy(abtPdu + sz, pbtInfo, szInfo);
+  // A full queue drops the PDU, the peer gives up on its own
+  llcp_queue_push(&pll->ctrl, abtPdu, sz + szInfo, btSsap, btDsap);
+}
+
+static void
+llcp_dm_push(llcp_link *pll, const uint8_t btDsap, const uint8_t btSsap, const uint8_t btReason)
+{
+  llcp_ctrl_push(pll, btDsap, LLCP_PDU_DM, btSsap, &btReason, 1);
+}
+
+static llcp_conn *
+llcp_conn_find(llcp_link *pll, const uint8_t btSsap, const uint8_t btDsap)
+{
+  size_t  szConn;
+
+  for (szConn = 0; szConn < LLCP_CONNS; szConn++) {
+    llcp_conn *pconn = &pll->aconn[szConn];
+    if ((pconn->state != LLCP_CONN_FREE) && (pconn->btSsap == btSsap) && (pconn->btDsap == btDsap))
+      return pconn;
+  }
+  return NULL;
+}
+
+static llcp_conn *
+llcp_conn_alloc(llcp_link *pll, const uint8_t btSsap, const uint8_t btDsap)
+{
+  size_t  szConn;
+
+  for (szConn = 0; szConn < LLCP_CONNS; szConn++) {
+    llcp_conn *pconn = &pll->aconn[szConn];
+    if (pconn->state == LLCP_CONN_FREE) {
+      memset(pconn, 0, sizeof(*pconn));
+      pconn->pll = pll;
+      pconn->btSsap = btSsap;
+      pconn->btDsap = btDsap;
+      pconn->ui16Miu = LLCP_MIU_DEFAULT;
+      pconn->btRw = 1;
+      return pconn;
+    }
+  }
+  return NULL;
+}
+
+static void
+llcp_conn_release(llcp_conn *pconn)
+{
+  llcp_queue_clear(&pconn->tx);
+  llcp_queue_clear(&pconn->rx);
+  pconn->state = LLCP_CONN_FREE;
+}
+
+static void
+llcp_conn_closed(llcp_conn *pconn, const int iError)
+{
+  pconn->state = LLCP_CONN_CLOSED;
+  pconn->iError = iError;
+}
+
+// Every acknowledgement allows the peer to send a whole window: only send one when it fits in the receive queue
+static bool
+llcp_conn_room(const llcp_conn *pconn)
+{
+  return LLCP_QUEUE_LEN - pconn->rx.szCount >= pconn->pll->local.btRw;
+}
+
+static size_t
+llcp_conn_unacked(const llcp_conn *pconn)
+{
+  return (pconn->btVs - pconn->btVsa) & 0x0f;
+}
+
+static bool
+llcp_conn_pending(const llcp_conn *pconn)
+{
+  bool    bRoom;
+  size_t  szUnacked;
+
+  if (pconn->state != LLCP_CONN_CONNECTED)
+    return false;
+  bRoom = llcp_conn_room(pconn);
+  szUnacked = llcp_conn_unacked(pconn);
+  if ((pconn->btVr != pconn->btVra) || (bRoom == pconn->bLocalBusy))
+    return true;
+  return !pconn->bRemoteBusy && (szUnacked < pconn->btRw) && (pconn->tx.szCount > szUnacked);
+}
+
+static void
+llcp_conn_ack(llcp_conn *pconn, const uint8_t btNr)
+{
+  size_t  szAcked = (btNr - pconn->btVsa) & 0x0f;
+
+  // N(R) out of the sent I-PDUs is ignored
+  if (szAcked > llcp_conn_unacked(pconn))
+    return;
+  while (szAcked--)
+    llcp_queue_remove(&pconn->tx, 0);
+  pconn->btVsa = btNr;
+}
+
+// Next PDU of a connection: busy state changes first, then I-PDUs within the remote window, then a RR
+static size_t
+llcp_conn_next_pdu(llcp_conn *pconn, uint8_t *pbt, const size_t szMax)
+{
+  bool    bRoom;
+  size_t  szUnacked;
+
+  if ((pconn->state != LLCP_CONN_CONNECTED) || (szMax < 3))
+    return 0;
+  bRoom = llcp_conn_room(pconn);
+  szUnacked = llcp_conn_unacked(pconn);
+
+  if (!bRoom && ((pconn->btVr != pconn->btVra) || !pconn->bLocalBusy)) {
+    llcp_pdu_header(pbt, pconn->btDsap, LLCP_PDU_RNR, pconn->btSsap);
+    pbt[2] = pconn->btVr;
+    pconn->btVra = pconn->btVr;
+    pconn->bLocalBusy = true;
+    return 3;
+  }
+  if (bRoom && pconn->bLocalBusy) {
+    llcp_pdu_header(pbt, pconn->btDsap, LLCP_PDU_RR, pconn->btSsap);
+    pbt[2] = pconn->btVr;
+    pconn->btVra = pconn->btVr;
+    pconn->bLocalBusy = false;
+    return 3;
+  }
+  if (!pconn->bRemoteBusy && (szUnacked < pconn->btRw) && (pconn->tx.szCount > szUnacked)) {
+    struct llcp_sdu *psdu = llcp_queue_at(&pconn->tx, szUnacked);
+    if (3 + psdu->szData <= szMax) {
+      llcp_pdu_header(pbt, pconn->btDsap, LLCP_PDU_I, pconn->btSsap);
+      pbt[2] = (pconn->btVs << 4) | pconn->btVr;
+      memcpy(pbt + 3, psdu->pbtData, psdu->szData);
+      pconn->btVs = (pconn->btVs + 1) & 0x0f;
+      pconn->btVra = pconn->btVr;
+      pconn->pll->stats.ulBytesSent += psdu->szData;
+      return 3 + psdu->szData;
+    }
+  }
+  if (pconn->btVr != pconn->btVra) {
+    llcp_pdu_header(pbt, pconn->btDsap, LLCP_PDU_RR, pconn->btSsap);
+    pbt[2] = pconn->btVr;
+    pconn->btVra = pconn->btVr;
+    return 3;
+  }
+  return 0;
+}
+
+static bool
+llcp_link_pending(const llcp_link *pll)
+{
+  size_t  szConn;
+
+  if (pll->bDeactivate || pll->ctrl.szCount || pll->uitx.szCount)
+    return true;
+  for (szConn = 0; szConn < LLCP_CONNS; szConn++) {
+    if (llcp_conn_pending(&pll->aconn[szConn]))
+      return true;
+  }
+  return false;
+}
+
+// Next PDU to send no larger than szMax, 0 when there is none
+static size_t
+llcp_link_next_pdu(llcp_link *pll, uint8_t *pbt, const size_t szMax)
+{
+  struct llcp_sdu *psdu;
+  size_t  szConn, sz;
+
+  if (pll->ctrl.szCount) {
+    psdu = llcp_queue_at(&pll->ctrl, 0);
+    if (psdu->szData > szMax)
+      return 0;
+    sz = psdu->szData;
+    memcpy(pbt, psdu->pbtData, sz);
+    llcp_queue_remove(&pll->ctrl, 0);
+    pll->stats.ulPdusSent++;
+    return sz;
+  }
+  for (szConn = 0; szConn < LLCP_CONNS; szConn++) {
+    const size_t szIndex = (pll->szNextConn + szConn) % LLCP_CONNS;
+    if ((sz = llcp_conn_next_pdu(&pll->aconn[szIndex], pbt, szMax))) {
+      pll->szNextConn = szIndex + 1;
+      pll->stats.ulPdusSent++;
+      return sz;
+    }
+  }
+  if (pll->uitx.szCount) {
+    psdu = llcp_queue_at(&pll->uitx, 0);
+    if (2 + psdu->szData > szMax)
+      return 0;
+    sz = llcp_pdu_header(pbt, psdu->btDsap, LLCP_PDU_UI, psdu->btSsap);
+    memcpy(pbt + sz, psdu->pbtData, psdu->szData);
+    sz += psdu->szData;
+    pll->stats.ulBytesSent += psdu->szData;
+    llcp_queue_remove(&pll->uitx, 0);
+    pll->stats.ulPdusSent++;
+    return sz;
+  }
+  return 0;
+}
+
+static void
+llcp_link_wait_until(llcp_link *pll, const struct timespec *pts)
+{
+  while (!llcp_link_pending(pll)) {
+    if (pthread_cond_timedwait(&pll->cond, &pll->mutex, pts) == ETIMEDOUT)
+      break;
+  }
+}
+
+// Builds the next outgoing frame in abtTx: one PDU, an AGF PDU or a SYMM PDU
+static size_t
+llcp_link_build(llcp_link *pll)
+{
+  const size_t szMiu = pll->remote.ui16Miu;
+  uint8_t *pbt = pll->abtTx;
+  size_t  szPdu, szPos, szPdus = 1;
+
+  if (pll->bTxSymm && pll->bRxSymm) {
+    // Idle link: the SYMM PDU waits for local traffic, longer each time, keeping within the local link timeout
+    if (!llcp_link_pending(pll)) {
+      struct timespec ts;
+
+      pll->iSymmDelay = pll->iSymmDelay ? pll->iSymmDelay * 2 : LLCP_SYMM_DELAY_MIN;
+      if (pll->iSymmDelay > pll->local.ui16Lto / 2)
+        pll->iSymmDelay = pll->local.ui16Lto / 2;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += (long) pll->iSymmDelay * 1000000;
+      ts.tv_sec += ts.tv_nsec / 1000000000;
+      ts.tv_nsec %= 1000000000;
+      llcp_link_wait_until(pll, &ts);
+    }
+  } else {
+    pll->iSymmDelay = 0;
+  }
+
+  if (pll->bDeactivate) {
+    pll->bDiscSent = true;
+    pll->bTxSymm = false;
+    return llcp_pdu_header(pbt, LLCP_SAP_LM, LLCP_PDU_DISC, LLCP_SAP_LM);
+  }
+
+  // The first PDU is built after room for an AGF header and a length
+  if ((szPdu = llcp_link_next_pdu(pll, pbt + 4, 3 + szMiu)) == 0) {
+    pll->bTxSymm = true;
+    pll->stats.ulSymmSent++;
+    return llcp_pdu_header(pbt, LLCP_SAP_LM, LLCP_PDU_SYMM, LLCP_SAP_LM);
+  }
+  pll->bTxSymm = false;
+
+  // AGF information field: length-prefixed PDUs, within the remote link MIU
+  szPos = 2 + 2 + szPdu;
+  if (pll->local.bAggregate) {
+    while (szPos + 2 + 2 <= 2 + szMiu) {
+      size_t  sz = llcp_link_next_pdu(pll, pbt + szPos + 2, 2 + szMiu - szPos - 2);
+      if (sz == 0)
+        break;
+      pbt[szPos] = sz >> 8;
+      pbt[szPos + 1] = sz & 0xff;
+      szPos += 2 + sz;
+      szPdus++;
+    }
+  }
+  if (szPdus == 1) {
+    memmove(pbt, pbt + 4, szPdu);
+    return szPdu;
+  }
+  llcp_pdu_header(pbt, LLCP_SAP_LM, LLCP_PDU_AGF, LLCP_SAP_LM);
+  pbt[2] = szPdu >> 8;
+  pbt[3] = szPdu & 0xff;
+  pll->stats.ulAgfSent++;
+  return szPos;
+}
+
+static void
+llcp_pdu_process(llcp_link *pll, const uint8_t *pbt, const size_t sz, const bool bAggregated)
+{
+  uint8_t abtParams[16];
+  llcp_params params;
+  llcp_conn *pconn;
+  size_t  szPos, szPdu;
+  uint8_t btDsap, btSsap, btNs, btNr;
+  llcp_pdu_type ptype;
+
+  if (sz < 2)
+    return;
+  btDsap = pbt[0] >> 2;
+  ptype = ((pbt[0] & 0x3) << 2) | (pbt[1] >> 6);
+  btSsap = pbt[1] & 0x3f;
+  if (!bAggregated)
+    pll->bRxSymm = (ptype == LLCP_PDU_SYMM);
+  if ((ptype != LLCP_PDU_SYMM) && (ptype != LLCP_PDU_AGF))
+    pll->stats.ulPdusReceived++;
+
+  switch (ptype) {
+    case LLCP_PDU_SYMM:
+    case LLCP_PDU_PAX:
+    case LLCP_PDU_SNL:
+      break;
+    case LLCP_PDU_AGF:
+      // Nested AGF PDUs are not allowed
+      if (bAggregated)
+        break;
+      for (szPos = 2; szPos + 2 <= sz; szPos += 2 + szPdu) {
+        szPdu = (pbt[szPos] << 8) | pbt[szPos + 1];
+        if (szPos + 2 + szPdu > sz)
+          break;
+        llcp_pdu_process(pll, pbt + szPos + 2, szPdu, true);
+      }
+      break;
+    case LLCP_PDU_DISC:
+      if ((btDsap == LLCP_SAP_LM) && (btSsap == LLCP_SAP_LM)) {
+        pll->bDiscReceived = true;
+        break;
+      }
+      if ((pconn = llcp_conn_find(pll, btDsap, btSsap)) &&
+          ((pconn->state == LLCP_CONN_CONNECTED) || (pconn->state == LLCP_CONN_DISCONNECTING))) {
+        llcp_dm_push(pll, btSsap, btDsap, LLCP_DM_DISC);
+        llcp_conn_closed(pconn, 0);
+      } else {
+        llcp_dm_push(pll, btSsap, btDsap, LLCP_DM_NO_CONN);
+      }
+      break;
+    case LLCP_PDU_CONNECT:
+      if ((btDsap > LLCP_SAP_MAX) || !(pll->ui64Bound & (1ULL << btDsap))) {
+        llcp_dm_push(pll, btSsap, btDsap, LLCP_DM_NO_SERVICE);
+        break;
+      }
+      if (llcp_conn_find(pll, btDsap, btSsap) || ((pconn = llcp_conn_alloc(pll, btDsap, btSsap)) == NULL)) {
+        llcp_dm_push(pll, btSsap, btDsap, LLCP_DM_REJECTED);
+        break;
+      }
+      params.ui16Miu = LLCP_MIU_DEFAULT;
+      params.btRw = 1;
+      llcp_params_parse(pbt + 2, sz - 2, &params);
+      pconn->ui16Miu = params.ui16Miu;
+      pconn->btRw = params.btRw;
+      pconn->state = LLCP_CONN_CONNECTED;
+      llcp_ctrl_push(pll, btSsap, LLCP_PDU_CC, btDsap, abtParams, llcp_conn_params(pll, abtParams));
+      break;
+    case LLCP_PDU_CC:
+      for (szPos = 0; szPos < LLCP_CONNS; szPos++) {
+        pconn = &pll->aconn[szPos];
+        if ((pconn->state == LLCP_CONN_CONNECTING) && (pconn->btSsap == btDsap)) {
+          params.ui16Miu = LLCP_MIU_DEFAULT;
+          params.btRw = 1;
+          llcp_params_parse(pbt + 2, sz - 2, &params);
+          pconn->ui16Miu = params.ui16Miu;
+          pconn->btRw = params.btRw;
+          pconn->btDsap = btSsap;
+          pconn->state = LLCP_CONN_CONNECTED;
+          break;
+        }
+      }
+      break;
+    case LLCP_PDU_DM:
+      for (szPos = 0; szPos < LLCP_CONNS; szPos++) {
+        pconn = &pll->aconn[szPos];
+        if ((pconn->state != LLCP_CONN_FREE) && (pconn->state != LLCP_CONN_CLOSED) &&
+            (pconn->btSsap == btDsap) && (pconn->btDsap == btSsap)) {
+          llcp_conn_closed(pconn, (pconn->state == LLCP_CONN_CONNECTING) ? NFC_EOPABORTED : 0);
+          break;
+        }
+      }
+      break;
+    case LLCP_PDU_FRMR:
+      if ((pconn = llcp_conn_find(pll, btDsap, btSsap)) && (pconn->state != LLCP_CONN_CLOSED))
+        llcp_conn_closed(pconn, NFC_EIO);
+      break;
+    case LLCP_PDU_UI:
+      if ((btDsap <= LLCP_SAP_MAX) && (pll->ui64Bound & (1ULL << btDsap))) {
+        // Connectionless transport is unreliable: a full queue drops the SDU
+        if (llcp_queue_push(&pll->uirx, pbt + 2, sz - 2, btSsap, btDsap))
+          pll->stats.ulBytesReceived += sz - 2;
+      }
+      break;
+    case LLCP_PDU_I:
+    case LLCP_PDU_RR:
+    case LLCP_PDU_RNR:
+      if (sz < 3)
+        break;
+      if (((pconn = llcp_conn_find(pll, btDsap, btSsap)) == NULL) || (pconn->state != LLCP_CONN_CONNECTED)) {
+        if (!pconn || (pconn->state == LLCP_CONN_CLOSED))
+          llcp_dm_push(pll, btSsap, btDsap, LLCP_DM_NO_CONN);
+        break;
+      }
+      btNs = pbt[2] >> 4;
+      btNr = pbt[2] & 0x0f;
+      llcp_conn_ack(pconn, btNr);
+      if (ptype != LLCP_PDU_I) {
+        pconn->bRemoteBusy = (ptype == LLCP_PDU_RNR);
+        break;
+      }
+      // The MAC is reliable: an I-PDU out of sequence or beyond the window breaks the connection
+      if ((btNs != pconn->btVr) || (sz - 3 > pll->local.ui16Miu) ||
+          !llcp_queue_push(&pconn->rx, pbt + 3, sz - 3, btSsap, btDsap)) {
+        abtParams[0] = LLCP_FRMR_S | ptype;
+        abtParams[1] = pbt[2];
+        abtParams[2] = (pconn->btVs << 4) | pconn->btVr;
+        abtParams[3] = (pconn->btVsa << 4) | pconn->btVra;
+        llcp_ctrl_push(pll, btSsap, LLCP_PDU_FRMR, btDsap, abtParams, 4);
+        llcp_conn_closed(pconn, NFC_EIO);
+        break;
+      }
+      pconn->btVr = (pconn->btVr + 1) & 0x0f;
+      pll->stats.ulBytesReceived += sz - 3;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * @brief Default link parameters
+ */
+void
+llcp_params_default(llcp_params *pparams)
+{
+  pparams->btVersion = LLCP_VERSION;
+  pparams->ui16Miu = LLCP_MIU_DEFAULT;
+  pparams->ui16Wks = 1 << LLCP_SAP_LM;
+  pparams->ui16Lto = LLCP_LTO_DEFAULT;
+  pparams->btRw = 4;
+  pparams->bAggregate = true;
+}
+
+/**
+ * @brief Allocate a link on a device
+ * @return the link, NULL on allocation failure
+ * @param bInitiator true when the device is the DEP initiator
+ * @param pparams local parameters, NULL for the default ones
+ */
+llcp_link *
+llcp_link_new(nfc_device *pnd, const bool bInitiator, const llcp_params *pparams)
+{
+  llcp_link *pll;
+
+  if ((pll = calloc(1, sizeof(*pll))) == NULL)
+    return NULL;
+  pll->pnd = pnd;
+  pll->bInitiator = bInitiator;
+  if (pparams)
+    pll->local = *pparams;
+  else
+    llcp_params_default(&pll->local);
+  if (pll->local.ui16Miu < LLCP_MIU_DEFAULT)
+    pll->local.ui16Miu = LLCP_MIU_DEFAULT;
+  if (pll->local.ui16Miu > LLCP_MIU_MAX)
+    pll->local.ui16Miu = LLCP_MIU_MAX;
+  if (pll->local.btRw > LLCP_RW_MAX)
+    pll->local.btRw = LLCP_RW_MAX;
+  // The LTO parameter counts 10 ms units on one byte
+  pll->local.ui16Lto = (pll->local.ui16Lto + 9) / 10 * 10;
+  if ((pll->local.ui16Lto == 0) || (pll->local.ui16Lto > 2550))
+    pll->local.ui16Lto = (pll->local.ui16Lto == 0) ? LLCP_LTO_DEFAULT : 2550;
+  llcp_params_default(&pll->remote);
+  pthread_mutex_init(&pll->mutex, NULL);
+  pthread_cond_init(&pll->cond, NULL);
+  return pll;
+}
+
+/**
+ * @brief Free a link, llcp_link_run() must have returned
+ */
+void
+llcp_link_free(llcp_link *pll)
+{
+  size_t  szConn;
+
+  for (szConn = 0; szConn < LLCP_CONNS; szConn++)
+    llcp_conn_release(&pll->aconn[szConn]);
+  llcp_queue_clear(&pll->ctrl);
+  llcp_queue_clear(&pll->uitx);
+  llcp_queue_clear(&pll->uirx);
+  pthread_cond_destroy(&pll->cond);
+  pthread_mutex_destroy(&pll->mutex);
+  free(pll);
+}
+
+/**
+ * @brief Build the general bytes of the ATR_REQ (initiator) or ATR_RES (target)
+ * @return the length of the general bytes, 0 when pbtGB is too small
+ *
+ * The SAPs below 16 bound by llcp_bind() are announced as well-known services.
+ */
+size_t
+llcp_link_general_bytes(const llcp_link *pll, uint8_t *pbtGB, const size_t szGB)
+{
+  uint8_t abt[32];
+  size_t  sz = 0;
+  uint16_t ui16Wks = pll->local.ui16Wks | (pll->ui64Bound & 0xffff);
+
+  memcpy(abt, abtLlcpMagic, sizeof(abtLlcpMagic));
+  sz += sizeof(abtLlcpMagic);
+  abt[sz++] = LLCP_PARAM_VERSION;
+  abt[sz++] = 1;
+  abt[sz++] = pll->local.btVersion;
+  sz += llcp_param_miux(pll->local.ui16Miu, abt + sz);
+  abt[sz++] = LLCP_PARAM_WKS;
+  abt[sz++] = 2;
+  abt[sz++] = ui16Wks >> 8;
+  abt[sz++] = ui16Wks & 0xff;
+  abt[sz++] = LLCP_PARAM_LTO;
+  abt[sz++] = 1;
+  abt[sz++] = pll->local.ui16Lto / 10;
+  abt[sz++] = LLCP_PARAM_OPT;
+  abt[sz++] = 1;
+  abt[sz++] = LLCP_OPT_LSC;
+  if (sz > szGB)
+    return 0;
+  memcpy(pbtGB, abt, sz);
+  return sz;
+}
+
+/**
+ * @brief Activate the link with the general bytes received from the peer
+ * @return 0 on success, NFC_EINVARG when the peer does not talk LLCP, NFC_EDEVNOTSUPP on a major version mismatch
+ */
+int
+llcp_link_activate(llcp_link *pll, const uint8_t *pbtRemoteGB, const size_t szRemoteGB)
+{
+  llcp_params params;
+
+  if ((szRemoteGB < sizeof(abtLlcpMagic)) || memcmp(pbtRemoteGB, abtLlcpMagic, sizeof(abtLlcpMagic)))
+    return NFC_EINVARG;
+  llcp_params_default(&params);
+  params.btVersion = 0x10;
+  params.ui16Wks = 0;
+  params.btRw = 1;
+  llcp_params_parse(pbtRemoteGB + sizeof(abtLlcpMagic), szRemoteGB - sizeof(abtLlcpMagic), &params);
+  if ((params.btVersion >> 4) != (LLCP_VERSION >> 4))
+    return NFC_EDEVNOTSUPP;
+
+  pthread_mutex_lock(&pll->mutex);
+  pll->remote = params;
+  pll->state = LLCP_LINK_ACTIVE;
+  pthread_mutex_unlock(&pll->mutex);
+  return 0;
+}
+
+static void
+llcp_link_down(llcp_link *pll, const int iError)
+{
+  size_t  szConn;
+
+  pthread_mutex_lock(&pll->mutex);
+  pll->state = LLCP_LINK_DOWN;
+  pll->iError = iError;
+  for (szConn = 0; szConn < LLCP_CONNS; szConn++) {
+    llcp_conn *pconn = &pll->aconn[szConn];
+    if ((pconn->state != LLCP_CONN_FREE) && (pconn->state != LLCP_CONN_CLOSED))
+      llcp_conn_closed(pconn, NFC_ETGRELEASED);
+  }
+  pthread_cond_broadcast(&pll->cond);
+  pthread_mutex_unlock(&pll->mutex);
+}
+
+static void
+llcp_link_receive(llcp_link *pll, const size_t szRx)
+{
+  pthread_mutex_lock(&pll->mutex);
+  pll->stats.ulExchanges++;
+  llcp_pdu_process(pll, pll->abtRx, szRx, false);
+  pthread_cond_broadcast(&pll->cond);
+  pthread_mutex_unlock(&pll->mutex);
+}
+
+/**
+ * @brief Run the link: the MAC exchanges PDUs until the link is deactivated
+ * @return 0 after a deactivation, a libnfc error code when the DEP transport failed
+ *
+ * The initiator sends first, the target answers each PDU. A peer not heard from within its
+ * link timeout (and a margin for the transport) is lost.
+ */
+int
+llcp_link_run(llcp_link *pll)
+{
+  const int iTimeout = pll->remote.ui16Lto + LLCP_LTO_MARGIN;
+  size_t  szTx;
+  int     res = 0;
+
+  while (true) {
+    if (!pll->bInitiator) {
+      if ((res = nfc_target_receive_bytes(pll->pnd, pll->abtRx, sizeof(pll->abtRx), iTimeout)) < 0)
+        break;
+      llcp_link_receive(pll, res);
+      if (pll->bDiscReceived) {
+        // Still answer the DEP request
+        uint8_t abtSymm[2];
+        llcp_pdu_header(abtSymm, LLCP_SAP_LM, LLCP_PDU_SYMM, LLCP_SAP_LM);
+        nfc_target_send_bytes(pll->pnd, abtSymm, sizeof(abtSymm), iTimeout);
+        res = 0;
+        break;
+      }
+    }
+
+    pthread_mutex_lock(&pll->mutex);
+    szTx = llcp_link_build(pll);
+    pthread_mutex_unlock(&pll->mutex);
+
+    if (pll->bInitiator) {
+      res = nfc_initiator_transceive_bytes(pll->pnd, pll->abtTx, szTx, pll->abtRx, sizeof(pll->abtRx), iTimeout);
+    } else {
+      res = nfc_target_send_bytes(pll->pnd, pll->abtTx, szTx, iTimeout);
+    }
+    if (pll->bDiscSent) {
+      res = 0;
+      break;
+    }
+    if (res < 0)
+      break;
+    if (pll->bInitiator) {
+      llcp_link_receive(pll, res);
+      if (pll->bDiscReceived) {
+        res = 0;
+        break;
+      }
+    }
+  }
+  llcp_link_down(pll, res);
+  return res;
+}
+
+/**
+ * @brief Deactivate the link: a DISC PDU is sent to the peer, then llcp_link_run() returns
+ */
+void
+llcp_link_deactivate(llcp_link *pll)
+{
+  pthread_mutex_lock(&pll->mutex);
+  pll->bDeactivate = true;
+  pthread_cond_broadcast(&pll->cond);
+  pthread_mutex_unlock(&pll->mutex);
+}
+
+/**
+ * @brief Parameters received from the peer in llcp_link_activate()
+ */
+void
+llcp_link_get_remote_params(llcp_link *pll, llcp_params *pparams)
+{
+  pthread_mutex_lock(&pll->mutex);
+  *pparams = pll->remote;
+  pthread_mutex_unlock(&pll->mutex);
+}
+
+void
+llcp_link_get_stats(llcp_link *pll, llcp_stats *pstats)
+{
+  pthread_mutex_lock(&pll->mutex);
+  *pstats = pll->stats;
+  pthread_mutex_unlock(&pll->mutex);
+}
+
+/**
+ * @brief Bind a local SAP: it accepts connections (llcp_accept()) and receives UI PDUs (llcp_recv_ui())
+ */
+int
+llcp_bind(llcp_link *pll, const uint8_t btSap)
+{
+  if ((btSap == LLCP_SAP_LM) || (btSap > LLCP_SAP_MAX))
+    return NFC_EINVARG;
+  pthread_mutex_lock(&pll->mutex);
+  pll->ui64Bound |= 1ULL << btSap;
+  pthread_mutex_unlock(&pll->mutex);
+  return 0;
+}
+
+/**
+ * @brief Connect to the service bound to a remote SAP
+ * @return the connection, NULL on failure with the error code in *pres
+ *
+ * The local SAP is the first free one from LLCP_SAP_DYNAMIC up.
+ */
+llcp_conn *
+llcp_connect(llcp_link *pll, const uint8_t btDsap, int *pres)
+{
+  uint8_t abtParams[16];
+  llcp_conn *pconn = NULL;
+  uint8_t btSsap;
+  size_t  szConn;
+
+  *pres = NFC_EINVARG;
+  if ((btDsap == LLCP_SAP_LM) || (btDsap > LLCP_SAP_MAX))
+    return NULL;
+  pthread_mutex_lock(&pll->mutex);
+  for (btSsap = LLCP_SAP_DYNAMIC; btSsap <= LLCP_SAP_MAX; btSsap++) {
+    if (pll->ui64Bound & (1ULL << btSsap))
+      continue;
+    for (szConn = 0; szConn < LLCP_CONNS; szConn++) {
+      if ((pll->aconn[szConn].state != LLCP_CONN_FREE) && (pll->aconn[szConn].btSsap == btSsap))
+        break;
+    }
+    if (szConn == LLCP_CONNS)
+      break;
+  }
+  if ((btSsap > LLCP_SAP_MAX) || (pll->state == LLCP_LINK_DOWN) || ((pconn = llcp_conn_alloc(pll, btSsap, btDsap)) == NULL)) {
+    *pres = (pll->state == LLCP_LINK_DOWN) ? NFC_ETGRELEASED : NFC_ESOFT;
+    pthread_mutex_unlock(&pll->mutex);
+    return NULL;
+  }
+  pconn->state = LLCP_CONN_CONNECTING;
+  llcp_ctrl_push(pll, btDsap, LLCP_PDU_CONNECT, btSsap, abtParams, llcp_conn_params(pll, abtParams));
+  pthread_cond_broadcast(&pll->cond);
+  while (pconn->state == LLCP_CONN_CONNECTING)
+    pthread_cond_wait(&pll->cond, &pll->mutex);
+  if (pconn->state != LLCP_CONN_CONNECTED) {
+    *pres = pconn->iError;
+    llcp_conn_release(pconn);
+    pconn = NULL;
+  } else {
+    pconn->bAccepted = true;
+    *pres = 0;
+  }
+  pthread_mutex_unlock(&pll->mutex);
+  return pconn;
+}
+
+/**
+ * @brief Wait for a connection to a bound SAP
+ * @return the connection, NULL on failure with the error code in *pres
+ */
+llcp_conn *
+llcp_accept(llcp_link *pll, const uint8_t btSap, int *pres)
+{
+  llcp_conn *pconn = NULL;
+  size_t  szConn;
+
+  pthread_mutex_lock(&pll->mutex);
+  while (pconn == NULL) {
+    for (szConn = 0; szConn < LLCP_CONNS; szConn++) {
+      llcp_conn *p = &pll->aconn[szConn];
+      if ((p->state != LLCP_CONN_FREE) && (p->state != LLCP_CONN_CONNECTING) && !p->bAccepted && (p->btSsap == btSap)) {
+        pconn = p;
+        break;
+      }
+    }
+    if (pconn || (pll->state == LLCP_LINK_DOWN))
+      break;
+    pthread_cond_wait(&pll->cond, &pll->mutex);
+  }
+  if (pconn) {
+    pconn->bAccepted = true;
+    *pres = 0;
+  } else {
+    *pres = NFC_ETGRELEASED;
+  }
+  pthread_mutex_unlock(&pll->mutex);
+  return pconn;
+}
+
+/**
+ * @brief Send a SDU on a connection, wait while the send queue is full
+ * @return the SDU length, or a libnfc error code
+ *
+ * The SDU can not be larger than the remote MIU of the connection.
+ */
+int
+llcp_send(llcp_conn *pconn, const uint8_t *pbtData, const size_t szData)
+{
+  llcp_link *pll = pconn->pll;
+  int     res;
+
+  pthread_mutex_lock(&pll->mutex);
+  while ((pconn->state == LLCP_CONN_CONNECTED) && (pconn->tx.szCount == LLCP_QUEUE_LEN))
+    pthread_cond_wait(&pll->cond, &pll->mutex);
+  if (pconn->state != LLCP_CONN_CONNECTED) {
+    res = NFC_ETGRELEASED;
+  } else if (szData > pconn->ui16Miu) {
+    res = NFC_EINVARG;
+  } else if (!llcp_queue_push(&pconn->tx, pbtData, szData, pconn->btSsap, pconn->btDsap)) {
+    res = NFC_ESOFT;
+  } else {
+    res = szData;
+    pthread_cond_broadcast(&pll->cond);
+  }
+  pthread_mutex_unlock(&pll->mutex);
+  return res;
+}
+
+/**
+ * @brief Receive a SDU from a connection, wait until one is there
+ * @return the SDU length, 0 when the peer disconnected, NFC_EOVFLOW when pbtData is too small for the SDU,
+ * or a libnfc error code
+ */
+int
+llcp_recv(llcp_conn *pconn, uint8_t *pbtData, const size_t szData)
+{
+  llcp_link *pll = pconn->pll;
+  struct llcp_sdu *psdu;
+  int     res;
+
+  pthread_mutex_lock(&pll->mutex);
+  while ((pconn->state == LLCP_CONN_CONNECTED) && (pconn->rx.szCount == 0))
+    pthread_cond_wait(&pll->cond, &pll->mutex);
+  if (pconn->rx.szCount) {
+    psdu = llcp_queue_at(&pconn->rx, 0);
+    if (psdu->szData > szData) {
+      res = NFC_EOVFLOW;
+    } else {
+      memcpy(pbtData, psdu->pbtData, psdu->szData);
+      res = psdu->szData;
+      llcp_queue_remove(&pconn->rx, 0);
+      // Room in the receive queue may end a busy condition
+      pthread_cond_broadcast(&pll->cond);
+    }
+  } else {
+    res = pconn->iError;
+  }
+  pthread_mutex_unlock(&pll->mutex);
+  return res;
+}
+
+/**
+ * @brief Close a connection and free it
+ * @return 0 on success, or a libnfc error code
+ *
+ * The queued SDUs are delivered and acknowledged before the DISC PDU is sent.
+ */
+int
+llcp_close(llcp_conn *pconn)
+{
+  llcp_link *pll = pconn->pll;
+  int     res;
+
+  pthread_mutex_lock(&pll->mutex);
+  while ((pconn->state == LLCP_CONN_CONNECTED) && pconn->tx.szCount)
+    pthread_cond_wait(&pll->cond, &pll->mutex);
+  if (pconn->state == LLCP_CONN_CONNECTED) {
+    llcp_ctrl_push(pll, pconn->btDsap, LLCP_PDU_DISC, pconn->btSsap, NULL, 0);
+    pconn->state = LLCP_CONN_DISCONNECTING;
+    pthread_cond_broadcast(&pll->cond);
+    while (pconn->state == LLCP_CONN_DISCONNECTING)
+      pthread_cond_wait(&pll->cond, &pll->mutex);
+  }
+  res = pconn->iError;
+  llcp_conn_release(pconn);
+  pthread_mutex_unlock(&pll->mutex);
+  return res;
+}
+
+/**
+ * @brief Send a SDU with the connectionless transport, wait while the send queue is full
+ * @return the SDU length, or a libnfc error code
+ */
+int
+llcp_send_ui(llcp_link *pll, const uint8_t btSsap, const uint8_t btDsap, const uint8_t *pbtData, const size_t szData)
+{
+  int     res;
+
+  if ((btSsap > LLCP_SAP_MAX) || (btDsap > LLCP_SAP_MAX))
+    return NFC_EINVARG;
+  pthread_mutex_lock(&pll->mutex);
+  while ((pll->state != LLCP_LINK_DOWN) && (pll->uitx.szCount == LLCP_QUEUE_LEN))
+    pthread_cond_wait(&pll->cond, &pll->mutex);
+  if (pll->state == LLCP_LINK_DOWN) {
+    res = NFC_ETGRELEASED;
+  } else if (szData > pll->remote.ui16Miu) {
+    res = NFC_EINVARG;
+  } else if (!llcp_queue_push(&pll->uitx, pbtData, szData, btSsap, btDsap)) {
+    res = NFC_ESOFT;
+  } else {
+    res = szData;
+    pthread_cond_broadcast(&pll->cond);
+  }
+  pthread_mutex_unlock(&pll->mutex);
+  return res;
+}
+
+/**
+ * @brief Receive a SDU sent to a bound SAP with the connectionless transport
+ * @return the SDU length, NFC_EOVFLOW when pbtData is too small for the SDU, or a libnfc error code
+ * @param pbtSsap when not NULL, receives the SAP of the sender
+ */
+int
+llcp_recv_ui(llcp_link *pll, const uint8_t btSap, uint8_t *pbtData, const size_t szData, uint8_t *pbtSsap)
+{
+  struct llcp_sdu *psdu;
+  size_t  szIndex;
+  int     res = NFC_ETGRELEASED;
+
+  pthread_mutex_lock(&pll->mutex);
+  while (true) {
+    for (szIndex = 0; szIndex < pll->uirx.szCount; szIndex++) {
+      if (llcp_queue_at(&pll->uirx, szIndex)->btDsap == btSap)
+        break;
+    }
+    if ((szIndex < pll->uirx.szCount) || (pll->state == LLCP_LINK_DOWN))
+      break;
+    pthread_cond_wait(&pll->cond, &pll->mutex);
+  }
+  if (szIndex < pll->uirx.szCount) {
+    psdu = llcp_queue_at(&pll->uirx, szIndex);
+    if (psdu->szData > szData) {
+      res = NFC_EOVFLOW;
+    } else {
+      memcpy(pbtData, psdu->pbtData, psdu->szData);
+      if (pbtSsap)
+        *pbtSsap = psdu->btSsap;
+      res = psdu->szData;
+      llcp_queue_remove(&pll->uirx, szIndex);
+    }
+  }
+  pthread_mutex_unlock(&pll->mutex);
+  return res;
+}
@@ -0,0 +1,152 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file llcp.h
+ * @brief NFC Forum Logical Link Control Protocol (LLCP) over NFC-DEP
+ *
+ * The link runs over the DEP functions of libnfc: once nfc_initiator_select_dep_target()
+ * or nfc_target_init() has exchanged the LLCP general bytes (see llcp_link_general_bytes()),
+ * llcp_link_activate() parses the remote parameters and a thread runs llcp_link_run(),
+ * which owns the device until the link is deactivated. Other threads use the link through
+ * data link connections (llcp_connect(), llcp_accept(), llcp_send(), llcp_recv()) or
+ * connectionless transport (llcp_send_ui(), llcp_recv_ui()).
+ *
+ * Each DEP exchange carries one PDU per direction: several pending PDUs (I-PDUs of a
+ * send window, acknowledgements, UI-PDUs) are aggregated into one AGF PDU. When both
+ * sides are idle the SYMM PDUs are delayed, up to half the local link timeout.
+ *
+ * Not supported: the service discovery protocol (SNL PDUs) and connecting by service
+ * name, services are reached through their SAP.
+ */
+
+#ifndef _LIBNFC_LLCP_H_
+#  define _LIBNFC_LLCP_H_
+
+#  include <stdint.h>
+#  include <stdbool.h>
+#  include <stddef.h>
+
+#  include <nfc/nfc-types.h>
+
+// Version 1.1
+#  define LLCP_VERSION 0x11
+// Default link and connection MIU, the MIUX parameter extends it up to 2175 bytes
+#  define LLCP_MIU_DEFAULT 128
+#  define LLCP_MIU_MAX 2175
+// Default link timeout, in ms
+#  define LLCP_LTO_DEFAULT 100
+// Largest receive window (4-bit sequence numbers)
+#  define LLCP_RW_MAX 15
+
+// Service access points
+#  define LLCP_SAP_LM     0x00   // link management
+#  define LLCP_SAP_SDP    0x01   // service discovery
+#  define LLCP_SAP_SNEP   0x04   // Simple NDEF Exchange Protocol
+#  define LLCP_SAP_MAX    0x3f
+// SAPs from this one up are allocated to outgoing connections
+#  define LLCP_SAP_DYNAMIC 0x20
+
+typedef enum {
+  LLCP_PDU_SYMM = 0x0,
+  LLCP_PDU_PAX = 0x1,
+  LLCP_PDU_AGF = 0x2,
+  LLCP_PDU_UI = 0x3,
+  LLCP_PDU_CONNECT = 0x4,
+  LLCP_PDU_DISC = 0x5,
+  LLCP_PDU_CC = 0x6,
+  LLCP_PDU_DM = 0x7,
+  LLCP_PDU_FRMR = 0x8,
+  LLCP_PDU_SNL = 0x9,
+  LLCP_PDU_I = 0xc,
+  LLCP_PDU_RR = 0xd,
+  LLCP_PDU_RNR = 0xe,
+} llcp_pdu_type;
+
+// Disconnected mode reasons
+#  define LLCP_DM_DISC        0x00   // answer to DISC
+#  define LLCP_DM_NO_CONN     0x01   // no active connection for the connection-oriented PDU
+#  define LLCP_DM_NO_SERVICE  0x02   // no service bound to the target SAP
+#  define LLCP_DM_REJECTED    0x03   // CONNECT rejected by the service layer
+
+// Link and connection parameters
+typedef struct {
+  uint8_t  btVersion;
+  uint16_t ui16Miu;       // link MIU: largest information field of a PDU
+  uint16_t ui16Wks;       // well-known services bit map
+  uint16_t ui16Lto;       // link timeout, in ms
+  uint8_t  btRw;          // receive window of the connections (0 - 15)
+  bool     bAggregate;    // send AGF PDUs, the remote side must always accept them
+} llcp_params;
+
+// Link counters
+typedef struct {
+  unsigned long ulExchanges;    // DEP exchanges (one PDU each way)
+  unsigned long ulPdusSent;     // PDUs sent, the ones in AGF PDUs included
+  unsigned long ulPdusReceived;
+  unsigned long ulAgfSent;
+  unsigned long ulSymmSent;
+  unsigned long ulBytesSent;    // SDU bytes of the I and UI PDUs
+  unsigned long ulBytesReceived;
+} llcp_stats;
+
+typedef struct llcp_link llcp_link;
+typedef struct llcp_conn llcp_conn;
+
+void    llcp_params_default(llcp_params *pparams);
+
+llcp_link *llcp_link_new(nfc_device *pnd, const bool bInitiator, const llcp_params *pparams);
+void    llcp_link_free(llcp_link *pll);
+size_t  llcp_link_general_bytes(const llcp_link *pll, uint8_t *pbtGB, const size_t szGB);
+int     llcp_link_activate(llcp_link *pll, const uint8_t *pbtRemoteGB, const size_t szRemoteGB);
+int     llcp_link_run(llcp_link *pll);
+void    llcp_link_deactivate(llcp_link *pll);
+void    llcp_link_get_remote_params(llcp_link *pll, llcp_params *pparams);
+void    llcp_link_get_stats(llcp_link *pll, llcp_stats *pstats);
+
+// Connection-oriented transport
+int     llcp_bind(llcp_link *pll, const uint8_t btSap);
+llcp_conn *llcp_connect(llcp_link *pll, const uint8_t btDsap, int *pres);
+llcp_conn *llcp_accept(llcp_link *pll, const uint8_t btSap, int *pres);
+int     llcp_send(llcp_conn *pconn, const uint8_t *pbtData, const size_t szData);
+int     llcp_recv(llcp_conn *pconn, uint8_t *pbtData, const size_t szData);
+int     llcp_close(llcp_conn *pconn);
+
+// Connectionless transport
+int     llcp_send_ui(llcp_link *pll, const uint8_t btSsap, const uint8_t btDsap, const uint8_t *pbtData, const size_t szData);
+int     llcp_recv_ui(llcp_link *pll, const uint8_t btSap, uint8_t *pbtData, const size_t szData, uint8_t *pbtSsap);
+
+#endif // _LIBNFC_LLCP_H_
@@ -43,6 +43,8 @@
 
 #include <nfc/nfc.h>
 
+#include "nfc-utils.h"
+
 /**
  * @brief Execute a MIFARE Classic Command
  * @return Returns true if action was successfully performed; otherwise returns false.
@@ -140,3 +142,225 @@ nfc_initiator_mifare_cmd(nfc_device *pnd, const mifare_cmd mc, const uint8_t ui8
   // Command succesfully executed
   return true;
 }
+
+/*
+ * MIFARE Ultralight family memory engine
+ *
+ * The product, hence the memory size, is detected with GET_VERSION
+ * (Ultralight EV1 and NTAG21x). Tags without it answer with a NAK and go
+ * back to idle, they are selected again and told apart (Ultralight C has
+ * pages beyond 0x0F) with one more READ.
+ * Tags with GET_VERSION also support FAST_READ: page ranges are then read
+ * in as few commands as the reader's largest frame allows; when the reader
+ * fails on a long answer, the frame size is halved. Writes are diffed
+ * against the image last read from or written to the tag (abtCache, fetched
+ * first when unknown) and only send the pages which changed.
+ */
+
+static const struct mifareul_product {
+  uint8_t  btType;        // GET_VERSION product type
+  uint8_t  btStorage;     // GET_VERSION storage size
+  const char *pcName;
+  size_t   szPages;
+  size_t   szConfigPage;
+} mifareul_products[] = {
+  { 0x03, 0x0B, "MIFARE Ultralight EV1 (MF0UL11)", 20, 0x10 },
+  { 0x03, 0x0E, "MIFARE Ultralight EV1 (MF0UL21)", 41, 0x24 },
+  { 0x04, 0x0B, "NTAG210", 20, 0x10 },
+  { 0x04, 0x0E, "NTAG212", 41, 0x24 },
+  { 0x04, 0x0F, "NTAG213", 45, 0x28 },
+  { 0x04, 0x11, "NTAG215", 135, 0x82 },
+  { 0x04, 0x13, "NTAG216", 231, 0xE2 },
+};
+
+static const nfc_modulation nmMifareul = {
+  .nmt = NMT_ISO14443A,
+  .nbr = NBR_106,
+};
+
+static int
+mifareul_memory_cmd(nfc_device *pnd, mifareul_memory *pmm, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx, const size_t szRx)
+{
+  pmm->ulCommands++;
+  return nfc_initiator_transceive_bytes(pnd, pbtTx, szTx, pbtRx, szRx, -1);
+}
+
+// A NAK sends the tag back to idle: select it again
+static bool
+mifareul_memory_reselect(nfc_device *pnd, nfc_target *pnt)
+{
+  return nfc_initiator_select_passive_target(pnd, nmMifareul, pnt->nti.nai.abtUid, pnt->nti.nai.szUidLen, pnt) > 0;
+}
+
+/**
+ * @brief Identify the tag \a pnt, which must be selected, and set the memory size accordingly
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+mifareul_memory_detect(nfc_device *pnd, nfc_target *pnt, mifareul_memory *pmm)
+{
+  const uint8_t abtGetVersion[] = { MUL_GET_VERSION };
+  uint8_t abtRx[16];
+  int res;
+
+  pmm->bCached = false;
+  memset(pmm->abtVersion, 0x00, sizeof(pmm->abtVersion));
+  if (pmm->szMaxFrame == 0)
+    pmm->szMaxFrame = MIFAREUL_DEFAULT_MAX_FRAME;
+
+  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true) < 0) {
+    nfc_perror(pnd, "nfc_device_set_property_bool");
+    return false;
+  }
+
+  if ((res = mifareul_memory_cmd(pnd, pmm, abtGetVersion, sizeof(abtGetVersion), abtRx, sizeof(abtRx))) == (int) sizeof(pmm->abtVersion)) {
+    memcpy(pmm->abtVersion, abtRx, sizeof(pmm->abtVersion));
+    for (size_t i = 0; i < sizeof(mifareul_products) / sizeof(mifareul_products[0]); i++) {
+      if ((mifareul_products[i].btType == abtRx[2]) && (mifareul_products[i].btStorage == abtRx[6])) {
+        pmm->pcName = mifareul_products[i].pcName;
+        pmm->szPages = mifareul_products[i].szPages;
+        pmm->szConfigPage = mifareul_products[i].szConfigPage;
+        return true;
+      }
+    }
+    // Unknown product: the storage size byte gives at least 2^(n >> 1) user bytes, behind 4 header pages and 5 configuration pages
+    pmm->pcName = "MIFARE Ultralight family";
+    pmm->szPages = MIN(MIFAREUL_MAX_PAGES, 4 + (1u << (abtRx[6] >> 1)) / MIFAREUL_PAGE_SIZE + 5);
+    pmm->szConfigPage = pmm->szPages - 5;
+    return true;
+  }
+
+  // No GET_VERSION: Ultralight or Ultralight C
+  if (!mifareul_memory_reselect(pnd, pnt))
+    return false;
+  const uint8_t abtRead[] = { MUL_READ, 0x10 };
+  if (mifareul_memory_cmd(pnd, pmm, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx)) == 16) {
+    // 48 pages, but the 3DES key in pages 0x2C-0x2F cannot be read
+    pmm->pcName = "MIFARE Ultralight C";
+    pmm->szPages = 0x2C;
+    pmm->szConfigPage = 0x28;
+    return true;
+  }
+  if (!mifareul_memory_reselect(pnd, pnt))
+    return false;
+  pmm->pcName = "MIFARE Ultralight";
+  pmm->szPages = 16;
+  pmm->szConfigPage = 16;
+  return true;
+}
+
+/**
+ * @brief Read \a szCount pages from page \a szFirst into \a pbtData
+ *
+ * FAST_READ is used when the tag supports it, otherwise READ (4 pages per command).
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+mifareul_memory_read_pages(nfc_device *pnd, mifareul_memory *pmm, const size_t szFirst, const size_t szCount, uint8_t *pbtData)
+{
+  const bool bFastRead = pmm->abtVersion[0] || pmm->abtVersion[1];
+  uint8_t abtRx[MIFAREUL_MAX_PAGES * MIFAREUL_PAGE_SIZE];
+  size_t szPage = szFirst;
+
+  if (szFirst + szCount > pmm->szPages)
+    return false;
+
+  while (szPage < szFirst + szCount) {
+    size_t szPages = szFirst + szCount - szPage;
+    int res;
+
+    if (bFastRead) {
+      szPages = MIN(szPages, pmm->szMaxFrame / MIFAREUL_PAGE_SIZE);
+      const uint8_t abtFastRead[] = { MUL_FAST_READ, (uint8_t) szPage, (uint8_t)(szPage + szPages - 1) };
+      res = mifareul_memory_cmd(pnd, pmm, abtFastRead, sizeof(abtFastRead), abtRx, szPages * MIFAREUL_PAGE_SIZE);
+      if ((res < 0) && (pmm->szMaxFrame > 16)) {
+        // The reader may not take such a long frame: retry with shorter ones
+        pmm->szMaxFrame /= 2;
+        continue;
+      }
+    } else {
+      // READ answers 4 pages, rolling over at the end of the memory
+      szPages = MIN(szPages, 4);
+      const uint8_t abtReadCmd[] = { MUL_READ, (uint8_t) szPage };
+      res = mifareul_memory_cmd(pnd, pmm, abtReadCmd, sizeof(abtReadCmd), abtRx, 16);
+      if (res == 16)
+        res = szPages * MIFAREUL_PAGE_SIZE;
+    }
+    if (res != (int)(szPages * MIFAREUL_PAGE_SIZE)) {
+      if (res < 0)
+        nfc_perror(pnd, "nfc_initiator_transceive_bytes");
+      return false;
+    }
+    memcpy(pbtData + (szPage - szFirst) * MIFAREUL_PAGE_SIZE, abtRx, szPages * MIFAREUL_PAGE_SIZE);
+    szPage += szPages;
+  }
+  return true;
+}
+
+/**
+ * @brief Read the whole tag memory into abtData and abtCache
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+mifareul_memory_read(nfc_device *pnd, mifareul_memory *pmm)
+{
+  pmm->bCached = false;
+  if (!mifareul_memory_read_pages(pnd, pmm, 0, pmm->szPages, pmm->abtData))
+    return false;
+
+  memcpy(pmm->abtCache, pmm->abtData, pmm->szPages * MIFAREUL_PAGE_SIZE);
+  pmm->bCached = true;
+  return true;
+}
+
+static bool
+mifareul_memory_writable(const mifareul_memory *pmm, const size_t szPage, const int iFlags)
+{
+  if (szPage < 2)
+    return iFlags & MIFAREUL_WRITE_UID;
+  if (szPage == 2)
+    return iFlags & MIFAREUL_WRITE_LOCK;
+  if (szPage == 3)
+    return iFlags & MIFAREUL_WRITE_OTP;
+  if (szPage >= pmm->szConfigPage)
+    return iFlags & MIFAREUL_WRITE_CONFIG;
+  return true;
+}
+
+/**
+ * @brief Write the pages of abtData which differ from abtCache
+ *
+ * Without cache, the tag content is read first into abtCache.
+ * UID, lock, OTP and configuration pages are only written when asked by \a iFlags.
+ * On failure abtCache still describes what has been written, so a new call after re-selecting
+ * the tag only writes what is left.
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+mifareul_memory_write(nfc_device *pnd, mifareul_memory *pmm, const int iFlags)
+{
+  mifare_param mp;
+
+  if (!pmm->bCached) {
+    if (!mifareul_memory_read_pages(pnd, pmm, 0, pmm->szPages, pmm->abtCache))
+      return false;
+    pmm->bCached = true;
+  }
+
+  for (size_t szPage = 0; szPage < pmm->szPages; szPage++) {
+    uint8_t *pbtNew = pmm->abtData + szPage * MIFAREUL_PAGE_SIZE;
+    uint8_t *pbtOld = pmm->abtCache + szPage * MIFAREUL_PAGE_SIZE;
+
+    if (!mifareul_memory_writable(pmm, szPage, iFlags) || !memcmp(pbtNew, pbtOld, MIFAREUL_PAGE_SIZE))
+      continue;
+
+    // Compatibility write: the tag only takes the first 4 bytes
+    memset(mp.mpd.abtData, 0x00, sizeof(mp.mpd.abtData));
+    memcpy(mp.mpd.abtData, pbtNew, MIFAREUL_PAGE_SIZE);
+    pmm->ulCommands++;
+    if (!nfc_initiator_mifare_cmd(pnd, MC_WRITE, (uint8_t) szPage, &mp))
+      return false;
+    memcpy(pbtOld, pbtNew, MIFAREUL_PAGE_SIZE);
+  }
+  return true;
+}
@@ -142,4 +142,41 @@ typedef struct {
 // Reset struct alignment to default
 #  pragma pack()
 
+// MIFARE Ultralight family (Ultralight, Ultralight C, Ultralight EV1, NTAG21x) memory engine
+
+typedef enum {
+  MUL_GET_VERSION = 0x60,
+  MUL_READ = 0x30,
+  MUL_FAST_READ = 0x3A,
+} mifareul_cmd;
+
+// Largest memory: NTAG216, 231 pages
+#  define MIFAREUL_MAX_PAGES 256
+#  define MIFAREUL_PAGE_SIZE 4
+// Largest PN53x InDataExchange answer, rounded down to whole pages
+#  define MIFAREUL_DEFAULT_MAX_FRAME 252
+
+// mifareul_memory_write() flags
+#  define MIFAREUL_WRITE_UID    0x01  // pages 0 - 1, only for special writeable UID cards
+#  define MIFAREUL_WRITE_LOCK   0x02  // page 2, static lock bytes
+#  define MIFAREUL_WRITE_OTP    0x04  // page 3, OTP or Capability Container
+#  define MIFAREUL_WRITE_CONFIG 0x08  // dynamic lock, configuration, password and key pages
+
+typedef struct {
+  const char *pcName;                             // product name
+  uint8_t  abtVersion[8];                         // GET_VERSION answer, zeroes when not supported
+  size_t   szPages;                               // memory size in pages
+  size_t   szConfigPage;                          // first dynamic lock or configuration page
+  size_t   szMaxFrame;                            // largest FAST_READ answer accepted by the reader
+  uint8_t  abtData[MIFAREUL_MAX_PAGES * MIFAREUL_PAGE_SIZE];  // image to write to the tag
+  uint8_t  abtCache[MIFAREUL_MAX_PAGES * MIFAREUL_PAGE_SIZE]; // tag content, as last read or written
+  bool     bCached;                               // abtCache is valid
+  unsigned long ulCommands;                       // round trips to the tag
+} mifareul_memory;
+
+bool    mifareul_memory_detect(nfc_device *pnd, nfc_target *pnt, mifareul_memory *pmm);
+bool    mifareul_memory_read_pages(nfc_device *pnd, mifareul_memory *pmm, const size_t szFirst, const size_t szCount, uint8_t *pbtData);
+bool    mifareul_memory_read(nfc_device *pnd, mifareul_memory *pmm);
+bool    mifareul_memory_write(nfc_device *pnd, mifareul_memory *pmm, const int iFlags);
+
 #endif // _LIBNFC_MIFARE_H_
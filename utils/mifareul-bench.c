@@ -0,0 +1,272 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ * Copyright (C) 2014      Pim 't Hart
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file mifareul-bench.c
+ * @brief MIFARE Ultralight/NTAG memory engine benchmark against simulated tags
+ *
+ * This program is linked with nfc_initiator_transceive_bytes(),
+ * nfc_initiator_select_passive_target() and nfc_device_set_property_bool()
+ * wrapped (ld --wrap): the commands sent by mifare.c reach an Ultralight,
+ * Ultralight C, Ultralight EV1 or NTAG21x simulated here. It counts the round trips of
+ * whole tag dumps and restores, done 4 pages per READ and page by page as
+ * nfc-mfultralight used to, then with the memory engine.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "mifare.h"
+#include "nfc-utils.h"
+
+static struct {
+  uint8_t  abtVersion[8];     // all zero: no GET_VERSION
+  size_t   szPages;
+  size_t   szReadable;        // pages READ answers, the others NAK
+  size_t   szMaxFrame;        // longest answer the simulated reader accepts
+  bool     bHalted;           // after a NAK, until selected again
+  uint8_t  abtMemory[MIFAREUL_MAX_PAGES * MIFAREUL_PAGE_SIZE];
+  unsigned long ulCommands;
+  unsigned long ulWrites;     // pages programmed
+  unsigned long ulBytes;      // bytes sent and received over the air
+} sim;
+
+int
+__wrap_nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable)
+{
+  (void) pnd;
+  (void) property;
+  (void) bEnable;
+  return NFC_SUCCESS;
+}
+
+int
+__wrap_nfc_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData,
+                                           const size_t szInitData, nfc_target *pnt)
+{
+  (void) pnd;
+  (void) nm;
+  (void) pbtInitData;
+  (void) szInitData;
+  (void) pnt;
+  sim.ulCommands++;
+  sim.bHalted = false;
+  return 1;
+}
+
+static int
+sim_nak(void)
+{
+  sim.bHalted = true;
+  return NFC_ERFTRANS;
+}
+
+int
+__wrap_nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                                      const size_t szRx, int timeout)
+{
+  const bool bVersion = sim.abtVersion[1] != 0x00;
+  size_t szRes = 0;
+  (void) pnd;
+  (void) timeout;
+
+  sim.ulCommands++;
+  if (sim.bHalted)
+    return NFC_ETIMEOUT;
+  switch (pbtTx[0]) {
+    case MUL_GET_VERSION:
+      if (!bVersion)
+        return sim_nak();
+      memcpy(pbtRx, sim.abtVersion, sizeof(sim.abtVersion));
+      szRes = sizeof(sim.abtVersion);
+      break;
+    case MUL_READ:
+      if (pbtTx[1] >= sim.szReadable)
+        return sim_nak();
+      for (size_t n = 0; n < 16; n++)
+        pbtRx[n] = sim.abtMemory[(pbtTx[1] * MIFAREUL_PAGE_SIZE + n) % (sim.szReadable * MIFAREUL_PAGE_SIZE)];
+      szRes = 16;
+      break;
+    case MUL_FAST_READ:
+      if (!bVersion || (pbtTx[1] > pbtTx[2]) || (pbtTx[2] >= sim.szReadable))
+        return sim_nak();
+      szRes = (pbtTx[2] - pbtTx[1] + 1) * MIFAREUL_PAGE_SIZE;
+      if (szRes > sim.szMaxFrame)
+        return NFC_EIO;
+      memcpy(pbtRx, sim.abtMemory + pbtTx[1] * MIFAREUL_PAGE_SIZE, szRes);
+      break;
+    case MC_WRITE:
+      // Compatibility write: 16 bytes sent, the first 4 programmed, no answer beyond the ACK
+      if ((szTx != 18) || (pbtTx[1] >= sim.szPages))
+        return sim_nak();
+      if (pbtTx[1] >= 2)
+        memcpy(sim.abtMemory + pbtTx[1] * MIFAREUL_PAGE_SIZE, pbtTx + 2, MIFAREUL_PAGE_SIZE);
+      sim.ulWrites++;
+      break;
+    default:
+      return sim_nak();
+  }
+  if (szRes > szRx)
+    return NFC_EOVFLOW;
+  sim.ulBytes += szTx + szRes;
+  return (int) szRes;
+}
+
+static void
+sim_reset(const uint8_t btType, const uint8_t btStorage, const size_t szPages, const size_t szHiddenPages, const size_t szMaxFrame)
+{
+  memset(&sim, 0, sizeof(sim));
+  if (btType) {
+    const uint8_t abtVersion[] = { 0x00, 0x04, btType, 0x01, 0x01, 0x00, btStorage, 0x03 };
+    memcpy(sim.abtVersion, abtVersion, sizeof(abtVersion));
+  }
+  sim.szPages = szPages + szHiddenPages;
+  sim.szReadable = szPages;
+  sim.szMaxFrame = szMaxFrame;
+  memcpy(sim.abtMemory, "\x04\x01\x02\x8f\x03\x04\x05\x06\x00\x48\x00\x00\xE1\x10\x12\x00", 16);
+}
+
+static void
+report(const char *pcWhat, const unsigned long ulCommands, const unsigned long ulWrites, const unsigned long ulBytes)
+{
+  printf("  %-34s %4lu round trips %4lu pages written %6lu bytes over the air\n", pcWhat, ulCommands, ulWrites, ulBytes);
+}
+
+#define MEASURE(pcWhat, code) do { \
+    const unsigned long ulCommands = sim.ulCommands, ulWrites = sim.ulWrites, ulBytes = sim.ulBytes; \
+    code; \
+    report(pcWhat, sim.ulCommands - ulCommands, sim.ulWrites - ulWrites, sim.ulBytes - ulBytes); \
+  } while (0)
+
+// One READ per 4 pages and one WRITE per page, the way nfc-mfultralight used to work
+static void
+legacy_read(const size_t szPages, uint8_t *pbtData)
+{
+  uint8_t abtRx[16];
+  for (size_t szPage = 0; szPage < szPages; szPage += 4) {
+    const uint8_t abtTx[] = { MUL_READ, (uint8_t) szPage };
+    __wrap_nfc_initiator_transceive_bytes(NULL, abtTx, sizeof(abtTx), abtRx, sizeof(abtRx), -1);
+    memcpy(pbtData + szPage * MIFAREUL_PAGE_SIZE, abtRx, MIN(16, (szPages - szPage) * MIFAREUL_PAGE_SIZE));
+  }
+}
+
+static void
+legacy_write(const size_t szPages, const uint8_t *pbtData)
+{
+  uint8_t abtRx[16];
+  for (size_t szPage = 4; szPage < szPages; szPage++) {
+    uint8_t abtTx[18] = { MC_WRITE, (uint8_t) szPage };
+    memcpy(abtTx + 2, pbtData + szPage * MIFAREUL_PAGE_SIZE, MIFAREUL_PAGE_SIZE);
+    __wrap_nfc_initiator_transceive_bytes(NULL, abtTx, sizeof(abtTx), abtRx, sizeof(abtRx), -1);
+  }
+}
+
+// szPages can be read, the szHiddenPages after them (keys) cannot
+static int
+bench(const char *pcName, const uint8_t btType, const uint8_t btStorage, const size_t szPages, const size_t szHiddenPages, const size_t szMaxFrame)
+{
+  static mifareul_memory mm;
+  uint8_t abtImage[MIFAREUL_MAX_PAGES * MIFAREUL_PAGE_SIZE];
+  const size_t szSize = szPages * MIFAREUL_PAGE_SIZE;
+  nfc_target nt;
+
+  sim_reset(btType, btStorage, szPages, szHiddenPages, szMaxFrame);
+  memset(&nt, 0, sizeof(nt));
+  printf("%s (%lu pages, reader frames up to %lu bytes)\n", pcName, (unsigned long) szPages, (unsigned long) szMaxFrame);
+
+  MEASURE("READ, 4 pages per command", legacy_read(szPages, abtImage));
+  memset(&mm, 0, sizeof(mm));
+  MEASURE("engine detect", if (!mifareul_memory_detect(NULL, &nt, &mm)) return -1);
+  if (mm.szPages != szPages) {
+    fprintf(stderr, "Wrong memory size %lu\n", (unsigned long) mm.szPages);
+    return -1;
+  }
+  MEASURE("engine read", if (!mifareul_memory_read(NULL, &mm)) return -1);
+  if (memcmp(mm.abtData, sim.abtMemory, szSize)) {
+    fprintf(stderr, "Read content differs from the tag\n");
+    return -1;
+  }
+
+  // Fill the user pages, starting from a blank tag
+  memcpy(abtImage, mm.abtData, szSize);
+  for (size_t n = 4 * MIFAREUL_PAGE_SIZE; n < mm.szConfigPage * MIFAREUL_PAGE_SIZE; n++)
+    abtImage[n] = (uint8_t)(n * 7);
+
+  MEASURE("WRITE, every user page", legacy_write(mm.szConfigPage, abtImage));
+  memset(sim.abtMemory + 4 * MIFAREUL_PAGE_SIZE, 0, (mm.szConfigPage - 4) * MIFAREUL_PAGE_SIZE);
+  memcpy(mm.abtData, abtImage, szSize);
+  mm.bCached = false;
+  MEASURE("engine write, no cache", if (!mifareul_memory_write(NULL, &mm, 0)) return -1);
+  if (memcmp(sim.abtMemory, abtImage, szSize)) {
+    fprintf(stderr, "Tag content differs from the written image\n");
+    return -1;
+  }
+  MEASURE("engine write, same image", if (!mifareul_memory_write(NULL, &mm, 0)) return -1);
+  mm.abtData[0x20] ^= 0x5a;
+  MEASURE("engine write, one byte changed", if (!mifareul_memory_write(NULL, &mm, 0)) return -1);
+  // Rewrite a 32-byte NDEF message, some pages keep their value
+  for (size_t n = 0x10; n < 0x30; n++)
+    mm.abtData[n] = (uint8_t)(mm.abtData[n] + ((n / 8) & 1));
+  MEASURE("engine write, 32-byte message", if (!mifareul_memory_write(NULL, &mm, 0)) return -1);
+  if (memcmp(sim.abtMemory, mm.abtData, szSize)) {
+    fprintf(stderr, "Tag content differs from the written image\n");
+    return -1;
+  }
+  return 0;
+}
+
+int
+main(void)
+{
+  if ((bench("MIFARE Ultralight", 0x00, 0x00, 16, 0, 252) < 0) ||
+      (bench("MIFARE Ultralight C", 0x00, 0x00, 44, 4, 252) < 0) ||
+      (bench("MIFARE Ultralight EV1 (MF0UL21)", 0x03, 0x0E, 41, 0, 252) < 0) ||
+      (bench("NTAG213", 0x04, 0x0F, 45, 0, 252) < 0) ||
+      (bench("NTAG215", 0x04, 0x11, 135, 0, 252) < 0) ||
+      (bench("NTAG216", 0x04, 0x13, 231, 0, 252) < 0) ||
+      (bench("NTAG216", 0x04, 0x13, 231, 0, 64) < 0)) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
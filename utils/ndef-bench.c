@@ -0,0 +1,612 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file ndef-bench.c
+ * @brief NDEF engine benchmark against simulated Type 2, 3 and 4 Tags
+ *
+ * This program is linked with nfc_initiator_transceive_bytes(),
+ * nfc_initiator_select_passive_target() and nfc_device_set_property_bool()
+ * wrapped (ld --wrap): the commands sent by ndef.c reach a NTAG215, a FeliCa
+ * Type 3 Tag or a Type 4 Tag simulated here. Each command costs a fixed time
+ * for the exchange with the chip, the air time of both frames and the time
+ * the tag takes to program what is written. It compares the way a simple
+ * reader does it (CC read at each session, 4 pages per READ, one block per
+ * CHECK, NLEN read on its own, whole message written) with the engine, cold
+ * and with the CC cache, and with rewrites of the same, slightly changed and
+ * new messages.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "ndef.h"
+#include "nfc-utils.h"
+
+#define SIM_CHIP_US 1000
+#define SIM_T2_PAGES 135
+#define SIM_T2_WRITE_US 4100
+#define SIM_T3_NBR 8
+#define SIM_T3_NMAXB 64
+#define SIM_T3_WRITE_US 1500
+#define SIM_T4_FILE 0xE104
+#define SIM_T4_FILE_SIZE 2048
+#define SIM_T4_MLE 0xFF
+#define SIM_T4_WRITE_US 3000
+
+static const uint8_t abtSimUid[7] = { 0x04, 0x51, 0x7a, 0x22, 0x9c, 0x3e, 0x80 };
+static const uint8_t abtSimIdm[8] = { 0x01, 0x2e, 0x4c, 0xd5, 0x8a, 0x31, 0x17, 0x42 };
+
+static struct {
+  ndef_tag_type ntt;
+  uint8_t  abtPages[SIM_T2_PAGES * MIFAREUL_PAGE_SIZE];
+  uint8_t  abtBlocks[(1 + SIM_T3_NMAXB) * FELICA_BLOCK_SIZE];
+  uint8_t  abtCc[15];
+  uint8_t  abtFile[SIM_T4_FILE_SIZE];
+  uint16_t ui16Selected;      // Type 4 file, 0 when none
+  unsigned long ulCommands;
+  uint64_t ui64Time;          // µs
+} sim;
+
+int
+__wrap_nfc_device_set_property_bool(nfc_device *pnd, const nfc_property property, const bool bEnable)
+{
+  (void) pnd;
+  (void) property;
+  (void) bEnable;
+  return NFC_SUCCESS;
+}
+
+int
+__wrap_nfc_initiator_select_passive_target(nfc_device *pnd, const nfc_modulation nm, const uint8_t *pbtInitData,
+                                           const size_t szInitData, nfc_target *pnt)
+{
+  (void) pnd;
+  (void) nm;
+  (void) pbtInitData;
+  (void) szInitData;
+  (void) pnt;
+  sim.ulCommands++;
+  sim.ui64Time += SIM_CHIP_US;
+  return 1;
+}
+
+// Air time at 106 kbps (Type 2, 4) or 212 kbps (Type 3), with the frame overhead
+static uint64_t
+sim_air_us(const size_t szFrame)
+{
+  if (sim.ntt == NDEF_TAG_TYPE3)
+    return (szFrame + 10) * 8 * 1000000 / 211875;
+  return (szFrame + 4) * 9 * 1000000 / 105938;
+}
+
+static int
+sim_t2(const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx)
+{
+  const uint8_t abtVersion[] = { 0x00, 0x04, 0x04, 0x02, 0x01, 0x00, 0x11, 0x03 };
+
+  switch (pbtTx[0]) {
+    case MUL_GET_VERSION:
+      memcpy(pbtRx, abtVersion, sizeof(abtVersion));
+      return sizeof(abtVersion);
+    case MUL_READ:
+      if (pbtTx[1] >= SIM_T2_PAGES)
+        return NFC_ERFTRANS;
+      for (size_t n = 0; n < 16; n++)
+        pbtRx[n] = sim.abtPages[(pbtTx[1] * MIFAREUL_PAGE_SIZE + n) % sizeof(sim.abtPages)];
+      return 16;
+    case MUL_FAST_READ:
+      if ((pbtTx[1] > pbtTx[2]) || (pbtTx[2] >= SIM_T2_PAGES))
+        return NFC_ERFTRANS;
+      memcpy(pbtRx, sim.abtPages + pbtTx[1] * MIFAREUL_PAGE_SIZE, (pbtTx[2] - pbtTx[1] + 1) * MIFAREUL_PAGE_SIZE);
+      return (pbtTx[2] - pbtTx[1] + 1) * MIFAREUL_PAGE_SIZE;
+    case MC_WRITE:
+      if ((szTx != 18) || (pbtTx[1] < 4) || (pbtTx[1] >= SIM_T2_PAGES))
+        return NFC_ERFTRANS;
+      memcpy(sim.abtPages + pbtTx[1] * MIFAREUL_PAGE_SIZE, pbtTx + 2, MIFAREUL_PAGE_SIZE);
+      sim.ui64Time += SIM_T2_WRITE_US;
+      return 0;
+  }
+  return NFC_ERFTRANS;
+}
+
+// CHECK and UPDATE of the NDEF service, up to SIM_T3_NBR blocks per command
+static int
+sim_t3(const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx)
+{
+  uint8_t *apbtBlocks[SIM_T3_NBR];
+  size_t szPos = 10, szRes = 12;
+
+  if ((szTx < 12) || (pbtTx[0] != szTx) || ((pbtTx[1] != FC_CHECK) && (pbtTx[1] != FC_UPDATE)) ||
+      memcmp(pbtTx + 2, abtSimIdm, sizeof(abtSimIdm)))
+    return NFC_ERFTRANS;
+  pbtRx[1] = pbtTx[1] + 1;
+  memcpy(pbtRx + 2, abtSimIdm, sizeof(abtSimIdm));
+  pbtRx[10] = pbtRx[11] = 0x00;
+  const size_t szServices = pbtTx[szPos++];
+  szPos += 2 * szServices;
+  const size_t szBlocks = (szPos < szTx) ? pbtTx[szPos++] : 0;
+  if ((szServices == 0) || (szBlocks == 0) || (szBlocks > SIM_T3_NBR)) {
+    pbtRx[10] = 0xff;
+    pbtRx[11] = 0xa2;
+  }
+  for (size_t n = 0; (n < szBlocks) && !pbtRx[10]; n++) {
+    if (szPos + 2 > szTx)
+      return NFC_ERFTRANS;
+    const uint8_t btHead = pbtTx[szPos++];
+    uint16_t ui16Block = pbtTx[szPos++];
+    if (!(btHead & 0x80))
+      ui16Block |= pbtTx[szPos++] << 8;
+    if (ui16Block > SIM_T3_NMAXB) {
+      pbtRx[10] = 0xff;
+      pbtRx[11] = 0xa8;
+    }
+    apbtBlocks[n] = sim.abtBlocks + ui16Block * FELICA_BLOCK_SIZE;
+  }
+  if (pbtRx[10]) {
+    szRes = 12;
+  } else if (pbtTx[1] == FC_CHECK) {
+    pbtRx[12] = (uint8_t) szBlocks;
+    for (size_t n = 0; n < szBlocks; n++)
+      memcpy(pbtRx + 13 + n * FELICA_BLOCK_SIZE, apbtBlocks[n], FELICA_BLOCK_SIZE);
+    szRes = 13 + szBlocks * FELICA_BLOCK_SIZE;
+  } else {
+    if (szPos + szBlocks * FELICA_BLOCK_SIZE != szTx)
+      return NFC_ERFTRANS;
+    for (size_t n = 0; n < szBlocks; n++)
+      memcpy(apbtBlocks[n], pbtTx + szPos + n * FELICA_BLOCK_SIZE, FELICA_BLOCK_SIZE);
+    sim.ui64Time += szBlocks * SIM_T3_WRITE_US;
+  }
+  pbtRx[0] = (uint8_t) szRes;
+  return (int) szRes;
+}
+
+static int
+sim_t4_status(uint8_t *pbtRx, const size_t szData, const uint16_t ui16Sw)
+{
+  pbtRx[szData] = (uint8_t)(ui16Sw >> 8);
+  pbtRx[szData + 1] = (uint8_t) ui16Sw;
+  return (int)(szData + 2);
+}
+
+// NDEF application: SELECT, READ BINARY and UPDATE BINARY of the CC and NDEF files
+static int
+sim_t4(const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx)
+{
+  const uint8_t abtAid[] = { 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01 };
+  uint8_t *pbtFile = (sim.ui16Selected == 0xE103) ? sim.abtCc : sim.abtFile;
+  const size_t szFile = (sim.ui16Selected == 0xE103) ? sizeof(sim.abtCc) : sizeof(sim.abtFile);
+
+  if ((szTx < 4) || (pbtTx[0] != 0x00))
+    return sim_t4_status(pbtRx, 0, 0x6E00);
+  const size_t szOffset = (pbtTx[2] << 8) | pbtTx[3];
+  switch (pbtTx[1]) {
+    case 0xA4:
+      if ((pbtTx[2] == 0x04) && (szTx >= 12) && (pbtTx[4] == sizeof(abtAid)) && !memcmp(pbtTx + 5, abtAid, sizeof(abtAid))) {
+        sim.ui16Selected = 0;
+        return sim_t4_status(pbtRx, 0, 0x9000);
+      }
+      if ((pbtTx[2] == 0x00) && (szTx == 7)) {
+        const uint16_t ui16File = (uint16_t)((pbtTx[5] << 8) | pbtTx[6]);
+        if ((ui16File == 0xE103) || (ui16File == SIM_T4_FILE)) {
+          sim.ui16Selected = ui16File;
+          return sim_t4_status(pbtRx, 0, 0x9000);
+        }
+      }
+      return sim_t4_status(pbtRx, 0, 0x6A82);
+    case 0xB0:
+      if (!sim.ui16Selected || (szTx != 5))
+        return sim_t4_status(pbtRx, 0, 0x6986);
+      {
+        // Le 0x00 stands for 256 bytes
+        const size_t szLe = pbtTx[4] ? pbtTx[4] : 256;
+        if ((szLe > SIM_T4_MLE) || (szOffset + szLe > szFile))
+          return sim_t4_status(pbtRx, 0, 0x6B00);
+        memcpy(pbtRx, pbtFile + szOffset, szLe);
+        return sim_t4_status(pbtRx, szLe, 0x9000);
+      }
+    case 0xD6:
+      if ((sim.ui16Selected != SIM_T4_FILE) || (szTx < 5) || (szTx != 5u + pbtTx[4]))
+        return sim_t4_status(pbtRx, 0, 0x6986);
+      if (szOffset + pbtTx[4] > szFile)
+        return sim_t4_status(pbtRx, 0, 0x6B00);
+      memcpy(pbtFile + szOffset, pbtTx + 5, pbtTx[4]);
+      sim.ui64Time += SIM_T4_WRITE_US;
+      return sim_t4_status(pbtRx, 0, 0x9000);
+  }
+  return sim_t4_status(pbtRx, 0, 0x6D00);
+}
+
+int
+__wrap_nfc_initiator_transceive_bytes(nfc_device *pnd, const uint8_t *pbtTx, const size_t szTx, uint8_t *pbtRx,
+                                      const size_t szRx, int timeout)
+{
+  uint8_t abtRx[512];
+  int res = NFC_ERFTRANS;
+  (void) pnd;
+  (void) timeout;
+
+  sim.ulCommands++;
+  sim.ui64Time += SIM_CHIP_US + sim_air_us(szTx);
+  switch (sim.ntt) {
+    case NDEF_TAG_TYPE2:
+      res = sim_t2(pbtTx, szTx, abtRx);
+      break;
+    case NDEF_TAG_TYPE3:
+      res = sim_t3(pbtTx, szTx, abtRx);
+      break;
+    case NDEF_TAG_TYPE4:
+      res = sim_t4(pbtTx, szTx, abtRx);
+      break;
+    case NDEF_TAG_UNKNOWN:
+      break;
+  }
+  if (res < 0)
+    return res;
+  if ((size_t) res > szRx)
+    return NFC_EOVFLOW;
+  memcpy(pbtRx, abtRx, res);
+  sim.ui64Time += sim_air_us(res);
+  return res;
+}
+
+// Blank formatted tag: an empty NDEF message
+static void
+sim_reset(const ndef_tag_type ntt, nfc_target *pnt)
+{
+  memset(&sim, 0, sizeof(sim));
+  memset(pnt, 0, sizeof(*pnt));
+  sim.ntt = ntt;
+  switch (ntt) {
+    case NDEF_TAG_TYPE2:
+      pnt->nm.nmt = NMT_ISO14443A;
+      memcpy(pnt->nti.nai.abtUid, abtSimUid, sizeof(abtSimUid));
+      pnt->nti.nai.szUidLen = sizeof(abtSimUid);
+      memcpy(sim.abtPages, abtSimUid, 3);
+      memcpy(sim.abtPages + 4, abtSimUid + 3, 4);
+      // NTAG215 CC: 496 bytes of data area, then the TLV of an empty message
+      memcpy(sim.abtPages + 12, "\xE1\x10\x3E\x00\x03\x00\xFE", 7);
+      break;
+    case NDEF_TAG_TYPE3: {
+      pnt->nm.nmt = NMT_FELICA;
+      memcpy(pnt->nti.nfi.abtId, abtSimIdm, sizeof(abtSimIdm));
+      uint8_t *pbt = sim.abtBlocks;
+      pbt[0] = 0x10;
+      pbt[1] = SIM_T3_NBR;
+      pbt[2] = SIM_T3_NBR;
+      pbt[4] = SIM_T3_NMAXB;
+      pbt[10] = 0x01;
+      uint16_t ui16Sum = 0;
+      for (size_t n = 0; n < 14; n++)
+        ui16Sum += pbt[n];
+      pbt[14] = (uint8_t)(ui16Sum >> 8);
+      pbt[15] = (uint8_t) ui16Sum;
+      break;
+    }
+    case NDEF_TAG_TYPE4: {
+      pnt->nm.nmt = NMT_ISO14443A;
+      pnt->nti.nai.btSak = 0x20;
+      memcpy(pnt->nti.nai.abtUid, abtSimUid, sizeof(abtSimUid));
+      pnt->nti.nai.szUidLen = sizeof(abtSimUid);
+      const uint8_t abtCc[] = { 0x00, 0x0F, 0x20, 0x00, SIM_T4_MLE, 0x00, SIM_T4_MLE, 0x04, 0x06,
+                                (uint8_t)(SIM_T4_FILE >> 8), (uint8_t) SIM_T4_FILE, (uint8_t)(SIM_T4_FILE_SIZE >> 8), (uint8_t) SIM_T4_FILE_SIZE, 0x00, 0x00
+                              };
+      memcpy(sim.abtCc, abtCc, sizeof(abtCc));
+      break;
+    }
+    case NDEF_TAG_UNKNOWN:
+      break;
+  }
+}
+
+// Short records of 100-byte payloads, up to szMax bytes
+static size_t
+build_message(uint8_t *pbtMessage, const size_t szMax, const uint8_t btSeed)
+{
+  const size_t szPayload = 100, szRecord = 4 + szPayload;
+  size_t szPos = 0;
+
+  for (size_t r = 0; szPos + szRecord <= szMax; r++) {
+    uint8_t *pbt = pbtMessage + szPos;
+    pbt[0] = (r ? 0x00 : NDEF_RECORD_MB) | NDEF_RECORD_SR | 0x04;
+    pbt[1] = 1;
+    pbt[2] = (uint8_t) szPayload;
+    pbt[3] = 'b';
+    for (size_t n = 0; n < szPayload; n++)
+      pbt[4 + n] = (uint8_t)(btSeed + r * 31 + n * 7);
+    szPos += szRecord;
+  }
+  pbtMessage[szPos - szRecord] |= NDEF_RECORD_ME;
+  return szPos;
+}
+
+static void
+report(const char *pcWhat, const unsigned long ulCommands, const uint64_t ui64Time)
+{
+  printf("  %-40s %4lu commands %8.1f ms\n", pcWhat, ulCommands, ui64Time / 1000.0);
+}
+
+#define MEASURE(pcWhat, code) do { \
+    const unsigned long ulCommands = sim.ulCommands; \
+    const uint64_t ui64Time = sim.ui64Time; \
+    code; \
+    report(pcWhat, sim.ulCommands - ulCommands, sim.ui64Time - ui64Time); \
+  } while (0)
+
+static int
+simple_apdu(const uint8_t *pbtApdu, const size_t szApdu, uint8_t *pbtRx)
+{
+  int res = __wrap_nfc_initiator_transceive_bytes(NULL, pbtApdu, szApdu, pbtRx, 2 + SIM_T4_MLE, -1);
+  return ((res >= 2) && (pbtRx[res - 2] == 0x90)) ? res - 2 : -1;
+}
+
+// A simple reader: CC read at each session, 4 pages per READ, one block per CHECK, NLEN read on its own
+static bool
+simple_read(const nfc_target *pnt, uint8_t *pbtMessage, size_t *pszMessage)
+{
+  uint8_t abtRx[2 + SIM_T4_MLE];
+
+  switch (sim.ntt) {
+    case NDEF_TAG_TYPE2: {
+      uint8_t abtData[SIM_T2_PAGES * MIFAREUL_PAGE_SIZE];
+      const uint8_t abtGetVersion[] = { MUL_GET_VERSION };
+      __wrap_nfc_initiator_transceive_bytes(NULL, abtGetVersion, sizeof(abtGetVersion), abtRx, sizeof(abtRx), -1);
+      size_t szLen = 0, szHeader = 2;
+      for (size_t szPage = 3; szPage < SIM_T2_PAGES; szPage += 4) {
+        const uint8_t abtRead[] = { MUL_READ, (uint8_t) szPage };
+        if (__wrap_nfc_initiator_transceive_bytes(NULL, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), -1) != 16)
+          return false;
+        memcpy(abtData + (szPage - 3) * MIFAREUL_PAGE_SIZE, abtRx, 16);
+        const size_t szRead = (szPage + 1) * MIFAREUL_PAGE_SIZE;
+        // The NDEF TLV starts the data area
+        if (szRead >= MIFAREUL_PAGE_SIZE + 4) {
+          szLen = abtData[5];
+          if (szLen == 0xFF) {
+            szLen = (abtData[6] << 8) | abtData[7];
+            szHeader = 4;
+          }
+          if (szRead >= MIFAREUL_PAGE_SIZE + szHeader + szLen)
+            break;
+        }
+      }
+      memcpy(pbtMessage, abtData + 4 + szHeader, szLen);
+      *pszMessage = szLen;
+      return true;
+    }
+    case NDEF_TAG_TYPE3: {
+      felica_card fc;
+      felica_t3t_attribute attr;
+      felica_card_init(&fc, pnt);
+      if (!felica_t3t_read_attribute(NULL, &fc, &attr))
+        return false;
+      fc.btNbr = 1;
+      if (!felica_t3t_read_ndef(NULL, &fc, &attr, pbtMessage))
+        return false;
+      *pszMessage = attr.ui32Ln;
+      return true;
+    }
+    case NDEF_TAG_TYPE4: {
+      const uint8_t abtSelectApp[] = { 0x00, 0xA4, 0x04, 0x00, 0x07, 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, 0x00 };
+      const uint8_t abtSelectCc[] = { 0x00, 0xA4, 0x00, 0x0C, 0x02, 0xE1, 0x03 };
+      const uint8_t abtReadCc[] = { 0x00, 0xB0, 0x00, 0x00, 0x0F };
+      const uint8_t abtReadNlen[] = { 0x00, 0xB0, 0x00, 0x00, 0x02 };
+      if ((simple_apdu(abtSelectApp, sizeof(abtSelectApp), abtRx) < 0) || (simple_apdu(abtSelectCc, sizeof(abtSelectCc), abtRx) < 0) ||
+          (simple_apdu(abtReadCc, sizeof(abtReadCc), abtRx) != 15))
+        return false;
+      const uint8_t abtSelectNdef[] = { 0x00, 0xA4, 0x00, 0x0C, 0x02, abtRx[9], abtRx[10] };
+      const size_t szLe = MIN((abtRx[3] << 8) | abtRx[4], SIM_T4_MLE);
+      if ((simple_apdu(abtSelectNdef, sizeof(abtSelectNdef), abtRx) < 0) || (simple_apdu(abtReadNlen, sizeof(abtReadNlen), abtRx) != 2))
+        return false;
+      const size_t szLen = (abtRx[0] << 8) | abtRx[1];
+      for (size_t szPos = 0; szPos < szLen;) {
+        const size_t szChunk = MIN(szLe, szLen - szPos);
+        const uint8_t abtRead[] = { 0x00, 0xB0, (uint8_t)((2 + szPos) >> 8), (uint8_t)(2 + szPos), (uint8_t) szChunk };
+        if (simple_apdu(abtRead, sizeof(abtRead), abtRx) != (int) szChunk)
+          return false;
+        memcpy(pbtMessage + szPos, abtRx, szChunk);
+        szPos += szChunk;
+      }
+      *pszMessage = szLen;
+      return true;
+    }
+    case NDEF_TAG_UNKNOWN:
+      break;
+  }
+  return false;
+}
+
+// The whole message written, after the CC read
+static bool
+simple_write(const nfc_target *pnt, const uint8_t *pbtMessage, const size_t szMessage)
+{
+  uint8_t abtRx[2 + SIM_T4_MLE];
+
+  switch (sim.ntt) {
+    case NDEF_TAG_TYPE2: {
+      uint8_t abtData[SIM_T2_PAGES * MIFAREUL_PAGE_SIZE];
+      const uint8_t abtRead[] = { MUL_READ, 3 };
+      __wrap_nfc_initiator_transceive_bytes(NULL, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx), -1);
+      memset(abtData, 0, sizeof(abtData));
+      size_t szLen = 0;
+      abtData[szLen++] = 0x03;
+      if (szMessage < 0xFF) {
+        abtData[szLen++] = (uint8_t) szMessage;
+      } else {
+        abtData[szLen++] = 0xFF;
+        abtData[szLen++] = (uint8_t)(szMessage >> 8);
+        abtData[szLen++] = (uint8_t) szMessage;
+      }
+      memcpy(abtData + szLen, pbtMessage, szMessage);
+      szLen += szMessage;
+      abtData[szLen++] = 0xFE;
+      for (size_t szPage = 0; szPage * MIFAREUL_PAGE_SIZE < szLen; szPage++) {
+        uint8_t abtWrite[18] = { MC_WRITE, (uint8_t)(4 + szPage) };
+        memcpy(abtWrite + 2, abtData + szPage * MIFAREUL_PAGE_SIZE, MIFAREUL_PAGE_SIZE);
+        if (__wrap_nfc_initiator_transceive_bytes(NULL, abtWrite, sizeof(abtWrite), abtRx, sizeof(abtRx), -1) < 0)
+          return false;
+      }
+      return true;
+    }
+    case NDEF_TAG_TYPE3: {
+      felica_card fc;
+      felica_t3t_attribute attr;
+      felica_card_init(&fc, pnt);
+      return felica_t3t_read_attribute(NULL, &fc, &attr) && felica_t3t_write_ndef(NULL, &fc, &attr, pbtMessage, (uint32_t) szMessage);
+    }
+    case NDEF_TAG_TYPE4: {
+      const uint8_t abtSelectApp[] = { 0x00, 0xA4, 0x04, 0x00, 0x07, 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, 0x00 };
+      const uint8_t abtSelectCc[] = { 0x00, 0xA4, 0x00, 0x0C, 0x02, 0xE1, 0x03 };
+      const uint8_t abtReadCc[] = { 0x00, 0xB0, 0x00, 0x00, 0x0F };
+      const uint8_t abtClearNlen[] = { 0x00, 0xD6, 0x00, 0x00, 0x02, 0x00, 0x00 };
+      const uint8_t abtNlen[] = { 0x00, 0xD6, 0x00, 0x00, 0x02, (uint8_t)(szMessage >> 8), (uint8_t) szMessage };
+      uint8_t abtUpdate[5 + SIM_T4_MLE];
+      if ((simple_apdu(abtSelectApp, sizeof(abtSelectApp), abtRx) < 0) || (simple_apdu(abtSelectCc, sizeof(abtSelectCc), abtRx) < 0) ||
+          (simple_apdu(abtReadCc, sizeof(abtReadCc), abtRx) != 15))
+        return false;
+      const uint8_t abtSelectNdef[] = { 0x00, 0xA4, 0x00, 0x0C, 0x02, abtRx[9], abtRx[10] };
+      const size_t szLc = MIN((abtRx[5] << 8) | abtRx[6], SIM_T4_MLE);
+      if ((simple_apdu(abtSelectNdef, sizeof(abtSelectNdef), abtRx) < 0) || (simple_apdu(abtClearNlen, sizeof(abtClearNlen), abtRx) < 0))
+        return false;
+      for (size_t szPos = 0; szPos < szMessage;) {
+        const size_t szChunk = MIN(szLc, szMessage - szPos);
+        abtUpdate[0] = 0x00;
+        abtUpdate[1] = 0xD6;
+        abtUpdate[2] = (uint8_t)((2 + szPos) >> 8);
+        abtUpdate[3] = (uint8_t)(2 + szPos);
+        abtUpdate[4] = (uint8_t) szChunk;
+        memcpy(abtUpdate + 5, pbtMessage + szPos, szChunk);
+        if (simple_apdu(abtUpdate, 5 + szChunk, abtRx) < 0)
+          return false;
+        szPos += szChunk;
+      }
+      return simple_apdu(abtNlen, sizeof(abtNlen), abtRx) == 0;
+    }
+    case NDEF_TAG_UNKNOWN:
+      break;
+  }
+  return false;
+}
+
+// The message read must be the one written, its records views into it
+static int
+check_message(const uint8_t *pbtRead, const size_t szRead, const uint8_t *pbtMessage, const size_t szMessage)
+{
+  ndef_record nr;
+  size_t szOffset = 0, szRecords = 0;
+  int res;
+
+  if ((szRead != szMessage) || memcmp(pbtRead, pbtMessage, szMessage)) {
+    fprintf(stderr, "NDEF message read differs from the one written\n");
+    return -1;
+  }
+  while ((res = ndef_record_next(pbtRead, szRead, &szOffset, &nr)) > 0) {
+    if ((nr.pbtPayload < pbtRead) || (nr.pbtPayload + nr.szPayload > pbtRead + szRead) || (nr.szType != 1) || (nr.pbtType[0] != 'b'))
+      return -1;
+    szRecords++;
+  }
+  if ((res < 0) || !szRecords || !(nr.btHeader & NDEF_RECORD_ME)) {
+    fprintf(stderr, "Malformed NDEF message\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int
+bench(const char *pcName, const ndef_tag_type ntt, const size_t szMax)
+{
+  static uint8_t abtMessage[SIM_T4_FILE_SIZE], abtSimple[SIM_T4_FILE_SIZE];
+  ndef_cc_cache cache;
+  ndef_tag tag;
+  nfc_target nt;
+  const uint8_t *pbtRead;
+  size_t szRead, szSimple;
+
+  memset(&cache, 0, sizeof(cache));
+  sim_reset(ntt, &nt);
+  const size_t szMessage = build_message(abtMessage, szMax, 0x11);
+  printf("%s, %lu-byte NDEF message\n", pcName, (unsigned long) szMessage);
+
+  MEASURE("simple write", if (!simple_write(&nt, abtMessage, szMessage)) return -1);
+  MEASURE("simple read", if (!simple_read(&nt, abtSimple, &szSimple)) return -1);
+  if (check_message(abtSimple, szSimple, abtMessage, szMessage) < 0)
+    return -1;
+
+  if (!ndef_tag_open(&tag, &nt, &cache))
+    return -1;
+  MEASURE("engine read, CC read from the tag", if (!ndef_tag_read(NULL, &tag, &pbtRead, &szRead)) return -1);
+  if (check_message(pbtRead, szRead, abtMessage, szMessage) < 0)
+    return -1;
+  ndef_tag_close(&tag);
+
+  if (!ndef_tag_open(&tag, &nt, &cache))
+    return -1;
+  MEASURE("engine read, CC from the cache", if (!ndef_tag_read(NULL, &tag, &pbtRead, &szRead)) return -1);
+  if (check_message(pbtRead, szRead, abtMessage, szMessage) < 0)
+    return -1;
+  MEASURE("engine write, same message", if (!ndef_tag_write(NULL, &tag, abtMessage, szMessage)) return -1);
+  abtMessage[szMessage / 2] ^= 0x5a;
+  MEASURE("engine write, one byte changed", if (!ndef_tag_write(NULL, &tag, abtMessage, szMessage)) return -1);
+  const size_t szNew = build_message(abtMessage, szMax, 0x77);
+  MEASURE("engine write, new message", if (!ndef_tag_write(NULL, &tag, abtMessage, szNew)) return -1);
+  ndef_tag_close(&tag);
+
+  // Read back without cache
+  if (!ndef_tag_open(&tag, &nt, NULL) || !ndef_tag_read(NULL, &tag, &pbtRead, &szRead) ||
+      (check_message(pbtRead, szRead, abtMessage, szNew) < 0)) {
+    ndef_tag_close(&tag);
+    return -1;
+  }
+  ndef_tag_close(&tag);
+  return 0;
+}
+
+int
+main(void)
+{
+  printf("%d us per exchange with the chip\n", SIM_CHIP_US);
+  if ((bench("NTAG215 (Type 2)", NDEF_TAG_TYPE2, 440) < 0) ||
+      (bench("FeliCa (Type 3), 8 blocks per command", NDEF_TAG_TYPE3, SIM_T3_NMAXB * FELICA_BLOCK_SIZE) < 0) ||
+      (bench("ISO/IEC 14443-4 (Type 4), MLe 255", NDEF_TAG_TYPE4, SIM_T4_FILE_SIZE - 2) < 0))
+    return EXIT_FAILURE;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,774 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file ndef.c
+ * @brief provide samples structs and functions to read and write NDEF messages on NFC Forum Type 2, 3 and 4 Tags using libnfc
+ *
+ * The tag content is kept in an image: reads only fetch what the NDEF
+ * message needs, with the longest commands of each tag type (FAST_READ,
+ * CHECK of as many blocks as the attribute block allows, READ BINARY of MLe
+ * bytes), and writes only send the pages, blocks or byte ranges which differ
+ * from the image. The message length is cleared while the data is written
+ * (Type 2 and 4) or the attribute block flags the write (Type 3), so a torn
+ * write never leaves a message mixing old and new content.
+ * The capability container is looked up by UID in an optional cache: the
+ * next sessions with a tag save its GET_VERSION (Type 2), the CC file
+ * selection and read (Type 4), or read data blocks with the attribute block
+ * in their first CHECK (Type 3).
+ */
+#include "ndef.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+
+// Type 2: Capability Container then data area, which holds TLV blocks
+#define NDEF_T2_CC_PAGE 3
+#define NDEF_T2_DATA_PAGE 4
+#define NDEF_T2_MAGIC 0xE1
+#define NDEF_TLV_NULL 0x00
+#define NDEF_TLV_NDEF 0x03
+#define NDEF_TLV_TERMINATOR 0xFE
+
+// Type 4: short APDUs, an UPDATE BINARY header costs 5 bytes so closer changes are sent together
+#define NDEF_T4_MAX_LE 0xFF
+#define NDEF_T4_CC_FILE 0xE103
+#define NDEF_T4_CC_LEN 15
+#define NDEF_T4_MERGE_GAP 5
+
+/**
+ * @brief Tell the NFC Forum tag type of a target from its modulation, SAK or protocol info
+ */
+ndef_tag_type
+ndef_tag_detect(const nfc_target *pnt)
+{
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      if (pnt->nti.nai.btSak & 0x20)
+        return NDEF_TAG_TYPE4;
+      // MIFARE Ultralight family and NTAG: no MIFARE Classic memory, no ISO/IEC 14443-4
+      if ((pnt->nti.nai.btSak & 0x7f) == 0x00)
+        return NDEF_TAG_TYPE2;
+      break;
+    case NMT_ISO14443B:
+      if (pnt->nti.nbi.abtProtocolInfo[1] & 0x01)
+        return NDEF_TAG_TYPE4;
+      break;
+    case NMT_FELICA:
+      return NDEF_TAG_TYPE3;
+    default:
+      break;
+  }
+  return NDEF_TAG_UNKNOWN;
+}
+
+static ndef_cc *
+ndef_cache_find(ndef_cc_cache *pcache, const ndef_cc *pcc)
+{
+  for (size_t n = 0; n < NDEF_CC_CACHE_SIZE; n++) {
+    const ndef_cc *pentry = &pcache->acc[n];
+    if ((pentry->ntt == pcc->ntt) && (pentry->szUid == pcc->szUid) && !memcmp(pentry->abtUid, pcc->abtUid, pcc->szUid))
+      return &pcache->acc[n];
+  }
+  return NULL;
+}
+
+static void
+ndef_cache_store(ndef_tag *ptag)
+{
+  if (!ptag->pcache)
+    return;
+  ndef_cc *pentry = ndef_cache_find(ptag->pcache, &ptag->cc);
+  if (!pentry) {
+    pentry = &ptag->pcache->acc[ptag->pcache->szNext];
+    ptag->pcache->szNext = (ptag->pcache->szNext + 1) % NDEF_CC_CACHE_SIZE;
+  }
+  *pentry = ptag->cc;
+}
+
+static void
+ndef_cache_drop(ndef_tag *ptag)
+{
+  ndef_cc *pentry;
+  if (ptag->pcache && ((pentry = ndef_cache_find(ptag->pcache, &ptag->cc)) != NULL))
+    pentry->ntt = NDEF_TAG_UNKNOWN;
+  ptag->bCcKnown = false;
+}
+
+/**
+ * @brief Prepare a session with the selected target \a pnt
+ *
+ * Its capability container is taken from \a pcache, which may be NULL, when the cache knows its UID.
+ * @return Returns true if the tag type is supported; otherwise returns false.
+ */
+bool
+ndef_tag_open(ndef_tag *ptag, const nfc_target *pnt, ndef_cc_cache *pcache)
+{
+  memset(ptag, 0, sizeof(*ptag));
+  ptag->nt = *pnt;
+  ptag->pcache = pcache;
+  ptag->cc.ntt = ndef_tag_detect(pnt);
+  switch (pnt->nm.nmt) {
+    case NMT_ISO14443A:
+      ptag->cc.szUid = MIN(pnt->nti.nai.szUidLen, sizeof(ptag->cc.abtUid));
+      memcpy(ptag->cc.abtUid, pnt->nti.nai.abtUid, ptag->cc.szUid);
+      break;
+    case NMT_ISO14443B:
+      ptag->cc.szUid = sizeof(pnt->nti.nbi.abtPupi);
+      memcpy(ptag->cc.abtUid, pnt->nti.nbi.abtPupi, ptag->cc.szUid);
+      break;
+    case NMT_FELICA:
+      ptag->cc.szUid = sizeof(pnt->nti.nfi.abtId);
+      memcpy(ptag->cc.abtUid, pnt->nti.nfi.abtId, ptag->cc.szUid);
+      felica_card_init(&ptag->fc, pnt);
+      break;
+    default:
+      break;
+  }
+  if (ptag->cc.ntt == NDEF_TAG_UNKNOWN)
+    return false;
+
+  const ndef_cc *pentry;
+  if (pcache && ((pentry = ndef_cache_find(pcache, &ptag->cc)) != NULL)) {
+    ptag->cc = *pentry;
+    ptag->bCcKnown = true;
+  }
+  return true;
+}
+
+/**
+ * @brief End a session, the messages returned by ndef_tag_read() are no longer valid
+ */
+void
+ndef_tag_close(ndef_tag *ptag)
+{
+  free(ptag->pbtImage);
+  ptag->pbtImage = NULL;
+  ptag->szImage = 0;
+}
+
+static bool
+ndef_image_alloc(ndef_tag *ptag, const size_t szImage)
+{
+  if (szImage <= ptag->szImage)
+    return true;
+  uint8_t *pbt = realloc(ptag->pbtImage, szImage);
+  if (!pbt)
+    return false;
+  ptag->pbtImage = pbt;
+  ptag->szImage = szImage;
+  return true;
+}
+
+// Bytes the tag does not hold yet, as far as the image knows
+static bool
+ndef_image_differs(const ndef_tag *ptag, const uint8_t *pbtNew, const size_t szOffset, const size_t szLen)
+{
+  return (szOffset + szLen > ptag->szKnown) || memcmp(ptag->pbtImage + szOffset, pbtNew + szOffset, szLen);
+}
+
+/*
+ * NFC Forum Type 2 Tag
+ *
+ * Lock and Memory Control TLVs are skipped, not the areas they reserve: on
+ * the Ultralight family and NTAG these lie after the data area.
+ */
+
+// Read the data area up to byte szUpTo with whole commands: as many pages as one FAST_READ or READ answers
+static bool
+ndef_t2_fetch(nfc_device *pnd, ndef_tag *ptag, const size_t szUpTo)
+{
+  if (szUpTo <= ptag->szKnown)
+    return true;
+  if (szUpTo > ptag->cc.szArea)
+    return false;
+  const bool bFastRead = ptag->mm.abtVersion[0] || ptag->mm.abtVersion[1];
+  const size_t szPerCommand = bFastRead ? ptag->mm.szMaxFrame / MIFAREUL_PAGE_SIZE : 4;
+  const size_t szPage = ptag->szKnown / MIFAREUL_PAGE_SIZE;
+  size_t szCount = (szUpTo + MIFAREUL_PAGE_SIZE - 1) / MIFAREUL_PAGE_SIZE - szPage;
+  szCount = MIN(ptag->cc.szArea / MIFAREUL_PAGE_SIZE - szPage, (szCount + szPerCommand - 1) / szPerCommand * szPerCommand);
+  if (!mifareul_memory_read_pages(pnd, &ptag->mm, NDEF_T2_DATA_PAGE + szPage, szCount, ptag->pbtImage + szPage * MIFAREUL_PAGE_SIZE))
+    return false;
+  ptag->szKnown = (szPage + szCount) * MIFAREUL_PAGE_SIZE;
+  return true;
+}
+
+static bool
+ndef_t2_read(nfc_device *pnd, ndef_tag *ptag)
+{
+  uint8_t abtFirst[MIFAREUL_DEFAULT_MAX_FRAME];
+
+  if (ptag->bCcKnown) {
+    if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true) < 0) {
+      nfc_perror(pnd, "nfc_device_set_property_bool");
+      return false;
+    }
+    ptag->mm.szPages = ptag->cc.szPages;
+    ptag->mm.szConfigPage = ptag->cc.szPages;
+    memcpy(ptag->mm.abtVersion, ptag->cc.abtVersion, sizeof(ptag->mm.abtVersion));
+    if (ptag->mm.szMaxFrame == 0)
+      ptag->mm.szMaxFrame = MIFAREUL_DEFAULT_MAX_FRAME;
+  } else {
+    if (!mifareul_memory_detect(pnd, &ptag->nt, &ptag->mm))
+      return false;
+    ptag->cc.szPages = ptag->mm.szPages;
+    memcpy(ptag->cc.abtVersion, ptag->mm.abtVersion, sizeof(ptag->cc.abtVersion));
+  }
+
+  // The CC, then the data area as far as the first command goes
+  const bool bFastRead = ptag->mm.abtVersion[0] || ptag->mm.abtVersion[1];
+  size_t szCount = MIN(bFastRead ? ptag->mm.szMaxFrame / MIFAREUL_PAGE_SIZE : 4, ptag->mm.szConfigPage - NDEF_T2_CC_PAGE);
+  if (ptag->bCcKnown)
+    szCount = MIN(szCount, 1 + ptag->cc.szArea / MIFAREUL_PAGE_SIZE);
+  if (!mifareul_memory_read_pages(pnd, &ptag->mm, NDEF_T2_CC_PAGE, szCount, abtFirst))
+    return false;
+  if ((abtFirst[0] != NDEF_T2_MAGIC) || (abtFirst[2] == 0)) {
+    ndef_cache_drop(ptag);
+    return false;
+  }
+  ptag->cc.szArea = MIN(abtFirst[2] * 8u, (ptag->mm.szConfigPage - NDEF_T2_DATA_PAGE) * MIFAREUL_PAGE_SIZE);
+  ptag->cc.bWritable = (abtFirst[3] & 0x0f) == 0x00;
+  ptag->bCcKnown = true;
+  if (!ndef_image_alloc(ptag, ptag->cc.szArea))
+    return false;
+  ptag->szKnown = MIN((szCount - 1) * MIFAREUL_PAGE_SIZE, ptag->cc.szArea);
+  memcpy(ptag->pbtImage, abtFirst + MIFAREUL_PAGE_SIZE, ptag->szKnown);
+
+  // TLV blocks up to the NDEF one
+  size_t szPos = 0;
+  for (;;) {
+    if (!ndef_t2_fetch(pnd, ptag, szPos + 1))
+      return false;
+    const uint8_t btType = ptag->pbtImage[szPos];
+    if (btType == NDEF_TLV_NULL) {
+      szPos++;
+      continue;
+    }
+    if ((btType == NDEF_TLV_TERMINATOR) || !ndef_t2_fetch(pnd, ptag, szPos + 2))
+      return false;
+    size_t szLen = ptag->pbtImage[szPos + 1];
+    size_t szHeader = 2;
+    if (szLen == 0xFF) {
+      if (!ndef_t2_fetch(pnd, ptag, szPos + 4))
+        return false;
+      szLen = (ptag->pbtImage[szPos + 2] << 8) | ptag->pbtImage[szPos + 3];
+      szHeader = 4;
+    }
+    if (btType == NDEF_TLV_NDEF) {
+      if (!ndef_t2_fetch(pnd, ptag, szPos + szHeader + szLen))
+        return false;
+      ptag->szTlv = szPos;
+      ptag->szMessage = szPos + szHeader;
+      ptag->szMessageLen = szLen;
+      return true;
+    }
+    szPos += szHeader + szLen;
+  }
+}
+
+static bool
+ndef_t2_write_pages(nfc_device *pnd, ndef_tag *ptag, const uint8_t *pbtNew, const size_t szEnd)
+{
+  mifare_param mp;
+
+  for (size_t szOffset = 0; szOffset < szEnd; szOffset += MIFAREUL_PAGE_SIZE) {
+    if (!ndef_image_differs(ptag, pbtNew, szOffset, MIFAREUL_PAGE_SIZE))
+      continue;
+    // Compatibility write: the tag only takes the first 4 bytes
+    memset(mp.mpd.abtData, 0x00, sizeof(mp.mpd.abtData));
+    memcpy(mp.mpd.abtData, pbtNew + szOffset, MIFAREUL_PAGE_SIZE);
+    ptag->mm.ulCommands++;
+    if (!nfc_initiator_mifare_cmd(pnd, MC_WRITE, (uint8_t)(NDEF_T2_DATA_PAGE + szOffset / MIFAREUL_PAGE_SIZE), &mp))
+      return false;
+    // Unknown pages before this one differed too: the known part stays in one piece
+    memcpy(ptag->pbtImage + szOffset, pbtNew + szOffset, MIFAREUL_PAGE_SIZE);
+    ptag->szKnown = MAX(ptag->szKnown, szOffset + MIFAREUL_PAGE_SIZE);
+  }
+  return true;
+}
+
+static bool
+ndef_t2_write(nfc_device *pnd, ndef_tag *ptag, const uint8_t *pbtMessage, const size_t szMessage)
+{
+  const size_t szHeader = (szMessage < 0xFF) ? 2 : 4;
+  size_t szEnd = ptag->szTlv + szHeader + szMessage;
+
+  if (!ptag->cc.bWritable || (szMessage > 0xFFFE) || (szEnd > ptag->cc.szArea))
+    return false;
+
+  uint8_t *pbtNew = malloc(ptag->cc.szArea);
+  if (!pbtNew)
+    return false;
+  memcpy(pbtNew, ptag->pbtImage, ptag->szKnown);
+  memset(pbtNew + ptag->szKnown, 0x00, ptag->cc.szArea - ptag->szKnown);
+  memcpy(pbtNew + ptag->szTlv + szHeader, pbtMessage, szMessage);
+  if (szEnd < ptag->cc.szArea)
+    pbtNew[szEnd++] = NDEF_TLV_TERMINATOR;
+  szEnd = MIN((szEnd + MIFAREUL_PAGE_SIZE - 1) / MIFAREUL_PAGE_SIZE * MIFAREUL_PAGE_SIZE, ptag->cc.szArea);
+
+  // Message with a null length first, then the length alone
+  uint8_t *pbtLength = pbtNew + ptag->szTlv;
+  pbtLength[0] = NDEF_TLV_NDEF;
+  if (szHeader == 2) {
+    pbtLength[1] = 0x00;
+  } else {
+    pbtLength[1] = 0xFF;
+    pbtLength[2] = pbtLength[3] = 0x00;
+  }
+  bool res = true;
+  if (ndef_image_differs(ptag, pbtNew, ptag->szTlv + szHeader, szEnd - ptag->szTlv - szHeader))
+    res = ndef_t2_write_pages(pnd, ptag, pbtNew, szEnd);
+  if (szHeader == 2) {
+    pbtLength[1] = (uint8_t) szMessage;
+  } else {
+    pbtLength[2] = (uint8_t)(szMessage >> 8);
+    pbtLength[3] = (uint8_t) szMessage;
+  }
+  if (res)
+    res = ndef_t2_write_pages(pnd, ptag, pbtNew, szEnd);
+  free(pbtNew);
+  if (res) {
+    ptag->szMessage = ptag->szTlv + szHeader;
+    ptag->szMessageLen = szMessage;
+  }
+  return res;
+}
+
+/*
+ * NFC Forum Type 3 Tag
+ */
+
+static void
+ndef_t3_blocks(felica_block *pblocks, const uint16_t ui16Service, const size_t szFirst, const size_t szCount)
+{
+  for (size_t n = 0; n < szCount; n++) {
+    pblocks[n].ui16Service = ui16Service;
+    pblocks[n].ui16Block = (uint16_t)(szFirst + n);
+  }
+}
+
+static bool
+ndef_t3_read(nfc_device *pnd, ndef_tag *ptag)
+{
+  felica_block ablocks[FELICA_MAX_CHECK_BLOCKS];
+  uint8_t abtFirst[FELICA_MAX_CHECK_BLOCKS * FELICA_BLOCK_SIZE];
+  size_t szFirst = 1;
+
+  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, false) < 0) {
+    nfc_perror(pnd, "nfc_device_set_property_bool");
+    return false;
+  }
+  // Blocks per CHECK known: the attribute block comes with the first data blocks
+  if (ptag->bCcKnown) {
+    ptag->fc.btNbr = (uint8_t) ptag->cc.szMaxRead;
+    ptag->fc.btNbw = (uint8_t) ptag->cc.szMaxWrite;
+    szFirst = MIN(ptag->cc.szMaxRead, 1 + ptag->cc.szArea / FELICA_BLOCK_SIZE);
+  }
+  ndef_t3_blocks(ablocks, FELICA_T3T_SERVICE_READ, 0, szFirst);
+  if (!felica_check(pnd, &ptag->fc, ablocks, szFirst, abtFirst)) {
+    ndef_cache_drop(ptag);
+    return false;
+  }
+  memcpy(ptag->attr.abtBlock, abtFirst, FELICA_BLOCK_SIZE);
+  felica_t3t_decode_attribute(&ptag->fc, &ptag->attr);
+  if (!ptag->attr.bChecksumOk) {
+    ndef_cache_drop(ptag);
+    return false;
+  }
+  ptag->cc.szArea = ptag->attr.ui16Nmaxb * FELICA_BLOCK_SIZE;
+  ptag->cc.szMaxRead = ptag->fc.btNbr;
+  ptag->cc.szMaxWrite = ptag->fc.btNbw;
+  ptag->cc.bWritable = ptag->attr.btRwFlag == 0x01;
+  ptag->bCcKnown = true;
+
+  const size_t szBlocks = (ptag->attr.ui32Ln + FELICA_BLOCK_SIZE - 1) / FELICA_BLOCK_SIZE;
+  if ((ptag->attr.ui32Ln > ptag->cc.szArea) || !ndef_image_alloc(ptag, ptag->cc.szArea))
+    return false;
+  ptag->szKnown = MIN((szFirst - 1) * FELICA_BLOCK_SIZE, ptag->cc.szArea);
+  memcpy(ptag->pbtImage, abtFirst + FELICA_BLOCK_SIZE, ptag->szKnown);
+  // The rest in CHECKs as full as btNbr allows, what was read is kept even on failure
+  const size_t szDone = ptag->szKnown / FELICA_BLOCK_SIZE;
+  if (szDone < szBlocks) {
+    const size_t szRead = felica_check_range(pnd, &ptag->fc, FELICA_T3T_SERVICE_READ, 1 + szDone, szBlocks - szDone,
+                                             ptag->pbtImage + szDone * FELICA_BLOCK_SIZE);
+    ptag->szKnown = (szDone + szRead) * FELICA_BLOCK_SIZE;
+    if (szRead < szBlocks - szDone)
+      return false;
+  }
+  ptag->szMessage = 0;
+  ptag->szMessageLen = ptag->attr.ui32Ln;
+  return true;
+}
+
+static bool
+ndef_t3_write(nfc_device *pnd, ndef_tag *ptag, const uint8_t *pbtMessage, const size_t szMessage)
+{
+  const size_t szBlocks = (szMessage + FELICA_BLOCK_SIZE - 1) / FELICA_BLOCK_SIZE;
+
+  if (!ptag->cc.bWritable || (szBlocks * FELICA_BLOCK_SIZE > ptag->cc.szArea))
+    return false;
+
+  uint8_t *pbtNew = calloc(szBlocks + 1, FELICA_BLOCK_SIZE);
+  felica_block *pblocks = malloc((szBlocks + 1) * sizeof(felica_block));
+  uint8_t *pbtData = malloc((szBlocks + 1) * FELICA_BLOCK_SIZE);
+  bool res = false;
+  if (!pbtNew || !pblocks || !pbtData)
+    goto out;
+  memcpy(pbtNew, pbtMessage, szMessage);
+
+  // The attribute block flags the write in the first UPDATE, with the first blocks which changed
+  size_t szCount = 1;
+  for (size_t n = 0; n < szBlocks; n++) {
+    if (!ndef_image_differs(ptag, pbtNew, n * FELICA_BLOCK_SIZE, FELICA_BLOCK_SIZE))
+      continue;
+    pblocks[szCount].ui16Service = FELICA_T3T_SERVICE_WRITE;
+    pblocks[szCount].ui16Block = (uint16_t)(1 + n);
+    memcpy(pbtData + szCount * FELICA_BLOCK_SIZE, pbtNew + n * FELICA_BLOCK_SIZE, FELICA_BLOCK_SIZE);
+    szCount++;
+  }
+  if (szCount > 1) {
+    ptag->attr.btWriteFlag = FELICA_T3T_WRITEF_BUSY;
+    felica_t3t_encode_attribute(&ptag->attr);
+    pblocks[0].ui16Service = FELICA_T3T_SERVICE_WRITE;
+    pblocks[0].ui16Block = 0;
+    memcpy(pbtData, ptag->attr.abtBlock, FELICA_BLOCK_SIZE);
+    if (!felica_update(pnd, &ptag->fc, pblocks, szCount, pbtData))
+      goto out;
+    // Blocks beyond the known ones were all written
+    for (size_t n = 1; n < szCount; n++)
+      memcpy(ptag->pbtImage + (pblocks[n].ui16Block - 1) * FELICA_BLOCK_SIZE, pbtData + n * FELICA_BLOCK_SIZE, FELICA_BLOCK_SIZE);
+    ptag->szKnown = MAX(ptag->szKnown, szBlocks * FELICA_BLOCK_SIZE);
+  }
+  if ((szCount > 1) || (ptag->attr.ui32Ln != szMessage)) {
+    const felica_block fb = { FELICA_T3T_SERVICE_WRITE, 0 };
+    ptag->attr.btWriteFlag = FELICA_T3T_WRITEF_DONE;
+    ptag->attr.ui32Ln = (uint32_t) szMessage;
+    felica_t3t_encode_attribute(&ptag->attr);
+    if (!felica_update(pnd, &ptag->fc, &fb, 1, ptag->attr.abtBlock))
+      goto out;
+  }
+  ptag->szMessage = 0;
+  ptag->szMessageLen = szMessage;
+  res = true;
+
+out:
+  free(pbtNew);
+  free(pblocks);
+  free(pbtData);
+  return res;
+}
+
+/*
+ * NFC Forum Type 4 Tag
+ */
+
+// Sends an APDU, returns the response data length when the status is 90 00
+static int
+ndef_t4_apdu(nfc_device *pnd, ndef_tag *ptag, const uint8_t *pbtApdu, const size_t szApdu, uint8_t *pbtRx, const size_t szRx)
+{
+  int res;
+
+  ptag->ulApdus++;
+  if ((res = nfc_initiator_transceive_bytes(pnd, pbtApdu, szApdu, pbtRx, szRx, -1)) < 2)
+    return -1;
+  if ((pbtRx[res - 2] != 0x90) || (pbtRx[res - 1] != 0x00))
+    return -1;
+  return res - 2;
+}
+
+static bool
+ndef_t4_select_file(nfc_device *pnd, ndef_tag *ptag, const uint16_t ui16File)
+{
+  const uint8_t abtSelect[] = { 0x00, 0xA4, 0x00, 0x0C, 0x02, (uint8_t)(ui16File >> 8), (uint8_t) ui16File };
+  uint8_t abtRx[2];
+  return ndef_t4_apdu(pnd, ptag, abtSelect, sizeof(abtSelect), abtRx, sizeof(abtRx)) == 0;
+}
+
+static bool
+ndef_t4_read_binary(nfc_device *pnd, ndef_tag *ptag, const size_t szOffset, const size_t szLen, uint8_t *pbtData)
+{
+  const uint8_t abtRead[] = { 0x00, 0xB0, (uint8_t)(szOffset >> 8), (uint8_t) szOffset, (uint8_t) szLen };
+  uint8_t abtRx[NDEF_T4_MAX_LE + 2];
+  if (ndef_t4_apdu(pnd, ptag, abtRead, sizeof(abtRead), abtRx, sizeof(abtRx)) != (int) szLen)
+    return false;
+  memcpy(pbtData, abtRx, szLen);
+  return true;
+}
+
+static bool
+ndef_t4_read(nfc_device *pnd, ndef_tag *ptag)
+{
+  const uint8_t abtSelectApp[] = { 0x00, 0xA4, 0x04, 0x00, 0x07, 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01, 0x00 };
+  uint8_t abtRx[2];
+
+  if (nfc_device_set_property_bool(pnd, NP_EASY_FRAMING, true) < 0) {
+    nfc_perror(pnd, "nfc_device_set_property_bool");
+    return false;
+  }
+  if (ndef_t4_apdu(pnd, ptag, abtSelectApp, sizeof(abtSelectApp), abtRx, sizeof(abtRx)) != 0)
+    return false;
+
+  if (!ptag->bCcKnown) {
+    uint8_t abtCc[NDEF_T4_CC_LEN];
+    if (!ndef_t4_select_file(pnd, ptag, NDEF_T4_CC_FILE) || !ndef_t4_read_binary(pnd, ptag, 0, sizeof(abtCc), abtCc))
+      return false;
+    // CCLEN, version, MLe, MLc, then the NDEF File Control TLV
+    if ((((abtCc[0] << 8) | abtCc[1]) < NDEF_T4_CC_LEN) || (abtCc[7] != 0x04) || (abtCc[8] < 6) || (abtCc[13] != 0x00))
+      return false;
+    ptag->cc.szMaxRead = (abtCc[3] << 8) | abtCc[4];
+    ptag->cc.szMaxWrite = (abtCc[5] << 8) | abtCc[6];
+    ptag->cc.ui16FileId = (uint16_t)((abtCc[9] << 8) | abtCc[10]);
+    ptag->cc.szArea = (abtCc[11] << 8) | abtCc[12];
+    ptag->cc.bWritable = abtCc[14] == 0x00;
+    if ((ptag->cc.szMaxRead == 0) || (ptag->cc.szMaxWrite == 0) || (ptag->cc.szArea < 2))
+      return false;
+    ptag->bCcKnown = true;
+  }
+  if (!ndef_t4_select_file(pnd, ptag, ptag->cc.ui16FileId)) {
+    ndef_cache_drop(ptag);
+    return false;
+  }
+
+  // NLEN and as much of the message as one READ BINARY takes
+  const size_t szLe = MIN(ptag->cc.szMaxRead, NDEF_T4_MAX_LE);
+  if (!ndef_image_alloc(ptag, ptag->cc.szArea))
+    return false;
+  size_t szLen = MIN(szLe, ptag->cc.szArea);
+  if (!ndef_t4_read_binary(pnd, ptag, 0, szLen, ptag->pbtImage))
+    return false;
+  ptag->szKnown = szLen;
+  const size_t szEnd = 2 + ((ptag->pbtImage[0] << 8) | ptag->pbtImage[1]);
+  if (szEnd > ptag->cc.szArea)
+    return false;
+  while (ptag->szKnown < szEnd) {
+    szLen = MIN(szLe, szEnd - ptag->szKnown);
+    if (!ndef_t4_read_binary(pnd, ptag, ptag->szKnown, szLen, ptag->pbtImage + ptag->szKnown))
+      return false;
+    ptag->szKnown += szLen;
+  }
+  ptag->szMessage = 2;
+  ptag->szMessageLen = szEnd - 2;
+  return true;
+}
+
+// UPDATE BINARY of the byte ranges which differ, up to MLc bytes each
+static bool
+ndef_t4_update(nfc_device *pnd, ndef_tag *ptag, const uint8_t *pbtNew, const size_t szEnd)
+{
+  const size_t szLc = MIN(ptag->cc.szMaxWrite, NDEF_T4_MAX_LE);
+  uint8_t abtApdu[5 + NDEF_T4_MAX_LE];
+  uint8_t abtRx[2];
+  size_t szOffset = 0;
+
+  while (szOffset < szEnd) {
+    if (!ndef_image_differs(ptag, pbtNew, szOffset, 1)) {
+      szOffset++;
+      continue;
+    }
+    size_t szLast = szOffset + 1;
+    for (size_t n = szLast; (n < szEnd) && (n < szOffset + szLc) && (n - szLast < NDEF_T4_MERGE_GAP); n++) {
+      if (ndef_image_differs(ptag, pbtNew, n, 1))
+        szLast = n + 1;
+    }
+    const size_t szLen = szLast - szOffset;
+    abtApdu[0] = 0x00;
+    abtApdu[1] = 0xD6;
+    abtApdu[2] = (uint8_t)(szOffset >> 8);
+    abtApdu[3] = (uint8_t) szOffset;
+    abtApdu[4] = (uint8_t) szLen;
+    memcpy(abtApdu + 5, pbtNew + szOffset, szLen);
+    if (ndef_t4_apdu(pnd, ptag, abtApdu, 5 + szLen, abtRx, sizeof(abtRx)) != 0)
+      return false;
+    // Unknown bytes before this range differed too: the known part stays in one piece
+    memcpy(ptag->pbtImage + szOffset, pbtNew + szOffset, szLen);
+    ptag->szKnown = MAX(ptag->szKnown, szLast);
+    szOffset = szLast;
+  }
+  return true;
+}
+
+static bool
+ndef_t4_write(nfc_device *pnd, ndef_tag *ptag, const uint8_t *pbtMessage, const size_t szMessage)
+{
+  const size_t szEnd = 2 + szMessage;
+
+  if (!ptag->cc.bWritable || (szEnd > ptag->cc.szArea))
+    return false;
+  uint8_t *pbtNew = malloc(szEnd);
+  if (!pbtNew)
+    return false;
+
+  // Message with NLEN cleared first, then NLEN alone
+  pbtNew[0] = pbtNew[1] = 0x00;
+  memcpy(pbtNew + 2, pbtMessage, szMessage);
+  bool res = true;
+  if (ndef_image_differs(ptag, pbtNew, 2, szMessage))
+    res = ndef_t4_update(pnd, ptag, pbtNew, szEnd);
+  pbtNew[0] = (uint8_t)(szMessage >> 8);
+  pbtNew[1] = (uint8_t) szMessage;
+  if (res)
+    res = ndef_t4_update(pnd, ptag, pbtNew, 2);
+  free(pbtNew);
+  if (res) {
+    ptag->szMessage = 2;
+    ptag->szMessageLen = szMessage;
+  }
+  return res;
+}
+
+static void
+ndef_tag_count(ndef_tag *ptag)
+{
+  ptag->ulCommands = ptag->mm.ulCommands + ptag->fc.ulCommands + ptag->ulApdus;
+}
+
+/**
+ * @brief Read the NDEF message of the tag
+ *
+ * The message is left in the tag image: \a ppbtMessage points into it until the next call
+ * on \a ptag. The capability container is stored in the cache of the session.
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+ndef_tag_read(nfc_device *pnd, ndef_tag *ptag, const uint8_t **ppbtMessage, size_t *pszMessage)
+{
+  bool res = false;
+
+  ptag->bRead = false;
+  ptag->szKnown = 0;
+  switch (ptag->cc.ntt) {
+    case NDEF_TAG_TYPE2:
+      res = ndef_t2_read(pnd, ptag);
+      break;
+    case NDEF_TAG_TYPE3:
+      res = ndef_t3_read(pnd, ptag);
+      break;
+    case NDEF_TAG_TYPE4:
+      res = ndef_t4_read(pnd, ptag);
+      break;
+    case NDEF_TAG_UNKNOWN:
+      break;
+  }
+  ndef_tag_count(ptag);
+  if (!res)
+    return false;
+  ptag->bRead = true;
+  ndef_cache_store(ptag);
+  *ppbtMessage = ptag->pbtImage + ptag->szMessage;
+  *pszMessage = ptag->szMessageLen;
+  return true;
+}
+
+/**
+ * @brief Write a NDEF message to the tag
+ *
+ * Only what differs from the tag content is sent; the message is read first when
+ * ndef_tag_read() was not called in this session.
+ * @return Returns true if action was successfully performed; otherwise returns false.
+ */
+bool
+ndef_tag_write(nfc_device *pnd, ndef_tag *ptag, const uint8_t *pbtMessage, const size_t szMessage)
+{
+  const uint8_t *pbtOld;
+  size_t szOld;
+  bool res = false;
+
+  if (!ptag->bRead && !ndef_tag_read(pnd, ptag, &pbtOld, &szOld))
+    return false;
+  switch (ptag->cc.ntt) {
+    case NDEF_TAG_TYPE2:
+      res = ndef_t2_write(pnd, ptag, pbtMessage, szMessage);
+      break;
+    case NDEF_TAG_TYPE3:
+      res = ndef_t3_write(pnd, ptag, pbtMessage, szMessage);
+      break;
+    case NDEF_TAG_TYPE4:
+      res = ndef_t4_write(pnd, ptag, pbtMessage, szMessage);
+      break;
+    case NDEF_TAG_UNKNOWN:
+      break;
+  }
+  ndef_tag_count(ptag);
+  return res;
+}
+
+/**
+ * @brief Parse the record at \a *pszOffset of a NDEF message, without copying it
+ *
+ * The fields of \a pnr point into \a pbtMessage; \a *pszOffset moves to the next record.
+ * @return Returns 1 when a record was parsed, 0 at the end of the message, -1 on a malformed record.
+ */
+int
+ndef_record_next(const uint8_t *pbtMessage, const size_t szMessage, size_t *pszOffset, ndef_record *pnr)
+{
+  size_t szPos = *pszOffset;
+
+  if (szPos >= szMessage)
+    return 0;
+  const uint8_t btHeader = pbtMessage[szPos++];
+  const size_t szLengths = 1 + ((btHeader & NDEF_RECORD_SR) ? 1 : 4) + ((btHeader & NDEF_RECORD_IL) ? 1 : 0);
+  if (szMessage - szPos < szLengths)
+    return -1;
+  pnr->btHeader = btHeader;
+  pnr->szType = pbtMessage[szPos++];
+  if (btHeader & NDEF_RECORD_SR) {
+    pnr->szPayload = pbtMessage[szPos++];
+  } else {
+    pnr->szPayload = ((size_t) pbtMessage[szPos] << 24) | ((size_t) pbtMessage[szPos + 1] << 16) |
+                     ((size_t) pbtMessage[szPos + 2] << 8) | pbtMessage[szPos + 3];
+    szPos += 4;
+  }
+  pnr->szId = (btHeader & NDEF_RECORD_IL) ? pbtMessage[szPos++] : 0;
+
+  if (szMessage - szPos < pnr->szType)
+    return -1;
+  pnr->pbtType = pbtMessage + szPos;
+  szPos += pnr->szType;
+  if (szMessage - szPos < pnr->szId)
+    return -1;
+  pnr->pbtId = pbtMessage + szPos;
+  szPos += pnr->szId;
+  if (szMessage - szPos < pnr->szPayload)
+    return -1;
+  pnr->pbtPayload = pbtMessage + szPos;
+  szPos += pnr->szPayload;
+  *pszOffset = szPos;
+  return 1;
+}
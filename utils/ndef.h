@@ -0,0 +1,125 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file ndef.h
+ * @brief provide samples structs and functions to read and write NDEF messages on NFC Forum Type 2, 3 and 4 Tags using libnfc
+ */
+
+#ifndef _LIBNFC_NDEF_H_
+#  define _LIBNFC_NDEF_H_
+
+#  include <nfc/nfc-types.h>
+
+#  include "felica.h"
+#  include "mifare.h"
+
+typedef enum {
+  NDEF_TAG_UNKNOWN = 0,
+  NDEF_TAG_TYPE2,           // MIFARE Ultralight family, NTAG
+  NDEF_TAG_TYPE3,           // FeliCa
+  NDEF_TAG_TYPE4,           // ISO/IEC 14443-4, APDUs through the device firmware
+} ndef_tag_type;
+
+// Capability container of a tag, what a new session on the same UID does not need to read again
+typedef struct {
+  ndef_tag_type ntt;
+  uint8_t  abtUid[10];
+  size_t   szUid;
+  size_t   szArea;          // bytes for the NDEF TLV (Type 2), the message (Type 3) or the NDEF file (Type 4)
+  size_t   szMaxRead;       // blocks per CHECK (Type 3), MLe (Type 4)
+  size_t   szMaxWrite;      // blocks per UPDATE (Type 3), MLc (Type 4)
+  uint16_t ui16FileId;      // NDEF file (Type 4)
+  bool     bWritable;
+  size_t   szPages;         // memory size (Type 2)
+  uint8_t  abtVersion[8];   // GET_VERSION answer (Type 2), FAST_READ is used when not zero
+} ndef_cc;
+
+#  define NDEF_CC_CACHE_SIZE 16
+
+// Capability containers of the last tags seen, replaced in turn
+typedef struct {
+  ndef_cc  acc[NDEF_CC_CACHE_SIZE];
+  size_t   szNext;
+} ndef_cc_cache;
+
+typedef struct {
+  nfc_target nt;
+  ndef_cc  cc;
+  bool     bCcKnown;        // cc was read from the tag or found in the cache
+  ndef_cc_cache *pcache;    // may be NULL
+  uint8_t *pbtImage;        // Type 2 data area, Type 3 blocks after the attribute block, Type 4 NDEF file
+  size_t   szImage;         // allocated
+  size_t   szKnown;         // bytes of pbtImage holding the tag content, as last read or written
+  bool     bRead;           // the NDEF message was located by ndef_tag_read()
+  size_t   szTlv;           // offset of the NDEF TLV (Type 2)
+  size_t   szMessage;       // offset of the NDEF message in pbtImage
+  size_t   szMessageLen;
+  mifareul_memory mm;       // Type 2
+  felica_card fc;           // Type 3
+  felica_t3t_attribute attr;
+  unsigned long ulApdus;    // Type 4
+  unsigned long ulCommands; // round trips to the tag
+} ndef_tag;
+
+ndef_tag_type ndef_tag_detect(const nfc_target *pnt);
+bool    ndef_tag_open(ndef_tag *ptag, const nfc_target *pnt, ndef_cc_cache *pcache);
+void    ndef_tag_close(ndef_tag *ptag);
+bool    ndef_tag_read(nfc_device *pnd, ndef_tag *ptag, const uint8_t **ppbtMessage, size_t *pszMessage);
+bool    ndef_tag_write(nfc_device *pnd, ndef_tag *ptag, const uint8_t *pbtMessage, const size_t szMessage);
+
+// NDEF record header flags
+#  define NDEF_RECORD_MB 0x80
+#  define NDEF_RECORD_ME 0x40
+#  define NDEF_RECORD_CF 0x20
+#  define NDEF_RECORD_SR 0x10
+#  define NDEF_RECORD_IL 0x08
+#  define NDEF_RECORD_TNF 0x07
+
+// One record, its fields pointing into the message buffer
+typedef struct {
+  uint8_t  btHeader;
+  const uint8_t *pbtType;
+  size_t   szType;
+  const uint8_t *pbtId;
+  size_t   szId;
+  const uint8_t *pbtPayload;
+  size_t   szPayload;
+} ndef_record;
+
+int     ndef_record_next(const uint8_t *pbtMessage, const size_t szMessage, size_t *pszOffset, ndef_record *pnr);
+
+#endif // _LIBNFC_NDEF_H_
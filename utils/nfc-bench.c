@@ -0,0 +1,497 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-bench.c
+ * @brief Measures the latency and throughput of a NFC device
+ *
+ * Every test runs a few warm-up operations, then times each operation on
+ * its own; the result gives the spread (percentiles, standard deviation),
+ * not only the average, so that readers and firmware revisions can be
+ * compared without being fooled by a few slow outliers.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <err.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+#include "chips/pn53x.h"
+
+#define DEFAULT_SAMPLES 100
+#define WARMUP_SAMPLES 3
+#define MAX_RESULTS 64
+
+// Diagnose echo payloads: the command and its answer must fit in a normal frame
+static const size_t aszEchoSizes[] = { 1, 32, 64, 128, 192, 250 };
+// APDU and DEP payloads, the largest ones need the chip to chain frames
+static const size_t aszExchangeSizes[] = { 16, 64, 128, 192, 255 };
+
+typedef int (*bench_op)(const size_t szSize);
+
+struct bench_result {
+  const char *pcName;
+  size_t  szSize;
+  size_t  szSamples;
+  size_t  szErrors;
+  uint64_t ui64Min;
+  uint64_t ui64P50;
+  uint64_t ui64P90;
+  uint64_t ui64P99;
+  uint64_t ui64Max;
+  double  dMean;
+  double  dStdDev;
+  double  dThroughput;    // bytes per second, 0 when not relevant
+};
+
+static nfc_context *context;
+static nfc_device *pnd;
+static nfc_device *pndTarget;
+static nfc_target nt;
+static size_t szSamples = DEFAULT_SAMPLES;
+static uint64_t *pui64Samples;
+static struct bench_result results[MAX_RESULTS];
+static size_t szResults;
+static uint8_t abtTx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+static uint8_t abtRx[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+static uint8_t ui8Reload;
+
+static const nfc_modulation nmIso14443A = {
+  .nmt = NMT_ISO14443A,
+  .nbr = NBR_106,
+};
+
+static uint64_t
+now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+static int
+compare_samples(const void *a, const void *b)
+{
+  const uint64_t x = *(const uint64_t *) a;
+  const uint64_t y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static uint64_t
+percentile(const uint64_t *pui64Sorted, const size_t szCount, const unsigned int uiPercent)
+{
+  size_t szRank = (szCount * uiPercent + 99) / 100;
+  return pui64Sorted[(szRank > 0) ? szRank - 1 : 0];
+}
+
+/*
+ * Runs op szSamples times after the warm-up. op returns the number of bytes
+ * exchanged with the chip or the target, or a libnfc error code: failed
+ * operations are counted but do not take part in the timings.
+ * If reset is not NULL, it is called after each operation, out of the timings.
+ */
+static void
+bench_run(const char *pcName, const size_t szSize, bench_op op, bench_op reset)
+{
+  if (szResults == MAX_RESULTS)
+    return;
+
+  for (size_t n = 0; n < WARMUP_SAMPLES; n++) {
+    op(szSize);
+    if (reset)
+      reset(szSize);
+  }
+
+  struct bench_result *pr = &results[szResults++];
+  memset(pr, 0, sizeof(*pr));
+  pr->pcName = pcName;
+  pr->szSize = szSize;
+
+  uint64_t ui64Bytes = 0;
+  for (size_t n = 0; n < szSamples; n++) {
+    const uint64_t ui64Start = now_us();
+    const int res = op(szSize);
+    const uint64_t ui64Elapsed = now_us() - ui64Start;
+    if (reset)
+      reset(szSize);
+    if (res < 0) {
+      pr->szErrors++;
+      continue;
+    }
+    ui64Bytes += (uint64_t) res;
+    pui64Samples[pr->szSamples++] = ui64Elapsed;
+  }
+  if (pr->szSamples == 0)
+    return;
+
+  qsort(pui64Samples, pr->szSamples, sizeof(uint64_t), compare_samples);
+  double dSum = 0;
+  for (size_t n = 0; n < pr->szSamples; n++)
+    dSum += (double) pui64Samples[n];
+  pr->dMean = dSum / (double) pr->szSamples;
+  double dVar = 0;
+  for (size_t n = 0; n < pr->szSamples; n++)
+    dVar += ((double) pui64Samples[n] - pr->dMean) * ((double) pui64Samples[n] - pr->dMean);
+  pr->dStdDev = (pr->szSamples > 1) ? sqrt(dVar / (double)(pr->szSamples - 1)) : 0;
+  pr->ui64Min = pui64Samples[0];
+  pr->ui64P50 = percentile(pui64Samples, pr->szSamples, 50);
+  pr->ui64P90 = percentile(pui64Samples, pr->szSamples, 90);
+  pr->ui64P99 = percentile(pui64Samples, pr->szSamples, 99);
+  pr->ui64Max = pui64Samples[pr->szSamples - 1];
+  pr->dThroughput = (ui64Bytes && dSum > 0) ? (double) ui64Bytes * 1e6 / dSum : 0;
+}
+
+static int
+op_diagnose_echo(const size_t szSize)
+{
+  // Communication line test: the chip sends the data back
+  abtTx[0] = Diagnose;
+  abtTx[1] = 0x00;
+  for (size_t n = 0; n < szSize; n++)
+    abtTx[2 + n] = (uint8_t) n;
+  int res = pn53x_transceive(pnd, abtTx, szSize + 2, abtRx, sizeof(abtRx), -1);
+  if (res < 0)
+    return res;
+  // RC-S360 answers without the NumTst byte
+  if ((memcmp(abtRx + 1, abtTx + 2, szSize) != 0) && (memcmp(abtRx, abtTx + 2, szSize) != 0))
+    return NFC_ECHIP;
+  return (int)(2 * szSize);
+}
+
+static int
+op_firmware_version(const size_t szSize)
+{
+  (void) szSize;
+  const uint8_t abtCmd[] = { GetFirmwareVersion };
+  return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx), -1);
+}
+
+static int
+op_read_register(const size_t szSize)
+{
+  (void) szSize;
+  const uint8_t abtCmd[] = { ReadRegister, PN53X_REG_CIU_TReloadVal_lo >> 8, PN53X_REG_CIU_TReloadVal_lo & 0xff };
+  return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx), -1);
+}
+
+static int
+op_write_register(const size_t szSize)
+{
+  (void) szSize;
+  // The timer reload value read beforehand is written back: the chip state does not change
+  const uint8_t abtCmd[] = { WriteRegister, PN53X_REG_CIU_TReloadVal_lo >> 8, PN53X_REG_CIU_TReloadVal_lo & 0xff, ui8Reload };
+  return pn53x_transceive(pnd, abtCmd, sizeof(abtCmd), abtRx, sizeof(abtRx), -1);
+}
+
+static int
+op_detect(const size_t szSize)
+{
+  (void) szSize;
+  int res = nfc_initiator_select_passive_target(pnd, nmIso14443A, NULL, 0, &nt);
+  if (res == 0)
+    res = NFC_ENOTSUCHDEV;
+  return (res < 0) ? res : 0;
+}
+
+static int
+op_deselect(const size_t szSize)
+{
+  (void) szSize;
+  return nfc_initiator_deselect_target(pnd);
+}
+
+static int
+op_exchange(const size_t szSize)
+{
+  for (size_t n = 0; n < szSize; n++)
+    abtTx[n] = (uint8_t) n;
+  // ISO-DEP: SELECT by name of an unknown application, Lc fills the APDU up to szSize
+  if (nt.nm.nmt == NMT_ISO14443A) {
+    abtTx[0] = 0x00;
+    abtTx[1] = 0xa4;
+    abtTx[2] = 0x04;
+    abtTx[3] = 0x00;
+    abtTx[4] = (uint8_t)(szSize - 5);
+  }
+  int res = nfc_initiator_transceive_bytes(pnd, abtTx, szSize, abtRx, sizeof(abtRx), -1);
+  return (res < 0) ? res : (int)(szSize + (size_t) res);
+}
+
+static void *
+dep_target_thread(void *arg)
+{
+  (void) arg;
+  nfc_target ntTarget = {
+    .nm = {
+      .nmt = NMT_DEP,
+      .nbr = NBR_UNDEFINED
+    },
+    .nti = {
+      .ndi = {
+        .abtNFCID3 = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xff, 0x00, 0x00 },
+        .szGB = 4,
+        .abtGB = { 0x12, 0x34, 0x56, 0x78 },
+        .ndm = NDM_UNDEFINED,
+        .btPP = 0x01,
+      },
+    },
+  };
+  uint8_t abtData[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+
+  if (nfc_target_init(pndTarget, &ntTarget, abtData, sizeof(abtData), 0) < 0)
+    return NULL;
+  // Echo every frame until the initiator goes away
+  int res;
+  while ((res = nfc_target_receive_bytes(pndTarget, abtData, sizeof(abtData), 0)) >= 0) {
+    if (nfc_target_send_bytes(pndTarget, abtData, (size_t) res, 0) < 0)
+      break;
+  }
+  return NULL;
+}
+
+static void
+bench_dep(const char *pcConnstring)
+{
+  pthread_t thread;
+
+  pndTarget = nfc_open(context, pcConnstring);
+  if (pndTarget == NULL) {
+    ERR("Unable to open target device %s", pcConnstring);
+    return;
+  }
+  if (pthread_create(&thread, NULL, dep_target_thread, NULL) != 0) {
+    ERR("pthread_create");
+    nfc_close(pndTarget);
+    return;
+  }
+
+  // Give the target some time to be ready
+  int res = 0;
+  for (int n = 0; n < 10; n++) {
+    if ((res = nfc_initiator_select_dep_target(pnd, NDM_PASSIVE, NBR_424, NULL, &nt, 1000)) > 0)
+      break;
+  }
+  if (res > 0) {
+    for (size_t n = 0; n < sizeof(aszExchangeSizes) / sizeof(aszExchangeSizes[0]); n++)
+      bench_run("dep_exchange", aszExchangeSizes[n], op_exchange, NULL);
+    nfc_initiator_deselect_target(pnd);
+  } else {
+    ERR("No DEP target found on %s", pcConnstring);
+  }
+  // The target may still wait for an initiator, or for a frame
+  nfc_initiator_init(pnd);
+  nfc_abort_command(pndTarget);
+  pthread_join(thread, NULL);
+  nfc_close(pndTarget);
+}
+
+static void
+print_results(void)
+{
+  printf("%-20s %5s %5s %5s %8s %8s %8s %8s %8s %9s %9s %10s\n", "test", "size", "n", "err",
+         "min", "p50", "p90", "p99", "max", "mean", "stddev", "B/s");
+  for (size_t n = 0; n < szResults; n++) {
+    const struct bench_result *pr = &results[n];
+    printf("%-20s %5lu %5lu %5lu %8lu %8lu %8lu %8lu %8lu %9.1f %9.1f %10.0f\n", pr->pcName,
+           (unsigned long) pr->szSize, (unsigned long) pr->szSamples, (unsigned long) pr->szErrors,
+           (unsigned long) pr->ui64Min, (unsigned long) pr->ui64P50, (unsigned long) pr->ui64P90,
+           (unsigned long) pr->ui64P99, (unsigned long) pr->ui64Max, pr->dMean, pr->dStdDev, pr->dThroughput);
+  }
+  printf("(times in microseconds)\n");
+}
+
+static void
+print_json_string(const char *pc)
+{
+  putchar('"');
+  for (; *pc; pc++) {
+    if ((*pc == '"') || (*pc == '\\'))
+      printf("\\%c", *pc);
+    else if ((unsigned char) *pc < 0x20)
+      printf("\\u%04x", (unsigned int)(unsigned char) *pc);
+    else
+      putchar(*pc);
+  }
+  putchar('"');
+}
+
+static void
+print_results_json(const uint8_t *pbtFirmware, const int iFirmwareLen)
+{
+  printf("{\"libnfc\":");
+  print_json_string(nfc_version());
+  printf(",\"device\":");
+  print_json_string(nfc_device_get_name(pnd));
+  printf(",\"connstring\":");
+  print_json_string(nfc_device_get_connstring(pnd));
+  printf(",\"firmware\":\"");
+  for (int n = 0; n < iFirmwareLen; n++)
+    printf("%02x", pbtFirmware[n]);
+  printf("\",\"samples\":%lu,\"unit\":\"us\",\"results\":[", (unsigned long) szSamples);
+  for (size_t n = 0; n < szResults; n++) {
+    const struct bench_result *pr = &results[n];
+    printf("%s{\"test\":\"%s\",\"size\":%lu,\"samples\":%lu,\"errors\":%lu,"
+           "\"min\":%lu,\"p50\":%lu,\"p90\":%lu,\"p99\":%lu,\"max\":%lu,"
+           "\"mean\":%.1f,\"stddev\":%.1f,\"bytes_per_second\":%.0f}",
+           n ? "," : "", pr->pcName, (unsigned long) pr->szSize, (unsigned long) pr->szSamples, (unsigned long) pr->szErrors,
+           (unsigned long) pr->ui64Min, (unsigned long) pr->ui64P50, (unsigned long) pr->ui64P90,
+           (unsigned long) pr->ui64P99, (unsigned long) pr->ui64Max, pr->dMean, pr->dStdDev, pr->dThroughput);
+  }
+  printf("]}\n");
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-j] [-n samples] [-d connstring] [connstring]\n", progname);
+  printf("  -j\t\t print the results as JSON\n");
+  printf("  -n samples\t timed operations per test (default: %d)\n", DEFAULT_SAMPLES);
+  printf("  -d connstring\t second device, used as DEP target for the DEP throughput test\n");
+  printf("  connstring\t device to benchmark (default: the first one found)\n");
+  printf("A ISO14443A tag on the device enables the time-to-detect test, and the APDU\n");
+  printf("throughput test when the tag supports ISO/IEC 14443-4.\n");
+}
+
+int
+main(int argc, const char *argv[])
+{
+  bool    bJson = false;
+  const char *pcConnstring = NULL;
+  const char *pcTarget = NULL;
+
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else if (0 == strcmp(argv[arg], "-j")) {
+      bJson = true;
+    } else if ((0 == strcmp(argv[arg], "-n")) && (arg + 1 < argc)) {
+      szSamples = (size_t) strtoul(argv[++arg], NULL, 10);
+    } else if ((0 == strcmp(argv[arg], "-d")) && (arg + 1 < argc)) {
+      pcTarget = argv[++arg];
+    } else if ((argv[arg][0] != '-') && !pcConnstring) {
+      pcConnstring = argv[arg];
+    } else {
+      ERR("%s is not supported option.", argv[arg]);
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (szSamples == 0) {
+    ERR("At least one sample is needed");
+    exit(EXIT_FAILURE);
+  }
+  if ((pui64Samples = malloc(szSamples * sizeof(uint64_t))) == NULL) {
+    ERR("malloc");
+    exit(EXIT_FAILURE);
+  }
+
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+  pnd = nfc_open(context, pcConnstring);
+  if (pnd == NULL) {
+    ERR("Unable to open NFC device.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  if ((nfc_initiator_init(pnd) < 0) || (nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, false) < 0)) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  if (!bJson)
+    printf("NFC device: %s (%s)\n", nfc_device_get_name(pnd), nfc_device_get_connstring(pnd));
+
+  // Chip level round trips
+  uint8_t abtFirmware[8];
+  int iFirmwareLen = op_firmware_version(0);
+  if (iFirmwareLen > (int) sizeof(abtFirmware))
+    iFirmwareLen = sizeof(abtFirmware);
+  if (iFirmwareLen > 0)
+    memcpy(abtFirmware, abtRx, iFirmwareLen);
+  for (size_t n = 0; n < sizeof(aszEchoSizes) / sizeof(aszEchoSizes[0]); n++)
+    bench_run("diagnose_echo", aszEchoSizes[n], op_diagnose_echo, NULL);
+  bench_run("firmware_version", 0, op_firmware_version, NULL);
+  const int iRegLen = op_read_register(0);
+  if (iRegLen > 0) {
+    // RC-S360 has no status byte in front of the value
+    ui8Reload = abtRx[iRegLen - 1];
+    bench_run("read_register", 1, op_read_register, NULL);
+    bench_run("write_register", 1, op_write_register, NULL);
+  }
+
+  // RF: a tag must be present
+  if (op_detect(0) >= 0) {
+    nfc_initiator_deselect_target(pnd);
+    bench_run("time_to_detect", 0, op_detect, op_deselect);
+    if ((op_detect(0) >= 0) && (nt.nti.nai.btSak & 0x20)) {
+      for (size_t n = 0; n < sizeof(aszExchangeSizes) / sizeof(aszExchangeSizes[0]); n++)
+        bench_run("apdu_exchange", aszExchangeSizes[n], op_exchange, NULL);
+    }
+    nfc_initiator_deselect_target(pnd);
+  } else if (!bJson) {
+    printf("No ISO14443A tag found, RF tests skipped.\n");
+  }
+
+  if (pcTarget)
+    bench_dep(pcTarget);
+
+  if (bJson)
+    print_results_json(abtFirmware, iFirmwareLen);
+  else
+    print_results();
+
+  free(pui64Samples);
+  nfc_close(pnd);
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}
@@ -78,22 +78,14 @@
 static nfc_device *pnd;
 static nfc_context *context;
 static bool quiet_output = false;
-// Version of the emulated type4 tag:
-static int type4v = 2;
 
 #define SYMBOL_PARAM_fISO14443_4_PICC   0x20
 
-typedef enum { NONE, CC_FILE, NDEF_FILE } file;
-
 struct nfcforum_tag4_ndef_data {
   uint8_t *ndef_file;
   size_t   ndef_file_len;
 };
 
-struct nfcforum_tag4_state_machine_data {
-  file     current_file;
-};
-
 uint8_t nfcforum_capability_container[] = {
   0x00, 0x0F, /* CCLEN 15 bytes */
   0x20,       /* Mapping version 2.0, use option -1 to force v1.0 */
@@ -112,134 +104,6 @@ uint8_t nfcforum_capability_container[] = {
   0x00,       /* NDEF file write access condition */
 };
 
-/* C-ADPU offsets */
-#define CLA  0
-#define INS  1
-#define P1   2
-#define P2   3
-#define LC   4
-#define DATA 5
-
-#define ISO144434A_RATS 0xE0
-
-static int
-nfcforum_tag4_io(struct nfc_emulator *emulator, const uint8_t *data_in, const size_t data_in_len, uint8_t *data_out, const size_t data_out_len)
-{
-  int res = 0;
-
-  struct nfcforum_tag4_ndef_data *ndef_data = (struct nfcforum_tag4_ndef_data *)(emulator->user_data);
-  struct nfcforum_tag4_state_machine_data *state_machine_data = (struct nfcforum_tag4_state_machine_data *)(emulator->state_machine->data);
-
-  if (data_in_len == 0) {
-    // No input data, nothing to do
-    return res;
-  }
-
-  // Show transmitted command
-  if (!quiet_output) {
-    printf("    In: ");
-    print_hex(data_in, data_in_len);
-  }
-
-  if (data_in_len >= 4) {
-    if (data_in[CLA] != 0x00)
-      return -ENOTSUP;
-
-#define ISO7816_SELECT         0xA4
-#define ISO7816_READ_BINARY    0xB0
-#define ISO7816_UPDATE_BINARY  0xD6
-
-    switch (data_in[INS]) {
-      case ISO7816_SELECT:
-
-        switch (data_in[P1]) {
-          case 0x00: /* Select by ID */
-            if ((data_in[P2] | 0x0C) != 0x0C)
-              return -ENOTSUP;
-
-            const uint8_t ndef_capability_container[] = { 0xE1, 0x03 };
-            const uint8_t ndef_file[] = { 0xE1, 0x04 };
-            if ((data_in[LC] == sizeof(ndef_capability_container)) && (0 == memcmp(ndef_capability_container, data_in + DATA, data_in[LC]))) {
-              memcpy(data_out, "\x90\x00", res = 2);
-              state_machine_data->current_file = CC_FILE;
-            } else if ((data_in[LC] == sizeof(ndef_file)) && (0 == memcmp(ndef_file, data_in + DATA, data_in[LC]))) {
-              memcpy(data_out, "\x90\x00", res = 2);
-              state_machine_data->current_file = NDEF_FILE;
-            } else {
-              memcpy(data_out, "\x6a\x00", res = 2);
-              state_machine_data->current_file = NONE;
-            }
-
-            break;
-          case 0x04: /* Select by name */
-            if (data_in[P2] != 0x00)
-              return -ENOTSUP;
-
-            const uint8_t ndef_tag_application_name_v1[] = { 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x00 };
-            const uint8_t ndef_tag_application_name_v2[] = { 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01 };
-            if ((type4v == 1) && (data_in[LC] == sizeof(ndef_tag_application_name_v1)) && (0 == memcmp(ndef_tag_application_name_v1, data_in + DATA, data_in[LC])))
-              memcpy(data_out, "\x90\x00", res = 2);
-            else if ((type4v == 2) && (data_in[LC] == sizeof(ndef_tag_application_name_v2)) && (0 == memcmp(ndef_tag_application_name_v2, data_in + DATA, data_in[LC])))
-              memcpy(data_out, "\x90\x00", res = 2);
-            else
-              memcpy(data_out, "\x6a\x82", res = 2);
-
-            break;
-          default:
-            return -ENOTSUP;
-        }
-
-        break;
-      case ISO7816_READ_BINARY:
-        if ((size_t)(data_in[LC] + 2) > data_out_len) {
-          return -ENOSPC;
-        }
-        switch (state_machine_data->current_file) {
-          case NONE:
-            memcpy(data_out, "\x6a\x82", res = 2);
-            break;
-          case CC_FILE:
-            memcpy(data_out, nfcforum_capability_container + (data_in[P1] << 8) + data_in[P2], data_in[LC]);
-            memcpy(data_out + data_in[LC], "\x90\x00", 2);
-            res = data_in[LC] + 2;
-            break;
-          case NDEF_FILE:
-            memcpy(data_out, ndef_data->ndef_file + (data_in[P1] << 8) + data_in[P2], data_in[LC]);
-            memcpy(data_out + data_in[LC], "\x90\x00", 2);
-            res = data_in[LC] + 2;
-            break;
-        }
-        break;
-
-      case ISO7816_UPDATE_BINARY:
-        memcpy(ndef_data->ndef_file + (data_in[P1] << 8) + data_in[P2], data_in + DATA, data_in[LC]);
-        if ((data_in[P1] << 8) + data_in[P2] == 0) {
-          ndef_data->ndef_file_len = (ndef_data->ndef_file[0] << 8) + ndef_data->ndef_file[1] + 2;
-        }
-        memcpy(data_out, "\x90\x00", res = 2);
-        break;
-      default: // Unknown
-        if (!quiet_output) {
-          printf("Cadre inconnu, avortement de la cible émulée.\n");
-        }
-        res = -ENOTSUP;
-    }
-  } else {
-    res = -ENOTSUP;
-  }
-
-  // Show transmitted command
-  if (!quiet_output) {
-    if (res < 0) {
-      ERR("%s (%d)", strerror(-res), -res);
-    } else {
-      printf("    Out: ");
-      print_hex(data_out, res);
-    }
-  }
-  return res;
-}
-
 static void stop_emulation(int sig)
 {
   (void) sig;
@@ -293,6 +157,8 @@ static int
 ndef_message_save(char *filename, struct nfcforum_tag4_ndef_data *tag_data)
 {
   FILE *F;
+  // The initiator may have written a new NLEN
+  tag_data->ndef_file_len = (tag_data->ndef_file[0] << 8) + tag_data->ndef_file[1] + 2;
   if (!(F = fopen(filename, "w"))) {
     printf("fopen (%s, w)\n", filename);
     return -1;
@@ -311,8 +177,9 @@ ndef_message_save(char *filename, struct nfcforum_tag4_ndef_data *tag_data)
 static void
 usage(char *progname)
 {
-  fprintf(stderr, "usage: %s [-1] [infile [outfile]]\n", progname);
+  fprintf(stderr, "usage: %s [-1] [-m image] [infile [outfile]]\n", progname);
   fprintf(stderr, "      -1: force Tag Type 4 v1.0 (v2.0 par défaut)\n");
+  fprintf(stderr, "      -m: fichier NDEF (NLEN et message) projeté en mémoire, les écritures y sont faites en place\n");
 }
 
 int
@@ -349,13 +216,34 @@ main(int argc, char *argv[])
     .ndef_file_len = ndef_file[1] + 2,
   };
 
-  struct nfcforum_tag4_state_machine_data state_machine_data = {
-    .current_file = NONE,
+  struct nfc_emulation_file application = {
+    .name = { 0xD2, 0x76, 0x00, 0x00, 0x85, 0x01, 0x01 },
+    .name_len = 7,
+    .by_name = true,
   };
 
+  struct nfc_emulation_file capability_container_file = {
+    .name = { 0xE1, 0x03 },
+    .name_len = 2,
+    .content = nfcforum_capability_container,
+    .size = sizeof(nfcforum_capability_container),
+    .writable = false,
+  };
+
+  struct nfc_emulation_file ndef_data_file = {
+    .name = { 0xE1, 0x04 },
+    .name_len = 2,
+    .content = ndef_file,
+    .size = sizeof(ndef_file),
+    .writable = true,
+  };
+
+  struct nfc_emulation_storage storage = { .data = NULL, .fd = -1 };
+  struct nfc_emulation_dispatcher dispatcher;
+
   struct nfc_emulation_state_machine state_machine = {
-    .io   = nfcforum_tag4_io,
-    .data = &state_machine_data,
+    .io   = nfc_emulation_dispatch,
+    .data = &dispatcher,
   };
 
   struct nfc_emulator emulator = {
@@ -370,11 +258,25 @@ main(int argc, char *argv[])
   }
 
   if ((argc > (1 + options)) && (0 == strcmp("-1", argv[1 + options]))) {
-    type4v = 1;
     nfcforum_capability_container[2] = 0x10;
+    application.name[6] = 0x00;
     options += 1;
   }
 
+  // The NDEF file lives in the image file: what the initiator writes is kept, without a final save
+  if ((argc > (2 + options)) && (0 == strcmp("-m", argv[1 + options]))) {
+    if (nfc_emulation_storage_open(&storage, argv[2 + options], ndef_file, sizeof(ndef_file), 0) < 0) {
+      printf("Impossible de projeter le fichier '%s'\n", argv[2 + options]);
+      exit(EXIT_FAILURE);
+    }
+    ndef_data_file.content = storage.data;
+    ndef_data_file.size = storage.size;
+    ndef_data_file.storage = &storage;
+    nfcforum_tag4_data.ndef_file = storage.data;
+    nfcforum_tag4_data.ndef_file_len = (storage.data[0] << 8) + storage.data[1] + 2;
+    options += 2;
+  }
+
   if (argc > (3 + options)) {
     usage(argv[0]);
     exit(EXIT_FAILURE);
@@ -384,10 +286,20 @@ main(int argc, char *argv[])
   if (argc >= (2 + options)) {
     if (ndef_message_load(argv[1 + options], &nfcforum_tag4_data) < 0) {
       printf("Impossible de chargezr le fichier NDEF '%s'\n", argv[1 + options]);
+      nfc_emulation_storage_close(&storage);
       exit(EXIT_FAILURE);
     }
   }
 
+  nfc_emulation_dispatcher_init(&dispatcher);
+  if ((nfc_emulation_dispatcher_add_file(&dispatcher, &application) < 0) ||
+      (nfc_emulation_dispatcher_add_file(&dispatcher, &capability_container_file) < 0) ||
+      (nfc_emulation_dispatcher_add_file(&dispatcher, &ndef_data_file) < 0) ||
+      (nfc_emulation_dispatcher_build(&dispatcher) < 0)) {
+    ERR("Impossible de construire l'émulateur");
+    exit(EXIT_FAILURE);
+  }
+
   nfc_init(&context);
   if (context == NULL) {
     ERR("Impossible d'initier libnfc (malloc)\n");
@@ -408,8 +320,13 @@ main(int argc, char *argv[])
   printf("Support NFC: %s ouvert\n", nfc_device_get_name(pnd));
   printf("EMulation du tag NDEF en cours, veuillez le toucher avec un second périphérique NFC\n");
 
-  if (0 != nfc_emulate_target(pnd, &emulator, 0)) {  // contains already nfc_target_init() call
+  int res = nfc_emulate_target(pnd, &emulator, 0);  // contains already nfc_target_init() call
+  if (!quiet_output) {
+    print_emulation_report(&dispatcher);
+  }
+  if (0 != res) {
     nfc_perror(pnd, "nfc_emulate_target");
+    nfc_emulation_storage_close(&storage);
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
@@ -418,12 +335,14 @@ main(int argc, char *argv[])
   if (argc == (3 + options)) {
     if (ndef_message_save(argv[2 + options], &nfcforum_tag4_data) < 0) {
       printf("Impossible d'enregistrer le fichier NDEF '%s'", argv[2 + options]);
+      nfc_emulation_storage_close(&storage);
       nfc_close(pnd);
       nfc_exit(context);
       exit(EXIT_FAILURE);
     }
   }
 
+  nfc_emulation_storage_close(&storage);
   nfc_close(pnd);
   nfc_exit(context);
   exit(EXIT_SUCCESS);
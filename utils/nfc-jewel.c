@@ -60,139 +60,68 @@
 
 static nfc_device *pnd;
 static nfc_target nt;
-static jewel_req req;
-static jewel_res res;
-static jewel_tag ttDump;
-static uint32_t uiBlocks = 0x0E;
-static uint32_t uiBytesPerBlock = 0x08;
+static jewel_memory jm;
+static uint8_t abtDump[JEWEL_MEMORY_MAX_SIZE];
+static size_t szDump;
 
 static const nfc_modulation nmJewel = {
   .nmt = NMT_JEWEL,
   .nbr = NBR_106,
 };
 
-static void
-print_success_or_failure(bool bFailure, uint32_t *uiCounter)
-{
-  printf("%c", (bFailure) ? 'x' : '.');
-  if (uiCounter)
-    *uiCounter += (bFailure) ? 0 : 1;
-}
-
 static  bool
 read_card(void)
 {
-  uint32_t   block;
-  uint32_t   byte;
-  bool      bFailure = false;
-  uint32_t uiReadBlocks = 0;
-
-  printf("Lecture de %d blocs |", uiBlocks + 1);
-
-  for (block = 0; block <= uiBlocks; block++) {
-    for (byte = 0; byte < uiBytesPerBlock; byte++) {
-
-      // Try to read the byte
-      req.read.btCmd = TC_READ;
-      req.read.btAdd = (block << 3) + byte;
-      if (nfc_initiator_jewel_cmd(pnd, req, &res)) {
-        ttDump.ttd.abtData[(block << 3) + byte] = res.read.btDat;
-      } else {
-        bFailure = true;
-        break;
-      }
-    }
+  printf("Lecture de la carte |");
+  fflush(stdout);
 
-    print_success_or_failure(bFailure, &uiReadBlocks);
-    fflush(stdout);
+  if (!jewel_memory_read(pnd, &jm)) {
+    printf("x|\n");
+    return false;
   }
-  printf("|\n");
-  printf("Fait, %d blocs sur %d lus.\n", uiReadBlocks, uiBlocks + 1);
+  printf("%s|\n", jewel_memory_is_dynamic(&jm) ? "RALL+RSEG" : "RALL");
+  printf("Fait, %lu octets lus en %lu commandes.\n", (unsigned long) jm.szSize, jm.ulCommands);
 
-  return (!bFailure);
+  return true;
 }
 
 static  bool
 write_card(void)
 {
-  uint32_t block;
-  uint32_t byte;
-  bool     bFailure = false;
-  uint32_t uiWrittenBlocks = 0;
-  uint32_t uiSkippedBlocks = 0;
-  uint32_t uiPartialBlocks = 0;
-
   char    buffer[BUFSIZ];
-  bool    write_otp;
-  bool    write_lock;
+  int     iFlags = 0;
+  unsigned long ulCommands = jm.ulCommands;
 
   printf("Write Lock bytes ? [yN] ");
   if (!fgets(buffer, BUFSIZ, stdin)) {
     ERR("Impossible de lire l'entrée standard.");
   }
-  write_lock = ((buffer[0] == 'y') || (buffer[0] == 'Y'));
+  if ((buffer[0] == 'y') || (buffer[0] == 'Y'))
+    iFlags |= JEWEL_WRITE_LOCK;
 
   printf("Write OTP bytes ? [yN] ");
   if (!fgets(buffer, BUFSIZ, stdin)) {
     ERR("Impossible de lire l'entrée standard.");
   }
-  write_otp = ((buffer[0] == 'y') || (buffer[0] == 'Y'));
-
-  printf("Ecriture de %d pages |", uiBlocks + 1);
+  if ((buffer[0] == 'y') || (buffer[0] == 'Y'))
+    iFlags |= JEWEL_WRITE_OTP;
 
-  // Skip block 0 - as far as I know there are no Jewel tags with block 0 writeable
-  printf("s");
-  uiSkippedBlocks++;
+  printf("Ecriture des octets modifiés |");
 
-  for (block = uiSkippedBlocks; block <= uiBlocks; block++) {
-    // Skip block 0x0D - it is reserved for internal use and can't be written
-    if (block == 0x0D) {
-      printf("s");
-      uiSkippedBlocks++;
-      continue;
-    }
-    // Skip block 0X0E if lock-bits and OTP shouldn't be written
-    if ((block == 0x0E) && (!write_lock) && (!write_otp)) {
-      printf("s");
-      uiSkippedBlocks++;
-      continue;
-    }
-    // Write block 0x0E partially if lock-bits or OTP shouldn't be written
-    if ((block == 0x0E) && (!write_lock || !write_otp)) {
-      printf("p");
-      uiPartialBlocks++;
-    }
-
-    for (byte = 0; byte < uiBytesPerBlock; byte++) {
-      if ((block == 0x0E) && (byte == 0 || byte == 1) && (!write_lock)) {
-        continue;
-      }
-      if ((block == 0x0E) && (byte > 1) && (!write_otp)) {
-        continue;
-      }
-
-      // Show if the readout went well
-      if (bFailure) {
-        // When a failure occured we need to redo the anti-collision
-        if (nfc_initiator_select_passive_target(pnd, nmJewel, NULL, 0, &nt) <= 0) {
-          ERR("le support à été retiré");
-          return false;
-        }
-        bFailure = false;
-      }
-
-      req.writee.btCmd = TC_WRITEE;
-      req.writee.btAdd = (block << 3) + byte;
-      req.writee.btDat = ttDump.ttd.abtData[(block << 3) + byte];
-      if (!nfc_initiator_jewel_cmd(pnd, req, &res)) {
-        bFailure = true;
-      }
-    }
-    print_success_or_failure(bFailure, &uiWrittenBlocks);
+  // Only what differs from the card content is written, a retry resumes where the failure occured
+  int iRetries = 3;
+  while (!jewel_memory_write(pnd, &jm, iFlags)) {
+    printf("x");
     fflush(stdout);
+    // When a failure occured we need to redo the anti-collision
+    if ((--iRetries == 0) || (nfc_initiator_select_passive_target(pnd, nmJewel, NULL, 0, &nt) <= 0)) {
+      printf("|\n");
+      ERR("le support à été retiré");
+      return false;
+    }
   }
-  printf("|\n");
-  printf("Fait, %d blocs sur %d écrits (%d blocs partiels, %d blocs sautés).\n", uiWrittenBlocks, uiBlocks + 1, uiPartialBlocks, uiSkippedBlocks);
+  printf(".|\n");
+  printf("Fait, %lu commandes d'écriture.\n", jm.ulCommands - ulCommands);
 
   return true;
 }
@@ -217,9 +146,7 @@ main(int argc, const char *argv[])
 
   bReadAction = tolower((int)((unsigned char) * (argv[1])) == 'r');
 
-  if (bReadAction) {
-    memset(&ttDump, 0x00, sizeof(ttDump));
-  } else {
+  if (!bReadAction) {
     pfDump = fopen(argv[2], "rb");
 
     if (pfDump == NULL) {
@@ -227,7 +154,9 @@ main(int argc, const char *argv[])
       exit(EXIT_FAILURE);
     }
 
-    if (fread(&ttDump, 1, sizeof(ttDump), pfDump) != sizeof(ttDump)) {
+    // Topaz 96 dumps are 120 bytes long, dynamic memory tags dumps are larger
+    szDump = fread(abtDump, 1, sizeof(abtDump), pfDump);
+    if (szDump < JEWEL_STATIC_SIZE) {
       ERR("Impossible de lire le dump: %s\n", argv[2]);
       fclose(pfDump);
       exit(EXIT_FAILURE);
@@ -284,28 +213,39 @@ main(int argc, const char *argv[])
   }
   printf("\n");
 
+  if (!read_card()) {
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
   if (bReadAction) {
-    if (read_card()) {
-      printf("Ecriture des données dans le fichier: %s ... ", argv[2]);
-      fflush(stdout);
-      pfDump = fopen(argv[2], "wb");
-      if (pfDump == NULL) {
-        printf("Impossible d'ouvrir le fichier: %s\n", argv[2]);
-        nfc_close(pnd);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      if (fwrite(&ttDump, 1, sizeof(ttDump), pfDump) != sizeof(ttDump)) {
-        printf("Impossible d'écrire dans le fichier: %s\n", argv[2]);
-        fclose(pfDump);
-        nfc_close(pnd);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
+    printf("Ecriture des données dans le fichier: %s ... ", argv[2]);
+    fflush(stdout);
+    pfDump = fopen(argv[2], "wb");
+    if (pfDump == NULL) {
+      printf("Impossible d'ouvrir le fichier: %s\n", argv[2]);
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+    if (fwrite(jm.abtData, 1, jm.szSize, pfDump) != jm.szSize) {
+      printf("Impossible d'écrire dans le fichier: %s\n", argv[2]);
       fclose(pfDump);
-      printf("Fait.\n");
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
     }
+    fclose(pfDump);
+    printf("Fait.\n");
   } else {
+    if (szDump != jm.szSize) {
+      ERR("Le dump (%lu octets) ne correspond pas à la carte (%lu octets)\n", (unsigned long) szDump, (unsigned long) jm.szSize);
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+    memcpy(jm.abtData, abtDump, szDump);
     write_card();
   }
 
@@ -60,122 +60,82 @@
 
 static nfc_device *pnd;
 static nfc_target nt;
-static mifare_param mp;
-static mifareul_tag mtDump;
-static uint32_t uiBlocks = 0xF;
+static mifareul_memory mm;
+static uint8_t abtDump[MIFAREUL_MAX_PAGES * MIFAREUL_PAGE_SIZE];
+static size_t szDump;
 
 static const nfc_modulation nmMifare = {
   .nmt = NMT_ISO14443A,
   .nbr = NBR_106,
 };
 
-static void
-print_success_or_failure(bool bFailure, uint32_t *uiCounter)
-{
-  printf("%c", (bFailure) ? 'x' : '.');
-  if (uiCounter)
-    *uiCounter += (bFailure) ? 0 : 1;
-}
-
 static  bool
 read_card(void)
 {
-  uint32_t page;
-  bool    bFailure = false;
-  uint32_t uiReadedPages = 0;
-
-  printf("Lecture de %d pages |", uiBlocks + 1);
-
-  for (page = 0; page <= uiBlocks; page += 4) {
-    // Try to read out the data block
-    if (nfc_initiator_mifare_cmd(pnd, MC_READ, page, &mp)) {
-      memcpy(mtDump.amb[page / 4].mbd.abtData, mp.mpd.abtData, 16);
-    } else {
-      bFailure = true;
-      break;
-    }
+  printf("Lecture de %lu pages |", (unsigned long) mm.szPages);
+  fflush(stdout);
 
-    print_success_or_failure(bFailure, &uiReadedPages);
-    print_success_or_failure(bFailure, &uiReadedPages);
-    print_success_or_failure(bFailure, &uiReadedPages);
-    print_success_or_failure(bFailure, &uiReadedPages);
+  if (!mifareul_memory_read(pnd, &mm)) {
+    printf("x|\n");
+    return false;
   }
-  printf("|\n");
-  printf("Fait, %d pages sur %d lus.\n", uiReadedPages, uiBlocks + 1);
+  printf(".|\n");
+  printf("Fait, %lu pages lues en %lu commandes.\n", (unsigned long) mm.szPages, mm.ulCommands);
   fflush(stdout);
 
-  return (!bFailure);
+  return true;
 }
 
 static  bool
 write_card(void)
 {
-  uint32_t uiBlock = 0;
-  bool    bFailure = false;
-  uint32_t uiWritenPages = 0;
-  uint32_t uiSkippedPages = 0;
-
   char    buffer[BUFSIZ];
-  bool    write_otp;
-  bool    write_lock;
-  bool    write_uid;
+  int     iFlags = 0;
+  unsigned long ulCommands = mm.ulCommands;
 
   printf("Write OTP bytes ? [yN] ");
   if (!fgets(buffer, BUFSIZ, stdin)) {
     ERR("Impossible de lire l'entrée standard.");
   }
-  write_otp = ((buffer[0] == 'y') || (buffer[0] == 'Y'));
+  if ((buffer[0] == 'y') || (buffer[0] == 'Y'))
+    iFlags |= MIFAREUL_WRITE_OTP;
   printf("Write Lock bytes ? [yN] ");
   if (!fgets(buffer, BUFSIZ, stdin)) {
     ERR("Impossible de lire l'entrée standard.");
   }
-  write_lock = ((buffer[0] == 'y') || (buffer[0] == 'Y'));
+  if ((buffer[0] == 'y') || (buffer[0] == 'Y'))
+    iFlags |= MIFAREUL_WRITE_LOCK;
   printf("Write UID bytes (only for special writeable UID cards) ? [yN] ");
   if (!fgets(buffer, BUFSIZ, stdin)) {
     ERR("Impossible de lire l'entrée standard.");
   }
-  write_uid = ((buffer[0] == 'y') || (buffer[0] == 'Y'));
-
-  printf("Ecriture de %d pages |", uiBlocks + 1);
-  /* We may need to skip 2 first pages. */
-  if (!write_uid) {
-    printf("ss");
-    uiSkippedPages = 2;
+  if ((buffer[0] == 'y') || (buffer[0] == 'Y'))
+    iFlags |= MIFAREUL_WRITE_UID;
+  if (mm.szConfigPage < mm.szPages) {
+    printf("Write configuration pages (dynamic lock, password, keys) ? [yN] ");
+    if (!fgets(buffer, BUFSIZ, stdin)) {
+      ERR("Impossible de lire l'entrée standard.");
+    }
+    if ((buffer[0] == 'y') || (buffer[0] == 'Y'))
+      iFlags |= MIFAREUL_WRITE_CONFIG;
   }
 
-  for (int page = uiSkippedPages; page <= 0xF; page++) {
-    if ((page == 0x2) && (!write_lock)) {
-      printf("s");
-      uiSkippedPages++;
-      continue;
-    }
-    if ((page == 0x3) && (!write_otp)) {
-      printf("s");
-      uiSkippedPages++;
-      continue;
+  printf("Ecriture des pages modifiées |");
+
+  // Only the pages which differ from the card content are written, a retry resumes where the failure occured
+  int iRetries = 3;
+  while (!mifareul_memory_write(pnd, &mm, iFlags)) {
+    printf("x");
+    fflush(stdout);
+    // When a failure occured we need to redo the anti-collision
+    if ((--iRetries == 0) || (nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0)) {
+      printf("|\n");
+      ERR("le tag a été retiré");
+      return false;
     }
-    // Show if the readout went well
-    if (bFailure) {
-      // When a failure occured we need to redo the anti-collision
-      if (nfc_initiator_select_passive_target(pnd, nmMifare, NULL, 0, &nt) <= 0) {
-        ERR("le tag a été retiré");
-        return false;
-      }
-      bFailure = false;
-    }
-    // For the Mifare Ultralight, this write command can be used
-    // in compatibility mode, which only actually writes the first
-    // page (4 bytes). The Ultralight-specific Write command only
-    // writes one page at a time.
-    uiBlock = page / 4;
-    memcpy(mp.mpd.abtData, mtDump.amb[uiBlock].mbd.abtData + ((page % 4) * 4), 16);
-    if (!nfc_initiator_mifare_cmd(pnd, MC_WRITE, page, &mp))
-      bFailure = true;
-
-    print_success_or_failure(bFailure, &uiWritenPages);
   }
-  printf("|\n");
-  printf("Fait, %d pages sur %d écrites (%d pages sautées).\n", uiWritenPages, uiBlocks + 1, uiSkippedPages);
+  printf(".|\n");
+  printf("Fait, %lu pages écrites.\n", mm.ulCommands - ulCommands);
 
   return true;
 }
@@ -200,9 +160,7 @@ main(int argc, const char *argv[])
 
   bReadAction = tolower((int)((unsigned char) * (argv[1])) == 'r');
 
-  if (bReadAction) {
-    memset(&mtDump, 0x00, sizeof(mtDump));
-  } else {
+  if (!bReadAction) {
     pfDump = fopen(argv[2], "rb");
 
     if (pfDump == NULL) {
@@ -210,7 +168,9 @@ main(int argc, const char *argv[])
       exit(EXIT_FAILURE);
     }
 
-    if (fread(&mtDump, 1, sizeof(mtDump), pfDump) != sizeof(mtDump)) {
+    // The dump size is the one of the tag memory: 64 bytes for an Ultralight, up to 924 bytes for a NTAG216
+    szDump = fread(abtDump, 1, sizeof(abtDump), pfDump);
+    if ((szDump < sizeof(mifareul_tag)) || (szDump % MIFAREUL_PAGE_SIZE)) {
       ERR("Impossible de lire le dump: %s\n", argv[2]);
       fclose(pfDump);
       exit(EXIT_FAILURE);
@@ -266,36 +226,53 @@ main(int argc, const char *argv[])
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
+  if (!mifareul_memory_detect(pnd, &nt, &mm)) {
+    ERR("impossible d'identifier le tag\n");
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
   // Get the info from the current tag
-  printf("Carte MIFARE Ultralight trouvée avec l'UID: ");
+  printf("Carte %s trouvée avec l'UID: ", mm.pcName);
   size_t  szPos;
   for (szPos = 0; szPos < nt.nti.nai.szUidLen; szPos++) {
     printf("%02x", nt.nti.nai.abtUid[szPos]);
   }
   printf("\n");
 
+  if (!read_card()) {
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
   if (bReadAction) {
-    if (read_card()) {
-      printf("Ecriture des données dans le fichier: %s ... ", argv[2]);
-      fflush(stdout);
-      pfDump = fopen(argv[2], "wb");
-      if (pfDump == NULL) {
-        printf("Impossible d'ouvrir le fichier: %s\n", argv[2]);
-        nfc_close(pnd);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
-      if (fwrite(&mtDump, 1, sizeof(mtDump), pfDump) != sizeof(mtDump)) {
-        printf("Impossible d'écrire dans le fichier: %s\n", argv[2]);
-        fclose(pfDump);
-        nfc_close(pnd);
-        nfc_exit(context);
-        exit(EXIT_FAILURE);
-      }
+    printf("Ecriture des données dans le fichier: %s ... ", argv[2]);
+    fflush(stdout);
+    pfDump = fopen(argv[2], "wb");
+    if (pfDump == NULL) {
+      printf("Impossible d'ouvrir le fichier: %s\n", argv[2]);
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+    if (fwrite(mm.abtData, 1, mm.szPages * MIFAREUL_PAGE_SIZE, pfDump) != mm.szPages * MIFAREUL_PAGE_SIZE) {
+      printf("Impossible d'écrire dans le fichier: %s\n", argv[2]);
       fclose(pfDump);
-      printf("Fait.\n");
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
     }
+    fclose(pfDump);
+    printf("Fait.\n");
   } else {
+    if (szDump != mm.szPages * MIFAREUL_PAGE_SIZE) {
+      ERR("Le dump (%lu octets) ne correspond pas à la carte (%lu octets)\n", (unsigned long) szDump, (unsigned long)(mm.szPages * MIFAREUL_PAGE_SIZE));
+      nfc_close(pnd);
+      nfc_exit(context);
+      exit(EXIT_FAILURE);
+    }
+    memcpy(mm.abtData, abtDump, szDump);
     write_card();
   }
 
@@ -61,6 +61,7 @@
 #include <nfc/nfc.h>
 
 #include "nfc-utils.h"
+#include "felica.h"
 
 #if defined(WIN32) && defined(__GNUC__) /* mingw compiler */
 #include <getopt.h>
@@ -90,80 +91,6 @@ static void stop_select(int sig)
   }
 }
 
-static void
-build_felica_frame(const nfc_felica_info nfi, const uint8_t command, const uint8_t *payload, const size_t payload_len, uint8_t *frame, size_t *frame_len)
-{
-  frame[0] = 1 + 1 + 8 + payload_len;
-  *frame_len = frame[0];
-  frame[1] = command;
-  memcpy(frame + 2, nfi.abtId, 8);
-  memcpy(frame + 10, payload, payload_len);
-}
-
-#define CHECK 0x06
-static int
-nfc_forum_tag_type3_check(nfc_device *dev, const nfc_target *nt, const uint16_t block, const uint8_t block_count, uint8_t *data, size_t *data_len)
-{
-  uint8_t payload[1024] = {
-    1, // Services
-    0x0B, 0x00, // NFC Forum Tag Type 3's Service code
-    block_count,
-    0x80, block, // block 0
-  };
-
-  size_t payload_len = 1 + 2 + 1;
-  for (uint8_t b = 0; b < block_count; b++) {
-    if (block < 0x100) {
-      payload[payload_len++] = 0x80;
-      payload[payload_len++] = block + b;
-    } else {
-      payload[payload_len++] = 0x00;
-      payload[payload_len++] = (block + b) >> 8;
-      payload[payload_len++] = (block + b) & 0xff;
-    }
-  }
-
-  uint8_t frame[1024];
-  size_t frame_len = sizeof(frame);
-  build_felica_frame(nt->nti.nfi, CHECK, payload, payload_len, frame, &frame_len);
-
-  uint8_t rx[1024];
-  int res;
-  if ((res = nfc_initiator_transceive_bytes(dev, frame, frame_len, rx, sizeof(rx), 0)) < 0) {
-    return res;
-  }
-
-  const int res_overhead = 1 + 1 + 8 + 2;  // 1+1+8+2: LEN + CMD + NFCID2 + STATUS
-  if (res < res_overhead) {
-    // Not enough data
-    return -1;
-  }
-  uint8_t felica_res_len = rx[0];
-  if (res != felica_res_len) {
-    // Error while receiving felica frame
-    return -1;
-  }
-  if ((CHECK + 1) != rx[1]) {
-    // Command return does not match
-    return -1;
-  }
-  if (0 != memcmp(&rx[2], nt->nti.nfi.abtId, 8)) {
-    // NFCID2 does not match
-    return -1;
-  }
-  const uint8_t status_flag1 = rx[10];
-  const uint8_t status_flag2 = rx[11];
-  if ((status_flag1) || (status_flag2)) {
-    // Felica card's error
-    fprintf(stderr, "Status bytes: %02x, %02x\n", status_flag1, status_flag2);
-    return -1;
-  }
-  // const uint8_t res_block_count = res[12];
-  *data_len = res - res_overhead + 1; // +1 => block count is stored on 1 byte
-  memcpy(data, &rx[res_overhead + 1], *data_len);
-  return *data_len;
-}
-
 int
 main(int argc, char *argv[])
 {
@@ -292,25 +219,27 @@ main(int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  uint8_t data[1024];
-  size_t data_len = sizeof(data);
-
-  if (nfc_forum_tag_type3_check(pnd, &nt, 0, 1, data, &data_len) <= 0) {
-    nfc_perror(pnd, "nfc_forum_tag_type3_check");
+  // The attribute block gives the blocks per CHECK of the card, for the whole NDEF read
+  felica_card fc;
+  felica_t3t_attribute attr;
+  felica_card_init(&fc, &nt);
+  if (!felica_t3t_read_attribute(pnd, &fc, &attr)) {
+    nfc_perror(pnd, "felica_t3t_read_attribute");
     fclose(ndef_stream);
     nfc_close(pnd);
     nfc_exit(context);
     exit(EXIT_FAILURE);
   }
 
-  const int ndef_major_version = (data[0] & 0xf0) >> 4;
-  const int ndef_minor_version = (data[0] & 0x0f);
-  const int ndef_nbr = data[1];
-  const int ndef_nbw = data[2];
-  const int ndef_nmaxb = (data[3] << 8) + data[4];
-  const int ndef_writeflag = data[9];
-  const int ndef_rwflag = data[10];
-  uint32_t ndef_data_len = (data[11] << 16) + (data[12] << 8) + data[13];
+  const uint8_t *data = attr.abtBlock;
+  const int ndef_major_version = (attr.btVersion & 0xf0) >> 4;
+  const int ndef_minor_version = (attr.btVersion & 0x0f);
+  const int ndef_nbr = attr.btNbr;
+  const int ndef_nbw = attr.btNbw;
+  const int ndef_nmaxb = attr.ui16Nmaxb;
+  const int ndef_writeflag = attr.btWriteFlag;
+  const int ndef_rwflag = attr.btRwFlag;
+  uint32_t ndef_data_len = attr.ui32Ln;
   uint16_t ndef_calculated_checksum = 0;
   for (size_t n = 0; n < 14; n++)
     ndef_calculated_checksum += data[n];
@@ -370,24 +299,29 @@ main(int argc, char *argv[])
     exit(EXIT_FAILURE);
   }
 
-  const uint8_t block_max_per_check = data[1];
-  const uint16_t block_count_to_check = (ndef_data_len / 16) + 1;
-
-  data_len = 0;
-  for (uint16_t b = 0; b < ((block_count_to_check - 1) / block_max_per_check + 1); b += block_max_per_check) {
-    size_t size = sizeof(data) - data_len;
-    if (!nfc_forum_tag_type3_check(pnd, &nt, 1 + b, MIN(block_max_per_check, (block_count_to_check - (b * block_max_per_check))), data + data_len, &size)) {
-      nfc_perror(pnd, "nfc_forum_tag_type3_check");
-      fclose(ndef_stream);
-      nfc_close(pnd);
-      nfc_exit(context);
-      exit(EXIT_FAILURE);
-    }
-    data_len += size;
+  uint8_t *ndef_data = malloc(ndef_data_len);
+  if (!ndef_data) {
+    ERR("Impossible d'allouer %lu octets", (unsigned long) ndef_data_len);
+    fclose(ndef_stream);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  if (!felica_t3t_read_ndef(pnd, &fc, &attr, ndef_data)) {
+    nfc_perror(pnd, "felica_t3t_read_ndef");
+    free(ndef_data);
+    fclose(ndef_stream);
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  if (!quiet) {
+    fprintf(message_stream, "%lu commandes CHECK de %d blocs au plus\n", fc.ulCommands, fc.btNbr);
   }
 
-  if (fwrite(data, 1, ndef_data_len, ndef_stream) != ndef_data_len) {
+  if (fwrite(ndef_data, 1, ndef_data_len, ndef_stream) != ndef_data_len) {
     fprintf(stderr, "Erreur: impossible d'écrire dans le fichier.\n");
+    free(ndef_data);
     fclose(ndef_stream);
     nfc_close(pnd);
     nfc_exit(context);
@@ -398,6 +332,7 @@ main(int argc, char *argv[])
     }
   }
 
+  free(ndef_data);
   fclose(ndef_stream);
   nfc_close(pnd);
   nfc_exit(context);
@@ -0,0 +1,267 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+
+/**
+ * @file nfc-sniff.c
+ * @brief Passive sniffer: prints the frames exchanged by other devices
+ *
+ * The frames come from nfc_sniff() and go through a lock-free single
+ * producer, single consumer ring to a printing thread, so that a slow
+ * terminal does not slow down the draining of the chip FIFO: when the ring
+ * is full, frames are dropped and counted. At the end, the counters tell
+ * how well the transport (USB, UART, SPI, I2C) kept up with the chip.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+
+#define RING_SLOTS 1024       // power of two
+#define RING_FRAME_MAX 512
+
+struct ring_slot {
+  nfc_sniffed_frame nsf;
+  uint8_t abtData[RING_FRAME_MAX];
+};
+
+// Written by the sniffing thread only: uiHead; by the printing thread only: uiTail
+static struct ring_slot ring[RING_SLOTS];
+static unsigned int uiHead;
+static unsigned int uiTail;
+static uint64_t ui64Dropped;
+
+static volatile sig_atomic_t quitting = 0;
+static bool bQuiet = false;
+
+static void
+stop_sniffing(int sig)
+{
+  (void) sig;
+  quitting = 1;
+}
+
+static int
+ring_push(nfc_device *pnd, const nfc_sniffed_frame *pnf, void *data)
+{
+  (void) pnd;
+  (void) data;
+  const unsigned int uiTailNow = __atomic_load_n(&uiTail, __ATOMIC_ACQUIRE);
+  if ((uiHead - uiTailNow) == RING_SLOTS) {
+    ui64Dropped++;
+    return quitting;
+  }
+  struct ring_slot *ps = &ring[uiHead % RING_SLOTS];
+  ps->nsf = *pnf;
+  ps->nsf.len = (pnf->len < RING_FRAME_MAX) ? pnf->len : RING_FRAME_MAX;
+  memcpy(ps->abtData, pnf->data, ps->nsf.len);
+  ps->nsf.data = ps->abtData;
+  __atomic_store_n(&uiHead, uiHead + 1, __ATOMIC_RELEASE);
+  return quitting;
+}
+
+static volatile bool bSniffing = true;
+static uint64_t ui64First;
+
+static void *
+ring_print(void *arg)
+{
+  (void) arg;
+  for (;;) {
+    const unsigned int uiHeadNow = __atomic_load_n(&uiHead, __ATOMIC_ACQUIRE);
+    if (uiTail == uiHeadNow) {
+      if (!bSniffing)
+        break;
+      usleep(1000);
+      continue;
+    }
+    const struct ring_slot *ps = &ring[uiTail % RING_SLOTS];
+    if (!bQuiet) {
+      if (ui64First == 0)
+        ui64First = ps->nsf.timestamp_us;
+      printf("%10.6f %4lu bits%s%s%s: ", (ps->nsf.timestamp_us - ui64First) / 1e6, (unsigned long) ps->nsf.bits,
+             (ps->nsf.flags & NFC_SNIFF_ERROR) ? " error" : "", (ps->nsf.flags & NFC_SNIFF_OVERRUN) ? " overrun" : "",
+             (ps->nsf.flags & NFC_SNIFF_MERGED) ? " merged" : "");
+      for (size_t n = 0; n < ps->nsf.len; n++)
+        printf("%02x ", ps->abtData[n]);
+      printf("\n");
+    }
+    __atomic_store_n(&uiTail, uiTail + 1, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-i] [-b 106|212|424|847] [-f] [-t seconds] [-q] [connstring]\n", progname);
+  printf("  -i\t\t frames sent by initiators (default: frames sent by targets)\n");
+  printf("  -b baudrate\t baud rate (default: 106)\n");
+  printf("  -f\t\t FeliCa frames (default: ISO14443A)\n");
+  printf("  -t seconds\t stop after this duration (default: on Ctrl-C)\n");
+  printf("  -q\t\t print the counters only\n");
+  printf("  connstring\t device to sniff with (default: the first one found)\n");
+}
+
+int
+main(int argc, const char *argv[])
+{
+  nfc_context *context;
+  nfc_device *pnd;
+  nfc_modulation nm = { .nmt = NMT_ISO14443A, .nbr = NBR_106 };
+  nfc_mode nmFrom = N_TARGET;
+  const char *pcConnstring = NULL;
+  unsigned long ulSeconds = 0;
+
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else if (0 == strcmp(argv[arg], "-i")) {
+      nmFrom = N_INITIATOR;
+    } else if (0 == strcmp(argv[arg], "-f")) {
+      nm.nmt = NMT_FELICA;
+      if (nm.nbr == NBR_106)
+        nm.nbr = NBR_212;
+    } else if (0 == strcmp(argv[arg], "-q")) {
+      bQuiet = true;
+    } else if ((0 == strcmp(argv[arg], "-b")) && (arg + 1 < argc)) {
+      switch (strtoul(argv[++arg], NULL, 10)) {
+        case 106:
+          nm.nbr = NBR_106;
+          break;
+        case 212:
+          nm.nbr = NBR_212;
+          break;
+        case 424:
+          nm.nbr = NBR_424;
+          break;
+        case 847:
+          nm.nbr = NBR_847;
+          break;
+        default:
+          ERR("%s is not a supported baud rate.", argv[arg]);
+          exit(EXIT_FAILURE);
+      }
+    } else if ((0 == strcmp(argv[arg], "-t")) && (arg + 1 < argc)) {
+      ulSeconds = strtoul(argv[++arg], NULL, 10);
+    } else if ((argv[arg][0] != '-') && !pcConnstring) {
+      pcConnstring = argv[arg];
+    } else {
+      ERR("%s is not supported option.", argv[arg]);
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+  pnd = nfc_open(context, pcConnstring);
+  if (pnd == NULL) {
+    ERR("Unable to open NFC device.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  // Another reader provides the field
+  if ((nfc_initiator_init(pnd) < 0) || (nfc_device_set_property_bool(pnd, NP_ACTIVATE_FIELD, false) < 0)) {
+    nfc_perror(pnd, "nfc_initiator_init");
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+  printf("NFC device: %s sniffing %s frames sent by %s\n", nfc_device_get_name(pnd),
+         str_nfc_modulation_type(nm.nmt), (nmFrom == N_TARGET) ? "targets" : "initiators");
+  fflush(stdout);
+
+  signal(SIGINT, stop_sniffing);
+  pthread_t printer;
+  if (pthread_create(&printer, NULL, ring_print, NULL) != 0) {
+    ERR("Unable to start the printing thread");
+    nfc_close(pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  // One second slices, so that Ctrl-C is seen even when nothing is received
+  nfc_sniff_stats total, slice;
+  memset(&total, 0, sizeof(total));
+  int res = 0;
+  for (unsigned long ulSlice = 0; !quitting && ((ulSeconds == 0) || (ulSlice < ulSeconds)); ulSlice++) {
+    if ((res = nfc_sniff(pnd, nm, nmFrom, ring_push, NULL, 1000, &slice)) < 0)
+      break;
+    total.polls += slice.polls;
+    total.frames += slice.frames;
+    total.bytes += slice.bytes;
+    total.errors += slice.errors;
+    total.merged += slice.merged;
+    total.overruns += slice.overruns;
+    total.elapsed_us += slice.elapsed_us;
+    if (slice.peak_fifo_level > total.peak_fifo_level)
+      total.peak_fifo_level = slice.peak_fifo_level;
+  }
+  bSniffing = false;
+  pthread_join(printer, NULL);
+  if (res < 0)
+    nfc_perror(pnd, "nfc_sniff");
+
+  printf("%" PRIu64 " polls", total.polls);
+  if (total.polls)
+    printf(" (every %.0f us)", (double) total.elapsed_us / total.polls);
+  printf(", %" PRIu64 " frames, %" PRIu64 " bytes, %" PRIu64 " with errors, %" PRIu64 " merged\n", total.frames, total.bytes,
+         total.errors, total.merged);
+  printf("%" PRIu64 " FIFO overruns, peak FIFO level %lu/64, %" PRIu64 " frames dropped by the printing thread\n",
+         total.overruns, (unsigned long) total.peak_fifo_level, ui64Dropped);
+
+  nfc_close(pnd);
+  nfc_exit(context);
+  exit((res < 0) ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,309 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfc-stats.c
+ * @brief Exports the counters of the NFC devices in Prometheus text format
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+
+#define MAX_DEVICE_COUNT 16
+#define MAX_TARGET_COUNT 16
+
+static nfc_device *pnds[MAX_DEVICE_COUNT];
+static nfc_device_stats stats[MAX_DEVICE_COUNT];
+static size_t szDevices;
+
+static void
+print_usage(const char *argv[])
+{
+  printf("Usage: %s [OPTIONS]\n", argv[0]);
+  printf("Options:\n");
+  printf("\t-h\tAfficher ce message d'aide.\n");
+  printf("\t-p N\tChercher des tags N fois sur chaque support avant l'export.\n");
+  printf("\t-i S\tRecommencer toutes les S secondes, sans fin.\n");
+  printf("\t-o FILE\tEcrire l'export dans FILE (remplacé atomiquement) au lieu de la sortie standard.\n");
+}
+
+// Label values are quoted: backslashes, double quotes and newlines must be escaped
+static void
+print_label(FILE *f, const char *pcName, const char *pcValue)
+{
+  fprintf(f, "%s=\"", pcName);
+  for (; *pcValue; pcValue++) {
+    if (*pcValue == '\n') {
+      fputs("\\n", f);
+    } else {
+      if ((*pcValue == '\\') || (*pcValue == '"'))
+        fputc('\\', f);
+      fputc(*pcValue, f);
+    }
+  }
+  fputc('"', f);
+}
+
+static void
+print_device_labels(FILE *f, const size_t szDevice)
+{
+  print_label(f, "device", nfc_device_get_name(pnds[szDevice]));
+  fputc(',', f);
+  print_label(f, "connstring", nfc_device_get_connstring(pnds[szDevice]));
+}
+
+static void
+print_family(FILE *f, const char *pcName, const char *pcType, const char *pcHelp)
+{
+  fprintf(f, "# HELP %s %s\n", pcName, pcHelp);
+  fprintf(f, "# TYPE %s %s\n", pcName, pcType);
+}
+
+static void
+print_device_counter(FILE *f, const char *pcName, const char *pcHelp, const size_t szOffset)
+{
+  print_family(f, pcName, "counter", pcHelp);
+  for (size_t n = 0; n < szDevices; n++) {
+    fprintf(f, "%s{", pcName);
+    print_device_labels(f, n);
+    fprintf(f, "} %" PRIu64 "\n", *(const uint64_t *)((const uint8_t *)&stats[n] + szOffset));
+  }
+}
+
+static void
+print_stats(FILE *f)
+{
+  print_device_counter(f, "nfc_tx_frames_total", "Frames sent to the chip.", offsetof(nfc_device_stats, tx_frames));
+  print_device_counter(f, "nfc_tx_bytes_total", "Payload bytes sent to the chip.", offsetof(nfc_device_stats, tx_bytes));
+  print_device_counter(f, "nfc_rx_frames_total", "Frames received from the chip.", offsetof(nfc_device_stats, rx_frames));
+  print_device_counter(f, "nfc_rx_bytes_total", "Payload bytes received from the chip.", offsetof(nfc_device_stats, rx_bytes));
+  print_device_counter(f, "nfc_timeouts_total", "Commands the chip did not answer in time.", offsetof(nfc_device_stats, timeouts));
+  print_device_counter(f, "nfc_aborts_total", "Commands aborted by the application.", offsetof(nfc_device_stats, aborts));
+
+  print_family(f, "nfc_chip_status_errors_total", "counter", "Commands which ended with a chip error status.");
+  for (size_t n = 0; n < szDevices; n++) {
+    for (size_t s = 1; s < NFC_STATS_STATUS_CODES; s++) {
+      if (stats[n].status_errors[s]) {
+        fputs("nfc_chip_status_errors_total{", f);
+        print_device_labels(f, n);
+        fprintf(f, ",status=\"0x%02x\"} %" PRIu64 "\n", (unsigned int) s, stats[n].status_errors[s]);
+      }
+    }
+  }
+
+  // Only the commands used at least once are exported, to keep the series count low
+  print_family(f, "nfc_command_errors_total", "counter", "Commands which failed, on the bus or reported by the chip.");
+  for (size_t n = 0; n < szDevices; n++) {
+    for (size_t c = 0; c < NFC_STATS_COMMANDS; c++) {
+      const nfc_command_stats *pcs = &stats[n].commands[c];
+      if (pcs->count) {
+        fputs("nfc_command_errors_total{", f);
+        print_device_labels(f, n);
+        fputc(',', f);
+        print_label(f, "command", pcs->name);
+        fprintf(f, "} %" PRIu64 "\n", pcs->errors);
+      }
+    }
+  }
+
+  print_family(f, "nfc_command_duration_seconds", "histogram", "Time from sending a command to the chip to its complete response.");
+  for (size_t n = 0; n < szDevices; n++) {
+    for (size_t c = 0; c < NFC_STATS_COMMANDS; c++) {
+      const nfc_command_stats *pcs = &stats[n].commands[c];
+      if (!pcs->count)
+        continue;
+      // Prometheus buckets are cumulative, libnfc ones are not
+      uint64_t ui64Cumulative = 0;
+      for (size_t b = 0; b < NFC_STATS_LATENCY_BUCKETS; b++) {
+        ui64Cumulative += pcs->latency_buckets[b];
+        fputs("nfc_command_duration_seconds_bucket{", f);
+        print_device_labels(f, n);
+        fputc(',', f);
+        print_label(f, "command", pcs->name);
+        if (b < NFC_STATS_LATENCY_BUCKETS - 1) {
+          fprintf(f, ",le=\"%g\"} %" PRIu64 "\n", (double)((uint64_t) NFC_STATS_LATENCY_BASE_US << b) / 1e6, ui64Cumulative);
+        } else {
+          fprintf(f, ",le=\"+Inf\"} %" PRIu64 "\n", ui64Cumulative);
+        }
+      }
+      fputs("nfc_command_duration_seconds_sum{", f);
+      print_device_labels(f, n);
+      fputc(',', f);
+      print_label(f, "command", pcs->name);
+      fprintf(f, "} %g\n", (double) pcs->latency_us_total / 1e6);
+      fputs("nfc_command_duration_seconds_count{", f);
+      print_device_labels(f, n);
+      fputc(',', f);
+      print_label(f, "command", pcs->name);
+      fprintf(f, "} %" PRIu64 "\n", pcs->count);
+    }
+  }
+}
+
+static bool
+export_stats(const char *pcFile)
+{
+  for (size_t n = 0; n < szDevices; n++) {
+    if (nfc_device_get_stats(pnds[n], &stats[n]) < 0) {
+      nfc_perror(pnds[n], "nfc_device_get_stats");
+      return false;
+    }
+  }
+  if (!pcFile) {
+    print_stats(stdout);
+    fflush(stdout);
+    return true;
+  }
+
+  // Write aside then rename, so that a collector never reads a partial export
+  char acTmp[FILENAME_MAX];
+  snprintf(acTmp, sizeof(acTmp), "%s.tmp", pcFile);
+  FILE *f = fopen(acTmp, "w");
+  if (!f) {
+    ERR("Impossible d'ouvrir le fichier: %s", acTmp);
+    return false;
+  }
+  print_stats(f);
+  if ((fclose(f) != 0) || (rename(acTmp, pcFile) != 0)) {
+    ERR("Impossible d'écrire dans le fichier: %s", pcFile);
+    remove(acTmp);
+    return false;
+  }
+  return true;
+}
+
+static void
+poll_targets(const int iPolls)
+{
+  const nfc_modulation nm = {
+    .nmt = NMT_ISO14443A,
+    .nbr = NBR_106,
+  };
+  nfc_target ant[MAX_TARGET_COUNT];
+
+  for (int i = 0; i < iPolls; i++) {
+    for (size_t n = 0; n < szDevices; n++) {
+      nfc_initiator_list_passive_targets(pnds[n], nm, ant, MAX_TARGET_COUNT);
+    }
+  }
+}
+
+int
+main(int argc, const char *argv[])
+{
+  int iPolls = 0;
+  int iInterval = 0;
+  const char *pcFile = NULL;
+  nfc_context *context;
+
+  // Get commandline options
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv);
+      exit(EXIT_SUCCESS);
+    } else if ((0 == strcmp(argv[arg], "-p")) && (arg + 1 < argc)) {
+      iPolls = atoi(argv[++arg]);
+    } else if ((0 == strcmp(argv[arg], "-i")) && (arg + 1 < argc)) {
+      iInterval = atoi(argv[++arg]);
+    } else if ((0 == strcmp(argv[arg], "-o")) && (arg + 1 < argc)) {
+      pcFile = argv[++arg];
+    } else {
+      ERR("%s n'est pas une option valide.", argv[arg]);
+      print_usage(argv);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Impossible d'initer libnfc (malloc)\n");
+    exit(EXIT_FAILURE);
+  }
+
+  nfc_connstring connstrings[MAX_DEVICE_COUNT];
+  size_t szDeviceFound = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+
+  for (size_t i = 0; i < szDeviceFound; i++) {
+    nfc_device *pnd = nfc_open(context, connstrings[i]);
+    if (pnd == NULL) {
+      ERR("nfc_open a échoué pour %s", connstrings[i]);
+      continue;
+    }
+    if (nfc_initiator_init(pnd) < 0) {
+      nfc_perror(pnd, "nfc_initiator_init");
+      nfc_close(pnd);
+      continue;
+    }
+    // A poll must not wait for a tag
+    nfc_device_set_property_bool(pnd, NP_INFINITE_SELECT, false);
+    pnds[szDevices++] = pnd;
+  }
+  if (szDevices == 0) {
+    ERR("Pas de support NFC trouvé.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  int res = EXIT_SUCCESS;
+  do {
+    poll_targets(iPolls);
+    if (!export_stats(pcFile)) {
+      res = EXIT_FAILURE;
+      break;
+    }
+    if (iInterval > 0)
+      sleep(iInterval);
+  } while (iInterval > 0);
+
+  for (size_t n = 0; n < szDevices; n++) {
+    nfc_close(pnds[n]);
+  }
+  nfc_exit(context);
+  exit(res);
+}
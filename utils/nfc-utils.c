@@ -38,6 +38,7 @@
  * @brief Provide some examples shared functions like print, parity calculation, options parsing.
  */
 #include <nfc/nfc.h>
+#include <nfc/nfc-emulation.h>
 #include <err.h>
 
 #include "nfc-utils.h"
@@ -127,3 +128,47 @@ print_nfc_target(const nfc_target *pnt, bool verbose)
   printf("%s", s);
   nfc_free(s);
 }
+
+void
+print_emulation_report(const struct nfc_emulation_dispatcher *dispatcher)
+{
+  size_t first = (dispatcher->log_count > NFC_EMULATION_LOG_SIZE) ? dispatcher->log_count - NFC_EMULATION_LOG_SIZE : 0;
+
+  printf("Last %lu commands (of %lu):\n", (unsigned long)(dispatcher->log_count - first), (unsigned long) dispatcher->log_count);
+  for (size_t n = first; n < dispatcher->log_count; n++) {
+    const struct nfc_emulation_log_entry *entry = &dispatcher->log[n % NFC_EMULATION_LOG_SIZE];
+    printf("  ");
+    for (size_t i = 0; i < sizeof(entry->header); i++) {
+      if (i < entry->header_len)
+        printf("%02x ", entry->header[i]);
+      else
+        printf("   ");
+    }
+    if (entry->result < 0)
+      printf(" -> error %d", entry->result);
+    else if (entry->result >= 2)
+      printf(" -> %02x %02x (%d bytes)", entry->trailer[0], entry->trailer[1], entry->result);
+    else
+      printf(" -> (%d bytes)", entry->result);
+    printf(" in %lu us", (unsigned long) entry->latency_us);
+    if (dispatcher->fwt_us)
+      printf(" (%lu%% of FWT)", (unsigned long)((uint64_t) entry->latency_us * 100 / dispatcher->fwt_us));
+    printf("\n");
+  }
+
+  if (dispatcher->fwt_us)
+    printf("FWT advertised by the ATS: %lu us, exceeded by %lu responses\n", (unsigned long) dispatcher->fwt_us, (unsigned long) dispatcher->fwt_overruns);
+
+  printf("Response latency per command:\n");
+  printf("  %-9s %8s %10s %10s %10s\n", "Command", "Count", "Min (us)", "Avg (us)", "Max (us)");
+  for (size_t n = 0; n < dispatcher->command_count; n++) {
+    const struct nfc_emulation_command *command = &dispatcher->commands[n];
+    if (command->count == 0)
+      continue;
+    char key[3 * NFC_EMULATION_KEY_MAX_LEN + 1] = "";
+    for (size_t i = 0; i < command->key_len; i++)
+      snprintf(key + 3 * i, sizeof(key) - 3 * i, "%02x ", command->key[i]);
+    printf("  %-9s %8lu %10lu %10lu %10lu\n", key, (unsigned long) command->count, (unsigned long) command->min_us,
+           (unsigned long)(command->total_us / command->count), (unsigned long) command->max_us);
+  }
+}
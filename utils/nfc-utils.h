@@ -101,4 +101,7 @@ void    print_hex_par(const uint8_t *pbtData, const size_t szBits, const uint8_t
 
 void    print_nfc_target(const nfc_target *pnt, bool verbose);
 
+struct nfc_emulation_dispatcher;
+void    print_emulation_report(const struct nfc_emulation_dispatcher *dispatcher);
+
 #endif
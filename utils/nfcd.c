@@ -0,0 +1,783 @@
+/*-
+ * Free/Libre Near Field Communication (NFC) library
+ *
+ * Libnfc historical contributors:
+ * Copyright (C) 2009      Roel Verdult
+ * Copyright (C) 2009-2013 Romuald Conty
+ * Copyright (C) 2010-2012 Romain Tartière
+ * Copyright (C) 2010-2013 Philippe Teuwen
+ * Copyright (C) 2012-2013 Ludovic Rousseau
+ * See AUTHORS file for a more comprehensive list of contributors.
+ * Additional contributors of this file:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *  1) Redistributions of source code must retain the above copyright notice,
+ *  this list of conditions and the following disclaimer.
+ *  2 )Redistributions in binary form must reproduce the above copyright
+ *  notice, this list of conditions and the following disclaimer in the
+ *  documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Note that this license only applies on the examples, NFC library itself is under LGPL
+ *
+ */
+
+/**
+ * @file nfcd.c
+ * @brief Broker daemon sharing NFC devices between several applications
+ *
+ * nfcd opens the readers once and serves them on a Unix socket to clients
+ * using the "broker" driver. Each device has its own worker thread and
+ * command queue: while a command runs on the chip, the main thread keeps
+ * reading and scheduling the next requests of every client, so the reader
+ * starts the next command as soon as the previous one completes.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <nfc/nfc.h>
+
+#include "nfc-utils.h"
+#include "nfc-internal.h"
+#include "chips/pn53x.h"
+#include "drivers/broker.h"
+
+#define MAX_DEVICE_COUNT 16
+#define MAX_CLIENT_COUNT 64
+
+// A lease holder may stay idle this long (ms) while other clients are waiting
+#define NFCD_DEFAULT_IDLE_TIMEOUT 200
+// A lease holder may keep the device this long (ms) while other clients are waiting
+#define NFCD_DEFAULT_LEASE_TIMEOUT 2000
+// Largest reply a client can ask for (MI chaining can exceed a single frame)
+#define NFCD_MAX_RX_LEN 65536
+
+#ifndef MSG_NOSIGNAL
+#  define MSG_NOSIGNAL 0
+#endif
+
+struct nfcd_client;
+
+struct nfcd_request {
+  struct nfcd_request *next;
+  struct nfcd_client *client;
+  struct broker_header header;
+  uint8_t payload[PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+};
+
+struct nfcd_device {
+  nfc_device *pnd;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  // Pending requests, in arrival order
+  struct nfcd_request *queue;
+  // Lease holder
+  struct nfcd_client *owner;
+  struct timeval lease_start;
+  struct timeval last_activity;
+  // Client whose command is on the chip right now
+  struct nfcd_client *running;
+  // Last client that drove the chip
+  uint64_t last_user;
+  // Grant counter used to serve the least recently served client first
+  uint64_t ticket;
+  unsigned int clients;
+  bool idle_pending;
+  bool quit;
+};
+
+struct nfcd_client {
+  uint64_t id;
+  int fd;
+  struct nfcd_device *device;
+  uint8_t priority;
+  uint64_t last_served;
+  unsigned int refcount;
+  pthread_mutex_t write_lock;
+  // Partially received request
+  uint8_t abtRx[sizeof(struct broker_header) + PN53x_EXTENDED_FRAME__DATA_MAX_LEN];
+  size_t szRx;
+};
+
+static struct nfcd_device devices[MAX_DEVICE_COUNT];
+static size_t szDevices = 0;
+static struct nfcd_client *clients[MAX_CLIENT_COUNT];
+static size_t szClients = 0;
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t next_client_id = 1;
+
+static int idle_timeout = NFCD_DEFAULT_IDLE_TIMEOUT;
+static int lease_timeout = NFCD_DEFAULT_LEASE_TIMEOUT;
+static bool verbose = false;
+static volatile sig_atomic_t quit = 0;
+
+static void
+stop_handler(int sig)
+{
+  (void) sig;
+  quit = 1;
+}
+
+static long
+elapsed_ms(const struct timeval *since)
+{
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_usec - since->tv_usec) / 1000;
+}
+
+static void
+client_ref(struct nfcd_client *client)
+{
+  pthread_mutex_lock(&clients_lock);
+  client->refcount++;
+  pthread_mutex_unlock(&clients_lock);
+}
+
+static void
+client_unref(struct nfcd_client *client)
+{
+  pthread_mutex_lock(&clients_lock);
+  bool last = (--client->refcount == 0);
+  pthread_mutex_unlock(&clients_lock);
+  if (last) {
+    close(client->fd);
+    pthread_mutex_destroy(&client->write_lock);
+    free(client);
+  }
+}
+
+static void
+client_reply(struct nfcd_client *client, const struct broker_header *request, uint8_t flags, int result, uint8_t status, const uint8_t *payload, size_t len)
+{
+  struct broker_header reply;
+  memset(&reply, 0, sizeof(reply));
+  reply.command = request->command;
+  reply.device = request->device;
+  reply.flags = flags;
+  reply.status = status;
+  reply.result = result;
+  reply.length = len;
+
+  pthread_mutex_lock(&client->write_lock);
+  // A client which stopped reading is dropped by SO_SNDTIMEO, errors are
+  // reported by its next read anyway
+  if (send(client->fd, &reply, sizeof(reply), MSG_NOSIGNAL) == sizeof(reply)) {
+    size_t szSent = 0;
+    while (szSent < len) {
+      ssize_t res = send(client->fd, payload + szSent, len - szSent, MSG_NOSIGNAL);
+      if (res <= 0)
+        break;
+      szSent += res;
+    }
+  }
+  pthread_mutex_unlock(&client->write_lock);
+}
+
+static bool
+device_has_waiters(const struct nfcd_device *dev)
+{
+  for (const struct nfcd_request *req = dev->queue; req; req = req->next) {
+    if ((req->header.command == BROKER_ACQUIRE) && (req->client != dev->owner))
+      return true;
+  }
+  return false;
+}
+
+static struct nfcd_request *
+device_unlink(struct nfcd_request **pp)
+{
+  struct nfcd_request *req = *pp;
+  *pp = req->next;
+  req->next = NULL;
+  return req;
+}
+
+/*
+ * Pick the next request to process, device lock held.
+ * Requests that do not wait for the lease (commands of the lease holder,
+ * releases, commands of revoked clients) go first, in arrival order. The
+ * lease goes to the waiting client with the highest priority, then to the
+ * least recently served one.
+ */
+static struct nfcd_request *
+device_schedule(struct nfcd_device *dev)
+{
+  struct nfcd_request **best = NULL;
+
+  for (struct nfcd_request **pp = &dev->queue; *pp; pp = &(*pp)->next) {
+    const struct nfcd_request *req = *pp;
+    if ((req->header.command != BROKER_ACQUIRE) || (req->client == dev->owner)) {
+      return device_unlink(pp);
+    }
+    if (dev->owner)
+      continue;
+    if ((!best) ||
+        (req->client->priority > (*best)->client->priority) ||
+        ((req->client->priority == (*best)->client->priority) && (req->client->last_served < (*best)->client->last_served))) {
+      best = pp;
+    }
+  }
+  return best ? device_unlink(best) : NULL;
+}
+
+static void
+device_revoke(struct nfcd_device *dev)
+{
+  if (verbose)
+    printf("%s: lease of client #%llu revoked\n", nfc_device_get_name(dev->pnd), (unsigned long long) dev->owner->id);
+  dev->owner = NULL;
+}
+
+static void
+device_run(struct nfcd_device *dev, struct nfcd_request *req, uint8_t *abtRx)
+{
+  struct nfcd_client *client = req->client;
+  uint8_t flags = 0;
+  int res = 0;
+  uint8_t status = 0;
+  size_t szRx = 0;
+
+  switch (req->header.command) {
+    case BROKER_ACQUIRE:
+      if (dev->owner != client) {
+        dev->owner = client;
+        client->last_served = ++dev->ticket;
+        gettimeofday(&dev->lease_start, NULL);
+        dev->last_activity = dev->lease_start;
+      }
+      if (dev->last_user && (dev->last_user != client->id)) {
+        // The targets of the previous client are not this one's
+        pthread_mutex_unlock(&dev->lock);
+        const uint8_t abtCmd[] = { InRelease, 0x00 };
+        pn53x_transceive(dev->pnd, abtCmd, sizeof(abtCmd), NULL, 0, -1);
+        pthread_mutex_lock(&dev->lock);
+        dev->last_user = client->id;
+        flags |= BROKER_FLAG_PREEMPTED;
+      }
+      pthread_mutex_unlock(&dev->lock);
+      client_reply(client, &req->header, flags, NFC_SUCCESS, 0, NULL, 0);
+      pthread_mutex_lock(&dev->lock);
+      break;
+
+    case BROKER_RELEASE:
+      if (dev->owner == client)
+        dev->owner = NULL;
+      break;
+
+    case BROKER_TRANSCEIVE:
+      if (dev->owner != client) {
+        // Lease was revoked, its targets are released once the device changes hands
+        pthread_mutex_unlock(&dev->lock);
+        client_reply(client, &req->header, BROKER_FLAG_REVOKED, NFC_SUCCESS, 0, NULL, 0);
+        pthread_mutex_lock(&dev->lock);
+        break;
+      }
+      if ((req->header.length == 0) || (req->payload[0] == PowerDown)) {
+        // Power management stays here: the driver must know the chip sleeps
+        res = NFC_EDEVNOTSUPP;
+      } else {
+        dev->running = client;
+        pthread_mutex_unlock(&dev->lock);
+        CHIP_DATA(dev->pnd)->last_status_byte = 0;
+        res = pn53x_transceive(dev->pnd, req->payload, req->header.length, abtRx, MIN(req->header.rx_len, NFCD_MAX_RX_LEN), req->header.timeout);
+        if (res < 0) {
+          status = CHIP_DATA(dev->pnd)->last_status_byte;
+        } else {
+          // Without room for the reply, pn53x_transceive() used its own buffer
+          szRx = req->header.rx_len ? (size_t) res : 0;
+          res = NFC_SUCCESS;
+        }
+        pthread_mutex_lock(&dev->lock);
+        dev->running = NULL;
+        dev->last_user = client->id;
+        gettimeofday(&dev->last_activity, NULL);
+      }
+      pthread_mutex_unlock(&dev->lock);
+      client_reply(client, &req->header, 0, res, status, abtRx, szRx);
+      pthread_mutex_lock(&dev->lock);
+      break;
+  }
+}
+
+static void *
+device_thread(void *arg)
+{
+  struct nfcd_device *dev = arg;
+  uint8_t *abtRx = malloc(NFCD_MAX_RX_LEN);
+  if (!abtRx) {
+    ERR("malloc");
+    return NULL;
+  }
+
+  pthread_mutex_lock(&dev->lock);
+  while (!dev->quit) {
+    if (dev->owner && (elapsed_ms(&dev->lease_start) >= lease_timeout) && device_has_waiters(dev)) {
+      device_revoke(dev);
+    }
+
+    struct nfcd_request *req = device_schedule(dev);
+    if (req) {
+      device_run(dev, req, abtRx);
+      client_unref(req->client);
+      free(req);
+      continue;
+    }
+
+    if (dev->idle_pending && !dev->queue) {
+      // Last client is gone: switch the RF field off like nfc_close() would
+      dev->idle_pending = false;
+      dev->last_user = 0;
+      pthread_mutex_unlock(&dev->lock);
+      nfc_idle(dev->pnd);
+      pthread_mutex_lock(&dev->lock);
+      continue;
+    }
+
+    if (dev->owner && device_has_waiters(dev)) {
+      // Others are waiting: wake up when the lease holder runs out of time
+      long remaining = MIN(idle_timeout - elapsed_ms(&dev->last_activity), lease_timeout - elapsed_ms(&dev->lease_start));
+      if (remaining <= 0) {
+        device_revoke(dev);
+        continue;
+      }
+      struct timeval now;
+      struct timespec deadline;
+      gettimeofday(&now, NULL);
+      deadline.tv_sec = now.tv_sec + remaining / 1000;
+      deadline.tv_nsec = (now.tv_usec + (remaining % 1000) * 1000) * 1000;
+      if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&dev->cond, &dev->lock, &deadline);
+    } else {
+      pthread_cond_wait(&dev->cond, &dev->lock);
+    }
+  }
+  pthread_mutex_unlock(&dev->lock);
+  free(abtRx);
+  return NULL;
+}
+
+static void
+device_abort(struct nfcd_device *dev, struct nfcd_client *client)
+{
+  struct nfcd_request *aborted = NULL;
+  struct nfcd_request **tail = &aborted;
+
+  pthread_mutex_lock(&dev->lock);
+  if (dev->running == client) {
+    // The worker replies once the driver gives up
+    nfc_abort_command(dev->pnd);
+  } else {
+    for (struct nfcd_request **pp = &dev->queue; *pp;) {
+      if (((*pp)->client == client) && ((*pp)->header.command != BROKER_RELEASE)) {
+        *tail = device_unlink(pp);
+        tail = &(*tail)->next;
+      } else {
+        pp = &(*pp)->next;
+      }
+    }
+  }
+  pthread_mutex_unlock(&dev->lock);
+
+  // Replies may block on a stalled client: send them without the device lock
+  while (aborted) {
+    struct nfcd_request *req = aborted;
+    aborted = req->next;
+    client_reply(client, &req->header, 0, NFC_EOPABORTED, 0, NULL, 0);
+    client_unref(client);
+    free(req);
+  }
+}
+
+static void
+client_detach(struct nfcd_client *client)
+{
+  struct nfcd_device *dev = client->device;
+  if (!dev)
+    return;
+
+  pthread_mutex_lock(&dev->lock);
+  for (struct nfcd_request **pp = &dev->queue; *pp;) {
+    if ((*pp)->client == client) {
+      struct nfcd_request *req = device_unlink(pp);
+      client_unref(client);
+      free(req);
+    } else {
+      pp = &(*pp)->next;
+    }
+  }
+  if (dev->owner == client)
+    dev->owner = NULL;
+  if (dev->running == client)
+    nfc_abort_command(dev->pnd);
+  if (--dev->clients == 0)
+    dev->idle_pending = true;
+  pthread_cond_signal(&dev->cond);
+  pthread_mutex_unlock(&dev->lock);
+  client->device = NULL;
+}
+
+static void
+client_list(struct nfcd_client *client, const struct broker_header *request)
+{
+  uint8_t abtNames[MAX_DEVICE_COUNT * DEVICE_NAME_LENGTH];
+  size_t szNames = 0;
+
+  for (size_t i = 0; i < szDevices; i++) {
+    const char *name = nfc_device_get_name(devices[i].pnd);
+    size_t len = strlen(name) + 1;
+    memcpy(abtNames + szNames, name, len);
+    szNames += len;
+  }
+  struct broker_header reply_to = *request;
+  reply_to.device = szDevices;
+  client_reply(client, &reply_to, 0, NFC_SUCCESS, 0, abtNames, szNames);
+}
+
+static void
+client_attach(struct nfcd_client *client, const struct broker_header *request)
+{
+  if ((request->device >= szDevices) || client->device) {
+    client_reply(client, request, 0, NFC_EINVARG, 0, NULL, 0);
+    return;
+  }
+  struct nfcd_device *dev = &devices[request->device];
+  client->device = dev;
+  client->priority = MIN(request->priority, BROKER_PRIORITY_MAX);
+
+  pthread_mutex_lock(&dev->lock);
+  dev->clients++;
+  dev->idle_pending = false;
+  pthread_mutex_unlock(&dev->lock);
+
+  const char *name = nfc_device_get_name(dev->pnd);
+  struct broker_header reply;
+  memset(&reply, 0, sizeof(reply));
+  reply.command = BROKER_ATTACH;
+  reply.device = request->device;
+  reply.timer_correction = CHIP_DATA(dev->pnd)->timer_correction;
+  reply.length = strlen(name);
+  pthread_mutex_lock(&client->write_lock);
+  if (send(client->fd, &reply, sizeof(reply), MSG_NOSIGNAL) == sizeof(reply))
+    send(client->fd, name, reply.length, MSG_NOSIGNAL);
+  pthread_mutex_unlock(&client->write_lock);
+
+  if (verbose)
+    printf("Client #%llu attached to %s with priority %u\n", (unsigned long long) client->id, name, client->priority);
+}
+
+static void
+client_enqueue(struct nfcd_client *client, const struct broker_header *header, const uint8_t *payload)
+{
+  struct nfcd_device *dev = client->device;
+  if (!dev) {
+    if (header->command != BROKER_RELEASE)
+      client_reply(client, header, 0, NFC_EINVARG, 0, NULL, 0);
+    return;
+  }
+  struct nfcd_request *req = malloc(sizeof(*req));
+  if (!req) {
+    client_reply(client, header, 0, NFC_ESOFT, 0, NULL, 0);
+    return;
+  }
+  req->next = NULL;
+  req->client = client;
+  req->header = *header;
+  memcpy(req->payload, payload, header->length);
+  client_ref(client);
+
+  pthread_mutex_lock(&dev->lock);
+  struct nfcd_request **pp = &dev->queue;
+  while (*pp)
+    pp = &(*pp)->next;
+  *pp = req;
+  pthread_cond_signal(&dev->cond);
+  pthread_mutex_unlock(&dev->lock);
+}
+
+/*
+ * Read whatever the client sent and dispatch every complete request.
+ * Returns false when the connection has to be dropped.
+ */
+static bool
+client_read(struct nfcd_client *client)
+{
+  ssize_t res = recv(client->fd, client->abtRx + client->szRx, sizeof(client->abtRx) - client->szRx, MSG_DONTWAIT);
+  if (res <= 0) {
+    return (res < 0) && ((errno == EAGAIN) || (errno == EINTR));
+  }
+  client->szRx += res;
+
+  while (client->szRx >= sizeof(struct broker_header)) {
+    struct broker_header header;
+    memcpy(&header, client->abtRx, sizeof(header));
+    if (header.length > PN53x_EXTENDED_FRAME__DATA_MAX_LEN) {
+      ERR("Client #%llu sent an oversized request", (unsigned long long) client->id);
+      return false;
+    }
+    const size_t szMsg = sizeof(header) + header.length;
+    if (client->szRx < szMsg)
+      break;
+    const uint8_t *payload = client->abtRx + sizeof(header);
+
+    switch (header.command) {
+      case BROKER_LIST:
+        client_list(client, &header);
+        break;
+      case BROKER_ATTACH:
+        client_attach(client, &header);
+        break;
+      case BROKER_ACQUIRE:
+      case BROKER_RELEASE:
+      case BROKER_TRANSCEIVE:
+        client_enqueue(client, &header, payload);
+        break;
+      case BROKER_ABORT:
+        if (client->device)
+          device_abort(client->device, client);
+        break;
+      default:
+        ERR("Client #%llu sent an unknown request (%u)", (unsigned long long) client->id, header.command);
+        return false;
+    }
+    memmove(client->abtRx, client->abtRx + szMsg, client->szRx - szMsg);
+    client->szRx -= szMsg;
+  }
+  return true;
+}
+
+static void
+client_accept(int listen_fd)
+{
+  int fd = accept(listen_fd, NULL, NULL);
+  if (fd < 0)
+    return;
+  if (szClients == MAX_CLIENT_COUNT) {
+    ERR("Too many clients, connection refused");
+    close(fd);
+    return;
+  }
+  struct nfcd_client *client = malloc(sizeof(*client));
+  if (!client) {
+    close(fd);
+    return;
+  }
+  // Replies are written by the device workers: do not let a stuck client block a reader
+  struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  client->id = next_client_id++;
+  client->fd = fd;
+  client->device = NULL;
+  client->priority = BROKER_PRIORITY_DEFAULT;
+  client->last_served = 0;
+  client->refcount = 1;
+  client->szRx = 0;
+  pthread_mutex_init(&client->write_lock, NULL);
+  clients[szClients++] = client;
+}
+
+static void
+client_drop(size_t i)
+{
+  struct nfcd_client *client = clients[i];
+  if (verbose)
+    printf("Client #%llu disconnected\n", (unsigned long long) client->id);
+  client_detach(client);
+  clients[i] = clients[--szClients];
+  client_unref(client);
+}
+
+static int
+listen_on(const char *path)
+{
+  struct sockaddr_un sa;
+  if (strlen(path) >= sizeof(sa.sun_path)) {
+    ERR("Socket path is too long: %s", path);
+    return -1;
+  }
+  memset(&sa, 0, sizeof(sa));
+  sa.sun_family = AF_UNIX;
+  strcpy(sa.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+  unlink(path);
+  if ((bind(fd, (struct sockaddr *) &sa, sizeof(sa)) < 0) || (listen(fd, MAX_CLIENT_COUNT) < 0)) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void
+print_usage(const char *progname)
+{
+  printf("usage: %s [-v] [-s socket] [-i ms] [-l ms] [connstring ...]\n", progname);
+  printf("  -v\t\t verbose display\n");
+  printf("  -s socket\t Unix socket to listen on (default: %s)\n", BROKER_DEFAULT_SOCKET);
+  printf("  -i ms\t\t idle time after which a lease is revoked if other clients wait (default: %d)\n", NFCD_DEFAULT_IDLE_TIMEOUT);
+  printf("  -l ms\t\t hold time after which a lease is revoked if other clients wait (default: %d)\n", NFCD_DEFAULT_LEASE_TIMEOUT);
+  printf("  connstring\t device to share, all detected devices when omitted\n");
+}
+
+int
+main(int argc, const char *argv[])
+{
+  const char *socket_path = BROKER_DEFAULT_SOCKET;
+  nfc_connstring connstrings[MAX_DEVICE_COUNT];
+  size_t szConnstrings = 0;
+
+  for (int arg = 1; arg < argc; arg++) {
+    if (0 == strcmp(argv[arg], "-h")) {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    } else if (0 == strcmp(argv[arg], "-v")) {
+      verbose = true;
+    } else if ((0 == strcmp(argv[arg], "-s")) && (arg + 1 < argc)) {
+      socket_path = argv[++arg];
+    } else if ((0 == strcmp(argv[arg], "-i")) && (arg + 1 < argc)) {
+      idle_timeout = atoi(argv[++arg]);
+    } else if ((0 == strcmp(argv[arg], "-l")) && (arg + 1 < argc)) {
+      lease_timeout = atoi(argv[++arg]);
+    } else if ((argv[arg][0] != '-') && (szConnstrings < MAX_DEVICE_COUNT)) {
+      strncpy(connstrings[szConnstrings], argv[arg], sizeof(nfc_connstring) - 1);
+      connstrings[szConnstrings][sizeof(nfc_connstring) - 1] = '\0';
+      szConnstrings++;
+    } else {
+      ERR("%s is not supported option.", argv[arg]);
+      print_usage(argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  nfc_context *context;
+  nfc_init(&context);
+  if (context == NULL) {
+    ERR("Unable to init libnfc (malloc)");
+    exit(EXIT_FAILURE);
+  }
+
+  if (szConnstrings == 0) {
+    szConnstrings = nfc_list_devices(context, connstrings, MAX_DEVICE_COUNT);
+  }
+  for (size_t i = 0; i < szConnstrings; i++) {
+    // Never serve devices of another broker
+    if (strncmp(connstrings[i], "broker:", strlen("broker:")) == 0)
+      continue;
+    nfc_device *pnd = nfc_open(context, connstrings[i]);
+    if (pnd == NULL) {
+      ERR("Unable to open NFC device: %s", connstrings[i]);
+      continue;
+    }
+    struct nfcd_device *dev = &devices[szDevices];
+    memset(dev, 0, sizeof(*dev));
+    dev->pnd = pnd;
+    pthread_mutex_init(&dev->lock, NULL);
+    pthread_cond_init(&dev->cond, NULL);
+    printf("Sharing device #%u: %s\n", (unsigned int) szDevices, nfc_device_get_name(pnd));
+    szDevices++;
+  }
+  if (szDevices == 0) {
+    ERR("No NFC device to share.");
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  int listen_fd = listen_on(socket_path);
+  if (listen_fd < 0) {
+    for (size_t i = 0; i < szDevices; i++)
+      nfc_close(devices[i].pnd);
+    nfc_exit(context);
+    exit(EXIT_FAILURE);
+  }
+
+  signal(SIGINT, stop_handler);
+  signal(SIGTERM, stop_handler);
+  signal(SIGPIPE, SIG_IGN);
+
+  for (size_t i = 0; i < szDevices; i++) {
+    pthread_create(&devices[i].thread, NULL, device_thread, &devices[i]);
+  }
+  printf("Listening on %s\n", socket_path);
+
+  while (!quit) {
+    struct pollfd pfd[MAX_CLIENT_COUNT + 1];
+    pfd[0].fd = listen_fd;
+    pfd[0].events = POLLIN;
+    for (size_t i = 0; i < szClients; i++) {
+      pfd[i + 1].fd = clients[i]->fd;
+      pfd[i + 1].events = POLLIN;
+    }
+    const size_t szPolled = szClients;
+    if (poll(pfd, szPolled + 1, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      perror("poll");
+      break;
+    }
+    // Walk backwards: dropping a client moves the last one into its slot
+    for (size_t i = szPolled; i > 0; i--) {
+      if (pfd[i].revents && !client_read(clients[i - 1])) {
+        client_drop(i - 1);
+      }
+    }
+    if (pfd[0].revents & POLLIN) {
+      client_accept(listen_fd);
+    }
+  }
+
+  close(listen_fd);
+  unlink(socket_path);
+  while (szClients) {
+    client_drop(szClients - 1);
+  }
+  for (size_t i = 0; i < szDevices; i++) {
+    pthread_mutex_lock(&devices[i].lock);
+    devices[i].quit = true;
+    pthread_cond_signal(&devices[i].cond);
+    pthread_mutex_unlock(&devices[i].lock);
+    pthread_join(devices[i].thread, NULL);
+    nfc_close(devices[i].pnd);
+    pthread_cond_destroy(&devices[i].cond);
+    pthread_mutex_destroy(&devices[i].lock);
+  }
+  nfc_exit(context);
+  exit(EXIT_SUCCESS);
+}